@@ -57,7 +57,9 @@ export {
   updatePositiveFromNegative,
   exportPositive,
   renderPositive,
-  filmlabPreview
+  filmlabPreview,
+  filmlabProfiles,
+  regenerateRollThumbs
 } from './photos';
 
 // Films
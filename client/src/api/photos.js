@@ -171,3 +171,48 @@ export async function filmlabPreview({ photoId, params, maxWidth = 1400, sourceT
   console.error('[API] filmlabPreview error:', err);
   return { ok: false, error: err && (err.error || err.message) };
 }
+
+/**
+ * Render one photo under several film curve profiles (profile picker)
+ * @param {object} options
+ * @param {number} options.photoId - Photo ID
+ * @param {object} options.params - FilmLab parameters
+ * @param {string[]} [options.profiles] - Profile keys (default: all)
+ * @param {string} options.sourceType - Source type: 'original' | 'negative' | 'positive'
+ * @returns {Promise<{width: number, height: number, profiles: Array<{key: string, name: string, image: string}>}>}
+ */
+export async function filmlabProfiles({ photoId, params, profiles, sourceType = 'original' }) {
+  const apiBase = getApiBase();
+  const res = await fetch(`${apiBase}/api/filmlab/profiles`, {
+    method: 'POST',
+    headers: { 'Content-Type': 'application/json' },
+    body: JSON.stringify({ photoId, params, profiles, sourceType })
+  });
+  if (!res.ok) {
+    const err = await res.json().catch(() => ({}));
+    throw new Error(err.error || 'Profile render failed');
+  }
+  return res.json();
+}
+
+/**
+ * Regenerate positive thumbnails for a whole roll
+ * @param {number} rollId - Roll ID
+ * @param {object} [options]
+ * @param {object} [options.params] - FilmLab parameters (default: roll preset)
+ * @param {string} [options.sourceType] - Source type: 'original' | 'negative' | 'positive'
+ * @returns {Promise<{ok: boolean, updated: number, skipped: number}>}
+ */
+export async function regenerateRollThumbs(rollId, { params, sourceType = 'original' } = {}) {
+  const apiBase = getApiBase();
+  const res = await fetch(`${apiBase}/api/filmlab/roll-thumbs`, {
+    method: 'POST',
+    headers: { 'Content-Type': 'application/json' },
+    body: JSON.stringify({ rollId, params, sourceType })
+  });
+  if (!res.ok) {
+    const err = await res.json().catch(() => ({}));
+    throw new Error(err.error || 'Thumbnail regeneration failed');
+  }
+  return res.json();
+}
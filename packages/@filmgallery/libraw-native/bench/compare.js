@@ -0,0 +1,161 @@
+/**
+ * @filmgallery/libraw-native - Benchmark Comparison
+ *
+ * Compares two bench/run.js reports, or runs the suite against two addon
+ * builds back to back and compares those.
+ *
+ * Usage:
+ *   node bench/compare.js <base.json> <head.json> [--threshold 5] [--fail-on-regression]
+ *   node bench/compare.js --base-addon <a.node> --head-addon <b.node> [run.js options...]
+ *
+ * A row is flagged as a regression when throughput drops, or p95 latency or
+ * peak RSS grows, by more than the threshold (percent).
+ */
+
+'use strict';
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { spawnSync } = require('child_process');
+
+function parseArgs(argv) {
+    const options = { files: [], threshold: 5, failOnRegression: false, baseAddon: null, headAddon: null, runArgs: [] };
+    for (let i = 0; i < argv.length; i++) {
+        const arg = argv[i];
+        switch (arg) {
+            case '--threshold': options.threshold = parseFloat(argv[++i]); break;
+            case '--fail-on-regression': options.failOnRegression = true; break;
+            case '--base-addon': options.baseAddon = path.resolve(argv[++i]); break;
+            case '--head-addon': options.headAddon = path.resolve(argv[++i]); break;
+            default:
+                if (arg.startsWith('--')) {
+                    // Forwarded to run.js (with its value, if any)
+                    options.runArgs.push(arg);
+                    if (i + 1 < argv.length && !argv[i + 1].startsWith('--')) options.runArgs.push(argv[++i]);
+                } else {
+                    options.files.push(path.resolve(arg));
+                }
+        }
+    }
+    return options;
+}
+
+/**
+ * Run the suite in a child process so each build gets a fresh addon load
+ */
+function runSuite(addon, runArgs, label) {
+    const out = path.join(os.tmpdir(), `filmgallery-bench-${label}-${process.pid}.json`);
+    const args = [path.join(__dirname, 'run.js'), '--addon', addon, '--out', out, ...runArgs];
+    process.stderr.write(`[compare] ${label}: ${addon}\n`);
+    const result = spawnSync(process.execPath, args, { stdio: ['ignore', 'inherit', 'inherit'] });
+    if (result.status !== 0) {
+        throw new Error(`Benchmark run for ${label} failed (exit ${result.status})`);
+    }
+    const report = JSON.parse(fs.readFileSync(out, 'utf8'));
+    fs.unlinkSync(out);
+    return report;
+}
+
+function pct(base, head) {
+    if (!base) return 0;
+    return ((head - base) / base) * 100;
+}
+
+function formatPct(value) {
+    return `${value >= 0 ? '+' : ''}${value.toFixed(1)}%`;
+}
+
+/**
+ * Pair results by scenario/concurrency and compute relative deltas
+ */
+function compareReports(base, head, threshold) {
+    const rows = [];
+    for (const h of head.results) {
+        const b = base.results.find(r => r.scenario === h.scenario && r.concurrency === h.concurrency);
+        if (!b) continue;
+
+        const throughput = pct(b.filesPerSec, h.filesPerSec);
+        const p95 = pct(b.latencyMs.p95, h.latencyMs.p95);
+        const rss = pct(b.peakRssMb, h.peakRssMb);
+        const regressions = [];
+        if (throughput < -threshold) regressions.push('throughput');
+        if (p95 > threshold) regressions.push('p95');
+        if (rss > threshold) regressions.push('rss');
+
+        rows.push({
+            scenario: h.scenario,
+            concurrency: h.concurrency,
+            filesPerSec: { base: b.filesPerSec, head: h.filesPerSec, delta: throughput },
+            p95Ms: { base: b.latencyMs.p95, head: h.latencyMs.p95, delta: p95 },
+            peakRssMb: { base: b.peakRssMb, head: h.peakRssMb, delta: rss },
+            cpuUtilization: { base: b.cpu.utilization, head: h.cpu.utilization },
+            regressions
+        });
+    }
+    return rows;
+}
+
+function printTable(rows) {
+    const header = ['scenario', 'c', 'files/s base', 'head', 'Δ', 'p95 base', 'head', 'Δ', 'rss Δ', ''];
+    const lines = rows.map(r => [
+        r.scenario,
+        String(r.concurrency),
+        r.filesPerSec.base.toFixed(2),
+        r.filesPerSec.head.toFixed(2),
+        formatPct(r.filesPerSec.delta),
+        r.p95Ms.base.toFixed(0),
+        r.p95Ms.head.toFixed(0),
+        formatPct(r.p95Ms.delta),
+        formatPct(r.peakRssMb.delta),
+        r.regressions.length ? `REGRESSION (${r.regressions.join(', ')})` : ''
+    ]);
+    const widths = header.map((h, i) => Math.max(h.length, ...lines.map(l => l[i].length)));
+    const fmt = (cols) => cols.map((c, i) => c.padEnd(widths[i])).join('  ').trimEnd();
+    console.log(fmt(header));
+    console.log(widths.map(w => '-'.repeat(w)).join('  '));
+    lines.forEach(l => console.log(fmt(l)));
+}
+
+function main() {
+    const options = parseArgs(process.argv.slice(2));
+    let base;
+    let head;
+
+    if (options.baseAddon && options.headAddon) {
+        base = runSuite(options.baseAddon, options.runArgs, 'base');
+        head = runSuite(options.headAddon, options.runArgs, 'head');
+    } else if (options.files.length === 2) {
+        base = JSON.parse(fs.readFileSync(options.files[0], 'utf8'));
+        head = JSON.parse(fs.readFileSync(options.files[1], 'utf8'));
+    } else {
+        console.log('Usage:');
+        console.log('  node bench/compare.js <base.json> <head.json> [--threshold 5] [--fail-on-regression]');
+        console.log('  node bench/compare.js --base-addon <a.node> --head-addon <b.node> [run.js options...]');
+        process.exit(1);
+    }
+
+    if (base.meta.cpuModel !== head.meta.cpuModel || base.meta.cpus !== head.meta.cpus) {
+        console.log(`Warning: reports come from different machines (${base.meta.cpuModel} x${base.meta.cpus} vs ${head.meta.cpuModel} x${head.meta.cpus})\n`);
+    }
+
+    const rows = compareReports(base, head, options.threshold);
+    printTable(rows);
+
+    const regressed = rows.filter(r => r.regressions.length > 0);
+    console.log(`\n${rows.length} row(s) compared, ${regressed.length} regression(s) beyond ${options.threshold}%`);
+    if (options.failOnRegression && regressed.length > 0) {
+        process.exit(2);
+    }
+}
+
+module.exports = { compareReports };
+
+if (require.main === module) {
+    try {
+        main();
+    } catch (e) {
+        process.stderr.write(`[compare] ${e.message}\n`);
+        process.exit(1);
+    }
+}
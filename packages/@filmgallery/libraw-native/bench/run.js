@@ -0,0 +1,429 @@
+/**
+ * @filmgallery/libraw-native - End-to-End Throughput Benchmark
+ *
+ * Drives the server RAW/FilmLab paths (raw-decoder decode/extractThumbnail,
+ * render-service, export-queue) at several concurrency levels and reports
+ * files/s, latency percentiles, peak RSS and CPU utilization as JSON. Peak RSS
+ * is sampled per run; processMaxRssMb is the process-lifetime high-water mark.
+ *
+ * Usage: node bench/run.js [options]
+ *   --corpus <dir>          Directory of RAW files (default: synthetic DNGs)
+ *   --synthetic <n>         Number of synthetic DNGs to generate (default 4)
+ *   --size <WxH>            Synthetic DNG size (default 6000x4000)
+ *   --scenarios <list>      decode,thumbnail,render,export (default all)
+ *   --concurrency <list>    Concurrency levels (default 1,2,4)
+ *   --iterations <n>        Passes over the corpus per level (default 1)
+ *   --max-width <px>        Render/export max width (default 4000)
+ *   --addon <path>          Load this libraw_native.node instead of the default build
+ *   --out <file>            Write the JSON report to a file
+ *   --verbose               Keep server log output
+ */
+
+'use strict';
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { performance } = require('perf_hooks');
+
+const SCENARIOS = ['decode', 'thumbnail', 'render', 'export'];
+const RAW_EXTENSIONS = ['.dng', '.cr2', '.cr3', '.nef', '.arw', '.raf', '.rw2', '.orf', '.pef', '.srw', '.3fr', '.fff', '.iiq'];
+
+// Representative negative-scan edit: inversion + film curve + tone, curves, HSL and split tone
+const RENDER_PARAMS = {
+    inverted: true,
+    inversionMode: 'log',
+    filmCurveEnabled: true,
+    filmCurveProfile: 'portra400',
+    exposure: 8,
+    contrast: 12,
+    highlights: -25,
+    shadows: 18,
+    whites: 5,
+    blacks: -5,
+    saturation: 10,
+    curves: {
+        rgb: [{ x: 0, y: 0 }, { x: 64, y: 58 }, { x: 192, y: 200 }, { x: 255, y: 255 }],
+        red: [{ x: 0, y: 0 }, { x: 255, y: 255 }],
+        green: [{ x: 0, y: 0 }, { x: 255, y: 255 }],
+        blue: [{ x: 0, y: 0 }, { x: 128, y: 124 }, { x: 255, y: 255 }]
+    },
+    hslParams: {
+        orange: { hue: 0, saturation: 10, luminance: 5 },
+        blue: { hue: -5, saturation: -10, luminance: 0 }
+    },
+    splitToning: {
+        highlights: { hue: 40, saturation: 15 },
+        shadows: { hue: 210, saturation: 10 },
+        balance: 0
+    }
+};
+
+// ============================================================================
+// Arguments
+// ============================================================================
+
+function parseArgs(argv) {
+    const options = {
+        corpus: null,
+        synthetic: 4,
+        width: 6000,
+        height: 4000,
+        scenarios: SCENARIOS.slice(),
+        concurrency: [1, 2, 4],
+        iterations: 1,
+        maxWidth: 4000,
+        addon: null,
+        out: null,
+        verbose: false
+    };
+
+    const list = (v) => v.split(',').map(s => s.trim()).filter(Boolean);
+
+    for (let i = 0; i < argv.length; i++) {
+        const arg = argv[i];
+        const next = () => {
+            if (i + 1 >= argv.length) throw new Error(`Missing value for ${arg}`);
+            return argv[++i];
+        };
+        switch (arg) {
+            case '--corpus': options.corpus = path.resolve(next()); break;
+            case '--synthetic': options.synthetic = parseInt(next(), 10); break;
+            case '--size': {
+                const [w, h] = next().toLowerCase().split('x').map(n => parseInt(n, 10));
+                options.width = w;
+                options.height = h;
+                break;
+            }
+            case '--scenarios': options.scenarios = list(next()); break;
+            case '--concurrency': options.concurrency = list(next()).map(n => parseInt(n, 10)); break;
+            case '--iterations': options.iterations = parseInt(next(), 10); break;
+            case '--max-width': options.maxWidth = parseInt(next(), 10); break;
+            case '--addon': options.addon = path.resolve(next()); break;
+            case '--out': options.out = path.resolve(next()); break;
+            case '--verbose': options.verbose = true; break;
+            case '--help':
+            case '-h':
+                options.help = true;
+                break;
+            default:
+                throw new Error(`Unknown option: ${arg}`);
+        }
+    }
+
+    for (const s of options.scenarios) {
+        if (!SCENARIOS.includes(s)) throw new Error(`Unknown scenario: ${s}`);
+    }
+    if (options.concurrency.some(n => !(n > 0))) throw new Error('Concurrency levels must be positive');
+    if (!(options.iterations > 0)) throw new Error('Iterations must be positive');
+
+    return options;
+}
+
+// ============================================================================
+// Measurement
+// ============================================================================
+
+function percentile(sorted, p) {
+    if (sorted.length === 0) return 0;
+    const rank = Math.min(sorted.length - 1, Math.max(0, Math.ceil((p / 100) * sorted.length) - 1));
+    return sorted[rank];
+}
+
+function round(value, digits = 2) {
+    const f = Math.pow(10, digits);
+    return Math.round(value * f) / f;
+}
+
+/**
+ * Sample RSS while a scenario runs. The interval only fires between
+ * synchronous JS stages, so the result is combined with a final sample.
+ */
+function startRssSampler(intervalMs = 50) {
+    let peak = process.memoryUsage().rss;
+    const timer = setInterval(() => {
+        const rss = process.memoryUsage().rss;
+        if (rss > peak) peak = rss;
+    }, intervalMs);
+    return () => {
+        clearInterval(timer);
+        return Math.max(peak, process.memoryUsage().rss);
+    };
+}
+
+/**
+ * Run `tasks` through `fn` with at most `concurrency` in flight
+ * @returns {Promise<{latencies: number[], errors: string[]}>}
+ */
+async function runPool(tasks, concurrency, fn) {
+    const latencies = [];
+    const errors = [];
+    let next = 0;
+
+    async function lane() {
+        while (next < tasks.length) {
+            const task = tasks[next++];
+            const start = performance.now();
+            try {
+                await fn(task);
+                latencies.push(performance.now() - start);
+            } catch (e) {
+                errors.push(e.message);
+            }
+        }
+    }
+
+    const lanes = [];
+    for (let i = 0; i < Math.min(concurrency, tasks.length); i++) lanes.push(lane());
+    await Promise.all(lanes);
+    return { latencies, errors };
+}
+
+async function measure(scenario, concurrency, lanes, tasks, fn) {
+    if (global.gc) global.gc();
+    const stopSampler = startRssSampler();
+    const cpuStart = process.cpuUsage();
+    const wallStart = performance.now();
+
+    const { latencies, errors } = await runPool(tasks, lanes, fn);
+
+    const wallMs = performance.now() - wallStart;
+    const cpu = process.cpuUsage(cpuStart);
+    const peakRss = stopSampler();
+    const sorted = latencies.slice().sort((a, b) => a - b);
+    const cpuMs = (cpu.user + cpu.system) / 1000;
+    const cores = os.cpus().length;
+
+    return {
+        scenario,
+        concurrency,
+        tasks: tasks.length,
+        completed: latencies.length,
+        errors: errors.length,
+        errorSamples: Array.from(new Set(errors)).slice(0, 3),
+        wallMs: round(wallMs),
+        filesPerSec: round(latencies.length / (wallMs / 1000), 3),
+        latencyMs: {
+            min: round(sorted[0] || 0),
+            mean: round(sorted.length ? sorted.reduce((a, b) => a + b, 0) / sorted.length : 0),
+            p50: round(percentile(sorted, 50)),
+            p95: round(percentile(sorted, 95)),
+            p99: round(percentile(sorted, 99)),
+            max: round(sorted[sorted.length - 1] || 0)
+        },
+        peakRssMb: round(peakRss / 1048576, 1),
+        cpu: {
+            userMs: round(cpu.user / 1000),
+            systemMs: round(cpu.system / 1000),
+            coresUsed: round(cpuMs / wallMs),
+            utilization: round(cpuMs / wallMs / cores, 3)
+        }
+    };
+}
+
+// ============================================================================
+// Setup
+// ============================================================================
+
+function findCorpus(options) {
+    if (options.corpus) {
+        const files = fs.readdirSync(options.corpus)
+            .filter(f => RAW_EXTENSIONS.includes(path.extname(f).toLowerCase()))
+            .sort()
+            .map(f => path.join(options.corpus, f));
+        if (files.length === 0) throw new Error(`No RAW files in ${options.corpus}`);
+        return { source: options.corpus, synthetic: false, files };
+    }
+
+    const { ensureSyntheticCorpus } = require('./synthetic-dng');
+    const dir = path.join(os.tmpdir(), 'filmgallery-bench-corpus');
+    const files = ensureSyntheticCorpus(dir, options.synthetic, { width: options.width, height: options.height });
+    return { source: dir, synthetic: true, width: options.width, height: options.height, files };
+}
+
+function log(message) {
+    process.stderr.write(`[bench] ${message}\n`);
+}
+
+async function main() {
+    const options = parseArgs(process.argv.slice(2));
+    if (options.help) {
+        const header = fs.readFileSync(__filename, 'utf8').split('*/')[0];
+        console.log(header.replace(/^\/\*\*|^ \* ?/gm, '').trim());
+        return;
+    }
+
+    // Environment must be in place before any server module is required:
+    // paths.js/db.js resolve DATA_ROOT at load, lib/index.js reads LIBRAW_NATIVE_ADDON.
+    const dataRoot = fs.mkdtempSync(path.join(os.tmpdir(), 'filmgallery-bench-'));
+    process.env.DATA_ROOT = dataRoot;
+    if (options.addon) process.env.LIBRAW_NATIVE_ADDON = options.addon;
+
+    const originalLog = console.log;
+    if (!options.verbose) console.log = () => {};
+
+    const serverDir = path.join(__dirname, '..', '..', '..', '..', 'server');
+    const libraw = require('../lib');
+    if (!libraw.isAvailable()) {
+        throw new Error(`Native addon not available: ${libraw.getLoadError() && libraw.getLoadError().message}`);
+    }
+    const rawDecoder = require(path.join(serverDir, 'services', 'raw-decoder'));
+    const needsRender = options.scenarios.includes('render') || options.scenarios.includes('export');
+    const renderService = needsRender ? require(path.join(serverDir, 'services', 'render-service')) : null;
+    const { ExportQueue } = options.scenarios.includes('export')
+        ? require(path.join(serverDir, 'services', 'export-queue'))
+        : {};
+    const { uploadsDir } = require(path.join(serverDir, 'config', 'paths'));
+
+    const corpus = findCorpus(options);
+    log(`corpus: ${corpus.files.length} file(s) from ${corpus.source}`);
+
+    // Render/export consume the 16-bit TIFF produced by RAW import, not the RAW itself
+    let renderInputs = [];
+    if (needsRender) {
+        const benchDir = path.join(uploadsDir, 'bench');
+        fs.mkdirSync(benchDir, { recursive: true });
+        for (const file of corpus.files) {
+            const tiff = await rawDecoder.decode(file, { outputFormat: 'tiff' });
+            const out = path.join(benchDir, `${path.basename(file, path.extname(file))}.tiff`);
+            fs.writeFileSync(out, tiff);
+            renderInputs.push(out);
+        }
+        log(`prepared ${renderInputs.length} TIFF(s) for render/export`);
+    }
+
+    const repeat = (items) => {
+        const tasks = [];
+        for (let i = 0; i < options.iterations; i++) tasks.push(...items);
+        return tasks;
+    };
+
+    const runners = {
+        decode: (file) => rawDecoder.decode(file, { outputFormat: 'jpeg' }),
+        thumbnail: (file) => rawDecoder.extractThumbnail(file),
+        render: (file) => renderService.renderFile(file, {
+            params: RENDER_PARAMS,
+            format: 'jpeg',
+            maxWidth: options.maxWidth
+        })
+    };
+
+    const results = [];
+    for (const scenario of options.scenarios) {
+        const inputs = scenario === 'render' || scenario === 'export' ? renderInputs : corpus.files;
+
+        for (const concurrency of options.concurrency) {
+            let fn = runners[scenario];
+            let queue = null;
+
+            if (scenario === 'export') {
+                // One single-photo job per task; the queue's own worker pool sets the concurrency
+                const outputDir = fs.mkdtempSync(path.join(dataRoot, 'export-'));
+                const photos = inputs.map((file, i) => ({
+                    id: i + 1,
+                    filename: path.basename(file),
+                    original_rel_path: path.relative(uploadsDir, file)
+                }));
+                queue = new ExportQueue({ concurrency, retryAttempts: 0, maxQueueSize: Infinity });
+                queue.setDatabase({ get: async (sql, [id]) => photos[id - 1] });
+                fn = (file) => new Promise((resolve, reject) => {
+                    const photoId = inputs.indexOf(file) + 1;
+                    queue.addJob({
+                        photoIds: [photoId],
+                        outputDir,
+                        format: 'JPEG',
+                        quality: 95,
+                        maxWidth: options.maxWidth,
+                        processingParams: RENDER_PARAMS
+                    }).then(job => {
+                        const onDone = (done) => {
+                            if (done.id !== job.id) return;
+                            cleanup();
+                            const errors = done.progress.errors;
+                            if (errors.length > 0) reject(new Error(errors[0].error));
+                            else resolve();
+                        };
+                        const onFail = ({ job: failed, error }) => {
+                            if (failed.id !== job.id) return;
+                            cleanup();
+                            reject(error);
+                        };
+                        const cleanup = () => {
+                            queue.off('jobCompleted', onDone);
+                            queue.off('jobFailed', onFail);
+                            queue.removeJob(job.id);
+                        };
+                        queue.on('jobCompleted', onDone);
+                        queue.on('jobFailed', onFail);
+                    }, reject);
+                });
+            }
+
+            // Warm-up: first-touch allocations, sharp/libvips init, JIT
+            await runPool(inputs.slice(0, 1), 1, fn).catch(() => {});
+
+            // Export submits everything at once so the queue, not the bench, limits parallelism
+            const tasks = repeat(inputs);
+            const lanes = scenario === 'export' ? tasks.length : concurrency;
+            const result = await measure(scenario, concurrency, lanes, tasks, fn);
+            results.push(result);
+            log(`${scenario.padEnd(9)} c=${String(concurrency).padEnd(2)} ` +
+                `${result.filesPerSec.toFixed(2)} files/s  p50 ${result.latencyMs.p50.toFixed(0)}ms  ` +
+                `p95 ${result.latencyMs.p95.toFixed(0)}ms  rss ${result.peakRssMb}MB  ` +
+                `cpu ${(result.cpu.utilization * 100).toFixed(0)}%` +
+                (result.errors ? `  errors ${result.errors}` : ''));
+
+            if (queue) queue.removeAllListeners();
+        }
+    }
+
+    const version = libraw.getVersion();
+    const report = {
+        meta: {
+            date: new Date().toISOString(),
+            node: process.version,
+            platform: `${process.platform}-${process.arch}`,
+            cpuModel: (os.cpus()[0] || {}).model || 'unknown',
+            cpus: os.cpus().length,
+            totalMemMb: Math.round(os.totalmem() / 1048576),
+            addon: options.addon || 'default',
+            libraw: version.version,
+            decoder: rawDecoder.getDecoderInfo()
+        },
+        config: {
+            scenarios: options.scenarios,
+            concurrency: options.concurrency,
+            iterations: options.iterations,
+            maxWidth: options.maxWidth
+        },
+        corpus: {
+            source: corpus.source,
+            synthetic: corpus.synthetic,
+            files: corpus.files.map(f => path.basename(f)),
+            bytes: corpus.files.reduce((sum, f) => sum + fs.statSync(f).size, 0)
+        },
+        results,
+        // Kernel high-water mark over the whole bench process (all runs, plus setup)
+        processMaxRssMb: round(process.resourceUsage().maxRSS / 1024, 1)
+    };
+
+    console.log = originalLog;
+    fs.rmSync(dataRoot, { recursive: true, force: true });
+
+    const json = JSON.stringify(report, null, 2);
+    if (options.out) {
+        fs.writeFileSync(options.out, json);
+        log(`report written to ${options.out}`);
+    } else {
+        process.stdout.write(json + '\n');
+    }
+}
+
+module.exports = { parseArgs, percentile, runPool, RENDER_PARAMS };
+
+if (require.main === module) {
+    main().catch(e => {
+        process.stderr.write(`[bench] ${e.stack || e.message}\n`);
+        process.exit(1);
+    });
+}
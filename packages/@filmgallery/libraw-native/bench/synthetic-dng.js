@@ -0,0 +1,348 @@
+/**
+ * @filmgallery/libraw-native - Synthetic DNG Generator
+ *
+ * Writes uncompressed 16-bit RGGB Bayer DNGs with a deterministic test scene
+ * (hue sweep, exposure ramp, grey patches, sensor noise) so benchmarks can run
+ * without a private RAW corpus. Each file carries an 8-bit RGB preview in
+ * IFD0 and the CFA image in a SubIFD, like camera-produced DNGs. With
+ * `linear` the SubIFD holds demosaiced LinearRaw RGB instead, like film
+ * scanner DNGs. With `compression: 'deflate'` the raw image is stored as
+ * zlib strips with horizontal differencing (compression 8, predictor 2).
+ *
+ * Usage: node bench/synthetic-dng.js <outDir> [count] [width] [height]
+ */
+
+'use strict';
+
+const fs = require('fs');
+const path = require('path');
+const zlib = require('zlib');
+
+// TIFF field types
+const BYTE = 1;
+const ASCII = 2;
+const SHORT = 3;
+const LONG = 4;
+const RATIONAL = 5;
+const SRATIONAL = 10;
+
+const TYPE_SIZE = { [BYTE]: 1, [ASCII]: 1, [SHORT]: 2, [LONG]: 4, [RATIONAL]: 8, [SRATIONAL]: 8 };
+
+// Rows per deflate strip
+const STRIP_ROWS = 16;
+
+// XYZ(D65) -> linear sRGB, used as ColorMatrix1 so the synthetic camera is sRGB-like
+const COLOR_MATRIX = [
+    3.2406, -1.5372, -0.4986,
+    -0.9689, 1.8758, 0.0415,
+    0.0557, -0.2040, 1.0570
+];
+
+/**
+ * Tiny deterministic PRNG (mulberry32)
+ */
+function createRandom(seed) {
+    let a = seed >>> 0;
+    return () => {
+        a = (a + 0x6D2B79F5) >>> 0;
+        let t = a;
+        t = Math.imul(t ^ (t >>> 15), t | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+/**
+ * Linear scene radiance at normalized coordinates (0-1), per channel
+ */
+function scene(u, v) {
+    // Grey patch strip along the bottom
+    if (v > 0.85) {
+        const step = Math.floor(u * 8) / 7;
+        const grey = 0.01 + 0.8 * step * step;
+        return [grey, grey, grey];
+    }
+    // Hue sweep horizontally, exposure ramp vertically
+    const h = u * 6;
+    const x = 1 - Math.abs((h % 2) - 1);
+    let rgb;
+    if (h < 1) rgb = [1, x, 0];
+    else if (h < 2) rgb = [x, 1, 0];
+    else if (h < 3) rgb = [0, 1, x];
+    else if (h < 4) rgb = [0, x, 1];
+    else if (h < 5) rgb = [x, 0, 1];
+    else rgb = [1, 0, x];
+    const exposure = Math.pow(2, -6 * v);
+    return rgb.map(c => (0.05 + 0.9 * c) * exposure);
+}
+
+/**
+ * Build the CFA plane (RGGB), or interleaved RGB when `linear`, as
+ * little-endian 16-bit samples
+ */
+function buildCfa(width, height, random, linear = false) {
+    const samples = linear ? 3 : 1;
+    const cfa = Buffer.allocUnsafe(width * height * samples * 2);
+    const whiteLevel = 65535;
+    let offset = 0;
+    for (let y = 0; y < height; y++) {
+        const v = y / height;
+        for (let x = 0; x < width; x++) {
+            const colors = linear ? [0, 1, 2] : [(y & 1) ? ((x & 1) ? 2 : 1) : ((x & 1) ? 1 : 0)];
+            const radiance = scene(x / width, v);
+            for (const color of colors) {
+                const noise = (random() - 0.5) * 0.004;
+                const value = Math.max(0, Math.min(whiteLevel, Math.round((radiance[color] + noise) * whiteLevel)));
+                cfa.writeUInt16LE(value, offset);
+                offset += 2;
+            }
+        }
+    }
+    return cfa;
+}
+
+/**
+ * Split 16-bit samples into zlib strips of STRIP_ROWS rows, each row
+ * differenced `samples` apart (TIFF predictor 2)
+ * @returns {Buffer[]}
+ */
+function deflateStrips(image, width, height, samples) {
+    const rowSamples = width * samples;
+    const strips = [];
+    for (let y = 0; y < height; y += STRIP_ROWS) {
+        const rows = Math.min(STRIP_ROWS, height - y);
+        const strip = Buffer.from(image.subarray(y * rowSamples * 2, (y + rows) * rowSamples * 2));
+        for (let r = 0; r < rows; r++) {
+            const row = r * rowSamples * 2;
+            for (let i = rowSamples - 1; i >= samples; i--) {
+                const delta = strip.readUInt16LE(row + i * 2) - strip.readUInt16LE(row + (i - samples) * 2);
+                strip.writeUInt16LE(delta & 0xffff, row + i * 2);
+            }
+        }
+        strips.push(zlib.deflateSync(strip));
+    }
+    return strips;
+}
+
+/**
+ * Build an 8-bit sRGB preview (nearest sampling of the scene)
+ */
+function buildPreview(width, height) {
+    const rgb = Buffer.allocUnsafe(width * height * 3);
+    let offset = 0;
+    for (let y = 0; y < height; y++) {
+        for (let x = 0; x < width; x++) {
+            const linear = scene(x / width, y / height);
+            for (let c = 0; c < 3; c++) {
+                const l = Math.min(1, linear[c]);
+                const s = l <= 0.0031308 ? l * 12.92 : 1.055 * Math.pow(l, 1 / 2.4) - 0.055;
+                rgb[offset++] = Math.round(s * 255);
+            }
+        }
+    }
+    return rgb;
+}
+
+function toRational(value, signed) {
+    const den = 10000;
+    const num = Math.round(value * den);
+    return signed ? [num, den] : [Math.max(0, num), den];
+}
+
+/**
+ * Serialize one IFD. Entries must be sorted by tag; values larger than 4
+ * bytes are placed in the data area that follows the IFD.
+ * @returns {{ifd: Buffer, data: Buffer}}
+ */
+function serializeIfd(entries, ifdOffset, nextIfdOffset) {
+    const ifdSize = 2 + entries.length * 12 + 4;
+    const ifd = Buffer.alloc(ifdSize);
+    const chunks = [];
+    let dataOffset = ifdOffset + ifdSize;
+
+    ifd.writeUInt16LE(entries.length, 0);
+    entries.forEach((entry, i) => {
+        let values = entry.value;
+        if (entry.type === ASCII) {
+            values = Buffer.from(values + '\0', 'latin1');
+        } else if (!Array.isArray(values)) {
+            values = [values];
+        }
+        const count = entry.type === RATIONAL || entry.type === SRATIONAL ? values.length / 2 : values.length;
+        const size = count * TYPE_SIZE[entry.type];
+        const bytes = Buffer.alloc(Math.max(4, size));
+
+        for (let k = 0; k < values.length; k++) {
+            switch (entry.type) {
+                case BYTE:
+                case ASCII: bytes.writeUInt8(values[k], k); break;
+                case SHORT: bytes.writeUInt16LE(values[k], k * 2); break;
+                case LONG:
+                case RATIONAL: bytes.writeUInt32LE(values[k], k * 4); break;
+                case SRATIONAL: bytes.writeInt32LE(values[k], k * 4); break;
+            }
+        }
+
+        const base = 2 + i * 12;
+        ifd.writeUInt16LE(entry.tag, base);
+        ifd.writeUInt16LE(entry.type, base + 2);
+        ifd.writeUInt32LE(count, base + 4);
+        if (size <= 4) {
+            bytes.copy(ifd, base + 8, 0, 4);
+        } else {
+            ifd.writeUInt32LE(dataOffset, base + 8);
+            chunks.push(bytes);
+            dataOffset += size + (size & 1);
+            if (size & 1) chunks.push(Buffer.alloc(1));
+        }
+    });
+    ifd.writeUInt32LE(nextIfdOffset, ifdSize - 4);
+
+    return { ifd, data: Buffer.concat(chunks) };
+}
+
+/**
+ * Byte size of a serialized IFD plus its data area (independent of offsets)
+ */
+function ifdByteSize(entries) {
+    const { ifd, data } = serializeIfd(entries, 0, 0);
+    return ifd.length + data.length;
+}
+
+/**
+ * Write a synthetic DNG file
+ * @param {string} filePath - Output path
+ * @param {Object} [options]
+ * @param {number} [options.width=6000] - CFA width (even)
+ * @param {number} [options.height=4000] - CFA height (even)
+ * @param {number} [options.seed=1] - Noise seed
+ * @param {boolean} [options.linear=false] - LinearRaw RGB instead of a CFA
+ * @param {string} [options.compression] - 'deflate' for zlib strips, else uncompressed
+ * @returns {string} filePath
+ */
+function writeSyntheticDng(filePath, options = {}) {
+    const width = (options.width || 6000) & ~1;
+    const height = (options.height || 4000) & ~1;
+    const seed = options.seed || 1;
+    const linear = !!options.linear;
+    const deflate = options.compression === 'deflate';
+    const previewWidth = Math.max(16, Math.round(width / 16));
+    const previewHeight = Math.max(16, Math.round(height / 16));
+
+    const cfa = buildCfa(width, height, createRandom(seed), linear);
+    const strips = deflate ? deflateStrips(cfa, width, height, linear ? 3 : 1) : [cfa];
+    const stripOffsets = (first) => strips.map((strip, i) => first + strips.slice(0, i).reduce((n, s) => n + s.length, 0));
+    const preview = buildPreview(previewWidth, previewHeight);
+    const model = linear ? 'Synthetic Linear' : 'Synthetic Bayer';
+
+    const ifd0Offset = 8;
+
+    const rawEntries = (cfaOffset) => [
+        { tag: 254, type: LONG, value: 0 },
+        { tag: 256, type: LONG, value: width },
+        { tag: 257, type: LONG, value: height },
+        { tag: 258, type: SHORT, value: linear ? [16, 16, 16] : 16 },
+        { tag: 259, type: SHORT, value: deflate ? 8 : 1 },
+        { tag: 262, type: SHORT, value: linear ? 34892 : 32803 },
+        { tag: 273, type: LONG, value: stripOffsets(cfaOffset) },
+        { tag: 277, type: SHORT, value: linear ? 3 : 1 },
+        { tag: 278, type: LONG, value: deflate ? STRIP_ROWS : height },
+        { tag: 279, type: LONG, value: strips.map(strip => strip.length) },
+        { tag: 284, type: SHORT, value: 1 },
+        ...(deflate ? [{ tag: 317, type: SHORT, value: 2 }] : []),
+        ...(linear ? [] : [
+            { tag: 33421, type: SHORT, value: [2, 2] },
+            { tag: 33422, type: BYTE, value: [0, 1, 1, 2] }
+        ]),
+        { tag: 50717, type: LONG, value: linear ? [65535, 65535, 65535] : 65535 }
+    ];
+
+    const ifd0Entries = (previewOffset, rawIfdOffset) => [
+        { tag: 254, type: LONG, value: 1 },
+        { tag: 256, type: LONG, value: previewWidth },
+        { tag: 257, type: LONG, value: previewHeight },
+        { tag: 258, type: SHORT, value: [8, 8, 8] },
+        { tag: 259, type: SHORT, value: 1 },
+        { tag: 262, type: SHORT, value: 2 },
+        { tag: 271, type: ASCII, value: 'FilmGallery' },
+        { tag: 272, type: ASCII, value: model },
+        { tag: 273, type: LONG, value: previewOffset },
+        { tag: 274, type: SHORT, value: 1 },
+        { tag: 277, type: SHORT, value: 3 },
+        { tag: 278, type: LONG, value: previewHeight },
+        { tag: 279, type: LONG, value: preview.length },
+        { tag: 284, type: SHORT, value: 1 },
+        { tag: 305, type: ASCII, value: 'libraw-native bench' },
+        { tag: 330, type: LONG, value: rawIfdOffset },
+        { tag: 50706, type: BYTE, value: [1, 4, 0, 0] },
+        { tag: 50707, type: BYTE, value: [1, 1, 0, 0] },
+        { tag: 50708, type: ASCII, value: `FilmGallery ${model}` },
+        { tag: 50721, type: SRATIONAL, value: COLOR_MATRIX.flatMap(v => toRational(v, true)) },
+        { tag: 50728, type: RATIONAL, value: [1, 1, 1, 1, 1, 1] },
+        { tag: 50778, type: SHORT, value: 21 }
+    ];
+
+    const ifd0Size = ifdByteSize(ifd0Entries(0, 0));
+    const rawIfdOffset = ifd0Offset + ifd0Size + (ifd0Size & 1);
+    const rawIfdSize = ifdByteSize(rawEntries(0));
+    const previewOffset = rawIfdOffset + rawIfdSize + (rawIfdSize & 1);
+    const cfaOffset = previewOffset + preview.length + (preview.length & 1);
+
+    const header = Buffer.alloc(8);
+    header.write('II', 0, 'latin1');
+    header.writeUInt16LE(42, 2);
+    header.writeUInt32LE(ifd0Offset, 4);
+
+    const ifd0 = serializeIfd(ifd0Entries(previewOffset, rawIfdOffset), ifd0Offset, 0);
+    const rawIfd = serializeIfd(rawEntries(cfaOffset), rawIfdOffset, 0);
+    const pad = (n) => Buffer.alloc(n & 1);
+
+    fs.mkdirSync(path.dirname(filePath), { recursive: true });
+    fs.writeFileSync(filePath, Buffer.concat([
+        header,
+        ifd0.ifd, ifd0.data, pad(ifd0Size),
+        rawIfd.ifd, rawIfd.data, pad(rawIfdSize),
+        preview, pad(preview.length),
+        ...strips
+    ]));
+
+    return filePath;
+}
+
+/**
+ * Write `count` synthetic DNGs (skipping ones that already exist)
+ * @returns {string[]} File paths
+ */
+function ensureSyntheticCorpus(outDir, count, options = {}) {
+    const width = options.width || 6000;
+    const height = options.height || 4000;
+    const files = [];
+    for (let i = 0; i < count; i++) {
+        const filePath = path.join(outDir, `synthetic_${width}x${height}_${i + 1}.dng`);
+        if (!fs.existsSync(filePath)) {
+            writeSyntheticDng(filePath, { width, height, seed: i + 1 });
+        }
+        files.push(filePath);
+    }
+    return files;
+}
+
+module.exports = {
+    writeSyntheticDng,
+    ensureSyntheticCorpus,
+    buildCfa,
+    createRandom
+};
+
+if (require.main === module) {
+    const [outDir, count = '4', width = '6000', height = '4000'] = process.argv.slice(2);
+    if (!outDir) {
+        console.log('Usage: node bench/synthetic-dng.js <outDir> [count] [width] [height]');
+        process.exit(1);
+    }
+    const files = ensureSyntheticCorpus(outDir, parseInt(count, 10), {
+        width: parseInt(width, 10),
+        height: parseInt(height, 10)
+    });
+    files.forEach(f => console.log(f));
+}
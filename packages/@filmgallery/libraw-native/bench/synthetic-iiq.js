@@ -0,0 +1,296 @@
+/**
+ * @filmgallery/libraw-native - Synthetic Phase One IIQ Generator
+ *
+ * Writes small Phase One IIQ files from the synthetic DNG scene so the
+ * medium-format loaders and calibration can be checked without a private
+ * corpus. The raw data is either uncompressed and key-scrambled (format 1)
+ * or IIQ L rows at their own offsets (format 3). Each file carries black
+ * level tables split into quadrants and a calibration block with sensor
+ * defects, a polynomial curve, quadrant multipliers and linearization, and
+ * luma and chroma flat fields.
+ *
+ * Usage: node bench/synthetic-iiq.js <outPath> [width] [height] [format]
+ */
+
+'use strict';
+
+const fs = require('fs');
+const path = require('path');
+const { buildCfa, createRandom } = require('./synthetic-dng');
+
+// Sensor black and the XOR keys of uncompressed data
+const BLACK = 256;
+const KEYS = [0x3a5c, 0xc3a5];
+
+// IIQ L length codes, in the order phase_one_load_raw_c() indexes them
+const LENGTHS = [8, 7, 6, 9, 11, 10, 5, 12, 14, 13];
+
+/**
+ * MSB-first bit writer, flushed as 32-bit little-endian words
+ */
+class BitWriter {
+    constructor() {
+        this.words = [];
+        this.word = 0;
+        this.bits = 0;
+    }
+
+    write(value, count) {
+        for (let i = count - 1; i >= 0; i--) {
+            this.word = (this.word << 1 | (value >>> i & 1)) >>> 0;
+            if (++this.bits === 32) {
+                this.words.push(this.word);
+                this.word = 0;
+                this.bits = 0;
+            }
+        }
+    }
+
+    // Pad to a whole word
+    finish() {
+        if (this.bits) {
+            this.write(0, 32 - this.bits);
+        }
+        const out = Buffer.alloc(this.words.length * 4);
+        this.words.forEach((word, i) => out.writeUInt32LE(word, i * 4));
+        return out;
+    }
+}
+
+/**
+ * Scramble 16-bit samples the way phase_one_load_raw() unscrambles them
+ */
+function scrambleRaw(raw, format) {
+    const mask = format === 1 ? 0x5555 : 0x1354;
+    const out = Buffer.alloc(raw.length * 2);
+    for (let i = 0; i < raw.length; i += 2) {
+        const a = (raw[i] & mask) | (raw[i + 1] & ~mask & 0xffff);
+        const b = (raw[i + 1] & mask) | (raw[i] & ~mask & 0xffff);
+        out.writeUInt16LE(a ^ KEYS[0], i * 2);
+        out.writeUInt16LE(b ^ KEYS[1], i * 2 + 2);
+    }
+    return out;
+}
+
+/**
+ * Encode IIQ L rows of 14-bit samples: per 8-column group and column
+ * parity, the shortest length code that holds every delta (14 stores raw
+ * 16-bit values)
+ * @returns {{data: Buffer, offsets: number[]}}
+ */
+function compressRows(raw, width, height) {
+    const rows = [];
+    const offsets = [];
+    let offset = 0;
+    for (let y = 0; y < height; y++) {
+        const row = raw.subarray(y * width, (y + 1) * width).map(v => v >> 2);
+        const bits = new BitWriter();
+        const pred = [0, 0];
+        const len = [14, 14];
+        for (let x = 0; x < width; x++) {
+            if (x >= (width & -8)) {
+                len[0] = len[1] = 14;
+            } else if ((x & 7) === 0) {
+                for (let i = 0; i < 2; i++) {
+                    let p = pred[i];
+                    let spread = 0;
+                    for (let k = x + i; k < x + 8; k += 2) {
+                        spread = Math.max(spread, row[k] - p, 1 - (row[k] - p));
+                        p = row[k];
+                    }
+                    const code = LENGTHS.reduce((best, l, k) =>
+                        l !== 14 && spread <= 1 << (l - 1) && (best < 0 || l < LENGTHS[best]) ? k : best, -1);
+                    const index = code < 0 ? LENGTHS.indexOf(14) : code;
+                    const zeros = (index >> 1) + 1;
+                    bits.write(0, zeros);
+                    if (zeros < 5) bits.write(1, 1);
+                    bits.write(index & 1, 1);
+                    len[i] = LENGTHS[index];
+                }
+            }
+            const l = len[x & 1];
+            if (l === 14) {
+                bits.write(row[x], 16);
+            } else {
+                bits.write(row[x] - pred[x & 1] - 1 + (1 << (l - 1)), l);
+            }
+            pred[x & 1] = row[x];
+        }
+        const data = bits.finish();
+        offsets.push(offset);
+        rows.push(data);
+        offset += data.length;
+    }
+    // The bit reader may fetch one word past the last row
+    rows.push(Buffer.alloc(8));
+    return { data: Buffer.concat(rows), offsets };
+}
+
+function shorts(values) {
+    const out = Buffer.alloc(values.length * 2);
+    values.forEach((v, i) => out.writeInt16LE(v, i * 2));
+    return out;
+}
+
+function longs(values) {
+    const out = Buffer.alloc(values.length * 4);
+    values.forEach((v, i) => out.writeUInt32LE(v >>> 0, i * 4));
+    return out;
+}
+
+function floats(values) {
+    const out = Buffer.alloc(values.length * 4);
+    values.forEach((v, i) => out.writeFloatLE(v, i * 4));
+    return out;
+}
+
+/**
+ * Build the calibration block phase_one_correct() reads: "II", a directory
+ * offset at 8, then 12-byte entries (tag, length, offset into the block)
+ */
+function buildCalibration(width, height) {
+    const grid = (step, size) => Math.ceil(size / step);
+    const wide = grid(16, width);
+    const high = grid(16, height);
+    const flatHead = shorts([0, 0, width, height, 16, 16, 0, 0]);
+    const lumaFlat = [];
+    const chromaFlat = [];
+    for (let y = 0; y < high; y++) {
+        for (let x = 0; x < wide; x++) {
+            lumaFlat.push(1 + 0.03 * Math.sin(x + 2 * y));
+            chromaFlat.push(Math.round(32768 * (1 + 0.02 * Math.cos(x - y))), Math.round(32768 * (1 - 0.015 * Math.sin(2 * x + y))));
+        }
+    }
+    const quadrantLinear = [];
+    for (let q = 0; q < 4; q++) {
+        for (let i = 0; i < 16; i++) quadrantLinear.push((i + 1) * 4000 + q * 30 - 45);
+    }
+    const records = [
+        // Bad pixels (type 129), an isolated bad column and a close pair (131)
+        [0x0400, shorts([10, 10, 129, 0, 33, 20, 129, 0, 51, 41, 129, 0, 70, 0, 131, 0, 20, 0, 131, 0, 22, 0, 131, 0])],
+        [0x041a, floats([12, 0.01, -2e-7, 0])],
+        [0x041e, Buffer.concat([longs([0, 0, 0, 0]), floats([0.01]), longs([0, 0, 0, 0, 0]), floats([-0.02]),
+            longs([0, 0, 0]), floats([0.015]), longs([0, 0, 0]), floats([-0.005])])],
+        [0x041f, longs(quadrantLinear)],
+        [0x0401, Buffer.concat([flatHead, floats(lumaFlat)])],
+        [0x040b, Buffer.concat([flatHead, Buffer.from(new Uint16Array(chromaFlat).buffer)])]
+    ];
+
+    const dirOffset = 16;
+    let dataOffset = dirOffset + 8 + records.length * 12;
+    const dir = Buffer.alloc(8 + records.length * 12);
+    dir.writeUInt32LE(records.length, 0);
+    records.forEach(([tag, data], i) => {
+        dir.writeUInt32LE(tag, 8 + i * 12);
+        dir.writeUInt32LE(data.length, 12 + i * 12);
+        dir.writeUInt32LE(dataOffset, 16 + i * 12);
+        dataOffset += data.length;
+    });
+    const header = Buffer.alloc(dirOffset);
+    header.write('II', 0, 'latin1');
+    header.writeUInt32LE(dirOffset, 8);
+    return Buffer.concat([header, dir, ...records.map(([, data]) => data)]);
+}
+
+/**
+ * Write a synthetic IIQ file
+ * @param {string} filePath - Output path
+ * @param {Object} [options]
+ * @param {number} [options.width=100] - Sensor width (even)
+ * @param {number} [options.height=64] - Sensor height (even)
+ * @param {number} [options.seed=1] - Noise seed
+ * @param {number} [options.format=1] - 1 (uncompressed) or 3 (IIQ L)
+ * @returns {string} filePath
+ */
+function writeSyntheticIiq(filePath, options = {}) {
+    const width = (options.width || 100) & ~1;
+    const height = (options.height || 64) & ~1;
+    const seed = options.seed || 1;
+    const format = options.format || 1;
+    if (format !== 1 && format !== 3) {
+        throw new RangeError(`Unsupported IIQ format ${format}`);
+    }
+
+    const cfa = buildCfa(width, height, createRandom(seed));
+    const raw = new Uint16Array(width * height);
+    for (let i = 0; i < raw.length; i++) {
+        raw[i] = BLACK + Math.floor(cfa.readUInt16LE(i * 2) * (0xfff0 - BLACK) / 65535);
+    }
+    const compressed = format === 3 ? compressRows(raw, width, height) : null;
+    const splitCol = width >> 1;
+    const splitRow = height >> 1;
+
+    // Blocks after the directory, each word aligned
+    const blocks = {
+        firmware: Buffer.alloc(256),
+        blackCol: shorts(Array.from({ length: height * 2 }, (_, i) => (i % 7) - 3)),
+        blackRow: shorts(Array.from({ length: width * 2 }, (_, i) => (i % 5) - 2)),
+        calibration: buildCalibration(width, height),
+        strips: compressed ? longs(compressed.offsets) : Buffer.alloc(0),
+        data: compressed ? compressed.data : scrambleRaw(raw, format)
+    };
+    blocks.firmware.write('Synthetic IIQ, FilmGallery', 0, 'latin1');
+
+    const entries = (at) => [
+        [0x0108, 4, 4, width],
+        [0x0109, 4, 4, height],
+        [0x010a, 4, 4, 0],
+        [0x010b, 4, 4, 0],
+        [0x010c, 4, 4, width],
+        [0x010d, 4, 4, height],
+        [0x010e, 4, 4, format],
+        [0x010f, 4, blocks.data.length, at.data],
+        [0x0110, 4, blocks.calibration.length, at.calibration],
+        [0x0112, 4, 4, (KEYS[1] << 16 | KEYS[0]) >>> 0],
+        ...(compressed ? [[0x021c, 4, blocks.strips.length, at.strips]] : []),
+        [0x021d, 4, 4, BLACK],
+        [0x0222, 4, 4, splitCol],
+        [0x0223, 4, blocks.blackCol.length, at.blackCol],
+        [0x0224, 4, 4, splitRow],
+        [0x0225, 4, blocks.blackRow.length, at.blackRow],
+        [0x0301, 1, blocks.firmware.length, at.firmware]
+    ];
+
+    const dirOffset = 16;
+    const count = entries({}).length;
+    const at = {};
+    let offset = dirOffset + 8 + count * 16;
+    for (const [name, block] of Object.entries(blocks)) {
+        at[name] = offset;
+        offset += block.length + (-block.length & 3);
+    }
+
+    const header = Buffer.alloc(dirOffset);
+    header.write('IIII', 0, 'latin1');
+    header.writeUInt32LE(0x52617700, 4);    // "Raw" in the top three bytes
+    header.writeUInt32LE(dirOffset, 8);
+
+    const dir = Buffer.alloc(8 + count * 16);
+    dir.writeUInt32LE(count, 0);
+    entries(at).forEach((entry, i) => entry.forEach((v, k) => dir.writeUInt32LE(v >>> 0, 8 + i * 16 + k * 4)));
+
+    fs.mkdirSync(path.dirname(filePath), { recursive: true });
+    fs.writeFileSync(filePath, Buffer.concat([
+        header, dir,
+        ...Object.values(blocks).flatMap(block => [block, Buffer.alloc(-block.length & 3)])
+    ]));
+
+    return filePath;
+}
+
+module.exports = {
+    writeSyntheticIiq
+};
+
+if (require.main === module) {
+    const [outPath, width = '100', height = '64', format = '1'] = process.argv.slice(2);
+    if (!outPath) {
+        console.log('Usage: node bench/synthetic-iiq.js <outPath> [width] [height] [format]');
+        process.exit(1);
+    }
+    console.log(writeSyntheticIiq(outPath, {
+        width: parseInt(width, 10),
+        height: parseInt(height, 10),
+        format: parseInt(format, 10)
+    }));
+}
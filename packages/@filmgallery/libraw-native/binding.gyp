@@ -1,10 +1,40 @@
 {
+  "variables": {
+    "jpegxl%": "<!(node -p \"process.env.LIBRAW_NATIVE_JPEGXL === '1'\")"
+  },
   "targets": [
     {
       "target_name": "libraw_native",
       "sources": [
         "src/libraw_binding.cpp",
         "src/async_workers.cpp",
+        "src/trace.cpp",
+        "src/camera_index.cpp",
+        "src/metadata_record.cpp",
+        "src/identify_snapshot.cpp",
+        "src/mosaic_cache.cpp",
+        "src/mem_image.cpp",
+        "src/linear_raw.cpp",
+        "src/monochrome_raw.cpp",
+        "src/color_convert.cpp",
+        "src/derivatives.cpp",
+        "src/filmlab_kernel.cpp",
+        "src/render_session.cpp",
+        "src/edit_session.cpp",
+        "src/cpu_dispatch.cpp",
+        "src/parallel.cpp",
+        "src/filmlab_preview.cpp",
+        "src/tiled_render.cpp",
+        "src/jpeg_encoder.cpp",
+        "src/jpeg_decoder.cpp",
+        "src/metadata_writer.cpp",
+        "src/lossy_dng.cpp",
+        "src/inflate.cpp",
+        "src/deflate_dng.cpp",
+        "src/jxl_dng.cpp",
+        "src/dng_tiles.cpp",
+        "src/packed_raw.cpp",
+        "src/medium_format.cpp",
         "deps/libraw/src/libraw_c_api.cpp",
         "deps/libraw/src/libraw_datastream.cpp",
         "deps/libraw/src/decoders/canon_600.cpp",
@@ -99,6 +129,22 @@
         "LIBRAW_LIBRARY_BUILD"
       ],
       "conditions": [
+        ["jpegxl=='true'", {
+          "defines": [
+            "LIBRAW_NATIVE_JPEGXL"
+          ],
+          "cflags_cc": [
+            "<!@(pkg-config --cflags libjxl libjxl_threads)"
+          ],
+          "xcode_settings": {
+            "OTHER_CPLUSPLUSFLAGS": [
+              "<!@(pkg-config --cflags libjxl libjxl_threads)"
+            ]
+          },
+          "libraries": [
+            "<!@(pkg-config --libs libjxl libjxl_threads)"
+          ]
+        }],
         ["OS=='win'", {
           "msvs_settings": {
             "VCCLCompilerTool": {
@@ -140,7 +186,8 @@
             ],
             "OTHER_CPLUSPLUSFLAGS": [
               "-fexceptions",
-              "-frtti"
+              "-frtti",
+              "-ffp-contract=off"
             ]
           }
         }],
@@ -149,6 +196,7 @@
             "-fexceptions",
             "-frtti",
             "-std=c++17",
+            "-ffp-contract=off",
             "-Wno-deprecated-declarations"
           ],
           "libraries": [
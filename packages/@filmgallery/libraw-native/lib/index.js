@@ -9,23 +9,35 @@
 'use strict';
 
 const path = require('path');
+const fs = require('fs');
+const { MetadataRecords } = require('./metadata-records');
+const { writeStripTiff } = require('./strip-tiff');
 
 // Load native addon
 let native = null;
 let loadError = null;
 
-try {
-    // Try node-gyp-build first (for prebuilds and dev builds)
-    native = require('node-gyp-build')(path.join(__dirname, '..'));
-} catch (e1) {
+if (process.env.LIBRAW_NATIVE_ADDON) {
+    // Explicit addon path (used by bench/ to compare two builds) - no fallback
     try {
-        // Fallback to direct build path
-        native = require('../build/Release/libraw_native.node');
-    } catch (e2) {
+        native = require(path.resolve(process.env.LIBRAW_NATIVE_ADDON));
+    } catch (e) {
+        loadError = new Error(`Failed to load native addon from LIBRAW_NATIVE_ADDON: ${e.message}`);
+    }
+} else {
+    try {
+        // Try node-gyp-build first (for prebuilds and dev builds)
+        native = require('node-gyp-build')(path.join(__dirname, '..'));
+    } catch (e1) {
         try {
-            native = require('../build/Debug/libraw_native.node');
-        } catch (e3) {
-            loadError = new Error(`Failed to load native addon: ${e1.message}`);
+            // Fallback to direct build path
+            native = require('../build/Release/libraw_native.node');
+        } catch (e2) {
+            try {
+                native = require('../build/Debug/libraw_native.node');
+            } catch (e3) {
+                loadError = new Error(`Failed to load native addon: ${e1.message}`);
+            }
         }
     }
 }
@@ -43,6 +55,15 @@ const ColorSpace = native?.ColorSpace || {
     REC2020: 8
 };
 
+const Transfer = native?.Transfer || {
+    DEFAULT: -1,
+    LINEAR: 0,
+    SRGB: 1,
+    GAMMA22: 2,
+    GAMMA18: 3,
+    BT709: 4
+};
+
 const DemosaicQuality = native?.DemosaicQuality || {
     LINEAR: 0,
     VNG: 1,
@@ -118,6 +139,36 @@ class LibRawProcessor {
         return result;
     }
 
+    /**
+     * Load a RAW file from disk, skipping metadata parsing when a snapshot
+     * from getIdentifySnapshot() still matches the file. A stale or
+     * incompatible snapshot falls back to a normal load.
+     * @param {string} filePath - Path to the RAW file
+     * @param {Buffer} snapshot - Blob from getIdentifySnapshot()
+     * @returns {Promise<{success: boolean, width: number, height: number, fromSnapshot: boolean, snapshotStatus: string}>}
+     */
+    async openWithSnapshot(filePath, snapshot) {
+        const result = await promisify(this._native, 'openWithSnapshot', filePath, snapshot);
+        this._isOpen = true;
+        return result;
+    }
+
+    /**
+     * Load a RAW file already unpacked from a mosaic cache written by
+     * writeMosaicCache(), skipping both metadata parsing and the camera
+     * decoder. A missing, stale or incompatible cache falls back to the
+     * identify snapshot (when given), then to a normal load.
+     * @param {string} filePath - Path to the RAW file
+     * @param {string} cachePath - Cache file from writeMosaicCache()
+     * @param {Buffer|null} [snapshot=null] - Blob from getIdentifySnapshot()
+     * @returns {Promise<{success: boolean, width: number, height: number, fromMosaic: boolean, mosaicStatus: string, fromSnapshot: boolean}>}
+     */
+    async openWithMosaicCache(filePath, cachePath, snapshot = null) {
+        const result = await promisify(this._native, 'openWithMosaicCache', filePath, cachePath, snapshot);
+        this._isOpen = true;
+        return result;
+    }
+
     /**
      * Unpack RAW data (prepare for processing)
      * @returns {Promise<{success: boolean}>}
@@ -137,20 +188,69 @@ class LibRawProcessor {
 
     /**
      * Alias for dcrawProcess() for API compatibility
-     * @returns {Promise<{success: boolean, width: number, height: number}>}
+     * @returns {Promise<{success: boolean, width: number, height: number, linear: boolean, monochrome: boolean, whiteLevel: number, autoBright: boolean, histogram: {bins: number, channels: number, data: Uint32Array}|null}>}
      */
     async processImage() {
         return this.dcrawProcess();
     }
 
     /**
-     * Create an in-memory image from processed data
-     * @returns {Promise<{success: boolean, data: Buffer, width: number, height: number, bits: number, colors: number}>}
+     * Create an in-memory image from processed data. Images larger than the
+     * limit (see setMemImageLimit) come back with `data: null` and a strip
+     * layout instead; fetch them with imageStrips() or writeStripTiff().
+     * @returns {Promise<{success: boolean, data: Buffer|null, width: number, height: number, bits: number, colors: number, dataSize: number, stride: number, colorSpace: number, transfer: number|null, stripHeight?: number, stripCount?: number}>}
      */
     async makeMemImage() {
         return promisify(this._native, 'makeMemImage');
     }
 
+    /**
+     * Encode the processed image as a baseline JPEG natively. Rows go through
+     * the same conversion as makeMemImage() (8-bit) band by band straight
+     * into the encoder, so the full-size pixels are never held; large images
+     * are entropy-coded in parallel bands joined by restart markers.
+     * @param {Object} [options]
+     * @param {number} [options.quality=90] - 1-100
+     * @param {string} [options.subsampling='420'] - '420' or '444'
+     * @param {Buffer} [options.iccProfile] - Defaults to the export colour
+     *        space's profile when setExportColorSpace() is active
+     * @returns {Promise<{width: number, height: number, colors: number, colorSpace: number, transfer: number|null, data: Buffer}>}
+     */
+    async makeJpeg(options = {}) {
+        return promisify(this._native, 'makeJpeg', options);
+    }
+
+    /**
+     * Copy one strip of rows of the processed image
+     * @param {number} index - Strip index (0 to stripCount - 1)
+     * @returns {Promise<{row: number, rows: number, data: Buffer}>}
+     */
+    async readImageStrip(index) {
+        return promisify(this._native, 'readImageStrip', index);
+    }
+
+    /**
+     * Iterate the strips of a strip-mode makeMemImage() result, one in
+     * memory at a time
+     * @param {Object} image - makeMemImage() result
+     */
+    async *imageStrips(image) {
+        for (let i = 0; i < image.stripCount; i++) {
+            yield await this.readImageStrip(i);
+        }
+    }
+
+    /**
+     * Stream a strip-mode image to an uncompressed TIFF (BigTIFF over 4 GB)
+     * @param {Object} image - makeMemImage() result
+     * @param {string} filePath - Output path
+     * @param {Object} [options]
+     * @param {Buffer} [options.iccProfile] - ICC profile to embed
+     */
+    async writeStripTiff(image, filePath, options = {}) {
+        return writeStripTiff(this, image, filePath, options);
+    }
+
     /**
      * Unpack the embedded thumbnail
      * @returns {Promise<{success: boolean, width: number, height: number, format: number}>}
@@ -167,6 +267,18 @@ class LibRawProcessor {
         return promisify(this._native, 'makeMemThumbnail');
     }
 
+    /**
+     * Decode the embedded JPEG preview natively, unpacking it if needed.
+     * Scaling happens during decoding, so a 1/8 grid thumbnail skips the
+     * inverse DCT entirely.
+     * @param {Object} [options]
+     * @param {number} [options.scale=1] - 1, 2, 4 or 8: output is ceil(size / scale)
+     * @returns {Promise<{width: number, height: number, colors: number, bits: number, data: Buffer}>}
+     */
+    async decodeThumbnail(options = {}) {
+        return promisify(this._native, 'decodeThumbnail', options);
+    }
+
     /**
      * Get RAW file metadata (camera, settings, etc.)
      * @returns {Object} Metadata object
@@ -199,6 +311,67 @@ class LibRawProcessor {
         return this._native.getColorInfo();
     }
 
+    /**
+     * Get the LibRaw decoder selected for the loaded file
+     * @returns {Object} Decoder name/flags plus per-file X-Trans and frame count
+     */
+    getDecoderInfo() {
+        return this._native.getDecoderInfo();
+    }
+
+    /**
+     * Get all metadata fields (camera, size, lens, color) as one packed record
+     * @returns {MetadataRecords} Single-record block
+     */
+    getMetadataRecord() {
+        return new MetadataRecords(this._native.getMetadataRecord(), getMetadataSchema());
+    }
+
+    /**
+     * Serialize the parsed file structure (decoder, offsets, sizes, levels,
+     * colour matrices) for openWithSnapshot(). Call after loadFile() and
+     * before unpack(). Throws for decoders that cannot be snapshotted.
+     * @returns {Buffer} Versioned snapshot blob, bound to the file's size and mtime
+     */
+    getIdentifySnapshot() {
+        return this._native.getIdentifySnapshot();
+    }
+
+    /**
+     * Write the unpacked sensor data (unpacking first if needed) with the
+     * parsed file structure to `cachePath` for openWithMosaicCache(). Samples
+     * are bit-packed to their real bit depth and LZ-compressed in row bands.
+     * Call after loadFile() and before processing. Rejects for float and
+     * Phase One black-calibrated data, and decoders that cannot be captured.
+     * @param {string} cachePath - Written through a temporary file, then renamed
+     * @returns {Promise<{success: boolean, bytes: number, rawBytes: number}>}
+     */
+    async writeMosaicCache(cachePath) {
+        return promisify(this._native, 'writeMosaicCache', cachePath);
+    }
+
+    /**
+     * writeMosaicCache() off the caller's path: resolves once the unpacked
+     * image is copied out, so the processor can be processed or closed
+     * right away; the copy (as large as the raw image) is then compressed
+     * and written on another thread. `written` settles when the file is
+     * complete and should always get a rejection handler.
+     * @param {string} cachePath - Written through a temporary file, then renamed
+     * @returns {Promise<{success: boolean, rawBytes: number, written: Promise<{success: boolean, bytes: number}>}>}
+     */
+    captureMosaicCache(cachePath) {
+        return new Promise((resolve, reject) => {
+            let settle;
+            const written = new Promise((resolveWritten, rejectWritten) => {
+                settle = (err, result) => (err ? rejectWritten(err) : resolveWritten(result));
+            });
+            this._native.writeMosaicCache(cachePath, (err, result) => {
+                if (err) reject(err);
+                else resolve({ ...result, written });
+            }, settle);
+        });
+    }
+
     /**
      * Set output color space
      * @param {number} colorSpace - Color space constant (use ColorSpace enum)
@@ -283,6 +456,79 @@ class LibRawProcessor {
         this._native.setHighlightMode(mode);
     }
 
+    /**
+     * Largest image makeMemImage() returns as one Buffer (default 1 GB);
+     * larger images are returned in strips
+     * @param {number} bytes
+     */
+    setMemImageLimit(bytes) {
+        this._native.setMemImageLimit(bytes);
+    }
+
+    /**
+     * Convert makeMemImage()/readImageStrip() output from the output colour
+     * space to another one while copying, encoded with that space's transfer
+     * curve instead of the setGamma() curve. Pick a wide setOutputColorSpace()
+     * (e.g. the export space itself) so nothing is clipped before conversion.
+     * @param {number} colorSpace - ColorSpace constant (0 = off)
+     * @param {number} [transfer=Transfer.DEFAULT] - Transfer constant
+     */
+    setExportColorSpace(colorSpace, transfer = Transfer.DEFAULT) {
+        this._native.setExportColorSpace(colorSpace, transfer);
+    }
+
+    /**
+     * Allow the LinearRaw fast path (default on): already-demosaiced 3-colour
+     * images (film scanner DNGs) skip dcraw_process() for one fused pass with
+     * the same output. processImage() reports it as `linear: true`.
+     * @param {boolean} enabled
+     */
+    setLinearFastPath(enabled) {
+        this._native.setLinearFastPath(enabled);
+    }
+
+    /**
+     * Allow the parallel stand-ins for LibRaw's uncompressed/bit-packed and
+     * Phase One/Imacon loaders and Phase One calibration (default on). Their
+     * output is bit-identical to LibRaw's; turning them off runs LibRaw's own
+     * code for comparison.
+     * @param {boolean} enabled
+     */
+    setStandInLoaders(enabled) {
+        this._native.setStandInLoaders(enabled);
+    }
+
+    /**
+     * Monochrome output for black-and-white work: Bayer images are processed
+     * straight to one luminance channel (interpolated from the white-balanced
+     * mosaic, no demosaic or colour conversion). processImage() reports it as
+     * `monochrome: true`; other sensors still come out RGB.
+     * @param {boolean|{weights?: number[], float?: boolean}|null} options -
+     *        false/null = off, true = Rec. 709 weights; `weights` are camera
+     *        R, G, B (normalized), `float` makes makeMemImage() return 32-bit
+     *        float linear luminance (1.0 = white) instead of the gamma curve
+     */
+    setMonochrome(options) {
+        if (!options) {
+            this._native.setMonochrome(false);
+        } else if (options === true) {
+            this._native.setMonochrome(true);
+        } else {
+            this._native.setMonochrome(true, options.weights || null, !!options.float);
+        }
+    }
+
+    /**
+     * Bins per colour of the histogram returned by dcrawProcess() (default
+     * 256). It is LibRaw's own conversion histogram (8192 bins per colour of
+     * the linear output) summed down, together with the auto-bright white
+     * point makeMemImage() applies, so neither needs recomputing in JS.
+     * @param {number} bins - Power of two up to 8192, or 0 for no histogram
+     */
+    setHistogramBins(bins) {
+        this._native.setHistogramBins(bins);
+    }
+
     /**
      * Recycle the processor for loading a new file
      */
@@ -306,6 +552,264 @@ class LibRawProcessor {
     isLoaded() {
         return this._native.isLoaded();
     }
+
+    /**
+     * Tag trace spans of subsequently queued operations with a job id
+     * @param {number} jobId - Positive integer job id (0 = untagged)
+     */
+    setTraceJob(jobId) {
+        this._native.setTraceJob(jobId);
+    }
+}
+
+/**
+ * Runs one native render at a time. Calls made while a render runs collapse
+ * into a single render of the newest arguments, and every caller resolves
+ * with that render; `cancel` (optional) aborts the running one early.
+ */
+class RenderQueue {
+    constructor(start, cancel = null) {
+        this._start = start;
+        this._cancel = cancel;
+        this._running = null;
+        this._pending = null;
+    }
+
+    push(...args) {
+        if (!this._running) {
+            return this._run(args);
+        }
+        if (this._cancel) {
+            this._cancel();
+        }
+        if (this._pending) {
+            this._pending.args = args;
+            return this._pending.promise;
+        }
+        const pending = { args };
+        pending.promise = this._running.catch(() => {}).then(() => {
+            this._pending = null;
+            return this._run(pending.args);
+        });
+        this._pending = pending;
+        return pending.promise;
+    }
+
+    _run(args) {
+        const running = this._start(...args);
+        const clear = () => {
+            if (this._running === running && !this._pending) this._running = null;
+        };
+        running.then(clear, clear);
+        this._running = running;
+        // A render cancelled for a newer one resolves with the newer one
+        return running.then(result => (result && result.cancelled && this._pending) ? this._pending.promise : result);
+    }
+
+    hasPending() {
+        return this._pending !== null;
+    }
+
+    // Settles when the render started last has finished (ignores queued ones)
+    current() {
+        return this._running ? this._running.then(() => {}, () => {}) : Promise.resolve();
+    }
+
+    async idle() {
+        while (this._pending || this._running) {
+            await (this._pending ? this._pending.promise : this._running).catch(() => {});
+        }
+    }
+}
+
+/**
+ * FilmLab Render Session
+ * 
+ * Keeps a preview-sized source and per-stage checkpoints between renders, so
+ * a parameter change recomputes only from the earliest affected stage.
+ * Renders are serialized; while one runs, later calls coalesce to the newest
+ * stages and all of them resolve with that render.
+ */
+class FilmLabSession {
+    constructor() {
+        if (!native) {
+            throw loadError || new Error('Native LibRaw module not available');
+        }
+        this._native = new native.FilmLabSession();
+        this._queue = new RenderQueue(stages => promisify(this._native, 'render', stages));
+    }
+
+    /**
+     * Replace the source image (discards every checkpoint)
+     * @param {Buffer} data - Interleaved 8/16-bit RGB(A), native byte order
+     * @param {{width: number, height: number, channels?: number, bits?: number}} options
+     * @returns {Promise<void>}
+     */
+    async setSource(data, options) {
+        await this.idle();
+        this._native.setSource(data, options);
+    }
+
+    /**
+     * Upper bound for checkpoint memory (default 256 MB); the latest stages
+     * are kept first
+     * @param {number} bytes
+     * @returns {Promise<void>}
+     */
+    async setMemoryLimit(bytes) {
+        await this.idle();
+        this._native.setMemoryLimit(bytes);
+    }
+
+    /**
+     * Render to 8-bit RGB
+     * @param {Object} stages - RenderCore.getNativeStages(sourceBits)
+     * @returns {Promise<{width: number, height: number, channels: number, startStage: string, data: Buffer}>}
+     */
+    render(stages) {
+        return this._queue.push(stages);
+    }
+
+    /**
+     * Wait until no render is running or queued
+     * @returns {Promise<void>}
+     */
+    idle() {
+        return this._queue.idle();
+    }
+
+    /**
+     * @returns {{width: number, height: number, checkpoints: string[], checkpointBytes: number, busy: boolean}}
+     */
+    getInfo() {
+        return this._native.getInfo();
+    }
+
+    /**
+     * Release the source and checkpoints
+     * @returns {Promise<void>}
+     */
+    async close() {
+        await this.idle();
+        this._native.close();
+    }
+}
+
+/**
+ * FilmLab Edit Session
+ * 
+ * Keeps a full-resolution scan resident as a pyramid and renders only the
+ * visible viewport, from the smallest level with at least the output
+ * resolution. Parameter changes on an unchanged viewport reuse the stage
+ * checkpoints (see FilmLabSession). A new render cancels the running one.
+ */
+class FilmLabEditSession {
+    constructor() {
+        if (!native) {
+            throw loadError || new Error('Native LibRaw module not available');
+        }
+        this._native = new native.FilmLabEditSession();
+        this._loading = null;
+        this._queue = new RenderQueue(
+            async (stages, viewport) => {
+                if (this._loading) {
+                    await this._loading.catch(() => {});
+                    // Superseded while waiting for the source
+                    if (this._queue.hasPending()) return { cancelled: true };
+                }
+                return promisify(this._native, 'render', stages, viewport);
+            },
+            () => this._native.cancel()
+        );
+    }
+
+    /**
+     * Replace the source image and build its pyramid
+     * @param {Buffer} data - Interleaved 8/16-bit RGB(A), native byte order
+     * @param {Object} options
+     * @param {number} options.width
+     * @param {number} options.height
+     * @param {number} [options.channels=3]
+     * @param {number} [options.bits=8]
+     * @param {number} [options.minLevelSize=256] - Smallest level long edge
+     * @returns {Promise<{width: number, height: number, levels: Array<{width: number, height: number}>}>}
+     */
+    setSource(data, options) {
+        this._native.cancel();
+        const previous = this._loading;
+        const loading = (async () => {
+            if (previous) await previous.catch(() => {});
+            // Renders queued from now on wait for this load instead
+            await this._queue.current();
+            return promisify(this._native, 'setSource', data, options);
+        })();
+        this._loading = loading;
+        const clear = () => {
+            if (this._loading === loading) this._loading = null;
+        };
+        loading.then(clear, clear);
+        return loading;
+    }
+
+    /**
+     * Upper bound for viewport checkpoint memory (default 256 MB)
+     * @param {number} bytes
+     * @returns {Promise<void>}
+     */
+    async setMemoryLimit(bytes) {
+        await this.idle();
+        this._native.setMemoryLimit(bytes);
+    }
+
+    /**
+     * Render a viewport to 8-bit RGB
+     * @param {Object} stages - RenderCore.getNativeStages(sourceBits)
+     * @param {Object} viewport - Region in full-resolution pixels (default:
+     *        the whole image) and the output size
+     * @param {number} [viewport.x=0]
+     * @param {number} [viewport.y=0]
+     * @param {number} [viewport.width]
+     * @param {number} [viewport.height]
+     * @param {number} viewport.outWidth
+     * @param {number} viewport.outHeight
+     * @returns {Promise<{width: number, height: number, channels: number, level: number, startStage: string, cancelled: boolean, data: Buffer|null}>}
+     *          `cancelled` only when cancel() stopped it with nothing queued
+     */
+    render(stages, viewport) {
+        return this._queue.push(stages, viewport);
+    }
+
+    /**
+     * Stop the running render; it resolves with `cancelled: true`
+     */
+    cancel() {
+        this._native.cancel();
+    }
+
+    /**
+     * Wait until no render is running or queued
+     * @returns {Promise<void>}
+     */
+    idle() {
+        return this._queue.idle();
+    }
+
+    /**
+     * @returns {{width: number, height: number, levels: Array<{width: number, height: number}>, pyramidBytes: number, checkpoints: string[], busy: boolean}}
+     */
+    getInfo() {
+        return this._native.getInfo();
+    }
+
+    /**
+     * Release the pyramid and checkpoints
+     * @returns {Promise<void>}
+     */
+    async close() {
+        this._native.cancel();
+        await this.idle();
+        this._native.close();
+    }
 }
 
 /**
@@ -314,18 +818,33 @@ class LibRawProcessor {
  */
 function getVersion() {
     if (!native) {
-        return { version: 'unavailable', versionNumber: 0 };
+        return { version: 'unavailable', versionNumber: 0, cpu: 'baseline', cpuDetected: 'baseline', jpegxl: false };
     }
     return native.getVersion();
 }
 
+// Camera list never changes at runtime; built once per flavour
+let cameraListCache = null;
+let cameraInfoCache = null;
+
 /**
  * Get list of supported cameras
- * @returns {string[]}
+ * @param {Object} [options]
+ * @param {boolean} [options.detailed=false] - Return CameraInfo objects instead of display names
+ * @returns {string[]|Object[]} Frozen, shared array
  */
-function getCameraList() {
+function getCameraList(options = {}) {
     if (!native) return [];
-    return native.getCameraList();
+    if (options.detailed) {
+        if (!cameraInfoCache) {
+            cameraInfoCache = Object.freeze(native.getCameraList(true).map(Object.freeze));
+        }
+        return cameraInfoCache;
+    }
+    if (!cameraListCache) {
+        cameraListCache = Object.freeze(native.getCameraList());
+    }
+    return cameraListCache;
 }
 
 /**
@@ -338,13 +857,410 @@ function getCameraCount() {
 }
 
 /**
- * Check if a camera model is supported
- * @param {string} model - Camera model name
+ * Check if a camera is supported
+ * @param {string} makeOrName - "Make Model" display name, or the make when `model` is given
+ * @param {string} [model] - Model as written in the file (EXIF or LibRaw-normalized)
+ * @returns {boolean}
+ */
+function isSupportedCamera(makeOrName, model) {
+    if (!native) return false;
+    return model === undefined
+        ? native.isSupportedCamera(makeOrName)
+        : native.isSupportedCamera(makeOrName, model);
+}
+
+/**
+ * Look up a camera in the index
+ * @param {string} makeOrName - "Make Model" display name, or the make when `model` is given
+ * @param {string} [model]
+ * @returns {Object|null} CameraInfo
+ */
+function lookupCamera(makeOrName, model) {
+    if (!native) return null;
+    return model === undefined
+        ? native.lookupCamera(makeOrName)
+        : native.lookupCamera(makeOrName, model);
+}
+
+/**
+ * Batch lookup (one native call)
+ * @param {Array<string|{make: string, model: string}>} queries
+ * @returns {Array<Object|null>}
+ */
+function lookupCameras(queries) {
+    if (!native) return queries.map(() => null);
+    return native.lookupCameras(queries);
+}
+
+// ============================================================================
+// Metadata Records
+// ============================================================================
+
+// Schema is fixed for the lifetime of the addon
+let metadataSchemaCache = null;
+
+/**
+ * Get the packed metadata record layout (field names, types and offsets)
+ * @returns {{magic: number, version: number, headerSize: number, recordSize: number, fields: Array<{name: string, type: string, offset: number}>}}
+ */
+function getMetadataSchema() {
+    if (!native) {
+        throw loadError || new Error('Native LibRaw module not available');
+    }
+    if (!metadataSchemaCache) {
+        const schema = native.getMetadataSchema();
+        schema.fields.forEach(Object.freeze);
+        metadataSchemaCache = Object.freeze(schema);
+    }
+    return metadataSchemaCache;
+}
+
+/**
+ * Read metadata for many files in one native call (headers only, no unpack).
+ * Files that fail to open get a non-zero status instead of failing the batch.
+ * @param {string[]} paths
+ * @param {Object} [options]
+ * @param {number} [options.jobId=0] - Trace job id
+ * @returns {Promise<MetadataRecords>}
+ */
+function readMetadataBatch(paths, options = {}) {
+    const schema = getMetadataSchema();
+    return new Promise((resolve, reject) => {
+        native.readMetadataBatch(paths, options.jobId || 0, (err, buffer) => {
+            if (err) reject(err);
+            else resolve(new MetadataRecords(buffer, schema, paths.slice()));
+        });
+    });
+}
+
+// ============================================================================
+// Colour Conversion
+// ============================================================================
+
+/**
+ * Convert interleaved 8/16-bit RGB(A) pixels between colour spaces
+ * (16-bit samples in native byte order; alpha is copied)
+ * @param {Buffer} data
+ * @param {Object} options
+ * @param {number} options.width
+ * @param {number} options.height
+ * @param {number} [options.channels=3] - 3 or 4
+ * @param {number} [options.bits=8] - 8 or 16
+ * @param {number} options.from - ColorSpace constant of the input
+ * @param {number} options.to - ColorSpace constant of the output
+ * @param {number} [options.fromTransfer=Transfer.DEFAULT] - Input encoding
+ * @param {number} [options.toTransfer=Transfer.DEFAULT] - Output encoding
+ * @param {number} [options.jobId=0] - Trace job id
+ * @returns {Promise<Buffer>} Converted pixels (new buffer)
+ */
+function convertColorSpace(data, options) {
+    if (!native) {
+        return Promise.reject(loadError || new Error('Native LibRaw module not available'));
+    }
+    return promisify(native, 'convertColorSpace', data, options);
+}
+
+/**
+ * ICC profile describing a colour space with a transfer curve, for tagging
+ * converted output
+ * @param {number} colorSpace - ColorSpace constant
+ * @param {number} [transfer=Transfer.DEFAULT]
+ * @returns {Buffer}
+ */
+function getColorProfile(colorSpace, transfer = Transfer.DEFAULT) {
+    if (!native) {
+        throw loadError || new Error('Native LibRaw module not available');
+    }
+    return native.getColorProfile(colorSpace, transfer);
+}
+
+// ============================================================================
+// Derivative Images
+// ============================================================================
+
+/**
+ * Downsample one rendered image into several smaller ones in a single pass
+ * (area filter in linear light; each size is cascaded from the next larger)
+ * @param {Buffer} data - Interleaved 8/16-bit RGB(A), native byte order
+ * @param {Object} options
+ * @param {number} options.width
+ * @param {number} options.height
+ * @param {number} [options.channels=3] - 3 or 4
+ * @param {number} [options.bits=8] - 8 or 16
+ * @param {number} [options.transfer=Transfer.SRGB] - Encoding of the pixels
+ * @param {Array<{width?: number, height?: number}>} options.sizes - Bounding
+ *        boxes (fit inside, never enlarged; a missing side is unconstrained)
+ * @param {number} [options.pyramid] - Also append successive halvings while
+ *        the long edge stays at least this many pixels
+ * @param {number} [options.jobId=0] - Trace job id
+ * @returns {Promise<Array<{width: number, height: number, channels: number, bits: number, data: Buffer}>>}
+ *          One image per size, in order (pyramid levels last)
+ */
+function buildDerivatives(data, options) {
+    if (!native) {
+        return Promise.reject(loadError || new Error('Native LibRaw module not available'));
+    }
+    const sizes = [...options.sizes];
+    if (options.pyramid > 0) {
+        for (let scale = 2; Math.max(options.width, options.height) / scale >= options.pyramid; scale *= 2) {
+            sizes.push({
+                width: Math.max(1, Math.round(options.width / scale)),
+                height: Math.max(1, Math.round(options.height / scale))
+            });
+        }
+    }
+    return promisify(native, 'buildDerivatives', data, { ...options, sizes });
+}
+
+/**
+ * Render FilmLab edits onto many small images (thumbnails, grid previews)
+ * with the fixed-point preview kernel
+ *
+ * Per-channel stages are precomposed into 12-bit tables and the rest runs in
+ * integer arithmetic; output stays within a few codes of FilmLabSession.
+ * Images sharing a stages object share one kernel.
+ *
+ * @param {Array<{data: Buffer, width: number, height: number, channels?: number, bits?: number, stages?: Object}>} images -
+ *        Interleaved RGB(A), 8 or 16 bits; `stages` overrides options.stages
+ * @param {Object} [options]
+ * @param {Object} [options.stages] - RenderCore.getNativeStages() output for images without their own
+ * @param {number} [options.jobId=0] - Trace job id
+ * @returns {Promise<Array<{width: number, height: number, channels: 3, data: Buffer}>>} 8-bit RGB, in order
+ */
+function renderPreviews(images, options = {}) {
+    if (!native) {
+        return Promise.reject(loadError || new Error('Native LibRaw module not available'));
+    }
+    return promisify(native, 'renderPreviews', images, options);
+}
+
+/**
+ * Render one small image under many sets of FilmLab stages (look pickers,
+ * film profile strips) with the fixed-point preview kernel
+ *
+ * The variants' kernels are built in parallel, and each band of source rows
+ * goes through every variant while it is still in cache, so the image is read
+ * once for the whole set.
+ *
+ * @param {{data: Buffer, width: number, height: number, channels?: number, bits?: number}} image -
+ *        Interleaved RGB(A), 8 or 16 bits
+ * @param {Object[]} stages - RenderCore.getNativeStages() output, one per variant
+ * @param {Object} [options]
+ * @param {number} [options.jobId=0] - Trace job id
+ * @returns {Promise<Array<{width: number, height: number, channels: 3, data: Buffer}>>} 8-bit RGB, one per stages entry
+ */
+function renderVariants(image, stages, options = {}) {
+    if (!native) {
+        return Promise.reject(loadError || new Error('Native LibRaw module not available'));
+    }
+    return promisify(native, 'renderVariants', image, stages, options);
+}
+
+/**
+ * Render FilmLab edits at full resolution with bounded memory
+ *
+ * The source is an uncompressed TIFF (e.g. the geometry-transformed scan
+ * written by sharp with `tiff({ compression: 'none', tile: true })`), which
+ * is memory-mapped. Bands of rows run through the float kernel on every core
+ * and go straight into the JPEG encoder or a 16-bit TIFF written strip by
+ * strip, so memory stays at a few bands per thread whatever the image size.
+ *
+ * @param {string} inputPath - 8/16-bit gray or RGB(A) TIFF, strips or tiles
+ * @param {Object} stages - RenderCore.getNativeStages() output
+ * @param {Object} [options]
+ * @param {string} [options.format='jpeg'] - 'jpeg' (returned as `data`) or
+ *        'tiff16' (uncompressed, written to outputPath; BigTIFF over 4 GB)
+ * @param {string} [options.outputPath] - Output file, required for 'tiff16'
+ * @param {{left: number, top: number, width: number, height: number}} [options.region] -
+ *        Source rectangle to render (crop); default the whole image
+ * @param {number} [options.quality=90] - JPEG quality 1-100
+ * @param {string} [options.subsampling='420'] - '420' or '444'
+ * @param {Buffer} [options.iccProfile] - ICC profile to embed
+ * @param {number} [options.stripRows=64] - Rows per TIFF strip
+ * @param {number} [options.jobId=0] - Trace job id
+ * @returns {Promise<{width: number, height: number, sourceBits: number, format: string, data?: Buffer, path?: string}>}
+ */
+function renderTiled(inputPath, stages, options = {}) {
+    if (!native) {
+        return Promise.reject(loadError || new Error('Native LibRaw module not available'));
+    }
+    return promisify(native, 'renderTiled', inputPath, stages, options);
+}
+
+/**
+ * Encode interleaved pixels as a baseline JPEG natively (no sharp pipeline);
+ * large images are entropy-coded in parallel bands
+ * @param {Buffer} data - Interleaved 8/16-bit gray, RGB or RGBA (alpha
+ *        dropped), native byte order; 16-bit keeps the high byte
+ * @param {Object} options
+ * @param {number} options.width
+ * @param {number} options.height
+ * @param {number} [options.channels=3] - 1, 3 or 4
+ * @param {number} [options.bits=8] - 8 or 16
+ * @param {number} [options.quality=90] - 1-100
+ * @param {string} [options.subsampling='420'] - '420' or '444'
+ * @param {Buffer} [options.iccProfile] - ICC profile to embed
+ * @param {number} [options.jobId=0] - Trace job id
+ * @returns {Promise<Buffer>}
+ */
+function encodeJpeg(data, options) {
+    if (!native) {
+        return Promise.reject(loadError || new Error('Native LibRaw module not available'));
+    }
+    return promisify(native, 'encodeJpeg', data, options);
+}
+
+/**
+ * Decode a baseline JPEG natively, optionally scaled down in the DCT domain;
+ * restart intervals are decoded in parallel. Progressive JPEGs are rejected.
+ * @param {Buffer} data - JPEG file contents
+ * @param {Object} [options]
+ * @param {number} [options.scale=1] - 1, 2, 4 or 8: output is ceil(size / scale)
+ * @param {number} [options.jobId=0] - Trace job id
+ * @returns {Promise<{width: number, height: number, colors: number, bits: number, data: Buffer}>}
+ */
+function decodeJpeg(data, options = {}) {
+    if (!native) {
+        return Promise.reject(loadError || new Error('Native LibRaw module not available'));
+    }
+    return promisify(native, 'decodeJpeg', data, options);
+}
+
+/**
+ * Write EXIF/XMP/IPTC into an encoded JPEG or TIFF in memory, so an export is
+ * written once with its metadata instead of being rewritten by exiftool
+ *
+ * Tags use exiftool names: Make, Model, LensMake, LensModel, FNumber,
+ * ExposureTime, ISO, FocalLength, FocalLengthIn35mmFormat, DateTimeOriginal,
+ * CreateDate, ModifyDate, Orientation, ImageDescription, UserComment,
+ * Artist, Copyright, Software, GPSLatitude/GPSLongitude/GPSAltitude (signed
+ * decimals set the Ref tags), Subject (dc:subject), Keywords (IPTC and
+ * dc:subject), XMP-dc:Title/Description/Creator/Rights and any
+ * XMP-FilmGallery:<Name>. Existing EXIF entries are kept unless set; any XMP
+ * tag replaces the packet and Keywords replaces the IPTC record.
+ * @param {Buffer} data - JPEG or classic TIFF file contents
+ * @param {Object<string, string|number|Array>} tags - null/undefined skipped
+ * @param {Object} [options]
+ * @param {number} [options.jobId=0] - Trace job id
+ * @returns {Promise<Buffer>} New file contents
+ */
+function writeMetadata(data, tags, options = {}) {
+    if (!native) {
+        return Promise.reject(loadError || new Error('Native LibRaw module not available'));
+    }
+    return promisify(native, 'writeMetadata', data, tags, options);
+}
+
+// ============================================================================
+// Tracing (Chrome trace-event format)
+// ============================================================================
+
+// Largest trace ring buffer, in spans
+const TRACE_MAX_CAPACITY = native?.TRACE_MAX_CAPACITY || 262144;
+
+/**
+ * Start recording trace spans into the native ring buffer
+ * @param {Object} [options]
+ * @param {number} [options.capacity=65536] - Maximum number of spans kept, up to TRACE_MAX_CAPACITY
+ * @throws {RangeError} When capacity is not an integer in 0..TRACE_MAX_CAPACITY
+ */
+function enableTracing(options = {}) {
+    if (!native) return;
+    native.enableTracing(options.capacity ?? 0);
+}
+
+/**
+ * Stop recording trace spans (recorded spans are kept until re-enabled)
+ */
+function disableTracing() {
+    if (!native) return;
+    native.disableTracing();
+}
+
+/**
+ * Check if tracing is currently enabled
  * @returns {boolean}
  */
-function isSupportedCamera(model) {
+function isTracingEnabled() {
     if (!native) return false;
-    return native.isSupportedCamera(model);
+    return native.isTracingEnabled();
+}
+
+/**
+ * Current time on the trace clock
+ * @returns {number} Microseconds
+ */
+function traceNow() {
+    if (!native) return 0;
+    return native.traceNow();
+}
+
+/**
+ * Record a JS-side span into the native trace buffer
+ * @param {string} name - Span name
+ * @param {string} category - Span category (e.g. 'render', 'encode')
+ * @param {number} startUs - Start time from traceNow()
+ * @param {number} endUs - End time from traceNow()
+ * @param {number} [jobId=0] - Job id
+ * @param {boolean} [isAsync=false] - Record on an async track (awaited work)
+ */
+function recordTraceSpan(name, category, startUs, endUs, jobId = 0, isAsync = false) {
+    if (!native || !native.isTracingEnabled()) return;
+    native.recordTraceSpan(name, category, startUs, endUs, jobId, isAsync);
+}
+
+/**
+ * Run `fn` and record it as a span. Promises are awaited and recorded on an
+ * async track, since other work interleaves on the main thread meanwhile.
+ * @template T
+ * @param {string} name - Span name
+ * @param {string} category - Span category
+ * @param {number} jobId - Job id (0 = untagged)
+ * @param {() => T} fn - Work to measure
+ * @returns {T}
+ */
+function traceSpan(name, category, jobId, fn) {
+    if (!native || !native.isTracingEnabled()) return fn();
+
+    const start = native.traceNow();
+    const result = fn();
+    if (result && typeof result.then === 'function') {
+        return result.finally(() => {
+            recordTraceSpan(name, category, start, native.traceNow(), jobId, true);
+        });
+    }
+    recordTraceSpan(name, category, start, native.traceNow(), jobId, false);
+    return result;
+}
+
+/**
+ * Export recorded spans as a Chrome trace object (chrome://tracing, Perfetto)
+ * @param {Object} [options]
+ * @param {number} [options.since] - Window start (traceNow() microseconds)
+ * @param {number} [options.until] - Window end (traceNow() microseconds)
+ * @param {number} [options.jobId] - Only spans of this job
+ * @returns {{traceEvents: Object[], displayTimeUnit: string}}
+ */
+function dumpTrace(options = {}) {
+    if (!native) return { traceEvents: [], displayTimeUnit: 'ms' };
+    return JSON.parse(native.dumpTrace(options));
+}
+
+/**
+ * Write recorded spans to a JSON file loadable by chrome://tracing or Perfetto
+ * @param {string} filePath - Output path
+ * @param {Object} [options] - Same filters as dumpTrace()
+ * @returns {Promise<void>}
+ */
+async function writeTrace(filePath, options = {}) {
+    const json = native ? native.dumpTrace(options) : JSON.stringify(dumpTrace());
+    await fs.promises.writeFile(filePath, json);
+}
+
+// Opt-in at startup: LIBRAW_NATIVE_TRACE=1 (default capacity) or =<capacity>
+if (native && process.env.LIBRAW_NATIVE_TRACE) {
+    const capacity = parseInt(process.env.LIBRAW_NATIVE_TRACE, 10);
+    enableTracing({ capacity: capacity > 1 ? Math.min(capacity, TRACE_MAX_CAPACITY) : 0 });
 }
 
 /**
@@ -367,17 +1283,45 @@ function getLoadError() {
 module.exports = {
     // Main class
     LibRawProcessor,
+    FilmLabSession,
+    FilmLabEditSession,
     
     // Module functions
     getVersion,
     getCameraList,
     getCameraCount,
     isSupportedCamera,
+    lookupCamera,
+    lookupCameras,
+    getMetadataSchema,
+    readMetadataBatch,
+    MetadataRecords,
+    convertColorSpace,
+    getColorProfile,
+    buildDerivatives,
+    renderPreviews,
+    renderVariants,
+    renderTiled,
+    encodeJpeg,
+    decodeJpeg,
+    writeMetadata,
     isAvailable,
     getLoadError,
     
+    // Tracing
+    enableTracing,
+    TRACE_MAX_CAPACITY,
+    disableTracing,
+    isTracingEnabled,
+    traceNow,
+    recordTraceSpan,
+    traceSpan,
+    dumpTrace,
+    writeTrace,
+    
     // Constants
     ColorSpace,
+    Transfer,
     DemosaicQuality,
     HighlightMode
 };
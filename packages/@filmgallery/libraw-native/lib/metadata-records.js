@@ -0,0 +1,166 @@
+/**
+ * @filmgallery/libraw-native - Packed Metadata Records
+ *
+ * Reader for the fixed-layout metadata blocks produced by
+ * processor.getMetadataRecord() and readMetadataBatch(). Fields are read
+ * straight from the ArrayBuffer on demand; nothing is materialized until
+ * asked for. The layout is described in src/metadata_record.h.
+ */
+
+'use strict';
+
+const HEADER = {
+    magic: 0,
+    version: 4,
+    headerSize: 6,
+    count: 8,
+    recordSize: 12,
+    fieldCount: 16,
+    poolOffset: 20,
+    poolSize: 24
+};
+
+const SQL_TYPES = { i32: 'INTEGER', u32: 'INTEGER', f64: 'REAL', string: 'TEXT' };
+
+class MetadataRecords {
+    /**
+     * @param {ArrayBuffer} buffer - Block returned by the native addon
+     * @param {Object} schema - Result of getMetadataSchema()
+     * @param {string[]} [paths] - Source paths, one per record (batch reads)
+     */
+    constructor(buffer, schema, paths = null) {
+        const view = new DataView(buffer);
+        if (view.getUint32(HEADER.magic, true) !== schema.magic) {
+            throw new Error('Not a metadata record block');
+        }
+        if (view.getUint16(HEADER.version, true) !== schema.version ||
+            view.getUint32(HEADER.recordSize, true) !== schema.recordSize ||
+            view.getUint32(HEADER.fieldCount, true) !== schema.fields.length) {
+            throw new Error('Metadata record block does not match the schema');
+        }
+
+        this.buffer = buffer;
+        this.schema = schema;
+        this.paths = paths;
+        this.length = view.getUint32(HEADER.count, true);
+
+        this._view = view;
+        this._bytes = Buffer.from(buffer);
+        this._recordsOffset = view.getUint16(HEADER.headerSize, true);
+        this._recordSize = schema.recordSize;
+        this._poolOffset = view.getUint32(HEADER.poolOffset, true);
+        // Pool strings are interned natively, so equal strings share an offset
+        this._strings = new Map();
+        this._readers = new Map(schema.fields.map(f => [f.name, this._createReader(f)]));
+        this._fieldReaders = schema.fields.map(f => this._readers.get(f.name));
+    }
+
+    _createReader(field) {
+        const view = this._view;
+        const offset = field.offset;
+        switch (field.type) {
+            case 'i32': return (base) => view.getInt32(base + offset, true);
+            case 'u32': return (base) => view.getUint32(base + offset, true);
+            case 'f64': return (base) => view.getFloat64(base + offset, true);
+            case 'string': return (base) => this._string(
+                view.getUint32(base + offset, true),
+                view.getUint32(base + offset + 4, true)
+            );
+            default: throw new Error(`Unknown metadata field type: ${field.type}`);
+        }
+    }
+
+    _string(offset, length) {
+        if (length === 0) return '';
+        let value = this._strings.get(offset);
+        if (value === undefined) {
+            const start = this._poolOffset + offset;
+            value = this._bytes.toString('utf8', start, start + length);
+            this._strings.set(offset, value);
+        }
+        return value;
+    }
+
+    _base(index) {
+        if (index < 0 || index >= this.length) {
+            throw new RangeError(`Record index ${index} out of range (0-${this.length - 1})`);
+        }
+        return this._recordsOffset + index * this._recordSize;
+    }
+
+    /**
+     * Column names, in schema (and toRow) order
+     * @returns {string[]}
+     */
+    get columns() {
+        return this.schema.fields.map(f => f.name);
+    }
+
+    /**
+     * Column names with SQLite type affinities, for CREATE TABLE
+     * @returns {Array<{name: string, type: string}>}
+     */
+    get sqlColumns() {
+        return this.schema.fields.map(f => ({ name: f.name, type: SQL_TYPES[f.type] }));
+    }
+
+    /**
+     * LibRaw error code for a record (0 when the file was read)
+     * @param {number} index
+     * @returns {number}
+     */
+    status(index) {
+        return this._view.getInt32(this._base(index), true);
+    }
+
+    /**
+     * Read a single field
+     * @param {number} index - Record index
+     * @param {string} name - Field name (see columns)
+     * @returns {number|string}
+     */
+    get(index, name) {
+        const reader = this._readers.get(name);
+        if (!reader) throw new Error(`Unknown metadata field: ${name}`);
+        return reader(this._base(index));
+    }
+
+    /**
+     * Materialize one record as a plain object keyed by field name
+     * @param {number} index
+     * @returns {Object}
+     */
+    toObject(index) {
+        const base = this._base(index);
+        const result = {};
+        if (this.paths) result.path = this.paths[index];
+        this.schema.fields.forEach((f, i) => {
+            result[f.name] = this._fieldReaders[i](base);
+        });
+        return result;
+    }
+
+    /**
+     * Values in column order for a prepared INSERT. Empty strings and NaN
+     * (e.g. missing GPS) become null.
+     * @param {number} index
+     * @returns {Array<number|string|null>}
+     */
+    toRow(index) {
+        const base = this._base(index);
+        const row = new Array(this._fieldReaders.length);
+        for (let i = 0; i < row.length; i++) {
+            const value = this._fieldReaders[i](base);
+            row[i] = value === '' || Number.isNaN(value) ? null : value;
+        }
+        return row;
+    }
+
+    *[Symbol.iterator]() {
+        for (let i = 0; i < this.length; i++) {
+            yield this.toObject(i);
+        }
+    }
+}
+
+module.exports = { MetadataRecords };
@@ -22,9 +22,58 @@ const DEFAULT_OPTIONS = {
     useAutoWB: false,
     noAutoBright: true,
     halfSize: false,
-    highlightMode: 0
+    highlightMode: 0,
+    histogramBins: 256,
+    monochrome: null
 };
 
+/**
+ * `monochrome` option for the sharp-encoded outputs, which need integer
+ * samples (float luminance is only returned by decodeRaw())
+ */
+function integerMonochrome(monochrome) {
+    if (!monochrome || monochrome === true) return monochrome;
+    return { ...monochrome, float: false };
+}
+
+/**
+ * Load `input` into `processor`, configure it from `options` (merged with
+ * DEFAULT_OPTIONS) and process it
+ * @returns {Promise<{metadata: Object, sizeInfo: Object, processResult: Object}>}
+ */
+async function loadAndProcess(processor, input, options) {
+    const opts = { ...DEFAULT_OPTIONS, ...options };
+    
+    // Load file or buffer
+    if (typeof input === 'string') {
+        await processor.loadFile(input);
+    } else if (Buffer.isBuffer(input)) {
+        await processor.loadBuffer(input);
+    } else {
+        throw new Error('Input must be a file path or Buffer');
+    }
+    
+    // Get metadata before processing
+    const metadata = processor.getMetadata();
+    const sizeInfo = processor.getImageSize();
+    
+    // Configure processing parameters
+    processor.setOutputColorSpace(opts.colorSpace);
+    processor.setOutputBps(opts.outputBps);
+    processor.setQuality(opts.quality);
+    processor.setUseCameraWB(opts.useCameraWB);
+    processor.setUseAutoWB(opts.useAutoWB);
+    processor.setNoAutoBright(opts.noAutoBright);
+    processor.setHalfSize(opts.halfSize);
+    processor.setHighlightMode(opts.highlightMode);
+    processor.setHistogramBins(opts.histogramBins);
+    processor.setMonochrome(opts.monochrome);
+    
+    // Process
+    const processResult = await processor.dcrawProcess();
+    return { metadata, sizeInfo, processResult };
+}
+
 /**
  * Decode a RAW file and return raw pixel data
  * 
@@ -37,38 +86,17 @@ const DEFAULT_OPTIONS = {
  * @param {boolean} [options.useAutoWB=false] - Use auto white balance
  * @param {boolean} [options.noAutoBright=true] - Disable auto brightness
  * @param {boolean} [options.halfSize=false] - Output half-size image
- * @returns {Promise<{data: Buffer, width: number, height: number, bits: number, colors: number, metadata: Object}>}
+ * @param {number} [options.histogramBins=256] - Histogram bins per colour (0: none)
+ * @param {boolean|Object} [options.monochrome=null] - Bayer images straight to
+ *        one luminance channel (see LibRawProcessor.setMonochrome; `float`
+ *        gives 32-bit float linear samples)
+ * @returns {Promise<{data: Buffer, width: number, height: number, bits: number, colors: number, histogram: Object|null, whiteLevel: number, metadata: Object}>}
  */
 async function decodeRaw(input, options = {}) {
-    const opts = { ...DEFAULT_OPTIONS, ...options };
     const processor = new LibRawProcessor();
     
     try {
-        // Load file or buffer
-        if (typeof input === 'string') {
-            await processor.loadFile(input);
-        } else if (Buffer.isBuffer(input)) {
-            await processor.loadBuffer(input);
-        } else {
-            throw new Error('Input must be a file path or Buffer');
-        }
-        
-        // Get metadata before processing
-        const metadata = processor.getMetadata();
-        const sizeInfo = processor.getImageSize();
-        
-        // Configure processing parameters
-        processor.setOutputColorSpace(opts.colorSpace);
-        processor.setOutputBps(opts.outputBps);
-        processor.setQuality(opts.quality);
-        processor.setUseCameraWB(opts.useCameraWB);
-        processor.setUseAutoWB(opts.useAutoWB);
-        processor.setNoAutoBright(opts.noAutoBright);
-        processor.setHalfSize(opts.halfSize);
-        processor.setHighlightMode(opts.highlightMode);
-        
-        // Process
-        await processor.dcrawProcess();
+        const { metadata, sizeInfo, processResult } = await loadAndProcess(processor, input, options);
         
         // Get image data
         const imageResult = await processor.makeMemImage();
@@ -79,6 +107,8 @@ async function decodeRaw(input, options = {}) {
             height: imageResult.height,
             bits: imageResult.bits,
             colors: imageResult.colors,
+            histogram: processResult.histogram,
+            whiteLevel: processResult.whiteLevel,
             metadata: {
                 ...metadata,
                 ...sizeInfo
@@ -95,11 +125,40 @@ async function decodeRaw(input, options = {}) {
  * @param {string|Buffer} input - File path or Buffer
  * @param {Object} options - Processing options
  * @param {number} [options.quality=95] - JPEG quality (1-100)
- * @param {boolean} [options.progressive=false] - Progressive JPEG
+ * @param {boolean} [options.progressive=false] - Progressive JPEG (through sharp;
+ *        baseline JPEGs are encoded natively from the processed image)
  * @returns {Promise<{buffer: Buffer, metadata: Object}>}
  */
 async function decodeToJPEG(input, options = {}) {
-    const rawResult = await decodeRaw(input, options);
+    if (!options.progressive) {
+        const processor = new LibRawProcessor();
+        try {
+            const { metadata, sizeInfo } = await loadAndProcess(processor, input, {
+                ...options,
+                monochrome: integerMonochrome(options.monochrome)
+            });
+            const jpeg = await processor.makeJpeg({ quality: options.quality || 95 });
+            return {
+                buffer: jpeg.data,
+                success: true,
+                metadata: {
+                    ...metadata,
+                    ...sizeInfo,
+                    outputDimensions: {
+                        width: jpeg.width,
+                        height: jpeg.height
+                    }
+                }
+            };
+        } finally {
+            processor.close();
+        }
+    }
+    
+    const rawResult = await decodeRaw(input, {
+        ...options,
+        monochrome: integerMonochrome(options.monochrome)
+    });
     
     // Convert raw RGB data to JPEG using sharp
     const channels = rawResult.colors;
@@ -143,7 +202,8 @@ async function decodeToJPEG(input, options = {}) {
 async function decodeToTIFF(input, options = {}) {
     const rawResult = await decodeRaw(input, {
         ...options,
-        outputBps: 16  // Always use 16-bit for TIFF
+        outputBps: 16,  // Always use 16-bit for TIFF
+        monochrome: integerMonochrome(options.monochrome)
     });
     
     const channels = rawResult.colors;
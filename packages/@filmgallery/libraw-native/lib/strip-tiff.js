@@ -0,0 +1,165 @@
+/**
+ * @filmgallery/libraw-native - Strip TIFF Writer
+ *
+ * Streams an image that makeMemImage() returned in strips to an uncompressed
+ * TIFF file, one strip in memory at a time. Each addon strip becomes one TIFF
+ * strip, so readers such as sharp/libvips can load it sequentially. Files of
+ * 4 GB and over are written as BigTIFF. An ICC profile (e.g. getColorProfile()
+ * for an export colour space) can be embedded.
+ */
+
+'use strict';
+
+const fs = require('fs');
+
+const TAG = {
+    ImageWidth: 256,
+    ImageLength: 257,
+    BitsPerSample: 258,
+    Compression: 259,
+    PhotometricInterpretation: 262,
+    StripOffsets: 273,
+    SamplesPerPixel: 277,
+    RowsPerStrip: 278,
+    StripByteCounts: 279,
+    PlanarConfiguration: 284,
+    SampleFormat: 339,
+    ICCProfile: 34675
+};
+
+const UNDEFINED = 7;
+const SHORT = 3;
+const LONG = 4;
+const LONG8 = 16;
+
+/**
+ * Build header + IFD + out-of-line tag data for a strip layout
+ * @returns {{ header: Buffer, stripOffsets: number[] }}
+ */
+function buildHeader(image, iccProfile) {
+    const { width, height, colors, bits, stride, stripHeight, stripCount } = image;
+    const stripBytes = [];
+    for (let i = 0; i < stripCount; i++) {
+        stripBytes.push(Math.min(stripHeight, height - i * stripHeight) * stride);
+    }
+    const dataSize = stripBytes.reduce((a, b) => a + b, 0);
+
+    // Header/IFD is tiny next to the pixels; 64 KB + 16 B per strip is plenty
+    const big = dataSize + 65536 + stripCount * 16 > 0xffffffff;
+    const offsetSize = big ? 8 : 4;
+    const entrySize = big ? 20 : 12;
+    const headerSize = big ? 16 : 8;
+    const offsetType = big ? LONG8 : LONG;
+
+    const entries = [
+        [TAG.ImageWidth, LONG, [width]],
+        [TAG.ImageLength, LONG, [height]],
+        [TAG.BitsPerSample, SHORT, new Array(colors).fill(bits)],
+        [TAG.Compression, SHORT, [1]],
+        [TAG.PhotometricInterpretation, SHORT, [colors >= 3 ? 2 : 1]],
+        [TAG.StripOffsets, offsetType, null],      // filled below
+        [TAG.SamplesPerPixel, SHORT, [colors]],
+        [TAG.RowsPerStrip, LONG, [stripHeight]],
+        [TAG.StripByteCounts, offsetType, stripBytes],
+        [TAG.PlanarConfiguration, SHORT, [1]]
+    ];
+    if (bits === 32) {
+        // Float monochrome (setMonochrome({ float: true }))
+        entries.push([TAG.SampleFormat, SHORT, new Array(colors).fill(3)]);
+    }
+    if (iccProfile) {
+        entries.push([TAG.ICCProfile, UNDEFINED, iccProfile]);
+    }
+    const typeSize = { [UNDEFINED]: 1, [SHORT]: 2, [LONG]: 4, [LONG8]: 8 };
+
+    // IFD: count, entries, next-IFD offset; out-of-line values follow it
+    const ifdSize = (big ? 8 : 2) + entries.length * entrySize + offsetSize;
+    let extra = 0;
+    const extraOffsets = entries.map(([, type, values]) => {
+        const bytes = typeSize[type] * (values ? values.length : stripCount);
+        if (bytes <= offsetSize) return null;
+        const offset = headerSize + ifdSize + extra;
+        extra += (bytes + 7) & ~7;
+        return offset;
+    });
+    const pixelStart = headerSize + ifdSize + extra;
+
+    const stripOffsets = [];
+    let offset = pixelStart;
+    for (const bytes of stripBytes) {
+        stripOffsets.push(offset);
+        offset += bytes;
+    }
+    entries[5][2] = stripOffsets;
+
+    const header = Buffer.alloc(pixelStart);
+    const writeValue = (type, pos, value) => {
+        if (type === UNDEFINED) header.writeUInt8(value, pos);
+        else if (type === SHORT) header.writeUInt16LE(value, pos);
+        else if (type === LONG) header.writeUInt32LE(value, pos);
+        else header.writeBigUInt64LE(BigInt(value), pos);
+    };
+    const writeOffset = (pos, value) => writeValue(big ? LONG8 : LONG, pos, value);
+
+    // Header
+    header.write('II', 0, 'latin1');
+    if (big) {
+        header.writeUInt16LE(43, 2);
+        header.writeUInt16LE(8, 4);
+        writeOffset(8, headerSize);
+    } else {
+        header.writeUInt16LE(42, 2);
+        writeOffset(4, headerSize);
+    }
+
+    // IFD
+    let pos = headerSize;
+    if (big) {
+        header.writeBigUInt64LE(BigInt(entries.length), pos);
+        pos += 8;
+    } else {
+        header.writeUInt16LE(entries.length, pos);
+        pos += 2;
+    }
+    entries.forEach(([tag, type, values], i) => {
+        header.writeUInt16LE(tag, pos);
+        header.writeUInt16LE(type, pos + 2);
+        if (big) header.writeBigUInt64LE(BigInt(values.length), pos + 4);
+        else header.writeUInt32LE(values.length, pos + 4);
+        const valuePos = pos + (big ? 12 : 8);
+        let target = valuePos;
+        if (extraOffsets[i] !== null) {
+            writeOffset(valuePos, extraOffsets[i]);
+            target = extraOffsets[i];
+        }
+        values.forEach((value, j) => writeValue(type, target + j * typeSize[type], value));
+        pos += entrySize;
+    });
+    writeOffset(pos, 0);
+
+    return { header, stripOffsets };
+}
+
+/**
+ * Write a strip-mode image to an uncompressed TIFF
+ * @param {LibRawProcessor} processor - Processor the image came from
+ * @param {Object} image - makeMemImage() result with stripCount/stripHeight
+ * @param {string} filePath - Output path
+ * @param {Object} [options]
+ * @param {Buffer} [options.iccProfile] - ICC profile to embed
+ */
+async function writeStripTiff(processor, image, filePath, options = {}) {
+    const { header, stripOffsets } = buildHeader(image, options.iccProfile);
+    const fd = await fs.promises.open(filePath, 'w');
+    try {
+        await fd.write(header, 0, header.length, 0);
+        for (let i = 0; i < image.stripCount; i++) {
+            const strip = await processor.readImageStrip(i);
+            await fd.write(strip.data, 0, strip.data.length, stripOffsets[i]);
+        }
+    } finally {
+        await fd.close();
+    }
+}
+
+module.exports = { writeStripTiff };
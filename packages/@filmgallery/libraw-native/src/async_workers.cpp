@@ -5,7 +5,10 @@
  */
 
 #include "async_workers.h"
+#include "parallel.h"
+#include <algorithm>
 #include <cstring>
+#include <memory>
 
 // Note: libraw_strerror is provided by LibRaw library (libraw_c_api.cpp)
 // We use extern declaration to reference it
@@ -15,19 +18,29 @@ extern "C" const char* libraw_strerror(int errorcode);
 // LibRawAsyncWorker (Base class)
 // ============================================================================
 
-LibRawAsyncWorker::LibRawAsyncWorker(Napi::Function& callback, LibRaw* processor)
-    : Napi::AsyncWorker(callback), processor_(processor), error_code_(0) {
+LibRawAsyncWorker::LibRawAsyncWorker(Napi::Function& callback, FilmLibRaw* processor)
+    : Napi::AsyncWorker(callback), processor_(processor), error_code_(0),
+      trace_job_(0), queued_at_(TraceIsEnabled() ? TraceNow() : 0) {
+}
+
+void LibRawAsyncWorker::TraceQueueWait() {
+    if (queued_at_) {
+        TraceRecordAsync("queue_wait", "queue", queued_at_, TraceNow(), trace_job_);
+    }
 }
 
 // ============================================================================
 // LoadFileWorker
 // ============================================================================
 
-LoadFileWorker::LoadFileWorker(Napi::Function& callback, LibRaw* processor, const std::string& path)
+LoadFileWorker::LoadFileWorker(Napi::Function& callback, FilmLibRaw* processor, const std::string& path)
     : LibRawAsyncWorker(callback, processor), file_path_(path) {
 }
 
 void LoadFileWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("open_file", "decode", trace_job_);
+    
     error_code_ = processor_->open_file(file_path_.c_str());
     if (error_code_ != LIBRAW_SUCCESS) {
         error_message_ = std::string("Failed to open file: ") + libraw_strerror(error_code_);
@@ -52,7 +65,7 @@ void LoadFileWorker::OnOK() {
 // LoadBufferWorker
 // ============================================================================
 
-LoadBufferWorker::LoadBufferWorker(Napi::Function& callback, LibRaw* processor,
+LoadBufferWorker::LoadBufferWorker(Napi::Function& callback, FilmLibRaw* processor,
                                    const char* data, size_t size)
     : LibRawAsyncWorker(callback, processor) {
     // Copy buffer data to ensure it remains valid during async execution
@@ -60,6 +73,9 @@ LoadBufferWorker::LoadBufferWorker(Napi::Function& callback, LibRaw* processor,
 }
 
 void LoadBufferWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("open_buffer", "decode", trace_job_);
+    
     error_code_ = processor_->open_buffer(buffer_data_.data(), buffer_data_.size());
     if (error_code_ != LIBRAW_SUCCESS) {
         error_message_ = std::string("Failed to open buffer: ") + libraw_strerror(error_code_);
@@ -78,16 +94,213 @@ void LoadBufferWorker::OnOK() {
     Callback().Call({Env().Null(), result});
 }
 
+// ============================================================================
+// OpenSnapshotWorker
+// ============================================================================
+
+OpenSnapshotWorker::OpenSnapshotWorker(Napi::Function& callback, FilmLibRaw* processor,
+                                       const std::string& path, const uint8_t* data, size_t size)
+    : LibRawAsyncWorker(callback, processor),
+      file_path_(path), snapshot_(data, data + size), status_(SNAPSHOT_INVALID) {
+}
+
+void OpenSnapshotWorker::Execute() {
+    TraceQueueWait();
+    {
+        TraceScope trace("open_snapshot", "decode", trace_job_);
+        status_ = processor_->OpenWithSnapshot(
+            file_path_.c_str(), snapshot_.data(), snapshot_.size());
+    }
+    if (status_ == SNAPSHOT_OK) {
+        return;
+    }
+    
+    // Stale or foreign snapshot: identify the file the normal way
+    TraceScope trace("open_file", "decode", trace_job_);
+    error_code_ = processor_->open_file(file_path_.c_str());
+    if (error_code_ != LIBRAW_SUCCESS) {
+        error_message_ = std::string("Failed to open file: ") + libraw_strerror(error_code_);
+        SetError(error_message_);
+    }
+}
+
+void OpenSnapshotWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("success", Napi::Boolean::New(Env(), true));
+    result.Set("width", Napi::Number::New(Env(), processor_->imgdata.sizes.width));
+    result.Set("height", Napi::Number::New(Env(), processor_->imgdata.sizes.height));
+    result.Set("rawWidth", Napi::Number::New(Env(), processor_->imgdata.sizes.raw_width));
+    result.Set("rawHeight", Napi::Number::New(Env(), processor_->imgdata.sizes.raw_height));
+    result.Set("fromSnapshot", Napi::Boolean::New(Env(), status_ == SNAPSHOT_OK));
+    result.Set("snapshotStatus", Napi::String::New(Env(), SnapshotStatusMessage(status_)));
+    
+    Callback().Call({Env().Null(), result});
+}
+
+// ============================================================================
+// MosaicWriteWorker
+// ============================================================================
+
+MosaicWriteWorker::MosaicWriteWorker(Napi::Function& callback, FilmLibRaw* processor,
+                                     const std::string& path, const std::string& cache_path,
+                                     Napi::Function* written)
+    : LibRawAsyncWorker(callback, processor),
+      file_path_(path), cache_path_(cache_path), bytes_(0) {
+    if (written) {
+        written_ = Napi::Persistent(*written);
+    }
+}
+
+void MosaicWriteWorker::Execute() {
+    TraceQueueWait();
+    if ((processor_->imgdata.progress_flags & LIBRAW_PROGRESS_THUMB_MASK) < LIBRAW_PROGRESS_LOAD_RAW) {
+        TraceScope trace("unpack", "decode", trace_job_);
+        error_code_ = processor_->Unpack();
+        if (error_code_ != LIBRAW_SUCCESS) {
+            error_message_ = std::string("Failed to unpack: ") + libraw_strerror(error_code_);
+            SetError(error_message_);
+            return;
+        }
+    }
+    
+    if (!written_.IsEmpty()) {
+        TraceScope trace("capture_mosaic", "io", trace_job_);
+        error_code_ = processor_->CaptureMosaic(file_path_.c_str(), capture_);
+    } else {
+        TraceScope trace("write_mosaic", "io", trace_job_);
+        error_code_ = processor_->SaveMosaic(file_path_.c_str(), cache_path_.c_str(), &bytes_);
+    }
+    if (error_code_ != LIBRAW_SUCCESS) {
+        error_message_ = std::string("Failed to write mosaic cache: ") + libraw_strerror(error_code_);
+        SetError(error_message_);
+    }
+}
+
+void MosaicWriteWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
+    const libraw_image_sizes_t& sizes = processor_->imgdata.sizes;
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("success", Napi::Boolean::New(Env(), true));
+    result.Set("rawBytes", Napi::Number::New(Env(), static_cast<double>(sizes.raw_pitch) * sizes.raw_height));
+    if (written_.IsEmpty()) {
+        result.Set("bytes", Napi::Number::New(Env(), static_cast<double>(bytes_)));
+        Callback().Call({Env().Null(), result});
+        return;
+    }
+    
+    Napi::Function written = written_.Value();
+    MosaicFlushWorker* flush = new MosaicFlushWorker(written, std::move(capture_), cache_path_);
+    flush->SetTraceJob(trace_job_);
+    flush->Queue();
+    Callback().Call({Env().Null(), result});
+}
+
+// ============================================================================
+// MosaicFlushWorker
+// ============================================================================
+
+MosaicFlushWorker::MosaicFlushWorker(Napi::Function& callback, MosaicCapture&& capture,
+                                     const std::string& cache_path)
+    : LibRawAsyncWorker(callback, nullptr),
+      capture_(std::move(capture)), cache_path_(cache_path), bytes_(0) {
+}
+
+void MosaicFlushWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("write_mosaic", "io", trace_job_);
+    
+    error_code_ = FilmLibRaw::WriteMosaic(capture_, cache_path_.c_str(), &bytes_);
+    if (error_code_ != LIBRAW_SUCCESS) {
+        error_message_ = std::string("Failed to write mosaic cache: ") + libraw_strerror(error_code_);
+        SetError(error_message_);
+    }
+}
+
+void MosaicFlushWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("success", Napi::Boolean::New(Env(), true));
+    result.Set("bytes", Napi::Number::New(Env(), static_cast<double>(bytes_)));
+    
+    Callback().Call({Env().Null(), result});
+}
+
+// ============================================================================
+// OpenMosaicWorker
+// ============================================================================
+
+OpenMosaicWorker::OpenMosaicWorker(Napi::Function& callback, FilmLibRaw* processor,
+                                   const std::string& path, const std::string& cache_path,
+                                   const uint8_t* snapshot, size_t snapshot_size)
+    : LibRawAsyncWorker(callback, processor),
+      file_path_(path), cache_path_(cache_path), snapshot_(snapshot, snapshot + snapshot_size),
+      mosaic_status_(SNAPSHOT_INVALID), snapshot_status_(SNAPSHOT_INVALID) {
+}
+
+void OpenMosaicWorker::Execute() {
+    TraceQueueWait();
+    {
+        TraceScope trace("open_mosaic", "decode", trace_job_);
+        mosaic_status_ = processor_->OpenWithMosaic(file_path_.c_str(), cache_path_.c_str());
+    }
+    if (mosaic_status_ == SNAPSHOT_OK) {
+        return;
+    }
+    
+    // Missing or stale cache: the identify snapshot still skips identify()
+    if (!snapshot_.empty()) {
+        TraceScope trace("open_snapshot", "decode", trace_job_);
+        snapshot_status_ = processor_->OpenWithSnapshot(
+            file_path_.c_str(), snapshot_.data(), snapshot_.size());
+        if (snapshot_status_ == SNAPSHOT_OK) {
+            return;
+        }
+    }
+    
+    TraceScope trace("open_file", "decode", trace_job_);
+    error_code_ = processor_->open_file(file_path_.c_str());
+    if (error_code_ != LIBRAW_SUCCESS) {
+        error_message_ = std::string("Failed to open file: ") + libraw_strerror(error_code_);
+        SetError(error_message_);
+    }
+}
+
+void OpenMosaicWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("success", Napi::Boolean::New(Env(), true));
+    result.Set("width", Napi::Number::New(Env(), processor_->imgdata.sizes.width));
+    result.Set("height", Napi::Number::New(Env(), processor_->imgdata.sizes.height));
+    result.Set("rawWidth", Napi::Number::New(Env(), processor_->imgdata.sizes.raw_width));
+    result.Set("rawHeight", Napi::Number::New(Env(), processor_->imgdata.sizes.raw_height));
+    result.Set("fromMosaic", Napi::Boolean::New(Env(), mosaic_status_ == SNAPSHOT_OK));
+    result.Set("mosaicStatus", Napi::String::New(Env(), SnapshotStatusMessage(mosaic_status_)));
+    result.Set("fromSnapshot", Napi::Boolean::New(Env(), snapshot_status_ == SNAPSHOT_OK));
+    if (!snapshot_.empty()) {
+        result.Set("snapshotStatus", Napi::String::New(Env(), SnapshotStatusMessage(snapshot_status_)));
+    }
+    
+    Callback().Call({Env().Null(), result});
+}
+
 // ============================================================================
 // UnpackWorker
 // ============================================================================
 
-UnpackWorker::UnpackWorker(Napi::Function& callback, LibRaw* processor)
+UnpackWorker::UnpackWorker(Napi::Function& callback, FilmLibRaw* processor)
     : LibRawAsyncWorker(callback, processor) {
 }
 
 void UnpackWorker::Execute() {
-    error_code_ = processor_->unpack();
+    TraceQueueWait();
+    TraceScope trace("unpack", "decode", trace_job_);
+    
+    error_code_ = processor_->Unpack();
     if (error_code_ != LIBRAW_SUCCESS) {
         error_message_ = std::string("Failed to unpack: ") + libraw_strerror(error_code_);
         SetError(error_message_);
@@ -107,14 +320,19 @@ void UnpackWorker::OnOK() {
 // ProcessWorker
 // ============================================================================
 
-ProcessWorker::ProcessWorker(Napi::Function& callback, LibRaw* processor)
-    : LibRawAsyncWorker(callback, processor) {
+ProcessWorker::ProcessWorker(Napi::Function& callback, FilmLibRaw* processor, int histogram_bins)
+    : LibRawAsyncWorker(callback, processor), histogram_bins_(histogram_bins),
+      colors_(0), white_level_(0), auto_bright_(false) {
 }
 
 void ProcessWorker::Execute() {
-    // First unpack if not already done
-    if (!processor_->imgdata.image) {
-        error_code_ = processor_->unpack();
+    TraceQueueWait();
+    TraceScope trace("dcraw_process", "decode", trace_job_);
+    
+    // First unpack if not already done (the LinearRaw fast path leaves
+    // imgdata.image empty, so check the stage instead)
+    if ((processor_->imgdata.progress_flags & LIBRAW_PROGRESS_THUMB_MASK) < LIBRAW_PROGRESS_LOAD_RAW) {
+        error_code_ = processor_->Unpack();
         if (error_code_ != LIBRAW_SUCCESS) {
             error_message_ = std::string("Failed to unpack: ") + libraw_strerror(error_code_);
             SetError(error_message_);
@@ -123,11 +341,21 @@ void ProcessWorker::Execute() {
     }
     
     // Process the image (demosaicing, white balance, etc.)
-    error_code_ = processor_->dcraw_process();
+    error_code_ = processor_->Process();
     if (error_code_ != LIBRAW_SUCCESS) {
         error_message_ = std::string("Failed to process: ") + libraw_strerror(error_code_);
         SetError(error_message_);
+        return;
+    }
+    
+    // LibRaw's own histogram and auto-bright white point, which the copy
+    // uses anyway, so callers need not recompute them from the output
+    colors_ = processor_->imgdata.idata.colors;
+    if (histogram_bins_ > 0) {
+        processor_->GetHistogram(histogram_bins_, histogram_);
     }
+    white_level_ = processor_->OutputWhiteLevel();
+    auto_bright_ = processor_->AutoBrightActive();
 }
 
 void ProcessWorker::OnOK() {
@@ -139,6 +367,22 @@ void ProcessWorker::OnOK() {
     result.Set("height", Napi::Number::New(Env(), processor_->imgdata.sizes.height));
     result.Set("iwidth", Napi::Number::New(Env(), processor_->imgdata.sizes.iwidth));
     result.Set("iheight", Napi::Number::New(Env(), processor_->imgdata.sizes.iheight));
+    result.Set("linear", Napi::Boolean::New(Env(), processor_->LinearImageActive()));
+    result.Set("monochrome", Napi::Boolean::New(Env(), processor_->MonochromeImageActive()));
+    result.Set("whiteLevel", Napi::Number::New(Env(), white_level_));
+    result.Set("autoBright", Napi::Boolean::New(Env(), auto_bright_));
+    
+    if (histogram_.empty()) {
+        result.Set("histogram", Env().Null());
+    } else {
+        Napi::Uint32Array data = Napi::Uint32Array::New(Env(), histogram_.size());
+        std::copy(histogram_.begin(), histogram_.end(), data.Data());
+        Napi::Object histogram = Napi::Object::New(Env());
+        histogram.Set("bins", Napi::Number::New(Env(), histogram_bins_));
+        histogram.Set("channels", Napi::Number::New(Env(), colors_));
+        histogram.Set("data", data);
+        result.Set("histogram", histogram);
+    }
     
     Callback().Call({Env().Null(), result});
 }
@@ -147,17 +391,42 @@ void ProcessWorker::OnOK() {
 // MakeMemImageWorker
 // ============================================================================
 
-MakeMemImageWorker::MakeMemImageWorker(Napi::Function& callback, LibRaw* processor)
-    : LibRawAsyncWorker(callback, processor), image_(nullptr) {
+int MemImageStripHeight(const MemImageLayout& layout) {
+    const size_t kStripBytes = 64 * 1024 * 1024;
+    size_t rows = layout.stride ? kStripBytes / layout.stride : 1;
+    return static_cast<int>(std::max<size_t>(1, std::min<size_t>(rows, layout.height)));
 }
 
-MakeMemImageWorker::~MakeMemImageWorker() {
-    // Note: Don't free image_ here as it's transferred to JS
+MakeMemImageWorker::MakeMemImageWorker(Napi::Function& callback, FilmLibRaw* processor, size_t limit)
+    : LibRawAsyncWorker(callback, processor), data_(nullptr) {
+    has_layout_ = processor_->GetMemImageLayout(layout_);
+    if (processor_->ExportColorSpaceActive()) {
+        color_space_ = processor_->ExportColorSpace();
+        transfer_ = processor_->ExportTransfer();
+    } else {
+        color_space_ = processor_->imgdata.params.output_color;
+        transfer_ = TRANSFER_DEFAULT;
+    }
+    
+    // Allocate the JS buffer up front so Execute() writes the pixels once,
+    // instead of into a LibRaw image that is then copied
+    if (has_layout_ && layout_.size <= limit) {
+        Napi::Buffer<uint8_t> buffer = Napi::Buffer<uint8_t>::New(callback.Env(), layout_.size);
+        data_ = buffer.Data();
+        buffer_ = Napi::Persistent(buffer);
+    }
 }
 
 void MakeMemImageWorker::Execute() {
-    image_ = processor_->dcraw_make_mem_image(&error_code_);
-    if (error_code_ != LIBRAW_SUCCESS || !image_) {
+    TraceQueueWait();
+    TraceScope trace("make_mem_image", "decode", trace_job_);
+    
+    if (!has_layout_) {
+        error_code_ = LIBRAW_OUT_OF_ORDER_CALL;
+    } else if (data_) {
+        error_code_ = processor_->CopyMemImageRows(data_, layout_.stride, 0, layout_.height);
+    }
+    if (error_code_ != LIBRAW_SUCCESS) {
         error_message_ = std::string("Failed to make memory image: ") + libraw_strerror(error_code_);
         SetError(error_message_);
     }
@@ -166,30 +435,530 @@ void MakeMemImageWorker::Execute() {
 void MakeMemImageWorker::OnOK() {
     Napi::HandleScope scope(Env());
     
-    if (!image_) {
-        Napi::Error::New(Env(), "No image data").ThrowAsJavaScriptException();
-        return;
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("success", Napi::Boolean::New(Env(), true));
+    result.Set("width", Napi::Number::New(Env(), layout_.width));
+    result.Set("height", Napi::Number::New(Env(), layout_.height));
+    result.Set("colors", Napi::Number::New(Env(), layout_.colors));
+    result.Set("bits", Napi::Number::New(Env(), layout_.bits));
+    result.Set("type", Napi::Number::New(Env(), LIBRAW_IMAGE_BITMAP));
+    result.Set("dataSize", Napi::Number::New(Env(), static_cast<double>(layout_.size)));
+    result.Set("stride", Napi::Number::New(Env(), static_cast<double>(layout_.stride)));
+    result.Set("colorSpace", Napi::Number::New(Env(), color_space_));
+    result.Set("transfer", transfer_ == TRANSFER_DEFAULT
+        ? Env().Null() : Napi::Number::New(Env(), transfer_));
+    
+    if (data_) {
+        result.Set("data", buffer_.Value());
+    } else {
+        // Over the limit: rows are fetched strip by strip (readImageStrip)
+        int strip_height = MemImageStripHeight(layout_);
+        result.Set("data", Env().Null());
+        result.Set("stripHeight", Napi::Number::New(Env(), strip_height));
+        result.Set("stripCount", Napi::Number::New(Env(), (layout_.height + strip_height - 1) / strip_height));
     }
     
+    Callback().Call({Env().Null(), result});
+}
+
+// ============================================================================
+// ReadImageStripWorker
+// ============================================================================
+
+ReadImageStripWorker::ReadImageStripWorker(Napi::Function& callback, FilmLibRaw* processor,
+                                           const MemImageLayout& layout, int first_row, int rows)
+    : LibRawAsyncWorker(callback, processor), stride_(layout.stride),
+      first_row_(first_row), rows_(rows) {
+    Napi::Buffer<uint8_t> buffer = Napi::Buffer<uint8_t>::New(callback.Env(), stride_ * rows_);
+    data_ = buffer.Data();
+    buffer_ = Napi::Persistent(buffer);
+}
+
+void ReadImageStripWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("read_image_strip", "decode", trace_job_);
+    
+    error_code_ = processor_->CopyMemImageRows(data_, stride_, first_row_, rows_);
+    if (error_code_ != LIBRAW_SUCCESS) {
+        error_message_ = std::string("Failed to read image strip: ") + libraw_strerror(error_code_);
+        SetError(error_message_);
+    }
+}
+
+void ReadImageStripWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
     Napi::Object result = Napi::Object::New(Env());
-    result.Set("success", Napi::Boolean::New(Env(), true));
-    result.Set("width", Napi::Number::New(Env(), image_->width));
-    result.Set("height", Napi::Number::New(Env(), image_->height));
-    result.Set("colors", Napi::Number::New(Env(), image_->colors));
-    result.Set("bits", Napi::Number::New(Env(), image_->bits));
-    result.Set("type", Napi::Number::New(Env(), image_->type));
+    result.Set("row", Napi::Number::New(Env(), first_row_));
+    result.Set("rows", Napi::Number::New(Env(), rows_));
+    result.Set("data", buffer_.Value());
     
-    // Create buffer with image data
-    size_t data_size = image_->data_size;
-    Napi::Buffer<unsigned char> buffer = Napi::Buffer<unsigned char>::Copy(
-        Env(), image_->data, data_size
-    );
-    result.Set("data", buffer);
-    result.Set("dataSize", Napi::Number::New(Env(), data_size));
+    Callback().Call({Env().Null(), result});
+}
+
+// ============================================================================
+// MakeJpegWorker
+// ============================================================================
+
+MakeJpegWorker::MakeJpegWorker(Napi::Function& callback, FilmLibRaw* processor, JpegOptions options)
+    : LibRawAsyncWorker(callback, processor), options_(std::move(options)) {
+    processor_->GetMemImageLayout(layout_);
+    if (processor_->ExportColorSpaceActive()) {
+        color_space_ = processor_->ExportColorSpace();
+        transfer_ = processor_->ExportTransfer();
+    } else {
+        color_space_ = processor_->imgdata.params.output_color;
+        transfer_ = TRANSFER_DEFAULT;
+    }
     
-    // Free the image now that we've copied the data
-    LibRaw::dcraw_clear_mem(image_);
-    image_ = nullptr;
+    // Pixels converted to an export space are tagged with it by default
+    if (options_.icc.empty() && transfer_ != TRANSFER_DEFAULT) {
+        BuildColorProfile(color_space_, transfer_, options_.icc);
+    }
+}
+
+void MakeJpegWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("make_jpeg", "encode", trace_job_);
+    
+    error_code_ = processor_->EncodeMemImageJpeg(options_, jpeg_);
+    if (error_code_ != LIBRAW_SUCCESS) {
+        error_message_ = std::string("Failed to encode JPEG: ") + libraw_strerror(error_code_);
+        SetError(error_message_);
+    }
+}
+
+void MakeJpegWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("width", Napi::Number::New(Env(), layout_.width));
+    result.Set("height", Napi::Number::New(Env(), layout_.height));
+    result.Set("colors", Napi::Number::New(Env(), layout_.colors));
+    result.Set("colorSpace", Napi::Number::New(Env(), color_space_));
+    result.Set("transfer", transfer_ == TRANSFER_DEFAULT
+        ? Env().Null() : Napi::Number::New(Env(), transfer_));
+    result.Set("data", Napi::Buffer<uint8_t>::Copy(Env(), jpeg_.data(), jpeg_.size()));
+    
+    Callback().Call({Env().Null(), result});
+}
+
+// ============================================================================
+// ColorConvertWorker
+// ============================================================================
+
+ColorConvertWorker::ColorConvertWorker(Napi::Function& callback, const Napi::Buffer<uint8_t>& source,
+                                       int width, int height, int channels, int bits,
+                                       const ColorConversion& conversion)
+    : LibRawAsyncWorker(callback, nullptr), src_(source.Data()), width_(width), height_(height),
+      channels_(channels), bits_(bits), conversion_(conversion) {
+    // Hold the source until Execute() has read it
+    source_ = Napi::Persistent(source);
+    Napi::Buffer<uint8_t> buffer = Napi::Buffer<uint8_t>::New(callback.Env(), source.Length());
+    data_ = buffer.Data();
+    buffer_ = Napi::Persistent(buffer);
+}
+
+void ColorConvertWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("convert_color", "render", trace_job_);
+    
+    if (!ConvertColorSpace(src_, data_, width_, height_, channels_, bits_, conversion_)) {
+        error_message_ = "Unsupported colour conversion";
+        SetError(error_message_);
+    }
+}
+
+void ColorConvertWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    Callback().Call({Env().Null(), buffer_.Value()});
+}
+
+// ============================================================================
+// DerivativesWorker
+// ============================================================================
+
+DerivativesWorker::DerivativesWorker(Napi::Function& callback, const Napi::Buffer<uint8_t>& source,
+                                     int width, int height, int channels, int bits,
+                                     TransferFunction transfer,
+                                     const std::vector<std::pair<int, int>>& sizes)
+    : LibRawAsyncWorker(callback, nullptr), src_(source.Data()), width_(width), height_(height),
+      channels_(channels), bits_(bits), transfer_(transfer) {
+    source_ = Napi::Persistent(source);
+    for (const auto& size : sizes) {
+        DerivativeLevel level;
+        DerivativeSize(width, height, size.first, size.second, &level.width, &level.height);
+        Napi::Buffer<uint8_t> buffer = Napi::Buffer<uint8_t>::New(
+            callback.Env(), static_cast<size_t>(level.width) * level.height * channels * (bits / 8));
+        level.data = buffer.Data();
+        levels_.push_back(level);
+        buffers_.push_back(Napi::Persistent(buffer));
+    }
+}
+
+void DerivativesWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("derivatives", "render", trace_job_);
+    
+    if (!BuildDerivatives(src_, width_, height_, channels_, bits_, transfer_, levels_)) {
+        error_message_ = "Unsupported derivative image format";
+        SetError(error_message_);
+    }
+}
+
+void DerivativesWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
+    Napi::Array result = Napi::Array::New(Env(), levels_.size());
+    for (size_t i = 0; i < levels_.size(); i++) {
+        Napi::Object item = Napi::Object::New(Env());
+        item.Set("width", Napi::Number::New(Env(), levels_[i].width));
+        item.Set("height", Napi::Number::New(Env(), levels_[i].height));
+        item.Set("channels", Napi::Number::New(Env(), channels_));
+        item.Set("bits", Napi::Number::New(Env(), bits_));
+        item.Set("data", buffers_[i].Value());
+        result.Set(static_cast<uint32_t>(i), item);
+    }
+    
+    Callback().Call({Env().Null(), result});
+}
+
+// ============================================================================
+// JpegEncodeWorker
+// ============================================================================
+
+JpegEncodeWorker::JpegEncodeWorker(Napi::Function& callback, const Napi::Buffer<uint8_t>& source,
+                                   int width, int height, int channels, int bits, JpegOptions options)
+    : LibRawAsyncWorker(callback, nullptr), src_(source.Data()), width_(width), height_(height),
+      channels_(channels), bits_(bits), options_(std::move(options)) {
+    source_ = Napi::Persistent(source);
+}
+
+void JpegEncodeWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("encode_jpeg", "encode", trace_job_);
+    
+    if (!EncodeJpeg(width_, height_, channels_, JpegBufferSource(src_, width_, channels_, bits_),
+                    options_, jpeg_)) {
+        error_message_ = "Unsupported JPEG image format";
+        SetError(error_message_);
+    }
+}
+
+void JpegEncodeWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    Callback().Call({Env().Null(), Napi::Buffer<uint8_t>::Copy(Env(), jpeg_.data(), jpeg_.size())});
+}
+
+// ============================================================================
+// JpegDecodeWorker
+// ============================================================================
+
+static Napi::Object JpegImageToObject(Napi::Env env, const JpegImage& image) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("width", Napi::Number::New(env, image.width));
+    result.Set("height", Napi::Number::New(env, image.height));
+    result.Set("colors", Napi::Number::New(env, image.channels));
+    result.Set("bits", Napi::Number::New(env, 8));
+    result.Set("data", Napi::Buffer<uint8_t>::Copy(env, image.data.data(), image.data.size()));
+    return result;
+}
+
+JpegDecodeWorker::JpegDecodeWorker(Napi::Function& callback, const Napi::Buffer<uint8_t>& source, int scale)
+    : LibRawAsyncWorker(callback, nullptr), data_(source.Data()), size_(source.Length()), scale_(scale) {
+    source_ = Napi::Persistent(source);
+}
+
+void JpegDecodeWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("decode_jpeg", "decode", trace_job_);
+    
+    JpegDecodeOptions options;
+    options.scale = scale_;
+    if (!DecodeJpeg(data_, size_, options, image_)) {
+        error_message_ = "Unsupported or corrupt JPEG data";
+        SetError(error_message_);
+    }
+}
+
+void JpegDecodeWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    Callback().Call({Env().Null(), JpegImageToObject(Env(), image_)});
+}
+
+// ============================================================================
+// MetadataWriteWorker
+// ============================================================================
+
+MetadataWriteWorker::MetadataWriteWorker(Napi::Function& callback, const Napi::Buffer<uint8_t>& source,
+                                         MetadataEdit edit)
+    : LibRawAsyncWorker(callback, nullptr), data_(source.Data()), size_(source.Length()), edit_(std::move(edit)) {
+    source_ = Napi::Persistent(source);
+}
+
+void MetadataWriteWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("write_metadata", "encode", trace_job_);
+    
+    if (!WriteMetadata(data_, size_, edit_, output_, error_message_)) {
+        SetError(error_message_);
+    }
+}
+
+void MetadataWriteWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    Callback().Call({Env().Null(), Napi::Buffer<uint8_t>::Copy(Env(), output_.data(), output_.size())});
+}
+
+// ============================================================================
+// FilmLabRenderWorker
+// ============================================================================
+
+FilmLabRenderWorker::FilmLabRenderWorker(Napi::Function& callback, const Napi::Object& owner,
+                                         RenderSession* session, FilmLabStages stages)
+    : LibRawAsyncWorker(callback, nullptr), session_(session), stages_(std::move(stages)),
+      start_stage_(-1) {
+    owner_ = Napi::Persistent(owner);
+    Napi::Buffer<uint8_t> buffer = Napi::Buffer<uint8_t>::New(
+        callback.Env(), static_cast<size_t>(session->Width()) * session->Height() * 3);
+    data_ = buffer.Data();
+    buffer_ = Napi::Persistent(buffer);
+    session_->SetBusy(true);
+}
+
+void FilmLabRenderWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("filmlab_render", "render", trace_job_);
+    
+    start_stage_ = session_->Render(stages_, data_);
+    if (start_stage_ < 0) {
+        error_message_ = "Invalid FilmLab stages";
+        SetError(error_message_);
+    }
+}
+
+void FilmLabRenderWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    session_->SetBusy(false);
+    
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("width", Napi::Number::New(Env(), session_->Width()));
+    result.Set("height", Napi::Number::New(Env(), session_->Height()));
+    result.Set("channels", Napi::Number::New(Env(), 3));
+    result.Set("startStage", Napi::String::New(Env(), FilmLabStageName(start_stage_)));
+    result.Set("data", buffer_.Value());
+    
+    Callback().Call({Env().Null(), result});
+}
+
+void FilmLabRenderWorker::OnError(const Napi::Error& error) {
+    session_->SetBusy(false);
+    LibRawAsyncWorker::OnError(error);
+}
+
+// ============================================================================
+// EditSourceWorker
+// ============================================================================
+
+EditSourceWorker::EditSourceWorker(Napi::Function& callback, const Napi::Object& owner,
+                                   EditSession* session, const Napi::Buffer<uint8_t>& source,
+                                   int width, int height, int channels, int bits, int min_size)
+    : LibRawAsyncWorker(callback, nullptr), session_(session), src_(source.Data()), width_(width),
+      height_(height), channels_(channels), bits_(bits), min_size_(min_size) {
+    owner_ = Napi::Persistent(owner);
+    source_ = Napi::Persistent(source);
+    session_->SetBusy(true);
+}
+
+void EditSourceWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("edit_source", "render", trace_job_);
+    
+    if (!session_->SetSource(src_, width_, height_, channels_, bits_, min_size_)) {
+        error_message_ = "Unsupported edit source format";
+        SetError(error_message_);
+    }
+}
+
+void EditSourceWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    session_->SetBusy(false);
+    
+    Napi::Array levels = Napi::Array::New(Env(), session_->LevelCount());
+    for (int i = 0; i < session_->LevelCount(); i++) {
+        Napi::Object level = Napi::Object::New(Env());
+        level.Set("width", Napi::Number::New(Env(), session_->LevelWidth(i)));
+        level.Set("height", Napi::Number::New(Env(), session_->LevelHeight(i)));
+        levels.Set(static_cast<uint32_t>(i), level);
+    }
+    
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("width", Napi::Number::New(Env(), session_->Width()));
+    result.Set("height", Napi::Number::New(Env(), session_->Height()));
+    result.Set("levels", levels);
+    
+    Callback().Call({Env().Null(), result});
+}
+
+void EditSourceWorker::OnError(const Napi::Error& error) {
+    session_->SetBusy(false);
+    LibRawAsyncWorker::OnError(error);
+}
+
+// ============================================================================
+// EditRenderWorker
+// ============================================================================
+
+EditRenderWorker::EditRenderWorker(Napi::Function& callback, const Napi::Object& owner,
+                                   EditSession* session, FilmLabStages stages,
+                                   const EditViewport& viewport)
+    : LibRawAsyncWorker(callback, nullptr), session_(session), stages_(std::move(stages)),
+      viewport_(viewport), generation_(session->NextGeneration()), start_stage_(-1), level_(0) {
+    owner_ = Napi::Persistent(owner);
+    Napi::Buffer<uint8_t> buffer = Napi::Buffer<uint8_t>::New(
+        callback.Env(), static_cast<size_t>(viewport.out_width) * viewport.out_height * 3);
+    data_ = buffer.Data();
+    buffer_ = Napi::Persistent(buffer);
+    session_->SetBusy(true);
+}
+
+void EditRenderWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("edit_render", "render", trace_job_);
+    
+    start_stage_ = session_->Render(stages_, viewport_, data_, generation_, &level_);
+    if (start_stage_ == -1) {
+        error_message_ = "Invalid FilmLab stages or viewport";
+        SetError(error_message_);
+    }
+}
+
+void EditRenderWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    session_->SetBusy(false);
+    
+    Napi::Object result = Napi::Object::New(Env());
+    bool cancelled = start_stage_ == RENDER_CANCELLED;
+    result.Set("cancelled", Napi::Boolean::New(Env(), cancelled));
+    result.Set("width", Napi::Number::New(Env(), viewport_.out_width));
+    result.Set("height", Napi::Number::New(Env(), viewport_.out_height));
+    result.Set("channels", Napi::Number::New(Env(), 3));
+    result.Set("level", Napi::Number::New(Env(), level_));
+    result.Set("startStage", Napi::String::New(Env(), FilmLabStageName(start_stage_)));
+    result.Set("data", cancelled ? Env().Null() : buffer_.Value());
+    
+    Callback().Call({Env().Null(), result});
+}
+
+void EditRenderWorker::OnError(const Napi::Error& error) {
+    session_->SetBusy(false);
+    LibRawAsyncWorker::OnError(error);
+}
+
+// ============================================================================
+// FilmLabPreviewWorker
+// ============================================================================
+
+FilmLabPreviewWorker::FilmLabPreviewWorker(Napi::Function& callback, std::vector<FilmLabStages> stages,
+                                           const std::vector<Napi::Buffer<uint8_t>>& sources,
+                                           const std::vector<PreviewImage>& images,
+                                           std::vector<size_t> stage_of_kernel, bool variants)
+    : LibRawAsyncWorker(callback, nullptr), stages_(std::move(stages)),
+      stage_of_kernel_(std::move(stage_of_kernel)), images_(images), variants_(variants) {
+    for (const Napi::Buffer<uint8_t>& source : sources) {
+        sources_.push_back(Napi::Persistent(source));
+    }
+    for (PreviewImage& image : images_) {
+        Napi::Buffer<uint8_t> buffer = Napi::Buffer<uint8_t>::New(
+            callback.Env(), static_cast<size_t>(image.width) * image.height * 3);
+        image.out = buffer.Data();
+        buffers_.push_back(Napi::Persistent(buffer));
+    }
+}
+
+void FilmLabPreviewWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("filmlab_preview", variants_ ? "render_variants" : "render", trace_job_);
+    
+    // Kernel k serves images whose kernel index is k; its bit depth comes
+    // from the first such image. Building the tables (3D LUTs, HSL) can
+    // outweigh rendering a small image, so kernels are built in parallel.
+    const size_t count = stage_of_kernel_.size();
+    std::vector<std::unique_ptr<FilmLabPreviewKernel>> built(count);
+    ParallelRows(static_cast<int>(count), 1, [&](int first, int last) {
+        for (int k = first; k < last; k++) {
+            int bits = 8;
+            for (const PreviewImage& image : images_) {
+                if (image.kernel == static_cast<size_t>(k)) {
+                    bits = image.bits;
+                    break;
+                }
+            }
+            built[k].reset(new FilmLabPreviewKernel(stages_[stage_of_kernel_[k]], bits));
+        }
+    });
+    std::vector<FilmLabPreviewKernel> kernels;
+    kernels.reserve(count);
+    for (auto& kernel : built) {
+        kernels.push_back(std::move(*kernel));
+    }
+    
+    if (variants_) {
+        RenderVariants(kernels, images_);
+    } else {
+        RenderPreviews(kernels, images_);
+    }
+}
+
+void FilmLabPreviewWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
+    Napi::Array result = Napi::Array::New(Env(), images_.size());
+    for (size_t i = 0; i < images_.size(); i++) {
+        Napi::Object item = Napi::Object::New(Env());
+        item.Set("width", Napi::Number::New(Env(), images_[i].width));
+        item.Set("height", Napi::Number::New(Env(), images_[i].height));
+        item.Set("channels", Napi::Number::New(Env(), 3));
+        item.Set("data", buffers_[i].Value());
+        result.Set(static_cast<uint32_t>(i), item);
+    }
+    
+    Callback().Call({Env().Null(), result});
+}
+
+// ============================================================================
+// TiledRenderWorker
+// ============================================================================
+
+TiledRenderWorker::TiledRenderWorker(Napi::Function& callback, std::string input_path, FilmLabStages stages,
+                                     TiledRenderOptions options)
+    : LibRawAsyncWorker(callback, nullptr), input_path_(std::move(input_path)), stages_(std::move(stages)),
+      options_(std::move(options)) {
+}
+
+void TiledRenderWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("render_tiled", "render", trace_job_);
+    
+    if (!RenderTiled(input_path_, stages_, options_, result_, error_message_)) {
+        SetError(error_message_);
+    }
+}
+
+void TiledRenderWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("width", Napi::Number::New(Env(), result_.width));
+    result.Set("height", Napi::Number::New(Env(), result_.height));
+    result.Set("sourceBits", Napi::Number::New(Env(), result_.bits));
+    if (options_.format == TILED_RENDER_TIFF16) {
+        result.Set("format", Napi::String::New(Env(), "tiff16"));
+        result.Set("path", Napi::String::New(Env(), options_.output_path));
+    } else {
+        result.Set("format", Napi::String::New(Env(), "jpeg"));
+        result.Set("data", Napi::Buffer<uint8_t>::Copy(Env(), result_.jpeg.data(), result_.jpeg.size()));
+    }
     
     Callback().Call({Env().Null(), result});
 }
@@ -198,11 +967,14 @@ void MakeMemImageWorker::OnOK() {
 // UnpackThumbnailWorker
 // ============================================================================
 
-UnpackThumbnailWorker::UnpackThumbnailWorker(Napi::Function& callback, LibRaw* processor)
+UnpackThumbnailWorker::UnpackThumbnailWorker(Napi::Function& callback, FilmLibRaw* processor)
     : LibRawAsyncWorker(callback, processor) {
 }
 
 void UnpackThumbnailWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("unpack_thumb", "decode", trace_job_);
+    
     error_code_ = processor_->unpack_thumb();
     if (error_code_ != LIBRAW_SUCCESS) {
         // Not an error if no thumbnail - just report it
@@ -231,7 +1003,7 @@ void UnpackThumbnailWorker::OnOK() {
 // MakeMemThumbnailWorker
 // ============================================================================
 
-MakeMemThumbnailWorker::MakeMemThumbnailWorker(Napi::Function& callback, LibRaw* processor)
+MakeMemThumbnailWorker::MakeMemThumbnailWorker(Napi::Function& callback, FilmLibRaw* processor)
     : LibRawAsyncWorker(callback, processor), image_(nullptr) {
 }
 
@@ -240,6 +1012,9 @@ MakeMemThumbnailWorker::~MakeMemThumbnailWorker() {
 }
 
 void MakeMemThumbnailWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("make_mem_thumb", "decode", trace_job_);
+    
     image_ = processor_->dcraw_make_mem_thumb(&error_code_);
     if (error_code_ != LIBRAW_SUCCESS || !image_) {
         error_message_ = std::string("Failed to make memory thumbnail: ") + libraw_strerror(error_code_);
@@ -277,3 +1052,83 @@ void MakeMemThumbnailWorker::OnOK() {
     
     Callback().Call({Env().Null(), result});
 }
+
+// ============================================================================
+// DecodeThumbnailWorker
+// ============================================================================
+
+DecodeThumbnailWorker::DecodeThumbnailWorker(Napi::Function& callback, FilmLibRaw* processor, int scale)
+    : LibRawAsyncWorker(callback, processor), scale_(scale) {
+}
+
+void DecodeThumbnailWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("decode_thumb", "decode", trace_job_);
+    
+    libraw_thumbnail_t& thumbnail = processor_->imgdata.thumbnail;
+    if (!thumbnail.thumb) {
+        error_code_ = processor_->unpack_thumb();
+        if (error_code_ != LIBRAW_SUCCESS) {
+            error_message_ = error_code_ == LIBRAW_NO_THUMBNAIL
+                ? std::string("No thumbnail available")
+                : std::string("Failed to unpack thumbnail: ") + libraw_strerror(error_code_);
+            SetError(error_message_);
+            return;
+        }
+    }
+    if (thumbnail.tformat != LIBRAW_THUMBNAIL_JPEG) {
+        error_message_ = "Thumbnail is not a JPEG";
+        SetError(error_message_);
+        return;
+    }
+    
+    JpegDecodeOptions options;
+    options.scale = scale_;
+    if (!DecodeJpeg(reinterpret_cast<const uint8_t*>(thumbnail.thumb), thumbnail.tlength, options, image_)) {
+        error_message_ = "Unsupported or corrupt thumbnail JPEG";
+        SetError(error_message_);
+    }
+}
+
+void DecodeThumbnailWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    Callback().Call({Env().Null(), JpegImageToObject(Env(), image_)});
+}
+
+// ============================================================================
+// MetadataBatchWorker
+// ============================================================================
+
+MetadataBatchWorker::MetadataBatchWorker(Napi::Function& callback, std::vector<std::string> paths)
+    : LibRawAsyncWorker(callback, nullptr), paths_(std::move(paths)), writer_(paths_.size()) {
+}
+
+void MetadataBatchWorker::Execute() {
+    TraceQueueWait();
+    TraceScope trace("metadata_batch", "metadata", trace_job_);
+    
+    // libraw_data_t is large; keep the instance off the worker thread's stack
+    std::unique_ptr<LibRaw> processor(new LibRaw(0));
+    
+    for (size_t i = 0; i < paths_.size(); i++) {
+        // A bad file only fails its own record
+        int code = processor->open_file(paths_[i].c_str());
+        if (code == LIBRAW_SUCCESS) {
+            writer_.Fill(i, processor->imgdata);
+        } else {
+            writer_.SetStatus(i, code);
+        }
+        processor->recycle();
+    }
+}
+
+void MetadataBatchWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
+    // Serialize straight into JS-owned memory (external buffers are not
+    // allowed under Electron's V8 sandbox, so this is the one copy)
+    Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(Env(), writer_.ByteLength());
+    writer_.Serialize(static_cast<uint8_t*>(buffer.Data()));
+    
+    Callback().Call({Env().Null(), buffer});
+}
@@ -9,7 +9,20 @@
 
 #include <napi.h>
 #include "libraw/libraw.h"
+#include "trace.h"
+#include "metadata_record.h"
+#include "film_libraw.h"
+#include "color_convert.h"
+#include "derivatives.h"
+#include "render_session.h"
+#include "edit_session.h"
+#include "filmlab_preview.h"
+#include "jpeg_encoder.h"
+#include "jpeg_decoder.h"
+#include "metadata_writer.h"
+#include "tiled_render.h"
 #include <string>
+#include <utility>
 #include <vector>
 
 /**
@@ -17,12 +30,20 @@
  */
 class LibRawAsyncWorker : public Napi::AsyncWorker {
 public:
-    LibRawAsyncWorker(Napi::Function& callback, LibRaw* processor);
+    LibRawAsyncWorker(Napi::Function& callback, FilmLibRaw* processor);
+    
+    // Job id attached to this worker's trace spans
+    void SetTraceJob(uint64_t job_id) { trace_job_ = job_id; }
     
 protected:
-    LibRaw* processor_;
+    // Record the time spent between Queue() and Execute()
+    void TraceQueueWait();
+    
+    FilmLibRaw* processor_;
     int error_code_;
     std::string error_message_;
+    uint64_t trace_job_;
+    uint64_t queued_at_;
 };
 
 /**
@@ -30,7 +51,7 @@ protected:
  */
 class LoadFileWorker : public LibRawAsyncWorker {
 public:
-    LoadFileWorker(Napi::Function& callback, LibRaw* processor, const std::string& path);
+    LoadFileWorker(Napi::Function& callback, FilmLibRaw* processor, const std::string& path);
     
     void Execute() override;
     void OnOK() override;
@@ -44,7 +65,7 @@ private:
  */
 class LoadBufferWorker : public LibRawAsyncWorker {
 public:
-    LoadBufferWorker(Napi::Function& callback, LibRaw* processor, 
+    LoadBufferWorker(Napi::Function& callback, FilmLibRaw* processor, 
                      const char* data, size_t size);
     
     void Execute() override;
@@ -54,26 +75,113 @@ private:
     std::vector<char> buffer_data_;
 };
 
+/**
+ * Async worker for reopening a RAW file from an identify snapshot.
+ * Falls back to a normal open_file() when the snapshot is rejected.
+ */
+class OpenSnapshotWorker : public LibRawAsyncWorker {
+public:
+    OpenSnapshotWorker(Napi::Function& callback, FilmLibRaw* processor,
+                       const std::string& path, const uint8_t* data, size_t size);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    std::string file_path_;
+    std::vector<uint8_t> snapshot_;
+    SnapshotStatus status_;
+};
+
+/**
+ * Async worker for writing a mosaic cache of the loaded file (unpacking
+ * first when needed). With a `written` callback it only copies the raw
+ * image out, calls back so the processor can move on, and leaves encoding
+ * and writing to a MosaicFlushWorker that calls `written`.
+ */
+class MosaicWriteWorker : public LibRawAsyncWorker {
+public:
+    MosaicWriteWorker(Napi::Function& callback, FilmLibRaw* processor,
+                      const std::string& path, const std::string& cache_path,
+                      Napi::Function* written = nullptr);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    std::string file_path_;
+    std::string cache_path_;
+    uint64_t bytes_;
+    Napi::FunctionReference written_;
+    MosaicCapture capture_;
+};
+
+/**
+ * Async worker encoding and writing a captured mosaic cache, independent
+ * of the processor it came from
+ */
+class MosaicFlushWorker : public LibRawAsyncWorker {
+public:
+    MosaicFlushWorker(Napi::Function& callback, MosaicCapture&& capture, const std::string& cache_path);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    MosaicCapture capture_;
+    std::string cache_path_;
+    uint64_t bytes_;
+};
+
+/**
+ * Async worker for reopening a RAW file unpacked from a mosaic cache.
+ * Falls back to the identify snapshot, if given, then to open_file().
+ */
+class OpenMosaicWorker : public LibRawAsyncWorker {
+public:
+    OpenMosaicWorker(Napi::Function& callback, FilmLibRaw* processor,
+                     const std::string& path, const std::string& cache_path,
+                     const uint8_t* snapshot, size_t snapshot_size);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    std::string file_path_;
+    std::string cache_path_;
+    std::vector<uint8_t> snapshot_;
+    SnapshotStatus mosaic_status_;
+    SnapshotStatus snapshot_status_;
+};
+
 /**
  * Async worker for unpacking RAW data
  */
 class UnpackWorker : public LibRawAsyncWorker {
 public:
-    UnpackWorker(Napi::Function& callback, LibRaw* processor);
+    UnpackWorker(Napi::Function& callback, FilmLibRaw* processor);
     
     void Execute() override;
     void OnOK() override;
 };
 
 /**
- * Async worker for processing (dcraw_process)
+ * Async worker for processing (dcraw_process, or the LinearRaw fast path)
  */
 class ProcessWorker : public LibRawAsyncWorker {
 public:
-    ProcessWorker(Napi::Function& callback, LibRaw* processor);
+    // `histogram_bins` per colour are returned (0: no histogram)
+    ProcessWorker(Napi::Function& callback, FilmLibRaw* processor, int histogram_bins);
     
     void Execute() override;
     void OnOK() override;
+    
+private:
+    int histogram_bins_;
+    std::vector<uint32_t> histogram_;   // colors x bins, empty when off
+    int colors_;
+    int white_level_;
+    bool auto_bright_;
 };
 
 /**
@@ -81,22 +189,72 @@ public:
  */
 class MakeMemImageWorker : public LibRawAsyncWorker {
 public:
-    MakeMemImageWorker(Napi::Function& callback, LibRaw* processor);
-    ~MakeMemImageWorker();
+    // Images larger than `limit` bytes are not copied; the result describes
+    // strips to fetch with ReadImageStripWorker instead
+    MakeMemImageWorker(Napi::Function& callback, FilmLibRaw* processor, size_t limit);
     
     void Execute() override;
     void OnOK() override;
     
 private:
-    libraw_processed_image_t* image_;
+    MemImageLayout layout_;
+    bool has_layout_;
+    int color_space_;               // Space the pixels are encoded in
+    TransferFunction transfer_;     // TRANSFER_DEFAULT: LibRaw's gamma curve
+    Napi::Reference<Napi::Buffer<uint8_t>> buffer_;    // Null in strip mode
+    uint8_t* data_;
 };
 
+/**
+ * Async worker copying one strip of rows of the processed image
+ */
+class ReadImageStripWorker : public LibRawAsyncWorker {
+public:
+    ReadImageStripWorker(Napi::Function& callback, FilmLibRaw* processor,
+                         const MemImageLayout& layout, int first_row, int rows);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    size_t stride_;
+    int first_row_;
+    int rows_;
+    Napi::Reference<Napi::Buffer<uint8_t>> buffer_;
+    uint8_t* data_;
+};
+
+/**
+ * Async worker encoding the processed image as JPEG (jpeg_encoder.h),
+ * converting rows band by band instead of making a memory image first.
+ * Embeds the export colour space's profile unless one is given.
+ */
+class MakeJpegWorker : public LibRawAsyncWorker {
+public:
+    MakeJpegWorker(Napi::Function& callback, FilmLibRaw* processor, JpegOptions options);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    JpegOptions options_;
+    MemImageLayout layout_;
+    int color_space_;
+    TransferFunction transfer_;
+    std::vector<uint8_t> jpeg_;
+};
+
+/**
+ * Rows per strip for images returned in strips (about 64 MB each)
+ */
+int MemImageStripHeight(const MemImageLayout& layout);
+
 /**
  * Async worker for unpacking thumbnail
  */
 class UnpackThumbnailWorker : public LibRawAsyncWorker {
 public:
-    UnpackThumbnailWorker(Napi::Function& callback, LibRaw* processor);
+    UnpackThumbnailWorker(Napi::Function& callback, FilmLibRaw* processor);
     
     void Execute() override;
     void OnOK() override;
@@ -107,7 +265,7 @@ public:
  */
 class MakeMemThumbnailWorker : public LibRawAsyncWorker {
 public:
-    MakeMemThumbnailWorker(Napi::Function& callback, LibRaw* processor);
+    MakeMemThumbnailWorker(Napi::Function& callback, FilmLibRaw* processor);
     ~MakeMemThumbnailWorker();
     
     void Execute() override;
@@ -117,6 +275,261 @@ private:
     libraw_processed_image_t* image_;
 };
 
+/**
+ * Async worker decoding the embedded JPEG preview, optionally scaled down
+ */
+class DecodeThumbnailWorker : public LibRawAsyncWorker {
+public:
+    DecodeThumbnailWorker(Napi::Function& callback, FilmLibRaw* processor, int scale);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    int scale_;
+    JpegImage image_;
+};
+
+/**
+ * Async worker that reads metadata for many files into one packed record block.
+ * Uses its own LibRaw instance and only parses headers (no unpack).
+ */
+class MetadataBatchWorker : public LibRawAsyncWorker {
+public:
+    MetadataBatchWorker(Napi::Function& callback, std::vector<std::string> paths);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    std::vector<std::string> paths_;
+    MetadataRecordWriter writer_;
+};
+
+/**
+ * Async worker converting an interleaved image between colour spaces
+ * (color_convert.h) into a new buffer
+ */
+class ColorConvertWorker : public LibRawAsyncWorker {
+public:
+    ColorConvertWorker(Napi::Function& callback, const Napi::Buffer<uint8_t>& source,
+                       int width, int height, int channels, int bits,
+                       const ColorConversion& conversion);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    Napi::Reference<Napi::Buffer<uint8_t>> source_;
+    Napi::Reference<Napi::Buffer<uint8_t>> buffer_;
+    const uint8_t* src_;
+    uint8_t* data_;
+    int width_;
+    int height_;
+    int channels_;
+    int bits_;
+    ColorConversion conversion_;
+};
+
+/**
+ * Async worker downsampling one image into several smaller ones
+ * (derivatives.h), each into its own new buffer
+ */
+class DerivativesWorker : public LibRawAsyncWorker {
+public:
+    DerivativesWorker(Napi::Function& callback, const Napi::Buffer<uint8_t>& source,
+                      int width, int height, int channels, int bits, TransferFunction transfer,
+                      const std::vector<std::pair<int, int>>& sizes);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    Napi::Reference<Napi::Buffer<uint8_t>> source_;
+    std::vector<Napi::Reference<Napi::Buffer<uint8_t>>> buffers_;
+    std::vector<DerivativeLevel> levels_;
+    const uint8_t* src_;
+    int width_;
+    int height_;
+    int channels_;
+    int bits_;
+    TransferFunction transfer_;
+};
+
+/**
+ * Async worker encoding interleaved 8/16-bit pixels as JPEG
+ */
+class JpegEncodeWorker : public LibRawAsyncWorker {
+public:
+    JpegEncodeWorker(Napi::Function& callback, const Napi::Buffer<uint8_t>& source,
+                     int width, int height, int channels, int bits, JpegOptions options);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    Napi::Reference<Napi::Buffer<uint8_t>> source_;
+    const uint8_t* src_;
+    int width_;
+    int height_;
+    int channels_;
+    int bits_;
+    JpegOptions options_;
+    std::vector<uint8_t> jpeg_;
+};
+
+/**
+ * Async worker decoding a baseline JPEG into 8-bit pixels
+ */
+class JpegDecodeWorker : public LibRawAsyncWorker {
+public:
+    JpegDecodeWorker(Napi::Function& callback, const Napi::Buffer<uint8_t>& source, int scale);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    Napi::Reference<Napi::Buffer<uint8_t>> source_;
+    const uint8_t* data_;
+    size_t size_;
+    int scale_;
+    JpegImage image_;
+};
+
+/**
+ * Async worker writing EXIF/XMP into an encoded JPEG or TIFF
+ */
+class MetadataWriteWorker : public LibRawAsyncWorker {
+public:
+    MetadataWriteWorker(Napi::Function& callback, const Napi::Buffer<uint8_t>& source, MetadataEdit edit);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    Napi::Reference<Napi::Buffer<uint8_t>> source_;
+    const uint8_t* data_;
+    size_t size_;
+    MetadataEdit edit_;
+    std::vector<uint8_t> output_;
+};
+
+/**
+ * Async worker rendering a FilmLab session (render_session.h) into a new RGB
+ * buffer. Holds the session object and marks it busy until the callback.
+ */
+class FilmLabRenderWorker : public LibRawAsyncWorker {
+public:
+    FilmLabRenderWorker(Napi::Function& callback, const Napi::Object& owner,
+                        RenderSession* session, FilmLabStages stages);
+    
+    void Execute() override;
+    void OnOK() override;
+    void OnError(const Napi::Error& error) override;
+    
+private:
+    Napi::ObjectReference owner_;
+    Napi::Reference<Napi::Buffer<uint8_t>> buffer_;
+    RenderSession* session_;
+    FilmLabStages stages_;
+    uint8_t* data_;
+    int start_stage_;
+};
+
+/**
+ * Async worker loading an edit session's source and building its pyramid
+ */
+class EditSourceWorker : public LibRawAsyncWorker {
+public:
+    EditSourceWorker(Napi::Function& callback, const Napi::Object& owner, EditSession* session,
+                     const Napi::Buffer<uint8_t>& source, int width, int height, int channels,
+                     int bits, int min_size);
+    
+    void Execute() override;
+    void OnOK() override;
+    void OnError(const Napi::Error& error) override;
+    
+private:
+    Napi::ObjectReference owner_;
+    Napi::Reference<Napi::Buffer<uint8_t>> source_;
+    EditSession* session_;
+    const uint8_t* src_;
+    int width_;
+    int height_;
+    int channels_;
+    int bits_;
+    int min_size_;
+};
+
+/**
+ * Async worker rendering an edit session's viewport into a new RGB buffer.
+ * Finishes early with `cancelled: true` once a newer render is started.
+ */
+class EditRenderWorker : public LibRawAsyncWorker {
+public:
+    EditRenderWorker(Napi::Function& callback, const Napi::Object& owner, EditSession* session,
+                     FilmLabStages stages, const EditViewport& viewport);
+    
+    void Execute() override;
+    void OnOK() override;
+    void OnError(const Napi::Error& error) override;
+    
+private:
+    Napi::ObjectReference owner_;
+    Napi::Reference<Napi::Buffer<uint8_t>> buffer_;
+    EditSession* session_;
+    FilmLabStages stages_;
+    EditViewport viewport_;
+    uint64_t generation_;
+    uint8_t* data_;
+    int start_stage_;
+    int level_;
+};
+
+/**
+ * Async worker rendering a batch of small images with the fixed-point
+ * preview kernel, or with `variants` one image with many stages
+ * (RenderVariants()). Kernels are built in Execute() on several threads,
+ * one per distinct (stages, bits) pair.
+ */
+class FilmLabPreviewWorker : public LibRawAsyncWorker {
+public:
+    FilmLabPreviewWorker(Napi::Function& callback, std::vector<FilmLabStages> stages,
+                         const std::vector<Napi::Buffer<uint8_t>>& sources,
+                         const std::vector<PreviewImage>& images, std::vector<size_t> stage_of_kernel,
+                         bool variants = false);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    std::vector<Napi::Reference<Napi::Buffer<uint8_t>>> sources_;
+    std::vector<Napi::Reference<Napi::Buffer<uint8_t>>> buffers_;
+    std::vector<FilmLabStages> stages_;
+    std::vector<size_t> stage_of_kernel_;
+    std::vector<PreviewImage> images_;
+    bool variants_;
+};
+
+/**
+ * Async worker rendering a mapped TIFF cache band by band into a JPEG buffer
+ * or a 16-bit TIFF file (tiled_render.h)
+ */
+class TiledRenderWorker : public LibRawAsyncWorker {
+public:
+    TiledRenderWorker(Napi::Function& callback, std::string input_path, FilmLabStages stages,
+                      TiledRenderOptions options);
+    
+    void Execute() override;
+    void OnOK() override;
+    
+private:
+    std::string input_path_;
+    FilmLabStages stages_;
+    TiledRenderOptions options_;
+    TiledRenderResult result_;
+};
+
 /**
  * Helper to convert libraw error code to string
  */
@@ -0,0 +1,431 @@
+/**
+ * @filmgallery/libraw-native - Camera Index Implementation
+ *
+ * Display strings follow "Make Model[ / Alt][, Model2][ (alias or note)]".
+ * Makes are canonicalized with LibRaw::simplify_make_model(), the same
+ * routine LibRaw applies to file metadata, so list entries and file
+ * make/model strings produce the same keys.
+ */
+
+#include "camera_index.h"
+#include "libraw/libraw.h"
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+// List makes that span several words (everything else is the first word)
+const char* const kMultiWordMakes[] = {
+    "OM Digital Solutions", "Digital Bolex", "Phase One", "Photo Control", "HMD Global", "JK Imaging", "ST Micro"
+};
+
+// Parenthesized remarks that describe support level rather than name a model
+struct NoteRule {
+    const char* keyword;
+    uint32_t capability;
+};
+
+const NoteRule kNoteRules[] = {
+    { "hack", CAMERA_CAP_MODIFIED_FIRMWARE },
+    { "single shot only", CAMERA_CAP_SINGLE_SHOT_ONLY },
+    { "dng only", CAMERA_CAP_DNG_ONLY },
+    { "raw decode only", CAMERA_CAP_PARTIAL },
+    { "not supported", CAMERA_CAP_PARTIAL },
+    { "dng", 0 },
+    { "cr2", 0 }
+};
+
+// Normalized models (see CameraKey) with an X-Trans sensor
+const char* const kXTransModels[] = {
+    "xpro1", "xpro2", "xpro3", "xe1", "xe2", "xe2s", "xe3", "xe4", "xe5",
+    "xt1", "xt1graphitesilver", "xt2", "xt3", "xt4", "xt5", "xt10", "xt20", "xt30", "xt30ii", "xt30iii", "xt50",
+    "xh1", "xh2", "xh2s", "xs10", "xs20", "x100s", "x100t", "x100f", "x100v", "x100vi",
+    "x20", "x30", "x70", "xq1", "xq2", "xm1", "xm5"
+};
+
+// Models whose raw files can carry several frames (LibRaw shot_select)
+struct ModelRule {
+    unsigned maker;
+    const char* model;
+};
+
+const ModelRule kMultiFrameModels[] = {
+    { LIBRAW_CAMERAMAKER_Pentax, "k1" },           // Pixel Shift
+    { LIBRAW_CAMERAMAKER_Pentax, "k1ii" },
+    { LIBRAW_CAMERAMAKER_Pentax, "k3ii" },
+    { LIBRAW_CAMERAMAKER_Pentax, "k3iii" },
+    { LIBRAW_CAMERAMAKER_Pentax, "k3iiimonochrome" },
+    { LIBRAW_CAMERAMAKER_Pentax, "kp" },
+    { LIBRAW_CAMERAMAKER_Pentax, "k70" },
+    { LIBRAW_CAMERAMAKER_Fujifilm, "s3pro" },      // SuperCCD SR
+    { LIBRAW_CAMERAMAKER_Fujifilm, "s5pro" },
+    { LIBRAW_CAMERAMAKER_Canon, "eos5div" },       // Dual Pixel RAW
+    { LIBRAW_CAMERAMAKER_Canon, "eosr5" }
+};
+
+// Canon bodies that write CR3 (everything else from Canon is CR2/CRW)
+const char* const kCanonCr3Models[] = {
+    "eosr", "eosra", "eosrp", "eosr1", "eosr3", "eosr5", "eosr5c", "eosr5ii", "eosr6", "eosr6ii", "eosr6iii",
+    "eosr7", "eosr8", "eosr10", "eosr50", "eosr50v", "eosr100", "eosm50", "eosm50ii", "eosm6ii", "eosm200",
+    "eos90d", "eos250d", "eos850d", "eos1dxiii", "powershotg5xii", "powershotg7xiii", "powershotsx70hs"
+};
+
+// Typical raw container per maker
+struct MakerFormat {
+    unsigned maker;
+    const char* format;
+};
+
+const MakerFormat kMakerFormats[] = {
+    { LIBRAW_CAMERAMAKER_Canon, "CR2" },
+    { LIBRAW_CAMERAMAKER_Nikon, "NEF" },
+    { LIBRAW_CAMERAMAKER_Sony, "ARW" },
+    { LIBRAW_CAMERAMAKER_Fujifilm, "RAF" },
+    { LIBRAW_CAMERAMAKER_Panasonic, "RW2" },
+    { LIBRAW_CAMERAMAKER_Olympus, "ORF" },
+    { LIBRAW_CAMERAMAKER_OmDigital, "ORF" },
+    { LIBRAW_CAMERAMAKER_Pentax, "PEF" },
+    { LIBRAW_CAMERAMAKER_Ricoh, "DNG" },
+    { LIBRAW_CAMERAMAKER_Leica, "DNG" },
+    { LIBRAW_CAMERAMAKER_Hasselblad, "3FR" },
+    { LIBRAW_CAMERAMAKER_PhaseOne, "IIQ" },
+    { LIBRAW_CAMERAMAKER_Leaf, "MOS" },
+    { LIBRAW_CAMERAMAKER_Mamiya, "MEF" },
+    { LIBRAW_CAMERAMAKER_Samsung, "SRW" },
+    { LIBRAW_CAMERAMAKER_Sigma, "X3F" },
+    { LIBRAW_CAMERAMAKER_Kodak, "DCR" },
+    { LIBRAW_CAMERAMAKER_Minolta, "MRW" },
+    { LIBRAW_CAMERAMAKER_Konica, "MRW" },
+    { LIBRAW_CAMERAMAKER_Epson, "ERF" },
+    { LIBRAW_CAMERAMAKER_Apple, "DNG" },
+    { LIBRAW_CAMERAMAKER_Google, "DNG" },
+    { LIBRAW_CAMERAMAKER_DJI, "DNG" },
+    { LIBRAW_CAMERAMAKER_GoPro, "GPR" },
+    { LIBRAW_CAMERAMAKER_OnePlus, "DNG" },
+    { LIBRAW_CAMERAMAKER_Xiaomi, "DNG" },
+    { LIBRAW_CAMERAMAKER_HUAWEI, "DNG" },
+    { LIBRAW_CAMERAMAKER_VIVO, "DNG" },
+    { LIBRAW_CAMERAMAKER_Zeiss, "DNG" }
+};
+
+std::string Trim(const std::string& s) {
+    size_t begin = s.find_first_not_of(" \t");
+    if (begin == std::string::npos) return std::string();
+    size_t end = s.find_last_not_of(" \t");
+    return s.substr(begin, end - begin + 1);
+}
+
+std::string Lower(const std::string& s) {
+    std::string out(s);
+    for (char& c : out) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    return out;
+}
+
+bool StartsWithNoCase(const std::string& s, const char* prefix) {
+    size_t n = strlen(prefix);
+    return s.size() >= n && strncasecmp(s.c_str(), prefix, n) == 0;
+}
+
+std::vector<std::string> Split(const std::string& s, const char* sep) {
+    std::vector<std::string> parts;
+    size_t sep_len = strlen(sep);
+    size_t start = 0;
+    for (;;) {
+        size_t pos = s.find(sep, start);
+        std::string part = Trim(s.substr(start, pos == std::string::npos ? std::string::npos : pos - start));
+        if (!part.empty()) parts.push_back(part);
+        if (pos == std::string::npos) break;
+        start = pos + sep_len;
+    }
+    return parts;
+}
+
+void ReplaceAll(std::string& s, const char* from, const char* to) {
+    size_t from_len = strlen(from);
+    size_t to_len = strlen(to);
+    for (size_t pos = s.find(from); pos != std::string::npos; pos = s.find(from, pos + to_len)) {
+        s.replace(pos, from_len, to);
+    }
+}
+
+/**
+ * Lowercase alphanumerics only, with generation suffix spellings unified:
+ * "Mark II", "MkII", "Mk2" and Nikon's "_2" all become "ii"; "+" is kept as
+ * "plus" so "P 25+" and "P 25" stay distinct
+ */
+std::string NormalizeModel(const std::string& model) {
+    std::string s = Lower(model);
+    ReplaceAll(s, "_2", " ii");
+    ReplaceAll(s, "_3", " iii");
+    ReplaceAll(s, "+", "plus");
+
+    std::string squashed;
+    squashed.reserve(s.size());
+    for (char c : s) {
+        if (isalnum(static_cast<unsigned char>(c))) squashed += c;
+    }
+
+    ReplaceAll(squashed, "mk2", "ii");
+    ReplaceAll(squashed, "mk3", "iii");
+    ReplaceAll(squashed, "mk4", "iv");
+    ReplaceAll(squashed, "markii", "ii");
+    ReplaceAll(squashed, "markiv", "iv");
+    ReplaceAll(squashed, "markv", "v");
+    ReplaceAll(squashed, "mkii", "ii");
+    ReplaceAll(squashed, "mkiv", "iv");
+    ReplaceAll(squashed, "mkv", "v");
+    return squashed;
+}
+
+/**
+ * Split a "Make Model" string the way the camera list is written
+ */
+void SplitMakeModel(const std::string& name, std::string& make, std::string& model) {
+    for (const char* multi : kMultiWordMakes) {
+        size_t n = strlen(multi);
+        if (StartsWithNoCase(name, multi) && (name.size() == n || name[n] == ' ')) {
+            make = name.substr(0, n);
+            model = Trim(name.substr(n));
+            return;
+        }
+    }
+    size_t space = name.find(' ');
+    make = space == std::string::npos ? name : name.substr(0, space);
+    model = space == std::string::npos ? std::string() : Trim(name.substr(space + 1));
+}
+
+// Words before the last one ("EOS 100D" -> "EOS ")
+std::string LeadingWords(const std::string& s) {
+    size_t space = s.rfind(' ');
+    return space == std::string::npos ? std::string() : s.substr(0, space + 1);
+}
+
+// Model-code prefix of the last word ("DMC-TZ60" -> "DMC-")
+std::string CodePrefix(const std::string& s) {
+    size_t space = s.rfind(' ');
+    std::string last = space == std::string::npos ? s : s.substr(space + 1);
+    size_t dash = last.find('-');
+    return dash == std::string::npos ? std::string() : last.substr(0, dash + 1);
+}
+
+bool ContainsNoCase(const std::string& haystack, const char* needle) {
+    return Lower(haystack).find(needle) != std::string::npos;
+}
+
+} // namespace
+
+// ============================================================================
+// Keys
+// ============================================================================
+
+std::string CameraKey(const std::string& make, const std::string& model, unsigned* maker_index,
+                      std::string* canonical_make) {
+    char make_buf[64];
+    char model_buf[128];
+    strncpy(make_buf, make.c_str(), sizeof(make_buf) - 1);
+    make_buf[sizeof(make_buf) - 1] = '\0';
+    strncpy(model_buf, model.c_str(), sizeof(model_buf) - 1);
+    model_buf[sizeof(model_buf) - 1] = '\0';
+
+    unsigned index = 0;
+    LibRaw::simplify_make_model(&index, make_buf, sizeof(make_buf), model_buf, sizeof(model_buf));
+
+    if (maker_index) *maker_index = index;
+    if (canonical_make) *canonical_make = make_buf;
+
+    // Unknown makers: key on the whole string so "Digital Bolex" + "D16" and
+    // "Digital" + "Bolex D16" agree
+    if (index == 0) {
+        return "0:" + NormalizeModel(std::string(make_buf) + model_buf);
+    }
+
+    std::string normalized = NormalizeModel(model_buf);
+    if (index == LIBRAW_CAMERAMAKER_Panasonic) {
+        // Panasonic files say "DC-S5M2" where the list says "DC-S5 MkII"
+        size_t n = normalized.size();
+        if (n > 2 && normalized[n - 2] == 'm' && (normalized[n - 1] == '2' || normalized[n - 1] == '3')) {
+            normalized.replace(n - 2, 2, normalized[n - 1] == '2' ? "ii" : "iii");
+        }
+    }
+    return std::to_string(index) + ":" + normalized;
+}
+
+// ============================================================================
+// Index
+// ============================================================================
+
+const CameraIndex& CameraIndex::Instance() {
+    static const CameraIndex index;
+    return index;
+}
+
+CameraIndex::CameraIndex() {
+    const char** list = LibRaw::cameraList();
+    int count = LibRaw::cameraCount();
+
+    entries_.reserve(count);
+    keys_.reserve(count * 3);
+    names_.reserve(count);
+
+    for (int i = 0; i < count; i++) {
+        AddEntry(list[i]);
+    }
+}
+
+void CameraIndex::AddKey(const std::string& make, const std::string& model, uint32_t index) {
+    if (model.empty()) return;
+    // First entry wins; later list entries never shadow an earlier exact model
+    keys_.emplace(CameraKey(make, model), index);
+}
+
+void CameraIndex::AddEntry(const char* display) {
+    uint32_t index = static_cast<uint32_t>(entries_.size());
+    entries_.emplace_back();
+    CameraEntry& entry = entries_.back();
+    entry.name = display;
+    entry.capabilities = 0;
+    entry.format = nullptr;
+    names_.emplace(entry.name, index);
+
+    std::string list_make;
+    std::string rest;
+    SplitMakeModel(entry.name, list_make, rest);
+
+    // Pull out parenthesized parts: notes set capability flags, anything else is an alias
+    std::string base;
+    std::vector<std::string> paren_aliases;
+    std::string with_parens;
+    size_t pos = 0;
+    while (pos < rest.size()) {
+        size_t open = rest.find('(', pos);
+        if (open == std::string::npos) {
+            base += rest.substr(pos);
+            break;
+        }
+        size_t close = rest.find(')', open);
+        if (close == std::string::npos) close = rest.size();
+        base += rest.substr(pos, open - pos);
+
+        bool is_note = false;
+        for (const std::string& part : Split(rest.substr(open + 1, close - open - 1), ",")) {
+            bool note = false;
+            for (const NoteRule& rule : kNoteRules) {
+                if (ContainsNoCase(part, rule.keyword)) {
+                    entry.capabilities |= rule.capability;
+                    note = true;
+                    break;
+                }
+            }
+            if (note) {
+                entry.notes.push_back(part);
+                is_note = true;
+            } else {
+                for (const std::string& alias : Split(part, " / ")) paren_aliases.push_back(alias);
+            }
+        }
+        if (!is_note) with_parens += rest.substr(open + 1, close - open - 1) + " ";
+        pos = close + 1;
+    }
+    base = Trim(base);
+
+    // Alternates: "EOS 250D / 200D II / Rebel SL3", "DMC-ZS40, DMC-TZ60 / TZ61", "Ixpress 96, 96C".
+    // A slash without spaces is part of the name ("DCS Pro SLR/n").
+    std::vector<std::string> models;
+    std::string primary;
+    for (const std::string& group : Split(base, ",")) {
+        std::vector<std::string> alts = Split(group, " / ");
+        for (size_t a = 0; a < alts.size(); a++) {
+            const std::string& alt = alts[a];
+            if (primary.empty()) {
+                primary = alt;
+                models.push_back(alt);
+                continue;
+            }
+            models.push_back(alt);
+            // Shorthand alternates borrow the leading words / code prefix of the
+            // first name in their group and of the primary model
+            const std::string* refs[] = { a > 0 ? &alts[0] : nullptr, &primary };
+            for (const std::string* ref : refs) {
+                if (!ref) continue;
+                std::string lead = LeadingWords(*ref);
+                std::string code = CodePrefix(*ref);
+                if (!lead.empty()) models.push_back(lead + alt);
+                if (!code.empty() && alt.find('-') == std::string::npos) models.push_back(lead + code + alt);
+            }
+        }
+    }
+    if (primary.empty()) primary = base;
+
+    unsigned maker_index = 0;
+    std::string canonical_make;
+    std::string primary_key = CameraKey(list_make, primary, &maker_index, &canonical_make);
+    entry.make = canonical_make;
+    entry.model = primary;
+    entry.maker_index = maker_index;
+
+    models.insert(models.end(), paren_aliases.begin(), paren_aliases.end());
+    for (const std::string& m : models) {
+        AddKey(list_make, m, index);
+        if (m == primary) continue;
+        bool seen = false;
+        for (const std::string& a : entry.aliases) seen = seen || a == m;
+        if (!seen) entry.aliases.push_back(m);
+    }
+    if (!with_parens.empty()) {
+        // "M (Typ 240)" as written by the camera
+        AddKey(list_make, base + " " + with_parens, index);
+    }
+
+    // Static capabilities
+    std::string norm = primary_key.substr(primary_key.find(':') + 1);
+    if (maker_index == LIBRAW_CAMERAMAKER_Fujifilm) {
+        for (const char* m : kXTransModels) {
+            if (norm == m) entry.capabilities |= CAMERA_CAP_XTRANS;
+        }
+    }
+    for (const ModelRule& rule : kMultiFrameModels) {
+        if (rule.maker == maker_index && norm == rule.model) entry.capabilities |= CAMERA_CAP_MULTI_FRAME;
+    }
+    if (ContainsNoCase(entry.name, "monochrom") || ContainsNoCase(entry.name, "achromatic")) {
+        entry.capabilities |= CAMERA_CAP_MONOCHROME;
+    }
+
+    for (const MakerFormat& f : kMakerFormats) {
+        if (f.maker == maker_index) {
+            entry.format = f.format;
+            break;
+        }
+    }
+    if (maker_index == LIBRAW_CAMERAMAKER_Canon) {
+        for (const char* m : kCanonCr3Models) {
+            if (norm == m) entry.format = "CR3";
+        }
+    } else if (maker_index == LIBRAW_CAMERAMAKER_Samsung && norm.compare(0, 6, "galaxy") == 0 &&
+               norm.compare(0, 8, "galaxynx") != 0) {
+        entry.format = "DNG";
+    } else if (maker_index == LIBRAW_CAMERAMAKER_Sigma && norm.compare(0, 2, "fp") == 0) {
+        entry.format = "DNG";
+    }
+    if (entry.capabilities & CAMERA_CAP_DNG_ONLY) {
+        entry.format = "DNG";
+    }
+}
+
+// ============================================================================
+// Lookup
+// ============================================================================
+
+const CameraEntry* CameraIndex::Find(const std::string& make, const std::string& model) const {
+    auto it = keys_.find(CameraKey(make, model));
+    return it == keys_.end() ? nullptr : &entries_[it->second];
+}
+
+const CameraEntry* CameraIndex::Find(const std::string& name) const {
+    auto exact = names_.find(name);
+    if (exact != names_.end()) return &entries_[exact->second];
+
+    std::string make;
+    std::string model;
+    SplitMakeModel(Trim(name), make, model);
+    return Find(make, model);
+}
@@ -0,0 +1,79 @@
+/**
+ * @filmgallery/libraw-native - Camera Index
+ *
+ * Hash index over LibRaw's supported camera list, built once at module init.
+ * Entries are keyed by LibRaw's maker index plus a normalized model, so both
+ * display names ("Sony ILCE-7M4 (A7 IV)") and the make/model strings found in
+ * files ("SONY" / "ILCE-7M4", "NIKON CORPORATION" / "NIKON Z 6_2") resolve in
+ * O(1). Regional names and alternates listed in the display strings are
+ * indexed as aliases.
+ */
+
+#ifndef CAMERA_INDEX_H
+#define CAMERA_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Capability flags (static, per camera model)
+enum CameraCapability : uint32_t {
+    CAMERA_CAP_XTRANS            = 1 << 0,  // Fujifilm X-Trans CFA (6x6)
+    CAMERA_CAP_MULTI_FRAME       = 1 << 1,  // Files may hold several raw frames (pixel shift, dual pixel, SR)
+    CAMERA_CAP_MONOCHROME        = 1 << 2,  // No colour filter array
+    CAMERA_CAP_PARTIAL           = 1 << 3,  // Some formats/modes unsupported, or raw decode only
+    CAMERA_CAP_DNG_ONLY          = 1 << 4,  // Supported only when shooting DNG
+    CAMERA_CAP_MODIFIED_FIRMWARE = 1 << 5,  // Raw output requires hacked/alternative firmware
+    CAMERA_CAP_SINGLE_SHOT_ONLY  = 1 << 6   // Multi-shot backs: only single-shot files decode
+};
+
+struct CameraEntry {
+    std::string name;                   // LibRaw display string
+    std::string make;                   // Canonical make (LibRaw normalized)
+    std::string model;                  // Primary model name
+    std::vector<std::string> aliases;   // Alternate/regional model names
+    std::vector<std::string> notes;     // Parenthesized remarks from the list
+    unsigned maker_index;               // LIBRAW_CAMERAMAKER_* (0 if unknown)
+    uint32_t capabilities;              // CameraCapability bits
+    const char* format;                 // Typical raw container (e.g. "CR3"), or nullptr
+};
+
+class CameraIndex {
+public:
+    /**
+     * Process-wide index; built on first use (thread-safe)
+     */
+    static const CameraIndex& Instance();
+
+    /**
+     * Lookup by file make/model (raw or LibRaw-normalized strings)
+     */
+    const CameraEntry* Find(const std::string& make, const std::string& model) const;
+
+    /**
+     * Lookup by a single "Make Model" string, e.g. a list display name
+     */
+    const CameraEntry* Find(const std::string& name) const;
+
+    const std::vector<CameraEntry>& Entries() const { return entries_; }
+    size_t KeyCount() const { return keys_.size(); }
+
+private:
+    CameraIndex();
+    void AddEntry(const char* display);
+    void AddKey(const std::string& make, const std::string& model, uint32_t index);
+
+    std::vector<CameraEntry> entries_;
+    std::unordered_map<std::string, uint32_t> keys_;    // maker:model -> entry
+    std::unordered_map<std::string, uint32_t> names_;   // exact display name -> entry
+};
+
+/**
+ * Index key for a make/model pair: LibRaw maker index plus the model with
+ * case, punctuation and "Mark II"/"MkII"/"_2" spelling differences removed
+ */
+std::string CameraKey(const std::string& make, const std::string& model, unsigned* maker_index = nullptr,
+                      std::string* canonical_make = nullptr);
+
+#endif // CAMERA_INDEX_H
@@ -0,0 +1,396 @@
+/**
+ * @filmgallery/libraw-native - Colour Space Conversion
+ */
+
+#include "color_convert.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include "libraw/libraw.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+namespace {
+
+// LibRaw's sRGB -> output space matrices, indexed by output_color - 1
+const double (*OutputMatrix(int space))[3] {
+    static const double (*const matrices[])[3] = {
+        LibRaw_constants::rgb_rgb, LibRaw_constants::adobe_rgb,
+        LibRaw_constants::wide_rgb, LibRaw_constants::prophoto_rgb,
+        LibRaw_constants::xyz_rgb, LibRaw_constants::aces_rgb,
+        LibRaw_constants::dcip3d65_rgb, LibRaw_constants::rec2020_rgb
+    };
+    return matrices[space - 1];
+}
+
+void Invert3x3(const double m[3][3], double out[3][3]) {
+    double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+               - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+               + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    out[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) / det;
+    out[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) / det;
+    out[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) / det;
+    out[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) / det;
+    out[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) / det;
+    out[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) / det;
+    out[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) / det;
+    out[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) / det;
+    out[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) / det;
+}
+
+TransferFunction Resolve(TransferFunction transfer, int space) {
+    return transfer == TRANSFER_DEFAULT ? DefaultTransfer(space) : transfer;
+}
+
+// BT.709 constants at full precision (the rounded 1.099/0.018 leave a small
+// step at the join); these are also what LibRaw solves for gamma 0.45/4.5
+const double kBt709Alpha = 1.09929682680944;
+const double kBt709Beta = 0.018053968510807;
+
+// Encoder table: 16 octaves [2^-16, 1) with 2^7 entries each, plus 1.0
+const int kTableOctaves = 16;
+const int kTableMantissaBits = 7;
+const int kTableFractionBits = 23 - kTableMantissaBits;
+const uint32_t kTableMinBits = static_cast<uint32_t>(127 - kTableOctaves) << 23;
+const float kTableMin = 1.0f / (1 << kTableOctaves);
+const size_t kTableSize = (static_cast<size_t>(kTableOctaves) << kTableMantissaBits) + 1;
+
+template <typename T>
+CPU_INLINE void ConvertRowBody(const T* in, T* out, int width, int channels, const float* decode,
+                               const float m[3][3], const TransferEncoder& encoder, float scale, float* row) {
+    // Decode + matrix
+    const T* src = in;
+    float* values = row;
+    for (int x = 0; x < width; x++, src += channels, values += 3) {
+        float r = decode[src[0]];
+        float g = decode[src[1]];
+        float b = decode[src[2]];
+        values[0] = m[0][0] * r + m[0][1] * g + m[0][2] * b;
+        values[1] = m[1][0] * r + m[1][1] * g + m[1][2] * b;
+        values[2] = m[2][0] * r + m[2][1] * g + m[2][2] * b;
+    }
+
+    encoder.EncodeRow(row, static_cast<size_t>(width) * 3);
+
+    // Quantize (alpha, if any, passes through)
+    values = row;
+    for (int x = 0; x < width; x++, in += channels, out += channels, values += 3) {
+        T alpha = channels == 4 ? in[3] : 0;
+        out[0] = static_cast<T>(values[0] * scale + 0.5f);
+        out[1] = static_cast<T>(values[1] * scale + 0.5f);
+        out[2] = static_cast<T>(values[2] * scale + 0.5f);
+        if (channels == 4) out[3] = alpha;
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, ConvertRow8, ConvertRowBody<uint8_t>,
+                    (const uint8_t* in, uint8_t* out, int width, int channels, const float* decode,
+                     const float m[3][3], const TransferEncoder& encoder, float scale, float* row),
+                    (in, out, width, channels, decode, m, encoder, scale, row))
+CPU_DISPATCH_KERNEL(void, ConvertRow16, ConvertRowBody<uint16_t>,
+                    (const uint16_t* in, uint16_t* out, int width, int channels, const float* decode,
+                     const float m[3][3], const TransferEncoder& encoder, float scale, float* row),
+                    (in, out, width, channels, decode, m, encoder, scale, row))
+
+void WriteU32(std::vector<uint8_t>& out, size_t pos, uint32_t value) {
+    out[pos] = static_cast<uint8_t>(value >> 24);
+    out[pos + 1] = static_cast<uint8_t>(value >> 16);
+    out[pos + 2] = static_cast<uint8_t>(value >> 8);
+    out[pos + 3] = static_cast<uint8_t>(value);
+}
+
+void WriteU16(std::vector<uint8_t>& out, size_t pos, uint16_t value) {
+    out[pos] = static_cast<uint8_t>(value >> 8);
+    out[pos + 1] = static_cast<uint8_t>(value);
+}
+
+void WriteS15Fixed16(std::vector<uint8_t>& out, size_t pos, double value) {
+    WriteU32(out, pos, static_cast<uint32_t>(static_cast<int32_t>(std::lround(value * 65536.0))));
+}
+
+} // namespace
+
+bool IsConvertibleColorSpace(int space) {
+    return space >= COLOR_SPACE_SRGB && space <= COLOR_SPACE_REC2020;
+}
+
+bool IsTransferFunction(int transfer) {
+    return transfer >= TRANSFER_DEFAULT && transfer <= TRANSFER_BT709;
+}
+
+TransferFunction DefaultTransfer(int space) {
+    switch (space) {
+        case COLOR_SPACE_ADOBE:
+        case COLOR_SPACE_WIDE:
+            return TRANSFER_GAMMA22;
+        case COLOR_SPACE_PROPHOTO:
+            return TRANSFER_GAMMA18;
+        case COLOR_SPACE_XYZ:
+        case COLOR_SPACE_ACES:
+            return TRANSFER_LINEAR;
+        case COLOR_SPACE_REC2020:
+            return TRANSFER_BT709;
+        default:
+            return TRANSFER_SRGB;
+    }
+}
+
+bool ColorSpaceMatrix(int from, int to, float matrix[3][3]) {
+    if (!IsConvertibleColorSpace(from) || !IsConvertibleColorSpace(to)) {
+        return false;
+    }
+
+    // from -> sRGB -> to
+    double inverse[3][3];
+    Invert3x3(OutputMatrix(from), inverse);
+    const double (*target)[3] = OutputMatrix(to);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            double sum = 0;
+            for (int k = 0; k < 3; k++) sum += target[i][k] * inverse[k][j];
+            matrix[i][j] = static_cast<float>(sum);
+        }
+    }
+    return true;
+}
+
+double TransferEncodeExact(TransferFunction transfer, double x) {
+    x = std::min(std::max(x, 0.0), 1.0);
+    switch (transfer) {
+        case TRANSFER_SRGB:
+            return x <= 0.0031308 ? x * 12.92 : 1.055 * std::pow(x, 1 / 2.4) - 0.055;
+        case TRANSFER_GAMMA22:
+            return std::pow(x, 256.0 / 563.0);
+        case TRANSFER_GAMMA18:
+            return x < 1.0 / 512 ? x * 16 : std::pow(x, 1 / 1.8);
+        case TRANSFER_BT709:
+            return x < kBt709Beta ? x * 4.5 : kBt709Alpha * std::pow(x, 0.45) - (kBt709Alpha - 1);
+        default:
+            return x;
+    }
+}
+
+double TransferDecodeExact(TransferFunction transfer, double y) {
+    y = std::min(std::max(y, 0.0), 1.0);
+    switch (transfer) {
+        case TRANSFER_SRGB:
+            return y <= 0.04045 ? y / 12.92 : std::pow((y + 0.055) / 1.055, 2.4);
+        case TRANSFER_GAMMA22:
+            return std::pow(y, 563.0 / 256.0);
+        case TRANSFER_GAMMA18:
+            return y < 16.0 / 512 ? y / 16 : std::pow(y, 1.8);
+        case TRANSFER_BT709:
+            return y < kBt709Beta * 4.5 ? y / 4.5 : std::pow((y + kBt709Alpha - 1) / kBt709Alpha, 1 / 0.45);
+        default:
+            return y;
+    }
+}
+
+TransferEncoder::TransferEncoder(TransferFunction transfer)
+    : transfer_(transfer), table_(kTableSize) {
+    for (size_t i = 0; i < kTableSize; i++) {
+        // Entry i is the float whose exponent/top mantissa bits are i
+        uint32_t bits = kTableMinBits + (static_cast<uint32_t>(i) << kTableFractionBits);
+        float x;
+        std::memcpy(&x, &bits, sizeof x);
+        table_[i] = static_cast<float>(TransferEncodeExact(transfer, x));
+    }
+}
+
+namespace {
+
+CPU_INLINE float EncodeValue(const float* table, TransferFunction transfer, float x) {
+    if (!(x > kTableMin)) {
+        // Below the table (or NaN); rare enough to evaluate directly
+        return x > 0.0f ? static_cast<float>(TransferEncodeExact(transfer, x)) : 0.0f;
+    }
+    if (x >= 1.0f) {
+        return 1.0f;
+    }
+
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof bits);
+    bits -= kTableMinBits;
+    uint32_t index = bits >> kTableFractionBits;
+    float frac = static_cast<float>(bits & ((1u << kTableFractionBits) - 1)) * (1.0f / (1u << kTableFractionBits));
+    float lo = table[index];
+    return lo + (table[index + 1] - lo) * frac;
+}
+
+CPU_INLINE void EncodeRowBody(const float* table, TransferFunction transfer, float* values, size_t count) {
+    if (transfer == TRANSFER_LINEAR) {
+        for (size_t i = 0; i < count; i++) {
+            values[i] = std::min(std::max(values[i], 0.0f), 1.0f);
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        values[i] = EncodeValue(table, transfer, values[i]);
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, EncodeRowKernel, EncodeRowBody,
+                    (const float* table, TransferFunction transfer, float* values, size_t count),
+                    (table, transfer, values, count))
+
+} // namespace
+
+float TransferEncoder::Encode(float x) const {
+    return EncodeValue(table_.data(), transfer_, x);
+}
+
+void TransferEncoder::EncodeRow(float* values, size_t count) const {
+    EncodeRowKernel(table_.data(), transfer_, values, count);
+}
+
+std::vector<float> TransferDecodeTable(TransferFunction transfer, int bits) {
+    size_t size = static_cast<size_t>(1) << bits;
+    double max = static_cast<double>(size - 1);
+    std::vector<float> table(size);
+    for (size_t i = 0; i < size; i++) {
+        table[i] = static_cast<float>(TransferDecodeExact(transfer, i / max));
+    }
+    return table;
+}
+
+bool ConvertColorSpace(const uint8_t* src, uint8_t* dst, int width, int height,
+                       int channels, int bits, const ColorConversion& conversion) {
+    TransferFunction from_transfer = Resolve(conversion.from_transfer, conversion.from);
+    TransferFunction to_transfer = Resolve(conversion.to_transfer, conversion.to);
+    float matrix[3][3];
+    if (!ColorSpaceMatrix(conversion.from, conversion.to, matrix) ||
+        !IsTransferFunction(from_transfer) || !IsTransferFunction(to_transfer) ||
+        (channels != 3 && channels != 4) || (bits != 8 && bits != 16) ||
+        width <= 0 || height <= 0) {
+        return false;
+    }
+
+    std::vector<float> decode = TransferDecodeTable(from_transfer, bits);
+    TransferEncoder encoder(to_transfer);
+    float scale = static_cast<float>((1 << bits) - 1);
+    size_t row_samples = static_cast<size_t>(width) * channels;
+
+    ParallelRows(height, 16, [&](int first, int last) {
+        std::vector<float> row(static_cast<size_t>(width) * 3);
+        for (int y = first; y < last; y++) {
+            size_t offset = static_cast<size_t>(y) * row_samples;
+            if (bits == 8) {
+                ConvertRow8(src + offset, dst + offset, width, channels, decode.data(),
+                            matrix, encoder, scale, row.data());
+            } else {
+                ConvertRow16(reinterpret_cast<const uint16_t*>(src) + offset,
+                             reinterpret_cast<uint16_t*>(dst) + offset, width, channels,
+                             decode.data(), matrix, encoder, scale, row.data());
+            }
+        }
+    });
+    return true;
+}
+
+bool BuildColorProfile(int space, TransferFunction transfer, std::vector<uint8_t>& out) {
+    static const char* const kNames[] = {
+        "sRGB", "Adobe RGB (1998)", "WideGamut D65", "ProPhoto D65",
+        "XYZ", "ACES", "DCI-P3 D65", "Rec. 2020"
+    };
+    static const char* const kTransferNames[] = {
+        "linear", "sRGB curve", "gamma 2.2", "gamma 1.8", "BT.709 curve"
+    };
+
+    transfer = Resolve(transfer, space);
+    if (!IsConvertibleColorSpace(space) || !IsTransferFunction(transfer)) {
+        return false;
+    }
+
+    std::string description = std::string(kNames[space - 1]) + " (" + kTransferNames[transfer] + ")";
+
+    // Tag data sizes: desc (v2 textDescriptionType), cprt, wtpt + 3 colorants,
+    // one TRC shared by all three channels (pure powers as a single gamma)
+    const int kCurvePoints = 1024;
+    size_t desc_size = 12 + description.size() + 1 + 4 + 4 + 2 + 1 + 67;
+    const char* copyright = "No copyright, use freely";
+    size_t cprt_size = 8 + std::strlen(copyright) + 1;
+    size_t curve_points = transfer == TRANSFER_LINEAR ? 0 : transfer == TRANSFER_GAMMA22 ? 1 : kCurvePoints;
+    size_t trc_size = 12 + curve_points * 2;
+
+    struct Tag { uint32_t signature; size_t offset; size_t size; };
+    const uint32_t kTagCount = 9;
+    size_t pos = 128 + 4 + kTagCount * 12;
+    auto place = [&pos](size_t size) {
+        size_t offset = pos;
+        pos += (size + 3) & ~static_cast<size_t>(3);
+        return offset;
+    };
+    size_t desc_at = place(desc_size);
+    size_t cprt_at = place(cprt_size);
+    size_t wtpt_at = place(20);
+    size_t xyz_at[3] = { place(20), place(20), place(20) };
+    size_t trc_at = place(trc_size);
+    const Tag tags[kTagCount] = {
+        { 0x64657363, desc_at, desc_size },     // desc
+        { 0x63707274, cprt_at, cprt_size },     // cprt
+        { 0x77747074, wtpt_at, 20 },            // wtpt
+        { 0x7258595a, xyz_at[0], 20 },          // rXYZ
+        { 0x6758595a, xyz_at[1], 20 },          // gXYZ
+        { 0x6258595a, xyz_at[2], 20 },          // bXYZ
+        { 0x72545243, trc_at, trc_size },       // rTRC
+        { 0x67545243, trc_at, trc_size },       // gTRC
+        { 0x62545243, trc_at, trc_size }        // bTRC
+    };
+
+    out.assign(pos, 0);
+
+    // Header: v2.1 display profile, RGB data, XYZ PCS, D50 illuminant
+    WriteU32(out, 0, static_cast<uint32_t>(pos));
+    WriteU32(out, 8, 0x02100000);
+    WriteU32(out, 12, 0x6d6e7472);      // 'mntr'
+    WriteU32(out, 16, 0x52474220);      // 'RGB '
+    WriteU32(out, 20, 0x58595a20);      // 'XYZ '
+    WriteU32(out, 36, 0x61637370);      // 'acsp'
+    WriteS15Fixed16(out, 68, 0.9642);
+    WriteS15Fixed16(out, 72, 1.0);
+    WriteS15Fixed16(out, 76, 0.8249);
+
+    WriteU32(out, 128, kTagCount);
+    for (uint32_t i = 0; i < kTagCount; i++) {
+        WriteU32(out, 132 + i * 12, tags[i].signature);
+        WriteU32(out, 136 + i * 12, static_cast<uint32_t>(tags[i].offset));
+        WriteU32(out, 140 + i * 12, static_cast<uint32_t>(tags[i].size));
+    }
+
+    WriteU32(out, desc_at, 0x64657363);
+    WriteU32(out, desc_at + 8, static_cast<uint32_t>(description.size() + 1));
+    std::memcpy(&out[desc_at + 12], description.c_str(), description.size());
+
+    WriteU32(out, cprt_at, 0x74657874);  // 'text'
+    std::memcpy(&out[cprt_at + 8], copyright, std::strlen(copyright));
+
+    // Colorants: columns of (space -> sRGB -> XYZ D50), as LibRaw's own profiles
+    double inverse[3][3];
+    Invert3x3(OutputMatrix(space), inverse);
+    const double white[3] = { 0.9642, 1.0, 0.8249 };
+    WriteU32(out, wtpt_at, 0x58595a20);
+    for (int i = 0; i < 3; i++) {
+        WriteS15Fixed16(out, wtpt_at + 8 + i * 4, white[i]);
+    }
+    for (int j = 0; j < 3; j++) {
+        WriteU32(out, xyz_at[j], 0x58595a20);
+        for (int i = 0; i < 3; i++) {
+            double sum = 0;
+            for (int k = 0; k < 3; k++) sum += LibRaw_constants::xyzd50_srgb[i][k] * inverse[k][j];
+            WriteS15Fixed16(out, xyz_at[j] + 8 + i * 4, sum);
+        }
+    }
+
+    WriteU32(out, trc_at, 0x63757276);   // 'curv'
+    WriteU32(out, trc_at + 8, static_cast<uint32_t>(curve_points));
+    if (curve_points == 1) {
+        WriteU16(out, trc_at + 12, 563);    // u8Fixed8, 563/256
+    } else {
+        for (size_t i = 0; i < curve_points; i++) {
+            double linear = TransferDecodeExact(transfer, static_cast<double>(i) / (curve_points - 1));
+            WriteU16(out, trc_at + 12 + i * 2, static_cast<uint16_t>(std::lround(linear * 65535.0)));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+/**
+ * @filmgallery/libraw-native - Colour Space Conversion
+ *
+ * Conversions between LibRaw's output colour spaces (sRGB, Adobe RGB,
+ * WideGamut, ProPhoto, XYZ, ACES, DCI-P3, Rec. 2020; all D65 like LibRaw's
+ * own out_rgb matrices) as decode -> 3x3 matrix -> encode in float:
+ *
+ *   decode   8/16-bit code value to linear through a full lookup table
+ *   matrix   out_rgb[to] * inverse(out_rgb[from]), precomputed once
+ *   encode   linear to transfer curve through a table indexed by the float's
+ *            exponent and top mantissa bits, linearly interpolated
+ *
+ * Rows are processed as flat float arrays (decode+matrix, then encode, then
+ * quantize) so each pass is a simple loop, and images are split across
+ * threads by rows. FilmLibRaw uses the same encoder to fuse a conversion into
+ * the output copy (export colour space), skipping LibRaw's gamma curve.
+ */
+
+#ifndef COLOR_CONVERT_H
+#define COLOR_CONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Same numbering as LibRaw's output_color (0 = raw is not convertible)
+enum ColorSpaceId {
+    COLOR_SPACE_SRGB = 1,
+    COLOR_SPACE_ADOBE = 2,
+    COLOR_SPACE_WIDE = 3,
+    COLOR_SPACE_PROPHOTO = 4,
+    COLOR_SPACE_XYZ = 5,
+    COLOR_SPACE_ACES = 6,
+    COLOR_SPACE_DCIP3 = 7,
+    COLOR_SPACE_REC2020 = 8
+};
+
+enum TransferFunction {
+    TRANSFER_DEFAULT = -1,  // The colour space's usual curve (DefaultTransfer)
+    TRANSFER_LINEAR = 0,
+    TRANSFER_SRGB = 1,      // IEC 61966-2-1 piecewise
+    TRANSFER_GAMMA22 = 2,   // Adobe RGB (1998), pure 563/256 power
+    TRANSFER_GAMMA18 = 3,   // ROMM (ProPhoto), 1.8 power with a 16x toe
+    TRANSFER_BT709 = 4      // BT.709/BT.2020 OETF (LibRaw's default gamma)
+};
+
+bool IsConvertibleColorSpace(int space);
+bool IsTransferFunction(int transfer);
+
+/**
+ * Transfer a colour space is normally encoded with
+ * (XYZ and ACES are linear, DCI-P3 uses the Display P3 sRGB curve)
+ */
+TransferFunction DefaultTransfer(int space);
+
+/**
+ * Linear-to-linear matrix from one output colour space to another
+ * @returns false if either space is not convertible
+ */
+bool ColorSpaceMatrix(int from, int to, float matrix[3][3]);
+
+/**
+ * Exact transfer functions (scalar, double precision)
+ */
+double TransferEncodeExact(TransferFunction transfer, double linear);
+double TransferDecodeExact(TransferFunction transfer, double encoded);
+
+/**
+ * Table-driven linear -> encoded evaluation. Inputs are clamped to [0, 1];
+ * the result is within 2e-6 of TransferEncodeExact().
+ */
+class TransferEncoder {
+public:
+    explicit TransferEncoder(TransferFunction transfer);
+
+    float Encode(float linear) const;
+
+    /**
+     * Encode `count` values in place
+     */
+    void EncodeRow(float* values, size_t count) const;
+
+private:
+    TransferFunction transfer_;
+    std::vector<float> table_;
+};
+
+/**
+ * Code value (0..2^bits-1) -> linear lookup table
+ */
+std::vector<float> TransferDecodeTable(TransferFunction transfer, int bits);
+
+/**
+ * A prepared conversion between two (space, transfer) pairs
+ */
+struct ColorConversion {
+    int from;
+    int to;
+    TransferFunction from_transfer;
+    TransferFunction to_transfer;
+};
+
+/**
+ * Convert interleaved 8- or 16-bit (native-endian) pixels with 3 or 4
+ * channels; a 4th channel is copied unchanged. `src` and `dst` may alias.
+ * @returns false for unsupported spaces, transfers, channels or bits
+ */
+bool ConvertColorSpace(const uint8_t* src, uint8_t* dst, int width, int height,
+                       int channels, int bits, const ColorConversion& conversion);
+
+/**
+ * ICC v2 matrix/TRC display profile describing `space` encoded with
+ * `transfer`, for tagging converted output
+ */
+bool BuildColorProfile(int space, TransferFunction transfer, std::vector<uint8_t>& out);
+
+#endif // COLOR_CONVERT_H
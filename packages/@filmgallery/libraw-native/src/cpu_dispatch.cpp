@@ -0,0 +1,83 @@
+/**
+ * @filmgallery/libraw-native - CPU Feature Dispatch
+ */
+
+#include "cpu_dispatch.h"
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace {
+
+CpuLevel Detect() {
+#if CPU_DISPATCH
+    // __builtin_cpu_supports also checks that the OS saves the AVX state
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl") &&
+        __builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) {
+        return CPU_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c") &&
+        __builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2")) {
+        return CPU_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt")) {
+        return CPU_SSE42;
+    }
+    return CPU_BASELINE;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    // Reported for getVersion() only; MSVC builds run the baseline kernels
+    int info[4];
+    __cpuid(info, 1);
+    bool sse42 = (info[2] & (1 << 20)) && (info[2] & (1 << 23));
+    bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    bool f16c = (info[2] & (1 << 29)) != 0;
+    __cpuidex(info, 7, 0);
+    bool avx2 = avx && f16c && (info[1] & (1 << 5)) && (info[1] & (1 << 3)) && (info[1] & (1 << 8));
+    bool avx512 = avx2 && (info[1] & (1 << 16)) && (info[1] & (1 << 17)) && (info[1] & (1 << 30)) &&
+                  (info[1] & (1 << 31)) && (_xgetbv(0) & 0xe6) == 0xe6;
+    return avx512 ? CPU_AVX512 : avx2 ? CPU_AVX2 : sse42 ? CPU_SSE42 : CPU_BASELINE;
+#else
+    return CPU_BASELINE;
+#endif
+}
+
+} // namespace
+
+CpuLevel DetectedCpuLevel() {
+    static const CpuLevel level = Detect();
+    return level;
+}
+
+CpuLevel ActiveCpuLevel() {
+    static const CpuLevel level = []() {
+#if CPU_DISPATCH
+        CpuLevel active = DetectedCpuLevel();
+        const char* cap = std::getenv("LIBRAW_NATIVE_CPU");
+        if (cap) {
+            for (int i = CPU_BASELINE; i <= CPU_AVX512; i++) {
+                if (std::strcmp(cap, CpuLevelName(static_cast<CpuLevel>(i))) == 0 && i < active) {
+                    active = static_cast<CpuLevel>(i);
+                }
+            }
+        }
+        return active;
+#else
+        return CPU_BASELINE;
+#endif
+    }();
+    return level;
+}
+
+const char* CpuLevelName(CpuLevel level) {
+    switch (level) {
+        case CPU_SSE42: return "sse4.2";
+        case CPU_AVX2: return "avx2";
+        case CPU_AVX512: return "avx512";
+        default: return "baseline";
+    }
+}
@@ -0,0 +1,80 @@
+/**
+ * @filmgallery/libraw-native - CPU Feature Dispatch
+ *
+ * binding.gyp builds for the baseline ISA so one binary runs everywhere.
+ * Hot row kernels are instead compiled once per ISA level with function
+ * target attributes, and a function pointer picks the best variant for the
+ * running CPU when the module loads:
+ *
+ *     CPU_INLINE void ScaleRowBody(float* row, size_t n, float k) { ... }
+ *     CPU_DISPATCH_KERNEL(void, ScaleRow, ScaleRowBody,
+ *                         (float* row, size_t n, float k), (row, n, k))
+ *
+ * defines `ScaleRow(row, n, k)`. The body is force-inlined into each
+ * variant, so the compiler vectorizes it for that variant's ISA. FMA is not
+ * enabled (and binding.gyp turns off contraction), so every level gives
+ * bit-identical results.
+ *
+ * LIBRAW_NATIVE_CPU=baseline|sse4.2|avx2|avx512 caps the level (benchmarks,
+ * tests). Non-x86 and MSVC builds use the baseline variant only.
+ */
+
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+enum CpuLevel {
+    CPU_BASELINE = 0,
+    CPU_SSE42 = 1,
+    CPU_AVX2 = 2,       // with F16C
+    CPU_AVX512 = 3      // F, BW, DQ, VL
+};
+
+/**
+ * Best level this CPU (and OS) supports
+ */
+CpuLevel DetectedCpuLevel();
+
+/**
+ * Level the kernels run at: detected, capped by LIBRAW_NATIVE_CPU
+ */
+CpuLevel ActiveCpuLevel();
+
+const char* CpuLevelName(CpuLevel level);
+
+template <typename Fn>
+Fn CpuSelect(Fn baseline, Fn sse42, Fn avx2, Fn avx512) {
+    switch (ActiveCpuLevel()) {
+        case CPU_AVX512: return avx512;
+        case CPU_AVX2: return avx2;
+        case CPU_SSE42: return sse42;
+        default: return baseline;
+    }
+}
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+
+#define CPU_DISPATCH 1
+#define CPU_INLINE inline __attribute__((always_inline))
+#define CPU_TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+#define CPU_TARGET_AVX2 __attribute__((target("avx2,f16c,bmi,bmi2")))
+#define CPU_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512dq,avx512vl,avx2,f16c,bmi,bmi2")))
+
+#define CPU_DISPATCH_KERNEL(ret, name, body, params, args)                          \
+    static ret name##_baseline params { return body args; }                         \
+    static CPU_TARGET_SSE42 ret name##_sse42 params { return body args; }           \
+    static CPU_TARGET_AVX2 ret name##_avx2 params { return body args; }             \
+    static CPU_TARGET_AVX512 ret name##_avx512 params { return body args; }         \
+    static ret (*const name) params = CpuSelect<ret (*) params>(                    \
+        name##_baseline, name##_sse42, name##_avx2, name##_avx512);
+
+#else
+
+#define CPU_DISPATCH 0
+#define CPU_INLINE inline
+
+#define CPU_DISPATCH_KERNEL(ret, name, body, params, args)                          \
+    static ret name params { return body args; }
+
+#endif
+
+#endif // CPU_DISPATCH_H
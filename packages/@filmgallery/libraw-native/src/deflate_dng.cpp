@@ -0,0 +1,239 @@
+/**
+ * @filmgallery/libraw-native - Deflate DNG
+ *
+ * Deflate-compressed DNGs (compression 8: HDR merges, scanner and
+ * denoiser output, mostly 16/24/32-bit float) go through LibRaw's
+ * deflate_dng_load_raw(), which is compiled only with zlib and then reads
+ * floats only. Unpack() runs DeflateDngLoadRaw() in its place: tiles or
+ * strips are read in file order, then inflated (inflate.cpp) and
+ * predictor-decoded on separate threads into the layout LibRaw's loader
+ * produces (dng_tiles.cpp). 16-bit integer data, which LibRaw rejects, is
+ * decoded straight to the integer image.
+ */
+
+#include "film_libraw.h"
+#include "inflate.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+inline bool LittleEndianHost() {
+    const uint16_t probe = 1;
+    return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+}
+
+// Half and 24-bit floats as the DNG SDK widens them: infinities become the
+// largest finite value, NaNs zero
+inline uint32_t HalfToFloatBits(uint16_t half) {
+    uint32_t sign = (half >> 15) & 1;
+    int exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            return sign << 31;
+        }
+        while (!(mantissa & 0x400)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        exponent++;
+        mantissa &= ~0x400u;
+    } else if (exponent == 31) {
+        return mantissa ? 0 : sign << 31 | uint32_t(0x1e + 127 - 15) << 23 | 0x3ffu << 13;
+    }
+    return sign << 31 | uint32_t(exponent + 127 - 15) << 23 | mantissa << 13;
+}
+
+inline uint32_t Fp24ToFloatBits(const uint8_t* p) {
+    uint32_t sign = p[0] >> 7;
+    int exponent = p[0] & 0x7f;
+    uint32_t mantissa = uint32_t(p[1]) << 8 | p[2];
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            return sign << 31;
+        }
+        while (!(mantissa & 0x10000)) {
+            mantissa <<= 1;
+            exponent--;
+        }
+        exponent++;
+        mantissa &= ~0x10000u;
+    } else if (exponent == 127) {
+        return mantissa ? 0 : sign << 31 | uint32_t(0x7e + 128 - 64) << 23 | 0xffffu << 7;
+    }
+    return sign << 31 | uint32_t(exponent + 128 - 64) << 23 | mantissa << 7;
+}
+
+// Floating point predictor (DNG 1.4, 34894/34895 group 2 or 4 pixels): bytes
+// are differenced `channels` apart, then stored as byte planes, most
+// significant first. Output is native-endian, except 24-bit values, which
+// stay big-endian for Fp24ToFloatBits().
+void DecodeFloatPredictor(uint8_t* src, uint8_t* dst, int cols, int channels, int bytes, bool little) {
+    const size_t plane = static_cast<size_t>(cols) * channels;
+    for (size_t i = channels; i < plane * bytes; i++) {
+        src[i] = static_cast<uint8_t>(src[i] + src[i - channels]);
+    }
+    for (int b = 0; b < bytes; b++) {
+        const uint8_t* in = src + b * plane;
+        uint8_t* out = dst + (bytes == 3 || !little ? b : bytes - 1 - b);
+        for (size_t i = 0; i < plane; i++) out[i * bytes] = in[i];
+    }
+}
+
+// Unpredicted samples from file byte order to what ExpandFloats() expects
+void SwapFloatBytes(uint8_t* row, size_t count, int bytes, bool file_little, bool little) {
+    if (bytes == 3) {
+        if (file_little) {
+            for (size_t i = 0; i < count; i++) std::swap(row[i * 3], row[i * 3 + 2]);
+        }
+    } else if (file_little != little) {
+        for (size_t i = 0; i < count; i++) std::reverse(row + i * bytes, row + (i + 1) * bytes);
+    }
+}
+
+// Widen a row of 2/3/4-byte floats to float
+float ExpandFloats(const uint8_t* src, float* dst, size_t count, int bytes) {
+    float max = 0.f;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t bits;
+        if (bytes == 2) {
+            uint16_t half;
+            memcpy(&half, src + i * 2, 2);
+            bits = HalfToFloatBits(half);
+        } else if (bytes == 3) {
+            bits = Fp24ToFloatBits(src + i * 3);
+        } else {
+            memcpy(&bits, src + i * 4, 4);
+        }
+        float value;
+        memcpy(&value, &bits, 4);
+        dst[i] = value;
+        max = value > max ? value : max;
+    }
+    return max;
+}
+
+} // namespace
+
+void FilmLibRaw::DeflateDngLoadRaw() {
+    const tiff_ifd_t& ifd = DngRawIfd();
+    const int samples = ifd.samples;
+    const bool floating = ifd.sample_format == 3;
+    const int bytes = ifd.bps / 8;
+    if (floating ? (ifd.bps % 8 || bytes < 2 || bytes > 4) : (ifd.sample_format > 1 || ifd.bps != 16)) {
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+    }
+
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    const size_t pixels = size_t(raw_width) * raw_height * samples;
+    if (INT64(pixels) * (floating ? 6 : 2) > INT64(imgdata.rawparams.max_raw_memory_mb) * INT64(1024 * 1024)) {
+        throw LIBRAW_EXCEPTION_TOOBIG;
+    }
+    unsigned tile_width, tile_height;
+    std::vector<DngTile> tiles;
+    ReadDngTiles(ifd, tile_width, tile_height, tiles);
+
+    // Floats are decoded whole first (convertFloatToInt() scales by their
+    // maximum), 16-bit integers straight into the image
+    float* float_image = nullptr;
+    ushort* int_image = nullptr;
+    if (floating) {
+        float_image = static_cast<float*>(calloc(pixels, sizeof(float)));
+    } else {
+        int_image = static_cast<ushort*>(calloc(pixels, sizeof(ushort)));
+    }
+    if (!float_image && !int_image) {
+        throw LIBRAW_EXCEPTION_ALLOC;
+    }
+
+    const bool little = LittleEndianHost();
+    const bool file_little = libraw_internal_data.unpacker_data.order == 0x4949;
+    // Float data is predicted unless the tag says none (LibRaw decodes any
+    // other value as predictor 3); integers only with predictor 2 and its
+    // X2/X4 variants. `factor` is the pixels per predictor group.
+    const int predictor = ifd.predictor;
+    const bool predicted = floating ? predictor > 1 : predictor == 2 || predictor == 34892 || predictor == 34893;
+    const int factor = predictor == (floating ? 34894 : 34892) ? 2 : predictor == (floating ? 34895 : 34893) ? 4 : 1;
+    const size_t row_samples = size_t(tile_width) * samples;
+    const size_t row_bytes = row_samples * bytes;
+    const size_t tile_bytes = row_bytes * tile_height;
+
+    std::vector<float> tile_max(tiles.size(), 0.f);
+    std::atomic<bool> ok(true);
+    ParallelRows(static_cast<int>(tiles.size()), 1, [&](int first, int last) {
+        std::vector<uint8_t> inflated;
+        std::vector<uint8_t> scratch;
+        std::vector<float> floats;
+        std::vector<ushort> ints;
+        try {
+            inflated.resize(tile_bytes);
+            scratch.resize(row_bytes);
+            if (floating) floats.resize(row_samples);
+            else ints.resize(row_samples);
+        } catch (const std::bad_alloc&) {
+            ok = false;
+            return;
+        }
+
+        for (int t = first; t < last && ok; t++) {
+            const DngTile& tile = tiles[t];
+            size_t written = 0;
+            if (!InflateZlib(tile.data.data(), tile.data.size(), inflated.data(), tile_bytes, written)) {
+                ok = false;
+                break;
+            }
+            // A short final strip leaves the rest of the buffer as zeros
+            memset(inflated.data() + written, 0, tile_bytes - written);
+
+            const unsigned rows = std::min(tile_height, raw_height - tile.row);
+            const size_t cols = std::min(tile_width, raw_width - tile.col);
+            float max = 0.f;
+            for (unsigned r = 0; r < rows; r++) {
+                uint8_t* src = inflated.data() + r * row_bytes;
+                const size_t offset = (size_t(tile.row + r) * raw_width + tile.col) * samples;
+                if (floating) {
+                    if (!predicted) {
+                        SwapFloatBytes(src, row_samples, bytes, file_little, little);
+                        memcpy(scratch.data(), src, row_bytes);
+                    } else {
+                        DecodeFloatPredictor(src, scratch.data(), tile_width / factor, samples * factor, bytes, little);
+                    }
+                    max = std::max(max, ExpandFloats(scratch.data(), floats.data(), row_samples, bytes));
+                    memcpy(float_image + offset, floats.data(), cols * samples * sizeof(float));
+                    continue;
+                }
+                for (size_t i = 0; i < row_samples; i++) {
+                    ints[i] = static_cast<ushort>(file_little ? src[i * 2] | src[i * 2 + 1] << 8
+                                                              : src[i * 2] << 8 | src[i * 2 + 1]);
+                }
+                if (predicted) {
+                    const size_t stride = size_t(samples) * factor;
+                    for (size_t i = stride; i < row_samples; i++) {
+                        ints[i] = static_cast<ushort>(ints[i] + ints[i - stride]);
+                    }
+                }
+                memcpy(int_image + offset, ints.data(), cols * samples * sizeof(ushort));
+            }
+            tile_max[t] = max;
+        }
+    });
+    if (!ok) {
+        free(float_image);
+        free(int_image);
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+    }
+
+    if (floating) {
+        float max = 0.f;
+        for (float m : tile_max) max = std::max(max, m);
+        AttachFloatImage(float_image, samples, max);
+    } else {
+        AttachRawImage(int_image, samples);
+    }
+}
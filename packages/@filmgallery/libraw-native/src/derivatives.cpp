@@ -0,0 +1,255 @@
+/**
+ * @filmgallery/libraw-native - Derivative Images
+ */
+
+#include "derivatives.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+/**
+ * Area filter taps along one axis: output sample o covers input
+ * [o * scale, (o + 1) * scale), each input weighted by its overlap
+ */
+struct AreaFilter {
+    std::vector<int> first;         // first input index per output
+    std::vector<int> offset;        // taps of output o: weights[offset[o] .. offset[o + 1])
+    std::vector<float> weights;
+
+    AreaFilter(int in, int out) {
+        double scale = static_cast<double>(in) / out;
+        first.reserve(out);
+        offset.reserve(out + 1);
+        for (int o = 0; o < out; o++) {
+            double start = o * scale;
+            double end = (o + 1) * scale;
+            int i0 = static_cast<int>(std::floor(start));
+            int i1 = std::min(in, static_cast<int>(std::ceil(end)));
+            first.push_back(i0);
+            offset.push_back(static_cast<int>(weights.size()));
+            for (int i = i0; i < i1; i++) {
+                double overlap = std::min(end, i + 1.0) - std::max(start, static_cast<double>(i));
+                weights.push_back(static_cast<float>(overlap / scale));
+            }
+        }
+        offset.push_back(static_cast<int>(weights.size()));
+    }
+
+    int Taps(int o) const { return offset[o + 1] - offset[o]; }
+    const float* Weights(int o) const { return weights.data() + offset[o]; }
+};
+
+/**
+ * A linear-light image: either the encoded source (decoded row by row) or a
+ * level already built in float
+ */
+struct LinearSource {
+    int width;
+    int height;
+    int channels;
+    const float* pixels;            // float level, or null for the source
+    const uint8_t* src;
+    int bits;
+    const float* decode;            // transfer decode table for colour samples
+    float alpha_scale;
+
+    // Linear row `y`; `scratch` holds width * channels floats when decoding
+    const float* Row(int y, float* scratch) const {
+        size_t samples = static_cast<size_t>(width) * channels;
+        if (pixels) {
+            return pixels + static_cast<size_t>(y) * samples;
+        }
+        if (bits == 8) {
+            DecodeRow(src + static_cast<size_t>(y) * samples, scratch, samples);
+        } else {
+            DecodeRow(reinterpret_cast<const uint16_t*>(src) + static_cast<size_t>(y) * samples, scratch, samples);
+        }
+        return scratch;
+    }
+
+    template <typename T>
+    void DecodeRow(const T* in, float* out, size_t samples) const {
+        if (channels == 3) {
+            for (size_t i = 0; i < samples; i++) out[i] = decode[in[i]];
+            return;
+        }
+        for (size_t i = 0; i < samples; i += 4) {
+            out[i] = decode[in[i]];
+            out[i + 1] = decode[in[i + 1]];
+            out[i + 2] = decode[in[i + 2]];
+            out[i + 3] = in[i + 3] * alpha_scale;
+        }
+    }
+};
+
+// One input row through the horizontal filter
+CPU_INLINE void FilterRowBody(const float* in, float* row, const AreaFilter& horizontal, int width, int channels) {
+    for (int x = 0; x < width; x++) {
+        const float* wx = horizontal.Weights(x);
+        const float* px = in + static_cast<size_t>(horizontal.first[x]) * channels;
+        float sum[4] = { 0, 0, 0, 0 };
+        for (int k = 0; k < horizontal.Taps(x); k++, px += channels) {
+            for (int c = 0; c < channels; c++) sum[c] += px[c] * wx[k];
+        }
+        for (int c = 0; c < channels; c++) row[x * channels + c] = sum[c];
+    }
+}
+
+// acc = row * weight (first tap) or acc += row * weight
+CPU_INLINE void AccumulateRowBody(float* acc, const float* row, float weight, size_t count, bool first) {
+    if (first) {
+        for (size_t i = 0; i < count; i++) acc[i] = row[i] * weight;
+    } else {
+        for (size_t i = 0; i < count; i++) acc[i] += row[i] * weight;
+    }
+}
+
+template <typename T>
+CPU_INLINE void QuantizeRowBody(const float* row, T* dst, size_t count, float max) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = static_cast<T>(row[i] * max + 0.5f);
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, FilterRow, FilterRowBody,
+                    (const float* in, float* row, const AreaFilter& horizontal, int width, int channels),
+                    (in, row, horizontal, width, channels))
+CPU_DISPATCH_KERNEL(void, AccumulateRow, AccumulateRowBody,
+                    (float* acc, const float* row, float weight, size_t count, bool first),
+                    (acc, row, weight, count, first))
+CPU_DISPATCH_KERNEL(void, QuantizeRow8, QuantizeRowBody<uint8_t>,
+                    (const float* row, uint8_t* dst, size_t count, float max), (row, dst, count, max))
+CPU_DISPATCH_KERNEL(void, QuantizeRow16, QuantizeRowBody<uint16_t>,
+                    (const float* row, uint16_t* dst, size_t count, float max), (row, dst, count, max))
+
+inline void QuantizeRow(const float* row, uint8_t* dst, size_t count, float max) {
+    QuantizeRow8(row, dst, count, max);
+}
+
+inline void QuantizeRow(const float* row, uint16_t* dst, size_t count, float max) {
+    QuantizeRow16(row, dst, count, max);
+}
+
+/**
+ * Area-resample `source` into a width x height float image
+ */
+std::vector<float> Resample(const LinearSource& source, int width, int height) {
+    const int channels = source.channels;
+    const AreaFilter horizontal(source.width, width);
+    const AreaFilter vertical(source.height, height);
+    std::vector<float> out(static_cast<size_t>(width) * height * channels);
+
+    // Split by output rows; input rows on a boundary are read by both sides
+    ParallelRows(height, 8, [&](int first, int last) {
+        std::vector<float> scratch(static_cast<size_t>(source.width) * channels);
+        std::vector<float> row(static_cast<size_t>(width) * channels);
+        for (int y = first; y < last; y++) {
+            float* acc = out.data() + static_cast<size_t>(y) * width * channels;
+            const float* wy = vertical.Weights(y);
+            for (int t = 0; t < vertical.Taps(y); t++) {
+                const float* in = source.Row(vertical.first[y] + t, scratch.data());
+                FilterRow(in, row.data(), horizontal, width, channels);
+                AccumulateRow(acc, row.data(), wy[t], row.size(), t == 0);
+            }
+        }
+    });
+    return out;
+}
+
+template <typename T>
+void Quantize(const float* in, T* out, int width, int height, int channels,
+              const TransferEncoder& encoder, float max) {
+    ParallelRows(height, 16, [&](int first, int last) {
+        size_t samples = static_cast<size_t>(width) * channels;
+        std::vector<float> row(samples);
+        for (int y = first; y < last; y++) {
+            const float* src = in + static_cast<size_t>(y) * samples;
+            std::memcpy(row.data(), src, samples * sizeof(float));
+            if (channels == 3) {
+                encoder.EncodeRow(row.data(), samples);
+            } else {
+                for (size_t i = 0; i < samples; i += 4) {
+                    row[i] = encoder.Encode(row[i]);
+                    row[i + 1] = encoder.Encode(row[i + 1]);
+                    row[i + 2] = encoder.Encode(row[i + 2]);
+                    row[i + 3] = std::min(std::max(row[i + 3], 0.0f), 1.0f);
+                }
+            }
+            QuantizeRow(row.data(), out + static_cast<size_t>(y) * samples, samples, max);
+        }
+    });
+}
+
+} // namespace
+
+void DerivativeSize(int width, int height, int max_width, int max_height,
+                    int* out_width, int* out_height) {
+    double scale = 1.0;
+    if (max_width > 0) scale = std::min(scale, static_cast<double>(max_width) / width);
+    if (max_height > 0) scale = std::min(scale, static_cast<double>(max_height) / height);
+    *out_width = std::max(1, static_cast<int>(std::lround(width * scale)));
+    *out_height = std::max(1, static_cast<int>(std::lround(height * scale)));
+}
+
+bool BuildDerivatives(const uint8_t* src, int width, int height, int channels, int bits,
+                      TransferFunction transfer, const std::vector<DerivativeLevel>& levels) {
+    if ((channels != 3 && channels != 4) || (bits != 8 && bits != 16) ||
+        transfer == TRANSFER_DEFAULT || !IsTransferFunction(transfer) ||
+        width <= 0 || height <= 0) {
+        return false;
+    }
+    for (const DerivativeLevel& level : levels) {
+        if (level.width <= 0 || level.height <= 0 || level.width > width || level.height > height) {
+            return false;
+        }
+    }
+
+    const std::vector<float> decode = TransferDecodeTable(transfer, bits);
+    const TransferEncoder encoder(transfer);
+    const float max = static_cast<float>((1 << bits) - 1);
+    const size_t bytes_per_pixel = static_cast<size_t>(channels) * (bits / 8);
+
+    // Largest first, so each level can start from the previous ones
+    std::vector<size_t> order(levels.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&levels](size_t a, size_t b) {
+        return static_cast<int64_t>(levels[a].width) * levels[a].height >
+               static_cast<int64_t>(levels[b].width) * levels[b].height;
+    });
+
+    struct Built { int width; int height; std::vector<float> pixels; };
+    std::vector<Built> built;
+
+    for (size_t index : order) {
+        const DerivativeLevel& level = levels[index];
+        if (level.width == width && level.height == height) {
+            std::memcpy(level.data, src, static_cast<size_t>(width) * height * bytes_per_pixel);
+            continue;
+        }
+
+        LinearSource source = { width, height, channels, nullptr, src, bits, decode.data(), 1.0f / max };
+        for (const Built& b : built) {
+            // Smallest built level still covering this one
+            if (b.width >= level.width && b.height >= level.height &&
+                static_cast<int64_t>(b.width) * b.height < static_cast<int64_t>(source.width) * source.height) {
+                source.width = b.width;
+                source.height = b.height;
+                source.pixels = b.pixels.data();
+            }
+        }
+
+        Built next = { level.width, level.height, Resample(source, level.width, level.height) };
+        if (bits == 8) {
+            Quantize(next.pixels.data(), level.data, level.width, level.height, channels, encoder, max);
+        } else {
+            Quantize(next.pixels.data(), reinterpret_cast<uint16_t*>(level.data),
+                     level.width, level.height, channels, encoder, max);
+        }
+        built.push_back(std::move(next));
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+/**
+ * @filmgallery/libraw-native - Derivative Images
+ *
+ * Fan-out of one rendered image into smaller copies (preview, thumbnail,
+ * pyramid levels) in a single pass over the source. Pixels are decoded to
+ * linear light once per source row, downsampled with an area (box) filter,
+ * and each level is re-encoded with the source's transfer curve
+ * (color_convert.h). Levels cascade: each one is resampled from the smallest
+ * larger level already built (kept in linear float), not from the source.
+ */
+
+#ifndef DERIVATIVES_H
+#define DERIVATIVES_H
+
+#include "color_convert.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Output size for a bounding box: fit inside, never enlarged, aspect kept.
+ * A bound of 0 leaves that dimension unconstrained.
+ */
+void DerivativeSize(int width, int height, int max_width, int max_height,
+                    int* out_width, int* out_height);
+
+/**
+ * One requested level; `data` receives width * height * channels samples
+ * in the source's layout
+ */
+struct DerivativeLevel {
+    int width;
+    int height;
+    uint8_t* data;
+};
+
+/**
+ * Build every level from interleaved 8/16-bit RGB(A) pixels encoded with
+ * `transfer` (alpha is averaged linearly). Levels may be given in any order.
+ * @returns false for unsupported channels/bits/transfer or an enlarging level
+ */
+bool BuildDerivatives(const uint8_t* src, int width, int height, int channels, int bits,
+                      TransferFunction transfer, const std::vector<DerivativeLevel>& levels);
+
+#endif // DERIVATIVES_H
@@ -0,0 +1,206 @@
+/**
+ * @filmgallery/libraw-native - DNG Tile Loaders
+ *
+ * Shared by the loaders Unpack() runs in place of LibRaw's for DNG
+ * compressions it was built without (deflate_dng.cpp, jxl_dng.cpp): the raw
+ * IFD checks, the tile or strip grid read in file order, and handing the
+ * decoded image to LibRaw in the layout its own float/deflate loaders leave
+ * (raw_image, color3_image or color4_image; floats converted as
+ * convertFloatToInt() does, with a dispatched kernel over row bands).
+ */
+
+#include "film_libraw.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+// convertFloatToInt()'s rounding: negatives and NaN to 0, then truncate
+CPU_INLINE void FloatToIntRowBody(const float* src, ushort* dst, size_t count, float scale) {
+    for (size_t i = 0; i < count; i++) {
+        float v = src[i] > 0.f ? src[i] : 0.f;
+        dst[i] = static_cast<ushort>(static_cast<int>(v * scale));
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, FloatToIntRow, FloatToIntRowBody,
+                    (const float* src, ushort* dst, size_t count, float scale), (src, dst, count, scale))
+
+} // namespace
+
+FilmLibRaw::Decoder FilmLibRaw::StandInLoader() const {
+    if (load_raw == &FilmLibRaw::deflate_dng_load_raw) {
+        return static_cast<Decoder>(&FilmLibRaw::DeflateDngLoadRaw);
+    }
+    if (load_raw == &FilmLibRaw::jxl_dng_load_raw_placeholder && JpegXlAvailable()) {
+        return static_cast<Decoder>(&FilmLibRaw::JxlDngLoadRaw);
+    }
+    if (!stand_in_loaders_) {
+        return nullptr;
+    }
+    for (const auto* loaders : {&PackedLoaders(), &MediumFormatLoaders()}) {
+        for (const auto& loader : *loaders) {
+            if (load_raw == loader.first) {
+                return loader.second;
+            }
+        }
+    }
+    return nullptr;
+}
+
+int FilmLibRaw::get_decoder_info(libraw_decoder_info_t* d_info) {
+    // Packed and medium-format stand-ins allocate and report exactly as
+    // LibRaw's loaders
+    for (const auto* loaders : {&PackedLoaders(), &MediumFormatLoaders()}) {
+        for (const auto& loader : *loaders) {
+            if (load_raw == loader.second) {
+                load_raw = loader.first;
+                int ret = LibRaw::get_decoder_info(d_info);
+                load_raw = loader.second;
+                return ret;
+            }
+        }
+    }
+
+    // Reported as the loaders they stand in for, allocating their own image
+    if (load_raw == static_cast<Decoder>(&FilmLibRaw::DeflateDngLoadRaw)) {
+        d_info->decoder_name = "deflate_dng_load_raw()";
+    } else if (load_raw == static_cast<Decoder>(&FilmLibRaw::JxlDngLoadRaw)) {
+        d_info->decoder_name = "jxl_dng_load_raw_placeholder()";
+    } else {
+        return LibRaw::get_decoder_info(d_info);
+    }
+    d_info->decoder_flags = LIBRAW_DECODER_OWNALLOC;
+    return LIBRAW_SUCCESS;
+}
+
+const tiff_ifd_t& FilmLibRaw::DngRawIfd() {
+    int iifd = find_ifd_by_offset(libraw_internal_data.unpacker_data.data_offset);
+    if (iifd < 0 || iifd >= int(libraw_internal_data.identify_data.tiff_nifds)) {
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+    }
+    const tiff_ifd_t& ifd = tiff_ifd[iifd];
+    const int samples = ifd.samples;
+    if ((samples != 1 && samples != 3 && samples != 4) ||
+        libraw_internal_data.unpacker_data.tiff_samples != unsigned(samples) ||
+        (imgdata.idata.filters && samples > 1)) {
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+    }
+    return ifd;
+}
+
+void FilmLibRaw::ReadDngTiles(const tiff_ifd_t& ifd, unsigned& tile_width, unsigned& tile_height,
+                              std::vector<DngTile>& tiles) {
+    const unpacker_data_t& unpacker = libraw_internal_data.unpacker_data;
+    LibRaw_abstract_datastream* input = libraw_internal_data.internal_data.input;
+
+    // Tile grid, as LibRaw's tile_stripe_data_t lays it out
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    const bool tiled = unpacker.tile_width <= raw_width && unpacker.tile_length <= raw_height;
+    const bool striped = ifd.rows_per_strip > 0 && unsigned(ifd.rows_per_strip) < raw_height &&
+                         ifd.strip_byte_counts_count > 0;
+    tile_width = tiled ? unpacker.tile_width : raw_width;
+    tile_height = tiled ? unpacker.tile_length : striped ? unsigned(ifd.rows_per_strip) : raw_height;
+    if (!tile_width || !tile_height) {
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+    }
+    const unsigned tiles_h = (raw_width + tile_width - 1) / tile_width;
+    const unsigned tiles_v = (raw_height + tile_height - 1) / tile_height;
+    const INT64 count = INT64(tiles_h) * tiles_v;
+    if (count < 1 || count > 1000000) {
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+    }
+
+    // Offsets: an array at data_offset (the stream is there), or the strip tags
+    tiles.assign(static_cast<size_t>(count), DngTile());
+    std::vector<INT64> offsets(tiles.size(), 0);
+    std::vector<INT64> lengths(tiles.size(), 0);
+    if (tiled) {
+        for (INT64& offset : offsets) offset = get4();
+    } else if (striped) {
+        for (size_t t = 0; t < tiles.size() && t < size_t(std::max(ifd.strip_offsets_count, 0)); t++) {
+            offsets[t] = ifd.strip_offsets[t];
+        }
+    } else {
+        offsets[0] = ifd.offset;
+    }
+    if (tiles.size() == 1 || (!tiled && !striped)) {
+        lengths[0] = ifd.bytes;
+    } else if (tiled) {
+        // ifd.bytes is the offset of the TileByteCounts array here
+        input->seek(ifd.bytes, SEEK_SET);
+        for (INT64& length : lengths) length = get4();
+    } else {
+        for (size_t t = 0; t < tiles.size() && t < size_t(std::max(ifd.strip_byte_counts_count, 0)); t++) {
+            lengths[t] = ifd.strip_byte_counts[t];
+        }
+    }
+
+    const INT64 limit = INT64(imgdata.rawparams.max_raw_memory_mb) * INT64(1024 * 1024);
+    for (size_t t = 0; t < tiles.size(); t++) {
+        DngTile& tile = tiles[t];
+        tile.row = unsigned(t / tiles_h) * tile_height;
+        tile.col = unsigned(t % tiles_h) * tile_width;
+        if (lengths[t] <= 0) continue;
+        if (lengths[t] > limit) {
+            throw LIBRAW_EXCEPTION_TOOBIG;
+        }
+        tile.data.resize(static_cast<size_t>(lengths[t]));
+        input->seek(offsets[t], SEEK_SET);
+        int got = input->read(tile.data.data(), 1, tile.data.size());
+        tile.data.resize(static_cast<size_t>(std::max(got, 0)));
+    }
+    checkCancel();
+}
+
+void FilmLibRaw::AttachRawImage(ushort* image, int samples) {
+    imgdata.rawdata.raw_alloc = image;
+    if (samples == 1) imgdata.rawdata.raw_image = image;
+    else if (samples == 3) imgdata.rawdata.color3_image = reinterpret_cast<ushort(*)[3]>(image);
+    else imgdata.rawdata.color4_image = reinterpret_cast<ushort(*)[4]>(image);
+    imgdata.sizes.raw_pitch = imgdata.sizes.raw_width * samples * sizeof(ushort);
+}
+
+void FilmLibRaw::AttachFloatImage(float* image, int samples, float max) {
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    imgdata.color.fmaximum = max;
+    if (!(imgdata.rawparams.options & LIBRAW_RAWOPTIONS_CONVERTFLOAT_TO_INT)) {
+        imgdata.rawdata.raw_alloc = image;
+        if (samples == 1) imgdata.rawdata.float_image = image;
+        else if (samples == 3) imgdata.rawdata.float3_image = reinterpret_cast<float(*)[3]>(image);
+        else imgdata.rawdata.float4_image = reinterpret_cast<float(*)[4]>(image);
+        imgdata.sizes.raw_pitch = raw_width * samples * sizeof(float);
+        return;
+    }
+
+    // convertFloatToInt() with its defaults: rescale to 16383 unless the
+    // range already sits within [4096, 32767]
+    const size_t band = size_t(raw_width) * samples;
+    ushort* converted = static_cast<ushort*>(malloc(band * raw_height * sizeof(ushort)));
+    if (!converted) {
+        free(image);
+        throw LIBRAW_EXCEPTION_ALLOC;
+    }
+    float tmax = std::max({float(std::max(imgdata.color.maximum, 1u)), max, 1.f});
+    float scale = 1.f;
+    if (tmax < 4096.f || tmax > 32767.f) {
+        scale = 16383.f / tmax;
+        imgdata.color.fnorm = scale;
+        imgdata.color.maximum = 16383;
+        imgdata.color.black = unsigned(float(imgdata.color.black) * scale);
+        for (int i = 0; i < int(sizeof(imgdata.color.cblack) / sizeof(imgdata.color.cblack[0])); i++) {
+            if (i != 4 && i != 5) imgdata.color.cblack[i] = unsigned(float(imgdata.color.cblack[i]) * scale);
+        }
+    } else {
+        imgdata.color.fnorm = 0.f;
+    }
+    ParallelRows(int(raw_height), 64, [&](int first, int last) {
+        FloatToIntRow(image + first * band, converted + first * band, (last - first) * band, scale);
+    });
+    free(image);
+    AttachRawImage(converted, samples);
+}
@@ -0,0 +1,179 @@
+/**
+ * @filmgallery/libraw-native - FilmLab Edit Session
+ */
+
+#include "edit_session.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/**
+ * Bilinear taps along one axis: output o samples between `first[o]` and
+ * `first[o] + 1` (clamped), weighting the second by `weight[o]`
+ */
+struct LinearTaps {
+    std::vector<int> first;
+    std::vector<int> second;
+    std::vector<float> weight;
+
+    // Output samples cover [origin, origin + extent) in full-resolution
+    // pixels; `ratio` is level pixels per full-resolution pixel
+    LinearTaps(double origin, double extent, int out, double ratio, int size) {
+        first.resize(out);
+        second.resize(out);
+        weight.resize(out);
+        for (int o = 0; o < out; o++) {
+            double position = (origin + (o + 0.5) * extent / out) * ratio - 0.5;
+            position = std::min(std::max(position, 0.0), static_cast<double>(size - 1));
+            int i = static_cast<int>(position);
+            first[o] = i;
+            second[o] = std::min(i + 1, size - 1);
+            weight[o] = static_cast<float>(position - i);
+        }
+    }
+};
+
+// One output row of 2x2 box averages from two rows of the level above
+CPU_INLINE void HalveRowBody(const uint16_t* row0, const uint16_t* row1, uint16_t* dst, int width, int above_width) {
+    for (int x = 0; x < width; x++) {
+        int x0 = 2 * x * 3;
+        int x1 = std::min(2 * x + 1, above_width - 1) * 3;
+        for (int c = 0; c < 3; c++) {
+            dst[x * 3 + c] = static_cast<uint16_t>(
+                (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+        }
+    }
+}
+
+// One output row blended from two source rows with bilinear taps
+CPU_INLINE void ResampleRowBody(const uint16_t* row0, const uint16_t* row1, float wy,
+                                const LinearTaps& tx, uint16_t* dst, int width) {
+    for (int x = 0; x < width; x++) {
+        const int x0 = tx.first[x] * 3;
+        const int x1 = tx.second[x] * 3;
+        const float wx = tx.weight[x];
+        for (int c = 0; c < 3; c++) {
+            float top = row0[x0 + c] + (row0[x1 + c] - row0[x0 + c]) * wx;
+            float bottom = row1[x0 + c] + (row1[x1 + c] - row1[x0 + c]) * wx;
+            dst[x * 3 + c] = static_cast<uint16_t>(top + (bottom - top) * wy + 0.5f);
+        }
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, HalveRow, HalveRowBody,
+                    (const uint16_t* row0, const uint16_t* row1, uint16_t* dst, int width, int above_width),
+                    (row0, row1, dst, width, above_width))
+CPU_DISPATCH_KERNEL(void, ResampleRow, ResampleRowBody,
+                    (const uint16_t* row0, const uint16_t* row1, float wy, const LinearTaps& tx,
+                     uint16_t* dst, int width),
+                    (row0, row1, wy, tx, dst, width))
+
+} // namespace
+
+EditSession::EditSession() : bits_(8), has_viewport_(false), generation_(0), busy_(false) {
+}
+
+bool EditSession::SetSource(const uint8_t* data, int width, int height, int channels, int bits, int min_size) {
+    if (width <= 0 || height <= 0 || (channels != 3 && channels != 4) || (bits != 8 && bits != 16)) {
+        return false;
+    }
+
+    levels_.clear();
+    levels_.push_back({ width, height, std::vector<uint16_t>(static_cast<size_t>(width) * height * 3) });
+    uint16_t* top = levels_[0].codes.data();
+    ParallelRows(height, 64, [&](int first, int last) {
+        for (size_t p = static_cast<size_t>(first) * width; p < static_cast<size_t>(last) * width; p++) {
+            for (int c = 0; c < 3; c++) {
+                size_t i = p * channels + c;
+                top[p * 3 + c] = bits == 8 ? data[i] : reinterpret_cast<const uint16_t*>(data)[i];
+            }
+        }
+    });
+
+    // Halve (rounding up) while the next level keeps a min_size long edge;
+    // odd edges reuse the last row/column
+    while (std::max(levels_.back().width, levels_.back().height) / 2 >= std::max(1, min_size)) {
+        const Level& above = levels_.back();
+        Level level{ (above.width + 1) / 2, (above.height + 1) / 2, {} };
+        level.codes.resize(static_cast<size_t>(level.width) * level.height * 3);
+        ParallelRows(level.height, 16, [&](int first, int last) {
+            for (int y = first; y < last; y++) {
+                const uint16_t* row0 = &above.codes[static_cast<size_t>(2 * y) * above.width * 3];
+                const uint16_t* row1 = &above.codes[static_cast<size_t>(std::min(2 * y + 1, above.height - 1)) * above.width * 3];
+                HalveRow(row0, row1, &level.codes[static_cast<size_t>(y) * level.width * 3],
+                         level.width, above.width);
+            }
+        });
+        levels_.push_back(std::move(level));
+    }
+
+    bits_ = bits;
+    has_viewport_ = false;
+    return true;
+}
+
+size_t EditSession::PyramidBytes() const {
+    size_t total = 0;
+    for (const Level& level : levels_) total += level.codes.size() * sizeof(uint16_t);
+    return total;
+}
+
+int EditSession::PickLevel(const EditViewport& viewport) const {
+    const double need_x = viewport.out_width / viewport.width;
+    const double need_y = viewport.out_height / viewport.height;
+    int level = 0;
+    while (level + 1 < LevelCount() &&
+           static_cast<double>(levels_[level + 1].width) / levels_[0].width >= need_x &&
+           static_cast<double>(levels_[level + 1].height) / levels_[0].height >= need_y) {
+        level++;
+    }
+    return level;
+}
+
+int EditSession::Render(const FilmLabStages& stages, const EditViewport& viewport, uint8_t* out,
+                        uint64_t generation, int* level) {
+    if (levels_.empty() || viewport.width <= 0 || viewport.height <= 0 ||
+        viewport.out_width <= 0 || viewport.out_height <= 0) {
+        return -1;
+    }
+
+    auto cancelled = [this, generation]() { return generation_.load(std::memory_order_relaxed) != generation; };
+    const int picked = PickLevel(viewport);
+    if (level) *level = picked;
+
+    if (!has_viewport_ || !(viewport == viewport_)) {
+        // New viewport: resample it from the picked level
+        const Level& source = levels_[picked];
+        const LinearTaps tx(viewport.x, viewport.width, viewport.out_width,
+                            static_cast<double>(source.width) / levels_[0].width, source.width);
+        const LinearTaps ty(viewport.y, viewport.height, viewport.out_height,
+                            static_cast<double>(source.height) / levels_[0].height, source.height);
+
+        std::vector<uint16_t> codes(static_cast<size_t>(viewport.out_width) * viewport.out_height * 3);
+        std::atomic<bool> stop(false);
+        ParallelRows(viewport.out_height, 16, [&](int first, int last) {
+            for (int y = first; y < last; y++) {
+                if (stop.load(std::memory_order_relaxed) || cancelled()) {
+                    stop.store(true, std::memory_order_relaxed);
+                    return;
+                }
+                const uint16_t* row0 = &source.codes[static_cast<size_t>(ty.first[y]) * source.width * 3];
+                const uint16_t* row1 = &source.codes[static_cast<size_t>(ty.second[y]) * source.width * 3];
+                ResampleRow(row0, row1, ty.weight[y], tx,
+                            &codes[static_cast<size_t>(y) * viewport.out_width * 3], viewport.out_width);
+            }
+        });
+        if (stop.load()) {
+            return RENDER_CANCELLED;
+        }
+
+        render_.SetSource(std::move(codes), viewport.out_width, viewport.out_height, bits_);
+        viewport_ = viewport;
+        has_viewport_ = true;
+    }
+
+    return render_.Render(stages, out, cancelled);
+}
@@ -0,0 +1,102 @@
+/**
+ * @filmgallery/libraw-native - FilmLab Edit Session
+ *
+ * Keeps a full-resolution scan resident as a pyramid of RGB code values
+ * (each level half the size of the one above, 2x2 box averaged) and renders
+ * only the visible viewport. A render picks the smallest level that still
+ * has at least the output resolution, resamples the viewport from it
+ * (bilinear) and runs the FilmLab stages through a RenderSession, so
+ * parameter changes on an unchanged viewport reuse its stage checkpoints.
+ *
+ * Renders carry a generation number; bumping the generation (Cancel(), or
+ * starting a newer render) makes a running render stop at the next row.
+ */
+
+#ifndef EDIT_SESSION_H
+#define EDIT_SESSION_H
+
+#include "render_session.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Visible region in full-resolution pixels and the output size
+ */
+struct EditViewport {
+    double x = 0;
+    double y = 0;
+    double width = 0;
+    double height = 0;
+    int out_width = 0;
+    int out_height = 0;
+
+    bool operator==(const EditViewport& other) const {
+        return x == other.x && y == other.y && width == other.width && height == other.height &&
+               out_width == other.out_width && out_height == other.out_height;
+    }
+};
+
+class EditSession {
+public:
+    EditSession();
+
+    /**
+     * Replace the source with interleaved 8/16-bit RGB(A) pixels (alpha is
+     * dropped) and build pyramid levels down to a `min_size` long edge
+     * @returns false for unsupported channels/bits or sizes
+     */
+    bool SetSource(const uint8_t* data, int width, int height, int channels, int bits, int min_size = 256);
+
+    /**
+     * Render the viewport into `out` (out_width * out_height * 3 bytes)
+     * @param generation - Value from NextGeneration(); the render stops once
+     *                     a newer generation exists
+     * @param level - Receives the pyramid level used
+     * @returns as RenderSession::Render()
+     */
+    int Render(const FilmLabStages& stages, const EditViewport& viewport, uint8_t* out,
+               uint64_t generation, int* level);
+
+    // Called on the JS thread before queuing a render / to abort the current one
+    uint64_t NextGeneration() { return ++generation_; }
+    void Cancel() { ++generation_; }
+
+    void SetMemoryLimit(size_t bytes) { render_.SetMemoryLimit(bytes); }
+
+    int Width() const { return levels_.empty() ? 0 : levels_[0].width; }
+    int Height() const { return levels_.empty() ? 0 : levels_[0].height; }
+    bool HasSource() const { return !levels_.empty(); }
+    int LevelCount() const { return static_cast<int>(levels_.size()); }
+    int LevelWidth(int level) const { return levels_[level].width; }
+    int LevelHeight(int level) const { return levels_[level].height; }
+    size_t PyramidBytes() const;
+    const RenderSession& ViewportSession() const { return render_; }
+
+    // Set while a worker uses the session; the binding refuses changes meanwhile
+    bool Busy() const { return busy_; }
+    void SetBusy(bool busy) { busy_ = busy; }
+
+private:
+    struct Level {
+        int width;
+        int height;
+        std::vector<uint16_t> codes;    // RGB code values
+    };
+
+    /**
+     * Smallest level with at least the viewport's output resolution
+     */
+    int PickLevel(const EditViewport& viewport) const;
+
+    std::vector<Level> levels_;
+    int bits_;
+    RenderSession render_;              // Holds the resampled viewport
+    EditViewport viewport_;
+    bool has_viewport_;
+    std::atomic<uint64_t> generation_;
+    bool busy_;
+};
+
+#endif // EDIT_SESSION_H
@@ -0,0 +1,369 @@
+/**
+ * @filmgallery/libraw-native - LibRaw Extensions
+ *
+ * LibRaw subclass used by LibRawProcessor for operations that need LibRaw's
+ * protected state. Implementations are split by feature:
+ *
+ *   identify_snapshot.cpp   save/restore the post-identify state
+ *   mosaic_cache.cpp        save/restore the unpacked raw image with the
+ *                           post-unpack state, skipping the camera codec
+ *   mem_image.cpp           size_t-clean output image copies (whole or by rows),
+ *                           optionally converted to an export colour space,
+ *                           and JPEG encoding fused with the copy
+ *   linear_raw.cpp          dcraw_process() fast path for LinearRaw images
+ *   monochrome_raw.cpp      single-channel luminance straight from Bayer data
+ *   lossy_dng.cpp           lossy (JPEG-tiled) DNGs, which LibRaw only reads
+ *                           with libjpeg
+ *   deflate_dng.cpp         deflate-compressed (float and 16-bit) DNGs, which
+ *                           LibRaw only reads with zlib
+ *   jxl_dng.cpp             JPEG XL-compressed (DNG 1.7) DNGs, when built with
+ *                           libjxl
+ *   dng_tiles.cpp           tile reading and image hand-off shared by the
+ *                           deflate and JPEG XL loaders
+ *   packed_raw.cpp          uncompressed and bit-packed loaders, mapped and
+ *                           unpacked by rows on several threads
+ *   medium_format.cpp       Phase One and Imacon loaders and Phase One
+ *                           calibration, by rows on several threads
+ */
+
+#ifndef FILM_LIBRAW_H
+#define FILM_LIBRAW_H
+
+#include "libraw/libraw.h"
+#include "identify_snapshot.h"
+#include "color_convert.h"
+#include "jpeg_encoder.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * Output image geometry after dcraw_process() (flip applied)
+ */
+struct MemImageLayout {
+    int width;
+    int height;
+    int colors;
+    int bits;
+    size_t stride;      // bytes per row
+    size_t size;        // bytes for the whole image
+};
+
+/**
+ * Unpacked raw image and post-unpack state copied out by CaptureMosaic(),
+ * so the cache file can be encoded and written while the processor moves on
+ */
+struct MosaicCapture {
+    std::vector<uint8_t> snapshot;
+    std::vector<ushort> image;      // rows x row_samples
+    int samples = 0;
+    int rows = 0;
+    size_t row_samples = 0;
+};
+
+class FilmLibRaw : public LibRaw {
+public:
+    FilmLibRaw()
+        : LibRaw(0), export_space_(0), export_transfer_(TRANSFER_DEFAULT), linear_fast_path_(true),
+          stand_in_loaders_(true), monochrome_(false), monochrome_float_(false), mono_float_(false) {
+        callbacks.post_identify_cb = &FilmLibRaw::PostIdentify;
+        SetMonochrome(false);
+    }
+
+    /**
+     * LibRaw::recycle(), also releasing the fast paths' images
+     */
+    void recycle();
+
+    // ------------------------------------------------------------------------
+    // Identify snapshots (identify_snapshot.cpp)
+    // ------------------------------------------------------------------------
+
+    /**
+     * Serialize the post-identify state of the currently opened file.
+     * Must be called after open_file() and before unpack().
+     * @returns LIBRAW_SUCCESS, LIBRAW_OUT_OF_ORDER_CALL, LIBRAW_IO_ERROR
+     *          or LIBRAW_FILE_UNSUPPORTED (decoder state cannot be captured)
+     */
+    int SaveSnapshot(const char* path, std::vector<uint8_t>& out);
+
+    /**
+     * Open `path` from a snapshot instead of identify(). On anything other
+     * than SNAPSHOT_OK the instance is recycled and left closed.
+     */
+    SnapshotStatus OpenWithSnapshot(const char* path, const uint8_t* data, size_t size);
+
+    // ------------------------------------------------------------------------
+    // Mosaic caches (mosaic_cache.cpp)
+    // ------------------------------------------------------------------------
+
+    /**
+     * Write the unpacked raw image of `path` with its post-unpack state to
+     * `cache_path` (through a temporary file, so readers never see a partial
+     * one). Must be called after unpack() and before processing.
+     * @param bytes - Receives the cache file size
+     * @returns LIBRAW_SUCCESS, LIBRAW_OUT_OF_ORDER_CALL, LIBRAW_IO_ERROR,
+     *          LIBRAW_UNSUFFICIENT_MEMORY or LIBRAW_FILE_UNSUPPORTED (float
+     *          or Phase One black-calibrated data, uncapturable decoder)
+     */
+    int SaveMosaic(const char* path, const char* cache_path, uint64_t* bytes);
+
+    /**
+     * SaveMosaic() split in two: copy the raw image and post-unpack state
+     * (same preconditions and errors, minus LIBRAW_IO_ERROR), then encode
+     * and write the copy without touching any processor.
+     */
+    int CaptureMosaic(const char* path, MosaicCapture& capture);
+    static int WriteMosaic(const MosaicCapture& capture, const char* cache_path, uint64_t* bytes);
+
+    /**
+     * Open `path` in the unpacked state from a mosaic cache, in place of
+     * identify() and unpack(). On anything other than SNAPSHOT_OK the
+     * instance is recycled and left closed.
+     */
+    SnapshotStatus OpenWithMosaic(const char* path, const char* cache_path);
+
+    // ------------------------------------------------------------------------
+    // Unpacking (lossy_dng.cpp, dng_tiles.cpp, packed_raw.cpp, medium_format.cpp)
+    // ------------------------------------------------------------------------
+
+    /**
+     * unpack(), then for lossy DNGs (readmitted after identify) decode the
+     * JPEG tiles LibRaw's stub left out. Deflate and JPEG XL DNGs,
+     * uncompressed or bit-packed data, and Phase One and Imacon files are
+     * unpacked with StandInLoader() in place of LibRaw's loader.
+     * @returns unpack()'s result, or LIBRAW_DATA_ERROR for undecodable tiles
+     */
+    int Unpack();
+
+    /**
+     * LibRaw's, with the stand-in loaders reported as the ones they replace
+     */
+    int get_decoder_info(libraw_decoder_info_t* d_info) override;
+
+    /**
+     * Allow the packed and medium-format stand-ins and the Phase One
+     * calibration (default on); off, LibRaw's own loaders and
+     * phase_one_correct() run for those files. Kept across recycle().
+     */
+    void SetStandInLoaders(bool enabled) { stand_in_loaders_ = enabled; }
+
+    /**
+     * Whether the addon was built with libjxl (LIBRAW_NATIVE_JPEGXL=1), so
+     * JPEG XL DNGs unpack
+     */
+    static bool JpegXlAvailable();
+
+    // ------------------------------------------------------------------------
+    // Output image (mem_image.cpp)
+    // ------------------------------------------------------------------------
+
+    /**
+     * Geometry of the processed image, 64-bit sizes throughout (32 bits per
+     * sample for float monochrome images)
+     * @returns false before dcraw_process()
+     */
+    bool GetMemImageLayout(MemImageLayout& layout) const;
+
+    /**
+     * Copy output rows [first_row, first_row + rows) as interleaved RGB into
+     * `dst` (`stride` bytes apart). Same pixels as dcraw_make_mem_image(),
+     * without its 4 GB limit, so large images can be produced strip by strip.
+     * @returns LIBRAW_SUCCESS, LIBRAW_OUT_OF_ORDER_CALL or LIBRAW_DATA_ERROR
+     */
+    int CopyMemImageRows(uint8_t* dst, size_t stride, int first_row, int rows);
+
+    /**
+     * JPEG of the 8-bit output image (same pixels as CopyMemImageRows()),
+     * converted band by band as the encoder asks for rows
+     * @returns LIBRAW_SUCCESS, LIBRAW_OUT_OF_ORDER_CALL or LIBRAW_DATA_ERROR
+     *          (not 1 or 3 colours, or larger than 65535 pixels)
+     */
+    int EncodeMemImageJpeg(const JpegOptions& options, std::vector<uint8_t>& out);
+
+    /**
+     * Make CopyMemImageRows() convert from output_color to `space`, encoded
+     * with `transfer`, in place of LibRaw's gamma curve (0 turns it off).
+     * Kept across recycle() like the other processing parameters.
+     */
+    void SetExportColorSpace(int space, TransferFunction transfer);
+
+    /**
+     * Whether copies are converted: an export space is set and the processed
+     * image is 3-colour in a convertible output_color (not raw/monochrome)
+     */
+    bool ExportColorSpaceActive() const;
+
+    int ExportColorSpace() const { return export_space_; }
+    TransferFunction ExportTransfer() const;
+
+    /**
+     * Linear value the output curve maps to full scale, as copy_mem_image()
+     * picks it: from the processed histogram with auto-bright, else 65535
+     * (both divided by params.bright)
+     */
+    int OutputWhiteLevel() const;
+
+    /**
+     * Whether OutputWhiteLevel() comes from the histogram (auto-bright on,
+     * highlight mode 0 or 2)
+     */
+    bool AutoBrightActive() const;
+
+    /**
+     * The histogram convert_to_rgb() filled (0x2000 bins of linear output
+     * values per colour), summed down to `bins` per colour, colour-major
+     * @param bins - Power of two up to 0x2000
+     * @returns false before processing or for an unsupported bin count
+     */
+    bool GetHistogram(int bins, std::vector<uint32_t>& out) const;
+
+    // ------------------------------------------------------------------------
+    // Processing (linear_raw.cpp)
+    // ------------------------------------------------------------------------
+
+    /**
+     * dcraw_process(), or for already-demosaiced 3-colour images (LinearRaw
+     * DNGs from film scanners, filters == 0) a single fused pass straight
+     * into a 3-sample linear image. Output pixels are the same either way.
+     * With monochrome mode on and MonochromeEligible(), a 1-colour luminance
+     * image instead. Compressed Phase One images are calibrated on several
+     * threads before dcraw_process(). Must be called after unpack().
+     */
+    int Process();
+
+    /**
+     * Whether Process() would take the fast path: unpacked 3-colour image
+     * without a CFA, and no option that needs LibRaw's full pipeline
+     */
+    bool LinearFastPathEligible() const;
+
+    /**
+     * Whether the current processed image came from the fast path
+     */
+    bool LinearImageActive() const { return linear_image_ && !imgdata.image; }
+
+    /**
+     * Allow the fast path (default on). Kept across recycle().
+     */
+    void SetLinearFastPath(bool enabled) { linear_fast_path_ = enabled; }
+
+    // ------------------------------------------------------------------------
+    // Monochrome (monochrome_raw.cpp)
+    // ------------------------------------------------------------------------
+
+    /**
+     * Make Process() interpolate luminance straight from the Bayer mosaic
+     * into a 1-colour image, skipping demosaicing and convert_to_rgb().
+     * Kept across recycle().
+     * @param weights - Of white-balanced camera R, G, B, normalized to sum
+     *        to 1 (null: Rec. 709)
+     * @param float_output - Copies are 32-bit float linear luminance (1.0 =
+     *        white, no output curve) instead of output_bps through the curve
+     */
+    void SetMonochrome(bool enabled, const float weights[3] = nullptr, bool float_output = false);
+
+    /**
+     * Whether Process() would build luminance: monochrome mode on, unpacked
+     * 2x2 Bayer image, and no option that needs LibRaw's full pipeline
+     */
+    bool MonochromeEligible() const;
+
+    /**
+     * Whether the current processed image is monochrome luminance
+     */
+    bool MonochromeImageActive() const { return mono_image_ && !imgdata.image; }
+
+private:
+    typedef void (LibRaw::*Decoder)();
+
+    static const std::vector<Decoder>& Decoders();
+    static uint32_t DecoderIndex(Decoder decoder);
+
+    void PrepareOutputCurve();
+
+    // CopyMemImageRows() at `layout.bits`, once the curve is prepared or
+    // with the export transfer's `encoder` (when ExportColorSpaceActive());
+    // safe to call from several threads for different rows
+    int CopyRows(const MemImageLayout& layout, const TransferEncoder* encoder,
+                 uint8_t* dst, size_t stride, int first_row, int rows) const;
+
+    // Snapshot of the current state: the identify state, or once unpacked
+    // the post-unpack one (mosaic caches). `unpacked` must match the blob.
+    int WriteSnapshot(const char* path, std::vector<uint8_t>& out);
+    SnapshotStatus RestoreSnapshot(const char* path, const uint8_t* data, size_t size, bool unpacked);
+
+    static void PostIdentify(void* context);
+    void AdmitLossyDng();
+    int LoadLossyDng(unsigned raw_width, unsigned raw_height);
+
+    // Compressed DNG tile or strip, read in file order
+    struct DngTile {
+        unsigned row;               // Top-left pixel in the raw frame
+        unsigned col;
+        std::vector<uint8_t> data;
+    };
+
+    // Our loader for a DNG compression LibRaw was built without or for
+    // uncompressed data, or null
+    Decoder StandInLoader() const;
+    void DeflateDngLoadRaw();
+    void JxlDngLoadRaw();
+
+    // LibRaw's uncompressed/bit-packed loaders and their stand-ins, which
+    // run LibRaw's themselves for layouts they do not cover
+    static const std::vector<std::pair<Decoder, Decoder>>& PackedLoaders();
+    void UnpackedLoadRaw();
+    void PackedLoadRaw();
+    void PackedDngLoadRaw();
+    void NikonStripedLoadRaw();
+    void Nikon14BitLoadRaw();
+    void AndroidTightLoadRaw();
+
+    // LibRaw's Phase One and Imacon loaders and their stand-ins, likewise
+    static const std::vector<std::pair<Decoder, Decoder>>& MediumFormatLoaders();
+    void PhaseOneLoadRawC();
+    void PhaseOneLoadRawS();
+    void PhaseOneLoadRaw();
+    void ImaconFullLoadRaw();
+
+    // raw2image_ex()'s Phase One black subtraction and phase_one_correct(),
+    // ahead of dcraw_process() (medium_format.cpp)
+    bool PhaseOneCalibrationPending();
+    int ProcessPhaseOne();
+    int PhaseOneSubtractBlack(const ushort* src, ushort* dest);
+    int PhaseOneCorrect();
+    void PhaseOneFlatField(int is_float, int nc);
+
+    // Helpers for the stand-in loaders; these throw LibRaw exceptions like
+    // the loaders themselves. The Attach functions take malloc()ed images
+    // over, AttachFloatImage() converting them as LibRaw's options say.
+    const tiff_ifd_t& DngRawIfd();
+    void ReadDngTiles(const tiff_ifd_t& ifd, unsigned& tile_width, unsigned& tile_height,
+                      std::vector<DngTile>& tiles);
+    void AttachRawImage(ushort* image, int samples);
+    void AttachFloatImage(float* image, int samples, float max);
+
+    int ProcessLinear();
+    void ScaleMultipliers(float scale_mul[4]);
+
+    // Colours of the 2x2 Bayer cell (FC() of rows/columns 0-1, second green
+    // possibly 3); false for any other CFA
+    bool BayerCell(int cell[4]) const;
+    int ProcessMonochrome();
+
+    int export_space_;
+    TransferFunction export_transfer_;
+    bool linear_fast_path_;
+    bool stand_in_loaders_;
+    std::unique_ptr<ushort[]> linear_image_;    // height x width x 3, unflipped
+    bool monochrome_;
+    bool monochrome_float_;
+    float monochrome_weights_[3];
+    bool mono_float_;                           // Float copies of the current image
+    std::unique_ptr<ushort[]> mono_image_;      // height x width luminance, unflipped
+};
+
+#endif // FILM_LIBRAW_H
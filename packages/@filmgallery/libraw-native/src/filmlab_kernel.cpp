@@ -0,0 +1,417 @@
+/**
+ * @filmgallery/libraw-native - FilmLab Kernel
+ *
+ * Cross-channel stages follow packages/shared (RenderCore._sampleLUT3DFloat,
+ * math/tone-curves highlightRollOff, filmLabHSL, filmLabSaturation,
+ * filmLabSplitTone applySplitToneFast), including where those round to 8 bits.
+ */
+
+#include "filmlab_kernel.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int HSL_TABLE_STEPS = FILMLAB_HSL_STEPS;
+const double PI = 3.14159265358979323846;
+
+// filmLabHSL HSL_CHANNELS: hue centre and one-sided range
+const float HSL_CENTERS[8] = { 0, 30, 60, 120, 180, 240, 280, 330 };
+const float HSL_RANGES[8] = { 30, 30, 30, 45, 30, 45, 30, 30 };
+
+CPU_INLINE float Clamp01(float v) {
+    return std::min(1.0f, std::max(0.0f, v));
+}
+
+// JavaScript Math.round
+CPU_INLINE float Round(float v) {
+    return std::floor(v + 0.5f);
+}
+
+CPU_INLINE float SampleTable(const float* table, int size, float x) {
+    float pos = Clamp01(x) * (size - 1);
+    int i = static_cast<int>(pos);
+    if (i >= size - 1) return table[size - 1];
+    float frac = pos - i;
+    return table[i] + (table[i + 1] - table[i]) * frac;
+}
+
+CPU_INLINE void SampleLut3D(const FilmLabLut3D& lut, float* rgb) {
+    const int size = lut.size;
+    const int max_index = size - 1;
+    const float* data = lut.data.data();
+
+    float pos[3];
+    int i0[3];
+    int i1[3];
+    float frac[3];
+    for (int c = 0; c < 3; c++) {
+        pos[c] = Clamp01(rgb[c]) * max_index;
+        i0[c] = static_cast<int>(pos[c]);
+        i1[c] = std::min(max_index, i0[c] + 1);
+        frac[c] = pos[c] - i0[c];
+    }
+    auto index = [size](int r, int g, int b) {
+        return (static_cast<size_t>(r) + static_cast<size_t>(g) * size + static_cast<size_t>(b) * size * size) * 3;
+    };
+    const size_t c000 = index(i0[0], i0[1], i0[2]), c100 = index(i1[0], i0[1], i0[2]);
+    const size_t c010 = index(i0[0], i1[1], i0[2]), c110 = index(i1[0], i1[1], i0[2]);
+    const size_t c001 = index(i0[0], i0[1], i1[2]), c101 = index(i1[0], i0[1], i1[2]);
+    const size_t c011 = index(i0[0], i1[1], i1[2]), c111 = index(i1[0], i1[1], i1[2]);
+
+    for (int c = 0; c < 3; c++) {
+        float v00 = data[c000 + c] * (1 - frac[0]) + data[c100 + c] * frac[0];
+        float v10 = data[c010 + c] * (1 - frac[0]) + data[c110 + c] * frac[0];
+        float v01 = data[c001 + c] * (1 - frac[0]) + data[c101 + c] * frac[0];
+        float v11 = data[c011 + c] * (1 - frac[0]) + data[c111 + c] * frac[0];
+        float v0 = v00 * (1 - frac[1]) + v10 * frac[1];
+        float v1 = v01 * (1 - frac[1]) + v11 * frac[1];
+        float out = v0 * (1 - frac[2]) + v1 * frac[2];
+        pos[c] = lut.intensity >= 1 ? out : rgb[c] + (out - rgb[c]) * lut.intensity;
+    }
+    rgb[0] = pos[0];
+    rgb[1] = pos[1];
+    rgb[2] = pos[2];
+}
+
+CPU_INLINE float HueToRgb(float p, float q, float t) {
+    if (t < 0) t += 1;
+    if (t > 1) t -= 1;
+    if (t < 1.0f / 6) return p + (q - p) * 6 * t;
+    if (t < 0.5f) return q;
+    if (t < 2.0f / 3) return p + (q - p) * (2.0f / 3 - t) * 6;
+    return p;
+}
+
+// Hue wrapped into [0, 360); inputs stay within a few turns
+CPU_INLINE float WrapHue(float h) {
+    while (h >= 360) h -= 360;
+    while (h < 0) h += 360;
+    return h;
+}
+
+// filmLabHSL hslToRgb, rounded to 8-bit steps like the JavaScript version
+CPU_INLINE void HslToRgb(float h, float s, float l, float* rgb) {
+    h = WrapHue(h) / 360;
+    if (s == 0) {
+        rgb[0] = rgb[1] = rgb[2] = Round(l * 255) / 255;
+        return;
+    }
+    float q = l < 0.5f ? l * (1 + s) : l + s - l * s;
+    float p = 2 * l - q;
+    rgb[0] = Round(HueToRgb(p, q, h + 1.0f / 3) * 255) / 255;
+    rgb[1] = Round(HueToRgb(p, q, h) * 255) / 255;
+    rgb[2] = Round(HueToRgb(p, q, h - 1.0f / 3) * 255) / 255;
+}
+
+CPU_INLINE float Smoothstep(float t) {
+    t = Clamp01(t);
+    return t * t * (3 - 2 * t);
+}
+
+// filmLabSplitTone calculateZoneWeights
+CPU_INLINE void ZoneWeights(float luminance, float balance, float* shadow, float* midtone, float* highlight) {
+    const float shadow_end = 0.25f;
+    const float highlight_start = 0.75f;
+    const float midpoint = 0.5f + balance / 200;
+    float s = 0, m = 0, h = 0;
+
+    if (luminance < shadow_end) {
+        s = 1;
+    } else if (luminance < midpoint) {
+        float t = (luminance - shadow_end) / (midpoint - shadow_end);
+        s = 1 - Smoothstep(t);
+        m = Smoothstep(t);
+    }
+    if (luminance >= shadow_end && luminance <= highlight_start) {
+        if (luminance >= midpoint - 0.1f && luminance <= midpoint + 0.1f) {
+            m = 1;
+        } else if (luminance < midpoint) {
+            m = std::max(m, Smoothstep((luminance - shadow_end) / (midpoint - shadow_end)));
+        } else {
+            m = std::max(m, 1 - Smoothstep((luminance - midpoint) / (highlight_start - midpoint)));
+        }
+    }
+    if (luminance > highlight_start) {
+        h = 1;
+    } else if (luminance > midpoint) {
+        float t = (luminance - midpoint) / (highlight_start - midpoint);
+        h = Smoothstep(t);
+        m = std::max(m, 1 - Smoothstep(t));
+    }
+    *shadow = s;
+    *midtone = m;
+    *highlight = h;
+}
+
+} // namespace
+
+const char* FilmLabStageName(int stage) {
+    switch (stage) {
+        case STAGE_DENSITY: return "density";
+        case STAGE_TONE: return "tone";
+        case STAGE_CURVES: return "curves";
+        case STAGE_COLOR: return "color";
+        default: return "none";
+    }
+}
+
+void FilmLabZoneWeights(float luminance, float balance, float* shadow, float* midtone, float* highlight) {
+    ZoneWeights(luminance, balance, shadow, midtone, highlight);
+}
+
+int FilmLabStages::FirstDifference(const FilmLabStages& other) const {
+    if (density != other.density || !(lut1 == other.lut1) || !(lut2 == other.lut2)) {
+        return STAGE_DENSITY;
+    }
+    if (tone != other.tone) {
+        return STAGE_TONE;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (curves[i] != other.curves[i]) return STAGE_CURVES;
+    }
+    if (hsl_active != other.hsl_active || saturation != other.saturation ||
+        split_active != other.split_active ||
+        !std::equal(hsl, hsl + 24, other.hsl) || !std::equal(split, split + 13, other.split)) {
+        return STAGE_COLOR;
+    }
+    return STAGE_COUNT;
+}
+
+bool FilmLabStages::Valid() const {
+    if (density.size() < 6 || density.size() % 3 || tone.size() < 6 || tone.size() % 3) {
+        return false;
+    }
+    for (const FilmLabLut3D* lut : { &lut1, &lut2 }) {
+        if (lut->size == 0) continue;
+        if (lut->size < 2 || lut->data.size() < static_cast<size_t>(lut->size) * lut->size * lut->size * 3) {
+            return false;
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        if (curves[i].size() < 2) return false;
+    }
+    return true;
+}
+
+FilmLabKernel::FilmLabKernel(const FilmLabStages& stages) : stages_(stages) {
+    if (!stages.hsl_active) return;
+
+    hsl_table_.resize((HSL_TABLE_STEPS + 1) * 4);
+    for (int i = 0; i <= HSL_TABLE_STEPS; i++) {
+        double hue = i * 360.0 / HSL_TABLE_STEPS;
+        double hue_shift = 0, sat = 0, lum = 0, total = 0;
+        for (int c = 0; c < 8; c++) {
+            double distance = std::fabs(hue - HSL_CENTERS[c]);
+            if (distance > 180) distance = 360 - distance;
+            if (distance >= HSL_RANGES[c]) continue;
+            double weight = 0.5 * (1 + std::cos(distance / HSL_RANGES[c] * PI));
+            total += weight;
+            hue_shift += stages.hsl[c * 3] * weight;
+            sat += stages.hsl[c * 3 + 1] / 100.0 * weight;
+            lum += stages.hsl[c * 3 + 2] / 100.0 * weight;
+        }
+        float* entry = &hsl_table_[i * 4];
+        entry[3] = static_cast<float>(lum);
+        if (total > 1) {
+            hue_shift /= total;
+            sat /= total;
+            lum /= total;
+        }
+        entry[0] = static_cast<float>(hue_shift);
+        entry[1] = static_cast<float>(sat);
+        entry[2] = static_cast<float>(lum);
+    }
+}
+
+namespace {
+
+CPU_INLINE void DensityBody(const FilmLabStages& stages, const uint16_t* src, int source_max,
+                            float* rgb, int pixels) {
+    const int size = static_cast<int>(stages.density.size() / 3);
+    const float* tables[3] = {
+        stages.density.data(), stages.density.data() + size, stages.density.data() + size * 2
+    };
+    const float scale = static_cast<float>(size - 1) / source_max;
+
+    for (int p = 0; p < pixels; p++) {
+        for (int c = 0; c < 3; c++) {
+            const float* table = tables[c];
+            float pos = src[p * 3 + c] * scale;
+            int index = static_cast<int>(pos);
+            rgb[p * 3 + c] = index >= size - 1 ? table[size - 1]
+                                               : table[index] + (table[index + 1] - table[index]) * (pos - index);
+        }
+    }
+    if (stages.lut1.size) {
+        for (int p = 0; p < pixels; p++) SampleLut3D(stages.lut1, rgb + p * 3);
+    }
+    if (stages.lut2.size) {
+        for (int p = 0; p < pixels; p++) SampleLut3D(stages.lut2, rgb + p * 3);
+    }
+}
+
+CPU_INLINE void ToneBody(const FilmLabStages& stages, float* rgb, int pixels) {
+    const int size = static_cast<int>(stages.tone.size() / 3);
+    const float* tables[3] = {
+        stages.tone.data(), stages.tone.data() + size, stages.tone.data() + size * 2
+    };
+    const float threshold = 0.8f;
+
+    for (int p = 0; p < pixels; p++, rgb += 3) {
+        for (int c = 0; c < 3; c++) rgb[c] = SampleTable(tables[c], size, rgb[c]);
+
+        // Highlight roll-off: tanh shoulder above the threshold, ratios kept
+        float max_value = std::max(rgb[0], std::max(rgb[1], rgb[2]));
+        if (max_value > threshold) {
+            float t = std::min((max_value - threshold) / (1 - threshold), 10.0f);
+            float e2t = std::exp(2 * t);
+            float compressed = threshold + (1 - threshold) * (e2t - 1) / (e2t + 1);
+            float scale = compressed / max_value;
+            rgb[0] *= scale;
+            rgb[1] *= scale;
+            rgb[2] *= scale;
+        }
+        rgb[0] = Clamp01(rgb[0]);
+        rgb[1] = Clamp01(rgb[1]);
+        rgb[2] = Clamp01(rgb[2]);
+    }
+}
+
+CPU_INLINE void CurvesBody(const FilmLabStages& stages, float* rgb, int pixels) {
+    const std::vector<float>* curves = stages.curves;
+    for (int p = 0; p < pixels; p++, rgb += 3) {
+        for (int c = 0; c < 3; c++) {
+            float v = SampleTable(curves[0].data(), static_cast<int>(curves[0].size()), rgb[c]);
+            rgb[c] = SampleTable(curves[c + 1].data(), static_cast<int>(curves[c + 1].size()), v);
+        }
+    }
+}
+
+CPU_INLINE void ColorBody(const FilmLabStages& stages, const float* hsl_table, float* rgb, int pixels) {
+    const float* split = stages.split;
+
+    for (int p = 0; p < pixels; p++, rgb += 3) {
+        float r = rgb[0], g = rgb[1], b = rgb[2];
+
+        if (stages.hsl_active) {
+            float max_value = std::max(r, std::max(g, b));
+            float min_value = std::min(r, std::min(g, b));
+            float l = (max_value + min_value) / 2;
+            float h = 0, s = 0;
+            if (max_value != min_value) {
+                float d = max_value - min_value;
+                s = l > 0.5f ? d / (2 - max_value - min_value) : d / (max_value + min_value);
+                if (max_value == r) {
+                    h = ((g - b) / d + (g < b ? 6 : 0)) / 6;
+                } else if (max_value == g) {
+                    h = ((b - r) / d + 2) / 6;
+                } else {
+                    h = ((r - g) / d + 4) / 6;
+                }
+                h *= 360;
+            }
+
+            float pos = std::min(std::max(h, 0.0f), 360.0f) * (HSL_TABLE_STEPS / 360.0f);
+            int index = std::min(static_cast<int>(pos), HSL_TABLE_STEPS - 1);
+            float frac = pos - index;
+            const float* e0 = &hsl_table[index * 4];
+            const float* e1 = e0 + 4;
+            float adjust[4];
+            for (int k = 0; k < 4; k++) adjust[k] = e0[k] + (e1[k] - e0[k]) * frac;
+
+            float out[3];
+            if (s < 0.05f) {
+                // Near-grey: hue is meaningless, only luminance applies
+                if (adjust[3] != 0) {
+                    HslToRgb(h, s, Clamp01(l + adjust[3] * 0.5f), out);
+                    r = out[0]; g = out[1]; b = out[2];
+                }
+            } else {
+                h = WrapHue(h + adjust[0]);
+                if (adjust[1] > 0) {
+                    s = Clamp01(s + (1 - s) * adjust[1]);
+                } else if (adjust[1] < 0) {
+                    s = Clamp01(s * (1 + adjust[1]));
+                }
+                if (adjust[2] > 0) {
+                    l = Clamp01(l + (1 - l) * adjust[2] * 0.5f);
+                } else if (adjust[2] < 0) {
+                    l = Clamp01(l * (1 + adjust[2] * 0.5f));
+                }
+                HslToRgb(h, s, l, out);
+                r = out[0]; g = out[1]; b = out[2];
+            }
+        }
+
+        if (stages.saturation != 0) {
+            // Luma-preserving (Rec. 709)
+            float strength = 1 + stages.saturation / 100;
+            float lum = 0.2126f * r + 0.7152f * g + 0.0722f * b;
+            r = Clamp01(lum + (r - lum) * strength);
+            g = Clamp01(lum + (g - lum) * strength);
+            b = Clamp01(lum + (b - lum) * strength);
+        }
+
+        if (stages.split_active) {
+            // Lerp towards the zone tints in 0-255 units, then round
+            float out[3] = { r * 255, g * 255, b * 255 };
+            float weights[3];
+            ZoneWeights(0.2126f * r + 0.7152f * g + 0.0722f * b, split[12],
+                        &weights[2], &weights[1], &weights[0]);
+            for (int zone = 0; zone < 3; zone++) {      // highlight, midtone, shadow
+                if (split[zone] > 0 && weights[zone] > 0) {
+                    float amount = split[zone] * weights[zone] * 0.3f;
+                    const float* tint = split + 3 + zone * 3;
+                    for (int c = 0; c < 3; c++) out[c] += (tint[c] - out[c]) * amount;
+                }
+            }
+            r = std::min(255.0f, std::max(0.0f, Round(out[0]))) / 255;
+            g = std::min(255.0f, std::max(0.0f, Round(out[1]))) / 255;
+            b = std::min(255.0f, std::max(0.0f, Round(out[2]))) / 255;
+        }
+
+        rgb[0] = Clamp01(r);
+        rgb[1] = Clamp01(g);
+        rgb[2] = Clamp01(b);
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, DensityRow, DensityBody,
+                    (const FilmLabStages& stages, const uint16_t* src, int source_max, float* rgb, int pixels),
+                    (stages, src, source_max, rgb, pixels))
+CPU_DISPATCH_KERNEL(void, ToneRow, ToneBody,
+                    (const FilmLabStages& stages, float* rgb, int pixels), (stages, rgb, pixels))
+CPU_DISPATCH_KERNEL(void, CurvesRow, CurvesBody,
+                    (const FilmLabStages& stages, float* rgb, int pixels), (stages, rgb, pixels))
+CPU_DISPATCH_KERNEL(void, ColorRow, ColorBody,
+                    (const FilmLabStages& stages, const float* hsl_table, float* rgb, int pixels),
+                    (stages, hsl_table, rgb, pixels))
+
+} // namespace
+
+void FilmLabKernel::Density(const uint16_t* src, int source_max, float* rgb, int pixels) const {
+    DensityRow(stages_, src, source_max, rgb, pixels);
+}
+
+void FilmLabKernel::Apply(int stage, float* rgb, int pixels) const {
+    switch (stage) {
+        case STAGE_TONE: Tone(rgb, pixels); break;
+        case STAGE_CURVES: Curves(rgb, pixels); break;
+        case STAGE_COLOR: Color(rgb, pixels); break;
+        default: break;
+    }
+}
+
+void FilmLabKernel::Tone(float* rgb, int pixels) const {
+    ToneRow(stages_, rgb, pixels);
+}
+
+void FilmLabKernel::Curves(float* rgb, int pixels) const {
+    CurvesRow(stages_, rgb, pixels);
+}
+
+void FilmLabKernel::Color(float* rgb, int pixels) const {
+    ColorRow(stages_, hsl_table_.data(), rgb, pixels);
+}
@@ -0,0 +1,125 @@
+/**
+ * @filmgallery/libraw-native - FilmLab Kernel
+ *
+ * Native evaluation of the shared RenderCore.processPixelFloat() pipeline,
+ * split at the stage boundaries a render session checkpoints:
+ *
+ *   STAGE_DENSITY  film curve, base correction, density levels, inversion
+ *                  (per channel, from RenderCore tables), then 3D LUTs
+ *   STAGE_TONE     white balance and tone (per channel, from tables),
+ *                  highlight roll-off, clamp
+ *   STAGE_CURVES   RGB master and per-channel curve LUTs
+ *   STAGE_COLOR    HSL, saturation, split toning
+ *
+ * The per-channel parts arrive as tables sampled by
+ * RenderCore.getNativeStages(), so film curve and tone formulas live only in
+ * JavaScript; the cross-channel parts are ported here.
+ */
+
+#ifndef FILMLAB_KERNEL_H
+#define FILMLAB_KERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum FilmLabStage {
+    STAGE_DENSITY = 0,
+    STAGE_TONE = 1,
+    STAGE_CURVES = 2,
+    STAGE_COLOR = 3,
+    STAGE_COUNT = 4
+};
+
+const char* FilmLabStageName(int stage);
+
+// HSL adjustment table entries per 360 degrees (0.1 degree steps)
+const int FILMLAB_HSL_STEPS = 3600;
+
+/**
+ * filmLabSplitTone zone weights for a Rec. 709 luminance and balance
+ */
+void FilmLabZoneWeights(float luminance, float balance, float* shadow, float* midtone, float* highlight);
+
+/**
+ * 3D LUT, red fastest, 3 floats per entry
+ */
+struct FilmLabLut3D {
+    int size = 0;
+    float intensity = 1.0f;
+    std::vector<float> data;
+
+    bool operator==(const FilmLabLut3D& other) const {
+        return size == other.size && intensity == other.intensity && data == other.data;
+    }
+};
+
+/**
+ * Parameters of every stage (RenderCore.getNativeStages())
+ */
+struct FilmLabStages {
+    // STAGE_DENSITY: 3 planar tables over [0, 1], then up to two LUTs
+    std::vector<float> density;
+    FilmLabLut3D lut1;
+    FilmLabLut3D lut2;
+
+    // STAGE_TONE: 3 planar tables over [0, 1]
+    std::vector<float> tone;
+
+    // STAGE_CURVES: RGB master, red, green, blue (any length >= 2)
+    std::vector<float> curves[4];
+
+    // STAGE_COLOR
+    bool hsl_active = false;
+    float hsl[24] = {};             // (hue, saturation, luminance) x 8 channels
+    float saturation = 0.0f;
+    bool split_active = false;
+    float split[13] = {};           // sat x3, tint RGB x3 (0-255), balance
+
+    /**
+     * First stage whose parameters differ (STAGE_COUNT when equal)
+     */
+    int FirstDifference(const FilmLabStages& other) const;
+
+    /**
+     * @returns false if a table or LUT has an unusable size
+     */
+    bool Valid() const;
+};
+
+/**
+ * Applies stages to rows of interleaved float RGB
+ */
+class FilmLabKernel {
+public:
+    explicit FilmLabKernel(const FilmLabStages& stages);
+
+    /**
+     * STAGE_DENSITY from source code values (0..source_max)
+     */
+    void Density(const uint16_t* src, int source_max, float* rgb, int pixels) const;
+
+    /**
+     * STAGE_TONE, STAGE_CURVES or STAGE_COLOR in place
+     */
+    void Apply(int stage, float* rgb, int pixels) const;
+
+    /**
+     * FILMLAB_HSL_STEPS + 1 entries of 4 (see hsl_table_); empty without HSL
+     */
+    const std::vector<float>& HslTable() const { return hsl_table_; }
+
+private:
+    void Tone(float* rgb, int pixels) const;
+    void Curves(float* rgb, int pixels) const;
+    void Color(float* rgb, int pixels) const;
+
+    const FilmLabStages& stages_;
+
+    // HSL adjustments by hue (0.1 degree steps): hue shift, saturation,
+    // luminance (weight-normalized) and the unnormalized luminance used for
+    // near-grey pixels
+    std::vector<float> hsl_table_;
+};
+
+#endif // FILMLAB_KERNEL_H
@@ -0,0 +1,390 @@
+/**
+ * @filmgallery/libraw-native - FilmLab Preview Kernel
+ */
+
+#include "filmlab_preview.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int ONE = 4096;                   // 12-bit fraction
+const int TABLE_SIZE = ONE + 1;         // Tables over [0, 1] in 12-bit steps
+const int HUE_TURN = FILMLAB_HSL_STEPS; // Hue in 0.1 degree steps
+
+// Highlight roll-off starts at 0.8; from 2.8 on tanh has saturated and the
+// scale is 1 / max
+const int ROLLOFF_START = 3277;
+const int ROLLOFF_END = 11469;
+
+// Table values keep headroom above 1.0 for the roll-off
+const int32_t TABLE_MIN = -4 * ONE;
+const int32_t TABLE_MAX = 15 * ONE;
+
+float Clamp01(float v) {
+    return std::min(1.0f, std::max(0.0f, v));
+}
+
+float SampleTable(const std::vector<float>& table, int channel, int size, float x) {
+    const float* values = table.data() + static_cast<size_t>(channel) * size;
+    float pos = Clamp01(x) * (size - 1);
+    int i = static_cast<int>(pos);
+    if (i >= size - 1) return values[size - 1];
+    return values[i] + (values[i + 1] - values[i]) * (pos - i);
+}
+
+int32_t ToFixed(double v, int32_t low, int32_t high) {
+    return static_cast<int32_t>(std::min<double>(high, std::max<double>(low, std::floor(v * ONE + 0.5))));
+}
+
+CPU_INLINE int32_t Clamp12(int32_t v) {
+    return std::min(ONE, std::max(0, v));
+}
+
+CPU_INLINE int32_t Lerp12(int32_t a, int32_t b, int32_t frac) {
+    return a + (((b - a) * frac) >> 12);
+}
+
+// 16-bit codes index 4097 entries spaced 16 codes apart
+CPU_INLINE int32_t Lookup16(const int32_t* table, uint16_t code) {
+    const int i = code >> 4;
+    return table[i] + (((table[i + 1] - table[i]) * (code & 15)) >> 4);
+}
+
+CPU_INLINE void SampleLut(const FilmLabPreviewKernel::Lut& lut, int32_t* rgb) {
+    const int size = lut.size;
+    const int max_index = size - 1;
+    const int32_t* data = lut.data.data();
+
+    int i0[3];
+    int i1[3];
+    int32_t frac[3];
+    for (int c = 0; c < 3; c++) {
+        const int32_t pos = rgb[c] * max_index;
+        i0[c] = pos >> 12;
+        frac[c] = pos & (ONE - 1);
+        if (i0[c] >= max_index) {
+            i0[c] = max_index;
+            frac[c] = 0;
+        }
+        i1[c] = std::min(max_index, i0[c] + 1);
+    }
+    auto index = [size](int r, int g, int b) {
+        return (static_cast<size_t>(r) + static_cast<size_t>(g) * size + static_cast<size_t>(b) * size * size) * 3;
+    };
+    const size_t c000 = index(i0[0], i0[1], i0[2]), c100 = index(i1[0], i0[1], i0[2]);
+    const size_t c010 = index(i0[0], i1[1], i0[2]), c110 = index(i1[0], i1[1], i0[2]);
+    const size_t c001 = index(i0[0], i0[1], i1[2]), c101 = index(i1[0], i0[1], i1[2]);
+    const size_t c011 = index(i0[0], i1[1], i1[2]), c111 = index(i1[0], i1[1], i1[2]);
+
+    int32_t out[3];
+    for (int c = 0; c < 3; c++) {
+        int32_t v00 = Lerp12(data[c000 + c], data[c100 + c], frac[0]);
+        int32_t v10 = Lerp12(data[c010 + c], data[c110 + c], frac[0]);
+        int32_t v01 = Lerp12(data[c001 + c], data[c101 + c], frac[0]);
+        int32_t v11 = Lerp12(data[c011 + c], data[c111 + c], frac[0]);
+        out[c] = Lerp12(Lerp12(v00, v10, frac[1]), Lerp12(v01, v11, frac[1]), frac[2]);
+    }
+    for (int c = 0; c < 3; c++) {
+        rgb[c] = lut.intensity >= ONE ? out[c] : Lerp12(rgb[c], out[c], lut.intensity);
+    }
+}
+
+CPU_INLINE int32_t HueChannel(int32_t p, int32_t q, int t) {
+    if (t < 0) t += HUE_TURN;
+    if (t >= HUE_TURN) t -= HUE_TURN;
+    if (t < HUE_TURN / 6) return p + (q - p) * t / (HUE_TURN / 6);
+    if (t < HUE_TURN / 2) return q;
+    if (t < HUE_TURN * 2 / 3) return p + (q - p) * (HUE_TURN * 2 / 3 - t) / (HUE_TURN / 6);
+    return p;
+}
+
+CPU_INLINE void HslToRgb(int h, int32_t s, int32_t l, int32_t* rgb) {
+    if (s == 0) {
+        rgb[0] = rgb[1] = rgb[2] = l;
+        return;
+    }
+    int32_t q = l < ONE / 2 ? (l * (ONE + s)) >> 12 : l + s - ((l * s) >> 12);
+    int32_t p = 2 * l - q;
+    rgb[0] = HueChannel(p, q, h + HUE_TURN / 3);
+    rgb[1] = HueChannel(p, q, h);
+    rgb[2] = HueChannel(p, q, h - HUE_TURN / 3);
+}
+
+CPU_INLINE void Hsl(const int32_t* table, int32_t* rgb) {
+    const int32_t r = rgb[0], g = rgb[1], b = rgb[2];
+    const int32_t max_value = std::max(r, std::max(g, b));
+    const int32_t min_value = std::min(r, std::min(g, b));
+    int32_t l = (max_value + min_value) >> 1;
+    int32_t s = 0;
+    int h = 0;
+    if (max_value != min_value) {
+        const int32_t d = max_value - min_value;
+        s = max_value + min_value > ONE ? (d << 12) / (2 * ONE - max_value - min_value)
+                                        : (d << 12) / (max_value + min_value);
+        if (max_value == r) {
+            h = HUE_TURN / 6 * (g - b) / d + (g < b ? HUE_TURN : 0);
+        } else if (max_value == g) {
+            h = HUE_TURN / 6 * (b - r) / d + HUE_TURN / 3;
+        } else {
+            h = HUE_TURN / 6 * (r - g) / d + HUE_TURN * 2 / 3;
+        }
+    }
+
+    const int32_t* adjust = table + h * 4;
+    if (s < ONE / 20) {
+        // Near-grey: hue is meaningless, only luminance applies
+        if (adjust[3] != 0) HslToRgb(h, s, Clamp12(l + adjust[3] / 2), rgb);
+        return;
+    }
+    h += adjust[0];
+    if (h >= HUE_TURN) h -= HUE_TURN;
+    if (h < 0) h += HUE_TURN;
+    if (adjust[1] > 0) {
+        s = Clamp12(s + (((ONE - s) * adjust[1]) >> 12));
+    } else if (adjust[1] < 0) {
+        s = Clamp12((s * (ONE + adjust[1])) >> 12);
+    }
+    if (adjust[2] > 0) {
+        l = Clamp12(l + (((ONE - l) * adjust[2]) >> 13));
+    } else if (adjust[2] < 0) {
+        l = Clamp12((l * (ONE + adjust[2] / 2)) >> 12);
+    }
+    HslToRgb(h, s, l, rgb);
+}
+
+// Rec. 709 luma weights summing to 4096
+CPU_INLINE int32_t Luma(const int32_t* rgb) {
+    return (871 * rgb[0] + 2929 * rgb[1] + 296 * rgb[2] + ONE / 2) >> 12;
+}
+
+// Pixels per pass; each stage runs over a chunk before the next starts
+const size_t CHUNK = 1024;
+
+// Source bytes per band of a variant sweep, small enough to stay in L2
+// while every kernel reads it
+const size_t VARIANT_BAND_BYTES = 128 * 1024;
+
+template <typename T>
+CPU_INLINE void InputPass(const FilmLabPreviewKernel::Tables& t, const T* src, int channels, int32_t* rgb, size_t n) {
+    const int32_t* input[3] = { t.input[0].data(), t.input[1].data(), t.input[2].data() };
+    for (size_t p = 0; p < n; p++) {
+        for (int c = 0; c < 3; c++) {
+            const T code = src[p * channels + c];
+            rgb[p * 3 + c] = sizeof(T) == 1 ? input[c][code] : Lookup16(input[c], code);
+        }
+    }
+}
+
+CPU_INLINE void LutTonePass(const FilmLabPreviewKernel::Tables& t, int32_t* rgb, size_t n) {
+    for (int i = 0; i < t.lut_count; i++) {
+        for (size_t p = 0; p < n; p++) SampleLut(t.luts[i], rgb + p * 3);
+    }
+    const int32_t* tone[3] = { t.tone[0].data(), t.tone[1].data(), t.tone[2].data() };
+    for (size_t p = 0; p < n; p++) {
+        for (int c = 0; c < 3; c++) rgb[p * 3 + c] = tone[c][rgb[p * 3 + c]];
+    }
+}
+
+// Highlight roll-off, clamp, then curves
+CPU_INLINE void CurvesPass(const FilmLabPreviewKernel::Tables& t, int32_t* rgb, size_t n) {
+    const uint32_t* rolloff = t.rolloff.data();
+    const uint16_t* curves[3] = { t.curves[0].data(), t.curves[1].data(), t.curves[2].data() };
+    for (size_t p = 0; p < n; p++, rgb += 3) {
+        const int32_t max_value = std::max(rgb[0], std::max(rgb[1], rgb[2]));
+        if (max_value >= ROLLOFF_START) {
+            for (int c = 0; c < 3; c++) {
+                rgb[c] = max_value < ROLLOFF_END
+                    ? static_cast<int32_t>((static_cast<int64_t>(rgb[c]) * rolloff[max_value - ROLLOFF_START]) >> 16)
+                    : static_cast<int32_t>(static_cast<int64_t>(rgb[c]) * ONE / max_value);
+            }
+        }
+        for (int c = 0; c < 3; c++) rgb[c] = curves[c][Clamp12(rgb[c])];
+    }
+}
+
+CPU_INLINE void ColorPass(const FilmLabPreviewKernel::Tables& t, int32_t* rgb, size_t n) {
+    if (t.hsl_active) {
+        const int32_t* table = t.hsl.data();
+        for (size_t p = 0; p < n; p++) Hsl(table, rgb + p * 3);
+    }
+
+    if (t.saturation != ONE) {
+        const int32_t strength = t.saturation;
+        for (size_t p = 0; p < n; p++) {
+            int32_t* px = rgb + p * 3;
+            const int32_t lum = Luma(px);
+            for (int c = 0; c < 3; c++) px[c] = Clamp12(lum + (((px[c] - lum) * strength) >> 12));
+        }
+    }
+
+    if (t.split_active) {
+        const int32_t* split = t.split.data();
+        for (size_t p = 0; p < n; p++) {
+            int32_t* px = rgb + p * 3;
+            const int32_t* amounts = split + Clamp12(Luma(px)) * 3;
+            for (int zone = 0; zone < 3; zone++) {      // highlight, midtone, shadow
+                if (amounts[zone] == 0) continue;
+                const int32_t* tint = t.tints + zone * 3;
+                for (int c = 0; c < 3; c++) px[c] += ((tint[c] - px[c]) * amounts[zone]) >> 12;
+            }
+        }
+    }
+}
+
+CPU_INLINE void OutputPass(const int32_t* rgb, uint8_t* out, size_t n) {
+    for (size_t i = 0; i < n * 3; i++) out[i] = static_cast<uint8_t>((Clamp12(rgb[i]) * 255 + ONE / 2) >> 12);
+}
+
+CPU_INLINE void PreviewRowBody(const FilmLabPreviewKernel::Tables& t, const uint8_t* src, int channels,
+                               uint8_t* out, size_t pixels) {
+    int32_t rgb[CHUNK * 3];
+    const size_t bytes = t.bits / 8;
+    for (size_t first = 0; first < pixels; first += CHUNK) {
+        const size_t n = std::min(CHUNK, pixels - first);
+        if (t.bits == 8) {
+            InputPass(t, src + first * channels, channels, rgb, n);
+        } else {
+            InputPass(t, reinterpret_cast<const uint16_t*>(src + first * channels * bytes), channels, rgb, n);
+        }
+        if (!t.direct) LutTonePass(t, rgb, n);
+        CurvesPass(t, rgb, n);
+        ColorPass(t, rgb, n);
+        OutputPass(rgb, out + first * 3, n);
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, PreviewRow, PreviewRowBody,
+                    (const FilmLabPreviewKernel::Tables& t, const uint8_t* src, int channels, uint8_t* out,
+                     size_t pixels),
+                    (t, src, channels, out, pixels))
+
+} // namespace
+
+FilmLabPreviewKernel::FilmLabPreviewKernel(const FilmLabStages& stages, int bits) {
+    Tables& t = tables_;
+    t.bits = bits;
+    t.lut_count = 0;
+    for (const FilmLabLut3D* source : { &stages.lut1, &stages.lut2 }) {
+        if (!source->size) continue;
+        Lut& lut = t.luts[t.lut_count++];
+        lut.size = source->size;
+        lut.intensity = ToFixed(source->intensity, 0, ONE);
+        const size_t count = static_cast<size_t>(lut.size) * lut.size * lut.size * 3;
+        lut.data.resize(count);
+        for (size_t i = 0; i < count; i++) lut.data[i] = ToFixed(source->data[i], 0, ONE);
+    }
+    t.direct = t.lut_count == 0;
+
+    // Input tables: per code for 8-bit sources, every 16th code for 16-bit
+    const int density_size = static_cast<int>(stages.density.size() / 3);
+    const int tone_size = static_cast<int>(stages.tone.size() / 3);
+    const int input_size = bits == 8 ? 256 : TABLE_SIZE;
+    for (int c = 0; c < 3; c++) {
+        t.input[c].resize(input_size);
+        for (int i = 0; i < input_size; i++) {
+            float x = bits == 8 ? i / 255.0f : std::min(1.0f, i * 16 / 65535.0f);
+            float density = SampleTable(stages.density, c, density_size, x);
+            t.input[c][i] = t.direct ? ToFixed(SampleTable(stages.tone, c, tone_size, density), TABLE_MIN, TABLE_MAX)
+                                     : ToFixed(density, 0, ONE);
+        }
+        if (!t.direct) {
+            t.tone[c].resize(TABLE_SIZE);
+            for (int i = 0; i < TABLE_SIZE; i++) {
+                t.tone[c][i] = ToFixed(SampleTable(stages.tone, c, tone_size, i / static_cast<float>(ONE)),
+                                       TABLE_MIN, TABLE_MAX);
+            }
+        }
+    }
+
+    // Roll-off scales: tanh shoulder above 0.8, ratios kept
+    t.rolloff.resize(ROLLOFF_END - ROLLOFF_START);
+    for (int m = ROLLOFF_START; m < ROLLOFF_END; m++) {
+        double max_value = static_cast<double>(m) / ONE;
+        double compressed = 0.8 + 0.2 * std::tanh(std::min((max_value - 0.8) / 0.2, 10.0));
+        t.rolloff[m - ROLLOFF_START] = static_cast<uint32_t>(std::floor(compressed / max_value * 65536 + 0.5));
+    }
+
+    // Master curve then the channel's own
+    const std::vector<float>* curves = stages.curves;
+    for (int c = 0; c < 3; c++) {
+        t.curves[c].resize(TABLE_SIZE);
+        for (int i = 0; i < TABLE_SIZE; i++) {
+            float v = SampleTable(curves[0], 0, static_cast<int>(curves[0].size()), i / static_cast<float>(ONE));
+            v = SampleTable(curves[c + 1], 0, static_cast<int>(curves[c + 1].size()), v);
+            t.curves[c][i] = static_cast<uint16_t>(ToFixed(v, 0, ONE));
+        }
+    }
+
+    t.hsl_active = stages.hsl_active;
+    if (t.hsl_active) {
+        FilmLabKernel kernel(stages);
+        const std::vector<float>& table = kernel.HslTable();
+        t.hsl.resize(table.size());
+        for (size_t i = 0; i < table.size(); i += 4) {
+            t.hsl[i] = static_cast<int32_t>(std::floor(table[i] * (HUE_TURN / 360.0) + 0.5));
+            t.hsl[i + 1] = ToFixed(table[i + 1], -ONE, ONE);
+            t.hsl[i + 2] = ToFixed(table[i + 2], -ONE, ONE);
+            t.hsl[i + 3] = ToFixed(table[i + 3], -2 * ONE, 2 * ONE);
+        }
+    }
+
+    t.saturation = ToFixed(1 + stages.saturation / 100.0, 0, 2 * ONE);
+
+    // Zone amounts by luminance (highlight, midtone, shadow) and tints
+    t.split_active = stages.split_active;
+    if (t.split_active) {
+        t.split.resize(TABLE_SIZE * 3);
+        for (int i = 0; i < TABLE_SIZE; i++) {
+            float weights[3];
+            FilmLabZoneWeights(i / static_cast<float>(ONE), stages.split[12], &weights[2], &weights[1], &weights[0]);
+            for (int zone = 0; zone < 3; zone++) {
+                float amount = stages.split[zone] > 0 ? stages.split[zone] * weights[zone] * 0.3f : 0.0f;
+                t.split[i * 3 + zone] = ToFixed(amount, 0, ONE);
+            }
+        }
+        for (int i = 0; i < 9; i++) t.tints[i] = ToFixed(stages.split[3 + i] / 255.0, 0, ONE);
+    }
+}
+
+void FilmLabPreviewKernel::Apply(const uint8_t* src, int channels, uint8_t* out, size_t pixels) const {
+    PreviewRow(tables_, src, channels, out, pixels);
+}
+
+void RenderPreviews(const std::vector<FilmLabPreviewKernel>& kernels, const std::vector<PreviewImage>& images) {
+    auto render_rows = [&kernels](const PreviewImage& image, int first, int last) {
+        const size_t stride = static_cast<size_t>(image.width) * image.channels * (image.bits / 8);
+        kernels[image.kernel].Apply(image.src + stride * first, image.channels,
+                                    image.out + static_cast<size_t>(first) * image.width * 3,
+                                    static_cast<size_t>(last - first) * image.width);
+    };
+
+    if (images.size() == 1) {
+        const PreviewImage& image = images[0];
+        ParallelRows(image.height, 64, [&](int first, int last) { render_rows(image, first, last); });
+        return;
+    }
+    ParallelRows(static_cast<int>(images.size()), 1, [&](int first, int last) {
+        for (int i = first; i < last; i++) render_rows(images[i], 0, images[i].height);
+    });
+}
+
+void RenderVariants(const std::vector<FilmLabPreviewKernel>& kernels, const std::vector<PreviewImage>& variants) {
+    if (variants.empty()) return;
+    const PreviewImage& image = variants[0];
+    const size_t stride = static_cast<size_t>(image.width) * image.channels * (image.bits / 8);
+    const int band_rows = static_cast<int>(std::max<size_t>(1, VARIANT_BAND_BYTES / stride));
+
+    ParallelRows(image.height, 8, [&](int first, int last) {
+        for (int band = first; band < last; band += band_rows) {
+            const int rows = std::min(band_rows, last - band);
+            for (const PreviewImage& variant : variants) {
+                kernels[variant.kernel].Apply(image.src + stride * band, image.channels,
+                                              variant.out + static_cast<size_t>(band) * image.width * 3,
+                                              static_cast<size_t>(rows) * image.width);
+            }
+        }
+    });
+}
@@ -0,0 +1,96 @@
+/**
+ * @filmgallery/libraw-native - FilmLab Preview Kernel
+ *
+ * Fixed-point version of the FilmLab stages (filmlab_kernel.h) for
+ * thumbnails and grid views, where throughput over many small images
+ * matters more than float precision. Values are 12-bit fractions
+ * (4096 = 1.0):
+ *
+ *   - density and tone (and, without 3D LUTs, both together) are
+ *     precomposed per channel into one table indexed by the source code
+ *     (8-bit: per code; 16-bit: 4097 entries, interpolated), as are the
+ *     master and per-channel curves
+ *   - 3D LUTs, highlight roll-off, HSL, saturation and split toning run in
+ *     integer arithmetic from tables built once per kernel
+ *
+ * Output is 8-bit RGB and stays within a few codes of the float kernel.
+ */
+
+#ifndef FILMLAB_PREVIEW_H
+#define FILMLAB_PREVIEW_H
+
+#include "filmlab_kernel.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class FilmLabPreviewKernel {
+public:
+    /**
+     * @param bits - Source bit depth the kernel is built for (8 or 16)
+     */
+    FilmLabPreviewKernel(const FilmLabStages& stages, int bits);
+
+    /**
+     * Render interleaved RGB(A) pixels (`channels` 3 or 4, alpha dropped)
+     * into 8-bit RGB
+     */
+    void Apply(const uint8_t* src, int channels, uint8_t* out, size_t pixels) const;
+
+    int Bits() const { return tables_.bits; }
+
+    // Precomputed tables, read by the row kernels in filmlab_preview.cpp
+    struct Lut {
+        int size = 0;
+        int intensity = 4096;
+        std::vector<int32_t> data;      // Fixed-point RGB entries, red fastest
+    };
+
+    struct Tables {
+        int bits;
+        bool direct;                    // input[] is the composed density + tone
+        std::vector<int32_t> input[3];  // density (with LUTs) or density + tone
+        std::vector<int32_t> tone[3];   // 4097 entries, only with LUTs
+        Lut luts[2];
+        int lut_count;
+        std::vector<uint32_t> rolloff;  // Q16 highlight scales from ROLLOFF_START
+        std::vector<uint16_t> curves[3];
+        bool hsl_active;
+        std::vector<int32_t> hsl;       // FILMLAB_HSL_STEPS + 1 entries of 4
+        int saturation;                 // Q12 strength, 4096 when off
+        bool split_active;
+        std::vector<int32_t> split;     // 4097 luminances x 3 zone amounts
+        int32_t tints[9];
+    };
+
+private:
+    Tables tables_;
+};
+
+/**
+ * One image of a preview batch
+ */
+struct PreviewImage {
+    const uint8_t* src;
+    int width;
+    int height;
+    int channels;
+    int bits;
+    size_t kernel;                      // Index into the batch's kernels
+    uint8_t* out;                       // width * height * 3 bytes
+};
+
+/**
+ * Render a batch, spread across threads by image (or by rows for a batch
+ * of one)
+ */
+void RenderPreviews(const std::vector<FilmLabPreviewKernel>& kernels, const std::vector<PreviewImage>& images);
+
+/**
+ * Render variants of one image (same src, size and format, each with its own
+ * kernel and out): rows are spread across threads, and each band of rows
+ * goes through every variant's kernel while it is still in cache
+ */
+void RenderVariants(const std::vector<FilmLabPreviewKernel>& kernels, const std::vector<PreviewImage>& variants);
+
+#endif // FILMLAB_PREVIEW_H
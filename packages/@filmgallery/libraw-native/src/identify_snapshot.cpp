@@ -0,0 +1,573 @@
+/**
+ * @filmgallery/libraw-native - Identify Snapshots Implementation
+ *
+ * Blob layout (little-endian):
+ *
+ *   header   (kHeaderSize bytes) magic 'FGIS', version, flags, LibRaw
+ *            version, struct layout fingerprint, file size/mtime, raw open
+ *            options, decoder indices, decoded payload length and checksum
+ *            of the encoded payload
+ *   payload  zero-run encoded: the identify-time structs copied verbatim,
+ *            the parsed TIFF IFDs, then the XMP packet and strip tables
+ *
+ * Most of the captured structs are zero-filled, so the zero-run encoding
+ * keeps a typical snapshot to a few kilobytes. The 64K-entry tone curve is
+ * left out when it is the identity (the common case). Heap pointers inside the
+ * copied structs are never trusted on restore: they are cleared, and the
+ * data behind them is either carried in the payload (XMP, strip tables),
+ * re-read from the file (ICC profile) or dropped (makernote AF blobs, CR3
+ * sample tables, which are only used during identify, and DNG opcode lists,
+ * which only the DNG SDK path reads).
+ *
+ * Taken after unpack(), a snapshot carries the post-unpack sizes and levels
+ * instead; it is flagged as such and only restored by mosaic caches
+ * (mosaic_cache.cpp), which supply the raw image alongside it.
+ */
+
+#include "film_libraw.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace {
+
+const uint32_t kMagic = 0x53494746;     // "FGIS"
+const uint16_t kVersion = 1;
+const size_t kHeaderSize = 64;
+const uint32_t kNoDecoder = 0xffffffff;
+
+// Header flags
+const uint16_t kFlagShrink = 1;          // sizes were rounded for half-size output
+const uint16_t kFlagLinearCurve = 2;     // color.curve is the identity, not stored
+const uint16_t kFlagUnpacked = 4;        // taken after unpack() (mosaic caches)
+
+// Shortest zero run worth encoding (shorter runs stay in the literal)
+const size_t kMinZeroRun = 8;
+
+uint32_t Fnv1a(const uint8_t* data, size_t size, uint32_t hash = 2166136261u) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Struct sizes and LibRaw limits; changes whenever the copied layout does
+ */
+uint32_t LayoutFingerprint() {
+    const uint32_t sizes[] = {
+        sizeof(libraw_image_sizes_t), sizeof(libraw_iparams_t), sizeof(libraw_lensinfo_t),
+        sizeof(libraw_makernotes_t), sizeof(libraw_shootinginfo_t), sizeof(libraw_colordata_t),
+        sizeof(libraw_imgother_t), sizeof(libraw_thumbnail_t), sizeof(libraw_thumbnail_list_t),
+        sizeof(libraw_internal_output_params_t), sizeof(identify_data_t), sizeof(unpacker_data_t),
+        sizeof(tiff_ifd_t), LIBRAW_IFD_MAXCOUNT, LIBRAW_CRXTRACKS_MAXCOUNT, LIBRAW_AFDATA_MAXCOUNT,
+        sizeof(void*)
+    };
+    return Fnv1a(reinterpret_cast<const uint8_t*>(sizes), sizeof(sizes));
+}
+
+bool StatFile(const char* path, int64_t* size, int64_t* mtime) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path, &st) != 0) return false;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+#endif
+    *size = static_cast<int64_t>(st.st_size);
+    *mtime = static_cast<int64_t>(st.st_mtime);
+    return true;
+}
+
+template <typename T>
+void Put(uint8_t* dst, T value) {
+    std::memcpy(dst, &value, sizeof(T));
+}
+
+template <typename T>
+T Get(const uint8_t* src) {
+    T value;
+    std::memcpy(&value, src, sizeof(T));
+    return value;
+}
+
+class PayloadWriter {
+public:
+    template <typename T>
+    void Struct(const T& value) {
+        Bytes(&value, sizeof(T));
+    }
+
+    void Bytes(const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        raw_.insert(raw_.end(), p, p + size);
+    }
+
+    const std::vector<uint8_t>& Raw() const { return raw_; }
+
+    /**
+     * Encode as [u32 literal length][literal bytes][u32 zero run length]...
+     */
+    void Encode(std::vector<uint8_t>& out) const {
+        size_t i = 0;
+        const size_t n = raw_.size();
+        while (i < n) {
+            size_t literal_start = i;
+            size_t zeros = 0;
+            while (i < n) {
+                if (raw_[i] == 0) {
+                    size_t run = 0;
+                    while (i + run < n && raw_[i + run] == 0) run++;
+                    if (run >= kMinZeroRun || i + run == n) {
+                        zeros = run;
+                        break;
+                    }
+                    i += run;
+                } else {
+                    i++;
+                }
+            }
+            uint8_t length[4];
+            Put<uint32_t>(length, static_cast<uint32_t>(i - literal_start));
+            out.insert(out.end(), length, length + 4);
+            out.insert(out.end(), raw_.begin() + literal_start, raw_.begin() + i);
+            Put<uint32_t>(length, static_cast<uint32_t>(zeros));
+            out.insert(out.end(), length, length + 4);
+            i += zeros;
+        }
+    }
+
+private:
+    std::vector<uint8_t> raw_;
+};
+
+class PayloadReader {
+public:
+    bool Decode(const uint8_t* data, size_t size, size_t expected) {
+        raw_.reserve(expected);
+        size_t i = 0;
+        while (i < size) {
+            if (size - i < 4) return false;
+            uint32_t literal = Get<uint32_t>(data + i);
+            i += 4;
+            if (size - i < static_cast<size_t>(literal) + 4) return false;
+            raw_.insert(raw_.end(), data + i, data + i + literal);
+            i += literal;
+            uint32_t zeros = Get<uint32_t>(data + i);
+            i += 4;
+            if (raw_.size() + zeros > expected) return false;
+            raw_.resize(raw_.size() + zeros, 0);
+        }
+        return raw_.size() == expected;
+    }
+
+    const std::vector<uint8_t>& Raw() const { return raw_; }
+
+    bool Bytes(void* dst, size_t size) {
+        if (raw_.size() - pos_ < size) return false;
+        std::memcpy(dst, raw_.data() + pos_, size);
+        pos_ += size;
+        return true;
+    }
+
+    template <typename T>
+    bool Struct(T& value) {
+        return Bytes(&value, sizeof(T));
+    }
+
+private:
+    std::vector<uint8_t> raw_;
+    size_t pos_ = 0;
+};
+
+}  // namespace
+
+const char* SnapshotStatusMessage(SnapshotStatus status) {
+    switch (status) {
+        case SNAPSHOT_OK: return "ok";
+        case SNAPSHOT_INVALID: return "snapshot is corrupt or from another build";
+        case SNAPSHOT_STALE: return "file or open options changed since the snapshot";
+        case SNAPSHOT_IO_ERROR: return "file could not be opened";
+    }
+    return "unknown";
+}
+
+// ============================================================================
+// Decoder table
+// ============================================================================
+
+// Every load_raw LibRaw's identify() can select (see get_decoder_info()).
+// Snapshots store an index into this list; the order is part of the format,
+// so append only. Foveon (x3f) keeps decoder state outside the captured
+// structs and is deliberately absent.
+const std::vector<FilmLibRaw::Decoder>& FilmLibRaw::Decoders() {
+    static const std::vector<Decoder> decoders = {
+        &FilmLibRaw::android_tight_load_raw,
+        &FilmLibRaw::android_loose_load_raw,
+        &FilmLibRaw::vc5_dng_load_raw_placeholder,
+        &FilmLibRaw::jxl_dng_load_raw_placeholder,
+        &FilmLibRaw::canon_600_load_raw,
+        &FilmLibRaw::fuji_compressed_load_raw,
+        &FilmLibRaw::fuji_14bit_load_raw,
+        &FilmLibRaw::canon_load_raw,
+        &FilmLibRaw::lossless_jpeg_load_raw,
+        &FilmLibRaw::canon_sraw_load_raw,
+        &FilmLibRaw::crxLoadRaw,
+        &FilmLibRaw::lossless_dng_load_raw,
+        &FilmLibRaw::packed_dng_load_raw,
+        &FilmLibRaw::pentax_load_raw,
+        &FilmLibRaw::nikon_load_raw,
+        &FilmLibRaw::nikon_coolscan_load_raw,
+        &FilmLibRaw::nikon_he_load_raw,
+        &FilmLibRaw::nikon_load_sraw,
+        &FilmLibRaw::nikon_yuv_load_raw,
+        &FilmLibRaw::rollei_load_raw,
+        &FilmLibRaw::phase_one_load_raw,
+        &FilmLibRaw::phase_one_load_raw_c,
+        &FilmLibRaw::phase_one_load_raw_s,
+        &FilmLibRaw::hasselblad_load_raw,
+        &FilmLibRaw::leaf_hdr_load_raw,
+        &FilmLibRaw::unpacked_load_raw,
+        &FilmLibRaw::unpacked_load_raw_reversed,
+        &FilmLibRaw::sinar_4shot_load_raw,
+        &FilmLibRaw::imacon_full_load_raw,
+        &FilmLibRaw::hasselblad_full_load_raw,
+        &FilmLibRaw::packed_load_raw,
+        &FilmLibRaw::broadcom_load_raw,
+        &FilmLibRaw::nokia_load_raw,
+        &FilmLibRaw::panasonic_load_raw,
+        &FilmLibRaw::panasonicC6_load_raw,
+        &FilmLibRaw::panasonicC7_load_raw,
+        &FilmLibRaw::panasonicC8_load_raw,
+        &FilmLibRaw::olympus_load_raw,
+        &FilmLibRaw::minolta_rd175_load_raw,
+        &FilmLibRaw::quicktake_100_load_raw,
+        &FilmLibRaw::kodak_radc_load_raw,
+        &FilmLibRaw::kodak_jpeg_load_raw,
+        &FilmLibRaw::lossy_dng_load_raw,
+        &FilmLibRaw::kodak_dc120_load_raw,
+        &FilmLibRaw::eight_bit_load_raw,
+        &FilmLibRaw::kodak_c330_load_raw,
+        &FilmLibRaw::kodak_c603_load_raw,
+        &FilmLibRaw::kodak_262_load_raw,
+        &FilmLibRaw::kodak_65000_load_raw,
+        &FilmLibRaw::kodak_ycbcr_load_raw,
+        &FilmLibRaw::kodak_rgb_load_raw,
+        &FilmLibRaw::sony_load_raw,
+        &FilmLibRaw::sony_ljpeg_load_raw,
+        &FilmLibRaw::sony_ycbcr_load_raw,
+        &FilmLibRaw::sony_arw_load_raw,
+        &FilmLibRaw::sony_arw2_load_raw,
+        &FilmLibRaw::sony_arq_load_raw,
+        &FilmLibRaw::samsung_load_raw,
+        &FilmLibRaw::samsung2_load_raw,
+        &FilmLibRaw::samsung3_load_raw,
+        &FilmLibRaw::smal_v6_load_raw,
+        &FilmLibRaw::smal_v9_load_raw,
+        &FilmLibRaw::pentax_4shot_load_raw,
+        &FilmLibRaw::deflate_dng_load_raw,
+        &FilmLibRaw::uncompressed_fp_dng_load_raw,
+        &FilmLibRaw::nikon_load_striped_packed_raw,
+        &FilmLibRaw::nikon_load_padded_packed_raw,
+        &FilmLibRaw::nikon_14bit_load_raw,
+        &FilmLibRaw::unpacked_load_raw_fuji_f700s20,
+        &FilmLibRaw::unpacked_load_raw_FujiDBP
+    };
+    return decoders;
+}
+
+uint32_t FilmLibRaw::DecoderIndex(Decoder decoder) {
+    if (!decoder) return kNoDecoder;
+    const std::vector<Decoder>& decoders = Decoders();
+    for (size_t i = 0; i < decoders.size(); i++) {
+        if (decoders[i] == decoder) return static_cast<uint32_t>(i);
+    }
+    return kNoDecoder;
+}
+
+// ============================================================================
+// Save
+// ============================================================================
+
+int FilmLibRaw::SaveSnapshot(const char* path, std::vector<uint8_t>& out) {
+    // unpack() rewrites sizes and levels, so only the open state is captured
+    if (!(imgdata.progress_flags & LIBRAW_PROGRESS_IDENTIFY) ||
+        (imgdata.progress_flags & LIBRAW_PROGRESS_LOAD_RAW)) {
+        return LIBRAW_OUT_OF_ORDER_CALL;
+    }
+    return WriteSnapshot(path, out);
+}
+
+int FilmLibRaw::WriteSnapshot(const char* path, std::vector<uint8_t>& out) {
+    uint32_t decoder = DecoderIndex(load_raw);
+    uint32_t component = DecoderIndex(pentax_component_load_raw);
+    if (decoder == kNoDecoder || (pentax_component_load_raw && component == kNoDecoder)) {
+        return LIBRAW_FILE_UNSUPPORTED;
+    }
+
+    int64_t file_size = 0;
+    int64_t mtime = 0;
+    if (!StatFile(path, &file_size, &mtime)) {
+        return LIBRAW_IO_ERROR;
+    }
+
+    uint16_t flags = libraw_internal_data.internal_output_params.shrink ? kFlagShrink : 0;
+    if (imgdata.progress_flags & LIBRAW_PROGRESS_LOAD_RAW) {
+        flags |= kFlagUnpacked;
+    }
+    libraw_colordata_t color = imgdata.color;
+    bool linear = true;
+    for (int i = 0; i < 0x10000 && linear; i++) {
+        linear = color.curve[i] == i;
+    }
+    if (linear) {
+        flags |= kFlagLinearCurve;
+        std::memset(color.curve, 0, sizeof(color.curve));
+    }
+    unsigned nifds = std::min(libraw_internal_data.identify_data.tiff_nifds, unsigned(LIBRAW_IFD_MAXCOUNT));
+
+    PayloadWriter payload;
+    payload.Struct(imgdata.sizes);
+    payload.Struct(imgdata.idata);
+    payload.Struct(imgdata.lens);
+    payload.Struct(imgdata.makernotes);
+    payload.Struct(imgdata.shootinginfo);
+    payload.Struct(color);
+    payload.Struct(imgdata.other);
+    payload.Struct(imgdata.thumbnail);
+    payload.Struct(imgdata.thumbs_list);
+    payload.Struct(imgdata.progress_flags);
+    payload.Struct(imgdata.process_warnings);
+    payload.Struct(libraw_internal_data.internal_output_params);
+    payload.Struct(libraw_internal_data.identify_data);
+    payload.Struct(libraw_internal_data.unpacker_data);
+    payload.Struct(libraw_internal_data.internal_data.profile_offset);
+    payload.Struct(libraw_internal_data.internal_data.toffset);
+    payload.Struct(libraw_internal_data.internal_data.pana_black);
+    payload.Bytes(tiff_ifd, nifds * sizeof(tiff_ifd_t));
+
+    // Heap data referenced from the structs above
+    uint32_t xmp_length = imgdata.idata.xmpdata ? imgdata.idata.xmplen : 0;
+    payload.Struct(xmp_length);
+    payload.Bytes(imgdata.idata.xmpdata, xmp_length);
+    for (unsigned i = 0; i < nifds; i++) {
+        const tiff_ifd_t& ifd = tiff_ifd[i];
+        int offsets = ifd.strip_offsets ? ifd.strip_offsets_count : 0;
+        int counts = ifd.strip_byte_counts ? ifd.strip_byte_counts_count : 0;
+        payload.Struct(offsets);
+        payload.Bytes(ifd.strip_offsets, offsets * sizeof(INT64));
+        payload.Struct(counts);
+        payload.Bytes(ifd.strip_byte_counts, counts * sizeof(INT64));
+    }
+
+    uint8_t header[kHeaderSize] = {};
+    Put<uint32_t>(header + 0, kMagic);
+    Put<uint16_t>(header + 4, kVersion);
+    Put<uint16_t>(header + 6, flags);
+    Put<uint32_t>(header + 8, static_cast<uint32_t>(LibRaw::versionNumber()));
+    Put<uint32_t>(header + 12, LayoutFingerprint());
+    Put<int64_t>(header + 16, file_size);
+    Put<int64_t>(header + 24, mtime);
+    Put<uint32_t>(header + 32, imgdata.rawparams.options);
+    Put<uint32_t>(header + 36, imgdata.rawparams.shot_select);
+    Put<uint32_t>(header + 40, imgdata.rawparams.specials);
+    Put<uint32_t>(header + 44, decoder);
+    Put<uint32_t>(header + 48, component);
+    Put<uint32_t>(header + 52, static_cast<uint32_t>(payload.Raw().size()));
+
+    out.assign(header, header + kHeaderSize);
+    payload.Encode(out);
+    // Checksum the encoded form: it is a fraction of the decoded size
+    Put<uint32_t>(out.data() + 56, Fnv1a(out.data() + kHeaderSize, out.size() - kHeaderSize));
+
+    return LIBRAW_SUCCESS;
+}
+
+// ============================================================================
+// Restore
+// ============================================================================
+
+SnapshotStatus FilmLibRaw::OpenWithSnapshot(const char* path, const uint8_t* data, size_t size) {
+    return RestoreSnapshot(path, data, size, false);
+}
+
+SnapshotStatus FilmLibRaw::RestoreSnapshot(const char* path, const uint8_t* data, size_t size, bool unpacked) {
+    recycle();
+
+    if (!data || size < kHeaderSize || Get<uint32_t>(data) != kMagic ||
+        Get<uint16_t>(data + 4) != kVersion ||
+        Get<uint32_t>(data + 8) != static_cast<uint32_t>(LibRaw::versionNumber()) ||
+        Get<uint32_t>(data + 12) != LayoutFingerprint() ||
+        ((Get<uint16_t>(data + 6) & kFlagUnpacked) != 0) != unpacked) {
+        return SNAPSHOT_INVALID;
+    }
+
+    // Identify depends on these; a different frame or option set means a different parse
+    if (Get<uint32_t>(data + 32) != imgdata.rawparams.options ||
+        Get<uint32_t>(data + 36) != imgdata.rawparams.shot_select ||
+        Get<uint32_t>(data + 40) != imgdata.rawparams.specials) {
+        return SNAPSHOT_STALE;
+    }
+
+    int64_t file_size = 0;
+    int64_t mtime = 0;
+    if (!StatFile(path, &file_size, &mtime)) {
+        return SNAPSHOT_IO_ERROR;
+    }
+    if (file_size != Get<int64_t>(data + 16) || mtime != Get<int64_t>(data + 24)) {
+        return SNAPSHOT_STALE;
+    }
+
+    const std::vector<Decoder>& decoders = Decoders();
+    uint32_t decoder = Get<uint32_t>(data + 44);
+    uint32_t component = Get<uint32_t>(data + 48);
+    if (decoder >= decoders.size() || (component != kNoDecoder && component >= decoders.size())) {
+        return SNAPSHOT_INVALID;
+    }
+
+    PayloadReader payload;
+    if (Fnv1a(data + kHeaderSize, size - kHeaderSize) != Get<uint32_t>(data + 56) ||
+        !payload.Decode(data + kHeaderSize, size - kHeaderSize, Get<uint32_t>(data + 52))) {
+        return SNAPSHOT_INVALID;
+    }
+
+    LibRaw_abstract_datastream* stream = nullptr;
+    try {
+        stream = new LibRaw_bigfile_datastream(path);
+    } catch (const std::bad_alloc&) {
+        return SNAPSHOT_IO_ERROR;
+    }
+    if (!stream->valid() || stream->size() != file_size) {
+        delete stream;
+        return SNAPSHOT_IO_ERROR;
+    }
+
+    bool ok = payload.Struct(imgdata.sizes) &&
+              payload.Struct(imgdata.idata) &&
+              payload.Struct(imgdata.lens) &&
+              payload.Struct(imgdata.makernotes) &&
+              payload.Struct(imgdata.shootinginfo) &&
+              payload.Struct(imgdata.color) &&
+              payload.Struct(imgdata.other) &&
+              payload.Struct(imgdata.thumbnail) &&
+              payload.Struct(imgdata.thumbs_list) &&
+              payload.Struct(imgdata.progress_flags) &&
+              payload.Struct(imgdata.process_warnings) &&
+              payload.Struct(libraw_internal_data.internal_output_params) &&
+              payload.Struct(libraw_internal_data.identify_data) &&
+              payload.Struct(libraw_internal_data.unpacker_data) &&
+              payload.Struct(libraw_internal_data.internal_data.profile_offset) &&
+              payload.Struct(libraw_internal_data.internal_data.toffset) &&
+              payload.Struct(libraw_internal_data.internal_data.pana_black);
+
+    uint16_t flags = Get<uint16_t>(data + 6);
+    if (flags & kFlagLinearCurve) {
+        for (int i = 0; i < 0x10000; i++) imgdata.color.curve[i] = i;
+    }
+    unsigned nifds = libraw_internal_data.identify_data.tiff_nifds;
+    ok = ok && nifds <= LIBRAW_IFD_MAXCOUNT;
+    std::memset(tiff_ifd, 0, sizeof(tiff_ifd));
+    ok = ok && payload.Bytes(tiff_ifd, nifds * sizeof(tiff_ifd_t));
+
+    // Pointers copied with the structs belong to the process that saved them
+    imgdata.idata.xmpdata = nullptr;
+    imgdata.color.profile = nullptr;
+    imgdata.thumbnail.thumb = nullptr;
+    for (int i = 0; i < LIBRAW_AFDATA_MAXCOUNT; i++) {
+        imgdata.makernotes.common.afdata[i].AFInfoData = nullptr;
+        imgdata.makernotes.common.afdata[i].AFInfoData_length = 0;
+    }
+    imgdata.makernotes.common.afcount = 0;
+    for (int i = 0; i < LIBRAW_CRXTRACKS_MAXCOUNT; i++) {
+        crx_data_header_t& hdr = libraw_internal_data.unpacker_data.crx_header[i];
+        hdr.stsc_data = nullptr;
+        hdr.sample_sizes = nullptr;
+        hdr.chunk_offsets = nullptr;
+        hdr.stsc_count = hdr.sample_count = hdr.sample_size = hdr.chunk_count = 0;
+    }
+    for (libraw_dng_rawopcode_t& opcodes : imgdata.color.dng_levels.rawopcodes) {
+        opcodes.data = nullptr;
+        opcodes.len = 0;
+    }
+    for (int i = 0; i < LIBRAW_IFD_MAXCOUNT; i++) {
+        tiff_ifd[i].strip_offsets = nullptr;
+        tiff_ifd[i].strip_byte_counts = nullptr;
+        tiff_ifd[i].strip_offsets_count = 0;
+        tiff_ifd[i].strip_byte_counts_count = 0;
+        for (libraw_dng_rawopcode_t& opcodes : tiff_ifd[i].dng_levels.rawopcodes) {
+            opcodes.data = nullptr;
+            opcodes.len = 0;
+        }
+    }
+
+    uint32_t xmp_length = 0;
+    ok = ok && payload.Struct(xmp_length);
+    if (ok && xmp_length) {
+        imgdata.idata.xmpdata = static_cast<char*>(malloc(xmp_length));
+        ok = payload.Bytes(imgdata.idata.xmpdata, xmp_length);
+        imgdata.idata.xmplen = xmp_length;
+    }
+    for (unsigned i = 0; ok && i < nifds; i++) {
+        int offsets = 0;
+        int counts = 0;
+        ok = payload.Struct(offsets) && offsets >= 0;
+        if (ok && offsets) {
+            tiff_ifd[i].strip_offsets = static_cast<INT64*>(calloc(offsets, sizeof(INT64)));
+            tiff_ifd[i].strip_offsets_count = offsets;
+            ok = payload.Bytes(tiff_ifd[i].strip_offsets, offsets * sizeof(INT64));
+        }
+        ok = ok && payload.Struct(counts) && counts >= 0;
+        if (ok && counts) {
+            tiff_ifd[i].strip_byte_counts = static_cast<INT64*>(calloc(counts, sizeof(INT64)));
+            tiff_ifd[i].strip_byte_counts_count = counts;
+            ok = payload.Bytes(tiff_ifd[i].strip_byte_counts, counts * sizeof(INT64));
+        }
+    }
+
+    if (!ok) {
+        delete stream;
+        recycle();
+        return SNAPSHOT_INVALID;
+    }
+
+    libraw_internal_data.internal_data.input = stream;
+    libraw_internal_data.internal_data.input_internal = 1;
+    load_raw = decoders[decoder];
+    pentax_component_load_raw = component == kNoDecoder ? nullptr : decoders[component];
+    write_fun = &FilmLibRaw::write_ppm_tiff;
+
+    // Embedded ICC profile, read the same way open_datastream() does
+    if (imgdata.color.profile_length) {
+        INT64 profile_size = std::min(INT64(imgdata.color.profile_length),
+                                      stream->size() - libraw_internal_data.internal_data.profile_offset);
+        if (profile_size > 0 && profile_size < LIBRAW_MAX_PROFILE_SIZE_MB * 1024LL * 1024LL) {
+            imgdata.color.profile = calloc(size_t(profile_size), 1);
+            imgdata.color.profile_length = unsigned(profile_size);
+            stream->seek(libraw_internal_data.internal_data.profile_offset, SEEK_SET);
+            stream->read(imgdata.color.profile, size_t(profile_size), 1);
+        }
+    }
+
+    // Tail of open_datastream(): shrink depends on the current output params.
+    // A snapshot taken with shrink already rounded sizes down to even.
+    libraw_internal_output_params_t& io = libraw_internal_data.internal_output_params;
+    io.shrink = imgdata.idata.filters &&
+                (imgdata.params.half_size ||
+                 imgdata.params.threshold || imgdata.params.aber[0] != 1 || imgdata.params.aber[2] != 1);
+    if (io.shrink && imgdata.idata.filters >= 1000) {
+        imgdata.sizes.width &= 65534;
+        imgdata.sizes.height &= 65534;
+    } else if ((flags & kFlagShrink) && imgdata.idata.filters >= 1000) {
+        recycle();
+        return SNAPSHOT_STALE;
+    }
+    imgdata.sizes.iheight = (imgdata.sizes.height + io.shrink) >> io.shrink;
+    imgdata.sizes.iwidth = (imgdata.sizes.width + io.shrink) >> io.shrink;
+
+    memmove(&imgdata.rawdata.color, &imgdata.color, sizeof(imgdata.color));
+    memmove(&imgdata.rawdata.sizes, &imgdata.sizes, sizeof(imgdata.sizes));
+    memmove(&imgdata.rawdata.iparams, &imgdata.idata, sizeof(imgdata.idata));
+    memmove(&imgdata.rawdata.ioparams, &io, sizeof(io));
+
+    return SNAPSHOT_OK;
+}
@@ -0,0 +1,30 @@
+/**
+ * @filmgallery/libraw-native - Identify Snapshots
+ *
+ * FilmLibRaw (film_libraw.h) can serialize the state identify() leaves behind
+ * (decoder selection, data offsets, sizes, CFA pattern, black/white levels,
+ * colour matrices, makernote-derived fields) into a versioned blob, and later
+ * reopen the same file from that blob without re-running identify().
+ *
+ * A snapshot is bound to the file (size and mtime), the LibRaw build (version
+ * and struct layout) and the raw open options (shot_select, options,
+ * specials). Any mismatch rejects the snapshot so the caller can fall back to
+ * a normal open_file().
+ */
+
+#ifndef IDENTIFY_SNAPSHOT_H
+#define IDENTIFY_SNAPSHOT_H
+
+enum SnapshotStatus {
+    SNAPSHOT_OK = 0,
+    SNAPSHOT_INVALID,       // Corrupt blob, other build, or unsupported decoder
+    SNAPSHOT_STALE,         // File size/mtime or open options changed
+    SNAPSHOT_IO_ERROR       // File could not be opened
+};
+
+/**
+ * Human-readable reason for a SnapshotStatus
+ */
+const char* SnapshotStatusMessage(SnapshotStatus status);
+
+#endif // IDENTIFY_SNAPSHOT_H
@@ -0,0 +1,346 @@
+/**
+ * @filmgallery/libraw-native - Inflate
+ */
+
+#include "inflate.h"
+#include <cstring>
+
+namespace {
+
+// Code lengths resolved by one table lookup
+const int FAST_BITS = 10;
+const int MAX_BITS = 15;
+
+const uint16_t LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+const uint8_t LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+const uint16_t DISTANCE_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+const uint8_t DISTANCE_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// Order the code length code lengths are sent in (3.2.7)
+const uint8_t CODE_LENGTH_ORDER[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+struct Huffman {
+    uint16_t fast[1 << FAST_BITS];      // symbol << 4 | length, 0 when longer than FAST_BITS
+    uint16_t count[MAX_BITS + 1];       // Codes of each length
+    uint16_t symbol[288];               // Symbols in canonical code order
+};
+
+// Canonical codes from code lengths (3.2.2); incomplete codes are allowed,
+// their unused codes fail when decoded
+bool BuildHuffman(const uint8_t* lengths, int n, Huffman& table) {
+    memset(table.fast, 0, sizeof table.fast);
+    memset(table.count, 0, sizeof table.count);
+    for (int i = 0; i < n; i++) {
+        table.count[lengths[i]]++;
+    }
+    table.count[0] = 0;
+    int left = 1;
+    for (int length = 1; length <= MAX_BITS; length++) {
+        left = (left << 1) - table.count[length];
+        if (left < 0) {
+            return false;   // Over-subscribed
+        }
+    }
+
+    uint16_t offset[MAX_BITS + 2];
+    offset[1] = 0;
+    for (int length = 1; length <= MAX_BITS; length++) {
+        offset[length + 1] = offset[length] + table.count[length];
+    }
+    for (int i = 0; i < n; i++) {
+        if (lengths[i]) table.symbol[offset[lengths[i]]++] = static_cast<uint16_t>(i);
+    }
+
+    // Codes are sent most significant bit first, but read from the low end
+    // of the bit buffer, so the table is indexed by the reversed code
+    int code = 0;
+    int k = 0;
+    for (int length = 1; length <= FAST_BITS; length++) {
+        for (int i = 0; i < table.count[length]; i++, k++, code++) {
+            int reversed = 0;
+            for (int b = 0; b < length; b++) reversed |= ((code >> b) & 1) << (length - 1 - b);
+            for (int j = reversed; j < (1 << FAST_BITS); j += 1 << length) {
+                table.fast[j] = static_cast<uint16_t>(table.symbol[k] << 4 | length);
+            }
+        }
+        code <<= 1;
+    }
+    return true;
+}
+
+// Little-endian bit buffer; reading past the end yields zero bits, which
+// Overrun() reports once they are consumed
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : data_(data), size_(size), pos_(0), acc_(0), bits_(0) {}
+
+    uint32_t Peek(int n) {
+        if (bits_ < n) Fill();
+        return static_cast<uint32_t>(acc_ & ((uint64_t(1) << n) - 1));
+    }
+
+    void Skip(int n) {
+        acc_ >>= n;
+        bits_ -= n;
+    }
+
+    uint32_t Bits(int n) {
+        uint32_t value = Peek(n);
+        Skip(n);
+        return value;
+    }
+
+    // Drop to a byte boundary and hand out the next whole bytes (stored blocks)
+    const uint8_t* Bytes(size_t n) {
+        Skip(bits_ & 7);
+        size_t start = pos_ - bits_ / 8;
+        acc_ = 0;
+        bits_ = 0;
+        if (start > size_ || n > size_ - start) {
+            pos_ = size_ + 1;
+            return nullptr;
+        }
+        pos_ = start + n;
+        return data_ + start;
+    }
+
+    bool Overrun() const {
+        return pos_ - bits_ / 8 > size_;
+    }
+
+private:
+    void Fill() {
+        while (bits_ <= 56) {
+            uint64_t byte = pos_ < size_ ? data_[pos_] : 0;
+            pos_++;
+            acc_ |= byte << bits_;
+            bits_ += 8;
+        }
+    }
+
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_;                // Bytes moved into acc_, including padding past the end
+    uint64_t acc_;
+    int bits_;
+};
+
+// Next symbol, -1 for a code the table does not have
+inline int DecodeSymbol(BitReader& bits, const Huffman& table) {
+    uint32_t look = bits.Peek(MAX_BITS);
+    uint16_t entry = table.fast[look & ((1 << FAST_BITS) - 1)];
+    if (entry) {
+        bits.Skip(entry & 15);
+        return entry >> 4;
+    }
+    // Longer codes, one bit at a time (puff.c)
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int length = 1; length <= MAX_BITS; length++) {
+        code |= (look >> (length - 1)) & 1;
+        int count = table.count[length];
+        if (code - first < count) {
+            bits.Skip(length);
+            return table.symbol[index + code - first];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+bool InflateBlock(BitReader& bits, const Huffman& lengths, const Huffman& distances,
+                  uint8_t* dst, size_t capacity, size_t& out) {
+    for (;;) {
+        int symbol = DecodeSymbol(bits, lengths);
+        if (symbol < 256) {
+            if (symbol < 0 || out >= capacity) {
+                return false;
+            }
+            dst[out++] = static_cast<uint8_t>(symbol);
+            continue;
+        }
+        if (symbol == 256) {
+            return !bits.Overrun();
+        }
+
+        symbol -= 257;
+        if (symbol >= 29) {
+            return false;
+        }
+        size_t length = LENGTH_BASE[symbol] + bits.Bits(LENGTH_EXTRA[symbol]);
+        int code = DecodeSymbol(bits, distances);
+        if (code < 0 || code >= 30) {
+            return false;
+        }
+        size_t distance = DISTANCE_BASE[code] + bits.Bits(DISTANCE_EXTRA[code]);
+        if (distance > out || length > capacity - out) {
+            return false;
+        }
+
+        uint8_t* to = dst + out;
+        const uint8_t* from = to - distance;
+        if (distance >= 8 && capacity - out >= length + 8) {
+            // Whole words; the last may write past `length`, into space the
+            // next symbols overwrite
+            for (size_t i = 0; i < length; i += 8) memcpy(to + i, from + i, 8);
+        } else {
+            for (size_t i = 0; i < length; i++) to[i] = from[i];
+        }
+        out += length;
+    }
+}
+
+bool InflateDynamic(BitReader& bits, Huffman& lengths, Huffman& distances) {
+    int nlen = static_cast<int>(bits.Bits(5)) + 257;
+    int ndist = static_cast<int>(bits.Bits(5)) + 1;
+    int ncode = static_cast<int>(bits.Bits(4)) + 4;
+    if (nlen > 286 || ndist > 30) {
+        return false;
+    }
+
+    uint8_t code_lengths[19] = {};
+    for (int i = 0; i < ncode; i++) {
+        code_lengths[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>(bits.Bits(3));
+    }
+    Huffman codes;
+    if (!BuildHuffman(code_lengths, 19, codes)) {
+        return false;
+    }
+
+    uint8_t all[286 + 30];
+    for (int i = 0; i < nlen + ndist;) {
+        int symbol = DecodeSymbol(bits, codes);
+        if (symbol < 0) {
+            return false;
+        }
+        if (symbol < 16) {
+            all[i++] = static_cast<uint8_t>(symbol);
+            continue;
+        }
+        uint8_t value = 0;
+        int repeat;
+        if (symbol == 16) {
+            if (i == 0) {
+                return false;
+            }
+            value = all[i - 1];
+            repeat = 3 + static_cast<int>(bits.Bits(2));
+        } else if (symbol == 17) {
+            repeat = 3 + static_cast<int>(bits.Bits(3));
+        } else {
+            repeat = 11 + static_cast<int>(bits.Bits(7));
+        }
+        if (i + repeat > nlen + ndist) {
+            return false;
+        }
+        while (repeat--) all[i++] = value;
+    }
+    if (!all[256]) {
+        return false;   // No end-of-block code
+    }
+    return BuildHuffman(all, nlen, lengths) && BuildHuffman(all + nlen, ndist, distances);
+}
+
+void BuildFixed(Huffman& lengths, Huffman& distances) {
+    uint8_t all[288];
+    int i = 0;
+    for (; i < 144; i++) all[i] = 8;
+    for (; i < 256; i++) all[i] = 9;
+    for (; i < 280; i++) all[i] = 7;
+    for (; i < 288; i++) all[i] = 8;
+    BuildHuffman(all, 288, lengths);
+    for (i = 0; i < 30; i++) all[i] = 5;
+    BuildHuffman(all, 30, distances);
+}
+
+uint32_t Adler32(const uint8_t* data, size_t size) {
+    uint32_t a = 1;
+    uint32_t b = 0;
+    while (size) {
+        // Largest run before b can overflow 32 bits
+        size_t run = size < 5552 ? size : 5552;
+        size -= run;
+        while (run--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return b << 16 | a;
+}
+
+} // namespace
+
+bool InflateZlib(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity, size_t& written) {
+    written = 0;
+    // CMF/FLG: deflate, window up to 32K, header check, no preset dictionary
+    if (size < 6 || (src[0] & 0x0F) != 8 || (src[0] >> 4) > 7 ||
+        ((src[0] << 8) | src[1]) % 31 || (src[1] & 0x20)) {
+        return false;
+    }
+
+    BitReader bits(src + 2, size - 2);
+    Huffman lengths;
+    Huffman distances;
+    size_t out = 0;
+    bool last = false;
+    while (!last) {
+        last = bits.Bits(1) != 0;
+        uint32_t type = bits.Bits(2);
+        if (type == 0) {
+            const uint8_t* header = bits.Bytes(4);
+            if (!header) {
+                return false;
+            }
+            size_t length = header[0] | header[1] << 8;
+            size_t check = header[2] | header[3] << 8;
+            if ((length ^ 0xFFFF) != check || length > capacity - out) {
+                return false;
+            }
+            const uint8_t* stored = bits.Bytes(length);
+            if (!stored) {
+                return false;
+            }
+            memcpy(dst + out, stored, length);
+            out += length;
+            continue;
+        }
+        if (type == 1) {
+            BuildFixed(lengths, distances);
+        } else if (type != 2 || !InflateDynamic(bits, lengths, distances)) {
+            return false;
+        }
+        if (!InflateBlock(bits, lengths, distances, dst, capacity, out)) {
+            return false;
+        }
+    }
+
+    const uint8_t* trailer = bits.Bytes(4);
+    if (!trailer) {
+        return false;
+    }
+    uint32_t adler = static_cast<uint32_t>(trailer[0]) << 24 | trailer[1] << 16 | trailer[2] << 8 | trailer[3];
+    if (adler != Adler32(dst, out)) {
+        return false;
+    }
+    written = out;
+    return true;
+}
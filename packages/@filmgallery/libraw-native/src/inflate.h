@@ -0,0 +1,25 @@
+/**
+ * @filmgallery/libraw-native - Inflate
+ *
+ * zlib-compatible decompression (RFC 1950 stream around RFC 1951 deflate
+ * data) for deflate-compressed DNG tiles, which LibRaw only reads when built
+ * with zlib. One-shot into a caller-sized buffer, like zlib's uncompress():
+ * stored, fixed and dynamic Huffman blocks, Adler-32 checked. Preset
+ * dictionaries are rejected.
+ */
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Inflate a zlib stream into dst
+ * @param written - Bytes produced
+ * @returns false for corrupt data, a checksum mismatch or output that does
+ *          not fit in `capacity` bytes
+ */
+bool InflateZlib(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity, size_t& written);
+
+#endif // INFLATE_H
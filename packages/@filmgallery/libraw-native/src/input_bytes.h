@@ -0,0 +1,57 @@
+/**
+ * @filmgallery/libraw-native - Loader Input Bytes
+ *
+ * A stretch of a LibRaw input as one block of memory: the mapped file, or a
+ * copy for inputs without a file name (buffers). The stand-in loaders
+ * (packed_raw.cpp, medium_format.cpp) read their rows from it on several
+ * threads instead of going through the datastream.
+ */
+
+#ifndef INPUT_BYTES_H
+#define INPUT_BYTES_H
+
+#include "libraw/libraw.h"
+#include "mapped_file.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class InputBytes {
+public:
+    /**
+     * Bytes [offset, offset + length) of `input`; copies get `slack` zero
+     * bytes past the end
+     * @returns false when the input is shorter; its position is then back at `offset`
+     */
+    bool Open(LibRaw_abstract_datastream* input, INT64 offset, size_t length, size_t slack) {
+        if (offset < 0 || input->size() < offset || uint64_t(input->size() - offset) < length) {
+            return false;
+        }
+        const char* name = input->fname();
+        if (name && map_.Open(name) && map_.Size() >= uint64_t(offset) + length) {
+            data_ = map_.Data() + offset;
+            available_ = map_.Size() - size_t(offset);
+            return true;
+        }
+        copy_.resize(length + slack);
+        input->seek(offset, SEEK_SET);
+        bool complete = size_t(input->read(copy_.data(), 1, length)) == length;
+        input->seek(offset, SEEK_SET);
+        data_ = copy_.data();
+        available_ = copy_.size();
+        return complete;
+    }
+
+    const uint8_t* Data() const { return data_; }
+
+    // Readable bytes from Data(), possibly past `length`
+    size_t Available() const { return available_; }
+
+private:
+    MappedFile map_;
+    std::vector<uint8_t> copy_;
+    const uint8_t* data_ = nullptr;
+    size_t available_ = 0;
+};
+
+#endif // INPUT_BYTES_H
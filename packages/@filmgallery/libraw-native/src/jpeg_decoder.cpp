@@ -0,0 +1,777 @@
+/**
+ * @filmgallery/libraw-native - JPEG Decoder
+ */
+
+#include "jpeg_decoder.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <new>
+
+namespace {
+
+// Natural (row-major) index of each zigzag position
+const uint8_t ZIGZAG[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Scale factors of the AAN IDCT (jidctflt.c), folded into the dequantization
+const double AAN_SCALE[8] = {
+    1.0, 1.387039845, 1.306562965, 1.175875602, 1.0, 0.785694958, 0.541196100, 0.275899379
+};
+
+// Code lengths resolved by one table lookup
+const int LOOKAHEAD = 9;
+
+// Output rows per colour conversion task
+const int MIN_CONVERT_ROWS = 32;
+
+struct HuffmanTable {
+    bool defined;
+    uint8_t fast_size[1 << LOOKAHEAD];      // Code length, 0 when longer than LOOKAHEAD
+    uint8_t fast_value[1 << LOOKAHEAD];
+    int16_t fast_ac[1 << LOOKAHEAD];        // AC code and value within LOOKAHEAD: value << 8 | run << 4 | bits
+    int32_t maxcode[17];                    // Largest code of each length, -1 if none
+    int32_t valoffset[17];                  // Index of a length's first value minus its first code
+    uint8_t values[256];
+};
+
+// Sign-extend an `s`-bit magnitude category value (F.2.2.1)
+inline int Extend(int value, int s) {
+    return value < (1 << (s - 1)) ? value - (1 << s) + 1 : value;
+}
+
+// Canonical codes from counts per length (Annex C)
+bool BuildHuffmanTable(const uint8_t counts[16], const uint8_t* values, int total, HuffmanTable& table) {
+    memset(&table, 0, sizeof table);
+    memcpy(table.values, values, total);
+    int32_t code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; length++) {
+        if (code + counts[length - 1] > (1 << length)) {
+            return false;   // Over-subscribed
+        }
+        table.valoffset[length] = k - code;
+        for (int i = 0; i < counts[length - 1]; i++, k++, code++) {
+            if (length <= LOOKAHEAD) {
+                int shift = LOOKAHEAD - length;
+                for (int j = 0; j < (1 << shift); j++) {
+                    int index = (code << shift) | j;
+                    if (index >= (1 << LOOKAHEAD)) {
+                        return false;
+                    }
+                    table.fast_size[index] = static_cast<uint8_t>(length);
+                    table.fast_value[index] = values[k];
+                }
+            }
+        }
+        table.maxcode[length] = counts[length - 1] ? code - 1 : -1;
+        code <<= 1;
+    }
+
+    for (int i = 0; i < (1 << LOOKAHEAD); i++) {
+        int length = table.fast_size[i];
+        int run = table.fast_value[i] >> 4;
+        int s = table.fast_value[i] & 15;
+        if (length && s && length + s <= LOOKAHEAD) {
+            int value = ((i << length) & ((1 << LOOKAHEAD) - 1)) >> (LOOKAHEAD - s);
+            value = Extend(value, s);
+            if (value >= -128 && value <= 127) {
+                table.fast_ac[i] = static_cast<int16_t>(value * 256 + run * 16 + length + s);
+            }
+        }
+    }
+    table.defined = true;
+    return true;
+}
+
+// Reads entropy-coded bytes, removing stuffed zeros; a marker or the end of
+// the data reads as zero bits
+class BitReader {
+public:
+    BitReader(const uint8_t* data, const uint8_t* end) : p_(data), end_(end), acc_(0), bits_(0) {}
+
+    uint32_t Peek(int n) {
+        if (bits_ < n) Fill();
+        return static_cast<uint32_t>(acc_ >> (64 - n));
+    }
+
+    void Skip(int n) {
+        acc_ <<= n;
+        bits_ -= n;
+    }
+
+    int Bits(int n) {
+        uint32_t value = Peek(n);
+        Skip(n);
+        return static_cast<int>(value);
+    }
+
+private:
+    void Fill() {
+        while (bits_ <= 56) {
+            uint32_t byte = 0;
+            if (p_ < end_) {
+                byte = *p_;
+                if (byte != 0xFF) {
+                    p_++;
+                } else if (p_ + 1 < end_ && p_[1] == 0x00) {
+                    p_ += 2;
+                } else {
+                    byte = 0;
+                    end_ = p_;
+                }
+            }
+            acc_ |= static_cast<uint64_t>(byte) << (56 - bits_);
+            bits_ += 8;
+        }
+    }
+
+    const uint8_t* p_;
+    const uint8_t* end_;
+    uint64_t acc_;
+    int bits_;
+};
+
+// Next Huffman symbol, -1 for a code the table does not have
+inline int DecodeSymbol(BitReader& bits, const HuffmanTable& table) {
+    uint32_t look = bits.Peek(LOOKAHEAD);
+    int size = table.fast_size[look];
+    if (size) {
+        bits.Skip(size);
+        return table.fast_value[look];
+    }
+    uint32_t code16 = bits.Peek(16);
+    for (int length = LOOKAHEAD + 1; length <= 16; length++) {
+        int32_t code = static_cast<int32_t>(code16 >> (16 - length));
+        if (code <= table.maxcode[length]) {
+            bits.Skip(length);
+            return table.values[(table.valoffset[length] + code) & 0xFF];
+        }
+    }
+    return -1;
+}
+
+struct Component {
+    int id;
+    int h, v;                   // Sampling factors
+    int tq;                     // Quantization table
+    int td, ta;                 // DC and AC Huffman tables
+    int block;                  // Samples per block side in the plane: 8 >> n
+    int rx, ry;                 // Output pixels per plane sample
+    int stride;                 // Plane samples per row
+    int rows;
+    std::vector<uint8_t> plane; // Decoded samples, padded to whole MCUs
+};
+
+struct Frame {
+    int sof;
+    int width, height;
+    int components;
+    Component comp[4];
+    int hmax, vmax;
+    int mcus_x, mcus_y;
+    int restart_interval;
+    int adobe_transform;        // -1 without an Adobe APP14 segment
+    uint16_t quant[4][64];      // Natural order
+    bool quant_defined[4];
+    HuffmanTable dc[4], ac[4];
+    const uint8_t* scan;        // Entropy-coded data of the first scan
+    const uint8_t* end;
+};
+
+bool IsSof(int marker) {
+    return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+// Markers up to the first scan (or only up to the frame header)
+bool ParseHeaders(const uint8_t* data, size_t size, Frame& frame, bool header_only) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    if (size < 4 || p[0] != 0xFF || p[1] != 0xD8) {
+        return false;
+    }
+    p += 2;
+    frame.sof = 0;
+    frame.restart_interval = 0;
+    frame.adobe_transform = -1;
+
+    for (;;) {
+        while (p < end && *p != 0xFF) p++;
+        while (p < end && *p == 0xFF) p++;
+        if (p >= end) {
+            return false;
+        }
+        int marker = *p++;
+        if (marker == 0x01 || marker == 0xD8 || (marker >= 0xD0 && marker <= 0xD7)) {
+            continue;
+        }
+        if (marker == 0xD9 || end - p < 2) {
+            return false;
+        }
+        size_t length = (static_cast<size_t>(p[0]) << 8) | p[1];
+        if (length < 2 || length > static_cast<size_t>(end - p)) {
+            return false;
+        }
+        const uint8_t* seg = p + 2;
+        size_t n = length - 2;
+        p += length;
+
+        if (IsSof(marker)) {
+            if (frame.sof || n < 6) return false;
+            frame.sof = marker;
+            frame.height = (seg[1] << 8) | seg[2];
+            frame.width = (seg[3] << 8) | seg[4];
+            frame.components = seg[5];
+            if (seg[0] != 8 || frame.width < 1 || frame.height < 1 ||
+                frame.components < 1 || frame.components > 4 || n < 6 + 3u * frame.components) {
+                return false;
+            }
+            frame.hmax = frame.vmax = 1;
+            for (int c = 0; c < frame.components; c++) {
+                Component& comp = frame.comp[c];
+                comp.id = seg[6 + c * 3];
+                comp.h = seg[7 + c * 3] >> 4;
+                comp.v = seg[7 + c * 3] & 15;
+                comp.tq = seg[8 + c * 3];
+                if (comp.h < 1 || comp.h > 4 || comp.v < 1 || comp.v > 4 || comp.tq > 3) {
+                    return false;
+                }
+                frame.hmax = std::max(frame.hmax, comp.h);
+                frame.vmax = std::max(frame.vmax, comp.v);
+            }
+            if (header_only) {
+                return true;
+            }
+        } else if (marker == 0xC4) {
+            while (n >= 17) {
+                int tc = seg[0] >> 4;
+                int th = seg[0] & 15;
+                int total = 0;
+                for (int i = 0; i < 16; i++) total += seg[1 + i];
+                if (tc > 1 || th > 3 || total > 256 || n < 17u + total ||
+                    !BuildHuffmanTable(seg + 1, seg + 17, total, tc ? frame.ac[th] : frame.dc[th])) {
+                    return false;
+                }
+                seg += 17 + total;
+                n -= 17 + total;
+            }
+        } else if (marker == 0xDB) {
+            while (n >= 1) {
+                int pq = seg[0] >> 4;
+                int tq = seg[0] & 15;
+                size_t bytes = pq ? 128 : 64;
+                if (pq > 1 || tq > 3 || n < 1 + bytes) {
+                    return false;
+                }
+                for (int k = 0; k < 64; k++) {
+                    frame.quant[tq][ZIGZAG[k]] = static_cast<uint16_t>(
+                        pq ? (seg[1 + k * 2] << 8) | seg[2 + k * 2] : seg[1 + k]);
+                }
+                frame.quant_defined[tq] = true;
+                seg += 1 + bytes;
+                n -= 1 + bytes;
+            }
+        } else if (marker == 0xDD) {
+            if (n < 2) return false;
+            frame.restart_interval = (seg[0] << 8) | seg[1];
+        } else if (marker == 0xEE) {
+            if (n >= 12 && memcmp(seg, "Adobe", 5) == 0) {
+                frame.adobe_transform = seg[11];
+            }
+        } else if (marker == 0xDA) {
+            // Baseline only: one interleaved scan with every component
+            if (!frame.sof || n < 1) return false;
+            int ns = seg[0];
+            if (ns != frame.components || n < 4 + 2u * ns) {
+                return false;
+            }
+            for (int i = 0; i < ns; i++) {
+                int id = seg[1 + i * 2];
+                int tables = seg[2 + i * 2];
+                int c = 0;
+                while (c < frame.components && frame.comp[c].id != id) c++;
+                if (c == frame.components || (tables >> 4) > 3 || (tables & 15) > 3) {
+                    return false;
+                }
+                frame.comp[c].td = tables >> 4;
+                frame.comp[c].ta = tables & 15;
+            }
+            const uint8_t* spectral = seg + 1 + ns * 2;
+            if (spectral[0] != 0 || spectral[1] != 63 || spectral[2] != 0) {
+                return false;
+            }
+            frame.scan = p;
+            frame.end = end;
+            return true;
+        }
+    }
+}
+
+/**
+ * 8x8 AAN inverse DCT (jidctflt.c) of dequantized coefficients, `factor`
+ * holding the AAN scales and the final 1/8. Pixels are level-shifted and
+ * carry the rounding half, unclamped.
+ */
+CPU_INLINE void IdctFloat(const int32_t* coef, const float* factor, float* pixels) {
+    float ws[64];
+    for (int col = 0; col < 8; col++) {
+        const int32_t* in = coef + col;
+        const float* f = factor + col;
+        float* w = ws + col;
+        if (!(in[8] | in[16] | in[24] | in[32] | in[40] | in[48] | in[56])) {
+            float dc = in[0] * f[0];
+            for (int row = 0; row < 8; row++) w[row * 8] = dc;
+            continue;
+        }
+        float tmp0 = in[0] * f[0];
+        float tmp1 = in[16] * f[16];
+        float tmp2 = in[32] * f[32];
+        float tmp3 = in[48] * f[48];
+        float tmp10 = tmp0 + tmp2;
+        float tmp11 = tmp0 - tmp2;
+        float tmp13 = tmp1 + tmp3;
+        float tmp12 = (tmp1 - tmp3) * 1.414213562f - tmp13;
+        tmp0 = tmp10 + tmp13;
+        tmp3 = tmp10 - tmp13;
+        tmp1 = tmp11 + tmp12;
+        tmp2 = tmp11 - tmp12;
+
+        float tmp4 = in[8] * f[8];
+        float tmp5 = in[24] * f[24];
+        float tmp6 = in[40] * f[40];
+        float tmp7 = in[56] * f[56];
+        float z13 = tmp6 + tmp5;
+        float z10 = tmp6 - tmp5;
+        float z11 = tmp4 + tmp7;
+        float z12 = tmp4 - tmp7;
+        tmp7 = z11 + z13;
+        tmp11 = (z11 - z13) * 1.414213562f;
+        float z5 = (z10 + z12) * 1.847759065f;
+        tmp10 = z5 - z12 * 1.082392200f;
+        tmp12 = z5 - z10 * 2.613125930f;
+        tmp6 = tmp12 - tmp7;
+        tmp5 = tmp11 - tmp6;
+        tmp4 = tmp10 - tmp5;
+
+        w[0] = tmp0 + tmp7;
+        w[56] = tmp0 - tmp7;
+        w[8] = tmp1 + tmp6;
+        w[48] = tmp1 - tmp6;
+        w[16] = tmp2 + tmp5;
+        w[40] = tmp2 - tmp5;
+        w[24] = tmp3 + tmp4;
+        w[32] = tmp3 - tmp4;
+    }
+
+    for (int row = 0; row < 8; row++) {
+        const float* w = ws + row * 8;
+        float* o = pixels + row * 8;
+        // Level shift and rounding ride on the DC term
+        float z5 = w[0] + 128.5f;
+        float tmp10 = z5 + w[4];
+        float tmp11 = z5 - w[4];
+        float tmp13 = w[2] + w[6];
+        float tmp12 = (w[2] - w[6]) * 1.414213562f - tmp13;
+        float tmp0 = tmp10 + tmp13;
+        float tmp3 = tmp10 - tmp13;
+        float tmp1 = tmp11 + tmp12;
+        float tmp2 = tmp11 - tmp12;
+
+        float z13 = w[5] + w[3];
+        float z10 = w[5] - w[3];
+        float z11 = w[1] + w[7];
+        float z12 = w[1] - w[7];
+        float tmp7 = z11 + z13;
+        tmp11 = (z11 - z13) * 1.414213562f;
+        z5 = (z10 + z12) * 1.847759065f;
+        tmp10 = z5 - z12 * 1.082392200f;
+        tmp12 = z5 - z10 * 2.613125930f;
+        float tmp6 = tmp12 - tmp7;
+        float tmp5 = tmp11 - tmp6;
+        float tmp4 = tmp10 - tmp5;
+
+        o[0] = tmp0 + tmp7;
+        o[7] = tmp0 - tmp7;
+        o[1] = tmp1 + tmp6;
+        o[6] = tmp1 - tmp6;
+        o[2] = tmp2 + tmp5;
+        o[5] = tmp2 - tmp5;
+        o[3] = tmp3 + tmp4;
+        o[4] = tmp3 - tmp4;
+    }
+}
+
+CPU_INLINE uint8_t ClampPixel(float value) {
+    return static_cast<uint8_t>(std::min(std::max(value, 0.f), 255.f));
+}
+
+CPU_INLINE void Idct8Body(const int32_t* coef, const float* factor, uint8_t* out, size_t stride) {
+    float pixels[64];
+    IdctFloat(coef, factor, pixels);
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) out[y * stride + x] = ClampPixel(pixels[y * 8 + x]);
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, Idct8, Idct8Body,
+                    (const int32_t* coef, const float* factor, uint8_t* out, size_t stride),
+                    (coef, factor, out, stride))
+
+// size x size outputs (4 or 2), each the mean of the pixels it covers,
+// taken before clamping
+CPU_INLINE void IdctBoxBody(const int32_t* coef, const float* factor, int size, uint8_t* out, size_t stride) {
+    float pixels[64];
+    IdctFloat(coef, factor, pixels);
+    const int span = 8 / size;
+    const float norm = 1.f / (span * span);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            float sum = 0;
+            for (int dy = 0; dy < span; dy++) {
+                for (int dx = 0; dx < span; dx++) sum += pixels[(y * span + dy) * 8 + x * span + dx];
+            }
+            out[y * stride + x] = ClampPixel(sum * norm);
+        }
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, IdctBox, IdctBoxBody,
+                    (const int32_t* coef, const float* factor, int size, uint8_t* out, size_t stride),
+                    (coef, factor, size, out, stride))
+
+// YCbCr to RGB with libjpeg's 16-bit fixed-point coefficients (jdcolor.c)
+CPU_INLINE void YccRowBody(const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        int luma = y[i];
+        int b = cb[i] - 128;
+        int r = cr[i] - 128;
+        int red = luma + ((91881 * r + 32768) >> 16);
+        int green = luma + ((-22554 * b - 46802 * r + 32768) >> 16);
+        int blue = luma + ((116130 * b + 32768) >> 16);
+        out[i * 3] = static_cast<uint8_t>(std::min(std::max(red, 0), 255));
+        out[i * 3 + 1] = static_cast<uint8_t>(std::min(std::max(green, 0), 255));
+        out[i * 3 + 2] = static_cast<uint8_t>(std::min(std::max(blue, 0), 255));
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, YccRow, YccRowBody,
+                    (const uint8_t* y, const uint8_t* cb, const uint8_t* cr, uint8_t* out, size_t n),
+                    (y, cb, cr, out, n))
+
+struct Decoder {
+    Frame& frame;
+    float factor[64];           // IdctFloat() scales: AAN factors and the final 1/8
+
+    // Dequantized coefficients of one block into `coef` (natural order,
+    // zero on entry); returns the last zigzag index written, -1 for a bad
+    // code
+    int DecodeBlock(BitReader& bits, const Component& comp, int& pred, int32_t* coef) const {
+        const uint16_t* quant = frame.quant[comp.tq];
+        int s = DecodeSymbol(bits, frame.dc[comp.td]);
+        if (s < 0 || s > 11) return -1;
+        if (s) pred += Extend(bits.Bits(s), s);
+        coef[0] = pred * quant[0];
+
+        const HuffmanTable& ac = frame.ac[comp.ta];
+        int last = 0;
+        for (int k = 1; k < 64; k++) {
+            int fast = ac.fast_ac[bits.Peek(LOOKAHEAD)];
+            if (fast) {
+                k += (fast >> 4) & 15;
+                bits.Skip(fast & 15);
+                if (k > 63) return -1;
+                if (comp.block > 1) {
+                    coef[ZIGZAG[k]] = (fast >> 8) * quant[ZIGZAG[k]];
+                    last = k;
+                }
+                continue;
+            }
+            int rs = DecodeSymbol(bits, ac);
+            if (rs < 0) return -1;
+            int r = rs >> 4;
+            s = rs & 15;
+            if (!s) {
+                if (r != 15) break;     // End of block
+                k += 15;
+                continue;
+            }
+            k += r;
+            if (k > 63 || s > 10) return -1;
+            int value = Extend(bits.Bits(s), s);
+            if (comp.block > 1) {
+                coef[ZIGZAG[k]] = value * quant[ZIGZAG[k]];
+                last = k;
+            }
+        }
+        return last;
+    }
+
+    void StoreBlock(const Component& comp, const int32_t* coef, int last, uint8_t* out) const {
+        size_t stride = static_cast<size_t>(comp.stride);
+        int block = comp.block;
+        if (last == 0) {
+            // DC only: a flat block (also every block at 1/8)
+            uint8_t flat = ClampPixel(coef[0] * 0.125f + 128.5f);
+            for (int y = 0; y < block; y++) memset(out + y * stride, flat, block);
+        } else if (block == 8) {
+            Idct8(coef, factor, out, stride);
+        } else {
+            IdctBox(coef, factor, block, out, stride);
+        }
+    }
+
+    // MCUs [first, last) of one restart interval
+    bool DecodeSegment(const uint8_t* data, const uint8_t* end, int first, int last) const {
+        BitReader bits(data, end);
+        int pred[4] = { 0, 0, 0, 0 };
+        int32_t coef[64] = {};
+        for (int mcu = first; mcu < last; mcu++) {
+            int mx = mcu % frame.mcus_x;
+            int my = mcu / frame.mcus_x;
+            for (int c = 0; c < frame.components; c++) {
+                Component& comp = frame.comp[c];
+                for (int by = 0; by < comp.v; by++) {
+                    for (int bx = 0; bx < comp.h; bx++) {
+                        int k = DecodeBlock(bits, comp, pred[c], coef);
+                        if (k < 0) return false;
+                        size_t y = static_cast<size_t>(my * comp.v + by) * comp.block;
+                        size_t x = static_cast<size_t>(mx * comp.h + bx) * comp.block;
+                        StoreBlock(comp, coef, k, comp.plane.data() + y * comp.stride + x);
+                        for (int i = 0; i <= k; i++) coef[ZIGZAG[i]] = 0;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+};
+
+// libjpeg's "fancy" 2:1 upsampling: each output sample is 3/4 of the nearest
+// input sample and 1/4 of the next nearest; edge samples are copied
+void UpsampleH2V1(const uint8_t* src, int n, uint8_t* dst) {
+    if (n == 1) {
+        dst[0] = dst[1] = src[0];
+        return;
+    }
+    dst[0] = src[0];
+    dst[1] = static_cast<uint8_t>((src[0] * 3 + src[1] + 2) >> 2);
+    for (int i = 1; i < n - 1; i++) {
+        int near = src[i] * 3;
+        dst[2 * i] = static_cast<uint8_t>((near + src[i - 1] + 1) >> 2);
+        dst[2 * i + 1] = static_cast<uint8_t>((near + src[i + 1] + 2) >> 2);
+    }
+    dst[2 * n - 2] = static_cast<uint8_t>((src[n - 1] * 3 + src[n - 2] + 1) >> 2);
+    dst[2 * n - 1] = src[n - 1];
+}
+
+// The same weights vertically (nearest row 3/4, other row 1/4), then across
+void UpsampleH2V2(const uint8_t* near, const uint8_t* far, int n, int* sum, uint8_t* dst) {
+    for (int i = 0; i < n; i++) sum[i] = near[i] * 3 + far[i];
+    if (n == 1) {
+        dst[0] = static_cast<uint8_t>((sum[0] * 4 + 8) >> 4);
+        dst[1] = static_cast<uint8_t>((sum[0] * 4 + 7) >> 4);
+        return;
+    }
+    dst[0] = static_cast<uint8_t>((sum[0] * 4 + 8) >> 4);
+    dst[1] = static_cast<uint8_t>((sum[0] * 3 + sum[1] + 7) >> 4);
+    for (int i = 1; i < n - 1; i++) {
+        int center = sum[i] * 3;
+        dst[2 * i] = static_cast<uint8_t>((center + sum[i - 1] + 8) >> 4);
+        dst[2 * i + 1] = static_cast<uint8_t>((center + sum[i + 1] + 7) >> 4);
+    }
+    dst[2 * n - 2] = static_cast<uint8_t>((sum[n - 1] * 3 + sum[n - 2] + 8) >> 4);
+    dst[2 * n - 1] = static_cast<uint8_t>((sum[n - 1] * 4 + 7) >> 4);
+}
+
+// Output rows [first, last): upsample and convert the planes
+void ConvertRows(const Frame& frame, bool rgb, JpegImage& image, int first, int last) {
+    const size_t width = static_cast<size_t>(image.width);
+    // One spare sample per row: 2:1 upsampling writes an even count
+    const size_t row_size = width + 1;
+    std::vector<uint8_t> upsampled(frame.components * row_size);
+    std::vector<int> sum(row_size);
+    for (int y = first; y < last; y++) {
+        const uint8_t* rows[3];
+        for (int c = 0; c < frame.components; c++) {
+            const Component& comp = frame.comp[c];
+            const int rx = comp.rx;
+            const int row = y / comp.ry;
+            const uint8_t* src = comp.plane.data() + static_cast<size_t>(row) * comp.stride;
+            if (rx == 1) {
+                rows[c] = src;
+                continue;
+            }
+            uint8_t* dst = upsampled.data() + c * row_size;
+            // Interpolating single-pixel blocks would only blur (libjpeg
+            // replicates them too)
+            const bool fancy = rx == 2 && comp.block > 1;
+            const int samples = (image.width + 1) / 2;
+            if (fancy && comp.ry == 1) {
+                UpsampleH2V1(src, samples, dst);
+            } else if (fancy && comp.ry == 2) {
+                // The other row is above for even output rows, below for odd
+                // ones, clamped to the component's real rows
+                const int rows_in = (image.height + 1) / 2;
+                const int other = (y & 1) ? std::min(row + 1, rows_in - 1) : std::max(row - 1, 0);
+                UpsampleH2V2(src, comp.plane.data() + static_cast<size_t>(other) * comp.stride,
+                             samples, sum.data(), dst);
+            } else {
+                for (size_t x = 0; x < width; x++) dst[x] = src[x / rx];
+            }
+            rows[c] = dst;
+        }
+
+        uint8_t* out = image.data.data() + static_cast<size_t>(y) * width * image.channels;
+        if (frame.components == 1) {
+            memcpy(out, rows[0], width);
+        } else if (rgb) {
+            for (size_t x = 0; x < width; x++) {
+                out[x * 3] = rows[0][x];
+                out[x * 3 + 1] = rows[1][x];
+                out[x * 3 + 2] = rows[2][x];
+            }
+        } else {
+            YccRow(rows[0], rows[1], rows[2], out, width);
+        }
+    }
+}
+
+} // namespace
+
+bool ReadJpegHeader(const uint8_t* data, size_t size, JpegHeader& header) {
+    std::unique_ptr<Frame> frame(new Frame());
+    if (!ParseHeaders(data, size, *frame, true)) {
+        return false;
+    }
+    header.width = frame->width;
+    header.height = frame->height;
+    header.components = frame->components;
+    header.progressive = frame->sof == 0xC2 || frame->sof == 0xC6 ||
+                         frame->sof == 0xCA || frame->sof == 0xCE;
+    return true;
+}
+
+bool DecodeJpeg(const uint8_t* data, size_t size, const JpegDecodeOptions& options, JpegImage& image) {
+    int scale = options.scale;
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+        return false;
+    }
+
+    try {
+        std::unique_ptr<Frame> owner(new Frame());
+        Frame& frame = *owner;
+        if (!ParseHeaders(data, size, frame, false) ||
+            (frame.sof != 0xC0 && frame.sof != 0xC1) ||
+            (frame.components != 1 && frame.components != 3)) {
+            return false;
+        }
+        if (frame.components == 1) {
+            // A single component is never interleaved: one block per MCU
+            frame.comp[0].h = frame.comp[0].v = frame.hmax = frame.vmax = 1;
+        }
+        for (int c = 0; c < frame.components; c++) {
+            const Component& comp = frame.comp[c];
+            if (frame.hmax % comp.h || frame.vmax % comp.v || !frame.quant_defined[comp.tq] ||
+                !frame.dc[comp.td].defined || !frame.ac[comp.ta].defined) {
+                return false;
+            }
+        }
+
+        Decoder decoder = { frame, {} };
+        for (int i = 0; i < 64; i++) {
+            decoder.factor[i] = static_cast<float>(AAN_SCALE[i >> 3] * AAN_SCALE[i & 7] / 8);
+        }
+
+        frame.mcus_x = (frame.width + 8 * frame.hmax - 1) / (8 * frame.hmax);
+        frame.mcus_y = (frame.height + 8 * frame.vmax - 1) / (8 * frame.vmax);
+        for (int c = 0; c < frame.components; c++) {
+            Component& comp = frame.comp[c];
+            // Subsampled components keep more of their resolution when
+            // scaling down, so they need less upsampling (as libjpeg does)
+            comp.block = 8 / scale;
+            comp.rx = frame.hmax / comp.h;
+            comp.ry = frame.vmax / comp.v;
+            while (comp.block < 8 && comp.rx % 2 == 0 && comp.ry % 2 == 0) {
+                comp.block *= 2;
+                comp.rx /= 2;
+                comp.ry /= 2;
+            }
+            comp.stride = frame.mcus_x * comp.h * comp.block;
+            comp.rows = frame.mcus_y * comp.v * comp.block;
+            comp.plane.assign(static_cast<size_t>(comp.stride) * comp.rows, 0);
+        }
+
+        // Entropy-coded segments, split at restart markers
+        std::vector<const uint8_t*> starts(1, frame.scan);
+        const uint8_t* p = frame.scan;
+        const uint8_t* scan_end = frame.end;
+        while (p + 1 < frame.end) {
+            const uint8_t* marker = static_cast<const uint8_t*>(memchr(p, 0xFF, frame.end - p - 1));
+            if (!marker) {
+                break;
+            }
+            uint8_t next = marker[1];
+            if (next == 0x00 || next == 0xFF) {
+                p = marker + (next ? 1 : 2);
+            } else if (next >= 0xD0 && next <= 0xD7) {
+                p = marker + 2;
+                starts.push_back(p);
+            } else {
+                scan_end = marker;
+                break;
+            }
+        }
+
+        const int mcus = frame.mcus_x * frame.mcus_y;
+        const int interval = frame.restart_interval ? frame.restart_interval : mcus;
+        const int segments = (mcus + interval - 1) / interval;
+        if (frame.restart_interval && static_cast<int>(starts.size()) < segments) {
+            return false;
+        }
+        starts.resize(segments);
+        starts.push_back(scan_end);
+
+        std::atomic<bool> ok(true);
+        auto decode = [&](int first, int last) {
+            for (int i = first; i < last && ok; i++) {
+                if (!decoder.DecodeSegment(starts[i], starts[i + 1], i * interval,
+                                           std::min(mcus, (i + 1) * interval))) {
+                    ok = false;
+                }
+            }
+        };
+        if (options.threaded) {
+            ParallelRows(segments, 1, decode);
+        } else {
+            decode(0, segments);
+        }
+        if (!ok) {
+            return false;
+        }
+
+        image.width = (frame.width + scale - 1) / scale;
+        image.height = (frame.height + scale - 1) / scale;
+        image.channels = frame.components;
+        image.data.resize(static_cast<size_t>(image.width) * image.height * image.channels);
+        const bool rgb = frame.components == 3 &&
+            (frame.adobe_transform == 0 ||
+             (frame.adobe_transform < 0 && frame.comp[0].id == 'R' &&
+              frame.comp[1].id == 'G' && frame.comp[2].id == 'B'));
+        auto convert = [&](int first, int last) { ConvertRows(frame, rgb, image, first, last); };
+        if (options.threaded) {
+            ParallelRows(image.height, MIN_CONVERT_ROWS, convert);
+        } else {
+            convert(0, image.height);
+        }
+        return true;
+    } catch (const std::bad_alloc&) {
+        return false;
+    }
+}
@@ -0,0 +1,59 @@
+/**
+ * @filmgallery/libraw-native - JPEG Decoder
+ *
+ * Baseline (sequential, Huffman) decoder for embedded previews and lossy DNG
+ * tiles, which LibRaw cannot decode when built without libjpeg. 8-bit
+ * grayscale or three-component images (YCbCr, or RGB when the Adobe APP14
+ * transform or the component IDs say so), sampling factors up to 4 that
+ * divide the largest one. Progressive and arithmetic-coded files are
+ * rejected.
+ *
+ * Scaled decoding happens per block, like libjpeg's scale_denom: at 1/2 and
+ * 1/4 each block's inverse transform is averaged down to 4x4 or 2x2 before
+ * rounding, and at 1/8 its DC coefficient is the pixel, so no IDCT runs and
+ * no AC coefficients are stored. Subsampled chroma is decoded to proportionally
+ * larger blocks; what remains 2:1 is interpolated like libjpeg's "fancy"
+ * upsampling, other ratios are replicated.
+ *
+ * Restart intervals are entropy-decoded on separate threads.
+ */
+
+#ifndef JPEG_DECODER_H
+#define JPEG_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct JpegHeader {
+    int width;
+    int height;
+    int components;             // 1 or 3 (4 for CMYK, which DecodeJpeg() rejects)
+    bool progressive;
+};
+
+struct JpegDecodeOptions {
+    int scale = 1;              // 1, 2, 4 or 8: output is ceil(size / scale)
+    bool threaded = true;       // Split restart intervals across threads
+};
+
+struct JpegImage {
+    int width = 0;
+    int height = 0;
+    int channels = 0;           // 1 (grayscale) or 3 (RGB)
+    std::vector<uint8_t> data;  // Interleaved 8-bit rows, width * channels bytes apart
+};
+
+/**
+ * Read the frame header without decoding
+ * @returns false if no SOF marker is found before the first scan
+ */
+bool ReadJpegHeader(const uint8_t* data, size_t size, JpegHeader& header);
+
+/**
+ * Decode a JPEG, optionally scaled down
+ * @returns false for unsupported or corrupt data
+ */
+bool DecodeJpeg(const uint8_t* data, size_t size, const JpegDecodeOptions& options, JpegImage& image);
+
+#endif // JPEG_DECODER_H
@@ -0,0 +1,612 @@
+/**
+ * @filmgallery/libraw-native - JPEG Encoder
+ */
+
+#include "jpeg_encoder.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Natural (row-major) index of each zigzag position
+const uint8_t ZIGZAG[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Annex K.1 quantization tables, natural order
+const uint8_t LUMA_QUANT[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61,
+    12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56,
+    14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77,
+    24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103, 99
+};
+
+const uint8_t CHROMA_QUANT[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99
+};
+
+// Annex K.3 Huffman tables: code counts per length 1..16, then symbols
+const uint8_t DC_LUMA_BITS[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const uint8_t DC_CHROMA_BITS[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+const uint8_t DC_VALUES[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+const uint8_t AC_LUMA_BITS[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+const uint8_t AC_LUMA_VALUES[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+const uint8_t AC_CHROMA_BITS[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+const uint8_t AC_CHROMA_VALUES[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+// Scale factors of the AAN DCT (jfdctflt.c), folded into the divisors
+const double AAN_SCALE[8] = {
+    1.0, 1.387039845, 1.306562965, 1.175875602, 1.0, 0.785694958, 0.541196100, 0.275899379
+};
+
+// Bands of fewer MCU rows are not worth a thread and a restart marker
+const int MIN_BAND_MCU_ROWS = 4;
+
+// ICC_PROFILE payload per APP2 segment
+const size_t ICC_CHUNK = 65519;
+
+struct HuffmanTable {
+    uint16_t code[256];
+    uint8_t size[256];
+};
+
+// Canonical codes from counts per length (Annex C)
+HuffmanTable BuildHuffmanTable(const uint8_t bits[16], const uint8_t* values) {
+    HuffmanTable table = {};
+    uint32_t code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; length++) {
+        for (int i = 0; i < bits[length - 1]; i++, k++) {
+            table.code[values[k]] = static_cast<uint16_t>(code++);
+            table.size[values[k]] = static_cast<uint8_t>(length);
+        }
+        code <<= 1;
+    }
+    return table;
+}
+
+struct ComponentTables {
+    float divisors[64];         // 1 / (quant * AAN scale * 8), transposed layout
+    const HuffmanTable* dc;
+    const HuffmanTable* ac;
+};
+
+struct Encoder {
+    int width;
+    int height;
+    int channels;               // Source samples per pixel
+    int components;             // 1 or 3
+    bool subsample;             // 4:2:0
+    int mcu_size;               // 8 or 16 pixels square
+    int mcus_x;
+    int mcu_rows;
+    uint8_t quant[2][64];       // Natural order, luma and chroma
+    HuffmanTable dc_luma, ac_luma, dc_chroma, ac_chroma;
+    ComponentTables luma;
+    ComponentTables chroma;
+};
+
+// Writes from the start of `out`, growing it as needed; trimmed to the
+// coded size when done
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out_(out), size_(0), acc_(0), bits_(0) {}
+
+    ~BitWriter() { out_.resize(size_); }
+
+    // Room for one block: 64 codes of at most 27 bits, every byte stuffed
+    void Reserve() {
+        if (out_.size() < size_ + 512) out_.resize(std::max<size_t>(2 * out_.size(), size_ + 4096));
+    }
+
+    // Append the low `size` bits of `value` (size 1..32), stuffing 0xFF
+    // bytes; whole bytes are written once 32 bits are pending
+    void Put(uint32_t value, int size) {
+        acc_ = (acc_ << size) | value;
+        bits_ += size;
+        if (bits_ >= 32) {
+            bits_ -= 32;
+            const uint32_t word = static_cast<uint32_t>(acc_ >> bits_);
+            uint8_t* dst = out_.data() + size_;
+            const uint32_t inverse = ~word;
+            if (((inverse - 0x01010101u) & ~inverse & 0x80808080u) == 0) {
+                dst[0] = static_cast<uint8_t>(word >> 24);
+                dst[1] = static_cast<uint8_t>(word >> 16);
+                dst[2] = static_cast<uint8_t>(word >> 8);
+                dst[3] = static_cast<uint8_t>(word);
+                size_ += 4;
+            } else {
+                for (int shift = 24; shift >= 0; shift -= 8) {
+                    const uint8_t byte = static_cast<uint8_t>(word >> shift);
+                    out_[size_++] = byte;
+                    if (byte == 0xFF) out_[size_++] = 0;
+                }
+            }
+        }
+    }
+
+    // Write out the pending bits, padding the last byte with 1 bits
+    void Flush() {
+        if (bits_ % 8) Put((1u << (8 - bits_ % 8)) - 1, 8 - bits_ % 8);
+        while (bits_ >= 8) {
+            bits_ -= 8;
+            const uint8_t byte = static_cast<uint8_t>(acc_ >> bits_);
+            out_[size_++] = byte;
+            if (byte == 0xFF) out_[size_++] = 0;
+        }
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+    size_t size_;
+    uint64_t acc_;
+    int bits_;
+};
+
+// RGB -> level-shifted YCbCr (JFIF), one row into planes
+template <int CH>
+CPU_INLINE void ColorRowBody(const uint8_t* src, int width, float* y, float* cb, float* cr) {
+    for (int x = 0; x < width; x++) {
+        const float r = src[x * CH];
+        const float g = src[x * CH + 1];
+        const float b = src[x * CH + 2];
+        y[x] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+        cb[x] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+        cr[x] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+    }
+}
+
+// One AAN pass (jfdctflt.c) down all 8 columns of a row-major block
+CPU_INLINE void DctColumns(float* d) {
+    for (int i = 0; i < 8; i++) {
+        const float tmp0 = d[i] + d[56 + i];
+        const float tmp7 = d[i] - d[56 + i];
+        const float tmp1 = d[8 + i] + d[48 + i];
+        const float tmp6 = d[8 + i] - d[48 + i];
+        const float tmp2 = d[16 + i] + d[40 + i];
+        const float tmp5 = d[16 + i] - d[40 + i];
+        const float tmp3 = d[24 + i] + d[32 + i];
+        const float tmp4 = d[24 + i] - d[32 + i];
+
+        // Even part
+        float tmp10 = tmp0 + tmp3;
+        const float tmp13 = tmp0 - tmp3;
+        float tmp11 = tmp1 + tmp2;
+        float tmp12 = tmp1 - tmp2;
+        d[i] = tmp10 + tmp11;
+        d[32 + i] = tmp10 - tmp11;
+        const float z1 = (tmp12 + tmp13) * 0.707106781f;
+        d[16 + i] = tmp13 + z1;
+        d[48 + i] = tmp13 - z1;
+
+        // Odd part
+        tmp10 = tmp4 + tmp5;
+        tmp11 = tmp5 + tmp6;
+        tmp12 = tmp6 + tmp7;
+        const float z5 = (tmp10 - tmp12) * 0.382683433f;
+        const float z2 = 0.541196100f * tmp10 + z5;
+        const float z4 = 1.306562965f * tmp12 + z5;
+        const float z3 = tmp11 * 0.707106781f;
+        const float z11 = tmp7 + z3;
+        const float z13 = tmp7 - z3;
+        d[40 + i] = z13 + z2;
+        d[24 + i] = z13 - z2;
+        d[8 + i] = z11 + z4;
+        d[56 + i] = z11 - z4;
+    }
+}
+
+// Zigzag position -> index in ForwardDct()'s transposed layout
+struct TransposedZigzag {
+    uint8_t index[64];
+    TransposedZigzag() {
+        for (int k = 0; k < 64; k++) index[k] = static_cast<uint8_t>((ZIGZAG[k] % 8) * 8 + ZIGZAG[k] / 8);
+    }
+};
+const TransposedZigzag ORDER;
+
+// Columns, transpose, columns: coefficient (v, u) ends up at u * 8 + v, so
+// the divisors are transposed and the zigzag walk goes through ORDER.
+// `coef` receives the quantized coefficients in zigzag order.
+// @returns bit k set for each nonzero AC coefficient k
+CPU_INLINE uint64_t ForwardDctBody(float* block, const float* divisors, const uint8_t* order, int16_t* coef) {
+    DctColumns(block);
+    for (int r = 0; r < 8; r++) {
+        for (int c = r + 1; c < 8; c++) std::swap(block[r * 8 + c], block[c * 8 + r]);
+    }
+    DctColumns(block);
+
+    int16_t quantized[64];
+    for (int i = 0; i < 64; i++) {
+        // Round to nearest like jcdctmgr.c; AC codes are limited to 10 bits
+        int q = static_cast<int>(block[i] * divisors[i] + 16384.5f) - 16384;
+        quantized[i] = static_cast<int16_t>(std::min(1023, std::max(-1023, q)));
+    }
+    coef[0] = static_cast<int16_t>(std::max(-1024, static_cast<int>(block[0] * divisors[0] + 16384.5f) - 16384));
+
+    uint64_t nonzero = 0;
+    for (int k = 1; k < 64; k++) {
+        coef[k] = quantized[order[k]];
+        nonzero |= static_cast<uint64_t>(coef[k] != 0) << k;
+    }
+    return nonzero;
+}
+
+CPU_DISPATCH_KERNEL(void, ColorRow3, ColorRowBody<3>,
+                    (const uint8_t* src, int width, float* y, float* cb, float* cr), (src, width, y, cb, cr))
+CPU_DISPATCH_KERNEL(void, ColorRow4, ColorRowBody<4>,
+                    (const uint8_t* src, int width, float* y, float* cb, float* cr), (src, width, y, cb, cr))
+CPU_DISPATCH_KERNEL(uint64_t, ForwardDct, ForwardDctBody,
+                    (float* block, const float* divisors, const uint8_t* order, int16_t* coef),
+                    (block, divisors, order, coef))
+
+// Bits of each magnitude a coefficient or DC difference can have (< 2048)
+struct BitLengths {
+    uint8_t bits[2048];
+    BitLengths() {
+        bits[0] = 0;
+        for (int i = 1; i < 2048; i++) bits[i] = static_cast<uint8_t>(bits[i / 2] + 1);
+    }
+};
+const BitLengths BIT_LENGTHS;
+
+// Huffman code for (run, size) followed by the value's low bits
+inline void PutCoefficient(BitWriter& writer, const HuffmanTable& table, int run, int value) {
+    const int size = BIT_LENGTHS.bits[value < 0 ? -value : value];
+    const int symbol = (run << 4) | size;
+    const uint32_t bits = static_cast<uint32_t>(value < 0 ? value - 1 : value) & ((1u << size) - 1);
+    writer.Put((static_cast<uint32_t>(table.code[symbol]) << size) | bits, table.size[symbol] + size);
+}
+
+inline int TrailingZeros(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+// Zigzag-ordered coefficients; `nonzero` marks the AC ones to code
+void EncodeBlock(BitWriter& writer, const int16_t* coef, uint64_t nonzero, int& dc,
+                 const ComponentTables& tables) {
+    PutCoefficient(writer, *tables.dc, 0, coef[0] - dc);
+    dc = coef[0];
+
+    int last = 0;
+    for (; nonzero; nonzero &= nonzero - 1) {
+        const int k = TrailingZeros(nonzero);
+        int run = k - last - 1;
+        for (; run > 15; run -= 16) {
+            writer.Put(tables.ac->code[0xF0], tables.ac->size[0xF0]);
+        }
+        PutCoefficient(writer, *tables.ac, run, coef[k]);
+        last = k;
+    }
+    if (last < 63) {
+        writer.Put(tables.ac->code[0x00], tables.ac->size[0x00]);
+    }
+}
+
+void TransformBlock(BitWriter& writer, const float* plane, size_t stride, int x, int& dc,
+                    const ComponentTables& tables) {
+    float block[64];
+    int16_t coef[64];
+    for (int r = 0; r < 8; r++) {
+        std::memcpy(block + r * 8, plane + r * stride + x, 8 * sizeof(float));
+    }
+    const uint64_t nonzero = ForwardDct(block, tables.divisors, ORDER.index, coef);
+    writer.Reserve();
+    EncodeBlock(writer, coef, nonzero, dc, tables);
+}
+
+// Entropy-code MCU rows [first, last) into `out`, ending on a byte boundary
+bool EncodeBand(const Encoder& enc, const JpegRowSource& source, int first, int last,
+                std::vector<uint8_t>& out) {
+    const size_t stride = static_cast<size_t>(enc.width) * enc.channels;
+    const int padded = enc.mcus_x * enc.mcu_size;
+    const size_t plane_size = static_cast<size_t>(padded) * enc.mcu_size;
+    std::vector<uint8_t> pixels(stride * enc.mcu_size);
+    std::vector<float> planes(plane_size * enc.components);
+    float* y = planes.data();
+    float* cb = y + plane_size;
+    float* cr = cb + plane_size;
+
+    // Initial guess of the coded size: 1 bit per sample
+    out.resize(static_cast<size_t>(last - first) * enc.mcu_size * stride / 8);
+    BitWriter writer(out);
+    int dc[3] = { 0, 0, 0 };
+
+    for (int mcu_row = first; mcu_row < last; mcu_row++) {
+        const int top = mcu_row * enc.mcu_size;
+        const int rows = std::min(enc.mcu_size, enc.height - top);
+        if (!source(pixels.data(), stride, top, rows)) {
+            return false;
+        }
+
+        // Rows and columns past the edge repeat the last ones
+        for (int r = 0; r < enc.mcu_size; r++) {
+            const uint8_t* line = pixels.data() + std::min(r, rows - 1) * stride;
+            const size_t offset = static_cast<size_t>(r) * padded;
+            if (enc.components == 1) {
+                for (int x = 0; x < enc.width; x++) y[offset + x] = line[x * enc.channels] - 128.0f;
+            } else if (enc.channels == 4) {
+                ColorRow4(line, enc.width, y + offset, cb + offset, cr + offset);
+            } else {
+                ColorRow3(line, enc.width, y + offset, cb + offset, cr + offset);
+            }
+            for (int c = 0; c < enc.components; c++) {
+                float* plane = planes.data() + c * plane_size + offset;
+                std::fill(plane + enc.width, plane + padded, plane[enc.width - 1]);
+            }
+        }
+
+        if (enc.subsample) {
+            // 2x2 box into the first 8 rows of each chroma plane, in place
+            const int half = padded / 2;
+            for (float* plane : { cb, cr }) {
+                for (int r = 0; r < 8; r++) {
+                    const float* row0 = plane + static_cast<size_t>(2 * r) * padded;
+                    const float* row1 = row0 + padded;
+                    float* dst = plane + static_cast<size_t>(r) * half;
+                    for (int x = 0; x < half; x++) {
+                        dst[x] = (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1]) * 0.25f;
+                    }
+                }
+            }
+            for (int mx = 0; mx < enc.mcus_x; mx++) {
+                const int x = mx * 16;
+                TransformBlock(writer, y, padded, x, dc[0], enc.luma);
+                TransformBlock(writer, y, padded, x + 8, dc[0], enc.luma);
+                TransformBlock(writer, y + 8 * padded, padded, x, dc[0], enc.luma);
+                TransformBlock(writer, y + 8 * padded, padded, x + 8, dc[0], enc.luma);
+                TransformBlock(writer, cb, half, mx * 8, dc[1], enc.chroma);
+                TransformBlock(writer, cr, half, mx * 8, dc[2], enc.chroma);
+            }
+        } else {
+            for (int mx = 0; mx < enc.mcus_x; mx++) {
+                TransformBlock(writer, y, padded, mx * 8, dc[0], enc.luma);
+                if (enc.components == 3) {
+                    TransformBlock(writer, cb, padded, mx * 8, dc[1], enc.chroma);
+                    TransformBlock(writer, cr, padded, mx * 8, dc[2], enc.chroma);
+                }
+            }
+        }
+    }
+
+    writer.Reserve();
+    writer.Flush();
+    return true;
+}
+
+void PutMarker(std::vector<uint8_t>& out, uint8_t marker, size_t length) {
+    out.push_back(0xFF);
+    out.push_back(marker);
+    if (length) {
+        out.push_back(static_cast<uint8_t>(length >> 8));
+        out.push_back(static_cast<uint8_t>(length));
+    }
+}
+
+void PutHuffmanTable(std::vector<uint8_t>& out, uint8_t id, const uint8_t bits[16], const uint8_t* values) {
+    int count = 0;
+    out.push_back(id);
+    for (int i = 0; i < 16; i++) {
+        out.push_back(bits[i]);
+        count += bits[i];
+    }
+    out.insert(out.end(), values, values + count);
+}
+
+void WriteHeaders(const Encoder& enc, const JpegOptions& options, int restart_interval,
+                  std::vector<uint8_t>& out) {
+    PutMarker(out, 0xD8, 0);
+
+    // JFIF 1.01, no density, no thumbnail
+    static const uint8_t JFIF[14] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+    PutMarker(out, 0xE0, 2 + sizeof(JFIF));
+    out.insert(out.end(), JFIF, JFIF + sizeof(JFIF));
+
+    const size_t icc_chunks = (options.icc.size() + ICC_CHUNK - 1) / ICC_CHUNK;
+    for (size_t i = 0; i < icc_chunks && icc_chunks < 256; i++) {
+        static const char ICC_ID[12] = "ICC_PROFILE";
+        const size_t offset = i * ICC_CHUNK;
+        const size_t size = std::min(ICC_CHUNK, options.icc.size() - offset);
+        PutMarker(out, 0xE2, 2 + sizeof(ICC_ID) + 2 + size);
+        out.insert(out.end(), ICC_ID, ICC_ID + sizeof(ICC_ID));
+        out.push_back(static_cast<uint8_t>(i + 1));
+        out.push_back(static_cast<uint8_t>(icc_chunks));
+        out.insert(out.end(), options.icc.begin() + offset, options.icc.begin() + offset + size);
+    }
+
+    const int tables = enc.components == 3 ? 2 : 1;
+    PutMarker(out, 0xDB, 2 + 65 * tables);
+    for (int t = 0; t < tables; t++) {
+        out.push_back(static_cast<uint8_t>(t));
+        for (int k = 0; k < 64; k++) out.push_back(enc.quant[t][ZIGZAG[k]]);
+    }
+
+    PutMarker(out, 0xC0, 8 + 3 * enc.components);
+    out.push_back(8);
+    out.push_back(static_cast<uint8_t>(enc.height >> 8));
+    out.push_back(static_cast<uint8_t>(enc.height));
+    out.push_back(static_cast<uint8_t>(enc.width >> 8));
+    out.push_back(static_cast<uint8_t>(enc.width));
+    out.push_back(static_cast<uint8_t>(enc.components));
+    for (int c = 0; c < enc.components; c++) {
+        out.push_back(static_cast<uint8_t>(c + 1));
+        out.push_back(c == 0 && enc.subsample ? 0x22 : 0x11);
+        out.push_back(c == 0 ? 0 : 1);
+    }
+
+    const size_t dht_length = 2 + (17 + 12) + (17 + 162);
+    PutMarker(out, 0xC4, tables == 2 ? 2 * dht_length - 2 : dht_length);
+    PutHuffmanTable(out, 0x00, DC_LUMA_BITS, DC_VALUES);
+    PutHuffmanTable(out, 0x10, AC_LUMA_BITS, AC_LUMA_VALUES);
+    if (tables == 2) {
+        PutHuffmanTable(out, 0x01, DC_CHROMA_BITS, DC_VALUES);
+        PutHuffmanTable(out, 0x11, AC_CHROMA_BITS, AC_CHROMA_VALUES);
+    }
+
+    if (restart_interval > 0) {
+        PutMarker(out, 0xDD, 4);
+        out.push_back(static_cast<uint8_t>(restart_interval >> 8));
+        out.push_back(static_cast<uint8_t>(restart_interval));
+    }
+
+    PutMarker(out, 0xDA, 6 + 2 * enc.components);
+    out.push_back(static_cast<uint8_t>(enc.components));
+    for (int c = 0; c < enc.components; c++) {
+        out.push_back(static_cast<uint8_t>(c + 1));
+        out.push_back(c == 0 ? 0x00 : 0x11);
+    }
+    out.push_back(0);       // Spectral selection 0..63, no approximation
+    out.push_back(63);
+    out.push_back(0);
+}
+
+void BuildComponentTables(const uint8_t quant[64], const HuffmanTable* dc, const HuffmanTable* ac,
+                          ComponentTables& tables) {
+    for (int v = 0; v < 8; v++) {
+        for (int u = 0; u < 8; u++) {
+            tables.divisors[u * 8 + v] = static_cast<float>(
+                1.0 / (quant[v * 8 + u] * AAN_SCALE[v] * AAN_SCALE[u] * 8.0));
+        }
+    }
+    tables.dc = dc;
+    tables.ac = ac;
+}
+
+} // namespace
+
+JpegRowSource JpegBufferSource(const uint8_t* src, int width, int channels, int bits) {
+    const size_t samples = static_cast<size_t>(width) * channels;
+    return [src, samples, bits](uint8_t* dst, size_t stride, int first_row, int rows) {
+        for (int r = 0; r < rows; r++) {
+            const size_t row = static_cast<size_t>(first_row) + r;
+            uint8_t* line = dst + r * stride;
+            if (bits == 8) {
+                std::memcpy(line, src + row * samples, samples);
+            } else {
+                const uint16_t* in = reinterpret_cast<const uint16_t*>(src) + row * samples;
+                for (size_t i = 0; i < samples; i++) line[i] = static_cast<uint8_t>(in[i] >> 8);
+            }
+        }
+        return true;
+    };
+}
+
+bool EncodeJpeg(int width, int height, int channels, const JpegRowSource& source,
+                const JpegOptions& options, std::vector<uint8_t>& out) {
+    if (width < 1 || height < 1 || width > 65535 || height > 65535 ||
+        (channels != 1 && channels != 3 && channels != 4)) {
+        return false;
+    }
+
+    Encoder enc;
+    enc.width = width;
+    enc.height = height;
+    enc.channels = channels;
+    enc.components = channels == 1 ? 1 : 3;
+    enc.subsample = enc.components == 3 && options.subsampling == JPEG_SUBSAMPLING_420;
+    enc.mcu_size = enc.subsample ? 16 : 8;
+    enc.mcus_x = (width + enc.mcu_size - 1) / enc.mcu_size;
+    enc.mcu_rows = (height + enc.mcu_size - 1) / enc.mcu_size;
+
+    // libjpeg's quality scaling, clamped to baseline's 8-bit entries
+    const int quality = std::min(100, std::max(1, options.quality));
+    const int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; i++) {
+        enc.quant[0][i] = static_cast<uint8_t>(std::min(255, std::max(1, (LUMA_QUANT[i] * scale + 50) / 100)));
+        enc.quant[1][i] = static_cast<uint8_t>(std::min(255, std::max(1, (CHROMA_QUANT[i] * scale + 50) / 100)));
+    }
+    enc.dc_luma = BuildHuffmanTable(DC_LUMA_BITS, DC_VALUES);
+    enc.ac_luma = BuildHuffmanTable(AC_LUMA_BITS, AC_LUMA_VALUES);
+    enc.dc_chroma = BuildHuffmanTable(DC_CHROMA_BITS, DC_VALUES);
+    enc.ac_chroma = BuildHuffmanTable(AC_CHROMA_BITS, AC_CHROMA_VALUES);
+    BuildComponentTables(enc.quant[0], &enc.dc_luma, &enc.ac_luma, enc.luma);
+    BuildComponentTables(enc.quant[1], &enc.dc_chroma, &enc.ac_chroma, enc.chroma);
+
+    // One band per thread; the restart interval (one band) must fit 16 bits
+    const int threads = ParallelThreads();
+    int band_rows = enc.mcu_rows;
+    if (threads > 1) {
+        band_rows = std::max(MIN_BAND_MCU_ROWS, (enc.mcu_rows + threads - 1) / threads);
+    }
+    band_rows = std::min(band_rows, std::max(1, 65535 / enc.mcus_x));
+    const int bands = (enc.mcu_rows + band_rows - 1) / band_rows;
+
+    std::vector<std::vector<uint8_t>> coded(bands);
+    std::vector<char> ok(bands, 0);
+    ParallelRows(bands, 1, [&](int first, int last) {
+        for (int band = first; band < last; band++) {
+            ok[band] = EncodeBand(enc, source, band * band_rows,
+                                  std::min(enc.mcu_rows, (band + 1) * band_rows), coded[band]);
+        }
+    });
+    if (std::find(ok.begin(), ok.end(), 0) != ok.end()) {
+        return false;
+    }
+
+    size_t size = 0;
+    for (const auto& band : coded) size += band.size() + 2;
+    out.clear();
+    out.reserve(size + 1024 + options.icc.size());
+    WriteHeaders(enc, options, bands > 1 ? band_rows * enc.mcus_x : 0, out);
+    for (int band = 0; band < bands; band++) {
+        out.insert(out.end(), coded[band].begin(), coded[band].end());
+        std::vector<uint8_t>().swap(coded[band]);
+        if (band + 1 < bands) {
+            PutMarker(out, static_cast<uint8_t>(0xD0 + band % 8), 0);
+        }
+    }
+    PutMarker(out, 0xD9, 0);
+    return true;
+}
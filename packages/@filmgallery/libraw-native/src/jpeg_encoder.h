@@ -0,0 +1,62 @@
+/**
+ * @filmgallery/libraw-native - JPEG Encoder
+ *
+ * Baseline (sequential, Huffman) JFIF encoder for previews, thumbnails and
+ * exports, so rendered pixels need no extra copy into sharp. YCbCr 4:2:0 or
+ * 4:4:4 (or grayscale), the Annex K quantization tables scaled by quality
+ * like libjpeg, and the Annex K Huffman tables.
+ *
+ * Large images are cut into horizontal bands of whole MCU rows that are
+ * entropy-coded on separate threads. Every band but the last ends in a
+ * restart marker (the restart interval is one band), which resets the DC
+ * predictors, so the coded bands are simply concatenated.
+ *
+ * Pixels come from a row source instead of a buffer: each band pulls its own
+ * MCU rows, so an output conversion (FilmLibRaw::EncodeMemImageJpeg) runs
+ * fused with encoding and the full-size RGB image never exists.
+ */
+
+#ifndef JPEG_ENCODER_H
+#define JPEG_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+enum JpegSubsampling {
+    JPEG_SUBSAMPLING_420 = 0,   // Chroma halved both ways
+    JPEG_SUBSAMPLING_444 = 1
+};
+
+struct JpegOptions {
+    int quality = 90;                           // 1-100
+    JpegSubsampling subsampling = JPEG_SUBSAMPLING_420;
+    std::vector<uint8_t> icc;                   // Embedded as APP2 ICC_PROFILE when set
+};
+
+/**
+ * Fill rows [first_row, first_row + rows) with 8-bit interleaved samples at
+ * `dst`, `stride` bytes apart. Called from several threads at once, for
+ * different rows.
+ * @returns false to abort encoding
+ */
+typedef std::function<bool(uint8_t* dst, size_t stride, int first_row, int rows)> JpegRowSource;
+
+/**
+ * Row source over a buffer of interleaved 8- or 16-bit (native-endian,
+ * high byte kept) pixels with `channels` samples each
+ */
+JpegRowSource JpegBufferSource(const uint8_t* src, int width, int channels, int bits);
+
+/**
+ * Encode a `width` x `height` image
+ * @param channels - Samples per source pixel: 1 (grayscale), 3 (RGB) or
+ *                   4 (RGBA, alpha dropped)
+ * @returns false for unsupported channels or size (1..65535), or when the
+ *          source fails
+ */
+bool EncodeJpeg(int width, int height, int channels, const JpegRowSource& source,
+                const JpegOptions& options, std::vector<uint8_t>& out);
+
+#endif // JPEG_ENCODER_H
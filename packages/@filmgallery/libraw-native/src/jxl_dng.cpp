@@ -0,0 +1,188 @@
+/**
+ * @filmgallery/libraw-native - JPEG XL DNG
+ *
+ * DNG 1.7 allows JPEG XL tiles (compression 52546: iPhone ProRAW, Adobe's
+ * JXL DNG export). LibRaw identifies these files but only decodes them
+ * through the DNG SDK; jxl_dng_load_raw_placeholder() just reports them
+ * unsupported. Built with libjxl (LIBRAW_NATIVE_JPEGXL=1 when running
+ * node-gyp, see binding.gyp), Unpack() runs JxlDngLoadRaw() in its place:
+ * tiles are read in file order and decoded on separate threads, each
+ * straight into raw_image or color3_image (float tiles via
+ * AttachFloatImage()). A single-tile image uses libjxl's own thread pool.
+ */
+
+#include "film_libraw.h"
+
+bool FilmLibRaw::JpegXlAvailable() {
+#ifdef LIBRAW_NATIVE_JPEGXL
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifndef LIBRAW_NATIVE_JPEGXL
+
+void FilmLibRaw::JxlDngLoadRaw() {
+    // StandInLoader() does not pick it without libjxl
+    throw LIBRAW_EXCEPTION_UNSUPPORTED_FORMAT;
+}
+
+#else
+
+#include "parallel.h"
+#include <jxl/decode.h>
+#include <jxl/decode_cxx.h>
+#include <jxl/thread_parallel_runner.h>
+#include <jxl/thread_parallel_runner_cxx.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Decode a tile's single frame as interleaved `channels` x T. Integer
+// samples keep their coded values (a 12-bit tile stays 0..4095) rather
+// than being rescaled to 16 bits.
+template <typename T>
+bool DecodeJxlTile(const std::vector<uint8_t>& data, int channels, void* runner,
+                   std::vector<T>& out, unsigned& width, unsigned& height) {
+    JxlDecoderPtr decoder = JxlDecoderMake(nullptr);
+    if (!decoder ||
+        JxlDecoderSubscribeEvents(decoder.get(), JXL_DEC_BASIC_INFO | JXL_DEC_FULL_IMAGE) != JXL_DEC_SUCCESS ||
+        JxlDecoderSetKeepOrientation(decoder.get(), JXL_TRUE) != JXL_DEC_SUCCESS ||
+        (runner && JxlDecoderSetParallelRunner(decoder.get(), JxlThreadParallelRunner, runner) != JXL_DEC_SUCCESS) ||
+        JxlDecoderSetInput(decoder.get(), data.data(), data.size()) != JXL_DEC_SUCCESS) {
+        return false;
+    }
+    JxlDecoderCloseInput(decoder.get());
+
+    const bool floating = sizeof(T) == sizeof(float);
+    JxlPixelFormat format = {uint32_t(channels), floating ? JXL_TYPE_FLOAT : JXL_TYPE_UINT16, JXL_NATIVE_ENDIAN, 0};
+    for (;;) {
+        JxlDecoderStatus status = JxlDecoderProcessInput(decoder.get());
+        if (status == JXL_DEC_BASIC_INFO) {
+            JxlBasicInfo info;
+            if (JxlDecoderGetBasicInfo(decoder.get(), &info) != JXL_DEC_SUCCESS ||
+                int(info.num_color_channels) != channels) {
+                return false;
+            }
+            width = info.xsize;
+            height = info.ysize;
+        } else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+            size_t bytes = 0;
+            if (JxlDecoderImageOutBufferSize(decoder.get(), &format, &bytes) != JXL_DEC_SUCCESS) {
+                return false;
+            }
+            out.resize(bytes / sizeof(T));
+            if (JxlDecoderSetImageOutBuffer(decoder.get(), &format, out.data(), bytes) != JXL_DEC_SUCCESS) {
+                return false;
+            }
+            if (!floating) {
+                JxlBitDepth depth = {JXL_BIT_DEPTH_FROM_CODESTREAM, 0, 0};
+                if (JxlDecoderSetImageOutBitDepth(decoder.get(), &depth) != JXL_DEC_SUCCESS) {
+                    return false;
+                }
+            }
+        } else {
+            // The image, or an error / truncated stream
+            return status == JXL_DEC_FULL_IMAGE;
+        }
+    }
+}
+
+} // namespace
+
+void FilmLibRaw::JxlDngLoadRaw() {
+    const tiff_ifd_t& ifd = DngRawIfd();
+    const int samples = ifd.samples;
+    const bool floating = ifd.sample_format == 3;
+    // Four-sample images would need the fourth as a JXL extra channel
+    if (samples == 4 || (!floating && (ifd.sample_format > 1 || ifd.bps > 16))) {
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+    }
+
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    const size_t pixels = size_t(raw_width) * raw_height * samples;
+    if (INT64(pixels) * (floating ? 6 : 2) > INT64(imgdata.rawparams.max_raw_memory_mb) * INT64(1024 * 1024)) {
+        throw LIBRAW_EXCEPTION_TOOBIG;
+    }
+    unsigned tile_width, tile_height;
+    std::vector<DngTile> tiles;
+    ReadDngTiles(ifd, tile_width, tile_height, tiles);
+
+    float* float_image = nullptr;
+    ushort* int_image = nullptr;
+    if (floating) {
+        float_image = static_cast<float*>(calloc(pixels, sizeof(float)));
+    } else {
+        int_image = static_cast<ushort*>(calloc(pixels, sizeof(ushort)));
+    }
+    if (!float_image && !int_image) {
+        throw LIBRAW_EXCEPTION_ALLOC;
+    }
+
+    // Tiles are decoded one per thread; a lone tile gets libjxl's threads
+    JxlThreadParallelRunnerPtr runner;
+    if (tiles.size() == 1) {
+        runner = JxlThreadParallelRunnerMake(nullptr, JxlThreadParallelRunnerDefaultNumWorkerThreads());
+    }
+
+    std::vector<float> tile_max(tiles.size(), 0.f);
+    std::atomic<bool> ok(true);
+    ParallelRows(static_cast<int>(tiles.size()), 1, [&](int first, int last) {
+        std::vector<float> floats;
+        std::vector<uint16_t> ints;
+        for (int t = first; t < last && ok; t++) {
+            const DngTile& tile = tiles[t];
+            const unsigned rows = std::min(tile_height, raw_height - tile.row);
+            const unsigned cols = std::min(tile_width, raw_width - tile.col);
+            unsigned width = 0;
+            unsigned height = 0;
+            bool decoded;
+            try {
+                decoded = floating ? DecodeJxlTile(tile.data, samples, runner.get(), floats, width, height)
+                                   : DecodeJxlTile(tile.data, samples, runner.get(), ints, width, height);
+            } catch (const std::bad_alloc&) {
+                decoded = false;
+            }
+            // Edge tiles may be coded at full tile size or cropped to the image
+            if (!decoded || width < cols || height < rows) {
+                ok = false;
+                break;
+            }
+
+            float max = 0.f;
+            for (unsigned r = 0; r < rows; r++) {
+                const size_t src = size_t(r) * width * samples;
+                const size_t dst = (size_t(tile.row + r) * raw_width + tile.col) * samples;
+                const size_t count = size_t(cols) * samples;
+                if (floating) {
+                    for (size_t i = 0; i < count; i++) max = floats[src + i] > max ? floats[src + i] : max;
+                    memcpy(float_image + dst, floats.data() + src, count * sizeof(float));
+                } else {
+                    memcpy(int_image + dst, ints.data() + src, count * sizeof(ushort));
+                }
+            }
+            tile_max[t] = max;
+        }
+    });
+    if (!ok) {
+        free(float_image);
+        free(int_image);
+        throw LIBRAW_EXCEPTION_DECODE_RAW;
+    }
+
+    if (floating) {
+        float max = 0.f;
+        for (float m : tile_max) max = std::max(max, m);
+        AttachFloatImage(float_image, samples, max);
+    } else {
+        AttachRawImage(int_image, samples);
+    }
+}
+
+#endif // LIBRAW_NATIVE_JPEGXL
@@ -11,6 +11,16 @@
 #include <napi.h>
 #include "libraw/libraw.h"
 #include "async_workers.h"
+#include "trace.h"
+#include "camera_index.h"
+#include "metadata_record.h"
+#include "film_libraw.h"
+#include "color_convert.h"
+#include "render_session.h"
+#include "edit_session.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <cstring>
 #include <memory>
@@ -29,17 +39,26 @@ private:
     // Core methods
     Napi::Value LoadFile(const Napi::CallbackInfo& info);
     Napi::Value LoadBuffer(const Napi::CallbackInfo& info);
+    Napi::Value OpenWithSnapshot(const Napi::CallbackInfo& info);
+    Napi::Value OpenWithMosaicCache(const Napi::CallbackInfo& info);
     Napi::Value Unpack(const Napi::CallbackInfo& info);
     Napi::Value UnpackThumbnail(const Napi::CallbackInfo& info);
     Napi::Value DcrawProcess(const Napi::CallbackInfo& info);
     Napi::Value MakeMemImage(const Napi::CallbackInfo& info);
+    Napi::Value ReadImageStrip(const Napi::CallbackInfo& info);
+    Napi::Value MakeJpeg(const Napi::CallbackInfo& info);
     Napi::Value MakeMemThumbnail(const Napi::CallbackInfo& info);
+    Napi::Value DecodeThumbnail(const Napi::CallbackInfo& info);
     
     // Metadata methods
     Napi::Value GetMetadata(const Napi::CallbackInfo& info);
     Napi::Value GetImageSize(const Napi::CallbackInfo& info);
     Napi::Value GetLensInfo(const Napi::CallbackInfo& info);
     Napi::Value GetColorInfo(const Napi::CallbackInfo& info);
+    Napi::Value GetDecoderInfo(const Napi::CallbackInfo& info);
+    Napi::Value GetMetadataRecord(const Napi::CallbackInfo& info);
+    Napi::Value GetIdentifySnapshot(const Napi::CallbackInfo& info);
+    Napi::Value WriteMosaicCache(const Napi::CallbackInfo& info);
     
     // Configuration methods
     Napi::Value SetOutputColorSpace(const Napi::CallbackInfo& info);
@@ -52,17 +71,28 @@ private:
     Napi::Value SetUseAutoWB(const Napi::CallbackInfo& info);
     Napi::Value SetQuality(const Napi::CallbackInfo& info);
     Napi::Value SetHighlightMode(const Napi::CallbackInfo& info);
+    Napi::Value SetMemImageLimit(const Napi::CallbackInfo& info);
+    Napi::Value SetExportColorSpace(const Napi::CallbackInfo& info);
+    Napi::Value SetLinearFastPath(const Napi::CallbackInfo& info);
+    Napi::Value SetStandInLoaders(const Napi::CallbackInfo& info);
+    Napi::Value SetMonochrome(const Napi::CallbackInfo& info);
+    Napi::Value SetHistogramBins(const Napi::CallbackInfo& info);
     
     // Utility methods
     Napi::Value Recycle(const Napi::CallbackInfo& info);
     Napi::Value Close(const Napi::CallbackInfo& info);
     Napi::Value IsLoaded(const Napi::CallbackInfo& info);
+    Napi::Value SetTraceJob(const Napi::CallbackInfo& info);
     
     // LibRaw instance
-    std::unique_ptr<LibRaw> processor_;
+    std::unique_ptr<FilmLibRaw> processor_;
+    std::string file_path_;     // Path of the open file (empty for buffers)
     bool is_loaded_;
     bool is_unpacked_;
     bool is_processed_;
+    size_t mem_image_limit_;    // Larger images are returned in strips
+    int histogram_bins_;        // Per colour in dcrawProcess() results, 0 = none
+    uint64_t trace_job_;
 };
 
 // ============================================================================
@@ -74,17 +104,26 @@ Napi::Object LibRawProcessor::Init(Napi::Env env, Napi::Object exports) {
         // Core methods
         InstanceMethod<&LibRawProcessor::LoadFile>("loadFile"),
         InstanceMethod<&LibRawProcessor::LoadBuffer>("loadBuffer"),
+        InstanceMethod<&LibRawProcessor::OpenWithSnapshot>("openWithSnapshot"),
+        InstanceMethod<&LibRawProcessor::OpenWithMosaicCache>("openWithMosaicCache"),
         InstanceMethod<&LibRawProcessor::Unpack>("unpack"),
         InstanceMethod<&LibRawProcessor::UnpackThumbnail>("unpackThumbnail"),
         InstanceMethod<&LibRawProcessor::DcrawProcess>("dcrawProcess"),
         InstanceMethod<&LibRawProcessor::MakeMemImage>("makeMemImage"),
+        InstanceMethod<&LibRawProcessor::ReadImageStrip>("readImageStrip"),
+        InstanceMethod<&LibRawProcessor::MakeJpeg>("makeJpeg"),
         InstanceMethod<&LibRawProcessor::MakeMemThumbnail>("makeMemThumbnail"),
+        InstanceMethod<&LibRawProcessor::DecodeThumbnail>("decodeThumbnail"),
         
         // Metadata methods
         InstanceMethod<&LibRawProcessor::GetMetadata>("getMetadata"),
         InstanceMethod<&LibRawProcessor::GetImageSize>("getImageSize"),
         InstanceMethod<&LibRawProcessor::GetLensInfo>("getLensInfo"),
         InstanceMethod<&LibRawProcessor::GetColorInfo>("getColorInfo"),
+        InstanceMethod<&LibRawProcessor::GetDecoderInfo>("getDecoderInfo"),
+        InstanceMethod<&LibRawProcessor::GetMetadataRecord>("getMetadataRecord"),
+        InstanceMethod<&LibRawProcessor::GetIdentifySnapshot>("getIdentifySnapshot"),
+        InstanceMethod<&LibRawProcessor::WriteMosaicCache>("writeMosaicCache"),
         
         // Configuration methods
         InstanceMethod<&LibRawProcessor::SetOutputColorSpace>("setOutputColorSpace"),
@@ -97,11 +136,18 @@ Napi::Object LibRawProcessor::Init(Napi::Env env, Napi::Object exports) {
         InstanceMethod<&LibRawProcessor::SetUseAutoWB>("setUseAutoWB"),
         InstanceMethod<&LibRawProcessor::SetQuality>("setQuality"),
         InstanceMethod<&LibRawProcessor::SetHighlightMode>("setHighlightMode"),
+        InstanceMethod<&LibRawProcessor::SetMemImageLimit>("setMemImageLimit"),
+        InstanceMethod<&LibRawProcessor::SetExportColorSpace>("setExportColorSpace"),
+        InstanceMethod<&LibRawProcessor::SetLinearFastPath>("setLinearFastPath"),
+        InstanceMethod<&LibRawProcessor::SetStandInLoaders>("setStandInLoaders"),
+        InstanceMethod<&LibRawProcessor::SetMonochrome>("setMonochrome"),
+        InstanceMethod<&LibRawProcessor::SetHistogramBins>("setHistogramBins"),
         
         // Utility methods
         InstanceMethod<&LibRawProcessor::Recycle>("recycle"),
         InstanceMethod<&LibRawProcessor::Close>("close"),
         InstanceMethod<&LibRawProcessor::IsLoaded>("isLoaded"),
+        InstanceMethod<&LibRawProcessor::SetTraceJob>("setTraceJob"),
     });
 
     Napi::FunctionReference* constructor = new Napi::FunctionReference();
@@ -118,10 +164,13 @@ Napi::Object LibRawProcessor::Init(Napi::Env env, Napi::Object exports) {
 
 LibRawProcessor::LibRawProcessor(const Napi::CallbackInfo& info)
     : Napi::ObjectWrap<LibRawProcessor>(info),
-      processor_(std::make_unique<LibRaw>()),
+      processor_(std::make_unique<FilmLibRaw>()),
       is_loaded_(false),
       is_unpacked_(false),
-      is_processed_(false) {
+      is_processed_(false),
+      mem_image_limit_(static_cast<size_t>(1) << 30),
+      histogram_bins_(256),
+      trace_job_(0) {
     
     // Set default output parameters
     processor_->imgdata.params.output_bps = 16;  // 16-bit output
@@ -133,6 +182,9 @@ LibRawProcessor::LibRawProcessor(const Napi::CallbackInfo& info)
     processor_->imgdata.params.use_camera_matrix = 1;  // Use camera color matrix
     processor_->imgdata.params.half_size = 0;  // Full size output (no crop)
     processor_->imgdata.params.user_flip = 0;  // Auto rotation based on EXIF
+    
+    // Stage spans for the tracer (no-op while tracing is disabled)
+    processor_->set_progress_handler(TraceProgressCallback, nullptr);
 }
 
 LibRawProcessor::~LibRawProcessor() {
@@ -159,11 +211,13 @@ Napi::Value LibRawProcessor::LoadFile(const Napi::CallbackInfo& info) {
     
     // Recycle before loading new file
     processor_->recycle();
+    file_path_ = path;
     is_loaded_ = false;
     is_unpacked_ = false;
     is_processed_ = false;
     
     LoadFileWorker* worker = new LoadFileWorker(callback, processor_.get(), path);
+    worker->SetTraceJob(trace_job_);
     worker->Queue();
     
     // Mark as loaded after queuing (will be set properly in OnOK)
@@ -186,6 +240,7 @@ Napi::Value LibRawProcessor::LoadBuffer(const Napi::CallbackInfo& info) {
     
     // Recycle before loading new file
     processor_->recycle();
+    file_path_.clear();
     is_loaded_ = false;
     is_unpacked_ = false;
     is_processed_ = false;
@@ -193,6 +248,75 @@ Napi::Value LibRawProcessor::LoadBuffer(const Napi::CallbackInfo& info) {
     LoadBufferWorker* worker = new LoadBufferWorker(
         callback, processor_.get(), buffer.Data(), buffer.Length()
     );
+    worker->SetTraceJob(trace_job_);
+    worker->Queue();
+    
+    is_loaded_ = true;
+    
+    return env.Undefined();
+}
+
+Napi::Value LibRawProcessor::OpenWithSnapshot(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsString() || !info[1].IsBuffer() || !info[2].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (string path, Buffer snapshot, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    std::string path = info[0].As<Napi::String>().Utf8Value();
+    Napi::Buffer<uint8_t> snapshot = info[1].As<Napi::Buffer<uint8_t>>();
+    Napi::Function callback = info[2].As<Napi::Function>();
+    
+    processor_->recycle();
+    file_path_ = path;
+    is_loaded_ = false;
+    is_unpacked_ = false;
+    is_processed_ = false;
+    
+    OpenSnapshotWorker* worker = new OpenSnapshotWorker(
+        callback, processor_.get(), path, snapshot.Data(), snapshot.Length()
+    );
+    worker->SetTraceJob(trace_job_);
+    worker->Queue();
+    
+    is_loaded_ = true;
+    
+    return env.Undefined();
+}
+
+Napi::Value LibRawProcessor::OpenWithMosaicCache(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 4 || !info[0].IsString() || !info[1].IsString() ||
+        !(info[2].IsBuffer() || info[2].IsNull() || info[2].IsUndefined()) || !info[3].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (string path, string cachePath, Buffer|null snapshot, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    std::string path = info[0].As<Napi::String>().Utf8Value();
+    std::string cache_path = info[1].As<Napi::String>().Utf8Value();
+    Napi::Function callback = info[3].As<Napi::Function>();
+    const uint8_t* snapshot = nullptr;
+    size_t snapshot_size = 0;
+    if (info[2].IsBuffer()) {
+        Napi::Buffer<uint8_t> buffer = info[2].As<Napi::Buffer<uint8_t>>();
+        snapshot = buffer.Data();
+        snapshot_size = buffer.Length();
+    }
+    
+    processor_->recycle();
+    file_path_ = path;
+    is_loaded_ = false;
+    is_unpacked_ = false;
+    is_processed_ = false;
+    
+    OpenMosaicWorker* worker = new OpenMosaicWorker(
+        callback, processor_.get(), path, cache_path, snapshot, snapshot_size
+    );
+    worker->SetTraceJob(trace_job_);
     worker->Queue();
     
     is_loaded_ = true;
@@ -221,6 +345,7 @@ Napi::Value LibRawProcessor::Unpack(const Napi::CallbackInfo& info) {
     Napi::Function callback = info[0].As<Napi::Function>();
     
     UnpackWorker* worker = new UnpackWorker(callback, processor_.get());
+    worker->SetTraceJob(trace_job_);
     worker->Queue();
     
     is_unpacked_ = true;
@@ -244,7 +369,8 @@ Napi::Value LibRawProcessor::DcrawProcess(const Napi::CallbackInfo& info) {
     
     Napi::Function callback = info[0].As<Napi::Function>();
     
-    ProcessWorker* worker = new ProcessWorker(callback, processor_.get());
+    ProcessWorker* worker = new ProcessWorker(callback, processor_.get(), histogram_bins_);
+    worker->SetTraceJob(trace_job_);
     worker->Queue();
     
     is_processed_ = true;
@@ -263,7 +389,110 @@ Napi::Value LibRawProcessor::MakeMemImage(const Napi::CallbackInfo& info) {
     
     Napi::Function callback = info[0].As<Napi::Function>();
     
-    MakeMemImageWorker* worker = new MakeMemImageWorker(callback, processor_.get());
+    MakeMemImageWorker* worker = new MakeMemImageWorker(callback, processor_.get(), mem_image_limit_);
+    worker->SetTraceJob(trace_job_);
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+Napi::Value LibRawProcessor::ReadImageStrip(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (number index, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    MemImageLayout layout;
+    if (!is_processed_ || !processor_->GetMemImageLayout(layout)) {
+        Napi::Error::New(env, "Image not processed").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    int index = info[0].As<Napi::Number>().Int32Value();
+    int strip_height = MemImageStripHeight(layout);
+    if (index < 0 || static_cast<int64_t>(index) * strip_height >= layout.height) {
+        Napi::RangeError::New(env, "Strip index out of range").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    int first_row = index * strip_height;
+    int rows = std::min(strip_height, layout.height - first_row);
+    Napi::Function callback = info[1].As<Napi::Function>();
+    
+    ReadImageStripWorker* worker = new ReadImageStripWorker(
+        callback, processor_.get(), layout, first_row, rows
+    );
+    worker->SetTraceJob(trace_job_);
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+// { quality?, subsampling?: '420' | '444', iccProfile?: Buffer }
+static bool ReadJpegOptions(const Napi::Value& value, JpegOptions& options) {
+    if (value.IsUndefined()) {
+        return true;
+    }
+    if (!value.IsObject()) {
+        return false;
+    }
+    Napi::Object object = value.As<Napi::Object>();
+    
+    Napi::Value quality = object.Get("quality");
+    if (quality.IsNumber()) {
+        options.quality = quality.As<Napi::Number>().Int32Value();
+        if (options.quality < 1 || options.quality > 100) return false;
+    } else if (!quality.IsUndefined()) {
+        return false;
+    }
+    
+    Napi::Value subsampling = object.Get("subsampling");
+    if (subsampling.IsString()) {
+        std::string mode = subsampling.As<Napi::String>().Utf8Value();
+        if (mode == "420") options.subsampling = JPEG_SUBSAMPLING_420;
+        else if (mode == "444") options.subsampling = JPEG_SUBSAMPLING_444;
+        else return false;
+    } else if (!subsampling.IsUndefined()) {
+        return false;
+    }
+    
+    Napi::Value icc = object.Get("iccProfile");
+    if (icc.IsBuffer()) {
+        Napi::Buffer<uint8_t> profile = icc.As<Napi::Buffer<uint8_t>>();
+        options.icc.assign(profile.Data(), profile.Data() + profile.Length());
+    } else if (!icc.IsUndefined() && !icc.IsNull()) {
+        return false;
+    }
+    return true;
+}
+
+Napi::Value LibRawProcessor::MakeJpeg(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[info.Length() - 1].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (object options?, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    JpegOptions options;
+    if (!ReadJpegOptions(info.Length() > 1 ? info[0] : env.Undefined(), options)) {
+        Napi::RangeError::New(env, "Expected JPEG options { quality 1-100, subsampling '420' or '444', iccProfile Buffer }")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (!is_processed_) {
+        Napi::Error::New(env, "Image not processed").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Function callback = info[info.Length() - 1].As<Napi::Function>();
+    
+    MakeJpegWorker* worker = new MakeJpegWorker(callback, processor_.get(), std::move(options));
+    worker->SetTraceJob(trace_job_);
     worker->Queue();
     
     return env.Undefined();
@@ -290,6 +519,7 @@ Napi::Value LibRawProcessor::UnpackThumbnail(const Napi::CallbackInfo& info) {
     Napi::Function callback = info[0].As<Napi::Function>();
     
     UnpackThumbnailWorker* worker = new UnpackThumbnailWorker(callback, processor_.get());
+    worker->SetTraceJob(trace_job_);
     worker->Queue();
     
     return env.Undefined();
@@ -307,6 +537,53 @@ Napi::Value LibRawProcessor::MakeMemThumbnail(const Napi::CallbackInfo& info) {
     Napi::Function callback = info[0].As<Napi::Function>();
     
     MakeMemThumbnailWorker* worker = new MakeMemThumbnailWorker(callback, processor_.get());
+    worker->SetTraceJob(trace_job_);
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+// { scale?: 1 | 2 | 4 | 8 }
+static bool ReadDecodeScale(const Napi::Value& value, int& scale) {
+    scale = 1;
+    if (value.IsUndefined()) {
+        return true;
+    }
+    if (!value.IsObject()) {
+        return false;
+    }
+    Napi::Value option = value.As<Napi::Object>().Get("scale");
+    if (option.IsNumber()) {
+        scale = option.As<Napi::Number>().Int32Value();
+    } else if (!option.IsUndefined()) {
+        return false;
+    }
+    return scale == 1 || scale == 2 || scale == 4 || scale == 8;
+}
+
+Napi::Value LibRawProcessor::DecodeThumbnail(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[info.Length() - 1].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (object options?, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    int scale;
+    if (!ReadDecodeScale(info.Length() > 1 ? info[0] : env.Undefined(), scale)) {
+        Napi::RangeError::New(env, "Expected scale 1, 2, 4 or 8").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (!is_loaded_) {
+        Napi::Error::New(env, "No file loaded").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Function callback = info[info.Length() - 1].As<Napi::Function>();
+    
+    DecodeThumbnailWorker* worker = new DecodeThumbnailWorker(callback, processor_.get(), scale);
+    worker->SetTraceJob(trace_job_);
     worker->Queue();
     
     return env.Undefined();
@@ -442,6 +719,108 @@ Napi::Value LibRawProcessor::GetColorInfo(const Napi::CallbackInfo& info) {
     return result;
 }
 
+Napi::Value LibRawProcessor::GetDecoderInfo(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (!is_loaded_) {
+        Napi::Error::New(env, "No file loaded").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    libraw_decoder_info_t decoder;
+    int ret = processor_->get_decoder_info(&decoder);
+    if (ret != LIBRAW_SUCCESS) {
+        Napi::Error::New(env, std::string("Failed to get decoder info: ") + libraw_strerror(ret))
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    // The decoder name identifies the codec, e.g. "crxLoadRaw()" (CR3),
+    // "sony_arw2_load_raw()", "lossy_dng_load_raw()"
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("name", Napi::String::New(env, decoder.decoder_name ? decoder.decoder_name : ""));
+    result.Set("flags", Napi::Number::New(env, decoder.decoder_flags));
+    result.Set("unsupported", Napi::Boolean::New(env, (decoder.decoder_flags & LIBRAW_DECODER_UNSUPPORTED_FORMAT) != 0));
+    result.Set("flatData", Napi::Boolean::New(env, (decoder.decoder_flags & LIBRAW_DECODER_FLATDATA) != 0));
+    result.Set("hasCurve", Napi::Boolean::New(env, (decoder.decoder_flags & LIBRAW_DECODER_HASCURVE) != 0));
+    
+    // Per-file capabilities (the static camera index only knows the model)
+    result.Set("xtrans", Napi::Boolean::New(env, processor_->imgdata.idata.filters == LIBRAW_XTRANS));
+    result.Set("frames", Napi::Number::New(env, processor_->imgdata.idata.raw_count));
+    
+    return result;
+}
+
+Napi::Value LibRawProcessor::GetMetadataRecord(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (!is_loaded_) {
+        Napi::Error::New(env, "No file loaded").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    // Same fields as getMetadata/getImageSize/getLensInfo/getColorInfo,
+    // packed into a single one-record block (see metadata_record.h)
+    MetadataRecordWriter writer(1);
+    writer.Fill(0, processor_->imgdata);
+    
+    Napi::ArrayBuffer buffer = Napi::ArrayBuffer::New(env, writer.ByteLength());
+    writer.Serialize(static_cast<uint8_t*>(buffer.Data()));
+    
+    return buffer;
+}
+
+Napi::Value LibRawProcessor::GetIdentifySnapshot(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (!is_loaded_ || file_path_.empty()) {
+        Napi::Error::New(env, "No file loaded (snapshots require loadFile)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    std::vector<uint8_t> snapshot;
+    int ret = processor_->SaveSnapshot(file_path_.c_str(), snapshot);
+    if (ret != LIBRAW_SUCCESS) {
+        // Taken after unpack(), or a decoder whose state lives outside the snapshot
+        Napi::Error::New(env, std::string("Failed to create identify snapshot: ") + libraw_strerror(ret))
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    return Napi::Buffer<uint8_t>::Copy(env, snapshot.data(), snapshot.size());
+}
+
+Napi::Value LibRawProcessor::WriteMosaicCache(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (string cachePath, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    if (!is_loaded_ || file_path_.empty()) {
+        Napi::Error::New(env, "No file loaded (mosaic caches require loadFile)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    std::string cache_path = info[0].As<Napi::String>().Utf8Value();
+    Napi::Function callback = info[1].As<Napi::Function>();
+    // Optional third callback: write in the background, calling `callback`
+    // once the raw image is copied out and `written` when the file is done
+    const bool background = info.Length() > 2 && info[2].IsFunction();
+    Napi::Function written = background ? info[2].As<Napi::Function>() : Napi::Function();
+    
+    MosaicWriteWorker* worker = new MosaicWriteWorker(callback, processor_.get(), file_path_, cache_path,
+                                                      background ? &written : nullptr);
+    worker->SetTraceJob(trace_job_);
+    worker->Queue();
+    
+    is_unpacked_ = true;
+    
+    return env.Undefined();
+}
+
 // ============================================================================
 // Configuration Methods
 // ============================================================================
@@ -598,103 +977,1609 @@ Napi::Value LibRawProcessor::SetHighlightMode(const Napi::CallbackInfo& info) {
     return env.Undefined();
 }
 
-// ============================================================================
-// Utility Methods
-// ============================================================================
-
-Napi::Value LibRawProcessor::Recycle(const Napi::CallbackInfo& info) {
+Napi::Value LibRawProcessor::SetMemImageLimit(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
-    processor_->recycle();
-    is_loaded_ = false;
-    is_unpacked_ = false;
-    is_processed_ = false;
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected (number bytes)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
     
-    return Napi::Boolean::New(env, true);
+    // makeMemImage() returns larger images in strips (readImageStrip)
+    int64_t bytes = info[0].As<Napi::Number>().Int64Value();
+    mem_image_limit_ = bytes > 0 ? static_cast<size_t>(bytes) : 0;
+    
+    return env.Undefined();
 }
 
-Napi::Value LibRawProcessor::Close(const Napi::CallbackInfo& info) {
+Napi::Value LibRawProcessor::SetExportColorSpace(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
-    processor_->recycle();
-    is_loaded_ = false;
-    is_unpacked_ = false;
-    is_processed_ = false;
+    if (info.Length() < 1 || !info[0].IsNumber() || (info.Length() > 1 && !info[1].IsNumber() && !info[1].IsUndefined())) {
+        Napi::TypeError::New(env, "Expected (number colorSpace, number transfer?)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
     
-    return Napi::Boolean::New(env, true);
+    int space = info[0].As<Napi::Number>().Int32Value();
+    int transfer = info.Length() > 1 && info[1].IsNumber() ? info[1].As<Napi::Number>().Int32Value() : TRANSFER_DEFAULT;
+    if ((space != 0 && !IsConvertibleColorSpace(space)) || !IsTransferFunction(transfer)) {
+        Napi::RangeError::New(env, "Unsupported export colour space or transfer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    // 0 = off; otherwise makeMemImage()/readImageStrip() convert from the
+    // output colour space while copying
+    processor_->SetExportColorSpace(space, static_cast<TransferFunction>(transfer));
+    
+    return env.Undefined();
 }
 
-Napi::Value LibRawProcessor::IsLoaded(const Napi::CallbackInfo& info) {
-    return Napi::Boolean::New(info.Env(), is_loaded_);
+Napi::Value LibRawProcessor::SetLinearFastPath(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsBoolean()) {
+        Napi::TypeError::New(env, "Expected (boolean enabled)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    // Off: LinearRaw images go through dcraw_process() like everything else
+    processor_->SetLinearFastPath(info[0].As<Napi::Boolean>().Value());
+    
+    return env.Undefined();
 }
 
-// ============================================================================
-// Module-level Functions
-// ============================================================================
-
-Napi::Value GetVersion(const Napi::CallbackInfo& info) {
+Napi::Value LibRawProcessor::SetStandInLoaders(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
-    Napi::Object result = Napi::Object::New(env);
-    result.Set("version", Napi::String::New(env, LibRaw::version()));
-    result.Set("versionNumber", Napi::Number::New(env, LibRaw::versionNumber()));
+    if (info.Length() < 1 || !info[0].IsBoolean()) {
+        Napi::TypeError::New(env, "Expected (boolean enabled)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
     
-    return result;
+    // Off: packed and medium-format files unpack with LibRaw's serial loaders
+    processor_->SetStandInLoaders(info[0].As<Napi::Boolean>().Value());
+    
+    return env.Undefined();
 }
 
-Napi::Value GetCameraList(const Napi::CallbackInfo& info) {
+Napi::Value LibRawProcessor::SetMonochrome(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
-    const char** list = LibRaw::cameraList();
-    int count = LibRaw::cameraCount();
+    bool weights_given = info.Length() > 1 && info[1].IsArray();
+    if (info.Length() < 1 || !info[0].IsBoolean() ||
+        (info.Length() > 1 && !weights_given && !info[1].IsUndefined() && !info[1].IsNull()) ||
+        (info.Length() > 2 && !info[2].IsBoolean() && !info[2].IsUndefined())) {
+        Napi::TypeError::New(env, "Expected (boolean enabled, number[3] weights?, boolean float?)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
     
-    Napi::Array result = Napi::Array::New(env, count);
-    for (int i = 0; i < count; i++) {
-        result.Set(i, Napi::String::New(env, list[i]));
+    float weights[3];
+    if (weights_given) {
+        Napi::Array array = info[1].As<Napi::Array>();
+        if (array.Length() != 3) {
+            Napi::TypeError::New(env, "Expected (boolean enabled, number[3] weights?, boolean float?)")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        double sum = 0;
+        for (uint32_t c = 0; c < 3; c++) {
+            Napi::Value value = array.Get(c);
+            double weight = value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : -1;
+            if (!std::isfinite(weight) || weight < 0) {
+                Napi::RangeError::New(env, "Monochrome weights must be finite and non-negative")
+                    .ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            weights[c] = static_cast<float>(weight);
+            sum += weight;
+        }
+        if (sum <= 0) {
+            Napi::RangeError::New(env, "Monochrome weights must not all be zero")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
     }
     
-    return result;
-}
-
-Napi::Value GetCameraCount(const Napi::CallbackInfo& info) {
-    return Napi::Number::New(info.Env(), LibRaw::cameraCount());
+    // Bayer images process straight to one luminance channel; anything else
+    // still comes out RGB
+    bool float_output = info.Length() > 2 && info[2].IsBoolean() && info[2].As<Napi::Boolean>().Value();
+    processor_->SetMonochrome(info[0].As<Napi::Boolean>().Value(), weights_given ? weights : nullptr, float_output);
+    
+    return env.Undefined();
 }
 
-Napi::Value IsSupportedCamera(const Napi::CallbackInfo& info) {
+Napi::Value LibRawProcessor::SetHistogramBins(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
-    if (info.Length() < 1 || !info[0].IsString()) {
-        Napi::TypeError::New(env, "Expected (string cameraModel)")
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected (number bins)")
             .ThrowAsJavaScriptException();
         return env.Undefined();
     }
     
-    std::string model = info[0].As<Napi::String>().Utf8Value();
-    const char** list = LibRaw::cameraList();
-    int count = LibRaw::cameraCount();
-    
-    for (int i = 0; i < count; i++) {
-        if (model == list[i]) {
-            return Napi::Boolean::New(env, true);
-        }
+    // LibRaw keeps 0x2000 bins per colour; results sum them down
+    int bins = info[0].As<Napi::Number>().Int32Value();
+    if (bins < 0 || bins > LIBRAW_HISTOGRAM_SIZE || (bins & (bins - 1))) {
+        Napi::RangeError::New(env, "Histogram bins must be 0 or a power of two up to 8192")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
     }
+    histogram_bins_ = bins;
     
-    return Napi::Boolean::New(env, false);
+    return env.Undefined();
 }
 
 // ============================================================================
-// Module Initialization
+// Utility Methods
 // ============================================================================
 
-Napi::Object Init(Napi::Env env, Napi::Object exports) {
-    // Initialize the LibRawProcessor class
-    LibRawProcessor::Init(env, exports);
+Napi::Value LibRawProcessor::Recycle(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    processor_->recycle();
+    file_path_.clear();
+    is_loaded_ = false;
+    is_unpacked_ = false;
+    is_processed_ = false;
+    
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value LibRawProcessor::Close(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    processor_->recycle();
+    file_path_.clear();
+    is_loaded_ = false;
+    is_unpacked_ = false;
+    is_processed_ = false;
+    
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value LibRawProcessor::IsLoaded(const Napi::CallbackInfo& info) {
+    return Napi::Boolean::New(info.Env(), is_loaded_);
+}
+
+Napi::Value LibRawProcessor::SetTraceJob(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected (number jobId)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    // 0 = untagged; applies to operations queued after this call
+    trace_job_ = static_cast<uint64_t>(info[0].As<Napi::Number>().Int64Value());
+    
+    return env.Undefined();
+}
+
+// ============================================================================
+// Module-level Functions
+// ============================================================================
+
+Napi::Value GetVersion(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("version", Napi::String::New(env, LibRaw::version()));
+    result.Set("versionNumber", Napi::Number::New(env, LibRaw::versionNumber()));
+    result.Set("cpu", Napi::String::New(env, CpuLevelName(ActiveCpuLevel())));
+    result.Set("cpuDetected", Napi::String::New(env, CpuLevelName(DetectedCpuLevel())));
+    result.Set("jpegxl", Napi::Boolean::New(env, FilmLibRaw::JpegXlAvailable()));
+    
+    return result;
+}
+
+// ============================================================================
+// Camera Index
+// ============================================================================
+
+static Napi::Value CameraEntryToObject(Napi::Env env, const CameraEntry* entry) {
+    if (!entry) {
+        return env.Null();
+    }
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("name", Napi::String::New(env, entry->name));
+    result.Set("make", Napi::String::New(env, entry->make));
+    result.Set("model", Napi::String::New(env, entry->model));
+    
+    Napi::Array aliases = Napi::Array::New(env, entry->aliases.size());
+    for (size_t i = 0; i < entry->aliases.size(); i++) {
+        aliases.Set(static_cast<uint32_t>(i), Napi::String::New(env, entry->aliases[i]));
+    }
+    result.Set("aliases", aliases);
+    
+    Napi::Array notes = Napi::Array::New(env, entry->notes.size());
+    for (size_t i = 0; i < entry->notes.size(); i++) {
+        notes.Set(static_cast<uint32_t>(i), Napi::String::New(env, entry->notes[i]));
+    }
+    result.Set("notes", notes);
+    
+    result.Set("format", entry->format ? Napi::String::New(env, entry->format) : env.Null());
+    result.Set("xtrans", Napi::Boolean::New(env, (entry->capabilities & CAMERA_CAP_XTRANS) != 0));
+    result.Set("multiFrame", Napi::Boolean::New(env, (entry->capabilities & CAMERA_CAP_MULTI_FRAME) != 0));
+    result.Set("monochrome", Napi::Boolean::New(env, (entry->capabilities & CAMERA_CAP_MONOCHROME) != 0));
+    result.Set("partial", Napi::Boolean::New(env, (entry->capabilities & CAMERA_CAP_PARTIAL) != 0));
+    result.Set("dngOnly", Napi::Boolean::New(env, (entry->capabilities & CAMERA_CAP_DNG_ONLY) != 0));
+    result.Set("modifiedFirmware", Napi::Boolean::New(env, (entry->capabilities & CAMERA_CAP_MODIFIED_FIRMWARE) != 0));
+    result.Set("singleShotOnly", Napi::Boolean::New(env, (entry->capabilities & CAMERA_CAP_SINGLE_SHOT_ONLY) != 0));
+    
+    return result;
+}
+
+// One query: "Make Model" string, or { make, model }
+static const CameraEntry* FindCamera(const Napi::Value& query) {
+    const CameraIndex& index = CameraIndex::Instance();
+    
+    if (query.IsString()) {
+        return index.Find(query.As<Napi::String>().Utf8Value());
+    }
+    if (query.IsObject()) {
+        Napi::Object obj = query.As<Napi::Object>();
+        Napi::Value make = obj.Get("make");
+        Napi::Value model = obj.Get("model");
+        if (make.IsString() && model.IsString()) {
+            return index.Find(make.As<Napi::String>().Utf8Value(), model.As<Napi::String>().Utf8Value());
+        }
+    }
+    return nullptr;
+}
+
+Napi::Value GetCameraList(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    const std::vector<CameraEntry>& entries = CameraIndex::Instance().Entries();
+    bool detailed = info.Length() > 0 && info[0].IsBoolean() && info[0].As<Napi::Boolean>().Value();
+    
+    Napi::Array result = Napi::Array::New(env, entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        result.Set(static_cast<uint32_t>(i), detailed
+            ? CameraEntryToObject(env, &entries[i])
+            : Napi::String::New(env, entries[i].name));
+    }
+    
+    return result;
+}
+
+Napi::Value GetCameraCount(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), LibRaw::cameraCount());
+}
+
+Napi::Value IsSupportedCamera(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString() || (info.Length() > 1 && !info[1].IsString() && !info[1].IsUndefined())) {
+        Napi::TypeError::New(env, "Expected (string cameraModel) or (string make, string model)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    const CameraIndex& index = CameraIndex::Instance();
+    std::string first = info[0].As<Napi::String>().Utf8Value();
+    const CameraEntry* entry = info.Length() > 1 && info[1].IsString()
+        ? index.Find(first, info[1].As<Napi::String>().Utf8Value())
+        : index.Find(first);
+    
+    return Napi::Boolean::New(env, entry != nullptr);
+}
+
+Napi::Value LookupCamera(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString() || (info.Length() > 1 && !info[1].IsString() && !info[1].IsUndefined())) {
+        Napi::TypeError::New(env, "Expected (string make, string model) or (string name)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    const CameraIndex& index = CameraIndex::Instance();
+    std::string first = info[0].As<Napi::String>().Utf8Value();
+    const CameraEntry* entry = info.Length() > 1 && info[1].IsString()
+        ? index.Find(first, info[1].As<Napi::String>().Utf8Value())
+        : index.Find(first);
+    
+    return CameraEntryToObject(env, entry);
+}
+
+Napi::Value LookupCameras(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsArray()) {
+        Napi::TypeError::New(env, "Expected (Array<string | {make, model}> queries)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Array queries = info[0].As<Napi::Array>();
+    uint32_t length = queries.Length();
+    Napi::Array result = Napi::Array::New(env, length);
+    for (uint32_t i = 0; i < length; i++) {
+        result.Set(i, CameraEntryToObject(env, FindCamera(queries.Get(i))));
+    }
+    
+    return result;
+}
+
+// ============================================================================
+// Metadata Records
+// ============================================================================
+
+Napi::Value GetMetadataSchema(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    static const char* const kTypeNames[] = { "i32", "u32", "f64", "string" };
+    
+    const std::vector<MetadataField>& schema = MetadataSchema();
+    Napi::Array fields = Napi::Array::New(env, schema.size());
+    for (size_t i = 0; i < schema.size(); i++) {
+        Napi::Object field = Napi::Object::New(env);
+        field.Set("name", Napi::String::New(env, schema[i].name));
+        field.Set("type", Napi::String::New(env, kTypeNames[schema[i].type]));
+        field.Set("offset", Napi::Number::New(env, schema[i].offset));
+        fields.Set(static_cast<uint32_t>(i), field);
+    }
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("magic", Napi::Number::New(env, kMetadataMagic));
+    result.Set("version", Napi::Number::New(env, kMetadataVersion));
+    result.Set("headerSize", Napi::Number::New(env, kMetadataHeaderSize));
+    result.Set("recordSize", Napi::Number::New(env, MetadataRecordSize()));
+    result.Set("fields", fields);
+    
+    return result;
+}
+
+Napi::Value ReadMetadataBatch(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsArray() || !info[info.Length() - 1].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (Array<string> paths, number jobId?, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Array list = info[0].As<Napi::Array>();
+    std::vector<std::string> paths;
+    paths.reserve(list.Length());
+    for (uint32_t i = 0; i < list.Length(); i++) {
+        Napi::Value item = list.Get(i);
+        if (!item.IsString()) {
+            Napi::TypeError::New(env, "Expected every path to be a string").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        paths.push_back(item.As<Napi::String>().Utf8Value());
+    }
+    
+    Napi::Function callback = info[info.Length() - 1].As<Napi::Function>();
+    MetadataBatchWorker* worker = new MetadataBatchWorker(callback, std::move(paths));
+    if (info.Length() > 2 && info[1].IsNumber()) {
+        worker->SetTraceJob(static_cast<uint64_t>(info[1].As<Napi::Number>().Int64Value()));
+    }
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+// ============================================================================
+// Colour Conversion
+// ============================================================================
+
+Napi::Value ConvertColorSpace(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsBuffer() || !info[1].IsObject() || !info[2].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (Buffer data, object options, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Buffer<uint8_t> data = info[0].As<Napi::Buffer<uint8_t>>();
+    Napi::Object options = info[1].As<Napi::Object>();
+    auto number = [&options](const char* key, int fallback) {
+        Napi::Value value = options.Get(key);
+        return value.IsNumber() ? value.As<Napi::Number>().Int32Value() : fallback;
+    };
+    
+    int width = number("width", 0);
+    int height = number("height", 0);
+    int channels = number("channels", 3);
+    int bits = number("bits", 8);
+    ColorConversion conversion;
+    conversion.from = number("from", COLOR_SPACE_SRGB);
+    conversion.to = number("to", COLOR_SPACE_SRGB);
+    int from_transfer = number("fromTransfer", TRANSFER_DEFAULT);
+    int to_transfer = number("toTransfer", TRANSFER_DEFAULT);
+    
+    if (width <= 0 || height <= 0 || (channels != 3 && channels != 4) || (bits != 8 && bits != 16)) {
+        Napi::RangeError::New(env, "Expected width/height > 0, channels 3 or 4, bits 8 or 16")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (!IsConvertibleColorSpace(conversion.from) || !IsConvertibleColorSpace(conversion.to) ||
+        !IsTransferFunction(from_transfer) || !IsTransferFunction(to_transfer)) {
+        Napi::RangeError::New(env, "Unsupported colour space or transfer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    size_t expected = static_cast<size_t>(width) * height * channels * (bits / 8);
+    if (data.Length() < expected) {
+        Napi::RangeError::New(env, "Buffer is smaller than width * height * channels * bytes")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (bits == 16 && reinterpret_cast<uintptr_t>(data.Data()) % 2) {
+        Napi::TypeError::New(env, "16-bit data must be 2-byte aligned").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    conversion.from_transfer = static_cast<TransferFunction>(from_transfer);
+    conversion.to_transfer = static_cast<TransferFunction>(to_transfer);
+    
+    Napi::Function callback = info[2].As<Napi::Function>();
+    ColorConvertWorker* worker = new ColorConvertWorker(callback, data, width, height, channels, bits, conversion);
+    if (options.Get("jobId").IsNumber()) {
+        worker->SetTraceJob(static_cast<uint64_t>(options.Get("jobId").As<Napi::Number>().Int64Value()));
+    }
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+Napi::Value GetColorProfile(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsNumber() || (info.Length() > 1 && !info[1].IsNumber() && !info[1].IsUndefined())) {
+        Napi::TypeError::New(env, "Expected (number colorSpace, number transfer?)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    int space = info[0].As<Napi::Number>().Int32Value();
+    int transfer = info.Length() > 1 && info[1].IsNumber() ? info[1].As<Napi::Number>().Int32Value() : TRANSFER_DEFAULT;
+    std::vector<uint8_t> profile;
+    if (!IsTransferFunction(transfer) || !BuildColorProfile(space, static_cast<TransferFunction>(transfer), profile)) {
+        Napi::RangeError::New(env, "Unsupported colour space or transfer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    return Napi::Buffer<uint8_t>::Copy(env, profile.data(), profile.size());
+}
+
+Napi::Value BuildDerivatives(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsBuffer() || !info[1].IsObject() || !info[2].IsFunction() ||
+        !info[1].As<Napi::Object>().Get("sizes").IsArray()) {
+        Napi::TypeError::New(env, "Expected (Buffer data, object options with sizes[], function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Buffer<uint8_t> data = info[0].As<Napi::Buffer<uint8_t>>();
+    Napi::Object options = info[1].As<Napi::Object>();
+    auto number = [](Napi::Object object, const char* key, int fallback) {
+        Napi::Value value = object.Get(key);
+        return value.IsNumber() ? value.As<Napi::Number>().Int32Value() : fallback;
+    };
+    
+    int width = number(options, "width", 0);
+    int height = number(options, "height", 0);
+    int channels = number(options, "channels", 3);
+    int bits = number(options, "bits", 8);
+    int transfer = number(options, "transfer", TRANSFER_SRGB);
+    
+    if (width <= 0 || height <= 0 || (channels != 3 && channels != 4) || (bits != 8 && bits != 16)) {
+        Napi::RangeError::New(env, "Expected width/height > 0, channels 3 or 4, bits 8 or 16")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (transfer == TRANSFER_DEFAULT || !IsTransferFunction(transfer)) {
+        Napi::RangeError::New(env, "Unsupported transfer").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    size_t expected = static_cast<size_t>(width) * height * channels * (bits / 8);
+    if (data.Length() < expected) {
+        Napi::RangeError::New(env, "Buffer is smaller than width * height * channels * bytes")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (bits == 16 && reinterpret_cast<uintptr_t>(data.Data()) % 2) {
+        Napi::TypeError::New(env, "16-bit data must be 2-byte aligned").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    // Bounding boxes; a missing or 0 side is unconstrained
+    Napi::Array list = options.Get("sizes").As<Napi::Array>();
+    std::vector<std::pair<int, int>> sizes;
+    for (uint32_t i = 0; i < list.Length(); i++) {
+        Napi::Value item = list.Get(i);
+        if (!item.IsObject()) {
+            Napi::TypeError::New(env, "Expected every size to be { width?, height? }").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        int max_width = number(item.As<Napi::Object>(), "width", 0);
+        int max_height = number(item.As<Napi::Object>(), "height", 0);
+        if (max_width < 0 || max_height < 0) {
+            Napi::RangeError::New(env, "Size bounds must not be negative").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        sizes.emplace_back(max_width, max_height);
+    }
+    
+    Napi::Function callback = info[2].As<Napi::Function>();
+    DerivativesWorker* worker = new DerivativesWorker(callback, data, width, height, channels, bits,
+                                                      static_cast<TransferFunction>(transfer), sizes);
+    if (options.Get("jobId").IsNumber()) {
+        worker->SetTraceJob(static_cast<uint64_t>(options.Get("jobId").As<Napi::Number>().Int64Value()));
+    }
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+// ============================================================================
+// JPEG Encoding and Decoding
+// ============================================================================
+
+Napi::Value EncodeJpegImage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsBuffer() || !info[1].IsObject() || !info[2].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (Buffer data, object options, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Buffer<uint8_t> data = info[0].As<Napi::Buffer<uint8_t>>();
+    Napi::Object options = info[1].As<Napi::Object>();
+    auto number = [&options](const char* key, int fallback) {
+        Napi::Value value = options.Get(key);
+        return value.IsNumber() ? value.As<Napi::Number>().Int32Value() : fallback;
+    };
+    
+    int width = number("width", 0);
+    int height = number("height", 0);
+    int channels = number("channels", 3);
+    int bits = number("bits", 8);
+    
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535 ||
+        (channels != 1 && channels != 3 && channels != 4) || (bits != 8 && bits != 16)) {
+        Napi::RangeError::New(env, "Expected width/height 1-65535, channels 1, 3 or 4, bits 8 or 16")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    size_t expected = static_cast<size_t>(width) * height * channels * (bits / 8);
+    if (data.Length() < expected) {
+        Napi::RangeError::New(env, "Buffer is smaller than width * height * channels * bytes")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (bits == 16 && reinterpret_cast<uintptr_t>(data.Data()) % 2) {
+        Napi::TypeError::New(env, "16-bit data must be 2-byte aligned").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    JpegOptions jpeg;
+    if (!ReadJpegOptions(options, jpeg)) {
+        Napi::RangeError::New(env, "Expected JPEG options { quality 1-100, subsampling '420' or '444', iccProfile Buffer }")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Function callback = info[2].As<Napi::Function>();
+    JpegEncodeWorker* worker = new JpegEncodeWorker(callback, data, width, height, channels, bits, std::move(jpeg));
+    if (options.Get("jobId").IsNumber()) {
+        worker->SetTraceJob(static_cast<uint64_t>(options.Get("jobId").As<Napi::Number>().Int64Value()));
+    }
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+Napi::Value DecodeJpegImage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsBuffer() || !info[info.Length() - 1].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (Buffer data, object options?, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Value options = info.Length() > 2 ? info[1] : env.Undefined();
+    int scale;
+    if (!ReadDecodeScale(options, scale)) {
+        Napi::RangeError::New(env, "Expected scale 1, 2, 4 or 8").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Function callback = info[info.Length() - 1].As<Napi::Function>();
+    JpegDecodeWorker* worker = new JpegDecodeWorker(callback, info[0].As<Napi::Buffer<uint8_t>>(), scale);
+    if (options.IsObject() && options.As<Napi::Object>().Get("jobId").IsNumber()) {
+        worker->SetTraceJob(static_cast<uint64_t>(options.As<Napi::Object>().Get("jobId").As<Napi::Number>().Int64Value()));
+    }
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+// ============================================================================
+// Metadata Writing
+// ============================================================================
+
+// One tag value: string, number, [numerator, denominator] or
+// { numerator, denominator }, or an array of strings or of numbers/pairs
+static bool ReadMetadataValue(const Napi::Value& value, MetadataValue& out) {
+    auto number = [](const Napi::Value& item, double& result) {
+        if (item.IsNumber()) {
+            result = item.As<Napi::Number>().DoubleValue();
+            return true;
+        }
+        Napi::Value numerator, denominator;
+        if (item.IsArray() && item.As<Napi::Array>().Length() == 2) {
+            numerator = item.As<Napi::Array>().Get(0u);
+            denominator = item.As<Napi::Array>().Get(1u);
+        } else if (item.IsObject() && !item.IsArray()) {
+            numerator = item.As<Napi::Object>().Get("numerator");
+            denominator = item.As<Napi::Object>().Get("denominator");
+        }
+        if (!numerator.IsNumber() || !denominator.IsNumber() || denominator.As<Napi::Number>().DoubleValue() == 0) {
+            return false;
+        }
+        result = numerator.As<Napi::Number>().DoubleValue() / denominator.As<Napi::Number>().DoubleValue();
+        return true;
+    };
+    
+    if (value.IsString()) {
+        out.kind = MetadataValue::TEXT;
+        out.text = value.As<Napi::String>().Utf8Value();
+        return true;
+    }
+    double single;
+    if (value.IsNumber() || (value.IsObject() && !value.IsArray())) {
+        out.kind = MetadataValue::NUMBERS;
+        out.numbers.assign(1, 0.0);
+        return number(value, out.numbers[0]);
+    }
+    if (!value.IsArray()) {
+        return false;
+    }
+    Napi::Array array = value.As<Napi::Array>();
+    out.kind = array.Length() > 0 && array.Get(0u).IsString() ? MetadataValue::LIST : MetadataValue::NUMBERS;
+    for (uint32_t i = 0; i < array.Length(); i++) {
+        Napi::Value item = array.Get(i);
+        if (out.kind == MetadataValue::LIST) {
+            if (!item.IsString()) return false;
+            out.list.push_back(item.As<Napi::String>().Utf8Value());
+        } else {
+            if (!number(item, single)) return false;
+            out.numbers.push_back(single);
+        }
+    }
+    return true;
+}
+
+Napi::Value WriteImageMetadata(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsBuffer() || !info[1].IsObject() || !info[info.Length() - 1].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (Buffer data, object tags, object options?, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    // Tags are validated here so mistakes throw instead of failing the write
+    Napi::Object tags = info[1].As<Napi::Object>();
+    Napi::Array names = tags.GetPropertyNames();
+    MetadataEdit edit;
+    for (uint32_t i = 0; i < names.Length(); i++) {
+        std::string name = names.Get(i).As<Napi::String>().Utf8Value();
+        Napi::Value value = tags.Get(name);
+        if (value.IsUndefined() || value.IsNull()) {
+            continue;
+        }
+        MetadataValue parsed;
+        std::string error;
+        if (!ReadMetadataValue(value, parsed)) {
+            error = "Invalid value for metadata tag " + name;
+        }
+        if (!error.empty() || !edit.Set(name, parsed, error)) {
+            Napi::RangeError::New(env, error).ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+    
+    Napi::Value options = info.Length() > 3 ? info[2] : env.Undefined();
+    Napi::Function callback = info[info.Length() - 1].As<Napi::Function>();
+    MetadataWriteWorker* worker = new MetadataWriteWorker(callback, info[0].As<Napi::Buffer<uint8_t>>(), std::move(edit));
+    if (options.IsObject() && options.As<Napi::Object>().Get("jobId").IsNumber()) {
+        worker->SetTraceJob(static_cast<uint64_t>(options.As<Napi::Object>().Get("jobId").As<Napi::Number>().Int64Value()));
+    }
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+// ============================================================================
+// FilmLabSession Class - Wraps RenderSession
+// ============================================================================
+
+class FilmLabSession : public Napi::ObjectWrap<FilmLabSession> {
+public:
+    static void Init(Napi::Env env, Napi::Object exports);
+    FilmLabSession(const Napi::CallbackInfo& info);
+
+private:
+    Napi::Value SetSource(const Napi::CallbackInfo& info);
+    Napi::Value SetMemoryLimit(const Napi::CallbackInfo& info);
+    Napi::Value Render(const Napi::CallbackInfo& info);
+    Napi::Value GetInfo(const Napi::CallbackInfo& info);
+    Napi::Value Close(const Napi::CallbackInfo& info);
+    
+    // Throws while a render worker holds the session
+    bool CheckIdle(Napi::Env env);
+    
+    std::unique_ptr<RenderSession> session_;
+};
+
+void FilmLabSession::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "FilmLabSession", {
+        InstanceMethod<&FilmLabSession::SetSource>("setSource"),
+        InstanceMethod<&FilmLabSession::SetMemoryLimit>("setMemoryLimit"),
+        InstanceMethod<&FilmLabSession::Render>("render"),
+        InstanceMethod<&FilmLabSession::GetInfo>("getInfo"),
+        InstanceMethod<&FilmLabSession::Close>("close"),
+    });
+    
+    exports.Set("FilmLabSession", func);
+}
+
+FilmLabSession::FilmLabSession(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<FilmLabSession>(info),
+      session_(std::make_unique<RenderSession>()) {
+}
+
+bool FilmLabSession::CheckIdle(Napi::Env env) {
+    if (!session_) {
+        Napi::Error::New(env, "Session is closed").ThrowAsJavaScriptException();
+        return false;
+    }
+    if (session_->Busy()) {
+        Napi::Error::New(env, "Session is rendering").ThrowAsJavaScriptException();
+        return false;
+    }
+    return true;
+}
+
+Napi::Value FilmLabSession::SetSource(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsBuffer() || !info[1].IsObject()) {
+        Napi::TypeError::New(env, "Expected (Buffer data, object { width, height, channels?, bits? })")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (!CheckIdle(env)) {
+        return env.Undefined();
+    }
+    
+    Napi::Buffer<uint8_t> data = info[0].As<Napi::Buffer<uint8_t>>();
+    Napi::Object options = info[1].As<Napi::Object>();
+    auto number = [&options](const char* key, int fallback) {
+        Napi::Value value = options.Get(key);
+        return value.IsNumber() ? value.As<Napi::Number>().Int32Value() : fallback;
+    };
+    
+    int width = number("width", 0);
+    int height = number("height", 0);
+    int channels = number("channels", 3);
+    int bits = number("bits", 8);
+    
+    if (width <= 0 || height <= 0 || (channels != 3 && channels != 4) || (bits != 8 && bits != 16)) {
+        Napi::RangeError::New(env, "Expected width/height > 0, channels 3 or 4, bits 8 or 16")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (data.Length() < static_cast<size_t>(width) * height * channels * (bits / 8)) {
+        Napi::RangeError::New(env, "Buffer is smaller than width * height * channels * bytes")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (bits == 16 && reinterpret_cast<uintptr_t>(data.Data()) % 2) {
+        Napi::TypeError::New(env, "16-bit data must be 2-byte aligned").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    session_->SetSource(data.Data(), width, height, channels, bits);
+    
+    return env.Undefined();
+}
+
+Napi::Value FilmLabSession::SetMemoryLimit(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected number bytes").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (!CheckIdle(env)) {
+        return env.Undefined();
+    }
+    
+    int64_t bytes = info[0].As<Napi::Number>().Int64Value();
+    session_->SetMemoryLimit(static_cast<size_t>(std::max<int64_t>(0, bytes)));
+    
+    return env.Undefined();
+}
+
+// Copies a Float32Array field; null/undefined leaves `out` empty
+static bool ReadFloatArray(Napi::Object object, const char* key, std::vector<float>& out) {
+    Napi::Value value = object.Get(key);
+    if (value.IsNull() || value.IsUndefined()) {
+        return true;
+    }
+    if (!value.IsTypedArray() || value.As<Napi::TypedArray>().TypedArrayType() != napi_float32_array) {
+        return false;
+    }
+    Napi::Float32Array array = value.As<Napi::Float32Array>();
+    out.assign(array.Data(), array.Data() + array.ElementLength());
+    return true;
+}
+
+static bool ReadLut3D(Napi::Object object, const char* key, FilmLabLut3D& lut) {
+    Napi::Value value = object.Get(key);
+    if (value.IsNull() || value.IsUndefined()) {
+        return true;
+    }
+    if (!value.IsObject()) {
+        return false;
+    }
+    Napi::Object entry = value.As<Napi::Object>();
+    if (!entry.Get("size").IsNumber() || !ReadFloatArray(entry, "data", lut.data)) {
+        return false;
+    }
+    lut.size = entry.Get("size").As<Napi::Number>().Int32Value();
+    if (entry.Get("intensity").IsNumber()) {
+        lut.intensity = entry.Get("intensity").As<Napi::Number>().FloatValue();
+    }
+    return true;
+}
+
+// Parses RenderCore.getNativeStages() output
+static bool ReadFilmLabStages(Napi::Object object, FilmLabStages& stages) {
+    if (!ReadFloatArray(object, "density", stages.density) || !ReadFloatArray(object, "tone", stages.tone) ||
+        !ReadLut3D(object, "lut1", stages.lut1) || !ReadLut3D(object, "lut2", stages.lut2) ||
+        !object.Get("curves").IsArray()) {
+        return false;
+    }
+    
+    Napi::Object curves = object.Get("curves").As<Napi::Object>();
+    for (uint32_t i = 0; i < 4; i++) {
+        if (!ReadFloatArray(curves, std::to_string(i).c_str(), stages.curves[i])) {
+            return false;
+        }
+    }
+    
+    std::vector<float> hsl;
+    std::vector<float> split;
+    if (!ReadFloatArray(object, "hsl", hsl) || !ReadFloatArray(object, "splitTone", split)) {
+        return false;
+    }
+    if (!hsl.empty()) {
+        if (hsl.size() != 24) return false;
+        stages.hsl_active = true;
+        std::copy(hsl.begin(), hsl.end(), stages.hsl);
+    }
+    if (!split.empty()) {
+        if (split.size() != 13) return false;
+        stages.split_active = true;
+        std::copy(split.begin(), split.end(), stages.split);
+    }
+    if (object.Get("saturation").IsNumber()) {
+        stages.saturation = object.Get("saturation").As<Napi::Number>().FloatValue();
+    }
+    
+    return stages.Valid();
+}
+
+Napi::Value FilmLabSession::Render(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsObject() || !info[1].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (object stages, function callback)").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (!CheckIdle(env)) {
+        return env.Undefined();
+    }
+    if (!session_->HasSource()) {
+        Napi::Error::New(env, "No source image set").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Object options = info[0].As<Napi::Object>();
+    FilmLabStages stages;
+    if (!ReadFilmLabStages(options, stages)) {
+        Napi::TypeError::New(env, "Expected stages from RenderCore.getNativeStages() (Float32Array tables)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Function callback = info[1].As<Napi::Function>();
+    FilmLabRenderWorker* worker = new FilmLabRenderWorker(callback, info.This().As<Napi::Object>(),
+                                                          session_.get(), std::move(stages));
+    if (options.Get("jobId").IsNumber()) {
+        worker->SetTraceJob(static_cast<uint64_t>(options.Get("jobId").As<Napi::Number>().Int64Value()));
+    }
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+Napi::Value FilmLabSession::GetInfo(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    Napi::Object result = Napi::Object::New(env);
+    Napi::Array checkpoints = Napi::Array::New(env);
+    if (session_) {
+        for (int stage = STAGE_DENSITY; stage < STAGE_COLOR; stage++) {
+            if (session_->CheckpointValid(stage)) {
+                checkpoints.Set(checkpoints.Length(), Napi::String::New(env, FilmLabStageName(stage)));
+            }
+        }
+    }
+    result.Set("width", Napi::Number::New(env, session_ ? session_->Width() : 0));
+    result.Set("height", Napi::Number::New(env, session_ ? session_->Height() : 0));
+    result.Set("checkpoints", checkpoints);
+    result.Set("checkpointBytes", Napi::Number::New(env, session_ ? static_cast<double>(session_->CheckpointBytes()) : 0));
+    result.Set("busy", Napi::Boolean::New(env, session_ && session_->Busy()));
+    
+    return result;
+}
+
+Napi::Value FilmLabSession::Close(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (!CheckIdle(env)) {
+        return env.Undefined();
+    }
+    session_.reset();
+    
+    return env.Undefined();
+}
+
+// ============================================================================
+// FilmLabEditSession Class - Wraps EditSession
+// ============================================================================
+
+class FilmLabEditSession : public Napi::ObjectWrap<FilmLabEditSession> {
+public:
+    static void Init(Napi::Env env, Napi::Object exports);
+    FilmLabEditSession(const Napi::CallbackInfo& info);
+
+private:
+    Napi::Value SetSource(const Napi::CallbackInfo& info);
+    Napi::Value SetMemoryLimit(const Napi::CallbackInfo& info);
+    Napi::Value Render(const Napi::CallbackInfo& info);
+    Napi::Value Cancel(const Napi::CallbackInfo& info);
+    Napi::Value GetInfo(const Napi::CallbackInfo& info);
+    Napi::Value Close(const Napi::CallbackInfo& info);
+    
+    // Throws while a worker holds the session
+    bool CheckIdle(Napi::Env env);
+    
+    std::unique_ptr<EditSession> session_;
+};
+
+void FilmLabEditSession::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "FilmLabEditSession", {
+        InstanceMethod<&FilmLabEditSession::SetSource>("setSource"),
+        InstanceMethod<&FilmLabEditSession::SetMemoryLimit>("setMemoryLimit"),
+        InstanceMethod<&FilmLabEditSession::Render>("render"),
+        InstanceMethod<&FilmLabEditSession::Cancel>("cancel"),
+        InstanceMethod<&FilmLabEditSession::GetInfo>("getInfo"),
+        InstanceMethod<&FilmLabEditSession::Close>("close"),
+    });
+    
+    exports.Set("FilmLabEditSession", func);
+}
+
+FilmLabEditSession::FilmLabEditSession(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<FilmLabEditSession>(info),
+      session_(std::make_unique<EditSession>()) {
+}
+
+bool FilmLabEditSession::CheckIdle(Napi::Env env) {
+    if (!session_) {
+        Napi::Error::New(env, "Session is closed").ThrowAsJavaScriptException();
+        return false;
+    }
+    if (session_->Busy()) {
+        Napi::Error::New(env, "Session is busy").ThrowAsJavaScriptException();
+        return false;
+    }
+    return true;
+}
+
+Napi::Value FilmLabEditSession::SetSource(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsBuffer() || !info[1].IsObject() || !info[2].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (Buffer data, object { width, height, channels?, bits?, minLevelSize? }, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (!CheckIdle(env)) {
+        return env.Undefined();
+    }
+    
+    Napi::Buffer<uint8_t> data = info[0].As<Napi::Buffer<uint8_t>>();
+    Napi::Object options = info[1].As<Napi::Object>();
+    auto number = [&options](const char* key, int fallback) {
+        Napi::Value value = options.Get(key);
+        return value.IsNumber() ? value.As<Napi::Number>().Int32Value() : fallback;
+    };
+    
+    int width = number("width", 0);
+    int height = number("height", 0);
+    int channels = number("channels", 3);
+    int bits = number("bits", 8);
+    int min_size = number("minLevelSize", 256);
+    
+    if (width <= 0 || height <= 0 || (channels != 3 && channels != 4) || (bits != 8 && bits != 16)) {
+        Napi::RangeError::New(env, "Expected width/height > 0, channels 3 or 4, bits 8 or 16")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (data.Length() < static_cast<size_t>(width) * height * channels * (bits / 8)) {
+        Napi::RangeError::New(env, "Buffer is smaller than width * height * channels * bytes")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (bits == 16 && reinterpret_cast<uintptr_t>(data.Data()) % 2) {
+        Napi::TypeError::New(env, "16-bit data must be 2-byte aligned").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Function callback = info[2].As<Napi::Function>();
+    EditSourceWorker* worker = new EditSourceWorker(callback, info.This().As<Napi::Object>(), session_.get(),
+                                                    data, width, height, channels, bits, min_size);
+    if (options.Get("jobId").IsNumber()) {
+        worker->SetTraceJob(static_cast<uint64_t>(options.Get("jobId").As<Napi::Number>().Int64Value()));
+    }
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+Napi::Value FilmLabEditSession::SetMemoryLimit(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected number bytes").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (!CheckIdle(env)) {
+        return env.Undefined();
+    }
+    
+    int64_t bytes = info[0].As<Napi::Number>().Int64Value();
+    session_->SetMemoryLimit(static_cast<size_t>(std::max<int64_t>(0, bytes)));
+    
+    return env.Undefined();
+}
+
+Napi::Value FilmLabEditSession::Render(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsObject() || !info[1].IsObject() || !info[2].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (object stages, object viewport, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (!CheckIdle(env)) {
+        return env.Undefined();
+    }
+    if (!session_->HasSource()) {
+        Napi::Error::New(env, "No source image set").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Object options = info[0].As<Napi::Object>();
+    FilmLabStages stages;
+    if (!ReadFilmLabStages(options, stages)) {
+        Napi::TypeError::New(env, "Expected stages from RenderCore.getNativeStages() (Float32Array tables)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    // Region in full-resolution pixels (default: whole image) and output size
+    Napi::Object view = info[1].As<Napi::Object>();
+    auto real = [&view](const char* key, double fallback) {
+        Napi::Value value = view.Get(key);
+        return value.IsNumber() ? value.As<Napi::Number>().DoubleValue() : fallback;
+    };
+    EditViewport viewport;
+    viewport.x = real("x", 0);
+    viewport.y = real("y", 0);
+    viewport.width = real("width", session_->Width());
+    viewport.height = real("height", session_->Height());
+    viewport.out_width = static_cast<int>(real("outWidth", 0));
+    viewport.out_height = static_cast<int>(real("outHeight", 0));
+    if (!(viewport.width > 0) || !(viewport.height > 0) || viewport.out_width <= 0 || viewport.out_height <= 0 ||
+        static_cast<int64_t>(viewport.out_width) * viewport.out_height > (static_cast<int64_t>(1) << 28)) {
+        Napi::RangeError::New(env, "Expected viewport width/height > 0 and outWidth/outHeight > 0")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Function callback = info[2].As<Napi::Function>();
+    EditRenderWorker* worker = new EditRenderWorker(callback, info.This().As<Napi::Object>(),
+                                                    session_.get(), std::move(stages), viewport);
+    if (options.Get("jobId").IsNumber()) {
+        worker->SetTraceJob(static_cast<uint64_t>(options.Get("jobId").As<Napi::Number>().Int64Value()));
+    }
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+Napi::Value FilmLabEditSession::Cancel(const Napi::CallbackInfo& info) {
+    if (session_) {
+        session_->Cancel();
+    }
+    return info.Env().Undefined();
+}
+
+Napi::Value FilmLabEditSession::GetInfo(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    Napi::Object result = Napi::Object::New(env);
+    Napi::Array levels = Napi::Array::New(env);
+    Napi::Array checkpoints = Napi::Array::New(env);
+    if (session_) {
+        for (int i = 0; i < session_->LevelCount(); i++) {
+            Napi::Object level = Napi::Object::New(env);
+            level.Set("width", Napi::Number::New(env, session_->LevelWidth(i)));
+            level.Set("height", Napi::Number::New(env, session_->LevelHeight(i)));
+            levels.Set(static_cast<uint32_t>(i), level);
+        }
+        for (int stage = STAGE_DENSITY; stage < STAGE_COLOR; stage++) {
+            if (session_->ViewportSession().CheckpointValid(stage)) {
+                checkpoints.Set(checkpoints.Length(), Napi::String::New(env, FilmLabStageName(stage)));
+            }
+        }
+    }
+    result.Set("width", Napi::Number::New(env, session_ ? session_->Width() : 0));
+    result.Set("height", Napi::Number::New(env, session_ ? session_->Height() : 0));
+    result.Set("levels", levels);
+    result.Set("pyramidBytes", Napi::Number::New(env, session_ ? static_cast<double>(session_->PyramidBytes()) : 0));
+    result.Set("checkpoints", checkpoints);
+    result.Set("busy", Napi::Boolean::New(env, session_ && session_->Busy()));
+    
+    return result;
+}
+
+Napi::Value FilmLabEditSession::Close(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (!CheckIdle(env)) {
+        return env.Undefined();
+    }
+    session_.reset();
+    
+    return env.Undefined();
+}
+
+// ============================================================================
+// FilmLab Previews
+// ============================================================================
+
+// Source pixels of a preview image ({ data, width, height, channels?,
+// bits? }); throws the JS exception itself when invalid
+static bool ReadPreviewImage(Napi::Env env, Napi::Object object, PreviewImage& image) {
+    auto number = [&object](const char* key, int fallback) {
+        Napi::Value value = object.Get(key);
+        return value.IsNumber() ? value.As<Napi::Number>().Int32Value() : fallback;
+    };
+    Napi::Buffer<uint8_t> data = object.Get("data").As<Napi::Buffer<uint8_t>>();
+    
+    image.width = number("width", 0);
+    image.height = number("height", 0);
+    image.channels = number("channels", 3);
+    image.bits = number("bits", 8);
+    image.src = data.Data();
+    image.kernel = 0;
+    image.out = nullptr;
+    if (image.width <= 0 || image.height <= 0 || (image.channels != 3 && image.channels != 4) ||
+        (image.bits != 8 && image.bits != 16)) {
+        Napi::RangeError::New(env, "Expected width/height > 0, channels 3 or 4, bits 8 or 16")
+            .ThrowAsJavaScriptException();
+        return false;
+    }
+    size_t expected = static_cast<size_t>(image.width) * image.height * image.channels * (image.bits / 8);
+    if (data.Length() < expected) {
+        Napi::RangeError::New(env, "Buffer is smaller than width * height * channels * bytes")
+            .ThrowAsJavaScriptException();
+        return false;
+    }
+    if (image.bits == 16 && reinterpret_cast<uintptr_t>(data.Data()) % 2) {
+        Napi::TypeError::New(env, "16-bit data must be 2-byte aligned").ThrowAsJavaScriptException();
+        return false;
+    }
+    return true;
+}
+
+Napi::Value RenderPreviews(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsArray() || !info[1].IsObject() || !info[2].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (Array images, object options, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Array list = info[0].As<Napi::Array>();
+    Napi::Object options = info[1].As<Napi::Object>();
+    
+    // Stage objects are parsed once each (images of a roll usually share
+    // one); a kernel is one (stages, bits) pair
+    std::vector<Napi::Object> stage_objects;
+    std::vector<FilmLabStages> stages;
+    std::vector<std::pair<size_t, int>> kernel_keys;
+    std::vector<Napi::Buffer<uint8_t>> sources;
+    std::vector<PreviewImage> images;
+    
+    for (uint32_t i = 0; i < list.Length(); i++) {
+        Napi::Value item = list.Get(i);
+        if (!item.IsObject() || !item.As<Napi::Object>().Get("data").IsBuffer()) {
+            Napi::TypeError::New(env, "Expected every image to be { data: Buffer, width, height, channels?, bits?, stages? }")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        Napi::Object object = item.As<Napi::Object>();
+        Napi::Buffer<uint8_t> data = object.Get("data").As<Napi::Buffer<uint8_t>>();
+        PreviewImage image;
+        if (!ReadPreviewImage(env, object, image)) {
+            return env.Undefined();
+        }
+        
+        Napi::Value stage_value = object.Get("stages").IsObject() ? object.Get("stages") : options.Get("stages");
+        if (!stage_value.IsObject()) {
+            Napi::TypeError::New(env, "Expected stages from RenderCore.getNativeStages() per image or in options")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        size_t stage_index = 0;
+        while (stage_index < stage_objects.size() && !stage_objects[stage_index].StrictEquals(stage_value)) {
+            stage_index++;
+        }
+        if (stage_index == stage_objects.size()) {
+            FilmLabStages parsed;
+            if (!ReadFilmLabStages(stage_value.As<Napi::Object>(), parsed)) {
+                Napi::TypeError::New(env, "Expected stages from RenderCore.getNativeStages() (Float32Array tables)")
+                    .ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            stage_objects.push_back(stage_value.As<Napi::Object>());
+            stages.push_back(std::move(parsed));
+        }
+        
+        std::pair<size_t, int> key(stage_index, image.bits);
+        image.kernel = std::find(kernel_keys.begin(), kernel_keys.end(), key) - kernel_keys.begin();
+        if (image.kernel == kernel_keys.size()) {
+            kernel_keys.push_back(key);
+        }
+        sources.push_back(data);
+        images.push_back(image);
+    }
+    
+    std::vector<size_t> stage_of_kernel;
+    for (const auto& key : kernel_keys) {
+        stage_of_kernel.push_back(key.first);
+    }
+    
+    Napi::Function callback = info[2].As<Napi::Function>();
+    FilmLabPreviewWorker* worker = new FilmLabPreviewWorker(callback, std::move(stages), sources, images,
+                                                            std::move(stage_of_kernel));
+    if (options.Get("jobId").IsNumber()) {
+        worker->SetTraceJob(static_cast<uint64_t>(options.Get("jobId").As<Napi::Number>().Int64Value()));
+    }
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+Napi::Value RenderVariants(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 4 || !info[0].IsObject() || !info[1].IsArray() || !info[2].IsObject() ||
+        !info[3].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (object image, Array stages, object options, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Object object = info[0].As<Napi::Object>();
+    if (!object.Get("data").IsBuffer()) {
+        Napi::TypeError::New(env, "Expected image to be { data: Buffer, width, height, channels?, bits? }")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    Napi::Buffer<uint8_t> data = object.Get("data").As<Napi::Buffer<uint8_t>>();
+    PreviewImage image;
+    if (!ReadPreviewImage(env, object, image)) {
+        return env.Undefined();
+    }
+    
+    // One kernel per distinct stages object; every variant shares the source
+    Napi::Array list = info[1].As<Napi::Array>();
+    Napi::Object options = info[2].As<Napi::Object>();
+    std::vector<Napi::Object> stage_objects;
+    std::vector<FilmLabStages> stages;
+    std::vector<PreviewImage> variants;
+    for (uint32_t i = 0; i < list.Length(); i++) {
+        Napi::Value stage_value = list.Get(i);
+        if (!stage_value.IsObject()) {
+            Napi::TypeError::New(env, "Expected every variant to be stages from RenderCore.getNativeStages()")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        size_t stage_index = 0;
+        while (stage_index < stage_objects.size() && !stage_objects[stage_index].StrictEquals(stage_value)) {
+            stage_index++;
+        }
+        if (stage_index == stage_objects.size()) {
+            FilmLabStages parsed;
+            if (!ReadFilmLabStages(stage_value.As<Napi::Object>(), parsed)) {
+                Napi::TypeError::New(env, "Expected stages from RenderCore.getNativeStages() (Float32Array tables)")
+                    .ThrowAsJavaScriptException();
+                return env.Undefined();
+            }
+            stage_objects.push_back(stage_value.As<Napi::Object>());
+            stages.push_back(std::move(parsed));
+        }
+        image.kernel = stage_index;
+        variants.push_back(image);
+    }
+    
+    std::vector<size_t> stage_of_kernel;
+    for (size_t k = 0; k < stages.size(); k++) {
+        stage_of_kernel.push_back(k);
+    }
+    
+    Napi::Function callback = info[3].As<Napi::Function>();
+    FilmLabPreviewWorker* worker = new FilmLabPreviewWorker(callback, std::move(stages), { data }, variants,
+                                                            std::move(stage_of_kernel), true);
+    if (options.Get("jobId").IsNumber()) {
+        worker->SetTraceJob(static_cast<uint64_t>(options.Get("jobId").As<Napi::Number>().Int64Value()));
+    }
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+Napi::Value RenderTiledImage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 4 || !info[0].IsString() || !info[1].IsObject() || !info[2].IsObject() ||
+        !info[3].IsFunction()) {
+        Napi::TypeError::New(env, "Expected (string inputPath, object stages, object options, function callback)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    FilmLabStages stages;
+    if (!ReadFilmLabStages(info[1].As<Napi::Object>(), stages)) {
+        Napi::TypeError::New(env, "Expected stages from RenderCore.getNativeStages() (Float32Array tables)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Object options = info[2].As<Napi::Object>();
+    TiledRenderOptions render;
+    if (!ReadJpegOptions(options, render.jpeg)) {
+        Napi::RangeError::New(env, "Expected JPEG options { quality 1-100, subsampling '420' or '444', iccProfile Buffer }")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Value format = options.Get("format");
+    std::string name = format.IsString() ? format.As<Napi::String>().Utf8Value() : "jpeg";
+    if (name == "tiff16") {
+        render.format = TILED_RENDER_TIFF16;
+    } else if (name != "jpeg") {
+        Napi::RangeError::New(env, "Expected format 'jpeg' or 'tiff16'").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (options.Get("outputPath").IsString()) {
+        render.output_path = options.Get("outputPath").As<Napi::String>().Utf8Value();
+    }
+    if (render.format == TILED_RENDER_TIFF16 && render.output_path.empty()) {
+        Napi::TypeError::New(env, "Expected outputPath for tiff16 output").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    Napi::Value region = options.Get("region");
+    if (region.IsObject()) {
+        Napi::Object rect = region.As<Napi::Object>();
+        auto side = [&rect](const char* key) {
+            Napi::Value value = rect.Get(key);
+            return value.IsNumber() ? value.As<Napi::Number>().Int32Value() : -1;
+        };
+        render.left = side("left");
+        render.top = side("top");
+        render.width = side("width");
+        render.height = side("height");
+        if (render.left < 0 || render.top < 0 || render.width <= 0 || render.height <= 0) {
+            Napi::RangeError::New(env, "Expected region { left, top, width, height } with a positive size")
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    } else if (!region.IsUndefined() && !region.IsNull()) {
+        Napi::TypeError::New(env, "Expected region to be an object").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    if (options.Get("stripRows").IsNumber()) {
+        render.strip_rows = options.Get("stripRows").As<Napi::Number>().Int32Value();
+        if (render.strip_rows < 1) {
+            Napi::RangeError::New(env, "Expected stripRows >= 1").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+    }
+    
+    Napi::Function callback = info[3].As<Napi::Function>();
+    TiledRenderWorker* worker = new TiledRenderWorker(callback, info[0].As<Napi::String>().Utf8Value(),
+                                                      std::move(stages), std::move(render));
+    if (options.Get("jobId").IsNumber()) {
+        worker->SetTraceJob(static_cast<uint64_t>(options.Get("jobId").As<Napi::Number>().Int64Value()));
+    }
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+// ============================================================================
+// Tracing
+// ============================================================================
+
+Napi::Value EnableTracing(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    size_t capacity = 65536;
+    if (info.Length() > 0 && !info[0].IsUndefined()) {
+        if (!info[0].IsNumber()) {
+            Napi::TypeError::New(env, "Trace capacity must be a number").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        double requested = info[0].As<Napi::Number>().DoubleValue();
+        if (!(requested >= 0 && requested <= double(TRACE_MAX_CAPACITY)) || requested != std::floor(requested)) {
+            Napi::RangeError::New(env, "Trace capacity must be an integer up to " + std::to_string(TRACE_MAX_CAPACITY))
+                .ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        if (requested > 0) capacity = static_cast<size_t>(requested);
+    }
+    
+    TraceEnable(capacity);
+    
+    return env.Undefined();
+}
+
+Napi::Value DisableTracing(const Napi::CallbackInfo& info) {
+    TraceDisable();
+    return info.Env().Undefined();
+}
+
+Napi::Value IsTracingEnabled(const Napi::CallbackInfo& info) {
+    return Napi::Boolean::New(info.Env(), TraceIsEnabled());
+}
+
+Napi::Value GetTraceNow(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), static_cast<double>(TraceNow()));
+}
+
+Napi::Value RecordTraceSpan(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 4 || !info[0].IsString() || !info[1].IsString() ||
+        !info[2].IsNumber() || !info[3].IsNumber()) {
+        Napi::TypeError::New(env, "Expected (string name, string category, number startUs, number endUs, number jobId?, boolean async?)")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    if (!TraceIsEnabled()) {
+        return env.Undefined();
+    }
+    
+    std::string name = info[0].As<Napi::String>().Utf8Value();
+    std::string category = info[1].As<Napi::String>().Utf8Value();
+    uint64_t start = static_cast<uint64_t>(info[2].As<Napi::Number>().Int64Value());
+    uint64_t end = static_cast<uint64_t>(info[3].As<Napi::Number>().Int64Value());
+    uint64_t job = 0;
+    if (info.Length() > 4 && info[4].IsNumber()) {
+        job = static_cast<uint64_t>(info[4].As<Napi::Number>().Int64Value());
+    }
+    
+    // Awaited JS stages overlap on the main thread, so they go on async tracks
+    bool async = info.Length() > 5 && info[5].IsBoolean() && info[5].As<Napi::Boolean>().Value();
+    if (async) {
+        TraceRecordAsync(name.c_str(), category.c_str(), start, end, job);
+    } else {
+        TraceRecord(name.c_str(), category.c_str(), start, end, job);
+    }
+    
+    return env.Undefined();
+}
+
+Napi::Value DumpTrace(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    uint64_t since = 0;
+    uint64_t until = 0;
+    uint64_t job = 0;
+    
+    if (info.Length() > 0 && info[0].IsObject()) {
+        Napi::Object options = info[0].As<Napi::Object>();
+        if (options.Get("since").IsNumber()) {
+            since = static_cast<uint64_t>(options.Get("since").As<Napi::Number>().Int64Value());
+        }
+        if (options.Get("until").IsNumber()) {
+            until = static_cast<uint64_t>(options.Get("until").As<Napi::Number>().Int64Value());
+        }
+        if (options.Get("jobId").IsNumber()) {
+            job = static_cast<uint64_t>(options.Get("jobId").As<Napi::Number>().Int64Value());
+        }
+    }
+    
+    return Napi::String::New(env, TraceDumpJson(since, until, job));
+}
+
+// ============================================================================
+// Module Initialization
+// ============================================================================
+
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    // Build the camera index up front so lookups never pay for it
+    CameraIndex::Instance();
+    
+    // Initialize the LibRawProcessor class
+    LibRawProcessor::Init(env, exports);
+    FilmLabSession::Init(env, exports);
+    FilmLabEditSession::Init(env, exports);
     
     // Add module-level functions
     exports.Set("getVersion", Napi::Function::New<GetVersion>(env, "getVersion"));
     exports.Set("getCameraList", Napi::Function::New<GetCameraList>(env, "getCameraList"));
     exports.Set("getCameraCount", Napi::Function::New<GetCameraCount>(env, "getCameraCount"));
     exports.Set("isSupportedCamera", Napi::Function::New<IsSupportedCamera>(env, "isSupportedCamera"));
+    exports.Set("lookupCamera", Napi::Function::New<LookupCamera>(env, "lookupCamera"));
+    exports.Set("lookupCameras", Napi::Function::New<LookupCameras>(env, "lookupCameras"));
+    exports.Set("getMetadataSchema", Napi::Function::New<GetMetadataSchema>(env, "getMetadataSchema"));
+    exports.Set("readMetadataBatch", Napi::Function::New<ReadMetadataBatch>(env, "readMetadataBatch"));
+    exports.Set("convertColorSpace", Napi::Function::New<ConvertColorSpace>(env, "convertColorSpace"));
+    exports.Set("getColorProfile", Napi::Function::New<GetColorProfile>(env, "getColorProfile"));
+    exports.Set("buildDerivatives", Napi::Function::New<BuildDerivatives>(env, "buildDerivatives"));
+    exports.Set("encodeJpeg", Napi::Function::New<EncodeJpegImage>(env, "encodeJpeg"));
+    exports.Set("decodeJpeg", Napi::Function::New<DecodeJpegImage>(env, "decodeJpeg"));
+    exports.Set("writeMetadata", Napi::Function::New<WriteImageMetadata>(env, "writeMetadata"));
+    exports.Set("renderPreviews", Napi::Function::New<RenderPreviews>(env, "renderPreviews"));
+    exports.Set("renderVariants", Napi::Function::New<RenderVariants>(env, "renderVariants"));
+    exports.Set("renderTiled", Napi::Function::New<RenderTiledImage>(env, "renderTiled"));
+    
+    // Tracing
+    exports.Set("enableTracing", Napi::Function::New<EnableTracing>(env, "enableTracing"));
+    exports.Set("disableTracing", Napi::Function::New<DisableTracing>(env, "disableTracing"));
+    exports.Set("isTracingEnabled", Napi::Function::New<IsTracingEnabled>(env, "isTracingEnabled"));
+    exports.Set("traceNow", Napi::Function::New<GetTraceNow>(env, "traceNow"));
+    exports.Set("recordTraceSpan", Napi::Function::New<RecordTraceSpan>(env, "recordTraceSpan"));
+    exports.Set("dumpTrace", Napi::Function::New<DumpTrace>(env, "dumpTrace"));
+    exports.Set("TRACE_MAX_CAPACITY", Napi::Number::New(env, static_cast<double>(TRACE_MAX_CAPACITY)));
     
     // Color space constants
     Napi::Object colorSpace = Napi::Object::New(env);
@@ -709,6 +2594,16 @@ Napi::Object Init(Napi::Env env, Napi::Object exports) {
     colorSpace.Set("REC2020", Napi::Number::New(env, 8));
     exports.Set("ColorSpace", colorSpace);
     
+    // Transfer function constants (convertColorSpace/setExportColorSpace)
+    Napi::Object transfer = Napi::Object::New(env);
+    transfer.Set("DEFAULT", Napi::Number::New(env, TRANSFER_DEFAULT));
+    transfer.Set("LINEAR", Napi::Number::New(env, TRANSFER_LINEAR));
+    transfer.Set("SRGB", Napi::Number::New(env, TRANSFER_SRGB));
+    transfer.Set("GAMMA22", Napi::Number::New(env, TRANSFER_GAMMA22));
+    transfer.Set("GAMMA18", Napi::Number::New(env, TRANSFER_GAMMA18));
+    transfer.Set("BT709", Napi::Number::New(env, TRANSFER_BT709));
+    exports.Set("Transfer", transfer);
+    
     // Demosaic quality constants
     Napi::Object quality = Napi::Object::New(env);
     quality.Set("LINEAR", Napi::Number::New(env, 0));
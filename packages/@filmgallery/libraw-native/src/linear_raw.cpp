@@ -0,0 +1,378 @@
+/**
+ * @filmgallery/libraw-native - LinearRaw Fast Path
+ *
+ * Film scanners write already-demosaiced (LinearRaw) DNGs: three samples per
+ * pixel and no CFA. dcraw_process() still copies them into its ushort[4]
+ * image and then walks that image once per stage (black subtraction, white
+ * balance scaling, colour conversion and histogram) although none of them
+ * looks at neighbouring pixels. Here the stages are fused into one threaded
+ * pass from LibRaw's decoded samples into a 3-sample linear image, with
+ * LibRaw's arithmetic, so CopyMemImageRows() produces the same pixels.
+ *
+ * Options that need the full pipeline (auto white balance, highlight
+ * blending/rebuilding, wavelet denoise, median filter, ICC profiles, crop
+ * boxes, processing callbacks, ...) keep using dcraw_process().
+ */
+
+#include "film_libraw.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Largest black-subtracted sample of a row (subtract_black_internal()'s
+// data_maximum), for adjust_maximum() before anything is scaled
+CPU_INLINE int RowMaximumBody(const ushort* src, const int* black, size_t n) {
+    int dmax = 0;
+    for (size_t i = 0; i < n; i++) {
+        dmax = std::max(dmax, src[i] - black[i]);
+    }
+    return dmax;
+}
+
+CPU_DISPATCH_KERNEL(int, RowMaximum, RowMaximumBody,
+                    (const ushort* src, const int* black, size_t n), (src, black, n))
+
+// Black subtraction then white balance scaling (scale_colors_loop()) of
+// interleaved samples; returns the row's data_maximum
+CPU_INLINE int ScaleRowBody(const ushort* src, const int* black, const float* mul, int* out, size_t n) {
+    int dmax = 0;
+    for (size_t i = 0; i < n; i++) {
+        int val = std::min(std::max(src[i] - black[i], 0), 65535);
+        dmax = std::max(dmax, val);
+        out[i] = std::min(std::max(static_cast<int>(val * mul[i]), 0), 65535);
+    }
+    return dmax;
+}
+
+CPU_DISPATCH_KERNEL(int, ScaleRow, ScaleRowBody,
+                    (const ushort* src, const int* black, const float* mul, int* out, size_t n),
+                    (src, black, mul, out, n))
+
+// convert_to_rgb_loop() for 3 colours, same float evaluation order. STEP
+// (3 or 4 samples per input pixel) is a constant so the loads vectorize.
+template <int STEP>
+CPU_INLINE void ConvertRowBody(const int* in, const float* m, ushort* out, size_t pixels) {
+    for (size_t i = 0; i < pixels; i++) {
+        float r = static_cast<float>(in[i * STEP]);
+        float g = static_cast<float>(in[i * STEP + 1]);
+        float b = static_cast<float>(in[i * STEP + 2]);
+        for (int c = 0; c < 3; c++) {
+            int val = static_cast<int>(m[c * 3] * r + m[c * 3 + 1] * g + m[c * 3 + 2] * b);
+            out[i * 3 + c] = static_cast<ushort>(std::min(std::max(val, 0), 65535));
+        }
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, ConvertRow3, ConvertRowBody<3>,
+                    (const int* in, const float* m, ushort* out, size_t pixels), (in, m, out, pixels))
+CPU_DISPATCH_KERNEL(void, ConvertRow4, ConvertRowBody<4>,
+                    (const int* in, const float* m, ushort* out, size_t pixels), (in, m, out, pixels))
+
+} // namespace
+
+void FilmLibRaw::recycle() {
+    linear_image_.reset();
+    mono_image_.reset();
+    LibRaw::recycle();
+}
+
+bool FilmLibRaw::LinearFastPathEligible() const {
+    const libraw_rawdata_t& raw = imgdata.rawdata;
+    const libraw_output_params_t& params = imgdata.params;
+
+    if (!linear_fast_path_ ||
+        (imgdata.progress_flags & LIBRAW_PROGRESS_THUMB_MASK) < LIBRAW_PROGRESS_LOAD_RAW ||
+        !(raw.color3_image || raw.color4_image) ||
+        raw.iparams.filters || raw.iparams.colors != 3 || raw.iparams.is_foveon ||
+        raw.ioparams.zero_is_bad || raw.ioparams.mix_green || raw.ioparams.fuji_width) {
+        return false;
+    }
+
+    // Stages that look at neighbouring pixels or need the whole image first
+    if ((~params.cropbox[2] && ~params.cropbox[3]) || params.bad_pixels || params.dark_frame ||
+        params.threshold || params.exp_correc > 0 || params.med_passes > 0 ||
+        params.highlight >= 2 || params.camera_profile ||
+        (params.use_fuji_rotate && raw.sizes.pixel_aspect != 1)) {
+        return false;
+    }
+    for (int c = 0; c < 4; c += 2) {
+        float aber = params.aber[c];
+        if (aber >= 0.001f && aber <= 1000.f && aber != 1) return false;
+    }
+
+    // Auto white balance averages the image before scaling
+    const float* cam_mul = raw.color.cam_mul;
+    if (params.use_auto_wb ||
+        (params.use_camera_wb &&
+         (cam_mul[0] < -0.5 ||
+          (cam_mul[0] <= 0.00001f &&
+           !(imgdata.rawparams.options & LIBRAW_RAWOPTIONS_CAMERAWB_FALLBACK_TO_DAYLIGHT))))) {
+        return false;
+    }
+
+    return !(callbacks.pre_subtractblack_cb || callbacks.pre_scalecolors_cb ||
+             callbacks.pre_preinterpolate_cb || callbacks.pre_interpolate_cb ||
+             callbacks.post_interpolate_cb || callbacks.pre_converttorgb_cb ||
+             callbacks.post_converttorgb_cb);
+}
+
+int FilmLibRaw::Process() {
+    mono_image_.reset();
+    if (MonochromeEligible()) {
+        linear_image_.reset();
+        return ProcessMonochrome();
+    }
+    if (LinearFastPathEligible()) {
+        return ProcessLinear();
+    }
+    linear_image_.reset();
+    if (PhaseOneCalibrationPending()) {
+        return ProcessPhaseOne();
+    }
+    return dcraw_process();
+}
+
+/**
+ * scale_colors() multipliers for the white balance modes the fast paths
+ * take (no auto white balance). Without a CFA the camera's white[][] patch
+ * only ever sums channel 0, so LibRaw uses cam_mul as-is.
+ */
+void FilmLibRaw::ScaleMultipliers(float scale_mul[4]) {
+    libraw_colordata_t& color = imgdata.color;
+    const libraw_output_params_t& params = imgdata.params;
+
+    if (params.user_mul[0]) {
+        memcpy(color.pre_mul, params.user_mul, sizeof color.pre_mul);
+    }
+    if (params.use_camera_wb && color.cam_mul[0] > 0.00001f) {
+        unsigned sum[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        for (int row = 0; row < 8; row++) {
+            for (int col = 0; col < 8; col++) {
+                int c = FC(row, col);
+                int val = color.white[row][col] - color.cblack[c];
+                if (val > 0) sum[c] += val;
+                sum[c + 4]++;
+            }
+        }
+        if (color.as_shot_wb_applied) {
+            color.pre_mul[0] = color.pre_mul[1] = color.pre_mul[2] = color.pre_mul[3] = 1.0;
+        } else if (sum[0] && sum[1] && sum[2] && sum[3]) {
+            for (int c = 0; c < 4; c++) color.pre_mul[c] = static_cast<float>(sum[c + 4]) / sum[c];
+        } else if (color.cam_mul[0] > 0.00001f && color.cam_mul[2] > 0.00001f) {
+            memcpy(color.pre_mul, color.cam_mul, sizeof color.pre_mul);
+        } else {
+            imgdata.process_warnings |= LIBRAW_WARN_BAD_CAMERA_WB;
+        }
+    }
+    // Nikon sRAW, daylight
+    if (color.as_shot_wb_applied && !params.use_camera_wb && !params.use_auto_wb &&
+        color.cam_mul[0] > 0.00001f && color.cam_mul[1] > 0.00001f && color.cam_mul[2] > 0.00001f) {
+        for (int c = 0; c < 3; c++) color.pre_mul[c] /= color.cam_mul[c];
+    }
+    if (color.pre_mul[1] == 0) color.pre_mul[1] = 1;
+    if (color.pre_mul[3] == 0) color.pre_mul[3] = color.pre_mul[1];
+
+    color.maximum -= color.black;
+    double dmin = DBL_MAX, dmax = 0;
+    for (int c = 0; c < 4; c++) {
+        dmin = std::min<double>(dmin, color.pre_mul[c]);
+        dmax = std::max<double>(dmax, color.pre_mul[c]);
+    }
+    if (!params.highlight) dmax = dmin;
+    for (int c = 0; c < 4; c++) {
+        if (dmax > 0.00001 && color.maximum > 0) {
+            scale_mul[c] = (color.pre_mul[c] /= float(dmax)) * 65535.f / color.maximum;
+        } else {
+            scale_mul[c] = 1.0;
+        }
+    }
+}
+
+int FilmLibRaw::ProcessLinear() {
+    try {
+        free_image();
+        raw2image_start();
+
+        libraw_decoder_info_t decoder_info;
+        get_decoder_info(&decoder_info);
+
+        libraw_colordata_t& color = imgdata.color;
+        const libraw_image_sizes_t& sizes = imgdata.sizes;
+        libraw_internal_output_params_t& io = libraw_internal_data.internal_output_params;
+
+        // Samples as raw2image_ex() reads them: rows past the decoded area are 0
+        const bool four = imgdata.rawdata.color4_image != nullptr;
+        const int step = four ? 4 : 3;
+        const uint8_t* base = four ? reinterpret_cast<const uint8_t*>(imgdata.rawdata.color4_image)
+                                   : reinterpret_cast<const uint8_t*>(imgdata.rawdata.color3_image);
+        const int width = sizes.width;
+        const int height = sizes.height;
+        const int copy_height = std::max(0, std::min<int>(height, int(sizes.raw_height) - int(sizes.top_margin)));
+        const int copy_width = std::max(0, std::min<int>(width, int(sizes.raw_width) - int(sizes.left_margin)));
+        const bool packed = four && sizes.raw_pitch == sizes.width * 8u && sizes.height == sizes.raw_height;
+        auto source_row = [&](int row) -> const ushort* {
+            if (packed) {
+                return reinterpret_cast<const ushort*>(base) + static_cast<size_t>(row) * width * 4;
+            }
+            return reinterpret_cast<const ushort*>(base + static_cast<size_t>(row + sizes.top_margin) * sizes.raw_pitch) +
+                   static_cast<size_t>(sizes.left_margin) * step;
+        };
+
+        // Black levels: adjust_bl(), then subtract_black_internal() with its
+        // per-channel and repeating pattern parts
+        adjust_bl();
+        int cblack[4];
+        for (int c = 0; c < 4; c++) cblack[c] = color.cblack[c];
+        const int pattern_rows = (color.cblack[4] && color.cblack[5]) ? color.cblack[4] : 0;
+        const int pattern_cols = pattern_rows ? color.cblack[5] : 0;
+        std::vector<int> pattern(color.cblack + 6, color.cblack + 6 + pattern_rows * pattern_cols);
+        const bool has_black = cblack[0] || cblack[1] || cblack[2] || cblack[3] || pattern_rows;
+        const size_t samples = static_cast<size_t>(copy_width) * step;
+
+        auto fill_black = [&](std::vector<int>& black, int row) {
+            const int* pat = pattern_rows ? pattern.data() + (row % pattern_rows) * pattern_cols : nullptr;
+            for (int col = 0; col < copy_width; col++) {
+                int extra = pat ? pat[col % pattern_cols] : 0;
+                for (int c = 0; c < step; c++) black[static_cast<size_t>(col) * step + c] = cblack[c] + extra;
+            }
+        };
+
+        // data_maximum is needed before scaling only when adjust_maximum() uses it
+        const bool adjust = !(decoder_info.decoder_flags & LIBRAW_DECODER_FIXEDMAXC) &&
+                            imgdata.params.adjust_maximum_thr >= 0.00001;
+        std::mutex mutex;
+        int data_maximum = 0;
+        if (adjust) {
+            ParallelRows(copy_height, 64, [&](int first, int last) {
+                std::vector<int> black(samples);
+                fill_black(black, first);
+                int dmax = 0;
+                for (int row = first; row < last; row++) {
+                    if (pattern_rows > 1) fill_black(black, row);
+                    dmax = std::max(dmax, RowMaximum(source_row(row), black.data(), samples));
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                data_maximum = std::max(data_maximum, dmax);
+            });
+        }
+
+        if (has_black) {
+            color.maximum -= color.black;
+            memset(color.cblack, 0, sizeof color.cblack);
+            color.black = 0;
+        }
+        if (adjust) {
+            color.data_maximum = data_maximum & 0xffff;
+            adjust_maximum();
+        }
+        if (imgdata.params.user_sat > 0) {
+            color.maximum = imgdata.params.user_sat;
+        }
+
+        float scale_mul[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        if (!imgdata.params.no_auto_scale) {
+            ScaleMultipliers(scale_mul);
+        }
+
+        // convert_to_rgb(): output matrix, or raw colour for unsupported spaces
+        const int output_color = imgdata.params.output_color;
+        gamma_curve(imgdata.params.gamm[0], imgdata.params.gamm[1], 0, 0);
+        io.raw_color |= output_color < 1 || output_color > 8;
+        const bool raw_color = io.raw_color != 0;
+        float out_cam[9];
+        if (!raw_color) {
+            static const double (*const out_rgb[])[3] = {
+                LibRaw_constants::rgb_rgb, LibRaw_constants::adobe_rgb,
+                LibRaw_constants::wide_rgb, LibRaw_constants::prophoto_rgb,
+                LibRaw_constants::xyz_rgb, LibRaw_constants::aces_rgb,
+                LibRaw_constants::dcip3d65_rgb, LibRaw_constants::rec2020_rgb
+            };
+            const double (*rgb)[3] = out_rgb[output_color - 1];
+            for (int i = 0; i < 3; i++) {
+                for (int j = 0; j < 3; j++) {
+                    out_cam[i * 3 + j] = 0.f;
+                    for (int k = 0; k < 3; k++) {
+                        out_cam[i * 3 + j] += float(rgb[i][k] * color.rgb_cam[k][j]);
+                    }
+                }
+            }
+        }
+
+        if (!libraw_internal_data.output_data.histogram) {
+            libraw_internal_data.output_data.histogram = (int (*)[LIBRAW_HISTOGRAM_SIZE])calloc(
+                1, sizeof(*libraw_internal_data.output_data.histogram) * 4);
+        }
+        int (*histogram)[LIBRAW_HISTOGRAM_SIZE] = libraw_internal_data.output_data.histogram;
+        memset(histogram, 0, sizeof(*histogram) * 4);
+
+        const size_t out_stride = static_cast<size_t>(width) * 3;
+        linear_image_.reset(new ushort[out_stride * height]);
+        ushort* linear = linear_image_.get();
+
+        std::vector<float> mul(samples);
+        for (size_t i = 0; i < samples; i++) mul[i] = scale_mul[i % step];
+
+        ParallelRows(height, 16, [&](int first, int last) {
+            std::vector<int> black(samples);
+            std::vector<int> scaled(samples);
+            std::vector<int> counts(3 * LIBRAW_HISTOGRAM_SIZE, 0);
+            fill_black(black, first);
+            int dmax = 0;
+            for (int row = first; row < last; row++) {
+                ushort* out = linear + static_cast<size_t>(row) * out_stride;
+                int pixels = row < copy_height ? copy_width : 0;
+                if (pixels) {
+                    if (pattern_rows > 1) fill_black(black, row);
+                    dmax = std::max(dmax, ScaleRow(source_row(row), black.data(), mul.data(), scaled.data(), samples));
+                    if (raw_color) {
+                        for (int col = 0; col < pixels; col++) {
+                            for (int c = 0; c < 3; c++) out[col * 3 + c] = static_cast<ushort>(scaled[col * step + c]);
+                        }
+                    } else {
+                        (four ? ConvertRow4 : ConvertRow3)(scaled.data(), out_cam, out, pixels);
+                    }
+                }
+                std::fill(out + static_cast<size_t>(pixels) * 3, out + out_stride, 0);
+                for (size_t i = 0; i < out_stride; i += 3) {
+                    counts[out[i] >> 3]++;
+                    counts[LIBRAW_HISTOGRAM_SIZE + (out[i + 1] >> 3)]++;
+                    counts[2 * LIBRAW_HISTOGRAM_SIZE + (out[i + 2] >> 3)]++;
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int c = 0; c < 3; c++) {
+                for (int i = 0; i < LIBRAW_HISTOGRAM_SIZE; i++) histogram[c][i] += counts[c * LIBRAW_HISTOGRAM_SIZE + i];
+            }
+            data_maximum = std::max(data_maximum, dmax);
+        });
+
+        if (!adjust) {
+            color.data_maximum = data_maximum & 0xffff;
+        }
+
+        // Same stage flags dcraw_process() leaves behind
+        imgdata.progress_flags = LIBRAW_PROGRESS_START | LIBRAW_PROGRESS_OPEN | LIBRAW_PROGRESS_RAW2_IMAGE |
+                                 LIBRAW_PROGRESS_IDENTIFY | LIBRAW_PROGRESS_SIZE_ADJUST | LIBRAW_PROGRESS_LOAD_RAW |
+                                 LIBRAW_PROGRESS_PRE_INTERPOLATE | LIBRAW_PROGRESS_CONVERT_RGB;
+        if (!imgdata.params.no_auto_scale) {
+            imgdata.progress_flags |= LIBRAW_PROGRESS_SCALE_COLORS;
+        }
+        if (imgdata.params.use_fuji_rotate) {
+            imgdata.progress_flags |= LIBRAW_PROGRESS_FUJI_ROTATE | LIBRAW_PROGRESS_STRETCH;
+        }
+        return LIBRAW_SUCCESS;
+    } catch (const std::bad_alloc&) {
+        recycle();
+        return LIBRAW_UNSUFFICIENT_MEMORY;
+    } catch (const LibRaw_exceptions&) {
+        // Only LibRaw's allocator throws on this path
+        recycle();
+        return LIBRAW_UNSUFFICIENT_MEMORY;
+    }
+}
@@ -0,0 +1,197 @@
+/**
+ * @filmgallery/libraw-native - Lossy DNG
+ *
+ * Built without libjpeg, LibRaw turns lossy DNGs (JPEG-compressed tiles,
+ * compression 34892: phone DNGs, Adobe's "smaller" DNG export) away at
+ * identify() and stubs out lossy_dng_load_raw(). Here the post-identify
+ * callback readmits the 3-colour ones, and Unpack() fills the image LibRaw
+ * left empty: the tiles are read in file order, decoded on separate threads
+ * with the addon's JPEG decoder, and mapped through the same per-channel
+ * curves as LibRaw's loader (the MapPolynomial opcode, or the sRGB curve).
+ */
+
+#include "film_libraw.h"
+#include "jpeg_decoder.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct LossyTile {
+    INT64 offset;
+    unsigned row;
+    unsigned col;
+    std::vector<uint8_t> data;
+};
+
+} // namespace
+
+void FilmLibRaw::PostIdentify(void* context) {
+    static_cast<FilmLibRaw*>(static_cast<LibRaw*>(context))->AdmitLossyDng();
+}
+
+void FilmLibRaw::AdmitLossyDng() {
+    if (load_raw != &FilmLibRaw::lossy_dng_load_raw || !(imgdata.process_warnings & LIBRAW_WARN_NO_JPEGLIB)) {
+        return;
+    }
+
+    // The checks identify() made before giving up on the missing libjpeg
+    const libraw_image_sizes_t& sizes = imgdata.sizes;
+    const libraw_iparams_t& idata = imgdata.idata;
+    const unpacker_data_t& unpacker = libraw_internal_data.unpacker_data;
+    if (!idata.dng_version || idata.colors != 3 || idata.filters || unpacker.tiff_samples != 3 ||
+        unpacker.tiff_bps != 8 || sizes.width < 22 || sizes.height < 22 ||
+        sizes.raw_width < 22 || sizes.raw_width > 64000 || sizes.raw_height < 22 || sizes.raw_height > 64000 ||
+        sizes.raw_width <= sizes.left_margin || sizes.raw_height <= sizes.top_margin ||
+        sizes.pixel_aspect < 0.1 || sizes.pixel_aspect > 10.) {
+        return;
+    }
+    imgdata.idata.raw_count = 1;
+    imgdata.process_warnings &= ~LIBRAW_WARN_NO_JPEGLIB;
+}
+
+int FilmLibRaw::Unpack() {
+    if (Decoder stand_in = StandInLoader()) {
+        // LibRaw's loader is a stub in this build, or a serial one; ours runs
+        // in its place, and the original is put back so the decoder still
+        // reads as LibRaw's
+        Decoder original = load_raw;
+        load_raw = stand_in;
+        int ret = unpack();
+        load_raw = original;
+        return ret;
+    }
+
+    // unpack() trims the raw size to the image; the tile grid covers the former
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    int ret = unpack();
+    if (ret != LIBRAW_SUCCESS || load_raw != &FilmLibRaw::lossy_dng_load_raw) {
+        return ret;
+    }
+    return LoadLossyDng(raw_width, raw_height);
+}
+
+int FilmLibRaw::LoadLossyDng(unsigned raw_width, unsigned raw_height) {
+    ushort (*image)[4] = imgdata.rawdata.color4_image;
+    if (!image) {
+        return LIBRAW_DATA_ERROR;
+    }
+
+    LibRaw_abstract_datastream* input = libraw_internal_data.internal_data.input;
+    unpacker_data_t& unpacker = libraw_internal_data.unpacker_data;
+    const int width = imgdata.sizes.width;
+    const int height = imgdata.sizes.height;
+    const int colors = imgdata.idata.colors;
+    ushort cur[4][256] = {};
+    std::vector<LossyTile> tiles;
+
+    try {
+        // Per-channel curves, as lossy_dng_load_raw() builds them
+        if (unpacker.meta_offset) {
+            short saved_order = unpacker.order;
+            input->seek(unpacker.meta_offset, SEEK_SET);
+            unpacker.order = 0x4d4d;
+            unsigned ntags = get4();
+            while (ntags--) {
+                unsigned opcode = get4();
+                get4();
+                get4();
+                if (opcode != 8) {
+                    input->seek(get4(), SEEK_CUR);
+                    continue;
+                }
+                input->seek(20, SEEK_CUR);
+                unsigned c = get4();
+                if (c > 3) break;
+                input->seek(12, SEEK_CUR);
+                unsigned deg = get4();
+                if (deg > 8) break;
+                double coeff[9];
+                for (unsigned i = 0; i <= deg; i++) coeff[i] = getreal(LIBRAW_EXIFTAG_TYPE_DOUBLE);
+                for (int i = 0; i < 256; i++) {
+                    double total = 0;
+                    for (unsigned j = 0; j <= deg; j++) total += coeff[j] * pow(i / 255.0, int(j));
+                    cur[c][i] = static_cast<ushort>(total * 0xffff);
+                }
+            }
+            unpacker.order = saved_order;
+        } else {
+            gamma_curve(1 / 2.4, 12.92, 1, 255);
+            for (int c = 0; c < 4; c++) memcpy(cur[c], imgdata.color.curve, sizeof cur[0]);
+            memcpy(imgdata.rawdata.color.curve, imgdata.color.curve, sizeof imgdata.color.curve);
+        }
+
+        // Tile offsets: an array at data_offset, or the single strip itself
+        INT64 save = unpacker.data_offset - 4;
+        unsigned trow = 0, tcol = 0;
+        while (trow < raw_height) {
+            input->seek(save += 4, SEEK_SET);
+            LossyTile tile;
+            tile.offset = unpacker.tile_length < unsigned(INT_MAX) ? INT64(get4()) : save;
+            tile.row = trow;
+            tile.col = tcol;
+            tiles.push_back(std::move(tile));
+            if ((tcol += unpacker.tile_width) >= raw_width) {
+                trow += unpacker.tile_length + (tcol = 0);
+            }
+        }
+
+        // Each tile runs to the next tile's start, bounded by the largest
+        // JPEG a tile could sensibly be (the decoder stops at EOI anyway)
+        std::vector<INT64> starts;
+        for (const LossyTile& tile : tiles) starts.push_back(tile.offset);
+        starts.push_back(input->size());
+        std::sort(starts.begin(), starts.end());
+        const INT64 tile_pixels = INT64(std::min<unsigned>(unpacker.tile_width, raw_width)) *
+                                  std::min<unsigned>(unpacker.tile_length, raw_height);
+        const INT64 bound = tile_pixels * colors * 2 + 65536;
+        for (LossyTile& tile : tiles) {
+            INT64 next = *std::upper_bound(starts.begin(), starts.end(), tile.offset);
+            INT64 bytes = std::min(std::max<INT64>(next - tile.offset, 0), bound);
+            tile.data.resize(static_cast<size_t>(bytes));
+            input->seek(tile.offset, SEEK_SET);
+            if (input->read(tile.data.data(), 1, tile.data.size()) < static_cast<int>(tile.data.size())) {
+                tile.data.clear();
+            }
+        }
+        checkCancel();
+    } catch (const LibRaw_exceptions& e) {
+        return e == LIBRAW_EXCEPTION_CANCELLED_BY_CALLBACK ? LIBRAW_CANCELLED_BY_CALLBACK : LIBRAW_IO_ERROR;
+    } catch (const std::bad_alloc&) {
+        return LIBRAW_UNSUFFICIENT_MEMORY;
+    }
+
+    // Tiles cover disjoint pixels; each decodes single-threaded on its own thread
+    std::atomic<bool> ok(true);
+    ParallelRows(static_cast<int>(tiles.size()), 1, [&](int first, int last) {
+        JpegDecodeOptions options;
+        options.threaded = false;
+        JpegImage decoded;
+        for (int t = first; t < last && ok; t++) {
+            const LossyTile& tile = tiles[t];
+            if (!DecodeJpeg(tile.data.data(), tile.data.size(), options, decoded) || decoded.channels != colors) {
+                ok = false;
+                break;
+            }
+            for (int r = 0; r < decoded.height && int(tile.row) + r < height; r++) {
+                const uint8_t* src = decoded.data.data() + static_cast<size_t>(r) * decoded.width * colors;
+                ushort (*dst)[4] = image + static_cast<size_t>(tile.row + r) * width + tile.col;
+                for (int col = 0; col < decoded.width && int(tile.col) + col < width; col++) {
+                    for (int c = 0; c < colors; c++) dst[col][c] = cur[c][src[col * colors + c]];
+                }
+            }
+        }
+    });
+    if (!ok) {
+        return LIBRAW_DATA_ERROR;
+    }
+
+    imgdata.color.maximum = imgdata.rawdata.color.maximum = 0xffff;
+    return LIBRAW_SUCCESS;
+}
@@ -0,0 +1,111 @@
+/**
+ * @filmgallery/libraw-native - Read-only File Mapping
+ *
+ * Maps a whole file for reading (mmap / MapViewOfFile). Used for the tiled
+ * render's TIFF cache (tiled_render.cpp), mosaic caches (mosaic_cache.cpp)
+ * and the stand-in loaders' input (input_bytes.h), which are read band by
+ * band from several threads.
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+#else
+        if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+        if (fd_ >= 0) close(fd_);
+#endif
+    }
+
+    bool Open(const std::string& path) {
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER size;
+        if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) || size.QuadPart <= 0) {
+            return false;
+        }
+        size_ = static_cast<size_t>(size.QuadPart);
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) return false;
+        data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        page_ = info.dwPageSize;
+#else
+        fd_ = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd_ < 0 || fstat(fd_, &st) != 0 || st.st_size <= 0) {
+            return false;
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (data == MAP_FAILED) return false;
+        data_ = static_cast<const uint8_t*>(data);
+        page_ = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+        return data_ != nullptr;
+    }
+
+    /**
+     * Drop the whole pages inside [offset, offset + length) from memory;
+     * touching them again reads them back from the file
+     */
+    void Release(uint64_t offset, uint64_t length) const {
+        uint64_t start = (offset + page_ - 1) / page_ * page_;
+        uint64_t end = std::min<uint64_t>(offset + length, size_) / page_ * page_;
+        if (end <= start) return;
+#ifdef _WIN32
+        // Unlocking pages that are not locked removes them from the working set
+        VirtualUnlock(const_cast<uint8_t*>(data_ + start), static_cast<SIZE_T>(end - start));
+#else
+        madvise(const_cast<uint8_t*>(data_ + start), static_cast<size_t>(end - start), MADV_DONTNEED);
+#endif
+    }
+
+    const uint8_t* Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+private:
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    size_t page_ = 4096;
+};
+
+#endif // MAPPED_FILE_H
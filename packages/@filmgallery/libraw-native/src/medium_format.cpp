@@ -0,0 +1,883 @@
+/**
+ * @filmgallery/libraw-native - Medium-format Backs and Imacon Scans
+ *
+ * Stand-ins Unpack() runs for LibRaw's Phase One and Imacon loaders, and the
+ * Phase One calibration Process() applies ahead of dcraw_process():
+ *
+ *   phase_one_load_raw_c()  IIQ L/S rows, each at its own offset, decoded on
+ *                           several threads from the mapped file
+ *   phase_one_load_raw_s()  IIQ S(ensor+) rows, likewise, with LibRaw's row
+ *                           decoder
+ *   phase_one_load_raw()    uncompressed, key-scrambled IIQ data
+ *   imacon_full_load_raw()  Flextight/Imacon 3-colour 16-bit scans
+ *   phase_one_correct()     black levels, defects, curves and flat fields,
+ *                           each pass over the image split across threads
+ *
+ * Output is bit-identical to LibRaw's; damaged files (rows past the end,
+ * errors at EOF) run LibRaw's own loader. hasselblad_load_raw() decodes one
+ * lossless JPEG stream without restart markers or row offsets, so
+ * Hasselblad backs stay with LibRaw.
+ */
+
+#include "film_libraw.h"
+#include "input_bytes.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// LibRaw's IIQ S row decoder (decoders_libraw.cpp), not declared in its headers
+void decode_S_type(int32_t out_width, uint32_t* img_input, ushort* outbuf);
+
+namespace {
+
+// Rows per thread chunk; medium-format rows are 10-20K samples
+const int MIN_ROWS = 16;
+
+// LibRaw's LIM(), NaN included (to `hi`)
+template <typename T>
+T Lim(T x, T lo, T hi) {
+    T low = x < hi ? x : hi;
+    return lo > low ? lo : low;
+}
+
+// 16-bit words in the input's byte order (read_shorts())
+CPU_INLINE void LoadWordsBody(const uint8_t* src, ushort* dst, size_t count, bool big_endian) {
+    if (big_endian) {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<ushort>(src[2 * i] << 8 | src[2 * i + 1]);
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<ushort>(src[2 * i + 1] << 8 | src[2 * i]);
+        }
+    }
+}
+
+// phase_one_load_raw(): sample pairs XORed with the file's keys and their
+// bits exchanged under `mask`
+CPU_INLINE void DescrambleBody(ushort* data, size_t pairs, unsigned akey, unsigned bkey, unsigned mask) {
+    for (size_t i = 0; i < pairs; i++) {
+        unsigned a = data[2 * i] ^ akey;
+        unsigned b = data[2 * i + 1] ^ bkey;
+        data[2 * i] = static_cast<ushort>((a & mask) | (b & ~mask));
+        data[2 * i + 1] = static_cast<ushort>((b & mask) | (a & ~mask));
+    }
+}
+
+// imacon_full_load_raw(): 3 words per pixel into ushort[4], 4th zeroed
+CPU_INLINE void LoadRgbWordsBody(const uint8_t* src, ushort* dst, size_t pixels, bool big_endian) {
+    for (size_t i = 0; i < pixels; i++) {
+        const uint8_t* p = src + 6 * i;
+        for (int c = 0; c < 3; c++) {
+            dst[4 * i + c] = static_cast<ushort>(big_endian ? p[2 * c] << 8 | p[2 * c + 1]
+                                                            : p[2 * c + 1] << 8 | p[2 * c]);
+        }
+        dst[4 * i + 3] = 0;
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, LoadWords, LoadWordsBody,
+                    (const uint8_t* src, ushort* dst, size_t count, bool big_endian),
+                    (src, dst, count, big_endian))
+CPU_DISPATCH_KERNEL(void, Descramble, DescrambleBody,
+                    (ushort* data, size_t pairs, unsigned akey, unsigned bkey, unsigned mask),
+                    (data, pairs, akey, bkey, mask))
+CPU_DISPATCH_KERNEL(void, LoadRgbWords, LoadRgbWordsBody,
+                    (const uint8_t* src, ushort* dst, size_t pixels, bool big_endian),
+                    (src, dst, pixels, big_endian))
+
+// get4() at `pos` of the input: 0xff for bytes past its end
+unsigned Word32(const uint8_t* data, size_t size, size_t pos, bool big_endian) {
+    uint8_t b[4];
+    for (int i = 0; i < 4; i++) b[i] = pos + i < size ? data[pos + i] : 0xff;
+    return big_endian ? unsigned(b[0]) << 24 | b[1] << 16 | b[2] << 8 | b[3]
+                      : unsigned(b[3]) << 24 | b[2] << 16 | b[1] << 8 | b[0];
+}
+
+/**
+ * ph1_bits() reading from memory: 32-bit words in the input's byte order,
+ * consumed MSB first
+ */
+class PhaseOneBits {
+public:
+    PhaseOneBits(const uint8_t* data, size_t size, size_t pos, bool big_endian)
+        : data_(data), size_(size), pos_(pos), big_endian_(big_endian) {}
+
+    unsigned Get(int nbits) {
+        if (nbits == 0) return 0;
+        if (vbits_ < nbits) {
+            bitbuf_ = bitbuf_ << 32 | Word32(data_, size_, pos_, big_endian_);
+            pos_ += 4;
+            vbits_ += 32;
+        }
+        unsigned c = unsigned((bitbuf_ << (64 - vbits_) >> (64 - nbits)) & 0xffffffff);
+        vbits_ -= nbits;
+        return c;
+    }
+
+    // Input position after the words read so far (ftell() in LibRaw's loader)
+    size_t Position() const { return pos_; }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_;
+    bool big_endian_;
+    uint64_t bitbuf_ = 0;
+    int vbits_ = 0;
+};
+
+/**
+ * A row of phase_one_load_raw_c(). Block lengths carry over from the row
+ * before; `len` holds them on entry (-1: not known yet) and on exit.
+ */
+struct PhaseOneRow {
+    int len[2];
+    bool carried;       // stopped at a length it had to carry in
+    unsigned errors;    // samples that overflowed (derror())
+    size_t first_error; // input position at the first of them
+};
+
+void DecodePhaseOneRow(PhaseOneBits& bits, ushort* pixel, int raw_width, int format, const ushort* curve,
+                       PhaseOneRow& row) {
+    static const int length[] = {8, 7, 6, 9, 11, 10, 5, 12, 14, 13};
+    int pred[2] = {0, 0};
+    row.carried = false;
+    row.errors = 0;
+    for (int col = 0; col < raw_width; col++) {
+        if (col >= (raw_width & -8)) {
+            row.len[0] = row.len[1] = 14;
+        } else if ((col & 7) == 0) {
+            for (int i = 0; i < 2; i++) {
+                int j;
+                for (j = 0; j < 5 && !bits.Get(1); j++) {
+                }
+                if (j--) row.len[i] = length[j * 2 + bits.Get(1)];
+            }
+        }
+        const int i = row.len[col & 1];
+        if (i < 0) {
+            row.carried = true;
+            return;
+        }
+        if (i == 14) {
+            pixel[col] = static_cast<ushort>(pred[col & 1] = int(bits.Get(16)));
+        } else {
+            pixel[col] = static_cast<ushort>(pred[col & 1] += int(bits.Get(i)) + 1 - (1 << (i - 1)));
+        }
+        if ((pred[col & 1] >> 16) && !row.errors++) {
+            row.first_error = bits.Position();
+        }
+        if (format == 5 && pixel[col] < 256) pixel[col] = curve[pixel[col]];
+    }
+}
+
+struct PhaseOneStripe {
+    unsigned row;
+    INT64 offset;
+    bool operator<(const PhaseOneStripe& other) const { return offset < other.offset; }
+};
+
+} // namespace
+
+const std::vector<std::pair<FilmLibRaw::Decoder, FilmLibRaw::Decoder>>& FilmLibRaw::MediumFormatLoaders() {
+    static const std::vector<std::pair<Decoder, Decoder>> loaders = {
+        {&FilmLibRaw::phase_one_load_raw_c, static_cast<Decoder>(&FilmLibRaw::PhaseOneLoadRawC)},
+        {&FilmLibRaw::phase_one_load_raw_s, static_cast<Decoder>(&FilmLibRaw::PhaseOneLoadRawS)},
+        {&FilmLibRaw::phase_one_load_raw, static_cast<Decoder>(&FilmLibRaw::PhaseOneLoadRaw)},
+        {&FilmLibRaw::imacon_full_load_raw, static_cast<Decoder>(&FilmLibRaw::ImaconFullLoadRaw)},
+    };
+    return loaders;
+}
+
+void FilmLibRaw::PhaseOneLoadRawC() {
+    LibRaw_abstract_datastream* input = libraw_internal_data.internal_data.input;
+    unpacker_data_t& unpacker = libraw_internal_data.unpacker_data;
+    ph1_t& ph1 = imgdata.color.phase_one_data;
+    const int raw_width = imgdata.sizes.raw_width;
+    const int raw_height = imgdata.sizes.raw_height;
+    const bool big_endian = unpacker.order != 0x4949;
+    ushort* image = imgdata.rawdata.raw_image;
+
+    // The row offset and black tables must be whole: LibRaw's loader reads
+    // them with derror()s and fills in what is missing
+    InputBytes bytes;
+    const INT64 size = input->size();
+    auto whole = [&](INT64 offset, INT64 length) { return offset >= 0 && offset + length <= size; };
+    if (ph1.format == 6 || !image || !whole(unpacker.strip_offset, INT64(raw_height) * 4) ||
+        (ph1.black_col && !whole(ph1.black_col, INT64(raw_height) * 4)) ||
+        (ph1.black_row && !whole(ph1.black_row, INT64(raw_width) * 4)) ||
+        !bytes.Open(input, 0, size_t(size), 8)) {
+        LibRaw::phase_one_load_raw_c();
+        return;
+    }
+    const uint8_t* data = bytes.Data();
+
+    std::vector<INT64> starts(raw_height);
+    for (int row = 0; row < raw_height; row++) {
+        const int offset = int(Word32(data, size_t(size), size_t(unpacker.strip_offset) + 4 * size_t(row), big_endian));
+        starts[row] = unpacker.data_offset + offset;
+        if (starts[row] < 0 || starts[row] >= size) {
+            LibRaw::phase_one_load_raw_c();
+            return;
+        }
+    }
+
+    for (int i = 0; i < 256; i++) {
+        imgdata.color.curve[i] = ushort(float(i * i) / 3.969f + 0.5f);
+    }
+
+    // Rows are independent but for the block lengths carried from the row
+    // before: rows that need them are decoded again in order afterwards
+    const int format = ph1.format;
+    const ushort* curve = imgdata.color.curve;
+    std::vector<PhaseOneRow> rows(raw_height);
+    auto decode = [&](int row, std::vector<ushort>& pixel) {
+        PhaseOneBits bits(data, size_t(size), size_t(starts[row]), big_endian);
+        DecodePhaseOneRow(bits, pixel.data(), raw_width, format, curve, rows[row]);
+        if (rows[row].carried) return;
+        ushort* dst = image + size_t(row) * raw_width;
+        if (format == 8) {
+            memcpy(dst, pixel.data(), size_t(raw_width) * 2);
+        } else {
+            for (int col = 0; col < raw_width; col++) dst[col] = static_cast<ushort>(pixel[col] << 2);
+        }
+    };
+    ParallelRows(raw_height, MIN_ROWS, [&](int first, int last) {
+        std::vector<ushort> pixel(raw_width);
+        for (int row = first; row < last; row++) {
+            rows[row].len[0] = rows[row].len[1] = -1;
+            decode(row, pixel);
+        }
+    });
+
+    std::vector<ushort> pixel(raw_width);
+    const PhaseOneRow* first_error = nullptr;
+    unsigned errors = 0;
+    for (int row = 0; row < raw_height; row++) {
+        if (rows[row].carried) {
+            // The first row's lengths are uninitialized in LibRaw's loader
+            if (!row) {
+                LibRaw::phase_one_load_raw_c();
+                return;
+            }
+            rows[row].len[0] = rows[row - 1].len[0];
+            rows[row].len[1] = rows[row - 1].len[1];
+            decode(row, pixel);
+        }
+        if (rows[row].errors && !first_error) first_error = &rows[row];
+        errors += rows[row].errors;
+    }
+
+    // derror() at end of file throws, leaving a partial image
+    if (first_error && (unpacker.data_error || INT64(first_error->first_error) >= size)) {
+        LibRaw::phase_one_load_raw_c();
+        return;
+    }
+
+    if (ph1.black_col || ph1.black_row) {
+        imgdata.rawdata.ph1_cblack = (short(*)[2])calloc(raw_height * 2, sizeof(ushort));
+        imgdata.rawdata.ph1_rblack = (short(*)[2])calloc(raw_width * 2, sizeof(ushort));
+        ushort* cblack = reinterpret_cast<ushort*>(imgdata.rawdata.ph1_cblack[0]);
+        ushort* rblack = reinterpret_cast<ushort*>(imgdata.rawdata.ph1_rblack[0]);
+        if (ph1.black_col) LoadWords(data + ph1.black_col, cblack, size_t(raw_height) * 2, big_endian);
+        if (ph1.black_row) LoadWords(data + ph1.black_row, rblack, size_t(raw_width) * 2, big_endian);
+    }
+
+    if (errors) {
+        // One derror() where LibRaw's loader first hits one, then the count
+        input->seek(INT64(first_error->first_error), SEEK_SET);
+        derror();
+        unpacker.data_error += int(errors - 1);
+    }
+    imgdata.color.maximum = 0xfffc - ph1.t_black;
+}
+
+void FilmLibRaw::PhaseOneLoadRawS() {
+    LibRaw_abstract_datastream* input = libraw_internal_data.internal_data.input;
+    const unpacker_data_t& unpacker = libraw_internal_data.unpacker_data;
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    ushort* image = imgdata.rawdata.raw_image;
+
+    // Rows run from their offset to the next one up; all must be whole
+    InputBytes bytes;
+    const INT64 size = input->size();
+    if (!unpacker.strip_offset || !image || !unpacker.data_offset ||
+        unpacker.strip_offset + INT64(raw_height) * 4 > size || !bytes.Open(input, 0, size_t(size), 8)) {
+        LibRaw::phase_one_load_raw_s();
+        return;
+    }
+    const uint8_t* data = bytes.Data();
+    const bool big_endian = unpacker.order != 0x4949;
+
+    std::vector<PhaseOneStripe> stripes(raw_height + 1);
+    for (unsigned row = 0; row < raw_height; row++) {
+        stripes[row].row = row;
+        stripes[row].offset =
+            INT64(Word32(data, size_t(size), size_t(unpacker.strip_offset) + 4 * size_t(row), big_endian)) +
+            unpacker.data_offset;
+    }
+    stripes[raw_height].row = raw_height;
+    stripes[raw_height].offset = unpacker.data_offset + INT64(unpacker.data_size);
+    std::sort(stripes.begin(), stripes.end());
+
+    const INT64 max_size = INT64(raw_width) * 3 + 2;
+    for (unsigned i = 0; i < raw_height; i++) {
+        const INT64 length = stripes[i + 1].offset - stripes[i].offset;
+        if (stripes[i].row < raw_height &&
+            (length > max_size || stripes[i].offset < 0 || stripes[i].offset + length > size)) {
+            LibRaw::phase_one_load_raw_s();
+            return;
+        }
+    }
+
+    // LibRaw reads every row into one buffer, and the decoder reads on past
+    // the row's bytes into what earlier rows left there: each thread starts
+    // from the buffer as the rows before its first would leave it
+    auto length = [&](int i) { return size_t(stripes[i + 1].offset - stripes[i].offset); };
+    ParallelRows(int(raw_height), MIN_ROWS, [&](int first, int last) {
+        std::vector<uint32_t> row_data(size_t(max_size) / 4 + 2, 0);
+        uint8_t* buffer = reinterpret_cast<uint8_t*>(row_data.data());
+        size_t covered = 0;
+        for (int i = first - 1; i >= 0 && covered < size_t(max_size); i--) {
+            if (stripes[i].row < raw_height && length(i) > covered) {
+                memcpy(buffer + covered, data + stripes[i].offset + covered, length(i) - covered);
+                covered = length(i);
+            }
+        }
+        for (int i = first; i < last; i++) {
+            const PhaseOneStripe& stripe = stripes[i];
+            if (stripe.row >= raw_height) continue;
+            memcpy(buffer, data + stripe.offset, length(i));
+            decode_S_type(int32_t(raw_width), row_data.data(), image + size_t(stripe.row) * raw_width);
+        }
+    });
+}
+
+void FilmLibRaw::PhaseOneLoadRaw() {
+    LibRaw_abstract_datastream* input = libraw_internal_data.internal_data.input;
+    const unpacker_data_t& unpacker = libraw_internal_data.unpacker_data;
+    ph1_t& ph1 = imgdata.color.phase_one_data;
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    const size_t samples = size_t(raw_width) * raw_height;
+    ushort* image = imgdata.rawdata.raw_image;
+
+    // An odd sample count makes LibRaw descramble one past the image
+    InputBytes bytes;
+    if (!image || (ph1.format && (samples & 1)) || !bytes.Open(input, unpacker.data_offset, samples * 2, 8)) {
+        LibRaw::phase_one_load_raw();
+        return;
+    }
+
+    input->seek(ph1.key_off, SEEK_SET);
+    const unsigned akey = get2();
+    const unsigned bkey = get2();
+    const unsigned mask = ph1.format == 1 ? 0x5555 : 0x1354;
+    if (ph1.black_col || ph1.black_row) {
+        imgdata.rawdata.ph1_cblack = (short(*)[2])calloc(raw_height * 2, sizeof(ushort));
+        imgdata.rawdata.ph1_rblack = (short(*)[2])calloc(raw_width * 2, sizeof(ushort));
+        if (ph1.black_col) {
+            input->seek(ph1.black_col, SEEK_SET);
+            read_shorts(reinterpret_cast<ushort*>(imgdata.rawdata.ph1_cblack[0]), raw_height * 2);
+        }
+        if (ph1.black_row) {
+            input->seek(ph1.black_row, SEEK_SET);
+            read_shorts(reinterpret_cast<ushort*>(imgdata.rawdata.ph1_rblack[0]), raw_width * 2);
+        }
+    }
+
+    // Chunks of whole pairs, which may straddle rows
+    const bool big_endian = unpacker.order != 0x4949;
+    const bool scrambled = ph1.format != 0;
+    ParallelRows(int(raw_height), MIN_ROWS, [&](int first, int last) {
+        const size_t begin = size_t(first) * raw_width & ~size_t(1);
+        const size_t end = unsigned(last) == raw_height ? samples : size_t(last) * raw_width & ~size_t(1);
+        LoadWords(bytes.Data() + begin * 2, image + begin, end - begin, big_endian);
+        if (scrambled) Descramble(image + begin, (end - begin) / 2, akey, bkey, mask);
+    });
+}
+
+void FilmLibRaw::ImaconFullLoadRaw() {
+    const unsigned width = imgdata.sizes.width;
+    const unsigned height = imgdata.sizes.height;
+    ushort (*image)[4] = imgdata.image;
+
+    InputBytes bytes;
+    if (!image || !bytes.Open(libraw_internal_data.internal_data.input, libraw_internal_data.unpacker_data.data_offset,
+                              size_t(width) * height * 6, 8)) {
+        LibRaw::imacon_full_load_raw();
+        return;
+    }
+
+    const bool big_endian = libraw_internal_data.unpacker_data.order != 0x4949;
+    ParallelRows(int(height), MIN_ROWS, [&](int first, int last) {
+        for (int row = first; row < last; row++) {
+            LoadRgbWords(bytes.Data() + size_t(row) * width * 6, image[size_t(row) * width], width, big_endian);
+        }
+    });
+}
+
+bool FilmLibRaw::PhaseOneCalibrationPending() {
+    return stand_in_loaders_ && is_phaseone_compressed() && imgdata.rawdata.raw_alloc && imgdata.rawdata.raw_image &&
+           !(imgdata.process_warnings & LIBRAW_WARN_RAWSPEED3_PROCESSED);
+}
+
+int FilmLibRaw::ProcessPhaseOne() {
+    // raw2image_ex() subtracts the black levels into a copy of the raw image
+    // and calibrates it on every call; this does the same in parallel, then
+    // hides raw_alloc so dcraw_process() takes the copy as a plain raw image
+    raw2image_start();
+    libraw_rawdata_t& raw = imgdata.rawdata;
+    ushort* original = raw.raw_image;
+    void* alloc = raw.raw_alloc;
+    ushort* corrected = static_cast<ushort*>(malloc(size_t(imgdata.sizes.raw_pitch) * imgdata.sizes.raw_height));
+    if (!corrected) {
+        return LIBRAW_UNSUFFICIENT_MEMORY;
+    }
+
+    int ret = PhaseOneSubtractBlack(static_cast<const ushort*>(alloc), corrected);
+    raw.raw_image = corrected;
+    if (ret == LIBRAW_SUCCESS && imgdata.params.use_p1_correction) {
+        ret = PhaseOneCorrect();
+    }
+    if (ret == LIBRAW_SUCCESS) {
+        raw.raw_alloc = nullptr;
+        ret = dcraw_process();
+        raw.raw_alloc = alloc;
+    }
+    raw.raw_image = original;
+    free(corrected);
+    return ret;
+}
+
+int FilmLibRaw::PhaseOneSubtractBlack(const ushort* src, ushort* dest) {
+    try {
+        checkCancel();
+    } catch (const LibRaw_exceptions&) {
+        return LIBRAW_CANCELLED_BY_CALLBACK;
+    }
+
+    const libraw_output_params_t& params = imgdata.params;
+    const libraw_rawdata_t& raw = imgdata.rawdata;
+    const ph1_t& ph1 = imgdata.color.phase_one_data;
+    const int raw_width = imgdata.sizes.raw_width;
+    const int bl = ph1.t_black;
+    const bool own_black = params.user_black < 0 && params.user_cblack[0] <= -1000000 &&
+                           params.user_cblack[1] <= -1000000 && params.user_cblack[2] <= -1000000 &&
+                           params.user_cblack[3] <= -1000000;
+    const bool tables = raw.ph1_cblack && raw.ph1_rblack;
+
+    ParallelRows(imgdata.sizes.raw_height, MIN_ROWS, [&](int first, int last) {
+        for (int row = first; row < last; row++) {
+            const ushort* in = src + size_t(row) * raw_width;
+            ushort* out = dest + size_t(row) * raw_width;
+            if (own_black && !tables) {
+                for (int col = 0; col < raw_width; col++) {
+                    int val = int(in[col]) - bl;
+                    out[col] = static_cast<ushort>(val > 0 ? val : 0);
+                }
+            } else if (own_black) {
+                for (int col = 0; col < raw_width; col++) {
+                    int val = int(in[col]) - bl + raw.ph1_cblack[row][col >= ph1.split_col] +
+                              raw.ph1_rblack[col][row >= ph1.split_row];
+                    out[col] = static_cast<ushort>(val > 0 ? val : 0);
+                }
+            } else {
+                // Black level set by the user, in cblack
+                ushort cblk[16];
+                for (int c = 0; c < 16; c++) cblk[c] = static_cast<ushort>(imgdata.color.cblack[fcol(row, c)]);
+                for (int col = 0; col < raw_width; col++) {
+                    ushort val = in[col];
+                    ushort black = cblk[col & 0xf];
+                    out[col] = static_cast<ushort>(val > black ? val - black : 0);
+                }
+            }
+        }
+    });
+    return LIBRAW_SUCCESS;
+}
+
+void FilmLibRaw::PhaseOneFlatField(int is_float, int nc) {
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    const unsigned top = imgdata.sizes.top_margin, left = imgdata.sizes.left_margin;
+    ushort* image = imgdata.rawdata.raw_image;
+
+    ushort head[8];
+    read_shorts(head, 8);
+    if (head[2] == 0 || head[3] == 0 || head[4] == 0 || head[5] == 0) {
+        return;
+    }
+    const unsigned wide = head[2] / head[4] + (head[2] % head[4] != 0);
+    const unsigned high = head[3] / head[5] + (head[3] % head[5] != 0);
+    const unsigned half = unsigned(nc + 1) / 2;
+
+    // The grid is read, and stepped down a row at a time, in order; rows
+    // are then scaled in parallel from a copy of the grid row they start
+    // with (the even planes, which is all the scaling reads)
+    const unsigned batch = 256;
+    std::vector<float> mrow(size_t(nc) * wide, 0.f);
+    std::vector<unsigned> rows;
+    std::vector<float> starts;
+    rows.reserve(batch);
+    starts.reserve(size_t(batch) * half * wide);
+    auto scale = [&]() {
+        ParallelRows(int(rows.size()), 8, [&](int first, int last) {
+            float mult[4];
+            for (int i = first; i < last; i++) {
+                const unsigned row = rows[i];
+                const float* start = starts.data() + size_t(i) * half * wide;
+                ushort* out = image + size_t(row) * raw_width;
+                for (unsigned x = 1; x < wide; x++) {
+                    for (int c = 0; c < nc; c += 2) {
+                        mult[c] = start[c / 2 * wide + x - 1];
+                        mult[c + 1] = (start[c / 2 * wide + x] - mult[c]) / head[4];
+                    }
+                    const unsigned cend = head[0] + x * head[4];
+                    for (unsigned col = cend - head[4];
+                         col < raw_width && col < cend && col < unsigned(head[0] + head[2] - head[4]); col++) {
+                        unsigned c = nc > 2 ? unsigned(FC(row - top, col - left)) : 0;
+                        if (!(c & 1)) {
+                            c = unsigned(out[col] * mult[c]);
+                            out[col] = static_cast<ushort>(std::min(c, 65535u));
+                        }
+                        for (c = 0; c < unsigned(nc); c += 2) mult[c] += mult[c + 1];
+                    }
+                }
+            }
+        });
+        rows.clear();
+        starts.clear();
+    };
+
+    for (unsigned y = 0; y < high; y++) {
+        checkCancel();
+        for (unsigned x = 0; x < wide; x++) {
+            for (int c = 0; c < nc; c += 2) {
+                float num = is_float ? getrealf(LIBRAW_EXIFTAG_TYPE_FLOAT) : float(get2()) / 32768.f;
+                if (y == 0) {
+                    mrow[c * wide + x] = num;
+                } else {
+                    mrow[(c + 1) * wide + x] = (num - mrow[c * wide + x]) / head[5];
+                }
+            }
+        }
+        if (y == 0) continue;
+        const unsigned rend = head[1] + y * head[5];
+        for (unsigned row = rend - head[5];
+             row < raw_height && row < rend && row < unsigned(head[1] + head[3] - head[5]); row++) {
+            rows.push_back(row);
+            for (int c = 0; c < nc; c += 2) {
+                starts.insert(starts.end(), mrow.begin() + c * wide, mrow.begin() + (c + 1) * wide);
+            }
+            for (unsigned x = 0; x < wide; x++) {
+                for (int c = 0; c < nc; c += 2) mrow[c * wide + x] += mrow[(c + 1) * wide + x];
+            }
+            if (rows.size() == batch) scale();
+        }
+    }
+    scale();
+}
+
+int FilmLibRaw::PhaseOneCorrect() {
+    LibRaw_abstract_datastream* input = libraw_internal_data.internal_data.input;
+    unpacker_data_t& unpacker = libraw_internal_data.unpacker_data;
+    const ph1_t& ph1 = imgdata.color.phase_one_data;
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    ushort* image = imgdata.rawdata.raw_image;
+    ushort* curve = imgdata.color.curve;
+    auto raw = [&](unsigned row, unsigned col) -> ushort& { return image[size_t(row) * raw_width + col]; };
+
+    // Curve lookups over rows [row0, row1) and columns [col0, col1)
+    auto apply_curve = [&](unsigned row0, unsigned row1, unsigned col0, unsigned col1) {
+        if (row1 <= row0) return;
+        ParallelRows(int(row1 - row0), MIN_ROWS, [&](int first, int last) {
+            for (unsigned row = row0 + first; row < row0 + unsigned(last); row++) {
+                for (unsigned col = col0; col < col1; col++) raw(row, col) = curve[raw(row, col)];
+            }
+        });
+    };
+
+    static const signed char dir[12][2] = {{-1, -1}, {-1, 1}, {1, -1},  {1, 1},  {-2, 0}, {0, -2},
+                                           {0, 2},   {2, 0},  {-2, -2}, {-2, 2}, {2, -2}, {2, 2}};
+    int head[9], diff, mindiff = INT_MAX;
+    INT64 off_412 = 0;
+    float poly[8];
+    int qmult_applied = 0, qlin_applied = 0;
+    std::vector<unsigned> bad_cols;
+
+    if (!unpacker.meta_length) {
+        return 0;
+    }
+    input->seek(unpacker.meta_offset, SEEK_SET);
+    unpacker.order = get2();
+    input->seek(6, SEEK_CUR);
+    input->seek(unpacker.meta_offset + get4(), SEEK_SET);
+    unsigned entries = get4();
+    get4();
+    const INT64 fsize = input->size();
+
+    try {
+        while (entries--) {
+            checkCancel();
+            const unsigned tag = get4();
+            int len = get4();
+            const unsigned data = get4();
+            const INT64 save = input->tell();
+            input->seek(unpacker.meta_offset + data, SEEK_SET);
+            if (input->eof()) {
+                // Bad or unknown tag
+                input->seek(save, SEEK_SET);
+                continue;
+            }
+            const INT64 savepos = input->tell();
+            if (len < 0 || (len > 8 && savepos + INT64(len) > 2 * fsize)) {
+                input->seek(save, SEEK_SET);
+                continue;
+            }
+
+            if (tag == 0x0400) {
+                // Sensor defects: bad columns are fixed at the end, sorted
+                while ((len -= 8) >= 0) {
+                    const unsigned col = get2();
+                    const unsigned row = get2();
+                    const unsigned type = get2();
+                    get2();
+                    if (col >= raw_width) continue;
+                    if (type == 131 || type == 137) {
+                        bad_cols.push_back(col);
+                    } else if (type == 129) {
+                        if (row >= raw_height) continue;
+                        const int j = (FC(row - imgdata.sizes.top_margin, col - imgdata.sizes.left_margin) != 1) * 4;
+                        unsigned count = 0;
+                        int sum = 0;
+                        for (int i = j; i < j + 8; i++) sum += p1rawc(row + dir[i][0], col + dir[i][1], count);
+                        if (count) raw(row, col) = ushort((sum + (count >> 1)) / count);
+                    }
+                }
+            } else if (tag == 0x0419 || tag == 0x041a) {
+                if (tag == 0x0419) {
+                    // Polynomial curve - output calibration, right half
+                    get4();
+                    for (int i = 0; i < 8; i++) poly[i] = getrealf(LIBRAW_EXIFTAG_TYPE_FLOAT);
+                    poly[3] += (ph1.tag_210 - poly[7]) * poly[6] + 1;
+                    for (int i = 0; i < 0x10000; i++) {
+                        float num = (poly[5] * i + poly[3]) * i + poly[1];
+                        curve[i] = ushort(Lim(num, 0.f, 65535.f));
+                    }
+                } else {
+                    // Polynomial curve
+                    for (int i = 0; i < 4; i++) poly[i] = getrealf(LIBRAW_EXIFTAG_TYPE_FLOAT);
+                    for (int i = 0; i < 0x10000; i++) {
+                        float num = 0;
+                        for (int j = 4; j--;) num = num * i + poly[j];
+                        curve[i] = ushort(Lim(num + i, 0.f, 65535.f));
+                    }
+                }
+                checkCancel();
+                apply_curve(0, raw_height, (tag & 1) * ph1.split_col, raw_width);
+            } else if (tag == 0x0401) {
+                // All-color flat fields - luma calibration
+                PhaseOneFlatField(1, 2);
+            } else if (tag == 0x0416 || tag == 0x0410) {
+                // Luma calibration
+                PhaseOneFlatField(0, 2);
+            } else if (tag == 0x040b) {
+                // Red+blue flat field - chroma calibration
+                PhaseOneFlatField(0, 4);
+            } else if (tag == 0x0412) {
+                input->seek(36, SEEK_CUR);
+                diff = abs(get2() - ph1.tag_21a);
+                if (mindiff > diff) {
+                    mindiff = diff;
+                    off_412 = input->tell() - 38;
+                }
+            } else if (tag == 0x041f && !qlin_applied && ph1.split_col > 0 && ph1.split_col < int(raw_width) &&
+                       ph1.split_row > 0 && ph1.split_row < int(raw_height)) {
+                // Quadrant linearization
+                ushort lc[2][2][16], ref[16];
+                bool baddiv = false;
+                for (int qr = 0; qr < 2; qr++) {
+                    for (int qc = 0; qc < 2; qc++) {
+                        for (int i = 0; i < 16; i++) lc[qr][qc][i] = ushort(get4());
+                        if (lc[qr][qc][15] == 0) baddiv = true;
+                    }
+                }
+                if (baddiv) continue;
+                for (int i = 0; i < 16; i++) {
+                    int v = 0;
+                    for (int qr = 0; qr < 2; qr++) {
+                        for (int qc = 0; qc < 2; qc++) v += lc[qr][qc][i];
+                    }
+                    ref[i] = ushort((v + 2) >> 2);
+                }
+                for (int qr = 0; qr < 2; qr++) {
+                    for (int qc = 0; qc < 2; qc++) {
+                        int cx[19], cf[19];
+                        for (int i = 0; i < 16; i++) {
+                            cx[1 + i] = lc[qr][qc][i];
+                            cf[1 + i] = ref[i];
+                        }
+                        cx[0] = cf[0] = 0;
+                        cx[17] = cf[17] = int((unsigned(ref[15]) * 65535) / lc[qr][qc][15]);
+                        cf[18] = cx[18] = 65535;
+                        cubic_spline(cx, cf, 19);
+                        checkCancel();
+                        apply_curve(qr ? ph1.split_row : 0, qr ? raw_height : ph1.split_row,
+                                    qc ? ph1.split_col : 0, qc ? raw_width : ph1.split_col);
+                    }
+                }
+                qlin_applied = 1;
+            } else if (tag == 0x041e && !qmult_applied) {
+                // Quadrant multipliers - output calibration
+                float qmult[2][2] = {{1, 1}, {1, 1}};
+                get4();
+                get4();
+                get4();
+                get4();
+                qmult[0][0] = 1.0f + getrealf(LIBRAW_EXIFTAG_TYPE_FLOAT);
+                get4();
+                get4();
+                get4();
+                get4();
+                get4();
+                qmult[0][1] = 1.0f + getrealf(LIBRAW_EXIFTAG_TYPE_FLOAT);
+                get4();
+                get4();
+                get4();
+                qmult[1][0] = 1.0f + getrealf(LIBRAW_EXIFTAG_TYPE_FLOAT);
+                get4();
+                get4();
+                get4();
+                qmult[1][1] = 1.0f + getrealf(LIBRAW_EXIFTAG_TYPE_FLOAT);
+                checkCancel();
+                ParallelRows(int(raw_height), MIN_ROWS, [&](int first, int last) {
+                    for (unsigned row = unsigned(first); row < unsigned(last); row++) {
+                        for (unsigned col = 0; col < raw_width; col++) {
+                            int i = int(qmult[row >= unsigned(ph1.split_row)][col >= unsigned(ph1.split_col)] *
+                                        raw(row, col));
+                            raw(row, col) = ushort(Lim(i, 0, 65535));
+                        }
+                    }
+                });
+                qmult_applied = 1;
+            } else if (tag == 0x0431 && !qmult_applied && ph1.split_col > 0 && ph1.split_col < int(raw_width) &&
+                       ph1.split_row > 0 && ph1.split_row < int(raw_height)) {
+                // Quadrant combined - four tile gain calibration
+                ushort lc[2][2][7], ref[7];
+                for (int i = 0; i < 7; i++) ref[i] = ushort(get4());
+                for (int qr = 0; qr < 2; qr++) {
+                    for (int qc = 0; qc < 2; qc++) {
+                        for (int i = 0; i < 7; i++) lc[qr][qc][i] = ushort(get4());
+                    }
+                }
+                for (int qr = 0; qr < 2; qr++) {
+                    for (int qc = 0; qc < 2; qc++) {
+                        int cx[9], cf[9];
+                        for (int i = 0; i < 7; i++) {
+                            cx[1 + i] = ref[i];
+                            cf[1 + i] = int((unsigned(ref[i]) * lc[qr][qc][i]) / 10000);
+                        }
+                        cx[0] = cf[0] = 0;
+                        cx[8] = cf[8] = 65535;
+                        cubic_spline(cx, cf, 9);
+                        checkCancel();
+                        apply_curve(qr ? ph1.split_row : 0, qr ? raw_height : ph1.split_row,
+                                    qc ? ph1.split_col : 0, qc ? raw_width : ph1.split_col);
+                    }
+                }
+                qmult_applied = 1;
+                qlin_applied = 1;
+            }
+            input->seek(save, SEEK_SET);
+        }
+
+        if (!bad_cols.empty()) {
+            // Fixes read only other columns, so each column's rows are
+            // independent; columns go in order, as later ones read earlier ones
+            std::sort(bad_cols.begin(), bad_cols.end());
+            bool prev_isolated = true;
+            for (size_t i = 0; i < bad_cols.size(); ++i) {
+                const bool next_isolated = i == bad_cols.size() - 1 || bad_cols[i + 1] > bad_cols[i] + 4;
+                const unsigned col = bad_cols[i];
+                const bool grad = prev_isolated && next_isolated;
+                ParallelRows(int(raw_height), MIN_ROWS * 8, [&](int first, int last) {
+                    for (unsigned row = unsigned(first); row < unsigned(last); ++row) {
+                        if (grad) {
+                            phase_one_fix_pixel_grad(row, col);
+                        } else {
+                            phase_one_fix_col_pixel_avg(row, col);
+                        }
+                    }
+                });
+                prev_isolated = next_isolated;
+            }
+        }
+
+        if (off_412) {
+            input->seek(off_412, SEEK_SET);
+            for (int i = 0; i < 9; i++) head[i] = get4() & 0x7fff;
+            const unsigned w0 = head[1] * head[3], w1 = head[2] * head[4];
+            if (w0 > 10240000 || w1 > 10240000) throw LIBRAW_EXCEPTION_ALLOC;
+            if (w0 < 1 || w1 < 1) throw LIBRAW_EXCEPTION_IO_CORRUPT;
+
+            // LibRaw's single block: yval[0], yval[1], then xval[0], xval[1]
+            std::vector<float> block((size_t(w0) + w1) * 6 / sizeof(float) + 1, 0.f);
+            float* yval[2] = {block.data(), block.data() + w0};
+            ushort* xval[2];
+            xval[0] = reinterpret_cast<ushort*>(yval[1] + w1);
+            xval[1] = xval[0] + w0;
+            get2();
+            for (int i = 0; i < 2; i++) {
+                for (unsigned j = 0; j < unsigned(head[i + 1] * head[i + 3]); j++) {
+                    yval[i][j] = getrealf(LIBRAW_EXIFTAG_TYPE_FLOAT);
+                }
+            }
+            for (int i = 0; i < 2; i++) {
+                for (unsigned j = 0; j < unsigned(head[i + 1] * head[i + 3]); j++) xval[i][j] = get2();
+            }
+            checkCancel();
+            ParallelRows(int(raw_height), MIN_ROWS, [&](int first, int last) {
+                float mult[2];
+                for (unsigned row = unsigned(first); row < unsigned(last); row++) {
+                    for (unsigned col = 0; col < raw_width; col++) {
+                        float cfrac = (float)col * head[3] / raw_width;
+                        const int cip = (int)cfrac;
+                        cfrac -= cip;
+                        const float num = raw(row, col) * 0.5f;
+                        for (int i = cip; i < cip + 2; i++) {
+                            int j, k;
+                            for (k = j = 0; j < head[1]; j++) {
+                                if (num < xval[0][k = head[1] * i + j]) break;
+                            }
+                            float frac;
+                            if (j == 0 || j == head[1] || k < 1 || unsigned(k) >= w0 + w1) {
+                                frac = 0;
+                            } else {
+                                int xdiv = (xval[0][k] - xval[0][k - 1]);
+                                frac = xdiv ? (xval[0][k] - num) / (xval[0][k] - xval[0][k - 1]) : 0;
+                            }
+                            if (unsigned(k) < w0 + w1) {
+                                mult[i - cip] = yval[0][k > 0 ? k - 1 : 0] * frac + yval[0][k] * (1 - frac);
+                            } else {
+                                mult[i - cip] = 0;
+                            }
+                        }
+                        const int i = int(((mult[0] * (1.f - cfrac) + mult[1] * cfrac) * row + num) * 2.f);
+                        raw(row, col) = ushort(Lim(i, 0, 65535));
+                    }
+                }
+            });
+        }
+    } catch (...) {
+        return LIBRAW_CANCELLED_BY_CALLBACK;
+    }
+    return 0;
+}
@@ -0,0 +1,248 @@
+/**
+ * @filmgallery/libraw-native - Output Image Copies
+ *
+ * Replacement for dcraw_make_mem_image()/copy_mem_image(), which size the
+ * image as `unsigned` and index rows and pixels as `int`: anything over
+ * 4 GB (or 2^31 pixels) silently wraps. Here every size and offset is 64-bit,
+ * and rows can be copied in ranges so callers can stream huge images in
+ * strips instead of holding one contiguous buffer. Rows are split across
+ * threads, and with an export colour space set the copy converts the linear
+ * image straight into that space (color_convert.h) instead of applying
+ * LibRaw's gamma curve. JPEG output pulls the same rows band by band
+ * (jpeg_encoder.h).
+ */
+
+#include "film_libraw.h"
+#include "parallel.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+bool FilmLibRaw::GetMemImageLayout(MemImageLayout& layout) const {
+    if ((imgdata.progress_flags & LIBRAW_PROGRESS_THUMB_MASK) < LIBRAW_PROGRESS_PRE_INTERPOLATE) {
+        return false;
+    }
+
+    get_mem_image_format(&layout.width, &layout.height, &layout.colors, &layout.bits);
+    if (MonochromeImageActive() && mono_float_) {
+        layout.bits = 32;
+    }
+    layout.stride = static_cast<size_t>(layout.width) * layout.colors * (layout.bits / 8);
+    layout.size = layout.stride * static_cast<size_t>(layout.height);
+    return true;
+}
+
+bool FilmLibRaw::AutoBrightActive() const {
+    return libraw_internal_data.output_data.histogram &&
+           !((imgdata.params.highlight & ~2) || imgdata.params.no_auto_bright);
+}
+
+int FilmLibRaw::OutputWhiteLevel() const {
+    int (*histogram)[0x2000] = libraw_internal_data.output_data.histogram;
+
+    int t_white = 0x2000;
+    if (AutoBrightActive()) {
+        // Single precision like LibRaw, so the white point matches exactly
+        INT64 pixels = static_cast<INT64>(imgdata.sizes.width) * imgdata.sizes.height;
+        INT64 perc = static_cast<INT64>(static_cast<float>(pixels) * imgdata.params.auto_bright_thr);
+        if (libraw_internal_data.internal_output_params.fuji_width) {
+            perc /= 2;
+        }
+        t_white = 0;
+        for (int c = 0; c < imgdata.idata.colors; c++) {
+            int val = 0x2000;
+            INT64 total = 0;
+            while (--val > 32) {
+                total += histogram[c][val];
+                if (total > perc) break;
+            }
+            t_white = std::max(t_white, val);
+        }
+    }
+    return static_cast<int>((t_white << 3) / imgdata.params.bright);
+}
+
+bool FilmLibRaw::GetHistogram(int bins, std::vector<uint32_t>& out) const {
+    int (*histogram)[0x2000] = libraw_internal_data.output_data.histogram;
+    if (!histogram || !(imgdata.progress_flags & LIBRAW_PROGRESS_CONVERT_RGB) ||
+        bins <= 0 || bins > 0x2000 || (bins & (bins - 1))) {
+        return false;
+    }
+
+    const int colors = imgdata.idata.colors;
+    const int group = 0x2000 / bins;
+    out.assign(static_cast<size_t>(colors) * bins, 0);
+    for (int c = 0; c < colors; c++) {
+        uint32_t* dst = out.data() + static_cast<size_t>(c) * bins;
+        for (int i = 0; i < 0x2000; i++) dst[i / group] += histogram[c][i];
+    }
+    return true;
+}
+
+void FilmLibRaw::PrepareOutputCurve() {
+    if (!libraw_internal_data.output_data.histogram) {
+        return;
+    }
+    gamma_curve(imgdata.params.gamm[0], imgdata.params.gamm[1], 2, OutputWhiteLevel());
+}
+
+void FilmLibRaw::SetExportColorSpace(int space, TransferFunction transfer) {
+    export_space_ = space;
+    export_transfer_ = transfer;
+}
+
+bool FilmLibRaw::ExportColorSpaceActive() const {
+    return IsConvertibleColorSpace(export_space_) && imgdata.idata.colors == 3 &&
+           !libraw_internal_data.internal_output_params.raw_color &&
+           IsConvertibleColorSpace(imgdata.params.output_color);
+}
+
+TransferFunction FilmLibRaw::ExportTransfer() const {
+    return export_transfer_ == TRANSFER_DEFAULT ? DefaultTransfer(export_space_) : export_transfer_;
+}
+
+int FilmLibRaw::CopyMemImageRows(uint8_t* dst, size_t stride, int first_row, int rows) {
+    MemImageLayout layout;
+    if (!GetMemImageLayout(layout)) {
+        return LIBRAW_OUT_OF_ORDER_CALL;
+    }
+    if (first_row < 0 || rows < 0 || first_row + rows > layout.height || stride < layout.stride) {
+        return LIBRAW_DATA_ERROR;
+    }
+    if (ExportColorSpaceActive()) {
+        const TransferEncoder encoder(ExportTransfer());
+        return CopyRows(layout, &encoder, dst, stride, first_row, rows);
+    }
+    PrepareOutputCurve();
+    return CopyRows(layout, nullptr, dst, stride, first_row, rows);
+}
+
+int FilmLibRaw::EncodeMemImageJpeg(const JpegOptions& options, std::vector<uint8_t>& out) {
+    MemImageLayout layout;
+    if (!GetMemImageLayout(layout)) {
+        return LIBRAW_OUT_OF_ORDER_CALL;
+    }
+    if (layout.colors != 1 && layout.colors != 3) {
+        return LIBRAW_DATA_ERROR;
+    }
+    std::unique_ptr<TransferEncoder> encoder;
+    if (ExportColorSpaceActive()) {
+        encoder.reset(new TransferEncoder(ExportTransfer()));
+    } else {
+        PrepareOutputCurve();
+    }
+
+    // Each band copies its own 8-bit MCU rows, so the output image is never
+    // held whole
+    layout.bits = 8;
+    layout.stride = static_cast<size_t>(layout.width) * layout.colors;
+    auto source = [this, &layout, &encoder](uint8_t* dst, size_t stride, int first_row, int rows) {
+        return CopyRows(layout, encoder.get(), dst, stride, first_row, rows) == LIBRAW_SUCCESS;
+    };
+    if (!EncodeJpeg(layout.width, layout.height, layout.colors, source, options, out)) {
+        return LIBRAW_DATA_ERROR;
+    }
+    return LIBRAW_SUCCESS;
+}
+
+int FilmLibRaw::CopyRows(const MemImageLayout& layout, const TransferEncoder* encoder,
+                         uint8_t* dst, size_t stride, int first_row, int rows) const {
+
+    // Processed image is height x width before the flip; output rows walk it
+    // according to flip (same mapping as LibRaw::flip_index, in 64 bits)
+    const int flip = imgdata.sizes.flip;
+    const INT64 src_height = imgdata.sizes.height;
+    const INT64 src_width = imgdata.sizes.width;
+    auto index = [&](INT64 row, INT64 col) -> INT64 {
+        if (flip & 4) std::swap(row, col);
+        if (flip & 2) row = src_height - 1 - row;
+        if (flip & 1) col = src_width - 1 - col;
+        return row * src_width + col;
+    };
+    const INT64 cstep = index(0, 1) - index(0, 0);
+
+    // dcraw_process()'s ushort[4] image, the LinearRaw fast path's 3-sample
+    // one (linear_raw.cpp) or monochrome luminance (monochrome_raw.cpp)
+    const int colors = imgdata.idata.colors;
+    const ushort* image = imgdata.image ? imgdata.image[0] : linear_image_ ? linear_image_.get() : mono_image_.get();
+    const INT64 pstep = imgdata.image ? 4 : linear_image_ ? 3 : 1;
+    if (!image) {
+        return LIBRAW_OUT_OF_ORDER_CALL;
+    }
+
+    if (layout.bits == 32) {
+        // Float monochrome: linear luminance, no output curve
+        const float scale = 1.0f / 65535.0f;
+        ParallelRows(rows, 16, [&](int first, int last) {
+            for (int row = first_row + first; row < first_row + last; row++) {
+                float* out = reinterpret_cast<float*>(dst + static_cast<size_t>(row - first_row) * stride);
+                const ushort* pix = image + index(row, 0);
+                for (int col = 0; col < layout.width; col++, pix += cstep) {
+                    out[col] = *pix * scale;
+                }
+            }
+        });
+        return LIBRAW_SUCCESS;
+    }
+
+    if (encoder) {
+        // Linear output-space values (clipped where LibRaw's curve clips)
+        // -> export space matrix -> export transfer, instead of the curve
+        float matrix[3][3];
+        ColorSpaceMatrix(imgdata.params.output_color, export_space_, matrix);
+        const float scale = 1.0f / OutputWhiteLevel();
+        const size_t samples = static_cast<size_t>(layout.width) * 3;
+
+        ParallelRows(rows, 16, [&](int first, int last) {
+            std::vector<float> values(samples);
+            for (int row = first_row + first; row < first_row + last; row++) {
+                const ushort* pix = image + index(row, 0) * pstep;
+                float* v = values.data();
+                for (int col = 0; col < layout.width; col++, pix += cstep * pstep, v += 3) {
+                    float r = std::min(pix[0] * scale, 1.0f);
+                    float g = std::min(pix[1] * scale, 1.0f);
+                    float b = std::min(pix[2] * scale, 1.0f);
+                    v[0] = matrix[0][0] * r + matrix[0][1] * g + matrix[0][2] * b;
+                    v[1] = matrix[1][0] * r + matrix[1][1] * g + matrix[1][2] * b;
+                    v[2] = matrix[2][0] * r + matrix[2][1] * g + matrix[2][2] * b;
+                }
+                encoder->EncodeRow(values.data(), samples);
+
+                uint8_t* line = dst + static_cast<size_t>(row - first_row) * stride;
+                if (layout.bits == 8) {
+                    for (size_t i = 0; i < samples; i++) {
+                        line[i] = static_cast<uint8_t>(values[i] * 255.0f + 0.5f);
+                    }
+                } else {
+                    ushort* out = reinterpret_cast<ushort*>(line);
+                    for (size_t i = 0; i < samples; i++) {
+                        out[i] = static_cast<ushort>(values[i] * 65535.0f + 0.5f);
+                    }
+                }
+            }
+        });
+        return LIBRAW_SUCCESS;
+    }
+
+    const ushort* curve = imgdata.color.curve;
+
+    ParallelRows(rows, 16, [&](int first, int last) {
+        for (int row = first_row + first; row < first_row + last; row++) {
+            uint8_t* line = dst + static_cast<size_t>(row - first_row) * stride;
+            const ushort* pix = image + index(row, 0) * pstep;
+            if (layout.bits == 8) {
+                uint8_t* out = line;
+                for (int col = 0; col < layout.width; col++, pix += cstep * pstep) {
+                    for (int c = 0; c < colors; c++) *out++ = curve[pix[c]] >> 8;
+                }
+            } else {
+                ushort* out = reinterpret_cast<ushort*>(line);
+                for (int col = 0; col < layout.width; col++, pix += cstep * pstep) {
+                    for (int c = 0; c < colors; c++) *out++ = curve[pix[c]];
+                }
+            }
+        }
+    });
+
+    return LIBRAW_SUCCESS;
+}
@@ -0,0 +1,214 @@
+/**
+ * @filmgallery/libraw-native - Packed Metadata Records Implementation
+ *
+ * Field names match the getMetadata()/getImageSize()/getLensInfo()/
+ * getColorInfo() object keys. Each field carries its own extractor, so the
+ * schema is the single source of truth for both the writer and JS.
+ */
+
+#include "metadata_record.h"
+#include <cstring>
+#include <limits>
+
+namespace {
+
+#define META_NUMBER(name, type, expr) \
+    { name, type, [](const libraw_data_t& d) -> double { return static_cast<double>(expr); }, nullptr, 0 }
+#define META_STRING(name, expr) \
+    { name, META_STR, nullptr, [](const libraw_data_t& d) -> const char* { return expr; }, 0 }
+
+// Decimal degrees from LibRaw's parsed deg/min/sec (NaN when absent)
+double GpsDegrees(const float dms[3], char ref, char parsed) {
+    if (!parsed) return std::numeric_limits<double>::quiet_NaN();
+    double value = dms[0] + dms[1] / 60.0 + dms[2] / 3600.0;
+    return (ref == 'S' || ref == 'W') ? -value : value;
+}
+
+std::vector<MetadataField> BuildSchema() {
+    std::vector<MetadataField> fields = {
+        { "status", META_I32, nullptr, nullptr, 0 },
+
+        // Camera info
+        META_STRING("make", d.idata.make),
+        META_STRING("model", d.idata.model),
+        META_STRING("normalizedMake", d.idata.normalized_make),
+        META_STRING("normalizedModel", d.idata.normalized_model),
+        META_STRING("software", d.idata.software),
+
+        // Image info
+        META_NUMBER("rawCount", META_U32, d.idata.raw_count),
+        META_NUMBER("dngVersion", META_U32, d.idata.dng_version),
+        META_NUMBER("isFoveon", META_U32, d.idata.is_foveon != 0),
+        META_NUMBER("colors", META_I32, d.idata.colors),
+        META_STRING("cdesc", d.idata.cdesc),
+
+        // Shooting info
+        META_NUMBER("iso", META_F64, d.other.iso_speed),
+        META_NUMBER("shutter", META_F64, d.other.shutter),
+        META_NUMBER("aperture", META_F64, d.other.aperture),
+        META_NUMBER("focalLength", META_F64, d.other.focal_len),
+        META_NUMBER("timestamp", META_F64, d.other.timestamp),
+        META_NUMBER("shotOrder", META_U32, d.other.shot_order),
+        META_STRING("artist", d.other.artist),
+        META_STRING("desc", d.other.desc),
+        META_NUMBER("gpsLatitude", META_F64,
+                    GpsDegrees(d.other.parsed_gps.latitude, d.other.parsed_gps.latref, d.other.parsed_gps.gpsparsed)),
+        META_NUMBER("gpsLongitude", META_F64,
+                    GpsDegrees(d.other.parsed_gps.longitude, d.other.parsed_gps.longref, d.other.parsed_gps.gpsparsed)),
+        META_NUMBER("gpsAltitude", META_F64,
+                    d.other.parsed_gps.gpsparsed ? d.other.parsed_gps.altitude : std::numeric_limits<float>::quiet_NaN()),
+
+        // Image size
+        META_NUMBER("rawWidth", META_U32, d.sizes.raw_width),
+        META_NUMBER("rawHeight", META_U32, d.sizes.raw_height),
+        META_NUMBER("width", META_U32, d.sizes.width),
+        META_NUMBER("height", META_U32, d.sizes.height),
+        META_NUMBER("topMargin", META_U32, d.sizes.top_margin),
+        META_NUMBER("leftMargin", META_U32, d.sizes.left_margin),
+        META_NUMBER("flip", META_I32, d.sizes.flip),
+        META_NUMBER("pixelAspect", META_F64, d.sizes.pixel_aspect),
+
+        // Lens info
+        META_NUMBER("minFocal", META_F64, d.lens.MinFocal),
+        META_NUMBER("maxFocal", META_F64, d.lens.MaxFocal),
+        META_NUMBER("maxApAtMinFocal", META_F64, d.lens.MaxAp4MinFocal),
+        META_NUMBER("maxApAtMaxFocal", META_F64, d.lens.MaxAp4MaxFocal),
+        META_NUMBER("exifMaxAp", META_F64, d.lens.EXIF_MaxAp),
+        META_STRING("lensMake", d.lens.LensMake),
+        META_STRING("lens", d.lens.Lens),
+        META_STRING("lensSerial", d.lens.LensSerial),
+        META_STRING("internalLensSerial", d.lens.InternalLensSerial),
+        META_NUMBER("focalLengthIn35mm", META_U32, d.lens.FocalLengthIn35mmFormat),
+
+        // Color info (cameraMultipliers flattened)
+        META_NUMBER("camMul0", META_F64, d.color.cam_mul[0]),
+        META_NUMBER("camMul1", META_F64, d.color.cam_mul[1]),
+        META_NUMBER("camMul2", META_F64, d.color.cam_mul[2]),
+        META_NUMBER("camMul3", META_F64, d.color.cam_mul[3]),
+        META_NUMBER("black", META_U32, d.color.black),
+        META_NUMBER("maximum", META_U32, d.color.maximum),
+        META_NUMBER("fmaximum", META_F64, d.color.fmaximum),
+        META_NUMBER("fnorm", META_F64, d.color.fnorm)
+    };
+
+    // Natural alignment, record size rounded up to 8 so F64 stays aligned
+    uint32_t offset = 0;
+    for (auto& field : fields) {
+        uint32_t size = field.type == META_I32 || field.type == META_U32 ? 4 : 8;
+        offset = (offset + size - 1) & ~(size - 1);
+        field.offset = offset;
+        offset += size;
+    }
+
+    return fields;
+}
+
+#undef META_NUMBER
+#undef META_STRING
+
+uint32_t ComputeRecordSize() {
+    const MetadataField& last = MetadataSchema().back();
+    uint32_t end = last.offset + (last.type == META_I32 || last.type == META_U32 ? 4 : 8);
+    return (end + 7) & ~7u;
+}
+
+template <typename T>
+void Store(uint8_t* dst, T value) {
+    // Records are little-endian; every supported target is too
+    std::memcpy(dst, &value, sizeof(T));
+}
+
+}  // namespace
+
+const std::vector<MetadataField>& MetadataSchema() {
+    static const std::vector<MetadataField> schema = BuildSchema();
+    return schema;
+}
+
+uint32_t MetadataRecordSize() {
+    static const uint32_t size = ComputeRecordSize();
+    return size;
+}
+
+// ============================================================================
+// MetadataRecordWriter
+// ============================================================================
+
+MetadataRecordWriter::MetadataRecordWriter(size_t count)
+    : count_(count), records_(count * MetadataRecordSize(), 0) {
+}
+
+uint32_t MetadataRecordWriter::AddString(const char* value, uint32_t* length) {
+    size_t len = value ? std::strlen(value) : 0;
+    *length = static_cast<uint32_t>(len);
+    if (len == 0) {
+        return 0;
+    }
+
+    // Makes, models and lens names repeat across a library; store each once
+    std::string key(value, len);
+    auto it = interned_.find(key);
+    if (it != interned_.end()) {
+        return it->second;
+    }
+
+    uint32_t offset = static_cast<uint32_t>(pool_.size());
+    pool_.append(key);
+    interned_.emplace(std::move(key), offset);
+    return offset;
+}
+
+void MetadataRecordWriter::Fill(size_t index, const libraw_data_t& data) {
+    uint8_t* record = records_.data() + index * MetadataRecordSize();
+
+    for (const MetadataField& field : MetadataSchema()) {
+        uint8_t* dst = record + field.offset;
+        switch (field.type) {
+            case META_I32:
+                Store<int32_t>(dst, field.number ? static_cast<int32_t>(field.number(data)) : 0);
+                break;
+            case META_U32:
+                Store<uint32_t>(dst, static_cast<uint32_t>(field.number(data)));
+                break;
+            case META_F64:
+                Store<double>(dst, field.number(data));
+                break;
+            case META_STR: {
+                uint32_t length = 0;
+                uint32_t offset = AddString(field.string(data), &length);
+                Store<uint32_t>(dst, offset);
+                Store<uint32_t>(dst + 4, length);
+                break;
+            }
+        }
+    }
+}
+
+void MetadataRecordWriter::SetStatus(size_t index, int status) {
+    uint8_t* record = records_.data() + index * MetadataRecordSize();
+    Store<int32_t>(record + MetadataSchema()[0].offset, status);
+}
+
+size_t MetadataRecordWriter::ByteLength() const {
+    return kMetadataHeaderSize + records_.size() + pool_.size();
+}
+
+void MetadataRecordWriter::Serialize(uint8_t* out) const {
+    uint8_t header[kMetadataHeaderSize] = {};
+    Store<uint32_t>(header + 0, kMetadataMagic);
+    Store<uint16_t>(header + 4, kMetadataVersion);
+    Store<uint16_t>(header + 6, kMetadataHeaderSize);
+    Store<uint32_t>(header + 8, static_cast<uint32_t>(count_));
+    Store<uint32_t>(header + 12, MetadataRecordSize());
+    Store<uint32_t>(header + 16, static_cast<uint32_t>(MetadataSchema().size()));
+    Store<uint32_t>(header + 20, static_cast<uint32_t>(kMetadataHeaderSize + records_.size()));
+    Store<uint32_t>(header + 24, static_cast<uint32_t>(pool_.size()));
+
+    std::memcpy(out, header, kMetadataHeaderSize);
+    if (!records_.empty()) {
+        std::memcpy(out + kMetadataHeaderSize, records_.data(), records_.size());
+    }
+    if (!pool_.empty()) {
+        std::memcpy(out + kMetadataHeaderSize + records_.size(), pool_.data(), pool_.size());
+    }
+}
@@ -0,0 +1,93 @@
+/**
+ * @filmgallery/libraw-native - Packed Metadata Records
+ *
+ * Fixed-layout binary records for file metadata, so library scans can read
+ * one or many files into a single buffer instead of building a JS object per
+ * field. The layout is described by a schema shared with lib/metadata-records.js:
+ *
+ *   header   (kMetadataHeaderSize bytes, little-endian)
+ *     u32 magic 'FGMR', u16 version, u16 header size, u32 record count,
+ *     u32 record size, u32 field count, u32 string pool offset,
+ *     u32 string pool size, u32 reserved
+ *   records  (record count x record size)
+ *     numeric fields inline at fixed offsets; strings as u32 offset + u32
+ *     byte length into the string pool
+ *   pool     (UTF-8 bytes, not NUL-terminated)
+ *
+ * Field 0 is always "status": 0 for a readable file, otherwise the LibRaw
+ * error code, in which case every other field is zero/empty.
+ */
+
+#ifndef METADATA_RECORD_H
+#define METADATA_RECORD_H
+
+#include "libraw/libraw.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum MetadataFieldType : uint8_t {
+    META_I32 = 0,
+    META_U32 = 1,
+    META_F64 = 2,
+    META_STR = 3
+};
+
+struct MetadataField {
+    const char* name;
+    MetadataFieldType type;
+    double (*number)(const libraw_data_t&);         // numeric fields
+    const char* (*string)(const libraw_data_t&);    // META_STR fields
+    uint32_t offset;                                // byte offset within a record
+};
+
+static const uint32_t kMetadataMagic = 0x524D4746;  // "FGMR"
+static const uint16_t kMetadataVersion = 1;
+static const uint16_t kMetadataHeaderSize = 32;
+
+/**
+ * Schema (fields with their record offsets), computed once
+ */
+const std::vector<MetadataField>& MetadataSchema();
+
+/**
+ * Size in bytes of one record
+ */
+uint32_t MetadataRecordSize();
+
+/**
+ * Accumulates records and their strings, then serializes the whole block
+ */
+class MetadataRecordWriter {
+public:
+    explicit MetadataRecordWriter(size_t count);
+
+    /**
+     * Fill record `index` from an opened LibRaw instance
+     */
+    void Fill(size_t index, const libraw_data_t& data);
+
+    /**
+     * Mark record `index` as failed (fields stay zero)
+     */
+    void SetStatus(size_t index, int status);
+
+    size_t ByteLength() const;
+
+    /**
+     * Write header, records and string pool to `out` (ByteLength() bytes)
+     */
+    void Serialize(uint8_t* out) const;
+
+private:
+    uint32_t AddString(const char* value, uint32_t* length);
+
+    size_t count_;
+    std::vector<uint8_t> records_;
+    std::string pool_;
+    std::unordered_map<std::string, uint32_t> interned_;   // string -> pool offset
+};
+
+#endif // METADATA_RECORD_H
@@ -0,0 +1,887 @@
+/**
+ * @filmgallery/libraw-native - Metadata Writer
+ */
+
+#include "metadata_writer.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// TIFF field types
+const uint16_t BYTE = 1;
+const uint16_t ASCII = 2;
+const uint16_t SHORT = 3;
+const uint16_t RATIONAL = 5;
+const uint16_t UNDEFINED = 7;
+
+const int IFD0 = 0;
+const int EXIF_IFD = 1;
+const int GPS_IFD = 2;
+
+const uint16_t TAG_EXIF_IFD = 0x8769;
+const uint16_t TAG_GPS_IFD = 0x8825;
+const uint16_t TAG_XMP = 700;
+const uint16_t TAG_IPTC = 0x83BB;           // IPTC-NAA
+const uint16_t TAG_PHOTOSHOP = 0x8649;      // Photoshop image resources
+const uint16_t TAG_EXIF_VERSION = 0x9000;
+const uint16_t TAG_USER_COMMENT = 0x9286;
+const uint16_t TAG_GPS_VERSION = 0x0000;
+
+const char* const XMP_NAMESPACE_FILMGALLERY = "http://ns.filmgallery.app/xmp/1.0/";
+const char* const XMP_NAMESPACE_DC = "http://purl.org/dc/elements/1.1/";
+
+// Photoshop resource IDs replaced along with the IPTC record
+const uint16_t RESOURCE_IPTC = 0x0404;
+const uint16_t RESOURCE_IPTC_DIGEST = 0x0425;
+
+// Longest IPTC keyword, in bytes
+const size_t IPTC_KEYWORD_MAX = 64;
+
+struct ExifTagDef {
+    const char* name;
+    int ifd;
+    uint16_t tag;
+    uint16_t type;
+};
+
+// exiftool names; ISOSpeedRatings and DateTimeDigitized are the EXIF 2.2 names
+const ExifTagDef EXIF_TAGS[] = {
+    {"ImageDescription", IFD0, 0x010E, ASCII},
+    {"Make", IFD0, 0x010F, ASCII},
+    {"Model", IFD0, 0x0110, ASCII},
+    {"Orientation", IFD0, 0x0112, SHORT},
+    {"Software", IFD0, 0x0131, ASCII},
+    {"ModifyDate", IFD0, 0x0132, ASCII},
+    {"Artist", IFD0, 0x013B, ASCII},
+    {"Copyright", IFD0, 0x8298, ASCII},
+    {"ExposureTime", EXIF_IFD, 0x829A, RATIONAL},
+    {"FNumber", EXIF_IFD, 0x829D, RATIONAL},
+    {"ISO", EXIF_IFD, 0x8827, SHORT},
+    {"ISOSpeedRatings", EXIF_IFD, 0x8827, SHORT},
+    {"DateTimeOriginal", EXIF_IFD, 0x9003, ASCII},
+    {"CreateDate", EXIF_IFD, 0x9004, ASCII},
+    {"DateTimeDigitized", EXIF_IFD, 0x9004, ASCII},
+    {"UserComment", EXIF_IFD, TAG_USER_COMMENT, UNDEFINED},
+    {"FocalLength", EXIF_IFD, 0x920A, RATIONAL},
+    {"FocalLengthIn35mmFormat", EXIF_IFD, 0xA405, SHORT},
+    {"LensMake", EXIF_IFD, 0xA433, ASCII},
+    {"LensModel", EXIF_IFD, 0xA434, ASCII},
+    {"GPSLatitudeRef", GPS_IFD, 0x0001, ASCII},
+    {"GPSLatitude", GPS_IFD, 0x0002, RATIONAL},
+    {"GPSLongitudeRef", GPS_IFD, 0x0003, ASCII},
+    {"GPSLongitude", GPS_IFD, 0x0004, RATIONAL},
+    {"GPSAltitudeRef", GPS_IFD, 0x0005, BYTE},
+    {"GPSAltitude", GPS_IFD, 0x0006, RATIONAL},
+};
+
+// Entries copied out of a JPEG's old EXIF whose offsets point elsewhere in it
+bool DroppedFromJpeg(uint16_t tag) {
+    return tag == 0x927C ||                     // MakerNote
+           tag == 0xA005 ||                     // Interoperability IFD
+           tag == 0x014A ||                     // SubIFDs
+           tag == 0x0111 || tag == 0x0117 ||    // Strip offsets / counts
+           tag == 0x0201 || tag == 0x0202;      // JPEG thumbnail
+}
+
+bool ParseNumber(const std::string& text, double& value) {
+    const char* begin = text.c_str();
+    char* end = nullptr;
+    double numerator = strtod(begin, &end);
+    if (end == begin) {
+        return false;
+    }
+    if (*end == '/') {
+        const char* rest = end + 1;
+        double denominator = strtod(rest, &end);
+        if (end == rest || denominator == 0) {
+            return false;
+        }
+        numerator /= denominator;
+    }
+    while (*end == ' ') end++;
+    value = numerator;
+    return *end == '\0' && std::isfinite(value);
+}
+
+// Reads "a/b" exactly, anything else through ToRational()
+bool ParseRational(const std::string& text, uint32_t& numerator, uint32_t& denominator) {
+    unsigned long long a, b;
+    char tail;
+    if (sscanf(text.c_str(), "%llu/%llu%c", &a, &b, &tail) == 2 && b && a <= 0xFFFFFFFFull && b <= 0xFFFFFFFFull) {
+        numerator = static_cast<uint32_t>(a);
+        denominator = static_cast<uint32_t>(b);
+        return true;
+    }
+    return false;
+}
+
+// Non-negative decimal as a rational: unit fractions (exposure times) stay
+// 1/n, otherwise the smallest power-of-ten denominator that is exact
+bool ToRational(double value, uint32_t& numerator, uint32_t& denominator) {
+    if (!(value >= 0) || value > 4294967295.0) {
+        return false;
+    }
+    if (value > 0 && value < 1) {
+        double inverse = 1 / value;
+        if (std::fabs(inverse - std::round(inverse)) < 1e-6 * inverse) {
+            numerator = 1;
+            denominator = static_cast<uint32_t>(std::round(inverse));
+            return true;
+        }
+    }
+    denominator = 1;
+    while (denominator < 10000 && value * denominator * 10 <= 4294967295.0 &&
+           std::fabs(value * denominator - std::round(value * denominator)) > 1e-6) {
+        denominator *= 10;
+    }
+    numerator = static_cast<uint32_t>(std::round(value * denominator));
+    return true;
+}
+
+std::string FormatNumber(double value) {
+    char buffer[32];
+    snprintf(buffer, sizeof buffer, "%.10g", value);
+    return buffer;
+}
+
+class ByteOrder {
+public:
+    explicit ByteOrder(bool little) : little_(little) {}
+
+    uint16_t Get16(const uint8_t* p) const {
+        return little_ ? uint16_t(p[0] | p[1] << 8) : uint16_t(p[0] << 8 | p[1]);
+    }
+
+    uint32_t Get32(const uint8_t* p) const {
+        return little_ ? uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24
+                       : uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | uint32_t(p[3]);
+    }
+
+    void Put16(std::vector<uint8_t>& out, uint16_t value) const {
+        uint8_t bytes[2] = {uint8_t(value >> 8), uint8_t(value)};
+        if (little_) std::swap(bytes[0], bytes[1]);
+        out.insert(out.end(), bytes, bytes + 2);
+    }
+
+    void Put32(std::vector<uint8_t>& out, uint32_t value) const {
+        uint8_t bytes[4] = {uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8), uint8_t(value)};
+        if (little_) std::reverse(bytes, bytes + 4);
+        out.insert(out.end(), bytes, bytes + 4);
+    }
+
+    void Set32(uint8_t* p, uint32_t value) const {
+        std::vector<uint8_t> bytes;
+        Put32(bytes, value);
+        memcpy(p, bytes.data(), 4);
+    }
+
+private:
+    bool little_;
+};
+
+int TypeSize(uint16_t type) {
+    switch (type) {
+        case 1: case 2: case 6: case 7: return 1;   // BYTE ASCII SBYTE UNDEFINED
+        case 3: case 8: return 2;                   // SHORT SSHORT
+        case 4: case 9: case 11: case 13: return 4; // LONG SLONG FLOAT IFD
+        case 5: case 10: case 12: return 8;         // RATIONAL SRATIONAL DOUBLE
+        default: return 0;
+    }
+}
+
+// A directory entry ready to lay out: value bytes in the output byte order,
+// or (TIFF files, whose data stays in place) the original value field
+struct Entry {
+    uint16_t tag;
+    uint16_t type;
+    uint32_t count;
+    std::vector<uint8_t> data;
+    bool verbatim;
+    uint8_t field[4];
+};
+
+struct Directories {
+    std::vector<Entry> ifd[3];
+    uint32_t next = 0;          // IFD0's next-IFD offset
+};
+
+// Read one IFD's entries; `copy` copies values out (JPEG EXIF, which is
+// rebuilt), otherwise the value fields are kept as they are
+bool ReadIfd(const uint8_t* tiff, size_t size, uint32_t offset, const ByteOrder& order, bool copy,
+             std::vector<Entry>& entries, uint32_t* next, uint32_t* exif, uint32_t* gps) {
+    if (offset < 8 || offset > size || size - offset < 2) {
+        return false;
+    }
+    const unsigned count = order.Get16(tiff + offset);
+    if ((size - offset - 2) / 12 < count) {
+        return false;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        const uint8_t* p = tiff + offset + 2 + i * 12;
+        Entry entry;
+        entry.tag = order.Get16(p);
+        entry.type = order.Get16(p + 2);
+        entry.count = order.Get32(p + 4);
+        entry.verbatim = !copy;
+        memcpy(entry.field, p + 8, 4);
+        if (entry.tag == TAG_EXIF_IFD || entry.tag == TAG_GPS_IFD) {
+            uint32_t* pointer = entry.tag == TAG_EXIF_IFD ? exif : gps;
+            if (pointer) *pointer = order.Get32(p + 8);
+            continue;
+        }
+        const int unit = TypeSize(entry.type);
+        if (!unit || (copy && DroppedFromJpeg(entry.tag))) {
+            continue;
+        }
+        if (copy) {
+            const uint64_t bytes = uint64_t(unit) * entry.count;
+            const uint64_t at = bytes <= 4 ? uint64_t(p + 8 - tiff) : order.Get32(p + 8);
+            if (at + bytes > size) {
+                continue;   // Corrupt entry
+            }
+            entry.data.assign(tiff + at, tiff + at + bytes);
+        }
+        entries.push_back(std::move(entry));
+    }
+    if (next) {
+        const size_t end = offset + 2 + size_t(count) * 12;
+        *next = size - end >= 4 ? order.Get32(tiff + end) : 0;
+    }
+    return true;
+}
+
+// IFD0 and its Exif/GPS directories
+bool ReadDirectories(const uint8_t* tiff, size_t size, const ByteOrder& order, bool copy, Directories& dirs) {
+    uint32_t exif = 0;
+    uint32_t gps = 0;
+    if (!ReadIfd(tiff, size, order.Get32(tiff + 4), order, copy, dirs.ifd[IFD0], &dirs.next, &exif, &gps)) {
+        return false;
+    }
+    // Unreadable sub-directories are dropped rather than failing the write
+    if (exif && !ReadIfd(tiff, size, exif, order, copy, dirs.ifd[EXIF_IFD], nullptr, nullptr, nullptr)) {
+        dirs.ifd[EXIF_IFD].clear();
+    }
+    if (gps && !ReadIfd(tiff, size, gps, order, copy, dirs.ifd[GPS_IFD], nullptr, nullptr, nullptr)) {
+        dirs.ifd[GPS_IFD].clear();
+    }
+    return true;
+}
+
+// UserComment: 8-byte character code, then ASCII or UTF-16 in TIFF byte order
+void EncodeUserComment(const std::string& text, const ByteOrder& order, std::vector<uint8_t>& out) {
+    bool ascii = std::all_of(text.begin(), text.end(), [](char c) { return (c & 0x80) == 0; });
+    if (ascii) {
+        out.assign({'A', 'S', 'C', 'I', 'I', 0, 0, 0});
+        out.insert(out.end(), text.begin(), text.end());
+        return;
+    }
+    out.assign({'U', 'N', 'I', 'C', 'O', 'D', 'E', 0});
+    for (size_t i = 0; i < text.size();) {
+        // UTF-8 to code point; malformed bytes become U+FFFD
+        uint32_t c = uint8_t(text[i]);
+        int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+        if (c >= 0x80 && (c < 0xC0 || c >= 0xF8 || i + extra >= text.size())) {
+            c = 0xFFFD;
+            extra = 0;
+        } else if (extra) {
+            c &= 0x3F >> extra;
+            for (int k = 1; k <= extra; k++) c = c << 6 | (uint8_t(text[i + k]) & 0x3F);
+        }
+        i += 1 + extra;
+        if (c >= 0x10000) {
+            c -= 0x10000;
+            order.Put16(out, uint16_t(0xD800 | c >> 10));
+            order.Put16(out, uint16_t(0xDC00 | (c & 0x3FF)));
+        } else {
+            order.Put16(out, uint16_t(c));
+        }
+    }
+}
+
+Entry EncodeTag(const MetadataEdit::ExifTag& tag, const ByteOrder& order) {
+    Entry entry;
+    entry.tag = tag.tag;
+    entry.type = tag.type;
+    entry.verbatim = false;
+    if (tag.type == ASCII) {
+        entry.data.assign(tag.text.begin(), tag.text.end());
+        entry.data.push_back(0);
+    } else if (tag.type == UNDEFINED) {
+        if (tag.tag == TAG_USER_COMMENT) EncodeUserComment(tag.text, order, entry.data);
+        else entry.data.assign(tag.text.begin(), tag.text.end());
+    } else if (tag.type == BYTE) {
+        for (uint32_t v : tag.values) entry.data.push_back(uint8_t(v));
+    } else if (tag.type == SHORT) {
+        for (uint32_t v : tag.values) order.Put16(entry.data, uint16_t(v));
+    } else {
+        for (uint32_t v : tag.values) order.Put32(entry.data, v);
+    }
+    entry.count = static_cast<uint32_t>(entry.data.size() / TypeSize(tag.type));
+    return entry;
+}
+
+void Upsert(std::vector<Entry>& entries, Entry entry) {
+    for (Entry& existing : entries) {
+        if (existing.tag == entry.tag) {
+            existing = std::move(entry);
+            return;
+        }
+    }
+    entries.push_back(std::move(entry));
+}
+
+bool HasTag(const std::vector<Entry>& entries, uint16_t tag) {
+    return std::any_of(entries.begin(), entries.end(), [tag](const Entry& e) { return e.tag == tag; });
+}
+
+// Apply the edit: set tags replace existing ones, and directories that end up
+// non-empty get the version tags readers expect
+void Merge(Directories& dirs, const MetadataEdit& edit, const std::string& xmp, const ByteOrder& order) {
+    for (const MetadataEdit::ExifTag& tag : edit.Exif()) {
+        Upsert(dirs.ifd[tag.ifd], EncodeTag(tag, order));
+    }
+    if (!xmp.empty()) {
+        MetadataEdit::ExifTag packet = {IFD0, TAG_XMP, UNDEFINED, {}, xmp};
+        Upsert(dirs.ifd[IFD0], EncodeTag(packet, order));
+    }
+    if (!dirs.ifd[EXIF_IFD].empty() && !HasTag(dirs.ifd[EXIF_IFD], TAG_EXIF_VERSION)) {
+        dirs.ifd[EXIF_IFD].push_back(EncodeTag({EXIF_IFD, TAG_EXIF_VERSION, UNDEFINED, {}, "0232"}, order));
+    }
+    if (!dirs.ifd[GPS_IFD].empty() && !HasTag(dirs.ifd[GPS_IFD], TAG_GPS_VERSION)) {
+        dirs.ifd[GPS_IFD].push_back(EncodeTag({GPS_IFD, TAG_GPS_VERSION, BYTE, {2, 3, 0, 0}, ""}, order));
+    }
+}
+
+// Lay out IFD0, Exif and GPS directories and their values starting at file
+// offset `base`, appending to `out`
+bool LayoutDirectories(Directories& dirs, const ByteOrder& order, uint32_t base, std::vector<uint8_t>& out) {
+    auto ifd_size = [](size_t entries) { return 2 + entries * 12 + 4; };
+    const bool has_exif = !dirs.ifd[EXIF_IFD].empty();
+    const bool has_gps = !dirs.ifd[GPS_IFD].empty();
+    const size_t ifd0_size = ifd_size(dirs.ifd[IFD0].size() + has_exif + has_gps);
+    const size_t exif_size = has_exif ? ifd_size(dirs.ifd[EXIF_IFD].size()) : 0;
+    const size_t gps_size = has_gps ? ifd_size(dirs.ifd[GPS_IFD].size()) : 0;
+    const uint64_t exif_offset = uint64_t(base) + ifd0_size;
+    const uint64_t gps_offset = exif_offset + exif_size;
+    const uint64_t data_offset = gps_offset + gps_size;
+
+    if (has_exif) Upsert(dirs.ifd[IFD0], Entry{TAG_EXIF_IFD, 4, 1, {}, false, {}});
+    if (has_gps) Upsert(dirs.ifd[IFD0], Entry{TAG_GPS_IFD, 4, 1, {}, false, {}});
+
+    std::vector<uint8_t> values;
+    for (int d = 0; d < 3; d++) {
+        std::vector<Entry>& entries = dirs.ifd[d];
+        if (d != IFD0 && entries.empty()) continue;
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.tag < b.tag; });
+        order.Put16(out, static_cast<uint16_t>(entries.size()));
+        for (const Entry& entry : entries) {
+            order.Put16(out, entry.tag);
+            order.Put16(out, entry.type);
+            order.Put32(out, entry.count);
+            if (entry.tag == TAG_EXIF_IFD || entry.tag == TAG_GPS_IFD) {
+                order.Put32(out, uint32_t(entry.tag == TAG_EXIF_IFD ? exif_offset : gps_offset));
+            } else if (entry.verbatim) {
+                out.insert(out.end(), entry.field, entry.field + 4);
+            } else if (entry.data.size() <= 4) {
+                out.insert(out.end(), entry.data.begin(), entry.data.end());
+                out.insert(out.end(), 4 - entry.data.size(), 0);
+            } else {
+                const uint64_t at = data_offset + values.size();
+                if (at + entry.data.size() > 0xFFFFFFFFull) {
+                    return false;
+                }
+                order.Put32(out, uint32_t(at));
+                values.insert(values.end(), entry.data.begin(), entry.data.end());
+                if (values.size() & 1) values.push_back(0);    // Word-aligned values
+            }
+        }
+        order.Put32(out, d == IFD0 ? dirs.next : 0);
+    }
+    out.insert(out.end(), values.begin(), values.end());
+    return true;
+}
+
+std::string EscapeXml(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        switch (c) {
+            case '&': escaped += "&amp;"; break;
+            case '<': escaped += "&lt;"; break;
+            case '>': escaped += "&gt;"; break;
+            case '"': escaped += "&quot;"; break;
+            default: escaped += c;
+        }
+    }
+    return escaped;
+}
+
+std::string BuildXmpPacket(const std::vector<MetadataEdit::XmpProperty>& properties) {
+    if (properties.empty()) {
+        return std::string();
+    }
+    std::string xml =
+        "<?xpacket begin=\"\xEF\xBB\xBF\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>\n"
+        "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\">\n"
+        " <rdf:RDF xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">\n"
+        "  <rdf:Description rdf:about=\"\"\n"
+        "    xmlns:dc=\"" + std::string(XMP_NAMESPACE_DC) + "\"\n"
+        "    xmlns:FilmGallery=\"" + XMP_NAMESPACE_FILMGALLERY + "\">\n";
+    for (const MetadataEdit::XmpProperty& property : properties) {
+        xml += "   <" + property.name + ">";
+        if (property.form == MetadataEdit::XmpProperty::SIMPLE) {
+            xml += EscapeXml(property.items[0]);
+        } else {
+            static const char* const containers[] = {"", "rdf:Bag", "rdf:Seq", "rdf:Alt"};
+            const char* container = containers[property.form];
+            const char* li = property.form == MetadataEdit::XmpProperty::ALT ? "<rdf:li xml:lang=\"x-default\">" : "<rdf:li>";
+            xml += std::string("\n    <") + container + ">\n";
+            for (const std::string& item : property.items) {
+                xml += std::string("     ") + li + EscapeXml(item) + "</rdf:li>\n";
+            }
+            xml += std::string("    </") + container + ">\n   ";
+        }
+        xml += "</" + property.name + ">\n";
+    }
+    xml += "  </rdf:Description>\n </rdf:RDF>\n</x:xmpmeta>\n<?xpacket end=\"w\"?>";
+    return xml;
+}
+
+void PutDataset(std::vector<uint8_t>& out, uint8_t record, uint8_t dataset, const uint8_t* data, size_t size) {
+    out.insert(out.end(), {0x1C, record, dataset, uint8_t(size >> 8), uint8_t(size)});
+    out.insert(out.end(), data, data + size);
+}
+
+// IPTC IIM record: UTF-8 coded character set, record version, then one 2:25
+// dataset per keyword (cut to 64 bytes on a character boundary)
+std::vector<uint8_t> BuildIptc(const std::vector<std::string>& keywords) {
+    std::vector<uint8_t> iptc;
+    if (keywords.empty()) {
+        return iptc;
+    }
+    const uint8_t utf8[] = {0x1B, '%', 'G'};
+    const uint8_t version[] = {0x00, 0x04};
+    PutDataset(iptc, 1, 90, utf8, sizeof utf8);
+    PutDataset(iptc, 2, 0, version, sizeof version);
+    for (const std::string& keyword : keywords) {
+        size_t length = std::min(keyword.size(), IPTC_KEYWORD_MAX);
+        while (length < keyword.size() && length && (uint8_t(keyword[length]) & 0xC0) == 0x80) length--;
+        PutDataset(iptc, 2, 25, reinterpret_cast<const uint8_t*>(keyword.data()), length);
+    }
+    return iptc;
+}
+
+// Copy Photoshop image resources ("8BIM", ID, even-padded Pascal name, size,
+// even-padded data) except the IPTC record and its digest; a malformed tail
+// is dropped
+void CopyResources(const uint8_t* data, size_t size, std::vector<uint8_t>& out) {
+    const ByteOrder order(false);
+    size_t pos = 0;
+    while (size - pos >= 12 && memcmp(data + pos, "8BIM", 4) == 0) {
+        const uint16_t id = order.Get16(data + pos + 4);
+        const size_t name = (size_t(data[pos + 6]) + 2) & ~size_t(1);
+        if (size - pos - 6 < name + 4) {
+            break;
+        }
+        const size_t at = pos + 6 + name;
+        const uint32_t length = order.Get32(data + at);
+        if (length > size - at - 4) {
+            break;
+        }
+        const size_t end = std::min(size, at + 4 + length + (length & 1));
+        if (id != RESOURCE_IPTC && id != RESOURCE_IPTC_DIGEST) {
+            out.insert(out.end(), data + pos, data + end);
+        }
+        pos = end;
+    }
+}
+
+void PutIptcResource(const std::vector<uint8_t>& iptc, std::vector<uint8_t>& out) {
+    const ByteOrder order(false);
+    out.insert(out.end(), {'8', 'B', 'I', 'M'});
+    order.Put16(out, RESOURCE_IPTC);
+    out.insert(out.end(), {0, 0});      // Empty name
+    order.Put32(out, static_cast<uint32_t>(iptc.size()));
+    out.insert(out.end(), iptc.begin(), iptc.end());
+    if (iptc.size() & 1) out.push_back(0);
+}
+
+bool Fail(std::string& error, const char* message) {
+    error = message;
+    return false;
+}
+
+const char EXIF_SIGNATURE[] = "Exif\0";                         // + second NUL: 6 bytes
+const char XMP_SIGNATURE[] = "http://ns.adobe.com/xap/1.0/";   // + NUL: 29 bytes
+const char XMP_EXTENSION_SIGNATURE[] = "http://ns.adobe.com/xmp/extension/";
+const char PHOTOSHOP_SIGNATURE[] = "Photoshop 3.0";                 // + NUL: 14 bytes
+
+bool HasSignature(const uint8_t* payload, size_t size, const char* signature, size_t length) {
+    return size >= length && memcmp(payload, signature, length) == 0;
+}
+
+void PutSegment(std::vector<uint8_t>& out, uint8_t marker, const char* signature, size_t signature_size,
+                const uint8_t* data, size_t size) {
+    const size_t length = 2 + signature_size + size;
+    out.push_back(0xFF);
+    out.push_back(marker);
+    out.push_back(uint8_t(length >> 8));
+    out.push_back(uint8_t(length));
+    out.insert(out.end(), signature, signature + signature_size);
+    out.insert(out.end(), data, data + size);
+}
+
+bool WriteJpegMetadata(const uint8_t* data, size_t size, const MetadataEdit& edit, const std::string& xmp,
+                       const std::vector<uint8_t>& iptc, std::vector<uint8_t>& out, std::string& error) {
+    // Segments up to the first scan; `insert` is where the new APP1s and APP13 go
+    struct Segment { size_t start, end; bool drop; };
+    std::vector<Segment> segments;
+    size_t insert = 2;
+    const uint8_t* old_exif = nullptr;
+    size_t old_exif_size = 0;
+    std::vector<uint8_t> resources;     // Kept Photoshop resources
+    size_t pos = 2;
+    for (;;) {
+        if (pos + 2 > size || data[pos] != 0xFF) {
+            return Fail(error, "Malformed JPEG: expected a marker");
+        }
+        const uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            pos++;      // Fill byte
+            continue;
+        }
+        if (marker == 0xDA || marker == 0xD9) {
+            break;      // Scan data and the rest are copied unchanged
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            segments.push_back({pos, pos + 2, false});
+            pos += 2;
+            continue;
+        }
+        if (pos + 4 > size) {
+            return Fail(error, "Malformed JPEG: truncated segment");
+        }
+        const size_t length = size_t(data[pos + 2]) << 8 | data[pos + 3];
+        if (length < 2 || length > size - pos - 2) {
+            return Fail(error, "Malformed JPEG: truncated segment");
+        }
+        const uint8_t* payload = data + pos + 4;
+        const size_t payload_size = length - 2;
+        bool drop = false;
+        if (marker == 0xE1 && HasSignature(payload, payload_size, EXIF_SIGNATURE, 6)) {
+            // Rewritten (or moved ahead of the new XMP) below
+            if (!old_exif) {
+                old_exif = payload + 6;
+                old_exif_size = payload_size - 6;
+            }
+            drop = true;
+        } else if (marker == 0xE1 && (HasSignature(payload, payload_size, XMP_SIGNATURE, sizeof XMP_SIGNATURE) ||
+                                      HasSignature(payload, payload_size, XMP_EXTENSION_SIGNATURE,
+                                                   sizeof XMP_EXTENSION_SIGNATURE))) {
+            drop = !xmp.empty();
+        } else if (marker == 0xED && !iptc.empty() &&
+                   HasSignature(payload, payload_size, PHOTOSHOP_SIGNATURE, sizeof PHOTOSHOP_SIGNATURE)) {
+            CopyResources(payload + sizeof PHOTOSHOP_SIGNATURE, payload_size - sizeof PHOTOSHOP_SIGNATURE, resources);
+            drop = true;
+        }
+        // New segments follow SOI and a leading JFIF/JFXX APP0
+        if (marker == 0xE0 && insert == pos) {
+            insert = pos + 2 + length;
+        }
+        segments.push_back({pos, pos + 2 + length, drop});
+        pos += 2 + length;
+    }
+
+    std::vector<uint8_t> exif;
+    if (edit.Exif().empty()) {
+        if (old_exif) exif.assign(old_exif, old_exif + old_exif_size);
+    } else {
+        // The old EXIF keeps its byte order; new EXIF is big-endian
+        Directories dirs;
+        bool little = false;
+        if (old_exif && old_exif_size >= 8 &&
+            (memcmp(old_exif, "II*\0", 4) == 0 || memcmp(old_exif, "MM\0*", 4) == 0)) {
+            little = old_exif[0] == 'I';
+            if (!ReadDirectories(old_exif, old_exif_size, ByteOrder(little), true, dirs)) {
+                dirs = Directories();
+            }
+        }
+        dirs.next = 0;      // The thumbnail IFD is not carried over
+        ByteOrder order(little);
+        Merge(dirs, edit, std::string(), order);
+        exif.assign(little ? "II*\0" : "MM\0*", (little ? "II*\0" : "MM\0*") + 4);
+        order.Put32(exif, 8);
+        if (!LayoutDirectories(dirs, order, 8, exif) || exif.size() + 2 + 6 > 0xFFFF) {
+            return Fail(error, "EXIF data does not fit in one APP1 segment");
+        }
+    }
+    if (xmp.size() + 2 + sizeof XMP_SIGNATURE > 0xFFFF) {
+        return Fail(error, "XMP packet does not fit in one APP1 segment");
+    }
+    if (!iptc.empty()) {
+        PutIptcResource(iptc, resources);
+        if (resources.size() + 2 + sizeof PHOTOSHOP_SIGNATURE > 0xFFFF) {
+            return Fail(error, "IPTC data does not fit in one APP13 segment");
+        }
+    }
+
+    out.clear();
+    out.reserve(size + exif.size() + xmp.size() + resources.size() + 64);
+    out.insert(out.end(), data, data + 2);
+    auto copy_segments = [&](bool before) {
+        for (const Segment& segment : segments) {
+            if ((segment.start < insert) == before && !segment.drop) {
+                out.insert(out.end(), data + segment.start, data + segment.end);
+            }
+        }
+    };
+    copy_segments(true);
+    if (!exif.empty()) {
+        PutSegment(out, 0xE1, EXIF_SIGNATURE, 6, exif.data(), exif.size());
+    }
+    if (!xmp.empty()) {
+        PutSegment(out, 0xE1, XMP_SIGNATURE, sizeof XMP_SIGNATURE,
+                   reinterpret_cast<const uint8_t*>(xmp.data()), xmp.size());
+    }
+    if (!resources.empty()) {
+        PutSegment(out, 0xED, PHOTOSHOP_SIGNATURE, sizeof PHOTOSHOP_SIGNATURE, resources.data(), resources.size());
+    }
+    copy_segments(false);
+    out.insert(out.end(), data + pos, data + size);
+    return true;
+}
+
+bool WriteTiffMetadata(const uint8_t* data, size_t size, const MetadataEdit& edit, const std::string& xmp,
+                       const std::vector<uint8_t>& iptc, std::vector<uint8_t>& out, std::string& error) {
+    const bool little = data[0] == 'I';
+    const ByteOrder order(little);
+    if (order.Get16(data + 2) == 43) {
+        return Fail(error, "BigTIFF is not supported");
+    }
+    // Old directories stay where they are, so kept values need not move
+    Directories dirs;
+    if (!ReadDirectories(data, size, order, false, dirs)) {
+        return Fail(error, "Malformed TIFF: unreadable IFD0");
+    }
+    Merge(dirs, edit, xmp, order);
+    if (!iptc.empty()) {
+        MetadataEdit::ExifTag record = {IFD0, TAG_IPTC, UNDEFINED, {}, std::string(iptc.begin(), iptc.end())};
+        Upsert(dirs.ifd[IFD0], EncodeTag(record, order));
+        // A stale IPTC copy among the Photoshop resources is removed
+        std::vector<Entry>& ifd0 = dirs.ifd[IFD0];
+        for (size_t i = 0; i < ifd0.size(); i++) {
+            Entry& entry = ifd0[i];
+            if (entry.tag != TAG_PHOTOSHOP || TypeSize(entry.type) != 1) continue;
+            const uint32_t at = entry.count <= 4 ? 0 : order.Get32(entry.field);
+            if (entry.count > 4 && (at > size || entry.count > size - at)) continue;
+            const uint8_t* irb = entry.count <= 4 ? entry.field : data + at;
+            std::vector<uint8_t> kept;
+            CopyResources(irb, entry.count, kept);
+            if (kept.empty()) {
+                ifd0.erase(ifd0.begin() + i);
+            } else {
+                entry.data = std::move(kept);
+                entry.count = static_cast<uint32_t>(entry.data.size());
+                entry.verbatim = false;
+            }
+            break;
+        }
+    }
+
+    out.clear();
+    out.reserve(size + 4096 + xmp.size());
+    out.assign(data, data + size);
+    if (out.size() & 1) out.push_back(0);
+    if (out.size() > 0xFFFFFFFFull) {
+        return Fail(error, "TIFF too large for 32-bit offsets");
+    }
+    const uint32_t base = static_cast<uint32_t>(out.size());
+    if (!LayoutDirectories(dirs, order, base, out)) {
+        return Fail(error, "TIFF too large for 32-bit offsets");
+    }
+    order.Set32(out.data() + 4, base);
+    return true;
+}
+
+} // namespace
+
+void MetadataEdit::SetExif(ExifTag tag) {
+    for (ExifTag& existing : exif_) {
+        if (existing.ifd == tag.ifd && existing.tag == tag.tag) {
+            existing = std::move(tag);
+            return;
+        }
+    }
+    exif_.push_back(std::move(tag));
+}
+
+void MetadataEdit::AddXmp(const std::string& name, XmpProperty::Form form, const std::vector<std::string>& items) {
+    for (XmpProperty& existing : xmp_) {
+        if (existing.name == name) {
+            // Subject and Keywords both feed dc:subject
+            if (form == XmpProperty::BAG) {
+                for (const std::string& item : items) {
+                    if (std::find(existing.items.begin(), existing.items.end(), item) == existing.items.end()) {
+                        existing.items.push_back(item);
+                    }
+                }
+            } else {
+                existing.items = items;
+            }
+            return;
+        }
+    }
+    xmp_.push_back({name, form, items});
+}
+
+bool MetadataEdit::Set(const std::string& name, const MetadataValue& value, std::string& error) {
+    auto bad_value = [&]() {
+        error = "Invalid value for metadata tag " + name;
+        return false;
+    };
+    // Strings for XMP; numbers are written in decimal
+    std::vector<std::string> items;
+    if (value.kind == MetadataValue::TEXT) items.push_back(value.text);
+    else if (value.kind == MetadataValue::LIST) items = value.list;
+    else for (double number : value.numbers) items.push_back(FormatNumber(number));
+
+    if (name == "Subject" || name == "Keywords" || name == "XMP-dc:Subject") {
+        AddXmp("dc:subject", XmpProperty::BAG, items);
+        if (name == "Keywords") {
+            for (const std::string& item : items) {
+                if (!item.empty() && std::find(keywords_.begin(), keywords_.end(), item) == keywords_.end()) {
+                    keywords_.push_back(item);
+                }
+            }
+        }
+        return true;
+    }
+    static const struct { const char* name; const char* property; XmpProperty::Form form; } DC[] = {
+        {"XMP-dc:Title", "dc:title", XmpProperty::ALT},
+        {"XMP-dc:Description", "dc:description", XmpProperty::ALT},
+        {"XMP-dc:Creator", "dc:creator", XmpProperty::SEQ},
+        {"XMP-dc:Rights", "dc:rights", XmpProperty::ALT},
+    };
+    for (const auto& dc : DC) {
+        if (name == dc.name) {
+            if (items.empty()) return bad_value();
+            AddXmp(dc.property, dc.form, items);
+            return true;
+        }
+    }
+    const std::string prefix = "XMP-FilmGallery:";
+    if (name.compare(0, prefix.size(), prefix) == 0) {
+        const std::string property = name.substr(prefix.size());
+        bool valid = !property.empty() && isalpha(static_cast<unsigned char>(property[0])) &&
+                     std::all_of(property.begin(), property.end(), [](char c) {
+                         return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-';
+                     });
+        if (!valid) {
+            error = "Invalid XMP property name " + name;
+            return false;
+        }
+        if (items.empty()) return bad_value();
+        AddXmp("FilmGallery:" + property,
+               value.kind == MetadataValue::LIST ? XmpProperty::BAG : XmpProperty::SIMPLE, items);
+        return true;
+    }
+
+    const ExifTagDef* def = nullptr;
+    for (const ExifTagDef& candidate : EXIF_TAGS) {
+        if (name == candidate.name) def = &candidate;
+    }
+    if (!def) {
+        error = "Unknown metadata tag " + name;
+        return false;
+    }
+    ExifTag tag = {def->ifd, def->tag, def->type, {}, std::string()};
+
+    if (def->type == ASCII || def->type == UNDEFINED) {
+        if (value.kind != MetadataValue::TEXT && !(value.kind == MetadataValue::NUMBERS && value.numbers.size() == 1)) {
+            return bad_value();
+        }
+        tag.text = value.kind == MetadataValue::TEXT ? value.text : FormatNumber(value.numbers[0]);
+        if (tag.type == ASCII && tag.text.find('\0') != std::string::npos) return bad_value();
+        SetExif(std::move(tag));
+        return true;
+    }
+
+    // Numeric tags
+    std::vector<double> numbers = value.numbers;
+    if (value.kind == MetadataValue::TEXT) {
+        double number;
+        if (!ParseNumber(value.text, number)) return bad_value();
+        numbers.assign(1, number);
+    } else if (value.kind != MetadataValue::NUMBERS || numbers.empty()) {
+        return bad_value();
+    }
+
+    const bool coordinate = def->ifd == GPS_IFD && (def->tag == 0x0002 || def->tag == 0x0004);
+    const bool altitude = def->ifd == GPS_IFD && def->tag == 0x0006;
+    if ((coordinate || altitude) && numbers.size() == 1) {
+        // A signed decimal sets the reference too, unless one was given for
+        // a positive value
+        const bool negative = numbers[0] < 0;
+        numbers[0] = std::fabs(numbers[0]);
+        const uint16_t ref_tag = static_cast<uint16_t>(def->tag - 1);
+        const bool has_ref = std::any_of(exif_.begin(), exif_.end(), [&](const ExifTag& t) {
+            return t.ifd == GPS_IFD && t.tag == ref_tag;
+        });
+        if (negative || !has_ref) {
+            if (altitude) SetExif({GPS_IFD, ref_tag, BYTE, {negative ? 1u : 0u}, ""});
+            else if (coordinate && def->tag == 0x0002) SetExif({GPS_IFD, ref_tag, ASCII, {}, negative ? "S" : "N"});
+            else SetExif({GPS_IFD, ref_tag, ASCII, {}, negative ? "W" : "E"});
+        }
+    }
+    if (coordinate || altitude) {
+        if (coordinate && numbers.size() == 1) {
+            // Degrees, minutes and hundredths of seconds
+            if (!(numbers[0] <= 180)) return bad_value();
+            const uint32_t hundredths = static_cast<uint32_t>(std::round(numbers[0] * 360000));
+            tag.values = {hundredths / 360000, 1, hundredths / 6000 % 60, 1, hundredths % 6000, 100};
+            SetExif(std::move(tag));
+            return true;
+        }
+        if (numbers.size() != (coordinate ? 3u : 1u)) return bad_value();
+    } else if (numbers.size() != 1) {
+        return bad_value();
+    }
+
+    for (double number : numbers) {
+        if (def->type == RATIONAL) {
+            uint32_t numerator, denominator;
+            bool exact = value.kind == MetadataValue::TEXT && value.text.find('-') == std::string::npos &&
+                         ParseRational(value.text, numerator, denominator);
+            if (!exact && !ToRational(number, numerator, denominator)) {
+                return bad_value();
+            }
+            tag.values.push_back(numerator);
+            tag.values.push_back(denominator);
+        } else {
+            const double limit = def->type == BYTE ? 255 : 65535;
+            if (!(number >= 0) || number > limit) return bad_value();
+            tag.values.push_back(static_cast<uint32_t>(std::round(number)));
+        }
+    }
+    SetExif(std::move(tag));
+    return true;
+}
+
+bool WriteMetadata(const uint8_t* data, size_t size, const MetadataEdit& edit,
+                   std::vector<uint8_t>& out, std::string& error) {
+    const std::string xmp = BuildXmpPacket(edit.Xmp());
+    const std::vector<uint8_t> iptc = BuildIptc(edit.Keywords());
+    if (size >= 4 && data[0] == 0xFF && data[1] == 0xD8) {
+        return WriteJpegMetadata(data, size, edit, xmp, iptc, out, error);
+    }
+    if (size >= 8 && (memcmp(data, "II", 2) == 0 || memcmp(data, "MM", 2) == 0) &&
+        (ByteOrder(data[0] == 'I').Get16(data + 2) == 42 || ByteOrder(data[0] == 'I').Get16(data + 2) == 43)) {
+        return WriteTiffMetadata(data, size, edit, xmp, iptc, out, error);
+    }
+    return Fail(error, "Expected a JPEG or TIFF");
+}
@@ -0,0 +1,94 @@
+/**
+ * @filmgallery/libraw-native - Metadata Writer
+ *
+ * Writes EXIF, XMP and IPTC into an encoded JPEG or TIFF in memory, so
+ * exports carry their metadata when first written instead of being rewritten
+ * by an external tool. Tags are named as exiftool names them (Make, FNumber,
+ * DateTimeOriginal, GPSLatitude, Subject, Keywords,
+ * XMP-FilmGallery:FilmName, ...).
+ *
+ * JPEG: the EXIF and XMP APP1 segments and the Photoshop APP13 segment are
+ * rebuilt and placed after SOI (and JFIF APP0); every other segment and the
+ * entropy-coded data are copied. TIFF: merged IFD0/Exif/GPS directories are
+ * appended and the header pointed at them; the pixel data stays where it is.
+ *
+ * Existing IFD0, Exif and GPS entries are kept unless set. The thumbnail IFD,
+ * the interoperability IFD and maker notes (whose internal offsets would
+ * break) are dropped. When any XMP tag is set the XMP packet is replaced,
+ * otherwise it is kept; likewise Keywords replaces the IPTC record (other
+ * Photoshop resources are kept).
+ */
+
+#ifndef METADATA_WRITER_H
+#define METADATA_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A tag value as it came from JS: a string, numbers (a [numerator,
+ * denominator] pair counts as one number) or a list of strings
+ */
+struct MetadataValue {
+    enum Kind { TEXT, NUMBERS, LIST } kind = TEXT;
+    std::string text;                   // UTF-8; "a/b" is also read as a number
+    std::vector<double> numbers;
+    std::vector<std::string> list;
+};
+
+/**
+ * Tags to write, collected from the JS object
+ */
+class MetadataEdit {
+public:
+    /**
+     * Add a tag
+     * @returns false with `error` set for an unknown tag or a value that
+     *          does not fit it
+     */
+    bool Set(const std::string& name, const MetadataValue& value, std::string& error);
+
+    bool Empty() const { return exif_.empty() && xmp_.empty() && keywords_.empty(); }
+
+    // A TIFF entry before byte order is known; values are SHORT/BYTE
+    // numbers, RATIONAL pairs or ASCII/UNDEFINED text
+    struct ExifTag {
+        int ifd;                        // 0 IFD0, 1 Exif, 2 GPS
+        uint16_t tag;
+        uint16_t type;
+        std::vector<uint32_t> values;
+        std::string text;
+    };
+
+    // An XMP property: "prefix:Name" with a simple value, or an rdf:Bag,
+    // rdf:Seq or x-default rdf:Alt of items
+    struct XmpProperty {
+        std::string name;
+        enum Form { SIMPLE, BAG, SEQ, ALT } form;
+        std::vector<std::string> items;
+    };
+
+    const std::vector<ExifTag>& Exif() const { return exif_; }
+    const std::vector<XmpProperty>& Xmp() const { return xmp_; }
+    const std::vector<std::string>& Keywords() const { return keywords_; }    // IPTC 2:25
+
+private:
+    void SetExif(ExifTag tag);
+    void AddXmp(const std::string& name, XmpProperty::Form form, const std::vector<std::string>& items);
+
+    std::vector<ExifTag> exif_;
+    std::vector<XmpProperty> xmp_;
+    std::vector<std::string> keywords_;
+};
+
+/**
+ * Write `edit` into a JPEG or classic (non-Big) TIFF
+ * @returns false with `error` set for other formats, malformed input, or
+ *          EXIF/XMP/IPTC too large for one JPEG segment
+ */
+bool WriteMetadata(const uint8_t* data, size_t size, const MetadataEdit& edit,
+                   std::vector<uint8_t>& out, std::string& error);
+
+#endif // METADATA_WRITER_H
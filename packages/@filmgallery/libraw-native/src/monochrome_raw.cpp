@@ -0,0 +1,390 @@
+/**
+ * @filmgallery/libraw-native - Monochrome CFA Luminance
+ *
+ * Black-and-white negatives digitized with a colour camera only need one
+ * channel, yet dcraw_process() demosaics to a ushort[4] image, converts it
+ * to RGB and leaves the desaturation to FilmLab. Here luminance is built
+ * straight from the Bayer mosaic in one threaded pass: black subtraction and
+ * white balance as LibRaw does them, then a single 5x5 filter per CFA site
+ * that is the weighted sum of the Malvar-He-Cutler (gradient-corrected
+ * linear) R, G and B interpolation filters. Nothing but the one-channel
+ * output image is allocated; half-size output takes each 2x2 cell as one
+ * pixel.
+ *
+ * Non-Bayer sensors (X-Trans, Foveon, Fuji SuperCCD, 4-colour CFAs) and
+ * options that need the full pipeline (auto white balance, highlight
+ * rebuilding, denoise, dark frames, crop boxes, callbacks, ...) keep using
+ * dcraw_process() and produce RGB.
+ */
+
+#include "film_libraw.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Output rows per band; each band scales its rows plus two above and below
+const int BAND_ROWS = 16;
+
+// Rec. 709 luminance, applied to white-balanced camera R, G, B
+const float DEFAULT_WEIGHTS[3] = {0.2126f, 0.7152f, 0.0722f};
+
+// Malvar-He-Cutler filters (x8) as weights of symmetric tap groups: centre,
+// row +-1, row +-2, column +-1, column +-2 and the four diagonals
+enum { TAP_GROUPS = 6 };
+const float FILTER_SAME[TAP_GROUPS] = {8, 0, 0, 0, 0, 0};              // Site's own colour
+const float FILTER_G_AT_RB[TAP_GROUPS] = {4, 2, -1, 2, -1, 0};         // Green at red/blue
+const float FILTER_ROW_AT_G[TAP_GROUPS] = {5, 4, -1, 0, 0.5f, -1};     // Row neighbours' colour at green
+const float FILTER_COL_AT_G[TAP_GROUPS] = {5, 0, 0.5f, 4, -1, -1};     // Column neighbours' colour at green
+const float FILTER_DIAGONAL[TAP_GROUPS] = {6, 0, -1.5f, 0, -1.5f, 2};  // Red at blue, blue at red
+
+// Luminance of one row from five padded rows (r2 is the row itself), two
+// sites per pair with their own filters
+CPU_INLINE void LumaRowBody(const float* r0, const float* r1, const float* r2, const float* r3,
+                            const float* r4, const float* k, float* y, size_t pairs) {
+    for (size_t i = 0; i < pairs; i++) {
+        for (int p = 0; p < 2; p++) {
+            const size_t x = 2 * i + p;
+            const float* kk = k + p * TAP_GROUPS;
+            y[x] = kk[0] * r2[x] +
+                   kk[1] * (r2[x - 1] + r2[x + 1]) +
+                   kk[2] * (r2[x - 2] + r2[x + 2]) +
+                   kk[3] * (r1[x] + r3[x]) +
+                   kk[4] * (r0[x] + r4[x]) +
+                   kk[5] * ((r1[x - 1] + r1[x + 1]) + (r3[x - 1] + r3[x + 1]));
+        }
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, LumaRow, LumaRowBody,
+                    (const float* r0, const float* r1, const float* r2, const float* r3,
+                     const float* r4, const float* k, float* y, size_t pairs),
+                    (r0, r1, r2, r3, r4, k, y, pairs))
+
+// Index reflected into [0, n) with the CFA phase kept (n >= 3)
+inline int Mirror(int i, int n) {
+    if (i < 0) return -i;
+    if (i >= n) return 2 * (n - 1) - i;
+    return i;
+}
+
+} // namespace
+
+void FilmLibRaw::SetMonochrome(bool enabled, const float weights[3], bool float_output) {
+    monochrome_ = enabled;
+    monochrome_float_ = float_output;
+    for (int c = 0; c < 3; c++) {
+        monochrome_weights_[c] = weights ? weights[c] : DEFAULT_WEIGHTS[c];
+    }
+}
+
+bool FilmLibRaw::BayerCell(int cell[4]) const {
+    // 2x2-periodic pattern: every row pair of `filters` repeats the first
+    const unsigned filters = imgdata.idata.filters;
+    if (filters < 1000 || filters != (filters & 0xff) * 0x01010101u) {
+        return false;
+    }
+    for (int i = 0; i < 4; i++) {
+        // LibRaw::FC(), which is not const
+        cell[i] = filters >> ((((i >> 1) << 1 & 14) + (i & 1)) << 1) & 3;
+    }
+    auto is_green = [](int c) { return c == 1 || c == 3; };
+    if (is_green(cell[0]) && is_green(cell[3])) {
+        return (cell[1] == 0 && cell[2] == 2) || (cell[1] == 2 && cell[2] == 0);
+    }
+    if (is_green(cell[1]) && is_green(cell[2])) {
+        return (cell[0] == 0 && cell[3] == 2) || (cell[0] == 2 && cell[3] == 0);
+    }
+    return false;
+}
+
+bool FilmLibRaw::MonochromeEligible() const {
+    const libraw_rawdata_t& raw = imgdata.rawdata;
+    const libraw_output_params_t& params = imgdata.params;
+    int cell[4];
+
+    if (!monochrome_ ||
+        (imgdata.progress_flags & LIBRAW_PROGRESS_THUMB_MASK) < LIBRAW_PROGRESS_LOAD_RAW ||
+        !raw.raw_image || raw.iparams.colors != 3 || raw.iparams.is_foveon ||
+        raw.ioparams.zero_is_bad || raw.ioparams.fuji_width || !BayerCell(cell) ||
+        raw.sizes.width < 5 || raw.sizes.height < 5) {
+        return false;
+    }
+
+    // Loaders whose samples raw2image_ex() still corrects on copy
+    if (load_raw == &FilmLibRaw::phase_one_load_raw_c || load_raw == &FilmLibRaw::phase_one_load_raw_s ||
+        load_raw == &FilmLibRaw::phase_one_load_raw || load_raw == &FilmLibRaw::canon_600_load_raw) {
+        return false;
+    }
+
+    // Same exclusions as the LinearRaw fast path, plus green matching
+    if ((~params.cropbox[2] && ~params.cropbox[3]) || params.bad_pixels || params.dark_frame ||
+        params.threshold || params.exp_correc > 0 || params.med_passes > 0 ||
+        params.highlight >= 2 || params.camera_profile || params.green_matching ||
+        (params.use_fuji_rotate && raw.sizes.pixel_aspect != 1)) {
+        return false;
+    }
+    for (int c = 0; c < 4; c += 2) {
+        float aber = params.aber[c];
+        if (aber >= 0.001f && aber <= 1000.f && aber != 1) return false;
+    }
+
+    const float* cam_mul = raw.color.cam_mul;
+    if (params.use_auto_wb ||
+        (params.use_camera_wb &&
+         (cam_mul[0] < -0.5 ||
+          (cam_mul[0] <= 0.00001f &&
+           !(imgdata.rawparams.options & LIBRAW_RAWOPTIONS_CAMERAWB_FALLBACK_TO_DAYLIGHT))))) {
+        return false;
+    }
+
+    return !(callbacks.pre_subtractblack_cb || callbacks.pre_scalecolors_cb ||
+             callbacks.pre_preinterpolate_cb || callbacks.pre_interpolate_cb ||
+             callbacks.post_interpolate_cb || callbacks.pre_converttorgb_cb ||
+             callbacks.post_converttorgb_cb);
+}
+
+int FilmLibRaw::ProcessMonochrome() {
+    try {
+        free_image();
+        raw2image_start();
+
+        libraw_decoder_info_t decoder_info;
+        get_decoder_info(&decoder_info);
+
+        libraw_colordata_t& color = imgdata.color;
+        libraw_image_sizes_t& sizes = imgdata.sizes;
+
+        int cell[4];
+        BayerCell(cell);
+        const int width = sizes.width;
+        const int height = sizes.height;
+        const int copy_height = std::max(0, std::min<int>(height, int(sizes.raw_height) - int(sizes.top_margin)));
+        const int copy_width = std::max(0, std::min<int>(width, int(sizes.raw_width) - int(sizes.left_margin)));
+        const ushort* raw_image = imgdata.rawdata.raw_image;
+        const size_t raw_pitch = sizes.raw_pitch / 2;
+
+        // Black levels as raw2image_ex() subtracts them inline (adjust_bl(),
+        // per-colour part), then scale_colors_loop()'s repeating pattern
+        adjust_bl();
+        int cblack[4];
+        for (int c = 0; c < 4; c++) cblack[c] = color.cblack[c];
+        const int pattern_rows = (color.cblack[4] && color.cblack[5]) ? color.cblack[4] : 0;
+        const int pattern_cols = pattern_rows ? color.cblack[5] : 0;
+        std::vector<int> pattern(color.cblack + 6, color.cblack + 6 + pattern_rows * pattern_cols);
+
+        auto source_row = [&](int row) {
+            return raw_image + static_cast<size_t>(row + sizes.top_margin) * raw_pitch + sizes.left_margin;
+        };
+
+        // copy_bayer()'s data_maximum, needed before scaling by adjust_maximum()
+        const bool adjust = !(decoder_info.decoder_flags & LIBRAW_DECODER_FIXEDMAXC) &&
+                            imgdata.params.adjust_maximum_thr >= 0.00001;
+        std::mutex mutex;
+        int data_maximum = 0;
+        auto row_maximum = [&](int row) {
+            const ushort* src = source_row(row);
+            const int* cb = cell + (row & 1) * 2;
+            int dmax = 0;
+            for (int col = 0; col < copy_width; col++) {
+                dmax = std::max(dmax, src[col] - cblack[cb[col & 1]]);
+            }
+            return dmax;
+        };
+        if (adjust) {
+            ParallelRows(copy_height, 64, [&](int first, int last) {
+                int dmax = 0;
+                for (int row = first; row < last; row++) dmax = std::max(dmax, row_maximum(row));
+                std::lock_guard<std::mutex> lock(mutex);
+                data_maximum = std::max(data_maximum, dmax);
+            });
+            color.data_maximum = data_maximum & 0xffff;
+        }
+
+        color.maximum -= color.black;
+        color.cblack[0] = color.cblack[1] = color.cblack[2] = color.cblack[3] = 0;
+        color.black = 0;
+        if (adjust) {
+            adjust_maximum();
+        }
+        if (imgdata.params.user_sat > 0) {
+            color.maximum = imgdata.params.user_sat;
+        }
+
+        float scale_mul[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        if (!imgdata.params.no_auto_scale) {
+            ScaleMultipliers(scale_mul);
+        }
+
+        // Black-subtracted, white-balanced samples of one mosaic row as
+        // scale_colors() leaves them (0 past the decoded area)
+        auto scale_row = [&](int row, float* out) {
+            if (row >= copy_height) {
+                std::fill(out, out + width, 0.0f);
+                return;
+            }
+            const ushort* src = source_row(row);
+            const int* cb = cell + (row & 1) * 2;
+            const int* pat = pattern_rows ? pattern.data() + (row % pattern_rows) * pattern_cols : nullptr;
+            for (int col = 0; col < copy_width; col++) {
+                const int c = cb[col & 1];
+                int val = src[col] > cblack[c] ? src[col] - cblack[c] : 0;
+                if (pat && val) val -= pat[col % pattern_cols];
+                out[col] = static_cast<float>(std::min(std::max(static_cast<int>(val * scale_mul[c]), 0), 65535));
+            }
+            std::fill(out + copy_width, out + width, 0.0f);
+        };
+
+        // Weights normalized to sum to 1, so white stays white
+        float weights[3];
+        float total = monochrome_weights_[0] + monochrome_weights_[1] + monochrome_weights_[2];
+        for (int c = 0; c < 3; c++) {
+            weights[c] = total > 0 ? monochrome_weights_[c] / total : DEFAULT_WEIGHTS[c];
+        }
+        auto weight = [&](int c) { return weights[c == 3 ? 1 : c]; };
+
+        const bool half = imgdata.params.half_size != 0;
+        const int out_width = half ? (width + 1) >> 1 : width;
+        const int out_height = half ? (height + 1) >> 1 : height;
+
+        // Per-site filters: each CFA site's weighted R, G and B
+        // interpolation filters summed into one, /8 folded in
+        float kernels[4][TAP_GROUPS];
+        for (int s = 0; s < 4; s++) {
+            const int own = cell[s] == 3 ? 1 : cell[s];
+            for (int t = 0; t < TAP_GROUPS; t++) {
+                float k;
+                if (own == 1) {
+                    k = weight(own) * FILTER_SAME[t] +
+                        weight(cell[s ^ 1]) * FILTER_ROW_AT_G[t] +
+                        weight(cell[s ^ 2]) * FILTER_COL_AT_G[t];
+                } else {
+                    k = weight(own) * FILTER_SAME[t] +
+                        weight(1) * FILTER_G_AT_RB[t] +
+                        weight(2 - own) * FILTER_DIAGONAL[t];
+                }
+                kernels[s][t] = k / 8;
+            }
+        }
+
+        int (*histogram)[LIBRAW_HISTOGRAM_SIZE] = libraw_internal_data.output_data.histogram;
+        if (!histogram) {
+            histogram = libraw_internal_data.output_data.histogram = (int (*)[LIBRAW_HISTOGRAM_SIZE])calloc(
+                1, sizeof(*libraw_internal_data.output_data.histogram) * 4);
+        }
+        memset(histogram, 0, sizeof(*histogram) * 4);
+
+        mono_image_.reset(new ushort[static_cast<size_t>(out_width) * out_height]);
+        ushort* mono = mono_image_.get();
+        int scaled_maximum = 0;
+
+        ParallelRows(out_height, BAND_ROWS, [&](int first, int last) {
+            std::vector<int> counts(LIBRAW_HISTOGRAM_SIZE, 0);
+            std::vector<float> luma(static_cast<size_t>(out_width) + 1);
+            int dmax = 0;
+            auto store = [&](int row) {
+                ushort* out = mono + static_cast<size_t>(row) * out_width;
+                for (int col = 0; col < out_width; col++) {
+                    int val = std::min(std::max(static_cast<int>(luma[col] + 0.5f), 0), 65535);
+                    out[col] = static_cast<ushort>(val);
+                    counts[val >> 3]++;
+                }
+            };
+
+            if (half) {
+                // Each 2x2 cell (rows/columns mirrored past odd edges) is one
+                // pixel; the two greens are averaged
+                float cell_weights[4];
+                for (int s = 0; s < 4; s++) {
+                    cell_weights[s] = weight(cell[s]) * ((cell[s] & 1) ? 0.5f : 1.0f);
+                }
+                std::vector<float> even(width + 1), odd(width + 1);
+                for (int row = first; row < last; row++) {
+                    const int top = 2 * row;
+                    scale_row(top, even.data());
+                    scale_row(Mirror(top + 1, height), odd.data());
+                    for (int source = top; !adjust && source < std::min(top + 2, copy_height); source++) {
+                        dmax = std::max(dmax, row_maximum(source));
+                    }
+                    even[width] = even[width - 2];
+                    odd[width] = odd[width - 2];
+                    for (int col = 0; col < out_width; col++) {
+                        const int x = 2 * col;
+                        luma[col] = cell_weights[0] * even[x] + cell_weights[1] * even[x + 1] +
+                                    cell_weights[2] * odd[x] + cell_weights[3] * odd[x + 1];
+                    }
+                    store(row);
+                }
+            } else {
+                // Scaled mosaic rows of one band plus two on either side, each
+                // padded by mirrored columns (three on the right so odd
+                // widths can run whole pairs)
+                const size_t pitch = static_cast<size_t>(width) + 5;
+                std::vector<float> rows((BAND_ROWS + 4) * pitch);
+                for (int band = first; band < last; band += BAND_ROWS) {
+                    const int band_rows = std::min(BAND_ROWS, last - band);
+                    for (int i = 0; i < band_rows + 4; i++) {
+                        const int source = Mirror(band - 2 + i, height);
+                        float* row = rows.data() + i * pitch + 2;
+                        scale_row(source, row);
+                        row[-1] = row[1];
+                        row[-2] = row[2];
+                        for (int k = 0; k < 3; k++) row[width + k] = row[width - 2 - k];
+                        if (!adjust && i >= 2 && i < band_rows + 2 && source < copy_height) {
+                            dmax = std::max(dmax, row_maximum(source));
+                        }
+                    }
+                    for (int r = 0; r < band_rows; r++) {
+                        const int row = band + r;
+                        const float* k = kernels[(row & 1) * 2];
+                        const float* base = rows.data() + r * pitch + 2;
+                        LumaRow(base, base + pitch, base + 2 * pitch, base + 3 * pitch, base + 4 * pitch,
+                                k, luma.data(), static_cast<size_t>(width + 1) / 2);
+                        store(row);
+                    }
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int i = 0; i < LIBRAW_HISTOGRAM_SIZE; i++) histogram[0][i] += counts[i];
+            scaled_maximum = std::max(scaled_maximum, dmax);
+        });
+
+        if (!adjust) {
+            color.data_maximum = scaled_maximum & 0xffff;
+        }
+
+        // One output colour from here on; half size shrinks the frame as
+        // pre_interpolate() does
+        imgdata.idata.colors = 1;
+        if (half) {
+            sizes.height = sizes.iheight = static_cast<ushort>(out_height);
+            sizes.width = sizes.iwidth = static_cast<ushort>(out_width);
+            imgdata.idata.filters = 0;
+        }
+        gamma_curve(imgdata.params.gamm[0], imgdata.params.gamm[1], 0, 0);
+        mono_float_ = monochrome_float_;
+
+        imgdata.progress_flags = LIBRAW_PROGRESS_START | LIBRAW_PROGRESS_OPEN | LIBRAW_PROGRESS_RAW2_IMAGE |
+                                 LIBRAW_PROGRESS_IDENTIFY | LIBRAW_PROGRESS_SIZE_ADJUST | LIBRAW_PROGRESS_LOAD_RAW |
+                                 LIBRAW_PROGRESS_PRE_INTERPOLATE | LIBRAW_PROGRESS_INTERPOLATE |
+                                 LIBRAW_PROGRESS_CONVERT_RGB;
+        if (!imgdata.params.no_auto_scale) {
+            imgdata.progress_flags |= LIBRAW_PROGRESS_SCALE_COLORS;
+        }
+        if (imgdata.params.use_fuji_rotate) {
+            imgdata.progress_flags |= LIBRAW_PROGRESS_FUJI_ROTATE | LIBRAW_PROGRESS_STRETCH;
+        }
+        return LIBRAW_SUCCESS;
+    } catch (const std::bad_alloc&) {
+        recycle();
+        return LIBRAW_UNSUFFICIENT_MEMORY;
+    } catch (const LibRaw_exceptions&) {
+        recycle();
+        return LIBRAW_UNSUFFICIENT_MEMORY;
+    }
+}
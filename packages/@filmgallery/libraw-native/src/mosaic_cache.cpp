@@ -0,0 +1,525 @@
+/**
+ * @filmgallery/libraw-native - Mosaic Caches
+ *
+ * Entropy decoding dominates unpack() for CR3, compressed RAF and NEF files,
+ * and the same files are decoded again and again (previews, exports, edits).
+ * A mosaic cache keeps the unpacked raw image next to the post-unpack
+ * snapshot (identify_snapshot.cpp), so a later open maps the cache and
+ * expands it on all cores instead of running the camera codec.
+ *
+ * File layout (little-endian):
+ *
+ *   header    (HEADER_SIZE bytes) magic 'FGMC', version, samples per pixel,
+ *             rows, samples per row, rows per band, band count, snapshot
+ *             length and a checksum of the header and band table
+ *   snapshot  post-unpack state, bound to the RAW file's size and mtime
+ *   table     per band: data offset, size, checksum, bit depth, encoding
+ *   bands     BAND_ROWS rows of raw samples each, bit-packed to the band's
+ *             real bit depth (the bits its largest sample needs) and
+ *             LZ-compressed when that saves space
+ *
+ * Bands are independent, so both writing and reading run in parallel.
+ */
+
+#include "film_libraw.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+
+namespace {
+
+const uint32_t MAGIC = 0x434d4746;      // "FGMC"
+const uint16_t VERSION = 1;
+const size_t HEADER_SIZE = 64;
+const size_t BAND_ENTRY_SIZE = 24;
+
+// Rows per band: enough bytes for the LZ matcher, enough bands to keep
+// every core busy on a 4000-row sensor
+const int BAND_ROWS = 64;
+
+// Band encodings
+const uint8_t BAND_PACKED = 0;          // bit-packed samples as they are
+const uint8_t BAND_LZ = 1;              // bit-packed, then LZ-compressed
+
+// LZ77 in LZ4-style sequences: token (literal count << 4 | match length -
+// MIN_MATCH, 15 meaning more length bytes follow), literals, 16-bit offset
+const size_t MIN_MATCH = 4;
+const size_t MAX_OFFSET = 65535;
+const int HASH_BITS = 14;
+
+uint32_t Fnv1a(const uint8_t* data, size_t size, uint32_t hash = 2166136261u) {
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+template <typename T>
+void Put(uint8_t* dst, T value) {
+    std::memcpy(dst, &value, sizeof(T));
+}
+
+template <typename T>
+T Get(const uint8_t* src) {
+    T value;
+    std::memcpy(&value, src, sizeof(T));
+    return value;
+}
+
+// ============================================================================
+// Bit packing
+// ============================================================================
+
+int BitDepth(const ushort* samples, size_t count) {
+    unsigned max = 0;
+    for (size_t i = 0; i < count; i++) max |= samples[i];
+    int bits = 0;
+    while (max >> bits) bits++;
+    return bits;
+}
+
+size_t PackedSize(size_t count, int bits) {
+    return (count * bits + 7) / 8;
+}
+
+// Samples LSB first, `bits` each
+void PackBits(const ushort* src, size_t count, int bits, uint8_t* dst) {
+    uint32_t acc = 0;
+    int filled = 0;
+    for (size_t i = 0; i < count; i++) {
+        acc |= static_cast<uint32_t>(src[i]) << filled;
+        filled += bits;
+        while (filled >= 8) {
+            *dst++ = static_cast<uint8_t>(acc);
+            acc >>= 8;
+            filled -= 8;
+        }
+    }
+    if (filled > 0) {
+        *dst = static_cast<uint8_t>(acc);
+    }
+}
+
+void UnpackBits(const uint8_t* src, size_t count, int bits, ushort* dst) {
+    if (bits == 0) {
+        std::memset(dst, 0, count * sizeof(ushort));
+        return;
+    }
+    const uint32_t mask = (1u << bits) - 1;
+    uint32_t acc = 0;
+    int filled = 0;
+    for (size_t i = 0; i < count; i++) {
+        while (filled < bits) {
+            acc |= static_cast<uint32_t>(*src++) << filled;
+            filled += 8;
+        }
+        dst[i] = static_cast<ushort>(acc & mask);
+        acc >>= bits;
+        filled -= bits;
+    }
+}
+
+// ============================================================================
+// LZ codec
+// ============================================================================
+
+void PutLength(std::vector<uint8_t>& out, size_t length) {
+    while (length >= 255) {
+        out.push_back(255);
+        length -= 255;
+    }
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+void PutSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literal_count,
+                 size_t offset, size_t match_length) {
+    const size_t extra = match_length ? match_length - MIN_MATCH : 0;
+    out.push_back(static_cast<uint8_t>(std::min<size_t>(literal_count, 15) << 4 | std::min<size_t>(extra, 15)));
+    if (literal_count >= 15) PutLength(out, literal_count - 15);
+    out.insert(out.end(), literals, literals + literal_count);
+    if (!match_length) return;
+    out.push_back(static_cast<uint8_t>(offset));
+    out.push_back(static_cast<uint8_t>(offset >> 8));
+    if (extra >= 15) PutLength(out, extra - 15);
+}
+
+/**
+ * Greedy single-probe matcher; the last sequence carries literals only
+ */
+void LzCompress(const uint8_t* src, size_t size, std::vector<uint8_t>& out) {
+    out.clear();
+    out.reserve(size / 2);
+    std::vector<uint32_t> table(static_cast<size_t>(1) << HASH_BITS, 0);   // position + 1
+    size_t anchor = 0;
+    size_t i = 0;
+    while (i + MIN_MATCH <= size) {
+        const uint32_t sequence = Get<uint32_t>(src + i);
+        const uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+        const size_t candidate = table[hash];
+        table[hash] = static_cast<uint32_t>(i + 1);
+        if (!candidate || i + 1 - candidate > MAX_OFFSET || Get<uint32_t>(src + candidate - 1) != sequence) {
+            i++;
+            continue;
+        }
+        const size_t match = candidate - 1;
+        size_t length = MIN_MATCH;
+        while (i + length < size && src[match + length] == src[i + length]) length++;
+        PutSequence(out, src + anchor, i - anchor, i - match, length);
+        i += length;
+        anchor = i;
+    }
+    PutSequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+bool ReadLength(const uint8_t* src, size_t size, size_t& pos, size_t& length) {
+    uint8_t byte;
+    do {
+        if (pos >= size) return false;
+        byte = src[pos++];
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool LzDecompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_size) {
+    size_t in = 0;
+    size_t out = 0;
+    while (in < size) {
+        const uint8_t token = src[in++];
+        size_t literals = token >> 4;
+        if (literals == 15 && !ReadLength(src, size, in, literals)) return false;
+        if (literals > size - in || literals > dst_size - out) return false;
+        std::memcpy(dst + out, src + in, literals);
+        in += literals;
+        out += literals;
+        if (in == size) break;
+
+        if (size - in < 2) return false;
+        const size_t offset = src[in] | static_cast<size_t>(src[in + 1]) << 8;
+        in += 2;
+        size_t length = token & 15;
+        if (length == 15 && !ReadLength(src, size, in, length)) return false;
+        length += MIN_MATCH;
+        if (offset == 0 || offset > out || length > dst_size - out) return false;
+        uint8_t* d = dst + out;
+        const uint8_t* s = d - offset;
+        if (offset >= length) {
+            std::memcpy(d, s, length);
+        } else {
+            for (size_t k = 0; k < length; k++) d[k] = s[k];     // overlapping run
+        }
+        out += length;
+    }
+    return out == dst_size;
+}
+
+// ============================================================================
+// Bands
+// ============================================================================
+
+struct EncodedBand {
+    std::vector<uint8_t> data;
+    uint32_t checksum = 0;
+    uint8_t bits = 0;
+    uint8_t mode = BAND_PACKED;
+};
+
+void EncodeBand(const ushort* samples, size_t count, std::vector<uint8_t>& packed, EncodedBand& band) {
+    band.bits = static_cast<uint8_t>(BitDepth(samples, count));
+    packed.resize(PackedSize(count, band.bits));
+    PackBits(samples, count, band.bits, packed.data());
+    LzCompress(packed.data(), packed.size(), band.data);
+    if (band.data.size() < packed.size()) {
+        band.mode = BAND_LZ;
+    } else {
+        band.mode = BAND_PACKED;
+        band.data.swap(packed);
+    }
+    band.checksum = Fnv1a(band.data.data(), band.data.size());
+}
+
+bool DecodeBand(const uint8_t* data, size_t size, uint8_t bits, uint8_t mode,
+                ushort* samples, size_t count, std::vector<uint8_t>& packed) {
+    if (bits > 16) return false;
+    const size_t packed_size = PackedSize(count, bits);
+    const uint8_t* source = data;
+    if (mode == BAND_LZ) {
+        packed.resize(packed_size);
+        if (!LzDecompress(data, size, packed.data(), packed_size)) return false;
+        source = packed.data();
+    } else if (mode != BAND_PACKED || size != packed_size) {
+        return false;
+    }
+    UnpackBits(source, count, bits, samples);
+    return true;
+}
+
+// Samples per pixel of the unpacked image (0: not cacheable)
+int RawSamples(const libraw_rawdata_t& raw) {
+    return raw.raw_image ? 1 : raw.color3_image ? 3 : raw.color4_image ? 4 : 0;
+}
+
+}  // namespace
+
+// ============================================================================
+// Save
+// ============================================================================
+
+namespace {
+
+// Raw image layout SaveMosaic() and CaptureMosaic() can store
+int MosaicLayout(const libraw_data_t& data, int& samples, int& rows, size_t& row_samples) {
+    // Processing rewrites the sizes and levels the snapshot captures
+    const unsigned stage = data.progress_flags & LIBRAW_PROGRESS_THUMB_MASK;
+    if (stage < LIBRAW_PROGRESS_LOAD_RAW || stage >= LIBRAW_PROGRESS_RAW2_IMAGE) {
+        return LIBRAW_OUT_OF_ORDER_CALL;
+    }
+
+    // Float images and Phase One's per-row/column black calibration stay
+    // out; everything else a loader leaves behind is in the snapshot
+    const libraw_rawdata_t& raw = data.rawdata;
+    samples = RawSamples(raw);
+    row_samples = raw.sizes.raw_pitch / sizeof(ushort);
+    rows = raw.sizes.raw_height;
+    if (!samples || raw.ph1_cblack || raw.ph1_rblack || rows <= 0 || raw.sizes.raw_pitch % sizeof(ushort) ||
+        row_samples < static_cast<size_t>(raw.sizes.raw_width) * samples) {
+        return LIBRAW_FILE_UNSUPPORTED;
+    }
+    return LIBRAW_SUCCESS;
+}
+
+int WriteMosaicFile(const std::vector<uint8_t>& snapshot, const ushort* image, int samples, int rows,
+                    size_t row_samples, const char* cache_path, uint64_t* bytes) {
+    const int bands = (rows + BAND_ROWS - 1) / BAND_ROWS;
+    std::vector<EncodedBand> encoded;
+    std::atomic<bool> failed(false);
+    try {
+        encoded.resize(bands);
+    } catch (const std::bad_alloc&) {
+        return LIBRAW_UNSUFFICIENT_MEMORY;
+    }
+    ParallelRows(bands, 1, [&](int first, int last) {
+        try {
+            std::vector<uint8_t> packed;
+            for (int b = first; b < last && !failed; b++) {
+                const int band_rows = std::min(BAND_ROWS, rows - b * BAND_ROWS);
+                EncodeBand(image + static_cast<size_t>(b) * BAND_ROWS * row_samples,
+                           static_cast<size_t>(band_rows) * row_samples, packed, encoded[b]);
+            }
+        } catch (const std::bad_alloc&) {
+            failed = true;
+        }
+    });
+    if (failed) {
+        return LIBRAW_UNSUFFICIENT_MEMORY;
+    }
+
+    std::vector<uint8_t> table(static_cast<size_t>(bands) * BAND_ENTRY_SIZE, 0);
+    uint64_t offset = 0;
+    for (int b = 0; b < bands; b++) {
+        uint8_t* entry = table.data() + static_cast<size_t>(b) * BAND_ENTRY_SIZE;
+        Put<uint64_t>(entry, offset);
+        Put<uint32_t>(entry + 8, static_cast<uint32_t>(encoded[b].data.size()));
+        Put<uint32_t>(entry + 12, encoded[b].checksum);
+        entry[16] = encoded[b].bits;
+        entry[17] = encoded[b].mode;
+        offset += encoded[b].data.size();
+    }
+
+    uint8_t header[HEADER_SIZE] = {};
+    Put<uint32_t>(header + 0, MAGIC);
+    Put<uint16_t>(header + 4, VERSION);
+    Put<uint16_t>(header + 6, static_cast<uint16_t>(samples));
+    Put<uint32_t>(header + 8, static_cast<uint32_t>(rows));
+    Put<uint32_t>(header + 12, static_cast<uint32_t>(row_samples));
+    Put<uint32_t>(header + 16, static_cast<uint32_t>(BAND_ROWS));
+    Put<uint32_t>(header + 20, static_cast<uint32_t>(bands));
+    Put<uint32_t>(header + 24, static_cast<uint32_t>(snapshot.size()));
+    Put<uint32_t>(header + 60, Fnv1a(table.data(), table.size(), Fnv1a(header, 60)));
+
+    // Unique temporary name next to the target, renamed over it when complete
+    static std::atomic<unsigned> counter(0);
+    const std::string temp = std::string(cache_path) + "." +
+                             std::to_string(reinterpret_cast<uintptr_t>(image)) + "-" +
+                             std::to_string(counter++) + ".part";
+    FILE* file = std::fopen(temp.c_str(), "wb");
+    if (!file) {
+        return LIBRAW_IO_ERROR;
+    }
+    bool ok = std::fwrite(header, 1, HEADER_SIZE, file) == HEADER_SIZE &&
+              std::fwrite(snapshot.data(), 1, snapshot.size(), file) == snapshot.size() &&
+              std::fwrite(table.data(), 1, table.size(), file) == table.size();
+    for (int b = 0; ok && b < bands; b++) {
+        const std::vector<uint8_t>& data = encoded[b].data;
+        ok = data.empty() || std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    }
+    ok = std::fclose(file) == 0 && ok;
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows
+    if (ok) std::remove(cache_path);
+#endif
+    if (!ok || std::rename(temp.c_str(), cache_path) != 0) {
+        std::remove(temp.c_str());
+        return LIBRAW_IO_ERROR;
+    }
+
+    if (bytes) {
+        *bytes = HEADER_SIZE + snapshot.size() + table.size() + offset;
+    }
+    return LIBRAW_SUCCESS;
+}
+
+}  // namespace
+
+int FilmLibRaw::SaveMosaic(const char* path, const char* cache_path, uint64_t* bytes) {
+    int samples, rows;
+    size_t row_samples;
+    int ret = MosaicLayout(imgdata, samples, rows, row_samples);
+    if (ret != LIBRAW_SUCCESS) {
+        return ret;
+    }
+
+    std::vector<uint8_t> snapshot;
+    ret = WriteSnapshot(path, snapshot);
+    if (ret != LIBRAW_SUCCESS) {
+        return ret;
+    }
+    return WriteMosaicFile(snapshot, static_cast<const ushort*>(imgdata.rawdata.raw_alloc), samples, rows,
+                           row_samples, cache_path, bytes);
+}
+
+int FilmLibRaw::CaptureMosaic(const char* path, MosaicCapture& capture) {
+    int ret = MosaicLayout(imgdata, capture.samples, capture.rows, capture.row_samples);
+    if (ret != LIBRAW_SUCCESS) {
+        return ret;
+    }
+
+    ret = WriteSnapshot(path, capture.snapshot);
+    if (ret != LIBRAW_SUCCESS) {
+        return ret;
+    }
+    const ushort* image = static_cast<const ushort*>(imgdata.rawdata.raw_alloc);
+    try {
+        capture.image.assign(image, image + static_cast<size_t>(capture.rows) * capture.row_samples);
+    } catch (const std::bad_alloc&) {
+        return LIBRAW_UNSUFFICIENT_MEMORY;
+    }
+    return LIBRAW_SUCCESS;
+}
+
+int FilmLibRaw::WriteMosaic(const MosaicCapture& capture, const char* cache_path, uint64_t* bytes) {
+    if (capture.image.size() != static_cast<size_t>(capture.rows) * capture.row_samples) {
+        return LIBRAW_OUT_OF_ORDER_CALL;
+    }
+    return WriteMosaicFile(capture.snapshot, capture.image.data(), capture.samples, capture.rows,
+                           capture.row_samples, cache_path, bytes);
+}
+
+// ============================================================================
+// Restore
+// ============================================================================
+
+SnapshotStatus FilmLibRaw::OpenWithMosaic(const char* path, const char* cache_path) {
+    recycle();
+
+    MappedFile file;
+    if (!file.Open(cache_path)) {
+        return SNAPSHOT_IO_ERROR;
+    }
+    const uint8_t* data = file.Data();
+    const size_t size = file.Size();
+    if (size < HEADER_SIZE || Get<uint32_t>(data) != MAGIC || Get<uint16_t>(data + 4) != VERSION) {
+        return SNAPSHOT_INVALID;
+    }
+
+    const int samples = Get<uint16_t>(data + 6);
+    const uint32_t rows = Get<uint32_t>(data + 8);
+    const size_t row_samples = Get<uint32_t>(data + 12);
+    const uint32_t band_rows = Get<uint32_t>(data + 16);
+    const uint32_t bands = Get<uint32_t>(data + 20);
+    const size_t snapshot_size = Get<uint32_t>(data + 24);
+    if ((samples != 1 && samples != 3 && samples != 4) || !rows || !row_samples || !band_rows ||
+        bands != (rows + band_rows - 1) / band_rows ||
+        snapshot_size > size - HEADER_SIZE ||
+        static_cast<uint64_t>(bands) * BAND_ENTRY_SIZE > size - HEADER_SIZE - snapshot_size) {
+        return SNAPSHOT_INVALID;
+    }
+    const uint8_t* table = data + HEADER_SIZE + snapshot_size;
+    const size_t table_size = static_cast<size_t>(bands) * BAND_ENTRY_SIZE;
+    if (Fnv1a(table, table_size, Fnv1a(data, 60)) != Get<uint32_t>(data + 60)) {
+        return SNAPSHOT_INVALID;
+    }
+    const uint8_t* band_data = table + table_size;
+    const uint64_t band_data_size = size - HEADER_SIZE - snapshot_size - table_size;
+
+    SnapshotStatus status = RestoreSnapshot(path, data + HEADER_SIZE, snapshot_size, true);
+    if (status != SNAPSHOT_OK) {
+        return status;
+    }
+
+    // The restored sizes must describe the cached image, as unpack() would
+    // have allocated it (raw_pitch per row, margins included)
+    const libraw_image_sizes_t& sizes = imgdata.sizes;
+    const bool single = imgdata.idata.filters || imgdata.idata.colors == 1;
+    const size_t alloc_rows = std::max<size_t>(rows, static_cast<size_t>(sizes.height) + sizes.top_margin) + 8;
+    if (sizes.raw_height != rows || sizes.raw_pitch != row_samples * sizeof(ushort) ||
+        row_samples < static_cast<size_t>(sizes.raw_width) * samples || single != (samples == 1) ||
+        static_cast<INT64>(row_samples) * static_cast<INT64>(alloc_rows) * static_cast<INT64>(sizeof(ushort)) >
+            INT64(imgdata.rawparams.max_raw_memory_mb) * INT64(1024 * 1024)) {
+        recycle();
+        return SNAPSHOT_INVALID;
+    }
+
+    ushort* image = static_cast<ushort*>(calloc(row_samples * alloc_rows, sizeof(ushort)));
+    if (!image) {
+        recycle();
+        return SNAPSHOT_INVALID;
+    }
+
+    std::atomic<bool> failed(false);
+    ParallelRows(static_cast<int>(bands), 1, [&](int first, int last) {
+        try {
+            std::vector<uint8_t> packed;
+            for (int b = first; b < last && !failed; b++) {
+                const uint8_t* entry = table + static_cast<size_t>(b) * BAND_ENTRY_SIZE;
+                const uint64_t offset = Get<uint64_t>(entry);
+                const uint32_t length = Get<uint32_t>(entry + 8);
+                if (offset > band_data_size || length > band_data_size - offset ||
+                    Fnv1a(band_data + offset, length) != Get<uint32_t>(entry + 12)) {
+                    failed = true;
+                    break;
+                }
+                const size_t first_row = static_cast<size_t>(b) * band_rows;
+                const size_t count = std::min<size_t>(band_rows, rows - first_row) * row_samples;
+                if (!DecodeBand(band_data + offset, length, entry[16], entry[17],
+                                image + first_row * row_samples, count, packed)) {
+                    failed = true;
+                }
+            }
+        } catch (const std::bad_alloc&) {
+            failed = true;
+        }
+    });
+    if (failed) {
+        free(image);
+        recycle();
+        return SNAPSHOT_INVALID;
+    }
+
+    // Attached the way unpack() leaves it; rawdata's copies of the structs
+    // were taken by RestoreSnapshot()
+    imgdata.rawdata.raw_alloc = image;
+    if (samples == 1) {
+        imgdata.rawdata.raw_image = image;
+    } else if (samples == 3) {
+        imgdata.rawdata.color3_image = reinterpret_cast<ushort(*)[3]>(image);
+    } else {
+        imgdata.rawdata.color4_image = reinterpret_cast<ushort(*)[4]>(image);
+    }
+    return SNAPSHOT_OK;
+}
@@ -0,0 +1,431 @@
+/**
+ * @filmgallery/libraw-native - Uncompressed and Bit-packed Raw Loaders
+ *
+ * Stand-ins Unpack() runs for LibRaw's loaders of uncompressed sensor data:
+ * unpacked_load_raw(), packed_load_raw(), packed_dng_load_raw(),
+ * nikon_load_striped_packed_raw(), nikon_14bit_load_raw() and
+ * android_tight_load_raw(). Those pull samples one at a time through
+ * getbits()/fgetc(); here the file is mapped (buffers are read in one go),
+ * rows are split across threads, and each row goes through a dispatched
+ * kernel for its packing: MSB-first 10/12/14/16-bit (byte or word order),
+ * Nikon's LSB-first 14-bit, MIPI RAW10. Output is bit-identical to LibRaw's.
+ * Layouts not covered here (interlaced or padded packed_load_raw() rows,
+ * tiled or multi-sample DNGs, truncated files) run LibRaw's own loader.
+ */
+
+#include "film_libraw.h"
+#include "input_bytes.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// Rows per thread chunk; rows are a few KB each
+const int MIN_ROWS = 32;
+
+// Bytes kernels may read past the last sample's byte (one 64-bit window)
+const size_t ROW_SLACK = 8;
+
+// Big-endian 64-bit window at `p`
+CPU_INLINE uint64_t LoadMsb64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = v << 8 | p[i];
+    return v;
+}
+
+// `count` samples of `bits` from an MSB-first bit stream starting at bit
+// `first_bit` of `src` (as getbits() reads it); needs ROW_SLACK readable bytes
+CPU_INLINE void UnpackMsbTail(const uint8_t* src, ushort* dst, size_t first_bit, size_t count, int bits) {
+    for (size_t i = 0; i < count; i++) {
+        size_t bit = first_bit + i * bits;
+        dst[i] = static_cast<ushort>(LoadMsb64(src + (bit >> 3)) << (bit & 7) >> (64 - bits));
+    }
+}
+
+CPU_INLINE void UnpackMsbBody(const uint8_t* src, ushort* dst, size_t count, int bits) {
+    UnpackMsbTail(src, dst, 0, count, bits);
+}
+
+// 2 samples in 3 bytes
+CPU_INLINE void UnpackMsb12Body(const uint8_t* src, ushort* dst, size_t count) {
+    const size_t groups = count / 2;
+    for (size_t i = 0; i < groups; i++) {
+        const uint8_t* p = src + 3 * i;
+        dst[2 * i] = static_cast<ushort>(p[0] << 4 | p[1] >> 4);
+        dst[2 * i + 1] = static_cast<ushort>((p[1] & 0x0f) << 8 | p[2]);
+    }
+    UnpackMsbTail(src, dst + 2 * groups, groups * 24, count - 2 * groups, 12);
+}
+
+// 4 samples in 7 bytes
+CPU_INLINE void UnpackMsb14Body(const uint8_t* src, ushort* dst, size_t count) {
+    const size_t groups = count / 4;
+    for (size_t i = 0; i < groups; i++) {
+        const uint8_t* p = src + 7 * i;
+        dst[4 * i] = static_cast<ushort>(p[0] << 6 | p[1] >> 2);
+        dst[4 * i + 1] = static_cast<ushort>((p[1] & 0x03) << 12 | p[2] << 4 | p[3] >> 4);
+        dst[4 * i + 2] = static_cast<ushort>((p[3] & 0x0f) << 10 | p[4] << 2 | p[5] >> 6);
+        dst[4 * i + 3] = static_cast<ushort>((p[5] & 0x3f) << 8 | p[6]);
+    }
+    UnpackMsbTail(src, dst + 4 * groups, groups * 56, count - 4 * groups, 14);
+}
+
+// 4 samples in 5 bytes
+CPU_INLINE void UnpackMsb10Body(const uint8_t* src, ushort* dst, size_t count) {
+    const size_t groups = count / 4;
+    for (size_t i = 0; i < groups; i++) {
+        const uint8_t* p = src + 5 * i;
+        dst[4 * i] = static_cast<ushort>(p[0] << 2 | p[1] >> 6);
+        dst[4 * i + 1] = static_cast<ushort>((p[1] & 0x3f) << 4 | p[2] >> 4);
+        dst[4 * i + 2] = static_cast<ushort>((p[2] & 0x0f) << 6 | p[3] >> 2);
+        dst[4 * i + 3] = static_cast<ushort>((p[3] & 0x03) << 8 | p[4]);
+    }
+    UnpackMsbTail(src, dst + 4 * groups, groups * 40, count - 4 * groups, 10);
+}
+
+// 16-bit words in either byte order, shifted down by `shift`
+CPU_INLINE void UnpackWordsBody(const uint8_t* src, ushort* dst, size_t count, bool big_endian, int shift) {
+    if (big_endian) {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<ushort>((src[2 * i] << 8 | src[2 * i + 1]) >> shift);
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<ushort>((src[2 * i + 1] << 8 | src[2 * i]) >> shift);
+        }
+    }
+}
+
+// Nikon Z/D6 14-bit: 4 samples in 7 bytes, LSB-first (unpack7bytesto4x16_nikon)
+CPU_INLINE void UnpackLsb14Body(const uint8_t* src, ushort* dst, size_t groups) {
+    for (size_t i = 0; i < groups; i++) {
+        const uint8_t* p = src + 7 * i;
+        dst[4 * i] = static_cast<ushort>((p[1] & 0x3f) << 8 | p[0]);
+        dst[4 * i + 1] = static_cast<ushort>((p[3] & 0x0f) << 10 | p[2] << 2 | p[1] >> 6);
+        dst[4 * i + 2] = static_cast<ushort>((p[5] & 0x03) << 12 | p[4] << 4 | p[3] >> 4);
+        dst[4 * i + 3] = static_cast<ushort>(p[6] << 6 | p[5] >> 2);
+    }
+}
+
+// MIPI RAW10: 4 high bytes, then a byte of their low 2-bit pairs
+CPU_INLINE void UnpackMipi10Body(const uint8_t* src, ushort* dst, size_t groups) {
+    for (size_t i = 0; i < groups; i++) {
+        const uint8_t* p = src + 5 * i;
+        dst[4 * i] = static_cast<ushort>(p[0] << 2 | (p[4] & 3));
+        dst[4 * i + 1] = static_cast<ushort>(p[1] << 2 | (p[4] >> 2 & 3));
+        dst[4 * i + 2] = static_cast<ushort>(p[2] << 2 | (p[4] >> 4 & 3));
+        dst[4 * i + 3] = static_cast<ushort>(p[3] << 2 | p[4] >> 6);
+    }
+}
+
+// Samples above `bits` in [first, last), counted like unpacked_load_raw()'s derror()s
+CPU_INLINE size_t CountOverBody(const ushort* row, size_t first, size_t last, int bits) {
+    size_t over = 0;
+    for (size_t i = first; i < last; i++) over += (row[i] >> bits) != 0;
+    return over;
+}
+
+// Curve lookup in place (packed_dng_load_raw()'s adobe_copy_pixel())
+CPU_INLINE void ApplyCurveBody(ushort* row, size_t count, const ushort* curve) {
+    for (size_t i = 0; i < count; i++) row[i] = curve[row[i]];
+}
+
+CPU_DISPATCH_KERNEL(void, UnpackMsb, UnpackMsbBody,
+                    (const uint8_t* src, ushort* dst, size_t count, int bits), (src, dst, count, bits))
+CPU_DISPATCH_KERNEL(void, UnpackMsb12, UnpackMsb12Body,
+                    (const uint8_t* src, ushort* dst, size_t count), (src, dst, count))
+CPU_DISPATCH_KERNEL(void, UnpackMsb14, UnpackMsb14Body,
+                    (const uint8_t* src, ushort* dst, size_t count), (src, dst, count))
+CPU_DISPATCH_KERNEL(void, UnpackMsb10, UnpackMsb10Body,
+                    (const uint8_t* src, ushort* dst, size_t count), (src, dst, count))
+CPU_DISPATCH_KERNEL(void, UnpackWords, UnpackWordsBody,
+                    (const uint8_t* src, ushort* dst, size_t count, bool big_endian, int shift),
+                    (src, dst, count, big_endian, shift))
+CPU_DISPATCH_KERNEL(void, UnpackLsb14, UnpackLsb14Body,
+                    (const uint8_t* src, ushort* dst, size_t groups), (src, dst, groups))
+CPU_DISPATCH_KERNEL(void, UnpackMipi10, UnpackMipi10Body,
+                    (const uint8_t* src, ushort* dst, size_t groups), (src, dst, groups))
+CPU_DISPATCH_KERNEL(size_t, CountOver, CountOverBody,
+                    (const ushort* row, size_t first, size_t last, int bits), (row, first, last, bits))
+CPU_DISPATCH_KERNEL(void, ApplyCurve, ApplyCurveBody,
+                    (ushort* row, size_t count, const ushort* curve), (row, count, curve))
+
+// `count` MSB-first samples of `bits` from a byte-aligned row
+void UnpackMsbRow(const uint8_t* src, ushort* dst, size_t count, int bits) {
+    switch (bits) {
+        case 16: UnpackWords(src, dst, count, true, 0); break;
+        case 14: UnpackMsb14(src, dst, count); break;
+        case 12: UnpackMsb12(src, dst, count); break;
+        case 10: UnpackMsb10(src, dst, count); break;
+        default: UnpackMsb(src, dst, count, bits); break;
+    }
+}
+
+/**
+ * Row of an MSB-first stream whose bytes come in `word`-byte groups each
+ * read LSB-first (packed_load_raw()'s `bite`), as a plain MSB-first byte
+ * row with ROW_SLACK readable bytes: straight from the input when possible,
+ * else reordered into `scratch`
+ */
+const uint8_t* StreamRow(const InputBytes& bytes, size_t start, size_t row_bytes, int word,
+                         std::vector<uint8_t>& scratch) {
+    if (word == 1 && start + row_bytes + ROW_SLACK <= bytes.Available()) {
+        return bytes.Data() + start;
+    }
+    const size_t first = start / word * word;
+    const size_t last = std::min(bytes.Available() / word * word,
+                                 (start + row_bytes + word - 1) / word * word);
+    scratch.assign(last - first + 2 * ROW_SLACK, 0);
+    const uint8_t* src = bytes.Data() + first;
+    for (size_t i = 0; i < last - first; i += word) {
+        for (int b = 0; b < word; b++) scratch[i + b] = src[i + word - 1 - b];
+    }
+    return scratch.data() + (start - first);
+}
+
+} // namespace
+
+const std::vector<std::pair<FilmLibRaw::Decoder, FilmLibRaw::Decoder>>& FilmLibRaw::PackedLoaders() {
+    static const std::vector<std::pair<Decoder, Decoder>> loaders = {
+        {&FilmLibRaw::unpacked_load_raw, static_cast<Decoder>(&FilmLibRaw::UnpackedLoadRaw)},
+        {&FilmLibRaw::packed_load_raw, static_cast<Decoder>(&FilmLibRaw::PackedLoadRaw)},
+        {&FilmLibRaw::packed_dng_load_raw, static_cast<Decoder>(&FilmLibRaw::PackedDngLoadRaw)},
+        {&FilmLibRaw::nikon_load_striped_packed_raw, static_cast<Decoder>(&FilmLibRaw::NikonStripedLoadRaw)},
+        {&FilmLibRaw::nikon_14bit_load_raw, static_cast<Decoder>(&FilmLibRaw::Nikon14BitLoadRaw)},
+        {&FilmLibRaw::android_tight_load_raw, static_cast<Decoder>(&FilmLibRaw::AndroidTightLoadRaw)},
+    };
+    return loaders;
+}
+
+void FilmLibRaw::UnpackedLoadRaw() {
+    // unpack() lifts the maximum for these makes around LibRaw's loader only
+    const unsigned saved_maximum = imgdata.color.maximum;
+    if (!strcasecmp(imgdata.idata.make, "Nikon") || !strcasecmp(imgdata.idata.make, "Hasselblad")) {
+        imgdata.color.maximum = 65535;
+    }
+
+    unpacker_data_t& unpacker = libraw_internal_data.unpacker_data;
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    const int shift = unpacker.load_flags;
+    ushort* image = imgdata.rawdata.raw_image;
+    InputBytes bytes;
+    if (!image || shift > 15 ||
+        !bytes.Open(libraw_internal_data.internal_data.input, unpacker.data_offset,
+                    size_t(raw_width) * raw_height * 2, ROW_SLACK)) {
+        LibRaw::unpacked_load_raw();
+        imgdata.color.maximum = saved_maximum;
+        return;
+    }
+
+    int bits = 0;
+    while (1 << ++bits < int(imgdata.color.maximum)) {
+    }
+    const bool check = imgdata.color.maximum < 0xffff || shift;
+    const bool big_endian = unpacker.order != 0x4949;
+    const unsigned top = imgdata.sizes.top_margin, height = imgdata.sizes.height;
+    const size_t left = std::min<unsigned>(imgdata.sizes.left_margin, raw_width);
+    const size_t right = std::min<size_t>(left + imgdata.sizes.width, raw_width);
+
+    std::vector<size_t> over(raw_height, 0);
+    ParallelRows(int(raw_height), MIN_ROWS, [&](int first, int last) {
+        for (int row = first; row < last; row++) {
+            ushort* dst = image + size_t(row) * raw_width;
+            UnpackWords(bytes.Data() + size_t(row) * raw_width * 2, dst, raw_width, big_endian, shift);
+            if (check && unsigned(row) - top < height) {
+                over[row] = CountOver(dst, left, right, bits);
+            }
+        }
+    });
+
+    size_t errors = 0;
+    for (size_t n : over) errors += n;
+    if (errors) {
+        // One derror() where LibRaw's loader leaves the stream, then the count
+        libraw_internal_data.internal_data.input->seek(
+            unpacker.data_offset + INT64(raw_width) * raw_height * 2 - 2, SEEK_SET);
+        derror();
+        unpacker.data_error += int(errors - 1);
+    }
+    imgdata.color.maximum = saved_maximum;
+}
+
+void FilmLibRaw::PackedLoadRaw() {
+    const unpacker_data_t& unpacker = libraw_internal_data.unpacker_data;
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    const int bits = unpacker.tiff_bps;
+    const unsigned flags = unpacker.load_flags;
+    const bool swap_pairs = flags >> 6 & 1;
+    ushort* image = imgdata.rawdata.raw_image;
+
+    // Rows are `row_stride` bytes apart in the stream, whatever the padding
+    // bits (packed_load_raw()'s rbits) at their end
+    size_t row_stride = size_t(raw_width) * bits / 8;
+    row_stride += row_stride & (flags >> 7);
+    const int word = 1 + int((flags & 24) >> 3);
+    const size_t row_bytes = (size_t(raw_width) * bits + 7) / 8;
+    const size_t needed = raw_height ? ((raw_height - 1) * row_stride * 8 + size_t(raw_width) * bits + 7) / 8 : 0;
+    const size_t length = (needed + word - 1) / word * word;
+
+    // Zero-byte-padded (load_flags & 1) and interlaced (& 2) rows stay with
+    // LibRaw, as do odd widths with swapped pairs (LibRaw writes past the row)
+    InputBytes bytes;
+    if (!image || bits < 1 || bits > 16 || (flags & 3) || (swap_pairs && (raw_width & 1)) ||
+        !bytes.Open(libraw_internal_data.internal_data.input, unpacker.data_offset, length, ROW_SLACK)) {
+        LibRaw::packed_load_raw();
+        return;
+    }
+
+    ParallelRows(int(raw_height), MIN_ROWS, [&](int first, int last) {
+        std::vector<uint8_t> scratch;
+        for (int row = first; row < last; row++) {
+            const uint8_t* src = StreamRow(bytes, size_t(row) * row_stride, row_bytes, word, scratch);
+            ushort* dst = image + size_t(row) * raw_width;
+            UnpackMsbRow(src, dst, raw_width, bits);
+            if (swap_pairs) {
+                for (unsigned col = 0; col < raw_width; col += 2) std::swap(dst[col], dst[col + 1]);
+            }
+        }
+    });
+}
+
+void FilmLibRaw::PackedDngLoadRaw() {
+    const unpacker_data_t& unpacker = libraw_internal_data.unpacker_data;
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    const int bits = unpacker.tiff_bps;
+    ushort* image = imgdata.rawdata.raw_image;
+
+    // One sample per pixel, untiled, rows byte-aligned (getbits(-1) per row)
+    const size_t row_bytes = (size_t(raw_width) * bits + 7) / 8;
+    InputBytes bytes;
+    if (!image || unpacker.tile_length < INT_MAX || unpacker.tiff_samples != 1 ||
+        bits < 1 || bits > 16 || (bits < 16 && unpacker.zero_after_ff) ||
+        !bytes.Open(libraw_internal_data.internal_data.input, unpacker.data_offset, row_bytes * raw_height, ROW_SLACK)) {
+        LibRaw::packed_dng_load_raw();
+        return;
+    }
+
+    const bool big_endian = unpacker.order != 0x4949;
+    const ushort* curve = imgdata.color.curve;
+    ParallelRows(int(raw_height), MIN_ROWS, [&](int first, int last) {
+        std::vector<uint8_t> scratch;
+        for (int row = first; row < last; row++) {
+            ushort* dst = image + size_t(row) * raw_width;
+            if (bits == 16) {
+                UnpackWords(bytes.Data() + size_t(row) * row_bytes, dst, raw_width, big_endian, 0);
+            } else {
+                UnpackMsbRow(StreamRow(bytes, size_t(row) * row_bytes, row_bytes, 1, scratch), dst, raw_width, bits);
+            }
+            ApplyCurve(dst, raw_width, curve);
+        }
+    });
+}
+
+void FilmLibRaw::NikonStripedLoadRaw() {
+    const unpacker_data_t& unpacker = libraw_internal_data.unpacker_data;
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    const int bits = unpacker.tiff_bps;
+    ushort* image = imgdata.rawdata.raw_image;
+
+    const tiff_ifd_t* ifd = nullptr;
+    for (unsigned i = 0; i < libraw_internal_data.identify_data.tiff_nifds; i++) {
+        if (tiff_ifd[i].offset == unpacker.data_offset) {
+            ifd = &tiff_ifd[i];
+            break;
+        }
+    }
+
+    // Strips restart the 32-bit word stream; with whole words per row no
+    // bits carry over from one strip into the next
+    const size_t row_bytes = size_t(raw_width) * bits / 8;
+    bool covered = image && ifd && bits >= 1 && bits <= 16 && (size_t(raw_width) * bits) % 32 == 0;
+    INT64 first_byte = INT64_MAX, last_byte = 0;
+    int strips = 0;
+    if (covered && ifd->rows_per_strip > 0 && ifd->strip_offsets_count > 0) {
+        const unsigned rows_per_strip = ifd->rows_per_strip;
+        strips = int(std::min<INT64>(ifd->strip_offsets_count, (INT64(raw_height) + rows_per_strip - 1) / rows_per_strip));
+        for (int s = 0; s < strips; s++) {
+            const INT64 rows = std::min<INT64>(rows_per_strip, INT64(raw_height) - INT64(s) * rows_per_strip);
+            first_byte = std::min<INT64>(first_byte, ifd->strip_offsets[s]);
+            last_byte = std::max<INT64>(last_byte, ifd->strip_offsets[s] + rows * INT64(row_bytes));
+        }
+    }
+    InputBytes bytes;
+    if (!covered || (strips && !bytes.Open(libraw_internal_data.internal_data.input, first_byte,
+                                           size_t(last_byte - first_byte), ROW_SLACK))) {
+        LibRaw::nikon_load_striped_packed_raw();
+        return;
+    }
+    if (!strips) {
+        return;     // Not unpacked, as LibRaw leaves it
+    }
+
+    // Rows past the last strip are left as LibRaw leaves them
+    const unsigned rows_per_strip = ifd->rows_per_strip;
+    const int rows = int(std::min<INT64>(raw_height, INT64(strips) * rows_per_strip));
+    ParallelRows(rows, MIN_ROWS, [&](int first, int last) {
+        std::vector<uint8_t> scratch;
+        for (int row = first; row < last; row++) {
+            const size_t start = size_t(ifd->strip_offsets[row / rows_per_strip] - first_byte) +
+                                 size_t(row % rows_per_strip) * row_bytes;
+            UnpackMsbRow(StreamRow(bytes, start, row_bytes, 4, scratch),
+                         image + size_t(row) * raw_width, raw_width, bits);
+        }
+    });
+}
+
+void FilmLibRaw::Nikon14BitLoadRaw() {
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    ushort* image = imgdata.rawdata.raw_image;
+
+    // Same line length and group bounds as nikon_14bit_load_raw(); the
+    // 3-colour (NEFX) layout stays with LibRaw
+    const unsigned line = unsigned(ceilf(float(raw_width * 7 / 4) / 16.0f)) * 16;
+    const unsigned pitch = imgdata.sizes.raw_pitch ? imgdata.sizes.raw_pitch / 2 : raw_width;
+    const bool bayer = !(imgdata.idata.filters == 0 && imgdata.idata.colors == 3);
+    InputBytes bytes;
+    if (!bayer || !image || pitch < 4 || line < 7 ||
+        !bytes.Open(libraw_internal_data.internal_data.input, libraw_internal_data.unpacker_data.data_offset,
+                    size_t(line) * raw_height, ROW_SLACK)) {
+        LibRaw::nikon_14bit_load_raw();
+        return;
+    }
+
+    const size_t groups = std::min(pitch / 4, line / 7);
+    ParallelRows(int(raw_height), MIN_ROWS, [&](int first, int last) {
+        for (int row = first; row < last; row++) {
+            UnpackLsb14(bytes.Data() + size_t(row) * line, image + size_t(row) * pitch, groups);
+        }
+    });
+}
+
+void FilmLibRaw::AndroidTightLoadRaw() {
+    const unsigned raw_width = imgdata.sizes.raw_width;
+    const unsigned raw_height = imgdata.sizes.raw_height;
+    ushort* image = imgdata.rawdata.raw_image;
+
+    // Widths that are not a multiple of 4 make LibRaw read past the row
+    const size_t row_bytes = size_t(-(-5 * int(raw_width) >> 5) << 3);
+    InputBytes bytes;
+    if (!image || (raw_width & 3) ||
+        !bytes.Open(libraw_internal_data.internal_data.input, libraw_internal_data.unpacker_data.data_offset,
+                    row_bytes * raw_height, ROW_SLACK)) {
+        LibRaw::android_tight_load_raw();
+        return;
+    }
+
+    ParallelRows(int(raw_height), MIN_ROWS, [&](int first, int last) {
+        for (int row = first; row < last; row++) {
+            UnpackMipi10(bytes.Data() + size_t(row) * row_bytes, image + size_t(row) * raw_width, raw_width / 4);
+        }
+    });
+}
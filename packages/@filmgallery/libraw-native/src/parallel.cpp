@@ -0,0 +1,130 @@
+/**
+ * @filmgallery/libraw-native - Parallel Row Loops Implementation
+ */
+
+#include "parallel.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+namespace {
+
+// One ParallelRows() call; lives on the caller's stack until no worker holds it
+struct Group {
+    const parallel_detail::RowJob* job;
+    std::atomic<int> next{0};           // Next unclaimed chunk
+    int active = 0;                     // Workers inside RunChunks(), guarded by the pool mutex
+    std::exception_ptr error;           // First exception, guarded by the pool mutex
+    std::condition_variable idle;
+};
+
+class RowPool {
+public:
+    // Never destroyed: workers are detached and may still be waiting at exit
+    static RowPool& Get() {
+        static RowPool* pool = new RowPool();
+        return *pool;
+    }
+
+    int Threads() const { return workers_ + 1; }
+
+    void Run(const parallel_detail::RowJob& job) {
+        Group group;
+        group.job = &job;
+        if (workers_ > 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(&group);
+        }
+        work_.notify_all();
+
+        RunChunks(group);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+            if (*it == &group) {
+                queue_.erase(it);
+                break;
+            }
+        }
+        // Every chunk was claimed by the caller (done) or by a worker still counted here
+        group.idle.wait(lock, [&] { return group.active == 0; });
+        if (group.error) {
+            std::rethrow_exception(group.error);
+        }
+    }
+
+private:
+    RowPool() {
+        int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int i = 1; i < threads; i++) {
+            try {
+                std::thread(&RowPool::Work, this).detach();
+                workers_++;
+            } catch (const std::system_error&) {
+                break;      // Run with the workers that did start (or inline)
+            }
+        }
+    }
+
+    void RunChunks(Group& group) {
+        const parallel_detail::RowJob& job = *group.job;
+        for (;;) {
+            int i = group.next.fetch_add(1);
+            if (i >= job.chunks) {
+                return;
+            }
+            int first = static_cast<int>(static_cast<long long>(job.rows) * i / job.chunks);
+            int last = static_cast<int>(static_cast<long long>(job.rows) * (i + 1) / job.chunks);
+            try {
+                job.run(job.context, first, last);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!group.error) {
+                    group.error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    void Work() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            work_.wait(lock, [this] { return !queue_.empty(); });
+            Group* group = queue_.front();
+            if (group->next.load() >= group->job->chunks) {
+                queue_.pop_front();
+                continue;
+            }
+            group->active++;
+            lock.unlock();
+            RunChunks(*group);
+            lock.lock();
+            if (--group->active == 0) {
+                group->idle.notify_all();
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable work_;
+    std::deque<Group*> queue_;
+    int workers_ = 0;
+};
+
+} // namespace
+
+int ParallelThreads() {
+    return RowPool::Get().Threads();
+}
+
+namespace parallel_detail {
+
+void Run(const RowJob& job) {
+    RowPool::Get().Run(job);
+}
+
+} // namespace parallel_detail
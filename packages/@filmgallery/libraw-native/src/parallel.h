@@ -0,0 +1,55 @@
+/**
+ * @filmgallery/libraw-native - Parallel Row Loops
+ *
+ * Splits a range of rows across one process-wide pool of worker threads
+ * (created on first use, one fewer than the hardware threads). Called from
+ * inside an AsyncWorker's Execute(): the calling thread claims chunks too, so
+ * concurrent jobs share the pool instead of each starting its own threads,
+ * and a call always completes even when every worker is busy.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+
+/**
+ * Threads a ParallelRows() call can use: the pool's workers plus the caller
+ */
+int ParallelThreads();
+
+namespace parallel_detail {
+
+struct RowJob {
+    void (*run)(void* context, int first, int last);
+    void* context;
+    int rows;
+    int chunks;
+};
+
+// Runs the job's chunks on the caller and the pool; rethrows the first exception
+void Run(const RowJob& job);
+
+} // namespace parallel_detail
+
+/**
+ * Run fn(first, last) over [0, rows) in contiguous chunks of at least
+ * `min_rows` rows. If `fn` throws (e.g. std::bad_alloc), the remaining
+ * chunks still run and the first exception is rethrown on the caller.
+ */
+template <typename Fn>
+void ParallelRows(int rows, int min_rows, Fn fn) {
+    int chunks = std::min(ParallelThreads(), std::max(1, rows / std::max(1, min_rows)));
+    if (chunks <= 1) {
+        fn(0, rows);
+        return;
+    }
+
+    parallel_detail::RowJob job = {
+        [](void* context, int first, int last) { (*static_cast<Fn*>(context))(first, last); },
+        &fn, rows, chunks
+    };
+    parallel_detail::Run(job);
+}
+
+#endif // PARALLEL_H
@@ -0,0 +1,244 @@
+/**
+ * @filmgallery/libraw-native - FilmLab Render Session
+ */
+
+#include "render_session.h"
+#include "parallel.h"
+#include "cpu_dispatch.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if CPU_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace {
+
+CPU_INLINE uint16_t FloatToHalfValue(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x47800000) {
+        // Beyond the half range: infinity (or NaN)
+        return static_cast<uint16_t>(sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00));
+    }
+    if (magnitude < 0x38800000) {
+        // Subnormal half: multiples of 2^-24
+        float abs_value;
+        std::memcpy(&abs_value, &magnitude, sizeof(abs_value));
+        return static_cast<uint16_t>(sign | static_cast<uint32_t>(std::nearbyint(abs_value * 16777216.0f)));
+    }
+    // Rebias the exponent (127 -> 15) and round 23 mantissa bits to 10;
+    // a carry out of the mantissa correctly bumps the exponent
+    uint32_t half = magnitude - 0x38000000;
+    half += 0xfff + ((half >> 13) & 1);
+    return static_cast<uint16_t>(sign | (half >> 13));
+}
+
+CPU_INLINE float HalfToFloatValue(uint16_t value) {
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+
+    if (exponent == 0) {
+        float magnitude = mantissa * (1.0f / 16777216.0f);
+        return sign ? -magnitude : magnitude;
+    }
+    uint32_t bits = exponent == 0x1f
+        ? sign | 0x7f800000 | (mantissa << 13)
+        : sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+CPU_INLINE void HalfToFloatBody(const uint16_t* in, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++) out[i] = HalfToFloatValue(in[i]);
+}
+
+// Round `row` through half precision, storing the halves in `checkpoint`
+// when it is not null
+CPU_INLINE void HalfRoundTripBody(float* row, uint16_t* checkpoint, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint16_t half = FloatToHalfValue(row[i]);
+        if (checkpoint) checkpoint[i] = half;
+        row[i] = HalfToFloatValue(half);
+    }
+}
+
+CPU_INLINE void QuantizeBody(const float* row, uint8_t* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = static_cast<uint8_t>(std::min(1.0f, std::max(0.0f, row[i])) * 255 + 0.5f);
+    }
+}
+
+CPU_DISPATCH_KERNEL(void, HalfToFloatGeneric, HalfToFloatBody,
+                    (const uint16_t* in, float* out, size_t count), (in, out, count))
+CPU_DISPATCH_KERNEL(void, HalfRoundTripGeneric, HalfRoundTripBody,
+                    (float* row, uint16_t* checkpoint, size_t count), (row, checkpoint, count))
+CPU_DISPATCH_KERNEL(void, QuantizeRow, QuantizeBody,
+                    (const float* row, uint8_t* out, size_t count), (row, out, count))
+
+#if CPU_DISPATCH
+
+// F16C converts 8 values per instruction with the same rounding (to nearest
+// even) as FloatToHalf(); NaN payloads may differ, which no stage observes
+CPU_TARGET_AVX2 void HalfToFloatF16C(const uint16_t* in, float* out, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(half));
+    }
+    HalfToFloatBody(in + i, out + i, count - i);
+}
+
+CPU_TARGET_AVX2 void HalfRoundTripF16C(float* row, uint16_t* checkpoint, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(row + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        if (checkpoint) _mm_storeu_si128(reinterpret_cast<__m128i*>(checkpoint + i), half);
+        _mm256_storeu_ps(row + i, _mm256_cvtph_ps(half));
+    }
+    HalfRoundTripBody(row + i, checkpoint ? checkpoint + i : nullptr, count - i);
+}
+
+void (*const HalfToFloatRow)(const uint16_t*, float*, size_t) =
+    ActiveCpuLevel() >= CPU_AVX2 ? HalfToFloatF16C : HalfToFloatGeneric;
+void (*const HalfRoundTripRow)(float*, uint16_t*, size_t) =
+    ActiveCpuLevel() >= CPU_AVX2 ? HalfRoundTripF16C : HalfRoundTripGeneric;
+
+#else
+
+void (*const HalfToFloatRow)(const uint16_t*, float*, size_t) = HalfToFloatGeneric;
+void (*const HalfRoundTripRow)(float*, uint16_t*, size_t) = HalfRoundTripGeneric;
+
+#endif
+
+} // namespace
+
+uint16_t FloatToHalf(float value) {
+    return FloatToHalfValue(value);
+}
+
+float HalfToFloat(uint16_t value) {
+    return HalfToFloatValue(value);
+}
+
+RenderSession::RenderSession()
+    : width_(0), height_(0), source_max_(255), has_stages_(false),
+      memory_limit_(static_cast<size_t>(256) << 20), busy_(false) {
+    std::fill(valid_, valid_ + STAGE_COLOR, false);
+}
+
+bool RenderSession::SetSource(const uint8_t* data, int width, int height, int channels, int bits) {
+    if (width <= 0 || height <= 0 || (channels != 3 && channels != 4) || (bits != 8 && bits != 16)) {
+        return false;
+    }
+
+    const size_t pixels = static_cast<size_t>(width) * height;
+    std::vector<uint16_t> codes(pixels * 3);
+    for (size_t p = 0; p < pixels; p++) {
+        for (int c = 0; c < 3; c++) {
+            size_t i = p * channels + c;
+            codes[p * 3 + c] = bits == 8 ? data[i] : reinterpret_cast<const uint16_t*>(data)[i];
+        }
+    }
+    return SetSource(std::move(codes), width, height, bits);
+}
+
+bool RenderSession::SetSource(std::vector<uint16_t> codes, int width, int height, int bits) {
+    if (width <= 0 || height <= 0 || (bits != 8 && bits != 16) ||
+        codes.size() != static_cast<size_t>(width) * height * 3) {
+        return false;
+    }
+
+    source_ = std::move(codes);
+    width_ = width;
+    height_ = height;
+    source_max_ = (1 << bits) - 1;
+
+    for (int k = 0; k < STAGE_COLOR; k++) {
+        valid_[k] = false;
+        std::vector<uint16_t>().swap(checkpoints_[k]);
+    }
+    has_stages_ = false;
+    return true;
+}
+
+size_t RenderSession::CheckpointBytes() const {
+    size_t total = 0;
+    for (int k = 0; k < STAGE_COLOR; k++) total += checkpoints_[k].size() * sizeof(uint16_t);
+    return total;
+}
+
+int RenderSession::Render(const FilmLabStages& stages, uint8_t* out,
+                          const std::function<bool()>& cancelled) {
+    if (source_.empty() || !stages.Valid()) {
+        return -1;
+    }
+
+    const int changed = has_stages_ ? stages.FirstDifference(stages_) : STAGE_DENSITY;
+    for (int k = changed; k < STAGE_COLOR; k++) valid_[k] = false;
+
+    // Checkpoints that fit under the limit, latest stage first
+    const size_t samples = source_.size();
+    const size_t affordable = memory_limit_ / (samples * sizeof(uint16_t));
+    bool keep[STAGE_COLOR];
+    for (int k = 0; k < STAGE_COLOR; k++) {
+        keep[k] = static_cast<size_t>(STAGE_COLOR - k) <= affordable;
+        if (!keep[k]) {
+            valid_[k] = false;
+            std::vector<uint16_t>().swap(checkpoints_[k]);
+        } else if (checkpoints_[k].size() != samples) {
+            checkpoints_[k].resize(samples);
+        }
+    }
+
+    // Restart in front of the earliest changed stage, or further back to
+    // the nearest checkpoint still held
+    int start = std::min(changed, static_cast<int>(STAGE_COLOR));
+    while (start > STAGE_DENSITY && !valid_[start - 1]) start--;
+
+    const FilmLabKernel kernel(stages);
+    std::atomic<bool> stop(false);
+    ParallelRows(height_, 16, [&](int first, int last) {
+        std::vector<float> row(static_cast<size_t>(width_) * 3);
+        for (int y = first; y < last; y++) {
+            if (cancelled && (stop.load(std::memory_order_relaxed) || cancelled())) {
+                stop.store(true, std::memory_order_relaxed);
+                return;
+            }
+            const size_t offset = static_cast<size_t>(y) * width_ * 3;
+            if (start == STAGE_DENSITY) {
+                kernel.Density(&source_[offset], source_max_, row.data(), width_);
+            } else {
+                HalfToFloatRow(&checkpoints_[start - 1][offset], row.data(), row.size());
+            }
+
+            for (int stage = start; stage < STAGE_COUNT; stage++) {
+                if (stage != STAGE_DENSITY) kernel.Apply(stage, row.data(), width_);
+                if (stage == STAGE_COLOR) break;
+
+                HalfRoundTripRow(row.data(), keep[stage] ? &checkpoints_[stage][offset] : nullptr, row.size());
+            }
+
+            QuantizeRow(row.data(), out + offset, row.size());
+        }
+    });
+
+    if (stop.load()) {
+        // Checkpoints from `start` on are partly rewritten; earlier ones
+        // still match stages_
+        for (int k = start; k < STAGE_COLOR; k++) valid_[k] = false;
+        return RENDER_CANCELLED;
+    }
+
+    for (int k = start; k < STAGE_COLOR; k++) valid_[k] = keep[k];
+    stages_ = stages;
+    has_stages_ = true;
+    return start;
+}
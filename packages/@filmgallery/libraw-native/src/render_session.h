@@ -0,0 +1,89 @@
+/**
+ * @filmgallery/libraw-native - FilmLab Render Session
+ *
+ * Keeps a preview-sized source image and the output of each FilmLab stage
+ * (filmlab_kernel.h) between renders. A render compares the new stage
+ * parameters with the previous ones and restarts from the checkpoint in
+ * front of the earliest changed stage, so dragging a late slider (HSL, split
+ * tone, curves) skips film curve, inversion, LUTs and tone entirely.
+ *
+ * Checkpoints hold RGB half floats (6 bytes per pixel). Every render rounds
+ * through half precision at the stage boundaries, whether or not it keeps the
+ * checkpoint, so incremental and full renders give identical output. When the
+ * memory limit does not cover all three checkpoints the latest stages are
+ * kept first.
+ */
+
+#ifndef RENDER_SESSION_H
+#define RENDER_SESSION_H
+
+#include "filmlab_kernel.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * IEEE 754 binary16 conversions (round to nearest even)
+ */
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+
+const int RENDER_CANCELLED = -2;
+
+class RenderSession {
+public:
+    RenderSession();
+
+    /**
+     * Replace the source with interleaved 8/16-bit RGB(A) pixels (alpha is
+     * dropped) and discard every checkpoint
+     * @returns false for unsupported channels/bits or sizes
+     */
+    bool SetSource(const uint8_t* data, int width, int height, int channels, int bits);
+
+    /**
+     * Same, taking RGB code values (0 .. 2^bits - 1) already unpacked
+     */
+    bool SetSource(std::vector<uint16_t> codes, int width, int height, int bits);
+
+    /**
+     * Upper bound for checkpoint memory in bytes (default 256 MB)
+     */
+    void SetMemoryLimit(size_t bytes) { memory_limit_ = bytes; }
+
+    /**
+     * Render into `out` (width * height * 3 bytes, RGB 8-bit). `cancelled`
+     * is polled between rows; a cancelled render leaves `out` incomplete and
+     * drops the checkpoints it was rewriting.
+     * @returns the first stage recomputed (STAGE_COUNT never: the colour
+     *          stage always runs), -1 without a source or valid stages, or
+     *          RENDER_CANCELLED
+     */
+    int Render(const FilmLabStages& stages, uint8_t* out,
+               const std::function<bool()>& cancelled = nullptr);
+
+    int Width() const { return width_; }
+    int Height() const { return height_; }
+    bool HasSource() const { return !source_.empty(); }
+    size_t CheckpointBytes() const;
+    bool CheckpointValid(int stage) const { return stage >= 0 && stage < STAGE_COLOR && valid_[stage]; }
+
+    // Set while a worker renders; the binding refuses changes meanwhile
+    bool Busy() const { return busy_; }
+    void SetBusy(bool busy) { busy_ = busy; }
+
+private:
+    int width_;
+    int height_;
+    int source_max_;
+    std::vector<uint16_t> source_;                  // RGB code values
+    std::vector<uint16_t> checkpoints_[STAGE_COLOR];  // Half RGB after each stage
+    bool valid_[STAGE_COLOR];
+    FilmLabStages stages_;
+    bool has_stages_;
+    size_t memory_limit_;
+    bool busy_;
+};
+
+#endif // RENDER_SESSION_H
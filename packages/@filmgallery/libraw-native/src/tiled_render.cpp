@@ -0,0 +1,495 @@
+/**
+ * @filmgallery/libraw-native - Tiled FilmLab Render
+ */
+
+#include "tiled_render.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+// Rows rendered per pass: one JPEG MCU row, and the TIFF16 scratch size
+const int RENDER_CHUNK_ROWS = 16;
+
+// Largest source or tile side; keeps row and tile arithmetic within int
+const int MAX_SIDE = 1 << 20;
+
+// Source rectangle being rendered
+struct Region {
+    int left;
+    int top;
+    int width;
+    int height;
+};
+
+// ============================================================================
+// Tiled TIFF source
+// ============================================================================
+
+bool HostIsLittleEndian() {
+    const uint16_t probe = 1;
+    uint8_t first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+class TiffSource {
+public:
+    bool Open(const std::string& path, std::string& error);
+
+    /**
+     * RGB code values of columns [left, left + width) of rows
+     * [first, first + rows), width * 3 per row
+     */
+    void ReadRows(int left, int width, int first, int rows, uint16_t* codes) const;
+
+    int Width() const { return width_; }
+    int Height() const { return height_; }
+    int Bits() const { return bits_; }
+
+private:
+    uint64_t Read(uint64_t pos, int bytes) const;
+    bool ReadValues(uint64_t entry, std::vector<uint64_t>& values) const;
+    void UnpackPixels(const uint8_t* src, int pixels, uint16_t* out) const;
+
+    MappedFile file_;
+    bool little_ = true;
+    bool swap_ = false;
+    bool big_ = false;
+    int width_ = 0;
+    int height_ = 0;
+    int samples_ = 0;
+    int bits_ = 0;
+    int tile_width_ = 0;
+    int tile_height_ = 0;
+    int tiles_across_ = 0;
+    size_t pixel_bytes_ = 0;
+    std::vector<uint64_t> offsets_;
+};
+
+uint64_t TiffSource::Read(uint64_t pos, int bytes) const {
+    const uint8_t* p = file_.Data() + pos;
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= static_cast<uint64_t>(p[little_ ? i : bytes - 1 - i]) << (8 * i);
+    }
+    return value;
+}
+
+// SHORT, LONG or LONG8 values of the IFD entry at `entry`
+bool TiffSource::ReadValues(uint64_t entry, std::vector<uint64_t>& values) const {
+    const int type = static_cast<int>(Read(entry + 2, 2));
+    const int size = type == 3 ? 2 : type == 4 ? 4 : type == 16 ? 8 : 0;
+    const uint64_t count = big_ ? Read(entry + 4, 8) : Read(entry + 4, 4);
+    const uint64_t inline_size = big_ ? 8 : 4;
+    if (!size || count == 0 || count > file_.Size() / size) {
+        return false;
+    }
+    uint64_t pos = big_ ? entry + 12 : entry + 8;
+    if (count * size > inline_size) {
+        pos = Read(pos, static_cast<int>(inline_size));
+        if (pos > file_.Size() || count * size > file_.Size() - pos) return false;
+    }
+    values.resize(static_cast<size_t>(count));
+    for (uint64_t i = 0; i < count; i++) {
+        values[static_cast<size_t>(i)] = Read(pos + i * size, size);
+    }
+    return true;
+}
+
+bool TiffSource::Open(const std::string& path, std::string& error) {
+    if (!file_.Open(path)) {
+        error = "Cannot map " + path;
+        return false;
+    }
+    const uint8_t* data = file_.Data();
+    const size_t size = file_.Size();
+    if (size < 16 || !((data[0] == 'I' && data[1] == 'I') || (data[0] == 'M' && data[1] == 'M'))) {
+        error = "Not a TIFF file";
+        return false;
+    }
+    little_ = data[0] == 'I';
+    swap_ = little_ != HostIsLittleEndian();
+    const int version = static_cast<int>(Read(2, 2));
+    big_ = version == 43;
+    if (version != 42 && !(big_ && Read(4, 2) == 8)) {
+        error = "Not a TIFF file";
+        return false;
+    }
+
+    const uint64_t ifd = big_ ? Read(8, 8) : Read(4, 4);
+    const int entry_size = big_ ? 20 : 12;
+    if (ifd > size - (big_ ? 8 : 2)) {
+        error = "Truncated TIFF";
+        return false;
+    }
+    const uint64_t count = big_ ? Read(ifd, 8) : Read(ifd, 2);
+    const uint64_t first_entry = ifd + (big_ ? 8 : 2);
+    if (count > (size - first_entry) / entry_size) {
+        error = "Truncated TIFF";
+        return false;
+    }
+
+    std::vector<uint64_t> bits, offsets, values;
+    int compression = 1, photometric = -1, planar = 1, rows_per_strip = 0;
+    bool tiled = false, strips = false, sample_format_ok = true;
+    for (uint64_t i = 0; i < count; i++) {
+        const uint64_t entry = first_entry + i * entry_size;
+        const int tag = static_cast<int>(Read(entry, 2));
+        std::vector<uint64_t>& target = tag == 258 ? bits : (tag == 273 || tag == 324) ? offsets : values;
+        switch (tag) {
+            case 256: case 257: case 258: case 259: case 262: case 273: case 277:
+            case 278: case 284: case 322: case 323: case 324: case 339:
+                break;
+            default:
+                continue;
+        }
+        if (!ReadValues(entry, target)) {
+            error = "Malformed TIFF tag " + std::to_string(tag);
+            return false;
+        }
+        const uint64_t value = target[0];
+        const int clamped = static_cast<int>(std::min<uint64_t>(value, 0x7fffffff));
+        switch (tag) {
+            case 256: width_ = clamped; break;
+            case 257: height_ = clamped; break;
+            case 259: compression = clamped; break;
+            case 262: photometric = clamped; break;
+            case 273: strips = true; break;
+            case 277: samples_ = clamped; break;
+            case 278: rows_per_strip = clamped; break;
+            case 284: planar = clamped; break;
+            case 322: tile_width_ = clamped; break;
+            case 323: tile_height_ = clamped; break;
+            case 324: tiled = true; break;
+            case 339:
+                for (uint64_t format : values) sample_format_ok = sample_format_ok && format == 1;
+                break;
+        }
+    }
+
+    if (width_ <= 0 || height_ <= 0 || samples_ < 1 || samples_ > 4 || bits.empty()) {
+        error = "TIFF is missing its size or samples";
+        return false;
+    }
+    if (width_ > MAX_SIDE || height_ > MAX_SIDE || tile_width_ > MAX_SIDE || tile_height_ > MAX_SIDE) {
+        error = "TIFF is larger than " + std::to_string(MAX_SIDE) + " pixels on a side";
+        return false;
+    }
+    bits_ = static_cast<int>(bits[0]);
+    bool uniform = bits.size() == 1 || bits.size() == static_cast<size_t>(samples_);
+    for (uint64_t value : bits) uniform = uniform && value == bits[0];
+    if (compression != 1 || planar != 1 || !sample_format_ok || !uniform || (bits_ != 8 && bits_ != 16) ||
+        !(samples_ >= 3 ? photometric == 2 : photometric == 1)) {
+        error = "Expected an uncompressed, chunky 8/16-bit unsigned gray or RGB TIFF";
+        return false;
+    }
+
+    if (tiled) {
+        if (tile_width_ <= 0 || tile_height_ <= 0) {
+            error = "TIFF is missing its tile size";
+            return false;
+        }
+    } else if (strips) {
+        tile_width_ = width_;
+        tile_height_ = rows_per_strip > 0 ? std::min(rows_per_strip, height_) : height_;
+    } else {
+        error = "TIFF has no strips or tiles";
+        return false;
+    }
+    tiles_across_ = (width_ + tile_width_ - 1) / tile_width_;
+    const int tiles_down = (height_ + tile_height_ - 1) / tile_height_;
+    pixel_bytes_ = static_cast<size_t>(samples_) * (bits_ / 8);
+    if (offsets.size() != static_cast<size_t>(tiles_across_) * tiles_down) {
+        error = "TIFF strip or tile count does not match its size";
+        return false;
+    }
+
+    // Tiles are stored whole; the last strip only holds the rows left
+    for (size_t i = 0; i < offsets.size(); i++) {
+        const int row = static_cast<int>(i / tiles_across_) * tile_height_;
+        const int rows = tiled ? tile_height_ : std::min(tile_height_, height_ - row);
+        const uint64_t bytes = static_cast<uint64_t>(tile_width_) * rows * pixel_bytes_;
+        if (offsets[i] > size || bytes > size - offsets[i]) {
+            error = "Truncated TIFF";
+            return false;
+        }
+    }
+    offsets_ = std::move(offsets);
+    return true;
+}
+
+void TiffSource::UnpackPixels(const uint8_t* src, int pixels, uint16_t* out) const {
+    const size_t green = samples_ >= 3 ? 1 : 0;
+    const size_t blue = samples_ >= 3 ? 2 : 0;
+    if (bits_ == 8) {
+        for (int p = 0; p < pixels; p++, src += pixel_bytes_, out += 3) {
+            out[0] = src[0];
+            out[1] = src[green];
+            out[2] = src[blue];
+        }
+        return;
+    }
+    const size_t channels[3] = { 0, green * 2, blue * 2 };
+    for (int p = 0; p < pixels; p++, src += pixel_bytes_, out += 3) {
+        for (int c = 0; c < 3; c++) {
+            uint16_t value;
+            std::memcpy(&value, src + channels[c], 2);
+            out[c] = swap_ ? static_cast<uint16_t>((value >> 8) | (value << 8)) : value;
+        }
+    }
+}
+
+void TiffSource::ReadRows(int left, int width, int first, int rows, uint16_t* codes) const {
+    const int last = first + rows;
+    const int first_tile = left / tile_width_;
+    const int last_tile = (left + width - 1) / tile_width_;
+    for (int y = first; y < last; y++) {
+        const int tile_row = y / tile_height_;
+        const size_t row_offset = static_cast<size_t>(y - tile_row * tile_height_) * tile_width_ * pixel_bytes_;
+        uint16_t* out = codes + static_cast<size_t>(y - first) * width * 3;
+        for (int tx = first_tile; tx <= last_tile; tx++) {
+            const int x = std::max(left, tx * tile_width_);
+            const int end = std::min(left + width, (tx + 1) * tile_width_);
+            const uint8_t* src = file_.Data() + offsets_[static_cast<size_t>(tile_row) * tiles_across_ + tx] +
+                                 row_offset + static_cast<size_t>(x - tx * tile_width_) * pixel_bytes_;
+            UnpackPixels(src, end - x, out + static_cast<size_t>(x - left) * 3);
+        }
+    }
+
+    // Tile rows finished by this read are not needed again
+    const size_t tile_bytes = static_cast<size_t>(tile_width_) * tile_height_ * pixel_bytes_;
+    for (int tile_row = first / tile_height_; tile_row <= (last - 1) / tile_height_; tile_row++) {
+        if (std::min((tile_row + 1) * tile_height_, height_) > last) break;
+        for (int tx = first_tile; tx <= last_tile; tx++) {
+            file_.Release(offsets_[static_cast<size_t>(tile_row) * tiles_across_ + tx], tile_bytes);
+        }
+    }
+}
+
+// ============================================================================
+// Rendering
+// ============================================================================
+
+// Float RGB of output rows [first, first + rows) after every stage
+void RenderRows(const TiffSource& source, const FilmLabKernel& kernel, const Region& region, int first, int rows,
+                std::vector<uint16_t>& codes, std::vector<float>& rgb) {
+    const size_t samples = static_cast<size_t>(region.width) * rows * 3;
+    codes.resize(samples);
+    rgb.resize(samples);
+    const int pixels = region.width * rows;
+    source.ReadRows(region.left, region.width, region.top + first, rows, codes.data());
+    kernel.Density(codes.data(), (1 << source.Bits()) - 1, rgb.data(), pixels);
+    for (int stage = STAGE_TONE; stage < STAGE_COUNT; stage++) {
+        kernel.Apply(stage, rgb.data(), pixels);
+    }
+}
+
+inline float Clamp01(float value) {
+    return std::min(1.0f, std::max(0.0f, value));
+}
+
+bool RenderJpeg(const TiffSource& source, const FilmLabKernel& kernel, const Region& region,
+                const TiledRenderOptions& options, TiledRenderResult& result, std::string& error) {
+    if (region.width > 65535 || region.height > 65535) {
+        error = "JPEG output is limited to 65535 pixels on a side";
+        return false;
+    }
+    const int width = region.width;
+    auto rows_source = [&](uint8_t* dst, size_t stride, int first_row, int rows) {
+        std::vector<uint16_t> codes;
+        std::vector<float> rgb;
+        RenderRows(source, kernel, region, first_row, rows, codes, rgb);
+        for (int r = 0; r < rows; r++) {
+            const float* src = rgb.data() + static_cast<size_t>(r) * width * 3;
+            uint8_t* out = dst + r * stride;
+            for (int i = 0; i < width * 3; i++) {
+                out[i] = static_cast<uint8_t>(Clamp01(src[i]) * 255 + 0.5f);
+            }
+        }
+        return true;
+    };
+    if (!EncodeJpeg(width, region.height, 3, rows_source, options.jpeg, result.jpeg)) {
+        error = "JPEG encoding failed";
+        return false;
+    }
+    return true;
+}
+
+// Little-endian TIFF header and IFD for `strips` uncompressed 16-bit RGB
+// strips; BigTIFF when the file would reach 4 GB
+std::vector<uint8_t> BuildTiff16Header(int width, int height, int strip_rows, const std::vector<uint8_t>& icc,
+                                       std::vector<uint64_t>& strip_offsets) {
+    const size_t stride = static_cast<size_t>(width) * 6;
+    const int strips = (height + strip_rows - 1) / strip_rows;
+    std::vector<uint64_t> strip_bytes(strips);
+    for (int i = 0; i < strips; i++) {
+        strip_bytes[i] = static_cast<uint64_t>(std::min(strip_rows, height - i * strip_rows)) * stride;
+    }
+    const uint64_t data_size = static_cast<uint64_t>(height) * stride;
+    const bool big = data_size + 65536 + icc.size() + static_cast<uint64_t>(strips) * 16 > 0xffffffffull;
+
+    struct Entry {
+        uint16_t tag;
+        uint16_t type;
+        std::vector<uint64_t> values;
+    };
+    const uint16_t offset_type = big ? 16 : 4;
+    std::vector<Entry> entries = {
+        { 256, 4, { static_cast<uint64_t>(width) } },
+        { 257, 4, { static_cast<uint64_t>(height) } },
+        { 258, 3, { 16, 16, 16 } },
+        { 259, 3, { 1 } },
+        { 262, 3, { 2 } },
+        { 273, offset_type, std::vector<uint64_t>(strips) },    // Filled below
+        { 277, 3, { 3 } },
+        { 278, 4, { static_cast<uint64_t>(strip_rows) } },
+        { 279, offset_type, strip_bytes },
+        { 284, 3, { 1 } }
+    };
+    if (!icc.empty()) {
+        entries.push_back({ 34675, 7, std::vector<uint64_t>(icc.begin(), icc.end()) });
+    }
+    auto type_size = [](uint16_t type) { return type == 7 ? 1 : type == 3 ? 2 : type == 4 ? 4 : 8; };
+
+    // IFD, then out-of-line values at 8-byte boundaries, then the pixels
+    const size_t header_size = big ? 16 : 8;
+    const size_t inline_size = big ? 8 : 4;
+    const size_t entry_size = big ? 20 : 12;
+    const size_t ifd_size = (big ? 8 : 2) + entries.size() * entry_size + inline_size;
+    std::vector<size_t> value_offsets;
+    size_t extra = 0;
+    for (const Entry& entry : entries) {
+        const size_t bytes = type_size(entry.type) * entry.values.size();
+        value_offsets.push_back(bytes > inline_size ? header_size + ifd_size + extra : 0);
+        if (bytes > inline_size) extra += (bytes + 7) & ~static_cast<size_t>(7);
+    }
+    const uint64_t pixel_start = header_size + ifd_size + extra;
+    strip_offsets.resize(strips);
+    for (int i = 0; i < strips; i++) {
+        strip_offsets[i] = pixel_start + static_cast<uint64_t>(i) * strip_rows * stride;
+    }
+    entries[5].values = strip_offsets;
+
+    std::vector<uint8_t> header(static_cast<size_t>(pixel_start), 0);
+    auto put = [&header](size_t pos, uint64_t value, size_t bytes) {
+        for (size_t i = 0; i < bytes; i++) header[pos + i] = static_cast<uint8_t>(value >> (8 * i));
+    };
+    header[0] = 'I';
+    header[1] = 'I';
+    if (big) {
+        put(2, 43, 2);
+        put(4, 8, 2);
+        put(8, header_size, 8);
+        put(header_size, entries.size(), 8);
+    } else {
+        put(2, 42, 2);
+        put(4, header_size, 4);
+        put(header_size, entries.size(), 2);
+    }
+    size_t pos = header_size + (big ? 8 : 2);
+    for (size_t i = 0; i < entries.size(); i++, pos += entry_size) {
+        const Entry& entry = entries[i];
+        const size_t size = type_size(entry.type);
+        put(pos, entry.tag, 2);
+        put(pos + 2, entry.type, 2);
+        put(pos + 4, entry.values.size(), big ? 8 : 4);
+        size_t target = pos + (big ? 12 : 8);
+        if (value_offsets[i]) {
+            put(target, value_offsets[i], inline_size);
+            target = value_offsets[i];
+        }
+        for (size_t j = 0; j < entry.values.size(); j++) put(target + j * size, entry.values[j], size);
+    }
+    put(pos, 0, inline_size);     // No next IFD
+    return header;
+}
+
+bool RenderTiff16(const TiffSource& source, const FilmLabKernel& kernel, const Region& region,
+                  const TiledRenderOptions& options, std::string& error) {
+    const int width = region.width;
+    const int height = region.height;
+    const int strip_rows = std::max(1, std::min(options.strip_rows, height));
+    const size_t stride = static_cast<size_t>(width) * 6;
+
+    std::vector<uint64_t> strip_offsets;
+    const std::vector<uint8_t> header = BuildTiff16Header(width, height, strip_rows, options.jpeg.icc, strip_offsets);
+    FILE* file = std::fopen(options.output_path.c_str(), "wb");
+    if (!file) {
+        error = "Cannot create " + options.output_path;
+        return false;
+    }
+    bool ok = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+
+    // One strip per thread per round, written in order once the round is done
+    const int strips = static_cast<int>(strip_offsets.size());
+    const int round_strips = ParallelThreads();
+    std::vector<uint8_t> round(static_cast<size_t>(std::min(round_strips, strips)) * strip_rows * stride);
+    for (int first_strip = 0; ok && first_strip < strips; first_strip += round_strips) {
+        const int count = std::min(round_strips, strips - first_strip);
+        ParallelRows(count, 1, [&](int first, int last) {
+            std::vector<uint16_t> codes;
+            std::vector<float> rgb;
+            for (int strip = first; strip < last; strip++) {
+                const int top = (first_strip + strip) * strip_rows;
+                const int bottom = std::min(top + strip_rows, height);
+                uint8_t* out = round.data() + static_cast<size_t>(strip) * strip_rows * stride;
+                for (int y = top; y < bottom; y += RENDER_CHUNK_ROWS) {
+                    const int rows = std::min(RENDER_CHUNK_ROWS, bottom - y);
+                    RenderRows(source, kernel, region, y, rows, codes, rgb);
+                    for (size_t i = 0; i < rgb.size(); i++, out += 2) {
+                        const uint16_t value = static_cast<uint16_t>(Clamp01(rgb[i]) * 65535 + 0.5f);
+                        out[0] = static_cast<uint8_t>(value);
+                        out[1] = static_cast<uint8_t>(value >> 8);
+                    }
+                }
+            }
+        });
+        const int round_top = first_strip * strip_rows;
+        const size_t bytes = static_cast<size_t>(std::min(round_top + count * strip_rows, height) - round_top) * stride;
+        ok = std::fwrite(round.data(), 1, bytes, file) == bytes;
+    }
+
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        error = "Cannot write " + options.output_path;
+        std::remove(options.output_path.c_str());
+    }
+    return ok;
+}
+
+} // namespace
+
+bool RenderTiled(const std::string& input_path, const FilmLabStages& stages,
+                 const TiledRenderOptions& options, TiledRenderResult& result, std::string& error) {
+    TiffSource source;
+    if (!source.Open(input_path, error)) {
+        return false;
+    }
+    Region region = { options.left, options.top, options.width, options.height };
+    if (region.width == 0) {
+        region = { 0, 0, source.Width(), source.Height() };
+    }
+    if (region.left < 0 || region.top < 0 || region.width <= 0 || region.height <= 0 ||
+        region.width > source.Width() - region.left || region.height > source.Height() - region.top) {
+        error = "Region is outside the " + std::to_string(source.Width()) + "x" +
+                std::to_string(source.Height()) + " source";
+        return false;
+    }
+    result.width = region.width;
+    result.height = region.height;
+    result.bits = source.Bits();
+
+    const FilmLabKernel kernel(stages);
+    if (options.format == TILED_RENDER_TIFF16) {
+        if (options.output_path.empty()) {
+            error = "TIFF16 output needs an output path";
+            return false;
+        }
+        return RenderTiff16(source, kernel, region, options, error);
+    }
+    return RenderJpeg(source, kernel, region, options, result, error);
+}
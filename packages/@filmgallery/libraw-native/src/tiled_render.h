@@ -0,0 +1,67 @@
+/**
+ * @filmgallery/libraw-native - Tiled FilmLab Render
+ *
+ * Full-resolution export renders with memory bounded by band size instead of
+ * image size. The source is an uncompressed tiled (or stripped) TIFF cache,
+ * typically the geometry-transformed scan as sharp writes it, which is mapped
+ * rather than read. Bands of rows are pulled from the mapped tiles, run
+ * through the float FilmLab kernel (filmlab_kernel.h) and handed straight to
+ * the output:
+ *
+ *   JPEG    the encoder's row source (jpeg_encoder.h), so each encoder band
+ *           renders its own MCU rows on its own thread
+ *   TIFF16  an uncompressed 16-bit RGB TIFF written strip by strip, one
+ *           round of strips per thread count in flight
+ *
+ * Neither the full source, the rendered float image nor the full output
+ * pixels are ever held. Tile rows of the mapping are released once read, so
+ * the resident cache stays near the rows being rendered.
+ */
+
+#ifndef TILED_RENDER_H
+#define TILED_RENDER_H
+
+#include "filmlab_kernel.h"
+#include "jpeg_encoder.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum TiledRenderFormat {
+    TILED_RENDER_JPEG = 0,
+    TILED_RENDER_TIFF16 = 1
+};
+
+struct TiledRenderOptions {
+    TiledRenderFormat format = TILED_RENDER_JPEG;
+    JpegOptions jpeg;                   // Quality and subsampling; icc is embedded in either format
+    std::string output_path;            // TIFF16 output file (required)
+    int strip_rows = 64;                // TIFF16 rows per strip
+
+    // Source rectangle to render (crop); width 0 renders the whole image
+    int left = 0;
+    int top = 0;
+    int width = 0;
+    int height = 0;
+};
+
+struct TiledRenderResult {
+    int width = 0;                      // Output size
+    int height = 0;
+    int bits = 0;                       // Source bits per sample (8 or 16)
+    std::vector<uint8_t> jpeg;          // JPEG output
+};
+
+/**
+ * Render `stages` over the TIFF at `input_path`: 8- or 16-bit unsigned,
+ * uncompressed, chunky gray, gray + alpha, RGB or RGBA (alpha dropped),
+ * strips or tiles, classic or BigTIFF, either byte order
+ * @returns false with `error` set for an unreadable or unsupported source, a
+ *          region outside it, a JPEG over 65535 pixels on a side, or a
+ *          failed write
+ */
+bool RenderTiled(const std::string& input_path, const FilmLabStages& stages,
+                 const TiledRenderOptions& options, TiledRenderResult& result, std::string& error);
+
+#endif // TILED_RENDER_H
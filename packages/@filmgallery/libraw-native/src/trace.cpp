@@ -0,0 +1,268 @@
+/**
+ * @filmgallery/libraw-native - Trace Recorder Implementation
+ *
+ * Spans are written into a mutex-guarded ring buffer. Recording only happens
+ * while tracing is enabled, so the lock is never touched in normal operation.
+ */
+
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> g_trace_enabled(false);
+
+namespace {
+
+struct TraceEvent {
+    char name[48];
+    char category[16];
+    uint64_t start_us;
+    uint64_t duration_us;
+    uint64_t job_id;
+    uint32_t thread_id;
+    bool async;
+};
+
+struct StageState {
+    enum LibRaw_progress stage;
+    const char* name;
+    uint64_t start_us;
+    bool open;
+};
+
+const std::chrono::steady_clock::time_point g_trace_epoch = std::chrono::steady_clock::now();
+
+std::mutex g_trace_mutex;
+std::vector<TraceEvent> g_trace_events;
+size_t g_trace_next = 0;      // Next slot to write
+size_t g_trace_count = 0;     // Number of valid slots
+uint32_t g_trace_main_thread = 0;
+
+std::atomic<uint32_t> g_trace_thread_counter(0);
+thread_local uint32_t t_trace_thread_id = 0;
+thread_local uint64_t t_trace_job_id = 0;
+thread_local StageState t_trace_stage = { LIBRAW_PROGRESS_START, nullptr, 0, false };
+
+uint32_t CurrentThreadId() {
+    if (t_trace_thread_id == 0) {
+        t_trace_thread_id = ++g_trace_thread_counter;
+    }
+    return t_trace_thread_id;
+}
+
+void CopyField(char* dst, size_t dst_size, const char* src) {
+    if (!src) src = "";
+    size_t n = strlen(src);
+    if (n >= dst_size) n = dst_size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+void AppendEscaped(std::string& out, const char* s) {
+    for (; *s; ++s) {
+        unsigned char c = static_cast<unsigned char>(*s);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+}
+
+void CloseStage(uint64_t now) {
+    if (t_trace_stage.open) {
+        TraceRecord(t_trace_stage.name, "libraw", t_trace_stage.start_us, now, t_trace_job_id);
+        t_trace_stage.open = false;
+    }
+}
+
+} // namespace
+
+// ============================================================================
+// Control
+// ============================================================================
+
+void TraceEnable(size_t capacity) {
+    capacity = std::min(std::max<size_t>(capacity, 1), TRACE_MAX_CAPACITY);
+
+    std::lock_guard<std::mutex> lock(g_trace_mutex);
+    g_trace_events.assign(capacity, TraceEvent());
+    g_trace_next = 0;
+    g_trace_count = 0;
+    g_trace_main_thread = CurrentThreadId();
+    g_trace_enabled.store(true, std::memory_order_relaxed);
+}
+
+void TraceDisable() {
+    // Recorded spans are kept so they can still be dumped
+    g_trace_enabled.store(false, std::memory_order_relaxed);
+}
+
+uint64_t TraceNow() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - g_trace_epoch).count());
+}
+
+uint64_t TraceSetThreadJob(uint64_t job_id) {
+    uint64_t previous = t_trace_job_id;
+    t_trace_job_id = job_id;
+    return previous;
+}
+
+// ============================================================================
+// Recording
+// ============================================================================
+
+static void RecordEvent(const char* name, const char* category,
+                        uint64_t start_us, uint64_t end_us, uint64_t job_id, bool async) {
+    TraceEvent event;
+    CopyField(event.name, sizeof(event.name), name);
+    CopyField(event.category, sizeof(event.category), category);
+    event.start_us = start_us;
+    event.duration_us = end_us > start_us ? end_us - start_us : 0;
+    event.job_id = job_id;
+    event.thread_id = CurrentThreadId();
+    event.async = async;
+
+    std::lock_guard<std::mutex> lock(g_trace_mutex);
+    if (g_trace_events.empty()) return;
+    g_trace_events[g_trace_next] = event;
+    g_trace_next = (g_trace_next + 1) % g_trace_events.size();
+    if (g_trace_count < g_trace_events.size()) g_trace_count++;
+}
+
+void TraceRecord(const char* name, const char* category,
+                 uint64_t start_us, uint64_t end_us, uint64_t job_id) {
+    if (!TraceIsEnabled()) return;
+    RecordEvent(name, category, start_us, end_us, job_id, false);
+}
+
+void TraceRecordAsync(const char* name, const char* category,
+                      uint64_t start_us, uint64_t end_us, uint64_t job_id) {
+    if (!TraceIsEnabled()) return;
+    RecordEvent(name, category, start_us, end_us, job_id, true);
+}
+
+void TraceEndStage() {
+    if (t_trace_stage.open) {
+        CloseStage(TraceNow());
+    }
+}
+
+int TraceProgressCallback(void* /*data*/, enum LibRaw_progress stage, int iteration, int expected) {
+    if (!TraceIsEnabled()) return 0;
+
+    uint64_t now = TraceNow();
+
+    // Stages report (0, n) on entry and (n-1, n) on exit; demosaic loops also
+    // report intermediate iterations, which are folded into one span.
+    if (iteration == 0 && !(t_trace_stage.open && t_trace_stage.stage == stage)) {
+        CloseStage(now);
+        t_trace_stage.stage = stage;
+        t_trace_stage.name = LibRaw::strprogress(stage);
+        t_trace_stage.start_us = now;
+        t_trace_stage.open = true;
+    } else if (iteration >= expected - 1 && t_trace_stage.open && t_trace_stage.stage == stage) {
+        CloseStage(now);
+    }
+
+    return 0;
+}
+
+// ============================================================================
+// Export
+// ============================================================================
+
+std::string TraceDumpJson(uint64_t since_us, uint64_t until_us, uint64_t job_id) {
+    std::vector<TraceEvent> events;
+    uint32_t main_thread;
+    {
+        std::lock_guard<std::mutex> lock(g_trace_mutex);
+        size_t size = g_trace_events.size();
+        size_t first = (g_trace_next + size - g_trace_count) % (size ? size : 1);
+        events.reserve(g_trace_count);
+        for (size_t i = 0; i < g_trace_count; i++) {
+            events.push_back(g_trace_events[(first + i) % size]);
+        }
+        main_thread = g_trace_main_thread;
+    }
+
+    std::vector<uint32_t> threads;
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first_event = true;
+    unsigned long long async_id = 0;
+    char buf[192];
+
+    for (const TraceEvent& e : events) {
+        uint64_t end_us = e.start_us + e.duration_us;
+        if (end_us < since_us) continue;
+        if (until_us && e.start_us > until_us) continue;
+        if (job_id && e.job_id != job_id) continue;
+
+        if (!first_event) out += ',';
+        first_event = false;
+
+        if (e.async) {
+            // Async begin/end pair with a per-dump id
+            unsigned long long id = ++async_id;
+            for (int phase = 0; phase < 2; phase++) {
+                if (phase) out += ',';
+                out += "{\"name\":\"";
+                AppendEscaped(out, e.name);
+                out += "\",\"cat\":\"";
+                AppendEscaped(out, e.category);
+                snprintf(buf, sizeof(buf),
+                         "\",\"ph\":\"%c\",\"id\":%llu,\"pid\":1,\"tid\":%u,\"ts\":%llu,\"args\":{\"job\":%llu}}",
+                         phase ? 'e' : 'b', id, e.thread_id,
+                         static_cast<unsigned long long>(phase ? end_us : e.start_us),
+                         static_cast<unsigned long long>(e.job_id));
+                out += buf;
+            }
+            continue;
+        }
+
+        out += "{\"name\":\"";
+        AppendEscaped(out, e.name);
+        out += "\",\"cat\":\"";
+        AppendEscaped(out, e.category);
+        snprintf(buf, sizeof(buf),
+                 "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%llu,\"args\":{\"job\":%llu}}",
+                 e.thread_id,
+                 static_cast<unsigned long long>(e.start_us),
+                 static_cast<unsigned long long>(e.duration_us),
+                 static_cast<unsigned long long>(e.job_id));
+        out += buf;
+
+        bool known = false;
+        for (uint32_t t : threads) {
+            if (t == e.thread_id) { known = true; break; }
+        }
+        if (!known) threads.push_back(e.thread_id);
+    }
+
+    // Thread name metadata so lanes read "main" / "worker N" in the viewer
+    for (uint32_t t : threads) {
+        if (!first_event) out += ',';
+        first_event = false;
+        if (t == main_thread) {
+            snprintf(buf, sizeof(buf),
+                     "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"main\"}}", t);
+        } else {
+            snprintf(buf, sizeof(buf),
+                     "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"worker %u\"}}", t, t);
+        }
+        out += buf;
+    }
+
+    out += "]}";
+    return out;
+}
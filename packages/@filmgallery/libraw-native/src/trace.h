@@ -0,0 +1,110 @@
+/**
+ * @filmgallery/libraw-native - Trace Recorder
+ *
+ * Opt-in span recorder for the native pipelines. Spans are kept in a fixed
+ * ring buffer and exported as Chrome trace-event JSON (chrome://tracing,
+ * Perfetto). When tracing is disabled every entry point is a single relaxed
+ * atomic load.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "libraw/libraw.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+extern std::atomic<bool> g_trace_enabled;
+
+inline bool TraceIsEnabled() {
+    return g_trace_enabled.load(std::memory_order_relaxed);
+}
+
+// Largest ring buffer TraceEnable() allocates (about 27 MB of spans)
+const size_t TRACE_MAX_CAPACITY = 262144;
+
+/**
+ * Start recording into a ring buffer of `capacity` spans (older spans are
+ * overwritten), clamped to 1..TRACE_MAX_CAPACITY. Re-enabling clears the buffer.
+ */
+void TraceEnable(size_t capacity);
+void TraceDisable();
+
+/**
+ * Monotonic timestamp in microseconds since the trace clock epoch
+ */
+uint64_t TraceNow();
+
+/**
+ * Record a complete span. `name` and `category` are copied.
+ */
+void TraceRecord(const char* name, const char* category,
+                 uint64_t start_us, uint64_t end_us, uint64_t job_id);
+
+/**
+ * Record a span that is not bound to the calling thread (e.g. time spent
+ * waiting in the libuv queue). Exported as an async event so overlapping
+ * waits get their own tracks.
+ */
+void TraceRecordAsync(const char* name, const char* category,
+                      uint64_t start_us, uint64_t end_us, uint64_t job_id);
+
+/**
+ * Serialize recorded spans as Chrome trace JSON. A zero `until_us` means no
+ * upper bound; a zero `job_id` means all jobs.
+ */
+std::string TraceDumpJson(uint64_t since_us, uint64_t until_us, uint64_t job_id);
+
+/**
+ * Job id attached to progress-stage spans emitted on the current thread.
+ * Returns the previous value.
+ */
+uint64_t TraceSetThreadJob(uint64_t job_id);
+
+/**
+ * LibRaw progress handler: turns stage begin/end notifications into nested
+ * spans on the calling thread. Never cancels.
+ */
+int TraceProgressCallback(void* data, enum LibRaw_progress stage, int iteration, int expected);
+
+/**
+ * Close a progress-stage span left open on the current thread
+ */
+void TraceEndStage();
+
+/**
+ * RAII span; does nothing unless tracing was enabled when it was created
+ */
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* category, uint64_t job_id)
+        : name_(name), category_(category), job_id_(job_id),
+          active_(TraceIsEnabled()), start_(0), previous_job_(0) {
+        if (active_) {
+            previous_job_ = TraceSetThreadJob(job_id_);
+            start_ = TraceNow();
+        }
+    }
+
+    ~TraceScope() {
+        if (active_) {
+            TraceEndStage();
+            TraceRecord(name_, category_, start_, TraceNow(), job_id_);
+            TraceSetThreadJob(previous_job_);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    const char* category_;
+    uint64_t job_id_;
+    bool active_;
+    uint64_t start_;
+    uint64_t previous_job_;
+};
+
+#endif // TRACE_H
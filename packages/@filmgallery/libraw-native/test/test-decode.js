@@ -4,8 +4,14 @@
  * Basic tests for the LibRaw native bindings
  */
 
+const fs = require('fs');
+const os = require('os');
 const path = require('path');
 const assert = require('assert');
+const { RenderCore } = require('../../../shared/render/RenderCore');
+const { RENDER_PARAMS } = require('../bench/run');
+const { writeSyntheticDng } = require('../bench/synthetic-dng');
+const { writeSyntheticIiq } = require('../bench/synthetic-iiq');
 
 // Test module loading
 console.log('=== LibRaw Native Module Tests ===\n');
@@ -22,71 +28,622 @@ try {
     process.exit(1);
 }
 
-// Test version
-const version = libraw.getVersion();
-console.log(`✅ LibRaw version: ${version.version} (${version.versionNumber})`);
+// Colour ramp: red across, green down, blue falling along the diagonal
+function colourRamp(width, height, bits = 8) {
+    const max = bits === 16 ? 65535 : 255;
+    const codes = bits === 16 ? new Uint16Array(width * height * 3) : Buffer.alloc(width * height * 3);
+    for (let y = 0, i = 0; y < height; y++) {
+        for (let x = 0; x < width; x++, i += 3) {
+            codes[i] = Math.round(x / (width - 1) * max);
+            codes[i + 1] = Math.round(y / (height - 1) * max);
+            codes[i + 2] = Math.round((1 - (x + y) / (width + height - 2)) * max);
+        }
+    }
+    return { data: bits === 16 ? Buffer.from(codes.buffer) : codes, width, height, bits };
+}
 
-// Test camera count
-const cameraCount = libraw.getCameraCount();
-console.log(`✅ Supported cameras: ${cameraCount}`);
+// RenderCore.processPixelFloat() over an RGB image, as 8-bit RGB
+function referenceRender(core, image) {
+    const max = image.bits === 16 ? 65535 : 255;
+    const codes = image.bits === 16 ? new Uint16Array(image.data.buffer, image.data.byteOffset, image.data.length / 2) : image.data;
+    const out = Buffer.alloc(image.width * image.height * 3);
+    for (let i = 0; i < out.length; i += 3) {
+        const rgb = core.processPixelFloat(codes[i] / max, codes[i + 1] / max, codes[i + 2] / max);
+        for (let c = 0; c < 3; c++) out[i + c] = Math.min(255, Math.max(0, Math.round(rgb[c] * 255)));
+    }
+    return out;
+}
 
-// Test Panasonic S9 support
-const s9Supported = libraw.isSupportedCamera('Panasonic DC-S9');
-console.log(`✅ Panasonic DC-S9 supported: ${s9Supported}`);
+// Uncompressed single-strip RGB TIFF of an 8/16-bit image (little-endian)
+function rgbTiff(image) {
+    const tiff = Buffer.alloc(122 + image.data.length);
+    tiff.write('II*\0', 0, 'latin1');
+    tiff.writeUInt32LE(8, 4);
+    tiff.writeUInt16LE(9, 8);
+    [[256, 4, image.width], [257, 4, image.height], [258, 3, image.bits], [259, 3, 1], [262, 3, 2], [273, 4, 122], [277, 3, 3],
+        [278, 4, image.height], [279, 4, image.data.length]]
+        .forEach(([tag, type, value], i) => {
+            tiff.writeUInt16LE(tag, 10 + i * 12);
+            tiff.writeUInt16LE(type, 12 + i * 12);
+            tiff.writeUInt32LE(1, 14 + i * 12);
+            tiff.writeUInt32LE(value, 18 + i * 12);
+        });
+    tiff.writeUInt32LE(0, 118);
+    image.data.copy(tiff, 122);
+    return tiff;
+}
 
-// Test constants
-assert(libraw.ColorSpace.SRGB === 1, 'ColorSpace.SRGB should be 1');
-assert(libraw.DemosaicQuality.AHD === 3, 'DemosaicQuality.AHD should be 3');
-assert(libraw.HighlightMode.CLIP === 0, 'HighlightMode.CLIP should be 0');
-console.log('✅ Constants exported correctly');
+// Same length and every value within `tolerance`
+function matches(actual, expected, tolerance) {
+    return actual.length === expected.length && actual.every((v, i) => Math.abs(v - expected[i]) <= tolerance);
+}
 
-// Test LibRawProcessor class
-const processor = new libraw.LibRawProcessor();
-assert(processor instanceof libraw.LibRawProcessor, 'Should create LibRawProcessor instance');
-assert(processor.isLoaded() === false, 'Should not be loaded initially');
-console.log('✅ LibRawProcessor class works');
+// `open` (default loadFile()), dcrawProcess() and makeMemImage() on a fresh
+// processor set up by `configure`
+async function decodeRaw(file, configure = () => {}, open = proc => proc.loadFile(file)) {
+    const proc = new libraw.LibRawProcessor();
+    try {
+        configure(proc);
+        const opened = await open(proc);
+        const decoder = proc.getDecoderInfo().name;
+        const processed = await proc.dcrawProcess();
+        return { opened, decoder, processed, image: await proc.makeMemImage() };
+    } finally {
+        proc.close();
+    }
+}
 
-processor.close();
+async function main() {
+    // Test version
+    const version = libraw.getVersion();
+    console.log(`✅ LibRaw version: ${version.version} (${version.versionNumber})`);
+    assert.ok(['baseline', 'sse4.2', 'avx2', 'avx512'].includes(version.cpu), 'getVersion().cpu is a CPU level');
+    assert.strictEqual(typeof version.jpegxl, 'boolean', 'getVersion().jpegxl is a boolean');
+    console.log(`✅ Kernel CPU level: ${version.cpu} (detected ${version.cpuDetected})`);
 
-console.log('\n=== All tests passed! ===\n');
+    // Test camera count
+    const cameraCount = libraw.getCameraCount();
+    console.log(`✅ Supported cameras: ${cameraCount}`);
 
-// If a test file is provided, test decoding
-const testFile = process.argv[2];
-if (testFile) {
-    console.log(`\n=== Testing with file: ${testFile} ===\n`);
-    
-    (async () => {
+    // Test Panasonic S9 support
+    const s9Supported = libraw.isSupportedCamera('Panasonic DC-S9');
+    console.log(`✅ Panasonic DC-S9 supported: ${s9Supported}`);
+
+    // Test camera index (display names, file make/model, aliases, batch)
+    assert(libraw.isSupportedCamera('SONY', 'ILCE-7M4'), 'File make/model should resolve');
+    assert(libraw.isSupportedCamera('NIKON CORPORATION', 'NIKON Z 6_2'), 'Nikon "_2" spelling should resolve');
+    assert(!libraw.isSupportedCamera('Nonexistent', 'Camera 1'), 'Unknown camera should not resolve');
+    const kissX7 = libraw.lookupCamera('Canon', 'Canon EOS Kiss X7');
+    assert(kissX7 && kissX7.model === 'EOS 100D', 'Regional alias should resolve to its entry');
+    assert(libraw.lookupCamera('FUJIFILM', 'X-T5').xtrans, 'X-T5 should be X-Trans');
+    assert(!libraw.lookupCamera('FUJIFILM', 'X-T200').xtrans, 'X-T200 should be Bayer');
+    const batch = libraw.lookupCameras([{ make: 'Panasonic', model: 'DC-S9' }, 'Sony ILCE-7M4 (A7 IV)', 'nope']);
+    assert(batch.length === 3 && batch[0] && batch[1] && batch[2] === null, 'Batch lookup should match single lookups');
+    assert(libraw.getCameraList() === libraw.getCameraList(), 'Camera list should be cached');
+    assert(libraw.getCameraList({ detailed: true }).length === cameraCount, 'Detailed list should cover every camera');
+    console.log('✅ Camera index lookups work');
+
+    // Test packed metadata records (a missing file fails only its own record)
+    const schema = libraw.getMetadataSchema();
+    assert(schema.fields[0].name === 'status' && schema.recordSize % 8 === 0, 'Schema should start with status');
+    assert(schema.fields.some(f => f.name === 'model' && f.type === 'string'), 'Schema should include model');
+    const records = await libraw.readMetadataBatch([path.join(__dirname, 'does-not-exist.dng')]);
+    assert(records.length === 1 && records.status(0) !== 0, 'Missing file should report a status');
+    assert(records.toRow(0).length === records.columns.length, 'Row should follow the column order');
+    assert(records.get(0, 'model') === '', 'Failed record should be empty');
+    console.log('✅ Metadata records work');
+
+    // Test colour conversion (round trip through Adobe RGB, profile header)
+    const gradient = Buffer.alloc(256 * 3);
+    for (let i = 0; i < gradient.length; i++) gradient[i] = i % 256;
+    const adobe = await libraw.convertColorSpace(gradient, { width: 256, height: 1, from: libraw.ColorSpace.SRGB, to: libraw.ColorSpace.ADOBE });
+    const back = await libraw.convertColorSpace(adobe, { width: 256, height: 1, from: libraw.ColorSpace.ADOBE, to: libraw.ColorSpace.SRGB });
+    assert(back.every((v, i) => Math.abs(v - gradient[i]) <= 2), 'sRGB -> Adobe -> sRGB should round-trip');
+    const icc = libraw.getColorProfile(libraw.ColorSpace.ADOBE);
+    assert(icc.readUInt32BE(0) === icc.length && icc.toString('latin1', 36, 40) === 'acsp', 'Profile should be ICC');
+    console.log('✅ Colour conversion works');
+
+    // Test derivatives (uniform grey stays grey at every size; fit inside, no enlargement)
+    const derivatives = await libraw.buildDerivatives(Buffer.alloc(300 * 200 * 3, 128), {
+        width: 300, height: 200, sizes: [{ width: 100 }, { width: 1000, height: 1000 }], pyramid: 40
+    });
+    assert(derivatives[0].width === 100 && derivatives[0].height === 67, 'Size should fit inside the bounds');
+    assert(derivatives[1].width === 300 && derivatives[1].height === 200, 'Size should never be enlarged');
+    assert(derivatives.length === 4 && derivatives[3].width === 75, 'Pyramid should halve down to the minimum');
+    assert(derivatives.every(image => image.data.every(v => Math.abs(v - 128) <= 1)), 'Grey should stay grey');
+    console.log('✅ Derivatives work');
+
+    // Test FilmLab session (identity stages keep grey; a saturation change reruns only the colour stage)
+    const identity = (size) => Float32Array.from({ length: size * 3 }, (_, i) => (i % size) / (size - 1));
+    const stages = {
+        density: identity(256), lut1: null, lut2: null, tone: identity(4097),
+        curves: [0, 1, 2, 3].map(() => Float32Array.of(0, 1)), hsl: null, saturation: 0, splitTone: null
+    };
+    const session = new libraw.FilmLabSession();
+    await session.setSource(Buffer.alloc(64 * 32 * 3, 128), { width: 64, height: 32 });
+    const first = await session.render(stages);
+    assert(first.startStage === 'density' && first.data.every(v => Math.abs(v - 128) <= 1), 'Identity should keep grey');
+    const second = await session.render({ ...stages, saturation: 30 });
+    assert(second.startStage === 'color', 'Saturation change should restart at the colour stage');
+    assert(session.getInfo().checkpoints.length === 3, 'All checkpoints should fit');
+    await session.close();
+    console.log('✅ FilmLab session works');
+
+    // Test FilmLab session against RenderCore (colour ramps under a full edit; restarts match a fresh reference)
+    const ramps = [colourRamp(64, 48, 8), colourRamp(64, 48, 16)];
+    const edits = [
+        { params: RENDER_PARAMS, startStage: 'density' },
+        { params: { ...RENDER_PARAMS, saturation: -30 }, startStage: 'color' },
+        { params: { ...RENDER_PARAMS, curves: { ...RENDER_PARAMS.curves, rgb: [{ x: 0, y: 0 }, { x: 128, y: 150 }, { x: 255, y: 255 }] } }, startStage: 'curves' }
+    ];
+    for (const ramp of ramps) {
+        const rampSession = new libraw.FilmLabSession();
+        await rampSession.setSource(ramp.data, { width: ramp.width, height: ramp.height, bits: ramp.bits });
+        for (const { params, startStage } of edits) {
+            const core = new RenderCore(params);
+            const rendered = await rampSession.render(core.getNativeStages(ramp.bits));
+            assert(rendered.startStage === startStage, `Render should restart at the ${startStage} stage`);
+            assert(matches(rendered.data, referenceRender(core, ramp), 2), `${ramp.bits}-bit render should match RenderCore within 2`);
+        }
+        await rampSession.close();
+    }
+    console.log('✅ FilmLab session matches RenderCore');
+
+    // Test edit session (pyramid levels, viewport level choice, newest render wins)
+    const edit = new libraw.FilmLabEditSession();
+    const info = await edit.setSource(Buffer.alloc(1024 * 512 * 3, 128), { width: 1024, height: 512, minLevelSize: 128 });
+    assert(info.levels.length === 4 && info.levels[3].width === 128, 'Pyramid should halve down to the minimum');
+    const [superseded, newest] = await Promise.all([
+        edit.render(stages, { outWidth: 256, outHeight: 128 }),
+        edit.render({ ...stages, saturation: 30 }, { x: 0, y: 0, width: 256, height: 128, outWidth: 256, outHeight: 128 })
+    ]);
+    assert(superseded === newest && newest.level === 0 && !newest.cancelled, 'Superseded render should resolve with the newest');
+    assert(newest.data.every(v => Math.abs(v - 128) <= 1), 'Grey should stay grey');
+    const whole = await edit.render(stages, { outWidth: 256, outHeight: 128 });
+    assert(whole.level === 2 && whole.width === 256, 'Whole image should come from the matching level');
+    await edit.close();
+    console.log('✅ Edit session works');
+
+    // Test edit session viewports against RenderCore (8x8 colour blocks stay exact down the pyramid;
+    // the whole image and a block-aligned crop at every level)
+    const blocks = colourRamp(32, 16);
+    const blocky = { data: Buffer.alloc(256 * 128 * 3), width: 256, height: 128, bits: 8 };
+    for (let y = 0; y < 128; y++) {
+        for (let x = 0; x < 256; x++) {
+            const block = ((y >> 3) * 32 + (x >> 3)) * 3;
+            blocks.data.copy(blocky.data, (y * 256 + x) * 3, block, block + 3);
+        }
+    }
+    const editCore = new RenderCore(RENDER_PARAMS);
+    const blockyReference = referenceRender(editCore, blocky);
+    const viewportEdit = new libraw.FilmLabEditSession();
+    await viewportEdit.setSource(blocky.data, { width: 256, height: 128, minLevelSize: 32 });
+    for (let level = 0; level < 4; level++) {
+        const scale = 1 << level;
+        for (const viewport of [
+            { x: 0, y: 0, width: 256, height: 128, outWidth: 256 / scale, outHeight: 128 / scale },
+            { x: 8 * scale, y: 4 * scale, width: 16 * scale, height: 8 * scale, outWidth: 16, outHeight: 8 }
+        ]) {
+            const rendered = await viewportEdit.render(editCore.getNativeStages(8), viewport);
+            const expected = Buffer.alloc(viewport.outWidth * viewport.outHeight * 3);
+            for (let y = 0; y < viewport.outHeight; y++) {
+                for (let x = 0; x < viewport.outWidth; x++) {
+                    const source = ((viewport.y + y * scale) * 256 + viewport.x + x * scale) * 3;
+                    blockyReference.copy(expected, (y * viewport.outWidth + x) * 3, source, source + 3);
+                }
+            }
+            assert(rendered.level === level, `Viewport should render from level ${level}`);
+            assert(matches(rendered.data, expected, 2), `Level ${level} viewport should match RenderCore within 2`);
+        }
+    }
+    await viewportEdit.close();
+    console.log('✅ Edit session viewports match RenderCore');
+
+    // Test preview batch (8- and 16-bit grey stay grey with shared or per-image stages)
+    const previews = await libraw.renderPreviews([
+        { data: Buffer.alloc(40 * 30 * 3, 128), width: 40, height: 30 },
+        { data: Buffer.from(new Uint16Array(20 * 10 * 4).fill(32896).buffer), width: 20, height: 10, channels: 4, bits: 16 },
+        { data: Buffer.alloc(8 * 8 * 3, 128), width: 8, height: 8, stages: { ...stages, saturation: 50 } }
+    ], { stages });
+    assert(previews.length === 3 && previews[1].width === 20 && previews[1].data.length === 20 * 10 * 3, 'Output should be 8-bit RGB');
+    assert(previews.every(image => image.data.every(v => Math.abs(v - 128) <= 1)), 'Grey should stay grey');
+    console.log('✅ Preview batch works');
+
+    // Test preview kernel against RenderCore (8- and 16-bit colour ramps, each under several edits)
+    const previewCores = [RENDER_PARAMS, { ...RENDER_PARAMS, filmCurveProfile: 'default' }, { ...RENDER_PARAMS, inverted: false }]
+        .map(params => new RenderCore(params));
+    const rampPreviews = await libraw.renderPreviews(ramps.flatMap(ramp => previewCores.map(core =>
+        ({ data: ramp.data, width: ramp.width, height: ramp.height, bits: ramp.bits, stages: core.getNativeStages(ramp.bits) }))));
+    ramps.forEach((ramp, r) => previewCores.forEach((core, c) => {
+        assert(matches(rampPreviews[r * previewCores.length + c].data, referenceRender(core, ramp), 2),
+            `${ramp.bits}-bit preview ${c} should match RenderCore within 2`);
+    }));
+    console.log('✅ Preview kernel matches RenderCore');
+
+    // Test variant batch (one grey image under several stage sets stays grey)
+    const variants = await libraw.renderVariants({ data: Buffer.alloc(24 * 16 * 3, 128), width: 24, height: 16 },
+        [stages, { ...stages, saturation: 50 }, stages]);
+    assert(variants.length === 3 && variants.every(v => v.width === 24 && v.data.length === 24 * 16 * 3), 'Output should be 8-bit RGB per variant');
+    assert(variants.every(v => v.data.every(c => Math.abs(c - 128) <= 1)), 'Grey should stay grey');
+    console.log('✅ Variant batch works');
+
+    // Test variant order against RenderCore (each variant of a colour ramp matches its own edit and its preview)
+    for (const [r, ramp] of ramps.entries()) {
+        const order = [2, 0, 1];
+        const rampVariants = await libraw.renderVariants({ data: ramp.data, width: ramp.width, height: ramp.height, bits: ramp.bits },
+            order.map(c => previewCores[c].getNativeStages(ramp.bits)));
+        order.forEach((c, v) => {
+            assert(matches(rampVariants[v].data, referenceRender(previewCores[c], ramp), 2), `${ramp.bits}-bit variant ${v} should match its own edit`);
+            assert(rampVariants[v].data.equals(rampPreviews[r * previewCores.length + c].data), `${ramp.bits}-bit variant ${v} should equal its preview`);
+        });
+    }
+    console.log('✅ Variant batch matches RenderCore in order');
+
+    // Test tiled render (8-bit strip TIFF -> JPEG and 16-bit TIFF, which reads back as a source)
+    const tiffPath = path.join(os.tmpdir(), `libraw-native-tiled-${process.pid}.tif`);
+    const tiff16Path = tiffPath.replace('.tif', '-16.tif');
+    fs.writeFileSync(tiffPath, rgbTiff({ data: Buffer.alloc(48 * 20 * 3, 128), width: 48, height: 20, bits: 8 }));
+    try {
+        const [tiledJpeg, tiff16] = await Promise.all([
+            libraw.renderTiled(tiffPath, stages, { quality: 90 }),
+            libraw.renderTiled(tiffPath, stages, { format: 'tiff16', outputPath: tiff16Path, stripRows: 7 })
+        ]);
+        assert(tiledJpeg.width === 48 && tiledJpeg.height === 20 && tiledJpeg.sourceBits === 8 && tiledJpeg.data[0] === 0xFF, 'JPEG should be returned');
+        assert(tiff16.path === tiff16Path && fs.statSync(tiff16Path).size > 48 * 20 * 6, '16-bit TIFF should be written');
+        const [decoded, again] = await Promise.all([libraw.decodeJpeg(tiledJpeg.data), libraw.renderTiled(tiff16Path, stages, { quality: 90 })]);
+        assert(again.sourceBits === 16 && again.width === 48, '16-bit output should read back as a source');
+        assert(decoded.data.every(v => Math.abs(v - 128) <= 2), 'Grey should stay grey');
+        await assert.rejects(libraw.renderTiled(tiffPath, stages, { format: 'tiff16' }), TypeError, 'Missing outputPath should be rejected');
+        console.log('✅ Tiled render works');
+    } finally {
+        fs.rmSync(tiffPath, { force: true });
+        fs.rmSync(tiff16Path, { force: true });
+    }
+
+    // Test tiled render against RenderCore (8- and 16-bit colour ramps to 4:4:4 JPEG and 16-bit TIFF)
+    try {
+        for (const ramp of ramps) {
+            const core = new RenderCore(RENDER_PARAMS);
+            const reference = referenceRender(core, ramp);
+            fs.writeFileSync(tiffPath, rgbTiff(ramp));
+            const [rampJpeg] = await Promise.all([
+                libraw.renderTiled(tiffPath, core.getNativeStages(ramp.bits), { quality: 100, subsampling: '444' }),
+                libraw.renderTiled(tiffPath, core.getNativeStages(ramp.bits), { format: 'tiff16', outputPath: tiff16Path, stripRows: 7 })
+            ]);
+            const rampDecoded = await libraw.decodeJpeg(rampJpeg.data);
+            assert(matches(rampDecoded.data, reference, 4), `${ramp.bits}-bit tiled JPEG should match RenderCore within 4`);
+            const written = fs.readFileSync(tiff16Path);
+            const pixels = written.subarray(written.length - reference.length * 2);
+            const narrowed = Buffer.from(Array.from({ length: reference.length }, (_, i) => Math.round(pixels.readUInt16LE(i * 2) / 257)));
+            assert(matches(narrowed, reference, 2), `${ramp.bits}-bit tiled TIFF should match RenderCore within 2`);
+        }
+        console.log('✅ Tiled render matches RenderCore');
+    } finally {
+        fs.rmSync(tiffPath, { force: true });
+        fs.rmSync(tiff16Path, { force: true });
+    }
+
+    // Test JPEG encoder (SOI/EOI framing, 4:4:4 and 16-bit input)
+    const jpegs = await Promise.all([
+        libraw.encodeJpeg(Buffer.alloc(100 * 60 * 3, 128), { width: 100, height: 60, quality: 80 }),
+        libraw.encodeJpeg(Buffer.from(new Uint16Array(17 * 9).fill(32896).buffer),
+            { width: 17, height: 9, channels: 1, bits: 16, subsampling: '444' })
+    ]);
+    assert(jpegs.every(jpeg => jpeg[0] === 0xFF && jpeg[1] === 0xD8 &&
+        jpeg[jpeg.length - 2] === 0xFF && jpeg[jpeg.length - 1] === 0xD9), 'JPEG should be framed by SOI/EOI');
+    console.log('✅ JPEG encoder works');
+
+    // Test JPEG decoder (full size, 1/8 scale, grayscale)
+    const [full, eighth, gray] = await Promise.all([
+        libraw.decodeJpeg(jpegs[0]), libraw.decodeJpeg(jpegs[0], { scale: 8 }), libraw.decodeJpeg(jpegs[1], { scale: 2 })
+    ]);
+    assert(full.width === 100 && full.height === 60 && full.colors === 3, 'Full-size decode should keep the size');
+    assert(eighth.width === 13 && eighth.height === 8 && gray.width === 9 && gray.height === 5 && gray.colors === 1,
+        'Scaled decode should be ceil(size / scale)');
+    assert([full, eighth, gray].every(image => image.data.every(v => Math.abs(v - 128) <= 2)), 'Grey should stay grey');
+    console.log('✅ JPEG decoder works');
+
+    // Test JPEG decoder rejects an over-subscribed Huffman table (200 one-bit codes)
+    await assert.rejects(libraw.decodeJpeg(Buffer.concat([
+        Buffer.from([0xFF, 0xD8, 0xFF, 0xC0, 0, 11, 8, 0, 8, 0, 8, 1, 1, 0x11, 0, 0xFF, 0xC4, 0, 219, 0x00, 200]),
+        Buffer.alloc(15), Buffer.from(Array.from({ length: 200 }, (_, i) => i)), Buffer.from([0xFF, 0xD9])
+    ])), Error, 'Over-subscribed Huffman tables should be rejected');
+    console.log('✅ JPEG decoder rejects bad Huffman tables');
+
+    // Test metadata writer (EXIF/XMP APP1 and IPTC APP13 after SOI, scan data unchanged)
+    const plain = await libraw.encodeJpeg(Buffer.alloc(32 * 16 * 3, 128), { width: 32, height: 16 });
+    const tagged = await libraw.writeMetadata(plain, { Make: 'Nikon', FNumber: 2.8, GPSLatitude: -33.87, 'XMP-FilmGallery:FilmName': 'HP5' });
+    assert(tagged.indexOf('Exif\0\0') > 0 && tagged.includes('<FilmGallery:FilmName>HP5<'), 'EXIF and XMP should be written');
+    assert(tagged.subarray(tagged.indexOf(Buffer.from([0xFF, 0xDA]))).equals(plain.subarray(plain.indexOf(Buffer.from([0xFF, 0xDA])))),
+        'Scan data should be copied unchanged');
+    const keyworded = await libraw.writeMetadata(tagged, { Keywords: ['HP5', 'Lab'] });
+    assert(keyworded.includes('Photoshop 3.0\0') && keyworded.includes(Buffer.from('\x1c\x02\x19\x00\x03HP5', 'latin1')) &&
+        keyworded.includes('<rdf:li>Lab</rdf:li>') && keyworded.includes('Nikon'),
+        'Keywords should be written to IPTC and dc:subject, keeping the EXIF');
+    await assert.rejects(libraw.writeMetadata(plain, { NoSuchTag: 1 }), RangeError, 'Unknown tags should be rejected with a RangeError');
+    console.log('✅ Metadata writer works');
+
+    // Test synthetic DNG decoding (uncompressed 16-bit Bayer and LinearRaw from bench/synthetic-dng.js)
+    const dngPath = path.join(os.tmpdir(), `libraw-native-synthetic-${process.pid}.dng`);
+    const linearDngPath = dngPath.replace('.dng', '-linear.dng');
+    const mosaicPath = dngPath.replace('.dng', '.fgmc');
+    const deflateDngPath = dngPath.replace('.dng', '-deflate.dng');
+    const linearDeflateDngPath = dngPath.replace('.dng', '-linear-deflate.dng');
+    const jxlDngPath = dngPath.replace('.dng', '-jxl.dng');
+    const iiqPath = dngPath.replace('.dng', '.iiq');
+    writeSyntheticDng(dngPath, { width: 96, height: 64 });
+    writeSyntheticDng(linearDngPath, { width: 96, height: 64, linear: true });
+    writeSyntheticDng(deflateDngPath, { width: 96, height: 64, compression: 'deflate' });
+    writeSyntheticDng(linearDeflateDngPath, { width: 96, height: 64, linear: true, compression: 'deflate' });
+    try {
+        const dng = await decodeRaw(dngPath);
+        assert(dng.decoder === 'packed_dng_load_raw()' && dng.image.width === 96 && dng.image.colors === 3, 'Synthetic DNG should decode');
+        const libRawLoader = await decodeRaw(dngPath, proc => proc.setStandInLoaders(false));
+        assert(libRawLoader.image.data.equals(dng.image.data), 'Packed loader should match LibRaw\'s loader');
+        console.log('✅ Packed loader matches LibRaw\'s');
+
+        const [linearFast, linearFull] = await Promise.all([
+            decodeRaw(linearDngPath), decodeRaw(linearDngPath, proc => proc.setLinearFastPath(false))
+        ]);
+        assert(linearFast.processed.linear && !linearFull.processed.linear, 'Only the default decode should take the fast path');
+        assert(linearFast.image.data.equals(linearFull.image.data), 'LinearRaw fast path should match dcraw_process()');
+        console.log('✅ LinearRaw fast path matches dcraw_process()');
+
+        const [mono, monoFloat, linearMono] = await Promise.all([
+            decodeRaw(dngPath, proc => proc.setMonochrome(true)),
+            decodeRaw(dngPath, proc => proc.setMonochrome({ float: true })),
+            decodeRaw(linearDngPath, proc => proc.setMonochrome(true))
+        ]);
+        assert(mono.processed.monochrome && mono.image.colors === 1 && mono.image.data.length === 96 * 64, 'Monochrome Bayer should give one 8-bit channel');
+        assert(monoFloat.image.colors === 1 && monoFloat.image.bits === 32 && monoFloat.image.data.length === 96 * 64 * 4, 'Float monochrome should give one float channel');
+        assert(!linearMono.processed.monochrome && linearMono.image.colors === 3, 'LinearRaw should stay RGB');
+        console.log('✅ Monochrome decode gives one channel');
+
+        for (const [file, decoded] of [[dngPath, dng], [linearDngPath, linearFast]]) {
+            const writer = new libraw.LibRawProcessor();
+            await writer.loadFile(file);
+            await writer.writeMosaicCache(mosaicPath);
+            writer.close();
+            const cached = await decodeRaw(file, undefined, proc => proc.openWithMosaicCache(file, mosaicPath));
+            assert(cached.opened.fromMosaic, `Mosaic cache should be reused (${cached.opened.mosaicStatus})`);
+            assert(cached.image.data.equals(decoded.image.data), 'Mosaic cache should reproduce the image');
+        }
+
+        // Closed as soon as the image is copied out; the write finishes on its own
+        fs.rmSync(mosaicPath, { force: true });
+        const capturer = new libraw.LibRawProcessor();
+        await capturer.loadFile(dngPath);
+        const { written } = await capturer.captureMosaicCache(mosaicPath);
+        capturer.close();
+        assert((await written).bytes === fs.statSync(mosaicPath).size, 'Captured mosaic cache should be written');
+        const captured = await decodeRaw(dngPath, undefined, proc => proc.openWithMosaicCache(dngPath, mosaicPath));
+        assert(captured.opened.fromMosaic && captured.image.data.equals(dng.image.data), 'Captured mosaic cache should reproduce the image');
+        console.log('✅ Mosaic cache round-trips');
+
+        for (const [file, decoded] of [[dngPath, dng], [linearDngPath, linearFast]]) {
+            const identified = new libraw.LibRawProcessor();
+            await identified.loadFile(file);
+            const snapshot = identified.getIdentifySnapshot();
+            identified.close();
+            const reopened = await decodeRaw(file, undefined, proc => proc.openWithSnapshot(file, snapshot));
+            assert(reopened.opened.fromSnapshot, `Identify snapshot should be reused (${reopened.opened.snapshotStatus})`);
+            assert(reopened.image.data.equals(decoded.image.data), 'Identify snapshot should reproduce the image');
+        }
+        console.log('✅ Identify snapshot round-trips');
+
+        for (const [file, decoded] of [[deflateDngPath, dng], [linearDeflateDngPath, linearFast]]) {
+            const deflated = await decodeRaw(file);
+            assert(deflated.decoder === 'deflate_dng_load_raw()', `Deflate DNG should use the deflate loader (${deflated.decoder})`);
+            assert(deflated.image.data.equals(decoded.image.data), 'Deflate DNG should match the uncompressed image');
+        }
+        console.log('✅ Deflate DNG matches uncompressed');
+
+        // No JPEG XL encoder here: relabel the raw IFD's uncompressed strip as
+        // compression 52546. Without libjxl it is unsupported, with it the
+        // strip is not a JXL codestream; either way unpacking must fail cleanly.
+        const jxlDng = fs.readFileSync(dngPath);
+        const entry = (ifd, tag) => {
+            for (let i = 0; i < jxlDng.readUInt16LE(ifd); i++) {
+                if (jxlDng.readUInt16LE(ifd + 2 + i * 12) === tag) return ifd + 2 + i * 12;
+            }
+            throw new Error(`Tag ${tag} missing`);
+        };
+        const rawIfd = jxlDng.readUInt32LE(entry(jxlDng.readUInt32LE(4), 330) + 8);
+        jxlDng.writeUInt16LE(52546, entry(rawIfd, 259) + 8);
+        fs.writeFileSync(jxlDngPath, jxlDng);
+        const jxl = new libraw.LibRawProcessor();
         try {
-            const proc = new libraw.LibRawProcessor();
-            
-            console.log('Loading file...');
-            const loadResult = await proc.loadFile(testFile);
-            console.log(`✅ Loaded: ${loadResult.width}x${loadResult.height}`);
-            
-            console.log('Getting metadata...');
-            const metadata = proc.getMetadata();
-            console.log(`✅ Camera: ${metadata.make} ${metadata.model}`);
-            console.log(`   ISO: ${metadata.iso}, Shutter: ${metadata.shutter}s, Aperture: f/${metadata.aperture}`);
-            
-            console.log('Processing...');
-            const processResult = await proc.dcrawProcess();
-            console.log(`✅ Processed: ${processResult.width}x${processResult.height}`);
-            
-            console.log('Creating memory image...');
-            const imageResult = await proc.makeMemImage();
-            console.log(`✅ Image: ${imageResult.width}x${imageResult.height}, ${imageResult.bits} bits, ${imageResult.colors} colors`);
-            console.log(`   Data size: ${(imageResult.dataSize / 1024 / 1024).toFixed(2)} MB`);
-            
-            proc.close();
-            
-            console.log('\n=== File test passed! ===\n');
-            
-        } catch (e) {
-            console.error('❌ File test failed:', e.message);
-            process.exit(1);
+            await jxl.loadFile(jxlDngPath);
+            assert(jxl.getDecoderInfo().name === 'jxl_dng_load_raw_placeholder()', 'JPEG XL DNG should be identified');
+            await assert.rejects(jxl.dcrawProcess(), 'Undecodable JPEG XL tiles should be rejected');
+        } finally {
+            jxl.close();
+        }
+        console.log(`✅ JPEG XL DNG identified and rejected cleanly (libjxl ${version.jpegxl ? 'built in' : 'not built in'})`);
+
+        // 100 columns leave a 4-column tail that IIQ L stores uncoded
+        for (const [format, loader] of [[1, 'phase_one_load_raw()'], [3, 'phase_one_load_raw_c()']]) {
+            writeSyntheticIiq(iiqPath, { width: 100, height: 64, format });
+            const [iiq, libRawIiq] = await Promise.all([
+                decodeRaw(iiqPath), decodeRaw(iiqPath, proc => proc.setStandInLoaders(false))
+            ]);
+            assert(iiq.decoder === loader && iiq.image.width === 100 && iiq.image.colors === 3, `Synthetic IIQ format ${format} should decode`);
+            assert(iiq.image.data.equals(libRawIiq.image.data), `IIQ format ${format} should match LibRaw's loader and calibration`);
         }
-    })();
-} else {
-    console.log('Tip: Pass a RAW file path to test decoding:');
-    console.log('  node test/test-decode.js /path/to/photo.rw2\n');
+        console.log('✅ Phase One loaders and calibration match LibRaw\'s');
+    } finally {
+        fs.rmSync(dngPath, { force: true });
+        fs.rmSync(linearDngPath, { force: true });
+        fs.rmSync(mosaicPath, { force: true });
+        fs.rmSync(deflateDngPath, { force: true });
+        fs.rmSync(linearDeflateDngPath, { force: true });
+        fs.rmSync(jxlDngPath, { force: true });
+        fs.rmSync(iiqPath, { force: true });
+    }
+
+    // Test constants
+    assert(libraw.ColorSpace.SRGB === 1, 'ColorSpace.SRGB should be 1');
+    assert(libraw.DemosaicQuality.AHD === 3, 'DemosaicQuality.AHD should be 3');
+    assert(libraw.HighlightMode.CLIP === 0, 'HighlightMode.CLIP should be 0');
+    console.log('✅ Constants exported correctly');
+
+    // Test LibRawProcessor class
+    const processor = new libraw.LibRawProcessor();
+    assert(processor instanceof libraw.LibRawProcessor, 'Should create LibRawProcessor instance');
+    assert(processor.isLoaded() === false, 'Should not be loaded initially');
+    console.log('✅ LibRawProcessor class works');
+
+    processor.close();
+
+    // Test tracing
+    if (!process.env.LIBRAW_NATIVE_TRACE) {
+        assert(libraw.isTracingEnabled() === false, 'Tracing should be off by default');
+    }
+    libraw.enableTracing({ capacity: 16 });
+    const traceStart = libraw.traceNow();
+    libraw.traceSpan('test-span', 'test', 7, () => {});
+    libraw.recordTraceSpan('test-manual', 'test', traceStart, libraw.traceNow(), 8);
+    const trace = libraw.dumpTrace({ jobId: 7 });
+    assert(trace.traceEvents.some(e => e.name === 'test-span' && e.ph === 'X'), 'Trace should contain test-span');
+    assert(!trace.traceEvents.some(e => e.name === 'test-manual'), 'Job filter should exclude other jobs');
+    libraw.disableTracing();
+    console.log('✅ Tracing works');
+
+    console.log('\n=== All tests passed! ===\n');
+
+    // If a test file is provided, test decoding
+    const testFile = process.argv[2];
+    if (testFile) {
+        await testDecodeFile(testFile);
+    } else {
+        console.log('Tip: Pass a RAW file path to test decoding:');
+        console.log('  node test/test-decode.js /path/to/photo.rw2\n');
+    }
+}
+
+async function testDecodeFile(testFile) {
+    console.log(`\n=== Testing with file: ${testFile} ===\n`);
+
+    const proc = new libraw.LibRawProcessor();
+    if (process.env.LIBRAW_NATIVE_TRACE) {
+        libraw.enableTracing();
+        proc.setTraceJob(1);
+    }
+
+    console.log('Loading file...');
+    const loadResult = await proc.loadFile(testFile);
+    console.log(`✅ Loaded: ${loadResult.width}x${loadResult.height}`);
+
+    console.log('Getting metadata...');
+    const metadata = proc.getMetadata();
+    console.log(`✅ Camera: ${metadata.make} ${metadata.model}`);
+    console.log(`   ISO: ${metadata.iso}, Shutter: ${metadata.shutter}s, Aperture: f/${metadata.aperture}`);
+    const record = proc.getMetadataRecord();
+    assert(record.get(0, 'model') === metadata.model, 'Packed record should match getMetadata()');
+    const snapshot = proc.getIdentifySnapshot();
+    const reopened = new libraw.LibRawProcessor();
+    const snapshotLoad = await reopened.openWithSnapshot(testFile, snapshot);
+    assert(snapshotLoad.fromSnapshot, `Snapshot should be reused (${snapshotLoad.snapshotStatus})`);
+    assert(snapshotLoad.width === loadResult.width && snapshotLoad.height === loadResult.height,
+        'Snapshot open should match loadFile()');
+    reopened.close();
+    const decoder = proc.getDecoderInfo();
+    const camera = libraw.lookupCamera(metadata.normalizedMake, metadata.normalizedModel);
+    console.log(`✅ Decoder: ${decoder.name} (frames: ${decoder.frames}), indexed: ${camera ? camera.name : 'no'}`);
+
+    console.log('Processing...');
+    const processResult = await proc.dcrawProcess();
+    console.log(`✅ Processed: ${processResult.width}x${processResult.height}`);
+    const histogram = processResult.histogram;
+    assert(histogram && histogram.data.length === histogram.bins * histogram.channels,
+        'Process result should carry the conversion histogram');
+    assert(processResult.whiteLevel > 0, 'Process result should carry the white level');
+
+    console.log('Creating memory image...');
+    const imageResult = await proc.makeMemImage();
+    console.log(`✅ Image: ${imageResult.width}x${imageResult.height}, ${imageResult.bits} bits, ${imageResult.colors} colors`);
+    console.log(`   Data size: ${(imageResult.dataSize / 1024 / 1024).toFixed(2)} MB`);
+
+    if (processResult.linear) {
+        proc.setLinearFastPath(false);
+        const full = await proc.dcrawProcess();
+        assert(!full.linear, 'Fast path should be off');
+        const fullImage = await proc.makeMemImage();
+        assert(fullImage.data.equals(imageResult.data), 'LinearRaw fast path should match dcraw_process()');
+        proc.setLinearFastPath(true);
+        console.log('✅ LinearRaw fast path matches dcraw_process()');
+    }
+
+    const mosaicPath = path.join(os.tmpdir(), `libraw-native-test-${process.pid}.fgmc`);
+    try {
+        const writer = new libraw.LibRawProcessor();
+        await writer.loadFile(testFile);
+        const written = await writer.writeMosaicCache(mosaicPath);
+        writer.close();
+        const cached = new libraw.LibRawProcessor();
+        const mosaicLoad = await cached.openWithMosaicCache(testFile, mosaicPath, snapshot);
+        assert(mosaicLoad.fromMosaic, `Mosaic cache should be reused (${mosaicLoad.mosaicStatus})`);
+        await cached.dcrawProcess();
+        const cachedImage = await cached.makeMemImage();
+        assert(cachedImage.data.equals(imageResult.data), 'Mosaic cache should reproduce the image');
+        cached.close();
+        console.log(`✅ Mosaic cache: ${(written.bytes / 1024 / 1024).toFixed(2)} MB for ${(written.rawBytes / 1024 / 1024).toFixed(2)} MB raw`);
+    } catch (e) {
+        if (!/mosaic cache: Unsupported/.test(e.message)) throw e;
+        console.log('ℹ️  Mosaic cache: not supported for this file');
+    } finally {
+        fs.rmSync(mosaicPath, { force: true });
+    }
+
+    proc.setMemImageLimit(0);
+    const stripped = await proc.makeMemImage();
+    assert(stripped.data === null && stripped.stripCount >= 1, 'Over the limit should return strips');
+    const strips = [];
+    for await (const strip of proc.imageStrips(stripped)) strips.push(strip.data);
+    assert(Buffer.concat(strips).equals(imageResult.data), 'Strips should match the contiguous image');
+    console.log(`✅ Strips: ${stripped.stripCount} x ${stripped.stripHeight} rows`);
+
+    proc.setMemImageLimit(1 << 30);
+    proc.setExportColorSpace(libraw.ColorSpace.SRGB, libraw.Transfer.BT709);
+    const exported = await proc.makeMemImage();
+    assert(exported.transfer === libraw.Transfer.BT709 && exported.data.length === imageResult.data.length,
+        'Export colour space should apply');
+    proc.setExportColorSpace(0);
+    console.log('✅ Export colour space works');
+
+    const jpeg = await proc.makeJpeg({ quality: 90 });
+    assert(jpeg.width === imageResult.width && jpeg.height === imageResult.height &&
+        jpeg.data[0] === 0xFF && jpeg.data[1] === 0xD8, 'makeJpeg should encode the processed image');
+    console.log(`✅ JPEG: ${(jpeg.data.length / 1024).toFixed(1)} KB`);
+
+    const thumb = await proc.decodeThumbnail({ scale: 2 }).catch(() => null);
+    if (thumb) {
+        assert(thumb.data.length === thumb.width * thumb.height * thumb.colors, 'Thumbnail pixels should be packed');
+        console.log(`✅ Thumbnail decoded: ${thumb.width}x${thumb.height}`);
+    }
+
+    proc.setMonochrome({ float: true });
+    const mono = await proc.dcrawProcess();
+    if (mono.monochrome) {
+        const monoImage = await proc.makeMemImage();
+        assert(monoImage.colors === 1 && monoImage.bits === 32 &&
+            monoImage.data.length === monoImage.width * monoImage.height * 4,
+            'Monochrome image should be one float channel');
+        console.log('✅ Monochrome luminance works');
+    }
+    proc.setMonochrome(false);
+
+    proc.close();
+
+    if (process.env.LIBRAW_NATIVE_TRACE) {
+        await libraw.writeTrace('test-decode-trace.json', { jobId: 1 });
+        console.log('✅ Trace written to test-decode-trace.json');
+    }
+
+    console.log('\n=== File test passed! ===\n');
 }
+
+main().catch(e => {
+    console.error('❌ Test failed:', e.stack || e.message);
+    process.exit(1);
+});
@@ -18,6 +18,19 @@ declare module '@filmgallery/libraw-native' {
         REC2020: 8;
     };
 
+    /**
+     * Transfer function constants (convertColorSpace/setExportColorSpace).
+     * DEFAULT picks the colour space's usual curve.
+     */
+    export const Transfer: {
+        DEFAULT: -1;
+        LINEAR: 0;
+        SRGB: 1;
+        GAMMA22: 2;
+        GAMMA18: 3;
+        BT709: 4;
+    };
+
     /**
      * Demosaic quality constants
      */
@@ -53,6 +66,33 @@ declare module '@filmgallery/libraw-native' {
         height: number;
         rawWidth?: number;
         rawHeight?: number;
+        /** openWithSnapshot only: whether the snapshot was used */
+        fromSnapshot?: boolean;
+        /** openWithSnapshot only: "ok" or why the snapshot was rejected */
+        snapshotStatus?: string;
+        /** openWithMosaicCache only: whether the file was loaded unpacked from the cache */
+        fromMosaic?: boolean;
+        /** openWithMosaicCache only: "ok" or why the cache was rejected */
+        mosaicStatus?: string;
+    }
+
+    /**
+     * Result from writing a mosaic cache
+     */
+    export interface MosaicCacheResult {
+        success: boolean;
+        /** Cache file size */
+        bytes: number;
+        /** Size of the unpacked raw image it holds */
+        rawBytes: number;
+    }
+
+    export interface MosaicCaptureResult {
+        success: boolean;
+        /** Size of the unpacked raw image copied out */
+        rawBytes: number;
+        /** Settles when the cache file is written */
+        written: Promise<{ success: boolean; bytes: number }>;
     }
 
     /**
@@ -64,6 +104,36 @@ declare module '@filmgallery/libraw-native' {
         height: number;
         iwidth: number;
         iheight: number;
+        /** Processed by the LinearRaw fast path instead of dcraw_process() */
+        linear: boolean;
+        /** Processed to one luminance channel (setMonochrome) */
+        monochrome: boolean;
+        /** Linear value makeMemImage() maps to full scale (auto-bright or 0xffff) */
+        whiteLevel: number;
+        /** Whether whiteLevel came from the auto-bright histogram clip */
+        autoBright: boolean;
+        /** LibRaw's conversion histogram, null with setHistogramBins(0) */
+        histogram: ProcessHistogram | null;
+    }
+
+    /**
+     * Histogram of the linear output, before gamma
+     */
+    export interface ProcessHistogram {
+        bins: number;
+        channels: number;
+        /** channels x bins counts, one channel after another */
+        data: Uint32Array;
+    }
+
+    /**
+     * Monochrome processing settings
+     */
+    export interface MonochromeOptions {
+        /** Camera R, G, B weights, normalized; default Rec. 709 */
+        weights?: [number, number, number];
+        /** makeMemImage() returns 32-bit float linear luminance */
+        float?: boolean;
     }
 
     /**
@@ -80,6 +150,75 @@ declare module '@filmgallery/libraw-native' {
         type: number;
     }
 
+    /**
+     * Result from makeMemImage. Over the mem image limit, data is null and
+     * the image is read in strips of stripHeight rows.
+     */
+    export interface ProcessedImageResult extends Omit<MemImageResult, 'data'> {
+        data: Buffer | null;
+        /** Bytes per row */
+        stride: number;
+        /** ColorSpace the pixels are in (export colour space when applied) */
+        colorSpace: number;
+        /** Transfer of the export colour space; null = setGamma() curve */
+        transfer: number | null;
+        stripHeight?: number;
+        stripCount?: number;
+    }
+
+    /**
+     * Baseline JPEG encoder settings
+     */
+    export interface JpegOptions {
+        /** 1-100; default 90 */
+        quality?: number;
+        /** Chroma subsampling; default '420' */
+        subsampling?: '420' | '444';
+        /** ICC profile to embed */
+        iccProfile?: Buffer;
+    }
+
+    /**
+     * Result from makeJpeg
+     */
+    export interface JpegImageResult {
+        width: number;
+        height: number;
+        colors: number;
+        colorSpace: number;
+        transfer: number | null;
+        data: Buffer;
+    }
+
+    /**
+     * Options for decodeJpeg / decodeThumbnail
+     */
+    export interface JpegDecodeOptions {
+        /** 1, 2, 4 or 8: output is ceil(size / scale); default 1 */
+        scale?: 1 | 2 | 4 | 8;
+    }
+
+    /**
+     * Decoded 8-bit JPEG pixels (interleaved gray or RGB)
+     */
+    export interface DecodedJpeg {
+        width: number;
+        height: number;
+        /** 1 or 3 */
+        colors: number;
+        bits: 8;
+        data: Buffer;
+    }
+
+    /**
+     * One strip of a processed image
+     */
+    export interface ImageStrip {
+        row: number;
+        rows: number;
+        data: Buffer;
+    }
+
     /**
      * Result from unpacking thumbnail
      */
@@ -160,12 +299,129 @@ declare module '@filmgallery/libraw-native' {
         fnorm: number;
     }
 
+    /**
+     * Decoder selected for the loaded file
+     */
+    export interface DecoderInfo {
+        /** LibRaw decoder, e.g. "crxLoadRaw()", "sony_arw2_load_raw()" */
+        name: string;
+        /** LIBRAW_DECODER_* bits */
+        flags: number;
+        unsupported: boolean;
+        flatData: boolean;
+        hasCurve: boolean;
+        xtrans: boolean;
+        /** Raw frames in the file (pixel shift, dual pixel) */
+        frames: number;
+    }
+
+    /**
+     * Camera index entry
+     */
+    export interface CameraInfo {
+        /** LibRaw display name */
+        name: string;
+        /** Canonical make */
+        make: string;
+        model: string;
+        /** Alternate and regional model names */
+        aliases: string[];
+        /** Remarks such as "CHDK hack" */
+        notes: string[];
+        /** Typical raw container, e.g. "CR3" */
+        format: string | null;
+        xtrans: boolean;
+        multiFrame: boolean;
+        monochrome: boolean;
+        /** Some formats or modes are not supported */
+        partial: boolean;
+        dngOnly: boolean;
+        modifiedFirmware: boolean;
+        singleShotOnly: boolean;
+    }
+
+    export type CameraQuery = string | { make: string; model: string };
+
+    /**
+     * Packed metadata record layout
+     */
+    export interface MetadataField {
+        name: string;
+        type: 'i32' | 'u32' | 'f64' | 'string';
+        /** Byte offset within a record */
+        offset: number;
+    }
+
+    export interface MetadataSchema {
+        magic: number;
+        version: number;
+        headerSize: number;
+        recordSize: number;
+        fields: readonly MetadataField[];
+    }
+
+    /**
+     * Reader over a packed metadata block (one record per file)
+     */
+    export class MetadataRecords implements Iterable<Record<string, number | string>> {
+        constructor(buffer: ArrayBuffer, schema: MetadataSchema, paths?: string[] | null);
+        readonly buffer: ArrayBuffer;
+        readonly schema: MetadataSchema;
+        /** Source paths for batch reads, otherwise null */
+        readonly paths: string[] | null;
+        readonly length: number;
+        readonly columns: string[];
+        readonly sqlColumns: Array<{ name: string; type: 'INTEGER' | 'REAL' | 'TEXT' }>;
+        /** LibRaw error code (0 when the file was read) */
+        status(index: number): number;
+        get(index: number, name: string): number | string;
+        toObject(index: number): Record<string, number | string>;
+        /** Column-ordered values; empty strings and NaN become null */
+        toRow(index: number): Array<number | string | null>;
+        [Symbol.iterator](): Iterator<Record<string, number | string>>;
+    }
+
     /**
      * Version information
      */
     export interface VersionInfo {
         version: string;
         versionNumber: number;
+        /** Instruction set the native kernels run with */
+        cpu: CpuLevel;
+        /** Best instruction set this CPU supports */
+        cpuDetected: CpuLevel;
+        /** Built with libjxl, so JPEG XL DNGs (DNG 1.7) unpack */
+        jpegxl: boolean;
+    }
+
+    export type CpuLevel = 'baseline' | 'sse4.2' | 'avx2' | 'avx512';
+
+    /**
+     * Filters for dumpTrace()/writeTrace()
+     */
+    export interface TraceDumpOptions {
+        since?: number;
+        until?: number;
+        jobId?: number;
+    }
+
+    /**
+     * Chrome trace-event document (chrome://tracing, Perfetto)
+     */
+    export interface ChromeTrace {
+        displayTimeUnit: string;
+        traceEvents: Array<{
+            name: string;
+            cat?: string;
+            ph: 'X' | 'b' | 'e' | 'M';
+            pid: number;
+            tid: number;
+            ts?: number;
+            dur?: number;
+            id?: number;
+            args?: { job?: number; name?: string };
+        }>;
     }
 
     /**
@@ -177,27 +433,46 @@ declare module '@filmgallery/libraw-native' {
         // Core methods (async with callback, use Promise wrapper)
         loadFile(path: string, callback: (err: Error | null, result: LoadResult) => void): void;
         loadBuffer(buffer: Buffer, callback: (err: Error | null, result: LoadResult) => void): void;
+        openWithSnapshot(path: string, snapshot: Buffer, callback: (err: Error | null, result: LoadResult) => void): void;
+        openWithMosaicCache(path: string, cachePath: string, snapshot: Buffer | null, callback: (err: Error | null, result: LoadResult) => void): void;
+        writeMosaicCache(cachePath: string, callback: (err: Error | null, result: MosaicCacheResult) => void,
+                         written?: (err: Error | null, result: { success: boolean; bytes: number }) => void): void;
         unpack(callback: (err: Error | null, result: { success: boolean }) => void): void;
         unpackThumbnail(callback: (err: Error | null, result: ThumbnailInfo) => void): void;
         dcrawProcess(callback: (err: Error | null, result: ProcessResult) => void): void;
-        makeMemImage(callback: (err: Error | null, result: MemImageResult) => void): void;
+        makeMemImage(callback: (err: Error | null, result: ProcessedImageResult) => void): void;
+        readImageStrip(index: number, callback: (err: Error | null, result: ImageStrip) => void): void;
+        makeJpeg(options: JpegOptions, callback: (err: Error | null, result: JpegImageResult) => void): void;
         makeMemThumbnail(callback: (err: Error | null, result: MemImageResult) => void): void;
+        decodeThumbnail(options: JpegDecodeOptions, callback: (err: Error | null, result: DecodedJpeg) => void): void;
 
         // Promisified versions (added by wrapper)
         loadFile(path: string): Promise<LoadResult>;
         loadBuffer(buffer: Buffer): Promise<LoadResult>;
+        openWithSnapshot(path: string, snapshot: Buffer): Promise<LoadResult>;
+        openWithMosaicCache(path: string, cachePath: string, snapshot?: Buffer | null): Promise<LoadResult>;
+        writeMosaicCache(cachePath: string): Promise<MosaicCacheResult>;
+        captureMosaicCache(cachePath: string): Promise<MosaicCaptureResult>;
         unpack(): Promise<{ success: boolean }>;
         unpackThumbnail(): Promise<ThumbnailInfo>;
         dcrawProcess(): Promise<ProcessResult>;
         processImage(): Promise<ProcessResult>;  // Alias for dcrawProcess
-        makeMemImage(): Promise<MemImageResult>;
+        makeMemImage(): Promise<ProcessedImageResult>;
+        readImageStrip(index: number): Promise<ImageStrip>;
+        makeJpeg(options?: JpegOptions): Promise<JpegImageResult>;
+        imageStrips(image: ProcessedImageResult): AsyncGenerator<ImageStrip>;
+        writeStripTiff(image: ProcessedImageResult, filePath: string, options?: { iccProfile?: Buffer }): Promise<void>;
         makeMemThumbnail(): Promise<MemImageResult>;
+        decodeThumbnail(options?: JpegDecodeOptions): Promise<DecodedJpeg>;
 
         // Synchronous metadata methods
         getMetadata(): Metadata;
         getImageSize(): ImageSize;
         getLensInfo(): LensInfo;
         getColorInfo(): ColorInfo;
+        getDecoderInfo(): DecoderInfo;
+        getMetadataRecord(): MetadataRecords;
+        getIdentifySnapshot(): Buffer;
 
         // Configuration methods
         setOutputColorSpace(colorSpace: number): void;
@@ -210,11 +485,18 @@ declare module '@filmgallery/libraw-native' {
         setUseAutoWB(useAutoWB: boolean): void;
         setQuality(quality: number): void;
         setHighlightMode(mode: number): void;
+        setMemImageLimit(bytes: number): void;
+        setExportColorSpace(colorSpace: number, transfer?: number): void;
+        setLinearFastPath(enabled: boolean): void;
+        setStandInLoaders(enabled: boolean): void;
+        setMonochrome(options: boolean | MonochromeOptions | null): void;
+        setHistogramBins(bins: number): void;
 
         // Utility methods
         recycle(): void;
         close(): void;
         isLoaded(): boolean;
+        setTraceJob(jobId: number): void;
     }
 
     /**
@@ -225,7 +507,8 @@ declare module '@filmgallery/libraw-native' {
     /**
      * Get list of all supported cameras
      */
-    export function getCameraList(): string[];
+    export function getCameraList(): readonly string[];
+    export function getCameraList(options: { detailed: true }): readonly CameraInfo[];
 
     /**
      * Get count of supported cameras
@@ -233,9 +516,263 @@ declare module '@filmgallery/libraw-native' {
     export function getCameraCount(): number;
 
     /**
-     * Check if a specific camera model is supported
+     * Check if a camera is supported, by display name or file make/model
+     */
+    export function isSupportedCamera(name: string): boolean;
+    export function isSupportedCamera(make: string, model: string): boolean;
+
+    /**
+     * Look up a camera by display name or file make/model
+     */
+    export function lookupCamera(name: string): CameraInfo | null;
+    export function lookupCamera(make: string, model: string): CameraInfo | null;
+
+    /**
+     * Batch lookup
+     */
+    export function lookupCameras(queries: CameraQuery[]): Array<CameraInfo | null>;
+
+    /**
+     * Packed metadata record layout
      */
-    export function isSupportedCamera(model: string): boolean;
+    export function getMetadataSchema(): MetadataSchema;
+
+    /**
+     * Read metadata for many files (headers only) into one packed block
+     */
+    export function readMetadataBatch(paths: string[], options?: { jobId?: number }): Promise<MetadataRecords>;
+
+    /**
+     * Pixel layout and spaces for convertColorSpace
+     */
+    export interface ColorConvertOptions {
+        width: number;
+        height: number;
+        /** 3 or 4 (alpha copied); default 3 */
+        channels?: number;
+        /** 8 or 16 (native byte order); default 8 */
+        bits?: number;
+        from: number;
+        to: number;
+        fromTransfer?: number;
+        toTransfer?: number;
+        jobId?: number;
+    }
+
+    /**
+     * Convert interleaved RGB(A) pixels between colour spaces into a new buffer
+     */
+    export function convertColorSpace(data: Buffer, options: ColorConvertOptions): Promise<Buffer>;
+
+    /**
+     * ICC profile for a colour space and transfer curve
+     */
+    export function getColorProfile(colorSpace: number, transfer?: number): Buffer;
+
+    /**
+     * Source layout and output sizes for buildDerivatives
+     */
+    export interface DerivativeOptions {
+        width: number;
+        height: number;
+        /** 3 or 4; default 3 */
+        channels?: number;
+        /** 8 or 16 (native byte order); default 8 */
+        bits?: number;
+        /** Encoding of the pixels; default Transfer.SRGB */
+        transfer?: number;
+        /** Bounding boxes (fit inside, never enlarged); a missing side is unconstrained */
+        sizes: Array<{ width?: number; height?: number }>;
+        /** Also append halvings while the long edge is at least this many pixels */
+        pyramid?: number;
+        jobId?: number;
+    }
+
+    export interface DerivativeImage {
+        width: number;
+        height: number;
+        channels: number;
+        bits: number;
+        data: Buffer;
+    }
+
+    /**
+     * Downsample one image into several sizes in one pass (pyramid levels last)
+     */
+    export function buildDerivatives(data: Buffer, options: DerivativeOptions): Promise<DerivativeImage[]>;
+
+    /**
+     * Encode interleaved gray/RGB/RGBA pixels (alpha dropped) as a baseline JPEG
+     */
+    export function encodeJpeg(data: Buffer, options: JpegOptions & {
+        width: number;
+        height: number;
+        /** 1, 3 or 4; default 3 */
+        channels?: number;
+        /** 8 or 16 (native byte order, high byte kept); default 8 */
+        bits?: number;
+        jobId?: number;
+    }): Promise<Buffer>;
+
+    /**
+     * Decode a baseline JPEG (progressive is rejected), optionally scaled down
+     */
+    export function decodeJpeg(data: Buffer, options?: JpegDecodeOptions & { jobId?: number }): Promise<DecodedJpeg>;
+
+    /**
+     * Tag values for writeMetadata, keyed by exiftool tag name (Make, FNumber,
+     * ExposureTime, GPSLatitude, Subject, XMP-FilmGallery:FilmName, ...).
+     * Numbers may be given as [numerator, denominator] or
+     * { numerator, denominator }; rationals also as 'a/b' strings.
+     */
+    export type MetadataTags = Record<string, string | number | [number, number] |
+        { numerator: number; denominator: number } | Array<string | number | [number, number]> | null | undefined>;
+
+    /**
+     * Write EXIF/XMP/IPTC into an encoded JPEG or classic TIFF; resolves to the new file contents
+     */
+    export function writeMetadata(data: Buffer, tags: MetadataTags, options?: { jobId?: number }): Promise<Buffer>;
+
+    /**
+     * Stage parameters from RenderCore.getNativeStages(sourceBits)
+     */
+    export interface FilmLabStages {
+        /** Planar R/G/B tables over [0, 1] (film curve to inversion) */
+        density: Float32Array;
+        lut1: { size: number; data: Float32Array; intensity: number } | null;
+        lut2: { size: number; data: Float32Array; intensity: number } | null;
+        /** Planar R/G/B tables over [0, 1] (white balance and tone) */
+        tone: Float32Array;
+        /** RGB master, red, green, blue curve LUTs */
+        curves: [Float32Array, Float32Array, Float32Array, Float32Array];
+        hsl: Float32Array | null;
+        saturation: number;
+        splitTone: Float32Array | null;
+        jobId?: number;
+    }
+
+    export type FilmLabStage = 'density' | 'tone' | 'curves' | 'color';
+
+    export interface PreviewImage {
+        data: Buffer;
+        width: number;
+        height: number;
+        /** 3 or 4 (alpha dropped); default 3 */
+        channels?: number;
+        /** 8 or 16 (native byte order); default 8 */
+        bits?: number;
+        /** Overrides the batch's stages */
+        stages?: FilmLabStages;
+    }
+
+    /**
+     * Render FilmLab stages onto a batch of small images with the fixed-point
+     * preview kernel; output is 8-bit RGB, in order
+     */
+    export function renderPreviews(images: PreviewImage[], options?: { stages?: FilmLabStages; jobId?: number }): Promise<Array<{ width: number; height: number; channels: 3; data: Buffer }>>;
+
+    /**
+     * Render one image under many sets of FilmLab stages with the fixed-point
+     * preview kernel; output is 8-bit RGB, one per stages entry
+     */
+    export function renderVariants(image: Omit<PreviewImage, 'stages'>, stages: FilmLabStages[], options?: { jobId?: number }): Promise<Array<{ width: number; height: number; channels: 3; data: Buffer }>>;
+
+    export interface TiledRenderOptions {
+        /** 'jpeg' (returned as data) or 'tiff16' (written to outputPath); default 'jpeg' */
+        format?: 'jpeg' | 'tiff16';
+        /** Required for tiff16 */
+        outputPath?: string;
+        /** Source rectangle to render (crop); default the whole image */
+        region?: { left: number; top: number; width: number; height: number };
+        /** JPEG quality 1-100; default 90 */
+        quality?: number;
+        subsampling?: '420' | '444';
+        iccProfile?: Buffer;
+        /** Rows per TIFF strip; default 64 */
+        stripRows?: number;
+        jobId?: number;
+    }
+
+    export interface TiledRenderResult {
+        width: number;
+        height: number;
+        /** Bits per sample of the source TIFF */
+        sourceBits: 8 | 16;
+        format: 'jpeg' | 'tiff16';
+        /** JPEG output */
+        data?: Buffer;
+        /** tiff16 output file */
+        path?: string;
+    }
+
+    /**
+     * Render FilmLab stages over a memory-mapped uncompressed TIFF band by
+     * band, straight into a JPEG or a 16-bit TIFF file
+     */
+    export function renderTiled(inputPath: string, stages: FilmLabStages, options?: TiledRenderOptions): Promise<TiledRenderResult>;
+
+    export interface FilmLabRender {
+        width: number;
+        height: number;
+        channels: 3;
+        /** First stage recomputed; earlier ones came from checkpoints */
+        startStage: FilmLabStage;
+        data: Buffer;
+    }
+
+    /**
+     * Checkpointed FilmLab renderer; renders are serialized and coalesce to
+     * the newest stages
+     */
+    export class FilmLabSession {
+        constructor();
+        setSource(data: Buffer, options: { width: number; height: number; channels?: number; bits?: number }): Promise<void>;
+        setMemoryLimit(bytes: number): Promise<void>;
+        render(stages: FilmLabStages): Promise<FilmLabRender>;
+        idle(): Promise<void>;
+        getInfo(): { width: number; height: number; checkpoints: FilmLabStage[]; checkpointBytes: number; busy: boolean };
+        close(): Promise<void>;
+    }
+
+    /**
+     * Visible region in full-resolution pixels (default: whole image) and
+     * the output size
+     */
+    export interface EditViewport {
+        x?: number;
+        y?: number;
+        width?: number;
+        height?: number;
+        outWidth: number;
+        outHeight: number;
+    }
+
+    export interface EditRender {
+        width: number;
+        height: number;
+        channels: 3;
+        /** Pyramid level the viewport was sampled from (0 = full resolution) */
+        level: number;
+        startStage: FilmLabStage | 'none';
+        /** Only when cancel() stopped the render with nothing queued */
+        cancelled: boolean;
+        data: Buffer | null;
+    }
+
+    /**
+     * Pan/zoom renderer over a resident full-resolution pyramid; a new
+     * render cancels the running one
+     */
+    export class FilmLabEditSession {
+        constructor();
+        setSource(data: Buffer, options: { width: number; height: number; channels?: number; bits?: number; minLevelSize?: number }): Promise<{ width: number; height: number; levels: Array<{ width: number; height: number }> }>;
+        setMemoryLimit(bytes: number): Promise<void>;
+        render(stages: FilmLabStages, viewport: EditViewport): Promise<EditRender>;
+        cancel(): void;
+        idle(): Promise<void>;
+        getInfo(): { width: number; height: number; levels: Array<{ width: number; height: number }>; pyramidBytes: number; checkpoints: FilmLabStage[]; busy: boolean };
+        close(): Promise<void>;
+    }
 
     /**
      * Check if the native module is available
@@ -246,10 +783,25 @@ declare module '@filmgallery/libraw-native' {
      * Get the load error if module failed to load
      */
     export function getLoadError(): Error | null;
+
+    /**
+     * Tracing - spans are kept in a native ring buffer while enabled
+     */
+    /** Largest trace ring buffer, in spans */
+    export const TRACE_MAX_CAPACITY: number;
+    /** @throws RangeError when capacity is not an integer in 0..TRACE_MAX_CAPACITY */
+    export function enableTracing(options?: { capacity?: number }): void;
+    export function disableTracing(): void;
+    export function isTracingEnabled(): boolean;
+    export function traceNow(): number;
+    export function recordTraceSpan(name: string, category: string, startUs: number, endUs: number, jobId?: number, isAsync?: boolean): void;
+    export function traceSpan<T>(name: string, category: string, jobId: number, fn: () => T): T;
+    export function dumpTrace(options?: TraceDumpOptions): ChromeTrace;
+    export function writeTrace(filePath: string, options?: TraceDumpOptions): Promise<void>;
 }
 
 declare module '@filmgallery/libraw-native/processor' {
-    import { Metadata, ImageSize, LensInfo, ColorInfo } from '@filmgallery/libraw-native';
+    import { Metadata, ImageSize, LensInfo, ColorInfo, MonochromeOptions } from '@filmgallery/libraw-native';
 
     export interface DecodeOptions {
         colorSpace?: number;
@@ -260,6 +812,7 @@ declare module '@filmgallery/libraw-native/processor' {
         noAutoBright?: boolean;
         halfSize?: boolean;
         highlightMode?: number;
+        monochrome?: boolean | MonochromeOptions | null;
     }
 
     export interface JPEGOptions extends DecodeOptions {
@@ -272,75 +272,8 @@ class RenderCore {
     const p = this.params;
     const luts = this.luts || this.prepareLUTs();
 
-    // ① Film Curve (H&D density model) — Q13: per-channel gamma + toe/shoulder
-    // Only when inverting negatives and film curve is enabled
-    if (p.inverted && p.filmCurveEnabled && p.filmCurveProfile) {
-      const profile = FILM_CURVE_PROFILES[p.filmCurveProfile];
-      if (profile) {
-        const gammaMain = p.filmCurveGamma ?? profile.gamma;
-        const dMin  = p.filmCurveDMin  ?? profile.dMin;
-        const dMax  = p.filmCurveDMax  ?? profile.dMax;
-        // Q13: prefer explicit params (from client), then profile, then defaults
-        const toe   = p.filmCurveToe ?? profile.toe ?? 0;
-        const shoulder = p.filmCurveShoulder ?? profile.shoulder ?? 0;
-
-        // Per-channel gamma: prefer explicit params, then profile, then main gamma
-        const gammaR = p.filmCurveGammaR ?? profile.gammaR ?? gammaMain;
-        const gammaG = p.filmCurveGammaG ?? profile.gammaG ?? gammaMain;
-        const gammaB = p.filmCurveGammaB ?? profile.gammaB ?? gammaMain;
-
-        r = applyFilmCurveFloat(r, { gamma: gammaR, dMin, dMax, toe, shoulder });
-        g = applyFilmCurveFloat(g, { gamma: gammaG, dMin, dMax, toe, shoulder });
-        b = applyFilmCurveFloat(b, { gamma: gammaB, dMin, dMax, toe, shoulder });
-      }
-    }
-
-    // ② Base Correction (neutralize film base color)
-    if (p.baseMode === 'log') {
-      // Log domain density subtraction (more accurate)
-      if (p.baseDensityR !== 0 || p.baseDensityG !== 0 || p.baseDensityB !== 0) {
-        const log10 = Math.log(10);
-        const minT = 0.001;
-        const Tr = Math.max(r, minT);
-        const Tg = Math.max(g, minT);
-        const Tb = Math.max(b, minT);
-        r = Math.pow(10, -(-Math.log(Tr) / log10 - p.baseDensityR));
-        g = Math.pow(10, -(-Math.log(Tg) / log10 - p.baseDensityG));
-        b = Math.pow(10, -(-Math.log(Tb) / log10 - p.baseDensityB));
-        r = Math.max(0, Math.min(1, r));
-        g = Math.max(0, Math.min(1, g));
-        b = Math.max(0, Math.min(1, b));
-      }
-    } else {
-      // Linear domain multiplication
-      if (p.baseRed !== 1.0 || p.baseGreen !== 1.0 || p.baseBlue !== 1.0) {
-        r = Math.max(0, Math.min(1, r * p.baseRed));
-        g = Math.max(0, Math.min(1, g * p.baseGreen));
-        b = Math.max(0, Math.min(1, b * p.baseBlue));
-      }
-    }
-
-    // ②.5 Density Levels (log domain auto-levels)
-    if (p.densityLevelsEnabled && p.baseMode === 'log') {
-      [r, g, b] = this._applyDensityLevelsFloat(r, g, b);
-    }
-
-    // ③ Inversion — inline float version
-    if (p.inverted) {
-      if (p.inversionMode === 'log') {
-        // Log inversion: out = 1 - log(in*255 + 1) / log(256)
-        // Adapted from invertLog() for 0-1 float range
-        const log256 = Math.log(256);
-        r = 1.0 - Math.log(r * 255 + 1) / log256;
-        g = 1.0 - Math.log(g * 255 + 1) / log256;
-        b = 1.0 - Math.log(b * 255 + 1) / log256;
-      } else {
-        // Linear inversion
-        r = 1.0 - r;
-        g = 1.0 - g;
-        b = 1.0 - b;
-      }
-    }
+    // ①–③ Film Curve, Base Correction, Density Levels, Inversion (per channel)
+    [r, g, b] = this._densityStageFloat(r, g, b);
 
     // ③b 3D LUT (after inversion — supports "Inversion LUT" workflows)
     if (luts.lut1) {
@@ -350,70 +283,8 @@ class RenderCore {
       [r, g, b] = this._sampleLUT3DFloat(r, g, b, luts.lut2, luts.lut2Intensity);
     }
 
-    // ④ White Balance — single call with cached gains
-    r *= luts.rBal;
-    g *= luts.gBal;
-    b *= luts.bBal;
-
-    // NaN guard
-    if (!Number.isFinite(r)) r = 0;
-    if (!Number.isFinite(g)) g = 0;
-    if (!Number.isFinite(b)) b = 0;
-
-    // ⑤ Tone Mapping — inline float math (replaces 8-bit toneLUT lookup)
-    // This matches the exact same formulas in buildToneLUT() / GPU shader,
-    // but without 8-bit quantization.
-
-    // 5a. Exposure (f-stop formula: 2^(exposure/50))
-    const expFactor = Math.pow(2, (Number(p.exposure) || 0) / 50);
-    r *= expFactor;
-    g *= expFactor;
-    b *= expFactor;
-
-    // 5b. Contrast (around perceptual mid-grey — Q11: 18% reflectance ≈ sRGB 0.46)
-    const ctr = Number(p.contrast) || 0;
-    if (ctr !== 0) {
-      const contrastFactor = (259 * (ctr + 255)) / (255 * (259 - ctr));
-      r = (r - CONTRAST_MID_GRAY) * contrastFactor + CONTRAST_MID_GRAY;
-      g = (g - CONTRAST_MID_GRAY) * contrastFactor + CONTRAST_MID_GRAY;
-      b = (b - CONTRAST_MID_GRAY) * contrastFactor + CONTRAST_MID_GRAY;
-    }
-
-    // 5c. Blacks & Whites (window remap)
-    const blackPoint = -(Number(p.blacks) || 0) * 0.002;
-    const whitePoint = 1.0 - (Number(p.whites) || 0) * 0.002;
-    if (blackPoint !== 0 || whitePoint !== 1) {
-      const range = whitePoint - blackPoint;
-      if (range > 0.001) {
-        r = (r - blackPoint) / range;
-        g = (g - blackPoint) / range;
-        b = (b - blackPoint) / range;
-      }
-    }
-
-    // 5d. Shadows (Bernstein basis, peak ~0.33)
-    const sFactor = (Number(p.shadows) || 0) * 0.005;
-    if (sFactor !== 0) {
-      const applyS = (v) => {
-        const c = Math.max(0, Math.min(1, v));
-        return v + sFactor * (1 - c) * (1 - c) * c * 4;
-      };
-      r = applyS(r);
-      g = applyS(g);
-      b = applyS(b);
-    }
-
-    // 5e. Highlights (Bernstein basis, peak ~0.67)
-    const hFactor = (Number(p.highlights) || 0) * 0.005;
-    if (hFactor !== 0) {
-      const applyH = (v) => {
-        const c = Math.max(0, Math.min(1, v));
-        return v + hFactor * c * c * (1 - c) * 4;
-      };
-      r = applyH(r);
-      g = applyH(g);
-      b = applyH(b);
-    }
+    // ④–⑤ White Balance, Tone Mapping (per channel)
+    [r, g, b] = this._toneStageFloat(r, g, b, luts);
 
     // ⑤b Highlight Roll-Off (Shoulder Compression)
     // Softly compress values > 0.8 into [0.8, 1.0] preserving color ratios
@@ -697,6 +568,65 @@ class RenderCore {
     };
   }
 
+  // ==========================================================================
+  // 原生分段参数 (FilmLabSession)
+  // ==========================================================================
+
+  /**
+   * 生成原生渲染会话 (@filmgallery/libraw-native FilmLabSession) 的分段参数
+   *
+   * 逐通道的阶段 (①–③ 密度/反转, ④–⑤ 白平衡/色调) 以查找表传递，
+   * 直接由 _densityStageFloat / _toneStageFloat 求值，与 processPixelFloat 一致；
+   * 跨通道的阶段 (3D LUT, 高光压缩, 曲线, HSL, 饱和度, 分离色调) 在原生端计算。
+   * 原生端逐阶段比较参数，只从最早变化的阶段开始重算。
+   *
+   * @param {number} [sourceBits=16] - 源像素位深 (8: 每个码值精确求值; 16: 4096 段线性插值)
+   * @returns {Object} 传给 FilmLabSession.render()
+   */
+  getNativeStages(sourceBits = 16) {
+    const p = this.params;
+    const luts = this.luts || this.prepareLUTs();
+
+    // 平面排列: [R 表, G 表, B 表]
+    const sampleChannels = (size, fn) => {
+      const table = new Float32Array(size * 3);
+      for (let i = 0; i < size; i++) {
+        const x = i / (size - 1);
+        const [r, g, b] = fn(x);
+        table[i] = r;
+        table[size + i] = g;
+        table[size * 2 + i] = b;
+      }
+      return table;
+    };
+
+    const lut3d = (lut, intensity) => (lut && lut.data && lut.size)
+      ? { size: lut.size, data: Float32Array.from(lut.data), intensity }
+      : null;
+
+    const split = luts.splitToneCtx;
+
+    return {
+      density: sampleChannels(sourceBits === 8 ? 256 : 4097, (x) => this._densityStageFloat(x, x, x)),
+      lut1: lut3d(luts.lut1, luts.lut1Intensity),
+      lut2: lut3d(luts.lut2, luts.lut2Intensity),
+      tone: sampleChannels(4097, (x) => this._toneStageFloat(x, x, x, luts)),
+      curves: [luts.lutRGBf, luts.lutRf, luts.lutGf, luts.lutBf],
+      hsl: (p.hslParams && !isDefaultHSL(p.hslParams))
+        ? Float32Array.from(this._packHSLParams(p.hslParams).flat())
+        : null,
+      saturation: isDefaultSaturation(p.saturation) ? 0 : p.saturation,
+      // [高光/中间调/阴影饱和度, 三组 tint RGB (0-255), balance]
+      splitTone: split
+        ? Float32Array.from([
+          split.highlightSat, split.midtoneSat, split.shadowSat,
+          ...split.highlightColor, ...split.midtoneColor, ...split.shadowColor,
+          split.balance,
+        ])
+        : null,
+    };
+  }
+
   /**
    * 获取 HSL GLSL 代码片段
    * 
@@ -979,6 +909,173 @@ vec3 applySplitTone(vec3 color, float highlightHue, float highlightSat,
   // Float Pipeline Helper Methods
   // ==========================================================================
 
+  /**
+   * ①–③ Film curve, base correction, density levels and inversion (float).
+   * Each channel depends only on its own input, so (x, x, x) evaluates all
+   * three per-channel curves at x (see getNativeStages).
+   *
+   * @param {number} r - Red transmittance (0.0–1.0)
+   * @param {number} g - Green transmittance (0.0–1.0)
+   * @param {number} b - Blue transmittance (0.0–1.0)
+   * @returns {[number, number, number]}
+   */
+  _densityStageFloat(r, g, b) {
+    const p = this.params;
+
+    // ① Film Curve (H&D density model) — Q13: per-channel gamma + toe/shoulder
+    // Only when inverting negatives and film curve is enabled
+    if (p.inverted && p.filmCurveEnabled && p.filmCurveProfile) {
+      const profile = FILM_CURVE_PROFILES[p.filmCurveProfile];
+      if (profile) {
+        const gammaMain = p.filmCurveGamma ?? profile.gamma;
+        const dMin  = p.filmCurveDMin  ?? profile.dMin;
+        const dMax  = p.filmCurveDMax  ?? profile.dMax;
+        // Q13: prefer explicit params (from client), then profile, then defaults
+        const toe   = p.filmCurveToe ?? profile.toe ?? 0;
+        const shoulder = p.filmCurveShoulder ?? profile.shoulder ?? 0;
+
+        // Per-channel gamma: prefer explicit params, then profile, then main gamma
+        const gammaR = p.filmCurveGammaR ?? profile.gammaR ?? gammaMain;
+        const gammaG = p.filmCurveGammaG ?? profile.gammaG ?? gammaMain;
+        const gammaB = p.filmCurveGammaB ?? profile.gammaB ?? gammaMain;
+
+        r = applyFilmCurveFloat(r, { gamma: gammaR, dMin, dMax, toe, shoulder });
+        g = applyFilmCurveFloat(g, { gamma: gammaG, dMin, dMax, toe, shoulder });
+        b = applyFilmCurveFloat(b, { gamma: gammaB, dMin, dMax, toe, shoulder });
+      }
+    }
+
+    // ② Base Correction (neutralize film base color)
+    if (p.baseMode === 'log') {
+      // Log domain density subtraction (more accurate)
+      if (p.baseDensityR !== 0 || p.baseDensityG !== 0 || p.baseDensityB !== 0) {
+        const log10 = Math.log(10);
+        const minT = 0.001;
+        const Tr = Math.max(r, minT);
+        const Tg = Math.max(g, minT);
+        const Tb = Math.max(b, minT);
+        r = Math.pow(10, -(-Math.log(Tr) / log10 - p.baseDensityR));
+        g = Math.pow(10, -(-Math.log(Tg) / log10 - p.baseDensityG));
+        b = Math.pow(10, -(-Math.log(Tb) / log10 - p.baseDensityB));
+        r = Math.max(0, Math.min(1, r));
+        g = Math.max(0, Math.min(1, g));
+        b = Math.max(0, Math.min(1, b));
+      }
+    } else {
+      // Linear domain multiplication
+      if (p.baseRed !== 1.0 || p.baseGreen !== 1.0 || p.baseBlue !== 1.0) {
+        r = Math.max(0, Math.min(1, r * p.baseRed));
+        g = Math.max(0, Math.min(1, g * p.baseGreen));
+        b = Math.max(0, Math.min(1, b * p.baseBlue));
+      }
+    }
+
+    // ②.5 Density Levels (log domain auto-levels)
+    if (p.densityLevelsEnabled && p.baseMode === 'log') {
+      [r, g, b] = this._applyDensityLevelsFloat(r, g, b);
+    }
+
+    // ③ Inversion — inline float version
+    if (p.inverted) {
+      if (p.inversionMode === 'log') {
+        // Log inversion: out = 1 - log(in*255 + 1) / log(256)
+        // Adapted from invertLog() for 0-1 float range
+        const log256 = Math.log(256);
+        r = 1.0 - Math.log(r * 255 + 1) / log256;
+        g = 1.0 - Math.log(g * 255 + 1) / log256;
+        b = 1.0 - Math.log(b * 255 + 1) / log256;
+      } else {
+        // Linear inversion
+        r = 1.0 - r;
+        g = 1.0 - g;
+        b = 1.0 - b;
+      }
+    }
+
+    return [r, g, b];
+  }
+
+  /**
+   * ④–⑤ White balance and tone mapping (float, per channel like
+   * _densityStageFloat; roll-off and clamping follow in processPixelFloat)
+   *
+   * @param {number} r
+   * @param {number} g
+   * @param {number} b
+   * @param {Object} luts - prepareLUTs() result
+   * @returns {[number, number, number]}
+   */
+  _toneStageFloat(r, g, b, luts) {
+    const p = this.params;
+
+    // ④ White Balance — single call with cached gains
+    r *= luts.rBal;
+    g *= luts.gBal;
+    b *= luts.bBal;
+
+    // NaN guard
+    if (!Number.isFinite(r)) r = 0;
+    if (!Number.isFinite(g)) g = 0;
+    if (!Number.isFinite(b)) b = 0;
+
+    // ⑤ Tone Mapping — inline float math (replaces 8-bit toneLUT lookup)
+    // This matches the exact same formulas in buildToneLUT() / GPU shader,
+    // but without 8-bit quantization.
+
+    // 5a. Exposure (f-stop formula: 2^(exposure/50))
+    const expFactor = Math.pow(2, (Number(p.exposure) || 0) / 50);
+    r *= expFactor;
+    g *= expFactor;
+    b *= expFactor;
+
+    // 5b. Contrast (around perceptual mid-grey — Q11: 18% reflectance ≈ sRGB 0.46)
+    const ctr = Number(p.contrast) || 0;
+    if (ctr !== 0) {
+      const contrastFactor = (259 * (ctr + 255)) / (255 * (259 - ctr));
+      r = (r - CONTRAST_MID_GRAY) * contrastFactor + CONTRAST_MID_GRAY;
+      g = (g - CONTRAST_MID_GRAY) * contrastFactor + CONTRAST_MID_GRAY;
+      b = (b - CONTRAST_MID_GRAY) * contrastFactor + CONTRAST_MID_GRAY;
+    }
+
+    // 5c. Blacks & Whites (window remap)
+    const blackPoint = -(Number(p.blacks) || 0) * 0.002;
+    const whitePoint = 1.0 - (Number(p.whites) || 0) * 0.002;
+    if (blackPoint !== 0 || whitePoint !== 1) {
+      const range = whitePoint - blackPoint;
+      if (range > 0.001) {
+        r = (r - blackPoint) / range;
+        g = (g - blackPoint) / range;
+        b = (b - blackPoint) / range;
+      }
+    }
+
+    // 5d. Shadows (Bernstein basis, peak ~0.33)
+    const sFactor = (Number(p.shadows) || 0) * 0.005;
+    if (sFactor !== 0) {
+      const applyS = (v) => {
+        const c = Math.max(0, Math.min(1, v));
+        return v + sFactor * (1 - c) * (1 - c) * c * 4;
+      };
+      r = applyS(r);
+      g = applyS(g);
+      b = applyS(b);
+    }
+
+    // 5e. Highlights (Bernstein basis, peak ~0.67)
+    const hFactor = (Number(p.highlights) || 0) * 0.005;
+    if (hFactor !== 0) {
+      const applyH = (v) => {
+        const c = Math.max(0, Math.min(1, v));
+        return v + hFactor * c * c * (1 - c) * 4;
+      };
+      r = applyH(r);
+      g = applyH(g);
+      b = applyH(b);
+    }
+
+    return [r, g, b];
+  }
+
   /**
    * Film curve (H&D density model) — float version
    * Operates on 0.0–1.0 transmittance values without 8-bit quantization.
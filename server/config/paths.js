@@ -38,4 +38,4 @@ if (!fs.existsSync(rollsDir)) fs.mkdirSync(rollsDir, { recursive: true });
 const filmDir = path.join(uploadsDir, 'films');
 if (!fs.existsSync(filmDir)) fs.mkdirSync(filmDir, { recursive: true });
 
-module.exports = { uploadsDir, tmpUploadDir, localTmpDir, rollsDir, filmDir };
+module.exports = { uploadsDir, tmpUploadDir, localTmpRoot, localTmpDir, rollsDir, filmDir };
@@ -7,13 +7,15 @@ const sharp = require('sharp');
 sharp.cache(false);
 const { uploadsDir } = require('../config/paths');
 const { buildPipeline } = require('../services/filmlab-service');
-const { generatePositiveThumb, cleanupOldThumb } = require('../services/thumb-service');
+const { generatePositiveThumb, writePositiveThumb, cleanupOldThumb, THUMB_WIDTH } = require('../services/thumb-service');
+const { getRollPreset } = require('../services/roll-service');
 
 // 使用统一渲染核心和源路径解析器
 const {
   RenderCore,
   EXPORT_MAX_WIDTH,
   PREVIEW_MAX_WIDTH_SERVER,
+  FILM_PROFILES,
   getEffectiveInverted
 } = require('../../packages/shared');
 
@@ -22,61 +24,143 @@ const {
   SOURCE_TYPE 
 } = require('../../packages/shared/sourcePathResolver');
 
-// POST /api/filmlab/preview
-// Body: { photoId, params, maxWidth, sourceType }
-router.post('/preview', async (req, res) => {
-  const { photoId, params, maxWidth, sourceType } = req.body || {};
-  if (!photoId) return res.status(400).json({ error: 'photoId required' });
-  try {
-    const row = await new Promise((resolve, reject) => {
-      db.get('SELECT id, roll_id, original_rel_path, positive_rel_path, full_rel_path, negative_rel_path FROM photos WHERE id = ?', [photoId], (err, r) => err ? reject(err) : resolve(r));
-    });
-    if (!row) return res.status(404).json({ error: 'photo not found' });
-    
-    // 【重要】使用严格源路径选择，不允许跨类型回退
-    const sourceResult = getStrictSourcePath(row, sourceType || 'original', {
-      allowFallbackWithinType: true,
-      allowCrossTypeFallback: false  // 绝不允许正片模式回退到负片
+// 原生分段渲染会话 (FilmLabSession): 缓存预览源图与各阶段检查点,
+// 拖动滑块时只重算受影响的阶段; 不可用时回退到 JS 逐像素渲染
+let LibRawNative = null;
+try {
+  LibRawNative = require('@filmgallery/libraw-native');
+  if (!LibRawNative.isAvailable() || !LibRawNative.FilmLabSession) LibRawNative = null;
+} catch (e) {
+  LibRawNative = null;
+}
+
+const PREVIEW_SESSION_LIMIT = 4;
+const PROFILE_STRIP_WIDTH = 320; // 胶片曲线选择器的样张宽度
+const VIEWPORT_SESSION_LIMIT = 2; // 全分辨率金字塔占用内存较大
+const previewSessions = new Map(); // photoId -> { key, session, bits, ready, users, retired }
+const viewportSessions = new Map();
+
+// 在照片的渲染会话 (LRU) 上执行 use(entry). 源文件、几何参数或尺寸变化时新建会话,
+// 通过 load(session) 载入源图后替换旧条目; 条目的 key/session/bits 创建后不再修改,
+// 并发请求不会用到彼此的源图或位深. 被替换或淘汰的会话在其请求结束后关闭
+async function withCachedSession(cache, limit, photoId, key, create, load, use) {
+  let entry = cache.get(photoId);
+  if (entry && entry.key === key) {
+    cache.delete(photoId); // 移到末尾 (LRU)
+  } else {
+    if (entry) {
+      cache.delete(photoId);
+      retireSession(entry);
+    }
+    const session = create();
+    entry = { key, session, bits: 8, users: 0, retired: false };
+    entry.ready = load(session).then((bits) => { entry.bits = bits; });
+    entry.ready.catch(() => {
+      if (cache.get(photoId) === entry) {
+        cache.delete(photoId);
+        retireSession(entry);
+      }
     });
-    
-    if (!sourceResult.path) {
-      // 如果正片模式但无正片文件，返回明确错误
-      return res.status(400).json({ 
+    if (cache.size >= limit) {
+      const [oldId, oldest] = cache.entries().next().value;
+      cache.delete(oldId);
+      retireSession(oldest);
+    }
+  }
+  cache.set(photoId, entry);
+
+  entry.users++;
+  try {
+    await entry.ready; // 并发请求共用同一次载入
+    return await use(entry);
+  } finally {
+    entry.users--;
+    if (entry.retired && entry.users === 0) entry.session.close().catch(() => {});
+  }
+}
+
+function retireSession(entry) {
+  entry.retired = true;
+  if (entry.users === 0) entry.session.close().catch(() => {});
+}
+
+// 解码 (旋转/缩放/裁剪后的) 源图为原始像素; sharp 保留源数据原始位深
+async function decodeRawSource(abs, params, options) {
+  const img = await buildPipeline(abs, params || {}, {
+    ...options,
+    toneAndCurvesInJs: true,
+    skipColorOps: true // Skip all color ops in Sharp, do everything in JS for consistency
+  });
+  const { data, info } = await img.raw().toBuffer({ resolveWithObject: true });
+  // 检测 16-bit 源
+  const bits = data.length >= info.width * info.height * info.channels * 2 ? 16 : 8;
+  // 16-bit 数据需要 2 字节对齐
+  const aligned = bits === 16 && data.byteOffset % 2 ? Buffer.from(data) : data;
+  return { data: aligned, width: info.width, height: info.height, channels: info.channels, bits };
+}
+
+// 按严格源路径规则查找照片源文件; 失败时返回 { status, body }
+async function resolvePhotoSource(photoId, sourceType, logTag) {
+  const row = await new Promise((resolve, reject) => {
+    db.get('SELECT id, roll_id, original_rel_path, positive_rel_path, full_rel_path, negative_rel_path FROM photos WHERE id = ?', [photoId], (err, r) => err ? reject(err) : resolve(r));
+  });
+  if (!row) return { status: 404, body: { error: 'photo not found' } };
+
+  // 【重要】使用严格源路径选择，不允许跨类型回退
+  const sourceResult = getStrictSourcePath(row, sourceType || 'original', {
+    allowFallbackWithinType: true,
+    allowCrossTypeFallback: false  // 绝不允许正片模式回退到负片
+  });
+
+  if (!sourceResult.path) {
+    // 如果正片模式但无正片文件，返回明确错误
+    return {
+      status: 400,
+      body: {
         error: 'source_type_unavailable',
         message: sourceResult.warning || `No ${sourceType} file available for this photo`,
         sourceType,
         photoId
-      });
-    }
-    
-    const relSource = sourceResult.path;
-    
-    // 记录警告（如有）
-    if (sourceResult.warning) {
-      console.log(`[FilmLab Preview] Photo ${photoId}: ${sourceResult.warning}`);
-    }
-    
-    const abs = path.join(uploadsDir, relSource);
-    if (!fs.existsSync(abs)) return res.status(404).json({ error: 'source missing on disk' });
+      }
+    };
+  }
 
-    // Build pipeline: rotate/resize/crop only. All color ops applied via shared module for client/server parity.
-    let img = await buildPipeline(abs, params || {}, { 
-      maxWidth: maxWidth || PREVIEW_MAX_WIDTH_SERVER, 
-      cropRect: (params && params.cropRect) || null, 
-      toneAndCurvesInJs: true,
-      skipColorOps: true // Skip all color ops in Sharp, do everything in JS for consistency
-    });
+  const relSource = sourceResult.path;
 
-    // Pull raw buffer — sharp 保留源数据原始位深
-    const { data, info } = await img.raw().toBuffer({ resolveWithObject: true });
-    const width = info.width;
-    const height = info.height;
-    const channels = info.channels; // expect 3
-    const out = Buffer.allocUnsafe(width * height * 3);
+  // 记录警告（如有）
+  if (sourceResult.warning) {
+    console.log(`[${logTag}] Photo ${photoId}: ${sourceResult.warning}`);
+  }
 
-    // 检测 16-bit 源
-    const expectedBytes8 = width * height * channels;
-    const is16bit = (data.length >= expectedBytes8 * 2);
+  const abs = path.join(uploadsDir, relSource);
+  if (!fs.existsSync(abs)) return { status: 404, body: { error: 'source missing on disk' } };
+  return { abs, relSource };
+}
+
+function sendJpegNoCache(res, buf) {
+  res.setHeader('Content-Type', 'image/jpeg');
+  res.setHeader('Cache-Control', 'no-store, no-cache, must-revalidate, proxy-revalidate');
+  res.setHeader('Pragma', 'no-cache');
+  res.setHeader('Expires', '0');
+  res.setHeader('Surrogate-Control', 'no-store');
+  res.end(buf);
+}
+
+// POST /api/filmlab/preview
+// Body: { photoId, params, maxWidth, sourceType }
+router.post('/preview', async (req, res) => {
+  const { photoId, params, maxWidth, sourceType } = req.body || {};
+  if (!photoId) return res.status(400).json({ error: 'photoId required' });
+  try {
+    const source = await resolvePhotoSource(photoId, sourceType, 'FilmLab Preview');
+    if (source.status) return res.status(source.status).json(source.body);
+    const { abs, relSource } = source;
+
+    const effectiveMaxWidth = maxWidth || PREVIEW_MAX_WIDTH_SERVER;
+    const cropRect = (params && params.cropRect) || null;
+
+    // Build pipeline: rotate/resize/crop only. All color ops applied via shared module for client/server parity.
+    const decodeSource = () => decodeRawSource(abs, params, { maxWidth: effectiveMaxWidth, cropRect });
 
     // 使用统一渲染核心
     // 使用 getEffectiveInverted 计算有效反转状态，正片模式不需要反转
@@ -84,43 +168,217 @@ router.post('/preview', async (req, res) => {
     const core = new RenderCore({ ...params, inverted: effectiveInverted });
     core.prepareLUTs();
 
-    // 使用 processPixelFloat 全浮点处理（预览也用浮点以确保一致性）
-    if (is16bit) {
-      const pixels = new Uint16Array(data.buffer, data.byteOffset, data.byteLength / 2);
-      for (let i = 0, j = 0; i < pixels.length; i += channels, j += 3) {
-        const [rF, gF, bF] = core.processPixelFloat(
-          pixels[i] / 65535, pixels[i + 1] / 65535, pixels[i + 2] / 65535
-        );
-        out[j]     = Math.min(255, Math.max(0, Math.round(rF * 255)));
-        out[j + 1] = Math.min(255, Math.max(0, Math.round(gF * 255)));
-        out[j + 2] = Math.min(255, Math.max(0, Math.round(bF * 255)));
-      }
+    let out, width, height;
+    if (LibRawNative) {
+      // 原生路径: 几何参数不变时复用已解码源图, 只从最早变化的阶段重算
+      const stat = fs.statSync(abs);
+      const key = JSON.stringify([
+        relSource, stat.mtimeMs, sourceType || 'original',
+        params?.rotation || 0, params?.orientation || 0, cropRect, effectiveMaxWidth
+      ]);
+      const result = await withCachedSession(previewSessions, PREVIEW_SESSION_LIMIT, photoId, key,
+        () => new LibRawNative.FilmLabSession(),
+        async (session) => {
+          const decoded = await decodeSource();
+          await session.setSource(decoded.data, decoded);
+          return decoded.bits;
+        },
+        (entry) => entry.session.render(core.getNativeStages(entry.bits)));
+      ({ data: out, width, height } = result);
     } else {
-      for (let i = 0, j = 0; i < data.length; i += channels, j += 3) {
-        const [rF, gF, bF] = core.processPixelFloat(
-          data[i] / 255, data[i + 1] / 255, data[i + 2] / 255
-        );
-        out[j]     = Math.min(255, Math.max(0, Math.round(rF * 255)));
-        out[j + 1] = Math.min(255, Math.max(0, Math.round(gF * 255)));
-        out[j + 2] = Math.min(255, Math.max(0, Math.round(bF * 255)));
+      const { data, width: w, height: h, channels, bits } = await decodeSource();
+      width = w;
+      height = h;
+      out = Buffer.allocUnsafe(width * height * 3);
+
+      // 使用 processPixelFloat 全浮点处理（预览也用浮点以确保一致性）
+      if (bits === 16) {
+        const pixels = new Uint16Array(data.buffer, data.byteOffset, data.byteLength / 2);
+        for (let i = 0, j = 0; i < pixels.length; i += channels, j += 3) {
+          const [rF, gF, bF] = core.processPixelFloat(
+            pixels[i] / 65535, pixels[i + 1] / 65535, pixels[i + 2] / 65535
+          );
+          out[j]     = Math.min(255, Math.max(0, Math.round(rF * 255)));
+          out[j + 1] = Math.min(255, Math.max(0, Math.round(gF * 255)));
+          out[j + 2] = Math.min(255, Math.max(0, Math.round(bF * 255)));
+        }
+      } else {
+        for (let i = 0, j = 0; i < data.length; i += channels, j += 3) {
+          const [rF, gF, bF] = core.processPixelFloat(
+            data[i] / 255, data[i + 1] / 255, data[i + 2] / 255
+          );
+          out[j]     = Math.min(255, Math.max(0, Math.round(rF * 255)));
+          out[j + 1] = Math.min(255, Math.max(0, Math.round(gF * 255)));
+          out[j + 2] = Math.min(255, Math.max(0, Math.round(bF * 255)));
+        }
       }
     }
 
     // Encode to JPEG and send
-    res.setHeader('Content-Type', 'image/jpeg');
-    res.setHeader('Cache-Control', 'no-store, no-cache, must-revalidate, proxy-revalidate');
-    res.setHeader('Pragma', 'no-cache');
-    res.setHeader('Expires', '0');
-    res.setHeader('Surrogate-Control', 'no-store');
     const buf = await sharp(out, { raw: { width, height, channels: 3 } }).jpeg({ quality: 85 }).toBuffer();
     console.log('[Server Preview] JPEG buffer size:', buf.length, 'bytes');
-    res.end(buf);
+    sendJpegNoCache(res, buf);
   } catch (e) {
     console.error('[FILMLAB] preview error', e);
     res.status(500).json({ error: e && e.message });
   }
 });
 
+// POST /api/filmlab/viewport
+// Body: { photoId, params, sourceType, viewport: { x, y, width, height, outWidth, outHeight } }
+// 平移/缩放编辑: 全分辨率源图常驻为金字塔, 只渲染可见区域 (坐标为旋转后的全分辨率像素);
+// 新请求会取消同一照片上仍在进行的渲染
+router.post('/viewport', async (req, res) => {
+  const { photoId, params, sourceType, viewport } = req.body || {};
+  if (!photoId) return res.status(400).json({ error: 'photoId required' });
+  if (!viewport || !(viewport.outWidth > 0) || !(viewport.outHeight > 0)) {
+    return res.status(400).json({ error: 'viewport.outWidth/outHeight required' });
+  }
+  if (!LibRawNative) return res.status(501).json({ error: 'native_unavailable' });
+  try {
+    const source = await resolvePhotoSource(photoId, sourceType, 'FilmLab Viewport');
+    if (source.status) return res.status(source.status).json(source.body);
+    const { abs, relSource } = source;
+
+    const stat = fs.statSync(abs);
+    const key = JSON.stringify([
+      relSource, stat.mtimeMs, sourceType || 'original', params?.rotation || 0, params?.orientation || 0
+    ]);
+    const effectiveInverted = getEffectiveInverted(sourceType, params?.inverted);
+    const core = new RenderCore({ ...params, inverted: effectiveInverted });
+    core.prepareLUTs();
+    const result = await withCachedSession(viewportSessions, VIEWPORT_SESSION_LIMIT, photoId, key,
+      () => new LibRawNative.FilmLabEditSession(),
+      async (session) => {
+        const decoded = await decodeRawSource(abs, params, { maxWidth: null, cropRect: null });
+        await session.setSource(decoded.data, decoded);
+        return decoded.bits;
+      },
+      (entry) => entry.session.render(core.getNativeStages(entry.bits), viewport));
+    if (result.cancelled) return res.status(409).json({ error: 'render_cancelled' });
+
+    const buf = await sharp(result.data, { raw: { width: result.width, height: result.height, channels: 3 } })
+      .jpeg({ quality: 85 }).toBuffer();
+    res.setHeader('X-Pyramid-Level', String(result.level));
+    sendJpegNoCache(res, buf);
+  } catch (e) {
+    console.error('[FILMLAB] viewport error', e);
+    res.status(500).json({ error: e && e.message });
+  }
+});
+
+// POST /api/filmlab/profiles
+// Body: { photoId, params, sourceType, profiles?, maxWidth? }
+// 胶片曲线选择器: 小尺寸源图只解码一次, 由 renderVariants 在同一次遍历中渲染每条曲线
+// (profiles 缺省为全部 FILM_PROFILES); 返回各曲线的 JPEG (data URL)
+router.post('/profiles', async (req, res) => {
+  const { photoId, params, sourceType, maxWidth } = req.body || {};
+  if (!photoId) return res.status(400).json({ error: 'photoId required' });
+  if (!LibRawNative || !LibRawNative.renderVariants) return res.status(501).json({ error: 'native_unavailable' });
+  const profiles = (Array.isArray(req.body.profiles) ? req.body.profiles : Object.keys(FILM_PROFILES))
+    .filter((key) => FILM_PROFILES[key]);
+  if (!profiles.length) return res.status(400).json({ error: 'no known profiles' });
+  try {
+    const source = await resolvePhotoSource(photoId, sourceType, 'FilmLab Profiles');
+    if (source.status) return res.status(source.status).json(source.body);
+
+    const cropRect = (params && params.cropRect) || null;
+    const decoded = await decodeRawSource(source.abs, params, { maxWidth: maxWidth || PROFILE_STRIP_WIDTH, cropRect });
+
+    // 曲线只在反转 + filmCurveEnabled 时生效, 选择器总是打开曲线
+    const effectiveInverted = getEffectiveInverted(sourceType, params?.inverted);
+    const stages = profiles.map((filmCurveProfile) => new RenderCore({
+      ...params, inverted: effectiveInverted, filmCurveEnabled: true, filmCurveProfile
+    }).getNativeStages(decoded.bits));
+    const variants = await LibRawNative.renderVariants(decoded, stages);
+
+    const images = await Promise.all(variants.map((v) =>
+      sharp(v.data, { raw: { width: v.width, height: v.height, channels: 3 } }).jpeg({ quality: 80 }).toBuffer()));
+    res.json({
+      width: decoded.width,
+      height: decoded.height,
+      profiles: profiles.map((key, i) => ({
+        key,
+        name: FILM_PROFILES[key].name,
+        image: `data:image/jpeg;base64,${images[i].toString('base64')}`
+      }))
+    });
+  } catch (e) {
+    console.error('[FILMLAB] profiles error', e);
+    res.status(500).json({ error: e && e.message });
+  }
+});
+
+// POST /api/filmlab/roll-thumbs
+// Body: { rollId, params?, sourceType }
+// 整卷重建正片缩略图: params 缺省为胶卷预设; 各帧按缩略图尺寸解码后由 renderPreviews
+// 一次批量渲染 (同位深的帧共用一个内核), 再写入 thumb-service 约定的路径
+router.post('/roll-thumbs', async (req, res) => {
+  const { rollId, sourceType } = req.body || {};
+  if (!rollId) return res.status(400).json({ error: 'rollId required' });
+  if (!LibRawNative || !LibRawNative.renderPreviews) return res.status(501).json({ error: 'native_unavailable' });
+  try {
+    let params = req.body.params;
+    if (!params) {
+      const preset = await getRollPreset(rollId);
+      params = (preset && preset.params) || {};
+    }
+    const rows = await new Promise((resolve, reject) => {
+      db.all('SELECT id, roll_id, frame_number, original_rel_path, positive_rel_path, full_rel_path, negative_rel_path, positive_thumb_rel_path FROM photos WHERE roll_id = ?', [rollId], (err, r) => err ? reject(err) : resolve(r || []));
+    });
+
+    const effectiveInverted = getEffectiveInverted(sourceType, params.inverted);
+    const core = new RenderCore({ ...params, inverted: effectiveInverted });
+    core.prepareLUTs();
+    const stagesByBits = new Map();
+    const stagesFor = (bits) => {
+      if (!stagesByBits.has(bits)) stagesByBits.set(bits, core.getNativeStages(bits));
+      return stagesByBits.get(bits);
+    };
+
+    // 逐帧解码, 避免整卷全分辨率源图同时驻留
+    const frames = [];
+    let skipped = 0;
+    for (const row of rows) {
+      const sourceResult = getStrictSourcePath(row, sourceType || 'original', {
+        allowFallbackWithinType: true,
+        allowCrossTypeFallback: false
+      });
+      const abs = sourceResult.path && path.join(uploadsDir, sourceResult.path);
+      if (!abs || !fs.existsSync(abs)) {
+        skipped++;
+        continue;
+      }
+      try {
+        const decoded = await decodeRawSource(abs, params, { maxWidth: THUMB_WIDTH, cropRect: params.cropRect || null });
+        frames.push({ row, image: { ...decoded, stages: stagesFor(decoded.bits) } });
+      } catch (err) {
+        console.warn(`[FILMLAB] roll-thumbs: photo ${row.id} decode failed:`, err.message);
+        skipped++;
+      }
+    }
+
+    const rendered = frames.length ? await LibRawNative.renderPreviews(frames.map((f) => f.image)) : [];
+    let updated = 0;
+    for (let i = 0; i < frames.length; i++) {
+      const { row } = frames[i];
+      const { data, width, height } = rendered[i];
+      const { relPath } = await writePositiveThumb(data, width, height, row.roll_id, row.frame_number);
+      cleanupOldThumb(row.positive_thumb_rel_path, relPath);
+      await new Promise((resolve, reject) => {
+        db.run('UPDATE photos SET positive_thumb_rel_path = ?, updated_at = CURRENT_TIMESTAMP WHERE id = ?',
+          [relPath, row.id], (err) => err ? reject(err) : resolve());
+      });
+      updated++;
+    }
+
+    res.json({ ok: true, updated, skipped });
+  } catch (e) {
+    console.error('[FILMLAB] roll-thumbs error', e);
+    res.status(500).json({ error: e && e.message });
+  }
+});
+
 // POST /api/filmlab/render
 // Body: { photoId, params, sourceType }
 router.post('/render', async (req, res) => {
@@ -84,6 +84,59 @@ router.get('/supported-formats', async (req, res) => {
   }
 });
 
+/**
+ * GET /api/raw/cameras
+ * 
+ * 支持的相机列表 (含能力信息)，用于 UI 过滤
+ * 
+ * Query:
+ * - q: 名称/别名关键字 (可选)
+ * - make: 厂商 (可选)
+ * - capability: xtrans | multiFrame | monochrome (可选)
+ */
+router.get('/cameras', (req, res) => {
+  try {
+    let cameras = rawDecoder.getCameraList({ detailed: true });
+    const q = (req.query.q || '').toString().trim().toLowerCase();
+    const make = (req.query.make || '').toString().trim().toLowerCase();
+    const capability = (req.query.capability || '').toString();
+
+    if (make) {
+      cameras = cameras.filter(c => c.make.toLowerCase() === make);
+    }
+    if (q) {
+      cameras = cameras.filter(c => c.name.toLowerCase().includes(q)
+        || c.aliases.some(a => a.toLowerCase().includes(q)));
+    }
+    if (['xtrans', 'multiFrame', 'monochrome'].includes(capability)) {
+      cameras = cameras.filter(c => c[capability]);
+    }
+
+    res.json({ success: true, count: cameras.length, cameras });
+  } catch (error) {
+    res.status(500).json({ success: false, error: error.message });
+  }
+});
+
+/**
+ * POST /api/raw/cameras/lookup
+ * 
+ * 批量查询相机支持情况
+ * 
+ * Request Body: { cameras: Array<string | { make, model }> }
+ */
+router.post('/cameras/lookup', (req, res) => {
+  const queries = req.body && req.body.cameras;
+  if (!Array.isArray(queries)) {
+    return res.status(400).json({ success: false, error: 'cameras must be an array' });
+  }
+  try {
+    res.json({ success: true, results: rawDecoder.lookupCameras(queries) });
+  } catch (error) {
+    res.status(500).json({ success: false, error: error.message });
+  }
+});
+
 /**
  * POST /api/raw/decode
  * 
@@ -96,6 +149,7 @@ router.get('/supported-formats', async (req, res) => {
  * - quality: 0-3 (default: 3)
  * - outputBits: 8 | 16 (default: 16)
  * - halfSize: boolean (default: false)
+ * - monochrome: boolean (default: false) - 黑白扫描直接输出单通道亮度
  */
 router.post('/decode', rawUpload.single('file'), async (req, res) => {
   try {
@@ -118,7 +172,8 @@ router.post('/decode', rawUpload.single('file'), async (req, res) => {
       whiteBalance: req.body.whiteBalance || 'camera',
       quality: parseInt(req.body.quality) || 3,
       outputBits: parseInt(req.body.outputBits) || 16,
-      halfSize: req.body.halfSize === 'true' || req.body.halfSize === true
+      halfSize: req.body.halfSize === 'true' || req.body.halfSize === true,
+      monochrome: req.body.monochrome === 'true' || req.body.monochrome === true
     };
 
     const result = await rawDecoder.decode(req.file.path, options);
@@ -16,6 +16,7 @@ const { runEquipmentMigration } = require('./utils/equipment-migration');
 const { runFilmStructMigration } = require('./utils/film-struct-migration');
 const { cacheSeconds } = require('./utils/cache');
 const { requestProfiler, getProfilerStats, scheduleProfilerLog } = require('./utils/profiler');
+const trace = require('./utils/trace');
 const PreparedStmt = require('./utils/prepared-statements');
 const { computeGuard } = require('./middleware/compute-guard');
 const { getServerMode, getCapabilities, isComputeEnabled } = require('../packages/shared/serverCapabilities');
@@ -183,6 +184,18 @@ const mountRoutes = () => {
   app.use('/api/raw', require('./routes/raw')); // RAW file decoding
   app.use('/api/filesystem', require('./routes/filesystem')); // Filesystem browsing for hybrid mode
   app.get('/api/_profiler', (req, res) => res.json(getProfilerStats()));
+  // Chrome trace JSON for native decode + render pipelines (?jobId=&since=&until=)
+  app.get('/api/_trace', (req, res) => {
+    const num = (v) => (v !== undefined && v !== '' ? Number(v) : undefined);
+    res.json(trace.dump({ jobId: num(req.query.jobId), since: num(req.query.since), until: num(req.query.until) }));
+  });
+  app.post('/api/_trace', (req, res) => {
+    const { enabled = true, capacity } = req.body || {};
+    if (capacity !== undefined && !(Number.isInteger(capacity) && capacity > 0 && capacity <= trace.MAX_CAPACITY)) {
+      return res.status(400).json({ error: `capacity must be an integer from 1 to ${trace.MAX_CAPACITY}` });
+    }
+    res.json({ ok: trace.setEnabled(!!enabled, capacity), enabled: trace.isEnabled() });
+  });
   app.get('/api/_prepared-statements', (req, res) => res.json(PreparedStmt.getStats()));
   
   // Port discovery API for mobile/watch auto-discovery
@@ -10,7 +10,7 @@ const fs = require('fs');
 const os = require('os');
 const db = require('../db');
 const { uploadsDir } = require('../config/paths');
-const { buildExifData, writeExif, writeExifWithExiftool } = require('./exif-service');
+const { buildExifData, writeExif, copyWithExif } = require('./exif-service');
 
 // ============================================================================
 // 常量定义
@@ -36,6 +36,11 @@ const NAMING_PATTERNS = {
   CUSTOM: 'custom'
 };
 
+/**
+ * 写入完整 EXIF/XMP 的文件扩展名
+ */
+const EXIF_EXTENSIONS = ['.jpg', '.jpeg', '.tif', '.tiff'];
+
 // ============================================================================
 // 照片查询
 // ============================================================================
@@ -262,9 +267,6 @@ async function prepareDownload(options) {
   const tempFilename = `${photoId}_${Date.now()}${ext}`;
   const tempPath = path.join(tempDir, tempFilename);
 
-  // 复制文件
-  fs.copyFileSync(sourcePath, tempPath);
-
   // 构建并写入 EXIF (photo 现在包含完整的 JOIN 数据)
   const exifData = buildExifData(photo, null, exifOptions);
   
@@ -278,19 +280,21 @@ async function prepareDownload(options) {
   }).catch(() => []);
   
   try {
-    // 只对 JPEG 文件写入完整的 EXIF/XMP
-    if (['.jpg', '.jpeg'].includes(ext.toLowerCase())) {
-      await writeExifWithExiftool(tempPath, exifData, {
+    // JPEG/TIFF 写入完整的 EXIF/XMP (读入内存写入后一次写出)
+    if (EXIF_EXTENSIONS.includes(ext.toLowerCase())) {
+      await copyWithExif(sourcePath, tempPath, exifData, {
         keywords: tags,
         rollTitle: photo.roll_title
       });
     } else {
-      // 对非 JPEG 文件使用基本 EXIF 写入
+      // 其他文件使用基本 EXIF 写入
+      fs.copyFileSync(sourcePath, tempPath);
       await writeExif(tempPath, exifData);
     }
   } catch (e) {
     console.error('[DownloadService] Failed to write EXIF:', e.message);
     // 即使 EXIF 写入失败，也返回文件
+    fs.copyFileSync(sourcePath, tempPath);
   }
 
   return {
@@ -361,11 +365,8 @@ async function batchDownload(photoIds, type, outputDir, options = {}) {
       const outputFilename = generateFilename(photo, namingPattern, ext);
       const outputPath = path.join(outputDir, outputFilename);
 
-      // 复制文件
-      fs.copyFileSync(sourcePath, outputPath);
-
-      // 写入 EXIF (photo 现在包含完整的 JOIN 数据)
-      if (shouldWriteExif && (ext.toLowerCase() === '.jpg' || ext.toLowerCase() === '.jpeg')) {
+      // 写入 EXIF (photo 现在包含完整的 JOIN 数据); 否则直接复制
+      if (shouldWriteExif && EXIF_EXTENSIONS.includes(ext.toLowerCase())) {
         const exifData = buildExifData(photo, null, exifOptions);
         
         // 获取关键词 (tags)
@@ -378,14 +379,17 @@ async function batchDownload(photoIds, type, outputDir, options = {}) {
         }).catch(() => []);
         
         try {
-          await writeExifWithExiftool(outputPath, exifData, {
+          await copyWithExif(sourcePath, outputPath, exifData, {
             keywords: tags,
             rollTitle: photo.roll_title
           });
         } catch (e) {
           console.error(`[DownloadService] Failed to write EXIF for photo ${photoId}:`, e.message);
           // 继续处理，不中断
+          fs.copyFileSync(sourcePath, outputPath);
         }
+      } else {
+        fs.copyFileSync(sourcePath, outputPath);
       }
 
       result.success++;
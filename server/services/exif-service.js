@@ -27,6 +27,15 @@ try {
   exiftool = null;
 }
 
+// 原生 EXIF/XMP 写入 (在内存中拼接到编码后的 JPEG/TIFF); 不可用时回退到 exiftool
+let LibRawNative = null;
+try {
+  LibRawNative = require('@filmgallery/libraw-native');
+  if (!LibRawNative.isAvailable()) LibRawNative = null;
+} catch (e) {
+  LibRawNative = null;
+}
+
 // ============================================================================
 // 常量定义
 // ============================================================================
@@ -603,9 +612,223 @@ async function readExif(filePath) {
   }
 }
 
+/**
+ * 构建 exiftool 标签名格式的写入数据 (exiftool 与原生写入共用)
+ * @param {Object} exifData - EXIF 数据对象 (由 buildExifData 返回)
+ * @param {Object} [options] - 额外选项
+ * @param {string[]} [options.keywords] - 关键词/标签
+ * @param {string} [options.rollTitle] - 卷标题
+ * @returns {Object} 标签名 -> 值
+ */
+function buildWriteData(exifData, options = {}) {
+  // 构建 exiftool 格式的写入数据
+  const writeData = {};
+  
+  // ========== 标准 EXIF 标签 ==========
+  // 相机信息
+  if (exifData.Make) writeData.Make = exifData.Make;
+  if (exifData.Model) writeData.Model = exifData.Model;
+  if (exifData.LensModel) writeData.LensModel = exifData.LensModel;
+  if (exifData.LensMake) writeData.LensMake = exifData.LensMake;
+  
+  // 拍摄参数
+  if (exifData.FNumber) writeData.FNumber = exifData.FNumber;
+  if (exifData.ExposureTime) {
+    // 转换分数为字符串
+    if (typeof exifData.ExposureTime === 'object') {
+      writeData.ExposureTime = `${exifData.ExposureTime.numerator}/${exifData.ExposureTime.denominator}`;
+    } else {
+      writeData.ExposureTime = exifData.ExposureTime;
+    }
+  }
+  if (exifData.ISOSpeedRatings) writeData.ISO = exifData.ISOSpeedRatings;
+  if (exifData.FocalLength) writeData.FocalLength = exifData.FocalLength;
+  
+  // 日期时间
+  if (exifData.DateTimeOriginal) {
+    writeData.DateTimeOriginal = exifData.DateTimeOriginal;
+    writeData.CreateDate = exifData.DateTimeOriginal;
+  }
+  
+  // GPS
+  if (exifData.GPSLatitude) {
+    // exiftool 接受十进制度数
+    const latDMS = exifData.GPSLatitude;
+    const lat = latDMS[0][0] + latDMS[1][0] / 60 + latDMS[2][0] / latDMS[2][1] / 3600;
+    const latSign = exifData.GPSLatitudeRef === 'S' ? -1 : 1;
+    writeData.GPSLatitude = lat * latSign;
+  }
+  if (exifData.GPSLongitude) {
+    const lonDMS = exifData.GPSLongitude;
+    const lon = lonDMS[0][0] + lonDMS[1][0] / 60 + lonDMS[2][0] / lonDMS[2][1] / 3600;
+    const lonSign = exifData.GPSLongitudeRef === 'W' ? -1 : 1;
+    writeData.GPSLongitude = lon * lonSign;
+  }
+  
+  // 描述信息
+  if (exifData.ImageDescription) writeData.ImageDescription = exifData.ImageDescription;
+  if (exifData.UserComment) writeData.UserComment = exifData.UserComment;
+  if (exifData.Artist) writeData.Artist = exifData.Artist;
+  if (exifData.Copyright) writeData.Copyright = exifData.Copyright;
+  if (exifData.Software) writeData.Software = exifData.Software;
+  
+  // ========== IPTC/XMP 关键词 ==========
+  const keywords = [...(options.keywords || [])];
+  if (exifData.FilmName) keywords.push(exifData.FilmName);
+  if (exifData.DevelopLab) keywords.push(exifData.DevelopLab);
+  if (keywords.length > 0) {
+    writeData.Subject = keywords;
+    writeData.Keywords = keywords;
+  }
+  
+  // ========== 构建综合描述 ==========
+  const descParts = [];
+  if (exifData.ImageDescription) descParts.push(exifData.ImageDescription);
+  if (options.rollTitle) descParts.push(`Roll: ${options.rollTitle}`);
+  
+  // 胶片信息
+  const filmParts = [];
+  if (exifData.FilmBrand) filmParts.push(exifData.FilmBrand);
+  if (exifData.FilmName) filmParts.push(exifData.FilmName);
+  if (exifData.FilmISO) filmParts.push(`ISO ${exifData.FilmISO}`);
+  if (exifData.FilmFormat) filmParts.push(exifData.FilmFormat);
+  if (filmParts.length > 0) {
+    descParts.push(`Film: ${filmParts.join(' ')}`);
+  }
+  
+  // 冲洗信息
+  const developParts = [];
+  if (exifData.DevelopLab) developParts.push(`Lab: ${exifData.DevelopLab}`);
+  if (exifData.DevelopProcess) developParts.push(`Process: ${exifData.DevelopProcess}`);
+  if (exifData.DevelopDate) developParts.push(`Date: ${exifData.DevelopDate}`);
+  if (developParts.length > 0) {
+    descParts.push(`Develop: ${developParts.join(', ')}`);
+  }
+  
+  if (descParts.length > 1) {
+    writeData.ImageDescription = descParts.join(' | ');
+  }
+  
+  // UserComment 包含更详细信息
+  const userCommentParts = [];
+  if (filmParts.length > 0) userCommentParts.push(`Film: ${filmParts.join(' ')}`);
+  if (exifData.LensModel) userCommentParts.push(`Lens: ${exifData.LensModel}`);
+  if (developParts.length > 0) userCommentParts.push(developParts.join(', '));
+  if (userCommentParts.length > 0) {
+    writeData.UserComment = userCommentParts.join(' | ');
+  }
+  
+  // ========== XMP-FilmGallery 自定义命名空间 ==========
+  // 扫描仪/数字化信息
+  if (exifData.ScannerMake) {
+    writeData['XMP-FilmGallery:ScannerMake'] = exifData.ScannerMake;
+  }
+  if (exifData.ScannerModel) {
+    writeData['XMP-FilmGallery:ScannerModel'] = exifData.ScannerModel;
+  }
+  if (exifData.ScannerSoftware) {
+    writeData['XMP-FilmGallery:ScanSoftware'] = exifData.ScannerSoftware;
+  }
+  if (exifData.ScanResolution) {
+    writeData['XMP-FilmGallery:ScanResolution'] = exifData.ScanResolution;
+  }
+  if (exifData.ScanBitDepth) {
+    writeData['XMP-FilmGallery:ScanBitDepth'] = exifData.ScanBitDepth;
+  }
+  if (exifData.ScanDate) {
+    writeData['XMP-FilmGallery:ScanDate'] = exifData.ScanDate;
+  }
+  
+  // 扫描仪设备信息 (来自设备库)
+  if (exifData.ScannerEquipment) {
+    writeData['XMP-FilmGallery:ScannerEquipment'] = exifData.ScannerEquipment;
+  }
+  if (exifData.ScannerEquipBrand) {
+    writeData['XMP-FilmGallery:ScannerEquipBrand'] = exifData.ScannerEquipBrand;
+  }
+  if (exifData.ScannerEquipModel) {
+    writeData['XMP-FilmGallery:ScannerEquipModel'] = exifData.ScannerEquipModel;
+  }
+  if (exifData.ScannerType) {
+    writeData['XMP-FilmGallery:ScannerType'] = exifData.ScannerType;
+  }
+  
+  // 胶片信息 (XMP)
+  if (exifData.FilmName) {
+    writeData['XMP-FilmGallery:FilmName'] = exifData.FilmName;
+  }
+  if (exifData.FilmBrand) {
+    writeData['XMP-FilmGallery:FilmBrand'] = exifData.FilmBrand;
+  }
+  if (exifData.FilmISO) {
+    writeData['XMP-FilmGallery:FilmISO'] = exifData.FilmISO;
+  }
+  if (exifData.FilmFormat) {
+    writeData['XMP-FilmGallery:FilmFormat'] = exifData.FilmFormat;
+  }
+  if (exifData.FilmProcess) {
+    writeData['XMP-FilmGallery:FilmProcess'] = exifData.FilmProcess;
+  }
+  
+  // 冲洗信息 (XMP)
+  if (exifData.DevelopLab) {
+    writeData['XMP-FilmGallery:DevelopLab'] = exifData.DevelopLab;
+  }
+  if (exifData.DevelopProcess) {
+    writeData['XMP-FilmGallery:DevelopProcess'] = exifData.DevelopProcess;
+  }
+  if (exifData.DevelopDate) {
+    writeData['XMP-FilmGallery:DevelopDate'] = exifData.DevelopDate;
+  }
+  
+  return writeData;
+}
+
+/**
+ * 使用原生模块将 EXIF/XMP 写入内存中的 JPEG/TIFF 数据
+ * (无需 exiftool 进程往返和整文件重写)
+ * @param {Buffer} data - 编码后的 JPEG/TIFF 文件内容
+ * @param {Object} exifData - EXIF 数据对象 (由 buildExifData 返回)
+ * @param {Object} [options] - 同 buildWriteData
+ * @returns {Promise<Buffer|null>} 写入后的数据; 原生模块不可用或写入失败时为 null
+ */
+async function embedExif(data, exifData, options = {}) {
+  if (!LibRawNative) return null;
+  
+  try {
+    return await LibRawNative.writeMetadata(data, buildWriteData(exifData, options));
+  } catch (err) {
+    console.warn('[ExifService] Native metadata write failed, falling back to exiftool:', err.message);
+    return null;
+  }
+}
+
+/**
+ * 复制图片并写入 EXIF/XMP: 优先在内存中写入后一次性写出,
+ * 否则复制后使用 exiftool 改写
+ * @param {string} sourcePath - 源文件路径
+ * @param {string} outputPath - 输出文件路径
+ * @param {Object} exifData - EXIF 数据对象 (由 buildExifData 返回)
+ * @param {Object} [options] - 同 buildWriteData
+ * @returns {Promise<boolean>} 写入是否成功
+ */
+async function copyWithExif(sourcePath, outputPath, exifData, options = {}) {
+  if (LibRawNative) {
+    const tagged = await embedExif(await fs.promises.readFile(sourcePath), exifData, options);
+    if (tagged) {
+      await fs.promises.writeFile(outputPath, tagged);
+      return true;
+    }
+  }
+  
+  await fs.promises.copyFile(sourcePath, outputPath);
+  return writeExifExternal(outputPath, exifData, options);
+}
+
 /**
  * 使用 exiftool-vendored 写入完整的 EXIF/XMP 数据
  * 支持标准 EXIF、IPTC 和 XMP 自定义命名空间 (FilmGallery)
+ * 原生模块可用时在内存中写入, 不启动 exiftool
  * 
  * @param {string} filePath - 图片文件路径
  * @param {Object} exifData - EXIF 数据对象 (由 buildExifData 返回)
@@ -615,6 +838,25 @@ async function readExif(filePath) {
  * @returns {Promise<boolean>} 写入是否成功
  */
 async function writeExifWithExiftool(filePath, exifData, options = {}) {
+  if (LibRawNative) {
+    const tagged = await embedExif(await fs.promises.readFile(filePath), exifData, options);
+    if (tagged) {
+      await fs.promises.writeFile(filePath, tagged);
+      return true;
+    }
+  }
+  
+  return writeExifExternal(filePath, exifData, options);
+}
+
+/**
+ * 使用 exiftool 改写文件 (不可用时回退到 piexif)
+ * @param {string} filePath - 图片文件路径
+ * @param {Object} exifData - EXIF 数据对象
+ * @param {Object} [options] - 同 buildWriteData
+ * @returns {Promise<boolean>} 写入是否成功
+ */
+async function writeExifExternal(filePath, exifData, options = {}) {
   if (!exiftool) {
     console.warn('[ExifService] exiftool-vendored not available, falling back to piexif');
     // 回退到 piexif (不支持 XMP)
@@ -623,165 +865,7 @@ async function writeExifWithExiftool(filePath, exifData, options = {}) {
   }
   
   try {
-    // 构建 exiftool 格式的写入数据
-    const writeData = {};
-    
-    // ========== 标准 EXIF 标签 ==========
-    // 相机信息
-    if (exifData.Make) writeData.Make = exifData.Make;
-    if (exifData.Model) writeData.Model = exifData.Model;
-    if (exifData.LensModel) writeData.LensModel = exifData.LensModel;
-    if (exifData.LensMake) writeData.LensMake = exifData.LensMake;
-    
-    // 拍摄参数
-    if (exifData.FNumber) writeData.FNumber = exifData.FNumber;
-    if (exifData.ExposureTime) {
-      // 转换分数为字符串
-      if (typeof exifData.ExposureTime === 'object') {
-        writeData.ExposureTime = `${exifData.ExposureTime.numerator}/${exifData.ExposureTime.denominator}`;
-      } else {
-        writeData.ExposureTime = exifData.ExposureTime;
-      }
-    }
-    if (exifData.ISOSpeedRatings) writeData.ISO = exifData.ISOSpeedRatings;
-    if (exifData.FocalLength) writeData.FocalLength = exifData.FocalLength;
-    
-    // 日期时间
-    if (exifData.DateTimeOriginal) {
-      writeData.DateTimeOriginal = exifData.DateTimeOriginal;
-      writeData.CreateDate = exifData.DateTimeOriginal;
-    }
-    
-    // GPS
-    if (exifData.GPSLatitude) {
-      // exiftool 接受十进制度数
-      const latDMS = exifData.GPSLatitude;
-      const lat = latDMS[0][0] + latDMS[1][0] / 60 + latDMS[2][0] / latDMS[2][1] / 3600;
-      const latSign = exifData.GPSLatitudeRef === 'S' ? -1 : 1;
-      writeData.GPSLatitude = lat * latSign;
-    }
-    if (exifData.GPSLongitude) {
-      const lonDMS = exifData.GPSLongitude;
-      const lon = lonDMS[0][0] + lonDMS[1][0] / 60 + lonDMS[2][0] / lonDMS[2][1] / 3600;
-      const lonSign = exifData.GPSLongitudeRef === 'W' ? -1 : 1;
-      writeData.GPSLongitude = lon * lonSign;
-    }
-    
-    // 描述信息
-    if (exifData.ImageDescription) writeData.ImageDescription = exifData.ImageDescription;
-    if (exifData.UserComment) writeData.UserComment = exifData.UserComment;
-    if (exifData.Artist) writeData.Artist = exifData.Artist;
-    if (exifData.Copyright) writeData.Copyright = exifData.Copyright;
-    if (exifData.Software) writeData.Software = exifData.Software;
-    
-    // ========== IPTC/XMP 关键词 ==========
-    const keywords = options.keywords || [];
-    if (exifData.FilmName) keywords.push(exifData.FilmName);
-    if (exifData.DevelopLab) keywords.push(exifData.DevelopLab);
-    if (keywords.length > 0) {
-      writeData.Subject = keywords;
-      writeData.Keywords = keywords;
-    }
-    
-    // ========== 构建综合描述 ==========
-    const descParts = [];
-    if (exifData.ImageDescription) descParts.push(exifData.ImageDescription);
-    if (options.rollTitle) descParts.push(`Roll: ${options.rollTitle}`);
-    
-    // 胶片信息
-    const filmParts = [];
-    if (exifData.FilmBrand) filmParts.push(exifData.FilmBrand);
-    if (exifData.FilmName) filmParts.push(exifData.FilmName);
-    if (exifData.FilmISO) filmParts.push(`ISO ${exifData.FilmISO}`);
-    if (exifData.FilmFormat) filmParts.push(exifData.FilmFormat);
-    if (filmParts.length > 0) {
-      descParts.push(`Film: ${filmParts.join(' ')}`);
-    }
-    
-    // 冲洗信息
-    const developParts = [];
-    if (exifData.DevelopLab) developParts.push(`Lab: ${exifData.DevelopLab}`);
-    if (exifData.DevelopProcess) developParts.push(`Process: ${exifData.DevelopProcess}`);
-    if (exifData.DevelopDate) developParts.push(`Date: ${exifData.DevelopDate}`);
-    if (developParts.length > 0) {
-      descParts.push(`Develop: ${developParts.join(', ')}`);
-    }
-    
-    if (descParts.length > 1) {
-      writeData.ImageDescription = descParts.join(' | ');
-    }
-    
-    // UserComment 包含更详细信息
-    const userCommentParts = [];
-    if (filmParts.length > 0) userCommentParts.push(`Film: ${filmParts.join(' ')}`);
-    if (exifData.LensModel) userCommentParts.push(`Lens: ${exifData.LensModel}`);
-    if (developParts.length > 0) userCommentParts.push(developParts.join(', '));
-    if (userCommentParts.length > 0) {
-      writeData.UserComment = userCommentParts.join(' | ');
-    }
-    
-    // ========== XMP-FilmGallery 自定义命名空间 ==========
-    // 扫描仪/数字化信息
-    if (exifData.ScannerMake) {
-      writeData['XMP-FilmGallery:ScannerMake'] = exifData.ScannerMake;
-    }
-    if (exifData.ScannerModel) {
-      writeData['XMP-FilmGallery:ScannerModel'] = exifData.ScannerModel;
-    }
-    if (exifData.ScannerSoftware) {
-      writeData['XMP-FilmGallery:ScanSoftware'] = exifData.ScannerSoftware;
-    }
-    if (exifData.ScanResolution) {
-      writeData['XMP-FilmGallery:ScanResolution'] = exifData.ScanResolution;
-    }
-    if (exifData.ScanBitDepth) {
-      writeData['XMP-FilmGallery:ScanBitDepth'] = exifData.ScanBitDepth;
-    }
-    if (exifData.ScanDate) {
-      writeData['XMP-FilmGallery:ScanDate'] = exifData.ScanDate;
-    }
-    
-    // 扫描仪设备信息 (来自设备库)
-    if (exifData.ScannerEquipment) {
-      writeData['XMP-FilmGallery:ScannerEquipment'] = exifData.ScannerEquipment;
-    }
-    if (exifData.ScannerEquipBrand) {
-      writeData['XMP-FilmGallery:ScannerEquipBrand'] = exifData.ScannerEquipBrand;
-    }
-    if (exifData.ScannerEquipModel) {
-      writeData['XMP-FilmGallery:ScannerEquipModel'] = exifData.ScannerEquipModel;
-    }
-    if (exifData.ScannerType) {
-      writeData['XMP-FilmGallery:ScannerType'] = exifData.ScannerType;
-    }
-    
-    // 胶片信息 (XMP)
-    if (exifData.FilmName) {
-      writeData['XMP-FilmGallery:FilmName'] = exifData.FilmName;
-    }
-    if (exifData.FilmBrand) {
-      writeData['XMP-FilmGallery:FilmBrand'] = exifData.FilmBrand;
-    }
-    if (exifData.FilmISO) {
-      writeData['XMP-FilmGallery:FilmISO'] = exifData.FilmISO;
-    }
-    if (exifData.FilmFormat) {
-      writeData['XMP-FilmGallery:FilmFormat'] = exifData.FilmFormat;
-    }
-    if (exifData.FilmProcess) {
-      writeData['XMP-FilmGallery:FilmProcess'] = exifData.FilmProcess;
-    }
-    
-    // 冲洗信息 (XMP)
-    if (exifData.DevelopLab) {
-      writeData['XMP-FilmGallery:DevelopLab'] = exifData.DevelopLab;
-    }
-    if (exifData.DevelopProcess) {
-      writeData['XMP-FilmGallery:DevelopProcess'] = exifData.DevelopProcess;
-    }
-    if (exifData.DevelopDate) {
-      writeData['XMP-FilmGallery:DevelopDate'] = exifData.DevelopDate;
-    }
+    const writeData = buildWriteData(exifData, options);
     
     console.log('[ExifService] Writing EXIF with exiftool:', Object.keys(writeData).length, 'tags');
     
@@ -810,6 +894,9 @@ module.exports = {
   buildExifData,
   writeExif,
   writeExifWithExiftool,
+  buildWriteData,
+  embedExif,
+  copyWithExif,
   readExif,
   
   // 辅助函数
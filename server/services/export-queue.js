@@ -21,6 +21,8 @@ const RenderCore = require('../../packages/shared/render/RenderCore');
 const { buildExportParams, validateExportParams } = require('../../packages/shared/filmLabExport');
 const { JPEG_QUALITY, EXPORT_MAX_WIDTH } = require('../../packages/shared/filmLabConstants');
 const { uploadsDir } = require('../config/paths');
+const trace = require('../utils/trace');
+const tiledRender = require('./tiled-render');
 
 // ============================================================================
 // 常量定义
@@ -74,6 +76,7 @@ class ExportJob {
     this.startedAt = null;
     this.completedAt = null;
     this.results = [];
+    this.traceId = trace.newJobId(); // 追踪 (Chrome trace) 中的任务 ID
   }
 
   /**
@@ -463,11 +466,12 @@ class ExportQueue extends EventEmitter {
     const inputPath = path.join(uploadsDir, relSource);
 
     // 执行导出
-    await this._exportPhoto(inputPath, outputPath, params, {
+    await trace.span('export_photo', 'export', job.traceId, () => this._exportPhoto(inputPath, outputPath, params, {
       format: job.format,
       quality: job.quality,
       maxWidth: job.maxWidth,
-    });
+      traceJob: job.traceId,
+    }));
 
     return {
       photoId,
@@ -486,7 +490,7 @@ class ExportQueue extends EventEmitter {
    * @param {Object} options - 导出选项
    */
   async _exportPhoto(inputPath, outputPath, params, options) {
-    const { format, quality, maxWidth } = options;
+    const { format, quality, maxWidth, traceJob = 0 } = options;
     
     // 使用 sharp 加载图像
     const image = sharp(inputPath, { failOn: 'none' });
@@ -513,15 +517,34 @@ class ExportQueue extends EventEmitter {
       pipeline = pipeline.resize({ width: targetWidth, withoutEnlargement: true });
     }
     
+    // 原生分块渲染 (JPEG / 16-bit TIFF): 内存与图像尺寸无关, 失败时回退到内存路径
+    if (tiledRender.isAvailable() && format !== 'PNG' && (format !== 'TIFF' || use16bit)) {
+      try {
+        const rendered = await tiledRender.renderPipeline(pipeline.clone(), new RenderCore(params), {
+          format: format === 'TIFF' ? 'tiff16' : 'jpeg',
+          quality,
+          cropRect: params.cropRect || null,
+          outputPath,
+          traceJob,
+        });
+        if (rendered.buffer) {
+          await trace.span('write', 'io', traceJob, () => fs.writeFile(outputPath, rendered.buffer));
+        }
+        return;
+      } catch (err) {
+        console.warn(`[ExportQueue] Tiled render failed, using in-memory path: ${err.message}`);
+      }
+    }
+    
     // 获取像素数据 — 高位深源使用 16-bit 以保留 RAW 动态范围
     let rawOpts = {};
     if (use16bit) {
       rawOpts = { depth: 'ushort' };
     }
     
-    const { data, info } = await pipeline
+    const { data, info } = await trace.span('read', 'io', traceJob, () => pipeline
       .raw(rawOpts)
-      .toBuffer({ resolveWithObject: true });
+      .toBuffer({ resolveWithObject: true }));
     
     // 创建 RenderCore 实例 — 传入完整参数 (自动归一化/兼容映射)
     const renderer = new RenderCore(params);
@@ -535,6 +558,7 @@ class ExportQueue extends EventEmitter {
       const pixels = new Uint16Array(data.buffer, data.byteOffset, data.byteLength / 2);
       const output = new Uint16Array(pixels.length);
       const maxVal = 65535;
+      const renderStart = trace.begin();
       
       for (let i = 0; i < pixels.length; i += channels) {
         const rIn = pixels[i] / maxVal;
@@ -551,6 +575,7 @@ class ExportQueue extends EventEmitter {
           output[i + 3] = pixels[i + 3]; // 保留 alpha
         }
       }
+      trace.end('render', 'render', traceJob, renderStart);
       
       // 重新构造 sharp 管线 (16-bit raw input)
       let finalPipeline = sharp(Buffer.from(output.buffer), {
@@ -566,10 +591,11 @@ class ExportQueue extends EventEmitter {
         finalPipeline = this._applyCrop(finalPipeline, params.cropRect, info);
       }
       
-      await this._writeOutput(finalPipeline, outputPath, format, quality, true);
+      await trace.span('encode', 'encode', traceJob, () => this._writeOutput(finalPipeline, outputPath, format, quality, true));
     } else {
       // ── 8-bit 源路径: 使用 processPixelFloat 保证一致性 ──
       const output = Buffer.alloc(data.length);
+      const renderStart = trace.begin();
       
       for (let i = 0; i < data.length; i += channels) {
         const [rF, gF, bF] = renderer.processPixelFloat(
@@ -584,6 +610,7 @@ class ExportQueue extends EventEmitter {
           output[i + 3] = data[i + 3]; // 保留 alpha
         }
       }
+      trace.end('render', 'render', traceJob, renderStart);
       
       let finalPipeline = sharp(output, {
         raw: {
@@ -597,7 +624,7 @@ class ExportQueue extends EventEmitter {
         finalPipeline = this._applyCrop(finalPipeline, params.cropRect, info);
       }
       
-      await this._writeOutput(finalPipeline, outputPath, format, quality, false);
+      await trace.span('encode', 'encode', traceJob, () => this._writeOutput(finalPipeline, outputPath, format, quality, false));
     }
   }
 
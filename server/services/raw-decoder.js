@@ -8,6 +8,11 @@
  */
 
 const path = require('path');
+const os = require('os');
+const fs = require('fs');
+const trace = require('../utils/trace');
+const identifyCache = require('./raw-identify-cache');
+const mosaicCache = require('./raw-mosaic-cache');
 
 // ============================================================================
 // 模块加载 - 优先使用 @filmgallery/libraw-native
@@ -92,6 +97,22 @@ function createProcessor() {
   return null;
 }
 
+/**
+ * 导出色彩空间 (decode 的 options.colorSpace)
+ * @param {string} name - 'srgb' | 'adobe' | 'prophoto' | 'p3' | 'rec2020'
+ * @returns {number|null} ColorSpace 常量，sRGB/未知时为 null
+ */
+function exportColorSpace(name) {
+  const { ColorSpace } = LibRawNative;
+  const spaces = {
+    adobe: ColorSpace.ADOBE,
+    prophoto: ColorSpace.PROPHOTO,
+    p3: ColorSpace.DCIP3,
+    rec2020: ColorSpace.REC2020
+  };
+  return spaces[String(name || '').toLowerCase()] || null;
+}
+
 /**
  * 判断是否使用原生模块
  */
@@ -99,6 +120,51 @@ function isNativeDecoder() {
   return activeDecoder === 'native';
 }
 
+/**
+ * 打开 RAW 文件
+ * 原生模块下复用缓存的 identify 快照跳过元数据解析；
+ * 首次打开或快照失效（文件已修改）时重新生成并写入缓存
+ * @param {Object} processor - createProcessor() 返回的实例
+ * @param {string} inputPath - RAW 文件路径
+ * @param {Object} [options]
+ * @param {boolean} [options.unpack=false] - 随后要解码像素：优先从马赛克缓存载入已解包的数据，
+ *   未命中时解包并写入缓存
+ */
+async function openRawFile(processor, inputPath, { unpack = false } = {}) {
+  if (!isNativeDecoder()) {
+    return processor.loadFile(inputPath);
+  }
+
+  const snapshot = await identifyCache.get(inputPath);
+  const cachePath = unpack && mosaicCache.isEnabled() ? mosaicCache.entryPath(inputPath) : null;
+  let result;
+  if (cachePath) {
+    result = await processor.openWithMosaicCache(inputPath, cachePath, snapshot);
+  } else if (snapshot) {
+    result = await processor.openWithSnapshot(inputPath, snapshot);
+  } else {
+    result = await processor.loadFile(inputPath);
+  }
+
+  if (!result.fromSnapshot && !result.fromMosaic) {
+    try {
+      await identifyCache.put(inputPath, processor.getIdentifySnapshot());
+    } catch (e) {
+      // 个别格式（如 Foveon）不支持快照，照常解码
+    }
+  }
+
+  if (cachePath) {
+    if (result.fromMosaic) {
+      await mosaicCache.touch(cachePath);
+    } else if (mosaicCache.worthCaching(processor)) {
+      // 只等待解包与复制，写盘和淘汰在后台完成
+      await mosaicCache.write(processor, cachePath);
+    }
+  }
+  return result;
+}
+
 // ============================================================================
 // RawDecoder 类
 // ============================================================================
@@ -140,11 +206,12 @@ class RawDecoder {
 
   /**
    * 检查特定相机是否支持
-   * @param {string} model - 相机型号
+   * @param {string} makeOrName - 厂商 (提供 model 时) 或完整相机名称
+   * @param {string} [model] - 文件中的相机型号
    */
-  isCameraSupported(model) {
+  isCameraSupported(makeOrName, model) {
     if (LibRawNative) {
-      return LibRawNative.isSupportedCamera(model);
+      return LibRawNative.isSupportedCamera(makeOrName, model);
     }
     // lightdrift-libraw 没有这个功能
     return null;
@@ -192,6 +259,10 @@ class RawDecoder {
    * @param {number} options.quality - JPEG 质量 (1-100)，默认 95
    * @param {boolean} options.halfSize - 使用半尺寸解码（更快）
    * @param {boolean} options.useCameraWB - 使用相机白平衡
+   * @param {boolean|Object} options.monochrome - 黑白输出：Bayer 数据直接插值为单通道亮度
+   *   (可传 {weights: [r, g, b]} 指定通道权重)
+   * @param {string} options.colorSpace - 输出色彩空间 ('srgb' | 'adobe' | 'prophoto' | 'p3' | 'rec2020')，默认 sRGB
+   * @param {number} options.traceJob - 追踪任务 ID (见 utils/trace)
    * @param {Function} onProgress - 进度回调 (percent, message)
    * @returns {Promise<Buffer>} 图像 Buffer
    */
@@ -206,12 +277,16 @@ class RawDecoder {
     }
 
     const outputFormat = (options.outputFormat || 'jpeg').toLowerCase();
+    const traceJob = options.traceJob || 0;
+    if (isNativeDecoder() && traceJob) {
+      processor.setTraceJob(traceJob);
+    }
     
     try {
       if (onProgress) onProgress(10, '加载 RAW 文件...');
       
-      // 加载文件
-      await processor.loadFile(inputPath);
+      // 加载文件（命中马赛克缓存时已是解包状态）
+      await openRawFile(processor, inputPath, { unpack: true });
       
       if (onProgress) onProgress(30, '配置处理参数...');
       
@@ -229,6 +304,10 @@ class RawDecoder {
         if (options.demosaicQuality !== undefined) {
           processor.setQuality(options.demosaicQuality);
         }
+        if (options.monochrome) {
+          // 输出经 sharp/原生 JPEG 编码，只用整数亮度
+          processor.setMonochrome(options.monochrome === true ? true : { weights: options.monochrome.weights });
+        }
         // 设置输出位深度 - TIFF 默认 16 位以保持质量
         if (options.outputBps !== undefined) {
           processor.setOutputBps(options.outputBps);
@@ -238,6 +317,15 @@ class RawDecoder {
         }
       }
       
+      // 非 sRGB 输出：LibRaw 直接输出到目标色彩空间（不经 sRGB 裁剪），
+      // 复制图像时由原生层套用该空间的标准传递曲线，并走条带 TIFF 路径嵌入 ICC
+      const exportSpace = isNativeDecoder() ? exportColorSpace(options.colorSpace) : null;
+      if (exportSpace) {
+        processor.setOutputColorSpace(exportSpace);
+        processor.setExportColorSpace(exportSpace);
+        processor.setMemImageLimit(0);
+      }
+      
       if (onProgress) onProgress(50, '处理图像...');
       
       // 处理图像
@@ -250,11 +338,40 @@ class RawDecoder {
       
       let buffer;
       
-      if (isNativeDecoder()) {
+      // 基线 JPEG 由原生层直接编码：输出转换与分带并行编码融合，不经 sharp，
+      // 也不生成完整的 RGB 缓冲区；失败时（如超过 65535 像素）回退到 sharp
+      if (isNativeDecoder() && outputFormat === 'jpeg' && !options.progressive &&
+          typeof processor.makeJpeg === 'function') {
+        try {
+          const jpeg = await trace.span('encode', 'encode', traceJob,
+            () => processor.makeJpeg({ quality: options.quality || 95 }));
+          buffer = jpeg.data;
+        } catch (e) {
+          console.warn('[RawDecoder] Native JPEG encode failed, falling back to sharp:', e.message);
+        }
+      }
+      
+      if (buffer) {
+        // 已由原生编码器生成
+      } else if (isNativeDecoder()) {
         // @filmgallery/libraw-native - 使用 makeMemImage 获取原始图像数据
         const imageData = await processor.makeMemImage();
         
-        if (!imageData || !imageData.data) {
+        // 超大图像（拼接/超高分辨率扫描）以条带返回：逐条写入临时 TIFF，
+        // 由 sharp 顺序读取，避免单个超大 Buffer
+        let stripFile = null;
+        if (imageData && !imageData.data && imageData.stripCount) {
+          stripFile = path.join(os.tmpdir(), `filmgallery-raw-${process.pid}-${Date.now()}.tif`);
+          const iccProfile = imageData.transfer !== null
+            ? LibRawNative.getColorProfile(imageData.colorSpace, imageData.transfer)
+            : undefined;
+          try {
+            await trace.span('write_strips', 'decode', traceJob, () => processor.writeStripTiff(imageData, stripFile, { iccProfile }));
+          } catch (e) {
+            fs.promises.unlink(stripFile).catch(() => {});
+            throw e;
+          }
+        } else if (!imageData || !imageData.data) {
           throw new Error('Failed to create memory image');
         }
         
@@ -280,7 +397,13 @@ class RawDecoder {
         // 注意：sharp 根据 TypedArray 类型来推断位深度
         // Buffer -> 默认 8 位, Uint16Array -> 16 位
         let sharpInput;
-        if (is16bit) {
+        if (stripFile) {
+          sharpInput = sharp(stripFile, { limitInputPixels: false, sequentialRead: true });
+          if (imageData.transfer !== null) {
+            // 像素已在目标色彩空间，保留嵌入的 ICC 而不是转换到 sRGB
+            sharpInput = sharpInput.keepIccProfile();
+          }
+        } else if (is16bit) {
           // 将 Buffer 转换为 Uint16Array，以便 sharp 正确识别为 16 位
           // LibRaw 在 Windows 上输出 little-endian 数据，与 Uint16Array 兼容
           const pixelData = new Uint16Array(
@@ -308,23 +431,29 @@ class RawDecoder {
           });
         }
         
-        if (outputFormat === 'tiff') {
-          // TIFF 输出 - 保持原始位深度
-          // sharp 会自动根据输入数据位深度输出相应的 TIFF
-          // 注意：不要设置 bitdepth 参数，让 sharp 自动处理
-          buffer = await sharpInput
-            .tiff({
-              compression: options.compression || 'lzw'
-              // 不设置 bitdepth，让 sharp 根据输入自动选择
-            })
-            .toBuffer();
-        } else {
-          buffer = await sharpInput
-            .jpeg({
-              quality: options.quality || 95,
-              progressive: options.progressive || false
-            })
-            .toBuffer();
+        try {
+          if (outputFormat === 'tiff') {
+            // TIFF 输出 - 保持原始位深度
+            // sharp 会自动根据输入数据位深度输出相应的 TIFF
+            // 注意：不要设置 bitdepth 参数，让 sharp 自动处理
+            buffer = await trace.span('encode', 'encode', traceJob, () => sharpInput
+              .tiff({
+                compression: options.compression || 'lzw'
+                // 不设置 bitdepth，让 sharp 根据输入自动选择
+              })
+              .toBuffer());
+          } else {
+            buffer = await trace.span('encode', 'encode', traceJob, () => sharpInput
+              .jpeg({
+                quality: options.quality || 95,
+                progressive: options.progressive || false
+              })
+              .toBuffer());
+          }
+        } finally {
+          if (stripFile) {
+            fs.promises.unlink(stripFile).catch(() => {});
+          }
         }
       } else {
         // lightdrift-libraw
@@ -377,7 +506,7 @@ class RawDecoder {
     }
     
     try {
-      await processor.loadFile(inputPath);
+      await openRawFile(processor, inputPath);
       
       if (isNativeDecoder()) {
         // @filmgallery/libraw-native
@@ -450,7 +579,7 @@ class RawDecoder {
     }
     
     try {
-      await processor.loadFile(inputPath);
+      await openRawFile(processor, inputPath);
       
       if (isNativeDecoder()) {
         // @filmgallery/libraw-native
@@ -479,7 +608,9 @@ class RawDecoder {
           artist: meta.artist,
           software: meta.software,
           flashUsed: meta.flashUsed,
-          orientation: meta.orientation
+          orientation: meta.orientation,
+          // 相机索引信息 (支持情况、X-Trans、多帧等)，未收录时为 null
+          cameraInfo: LibRawNative.lookupCamera(meta.normalizedMake, meta.normalizedModel)
         };
       } else {
         // lightdrift-libraw
@@ -581,15 +712,22 @@ module.exports = rawDecoder;
 module.exports.SUPPORTED_EXTENSIONS = SUPPORTED_EXTENSIONS;
 module.exports.isNativeDecoder = isNativeDecoder;
 module.exports.getDecoderInfo = () => decoderInfo;
-module.exports.isSupportedCamera = (model) => {
+module.exports.isSupportedCamera = (makeOrName, model) => {
   if (LibRawNative && LibRawNative.isSupportedCamera) {
-    return LibRawNative.isSupportedCamera(model);
+    return LibRawNative.isSupportedCamera(makeOrName, model);
   }
   return null; // fallback 模式无法检查
 };
-module.exports.getCameraList = () => {
+module.exports.getCameraList = (options) => {
   if (LibRawNative && LibRawNative.getCameraList) {
-    return LibRawNative.getCameraList();
+    return LibRawNative.getCameraList(options);
   }
   return [];
 };
+// 批量查询相机索引: queries 为 "Make Model" 字符串或 { make, model }
+module.exports.lookupCameras = (queries) => {
+  if (LibRawNative && LibRawNative.lookupCameras) {
+    return LibRawNative.lookupCameras(queries);
+  }
+  return queries.map(() => null);
+};
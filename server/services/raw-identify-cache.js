@@ -0,0 +1,73 @@
+/**
+ * RAW 解析快照缓存
+ *
+ * 保存 @filmgallery/libraw-native 的 identify 快照（解码器、偏移、尺寸、
+ * 黑白电平、色彩矩阵），重复打开同一 RAW 文件时跳过元数据解析。
+ * 快照自身绑定文件大小与修改时间，失效时原生层自动回退到完整解析，
+ * 因此这里只按路径存取，不做额外校验。
+ */
+
+const { runAsync, getAsync } = require('../utils/db-helpers');
+
+// ============================================================================
+// 数据库表初始化
+// ============================================================================
+
+const initTable = `
+CREATE TABLE IF NOT EXISTS raw_identify_cache (
+  path TEXT PRIMARY KEY,
+  snapshot BLOB NOT NULL,
+  updated_at TEXT NOT NULL DEFAULT (datetime('now', 'localtime'))
+)`;
+
+let ready = null;
+
+function ensureTable() {
+  if (!ready) {
+    ready = runAsync(initTable).catch((e) => {
+      console.error('[RawIdentifyCache] Failed to initialize table:', e);
+      ready = null;
+      throw e;
+    });
+  }
+  return ready;
+}
+
+// ============================================================================
+// 服务函数
+// ============================================================================
+
+/**
+ * 读取快照
+ * @param {string} filePath - RAW 文件路径
+ * @returns {Promise<Buffer|null>}
+ */
+async function get(filePath) {
+  try {
+    await ensureTable();
+    const row = await getAsync('SELECT snapshot FROM raw_identify_cache WHERE path = ?', [filePath]);
+    return row ? row.snapshot : null;
+  } catch (e) {
+    return null;
+  }
+}
+
+/**
+ * 写入（覆盖）快照
+ * @param {string} filePath - RAW 文件路径
+ * @param {Buffer} snapshot - processor.getIdentifySnapshot() 的结果
+ */
+async function put(filePath, snapshot) {
+  try {
+    await ensureTable();
+    await runAsync(
+      `INSERT OR REPLACE INTO raw_identify_cache (path, snapshot, updated_at)
+       VALUES (?, ?, datetime('now', 'localtime'))`,
+      [filePath, snapshot]
+    );
+  } catch (e) {
+    console.warn('[RawIdentifyCache] Failed to store snapshot:', e.message);
+  }
+}
+
+module.exports = { get, put };
@@ -0,0 +1,131 @@
+/**
+ * RAW 马赛克缓存
+ *
+ * 保存 @filmgallery/libraw-native 解包后的传感器数据（按实际位深打包、分带 LZ 压缩，
+ * 附带 identify 快照），同一 RAW 文件再次解码时直接载入，跳过相机解码器。
+ * 缓存文件自身绑定 RAW 文件大小与修改时间，失效时原生层自动回退，
+ * 因此这里只按路径命名，并按 LRU 把总大小控制在磁盘预算内。
+ *
+ * 预算由环境变量 RAW_MOSAIC_CACHE_MB 设置（默认 2048，0 关闭缓存）。
+ */
+
+const fs = require('fs');
+const path = require('path');
+const crypto = require('crypto');
+const { localTmpRoot } = require('../config/paths');
+
+const cacheDir = path.join(localTmpRoot, 'raw-mosaic');
+
+const parsedBudget = parseInt(process.env.RAW_MOSAIC_CACHE_MB, 10);
+const budgetBytes = (Number.isFinite(parsedBudget) && parsedBudget >= 0 ? parsedBudget : 2048) * 1024 * 1024;
+
+let pruning = null;
+
+/**
+ * 缓存是否启用
+ * @returns {boolean}
+ */
+function isEnabled() {
+  return budgetBytes > 0;
+}
+
+/**
+ * RAW 文件对应的缓存文件路径
+ * @param {string} filePath - RAW 文件路径
+ * @returns {string}
+ */
+function entryPath(filePath) {
+  const key = crypto.createHash('sha1').update(path.resolve(filePath)).digest('hex');
+  return path.join(cacheDir, `${key}.fgmc`);
+}
+
+/**
+ * 是否值得缓存：未压缩的格式直接读文件与读缓存一样快
+ * @param {Object} processor - 已打开文件的 LibRawProcessor
+ * @returns {boolean}
+ */
+function worthCaching(processor) {
+  try {
+    return !processor.getDecoderInfo().flatData;
+  } catch (e) {
+    return false;
+  }
+}
+
+/**
+ * 标记命中（LRU 按修改时间淘汰）
+ * @param {string} cachePath
+ */
+async function touch(cachePath) {
+  const now = new Date();
+  await fs.promises.utimes(cachePath, now, now).catch(() => {});
+}
+
+/**
+ * 按修改时间淘汰最旧的缓存，直到总大小不超过预算
+ */
+async function prune() {
+  let names;
+  try {
+    names = await fs.promises.readdir(cacheDir);
+  } catch (e) {
+    return;
+  }
+
+  const entries = [];
+  for (const name of names) {
+    if (!name.endsWith('.fgmc')) continue;
+    try {
+      const stat = await fs.promises.stat(path.join(cacheDir, name));
+      entries.push({ name, size: stat.size, mtime: stat.mtimeMs });
+    } catch (e) {
+      // 已被其他进程删除
+    }
+  }
+
+  let total = entries.reduce((sum, e) => sum + e.size, 0);
+  entries.sort((a, b) => a.mtime - b.mtime);
+  for (const entry of entries) {
+    if (total <= budgetBytes) break;
+    await fs.promises.rm(path.join(cacheDir, entry.name), { force: true });
+    total -= entry.size;
+  }
+}
+
+/**
+ * 写入缓存（会先解包），失败时不影响解码
+ * 只等待解包与复制出传感器数据，之后处理器即可继续解码或关闭；
+ * 压缩、写盘与淘汰在后台进行，不阻塞本次解码
+ * @param {Object} processor - 已打开文件的 LibRawProcessor
+ * @param {string} cachePath - entryPath() 的结果
+ */
+async function write(processor, cachePath) {
+  let written;
+  try {
+    await fs.promises.mkdir(cacheDir, { recursive: true });
+    ({ written } = await processor.captureMosaicCache(cachePath));
+  } catch (e) {
+    // 浮点 DNG、带黑电平校准的 Phase One 等不缓存，照常解码
+    return;
+  }
+
+  written.then(async (result) => {
+    if (result.bytes > budgetBytes) {
+      await fs.promises.rm(cachePath, { force: true });
+      return;
+    }
+    // 同一时间只运行一次淘汰
+    if (!pruning) {
+      pruning = prune().catch((e) => {
+        console.warn('[RawMosaicCache] Failed to prune cache:', e.message);
+      }).finally(() => {
+        pruning = null;
+      });
+    }
+    await pruning;
+  }).catch((e) => {
+    console.warn('[RawMosaicCache] Failed to write cache:', e.message);
+  });
+}
+
+module.exports = { isEnabled, entryPath, worthCaching, touch, write };
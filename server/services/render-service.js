@@ -14,6 +14,17 @@ const db = require('../db');
 const { uploadsDir } = require('../config/paths');
 const { buildPipeline } = require('./filmlab-service');
 const { RenderCore, EXPORT_MAX_WIDTH, PREVIEW_MAX_WIDTH_SERVER } = require('../../packages/shared');
+const trace = require('../utils/trace');
+const tiledRender = require('./tiled-render');
+
+// 原生衍生图缩放 (线性光面积平均, 级联); 不可用时回退到 sharp 缩放原始像素
+let LibRawNative = null;
+try {
+  LibRawNative = require('@filmgallery/libraw-native');
+  if (!LibRawNative.isAvailable()) LibRawNative = null;
+} catch (e) {
+  LibRawNative = null;
+}
 
 // ============================================================================
 // 照片查询
@@ -63,16 +74,16 @@ function getSourcePath(photo) {
  * @param {string} [options.format='jpeg'] - 'jpeg' | 'tiff16'
  * @param {number} [options.quality=95] - JPEG 质量 (1-100)
  * @param {number} [options.maxWidth] - 最大宽度 (null = 原尺寸)
- * @returns {Promise<{buffer: Buffer, width: number, height: number, format: string}>}
+ * @param {number} [options.traceJob] - 追踪任务 ID (见 utils/trace)
+ * @param {Array<{width?: number, height?: number, quality?: number}>} [options.derivatives]
+ *        同一次渲染附带输出的缩小 JPEG (预览/缩略图), 按边界框等比缩小, 不放大;
+ *        附带时不走分块渲染
+ * @param {string} [options.outputPath] - tiff16 经分块渲染时直接写入此文件
+ *        (结果带 outputPath, buffer 为 null); 其他情况由调用方写入 buffer
+ * @returns {Promise<{buffer: Buffer|null, width: number, height: number, format: string, outputPath?: string, derivatives?: Array}>}
  */
 async function renderPhoto(options) {
-  const {
-    photoId,
-    params = {},
-    format = 'jpeg',
-    quality = 95,
-    maxWidth = null
-  } = options;
+  const { photoId } = options;
 
   // 获取照片记录
   const photo = await getPhotoRecord(photoId);
@@ -86,6 +97,26 @@ async function renderPhoto(options) {
     throw new Error(`Source file not found for photo: ${photoId}`);
   }
 
+  return renderFile(sourcePath, options);
+}
+
+/**
+ * 渲染源文件 (不查询数据库, renderPhoto 与基准测试共用)
+ * @param {string} sourcePath - 源文件绝对路径
+ * @param {Object} options - 同 renderPhoto (photoId 除外)
+ * @returns {Promise<{buffer: Buffer|null, width: number, height: number, format: string, outputPath?: string, derivatives?: Array}>}
+ */
+async function renderFile(sourcePath, options = {}) {
+  const {
+    params = {},
+    format = 'jpeg',
+    quality = 95,
+    maxWidth = null,
+    derivatives = [],
+    outputPath = null,
+    traceJob = trace.isEnabled() ? trace.newJobId() : 0
+  } = options;
+
   // 构建几何变换管道 (旋转、裁剪、缩放)
   let img = await buildPipeline(sourcePath, params, {
     maxWidth: maxWidth || EXPORT_MAX_WIDTH,
@@ -94,11 +125,21 @@ async function renderPhoto(options) {
     skipColorOps: true
   });
 
+  // 原生分块渲染: 内存与图像尺寸无关; 失败时回退到下方的内存路径
+  // (附带衍生图时走内存路径, 衍生图从渲染像素直接缩小, 不解码刚编码的输出)
+  if (tiledRender.isAvailable() && !derivatives.length) {
+    try {
+      return await renderTiledFile(img.clone(), params, { format, quality, outputPath, traceJob });
+    } catch (err) {
+      console.warn(`[RenderService] Tiled render failed, using in-memory path: ${err.message}`);
+    }
+  }
+
   // 获取原始像素数据
   // sharp 在仅应用几何变换（rotate/resize/crop）时会保留源数据的原始位深。
   // 当输入为 16-bit TIFF（RAW 解码产物）时，.raw() 输出也是 16-bit。
   // 通过 buffer 大小检测实际位深（比依赖 info.depth 更可靠）。
-  const { data, info } = await img.raw().toBuffer({ resolveWithObject: true });
+  const { data, info } = await trace.span('read', 'io', traceJob, () => img.raw().toBuffer({ resolveWithObject: true }));
   const width = info.width;
   const height = info.height;
   const channels = info.channels;
@@ -115,6 +156,8 @@ async function renderPhoto(options) {
 
   // 根据输出格式选择处理方式
   let outputBuffer;
+  let derivativeOutputs;
+  const renderStart = trace.begin();
 
   if (format === 'tiff16') {
     // 16-bit TIFF Export - Float Pipeline for maximum quality
@@ -158,10 +201,14 @@ async function renderPhoto(options) {
       raw16[j16++] = bOut & 0xFF;
       raw16[j16++] = (bOut >> 8) & 0xFF;
     }
-
-    outputBuffer = await sharp(raw16, { raw: { width, height, channels: 3, depth: 'ushort' } })
-      .tiff({ compression: 'lzw', bitdepth: 16 })
-      .toBuffer();
+    trace.end('render', 'render', traceJob, renderStart);
+
+    [outputBuffer, derivativeOutputs] = await Promise.all([
+      trace.span('encode', 'encode', traceJob, () => sharp(raw16, { raw: { width, height, channels: 3, depth: 'ushort' } })
+        .tiff({ compression: 'lzw', bitdepth: 16 })
+        .toBuffer()),
+      encodeDerivatives(raw16, width, height, 16, derivatives, traceJob)
+    ]);
   } else {
     // 8-bit JPEG — Float pipeline for CPU/GPU consistency
     // Even though output is 8-bit, using processPixelFloat ensures identical
@@ -192,18 +239,86 @@ async function renderPhoto(options) {
       out[j + 1] = Math.min(255, Math.max(0, Math.round(gF * 255)));
       out[j + 2] = Math.min(255, Math.max(0, Math.round(bF * 255)));
     }
-
-    outputBuffer = await sharp(out, { raw: { width, height, channels: 3 } })
-      .jpeg({ quality })
-      .toBuffer();
+    trace.end('render', 'render', traceJob, renderStart);
+
+    [outputBuffer, derivativeOutputs] = await Promise.all([
+      trace.span('encode', 'encode', traceJob, () => sharp(out, { raw: { width, height, channels: 3 } })
+        .jpeg({ quality })
+        .toBuffer()),
+      encodeDerivatives(out, width, height, 8, derivatives, traceJob)
+    ]);
   }
 
-  return {
+  const result = {
     buffer: outputBuffer,
     width,
     height,
     format
   };
+  if (derivatives.length) result.derivatives = derivativeOutputs;
+  return result;
+}
+
+/**
+ * 分块渲染几何变换后的管线 (不生成衍生图)
+ * @param {import('sharp').Sharp} pipeline - buildPipeline 结果 (仅几何变换)
+ * @param {Object} params - FilmLab 处理参数
+ * @param {Object} options - format / quality / outputPath / traceJob (同 renderFile)
+ * @returns {Promise<{buffer: Buffer|null, width: number, height: number, format: string, outputPath?: string}>}
+ */
+async function renderTiledFile(pipeline, params, options) {
+  const { format, quality, outputPath, traceJob } = options;
+  const core = new RenderCore(params);
+  core.prepareLUTs();
+
+  const rendered = await tiledRender.renderPipeline(pipeline, core, { format, quality, outputPath, traceJob });
+  const result = {
+    buffer: rendered.buffer,
+    width: rendered.width,
+    height: rendered.height,
+    format
+  };
+  if (rendered.outputPath) result.outputPath = rendered.outputPath;
+  return result;
+}
+
+/**
+ * 从渲染后的原始像素生成缩小 JPEG (不再解码刚编码的全尺寸图)
+ * 原生模块可用时一次级联缩放出所有尺寸, 各尺寸并发编码
+ * @param {Buffer} pixels - RGB 像素 (16 位为小端)
+ * @param {number} width
+ * @param {number} height
+ * @param {number} bits - 8 | 16
+ * @param {Array<{width?: number, height?: number, quality?: number}>} specs
+ * @param {number} traceJob
+ * @returns {Promise<Array<{buffer: Buffer, width: number, height: number}>>}
+ */
+async function encodeDerivatives(pixels, width, height, bits, specs, traceJob) {
+  if (!specs.length) return [];
+  const depth = bits === 16 ? 'ushort' : 'uchar';
+
+  let images;
+  if (LibRawNative) {
+    images = await trace.span('derivatives', 'render', traceJob, () => LibRawNative.buildDerivatives(pixels, {
+      width, height, channels: 3, bits,
+      sizes: specs.map(spec => ({ width: spec.width || 0, height: spec.height || 0 })),
+      jobId: traceJob
+    }));
+  } else {
+    images = specs.map(() => ({ data: pixels, width, height }));
+  }
+
+  return Promise.all(specs.map((spec, i) => {
+    const image = images[i];
+    let pipeline = sharp(image.data, { raw: { width: image.width, height: image.height, channels: 3, depth } });
+    if (!LibRawNative) {
+      pipeline = pipeline.resize({ width: spec.width, height: spec.height, fit: 'inside', withoutEnlargement: true });
+    }
+    return trace.span('encode_derivative', 'encode', traceJob, () => pipeline
+      .jpeg({ quality: spec.quality || 80 })
+      .toBuffer({ resolveWithObject: true }))
+      .then(({ data, info }) => ({ buffer: data, width: info.width, height: info.height }));
+  }));
 }
 
 /**
@@ -219,12 +334,13 @@ async function renderToLibrary(photoId, params) {
     throw new Error(`Photo not found: ${photoId}`);
   }
 
-  // 渲染照片
+  // 渲染照片 (缩略图从同一次渲染的像素生成)
   const result = await renderPhoto({
     photoId,
     params,
     format: 'jpeg',
-    quality: 95
+    quality: 95,
+    derivatives: [{ width: 400, quality: 80 }]
   });
 
   // 确定输出目录
@@ -251,10 +367,7 @@ async function renderToLibrary(photoId, params) {
   const thumbName = `${base}_thumb.jpg`;
   const thumbPath = path.join(thumbDir, thumbName);
   
-  await sharp(result.buffer)
-    .resize({ width: 400, fit: 'inside', withoutEnlargement: true })
-    .jpeg({ quality: 80 })
-    .toFile(thumbPath);
+  fs.writeFileSync(thumbPath, result.derivatives[0].buffer);
   
   const relThumb = path.relative(uploadsDir, thumbPath).replace(/\\/g, '/');
 
@@ -295,15 +408,6 @@ async function renderToDirectory(photoId, params, outputDir, filename = null, op
     throw new Error(`Photo not found: ${photoId}`);
   }
 
-  // 渲染照片
-  const result = await renderPhoto({
-    photoId,
-    params,
-    format,
-    quality,
-    maxWidth
-  });
-
   // 确保输出目录存在
   if (!fs.existsSync(outputDir)) {
     fs.mkdirSync(outputDir, { recursive: true });
@@ -321,8 +425,20 @@ async function renderToDirectory(photoId, params, outputDir, filename = null, op
 
   const outPath = path.join(outputDir, outName);
 
+  // 渲染照片 (分块渲染的 tiff16 直接写入 outPath)
+  const result = await renderPhoto({
+    photoId,
+    params,
+    format,
+    quality,
+    maxWidth,
+    outputPath: outPath
+  });
+
   // 保存文件
-  fs.writeFileSync(outPath, result.buffer);
+  if (!result.outputPath) {
+    fs.writeFileSync(outPath, result.buffer);
+  }
 
   return {
     outputPath: outPath
@@ -385,6 +501,7 @@ function mergeParams(baseParams = {}, overrides = {}) {
 module.exports = {
   // 核心渲染
   renderPhoto,
+  renderFile,
   renderToLibrary,
   renderToDirectory,
   
@@ -83,6 +83,35 @@ async function generatePositiveThumb(sourceAbsPath, rollId, frameNumber) {
   return { absPath, relPath };
 }
 
+/**
+ * Write (or overwrite) a positive thumbnail from already rendered pixels,
+ * e.g. a roll-wide preview batch.
+ *
+ * @param {Buffer} data            – Interleaved 8-bit RGB
+ * @param {number} width
+ * @param {number} height
+ * @param {number|string} rollId
+ * @param {string} frameNumber     – e.g. "03"
+ * @returns {Promise<{ absPath: string, relPath: string }>}  Generated thumb paths
+ */
+async function writePositiveThumb(data, width, height, rollId, frameNumber) {
+  const { dir, absPath, relPath } = positiveThumbPaths(rollId, frameNumber);
+
+  if (!fs.existsSync(dir)) fs.mkdirSync(dir, { recursive: true });
+
+  // Remove stale file to avoid Windows locking issues
+  if (fs.existsSync(absPath)) {
+    try { fs.unlinkSync(absPath); } catch (_) { /* ignore */ }
+  }
+
+  await sharp(data, { raw: { width, height, channels: 3 } })
+    .resize({ width: THUMB_WIDTH, height: THUMB_HEIGHT, fit: THUMB_FIT })
+    .jpeg({ quality: THUMB_QUALITY })
+    .toFile(absPath);
+
+  return { absPath, relPath };
+}
+
 /**
  * Clean up an old thumbnail file if the path is different from the current one.
  *
@@ -113,5 +142,6 @@ module.exports = {
 
   // Generation
   generatePositiveThumb,
+  writePositiveThumb,
   cleanupOldThumb,
 };
@@ -0,0 +1,123 @@
+/**
+ * 分块渲染 - 大尺寸扫描的有界内存导出
+ *
+ * @module tiled-render
+ * @description sharp 只做几何变换 (旋转/缩放/裁剪), 结果写成未压缩的分块 TIFF 缓存;
+ * 原生模块映射该缓存, 在线程池上逐带运行 FilmLab 内核, 完成的行直接送入 JPEG 编码器
+ * 或逐条写入 16 位 TIFF。内存只与带高和线程数有关, 与图像尺寸无关
+ * (旧路径需要完整的 raw() 像素、完整的输出缓冲区以及 sharp 编码时的再一份拷贝)。
+ */
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const trace = require('../utils/trace');
+
+// 原生分块渲染; 不可用时调用方回退到内存路径
+let LibRawNative = null;
+try {
+  LibRawNative = require('@filmgallery/libraw-native');
+  if (!LibRawNative.isAvailable() || !LibRawNative.renderTiled) LibRawNative = null;
+} catch (e) {
+  LibRawNative = null;
+}
+
+/** 缓存分块尺寸 (TIFF 要求为 16 的倍数) */
+const CACHE_TILE_SIZE = 256;
+
+let cacheCounter = 0;
+
+/**
+ * 原生分块渲染是否可用
+ * @returns {boolean}
+ */
+function isAvailable() {
+  return !!LibRawNative;
+}
+
+/**
+ * 临时文件路径 (系统临时目录, 进程内唯一)
+ * @param {string} suffix
+ * @returns {string}
+ */
+function tempPath(suffix) {
+  cacheCounter += 1;
+  return path.join(os.tmpdir(), `filmgallery-render-${process.pid}-${cacheCounter}${suffix}`);
+}
+
+/**
+ * 裁剪比例 → 像素区域 (与导出队列的 _applyCrop 取整一致, 并限制在图像内)
+ * @param {{x: number, y: number, w: number, h: number}|null} cropRect
+ * @param {number} width
+ * @param {number} height
+ * @returns {{left: number, top: number, width: number, height: number}|undefined}
+ */
+function cropRegion(cropRect, width, height) {
+  if (!cropRect) return undefined;
+  const left = Math.max(0, Math.min(width - 1, Math.round((cropRect.x || 0) * width)));
+  const top = Math.max(0, Math.min(height - 1, Math.round((cropRect.y || 0) * height)));
+  const w = Math.min(width - left, Math.round((cropRect.w || 0) * width));
+  const h = Math.min(height - top, Math.round((cropRect.h || 0) * height));
+  return w > 0 && h > 0 ? { left, top, width: w, height: h } : undefined;
+}
+
+/**
+ * 渲染几何变换后的 sharp 管线
+ * @param {import('sharp').Sharp} pipeline - 仅含几何变换的管线 (会被写入缓存, 调用方如需复用请传 clone())
+ * @param {Object} core - RenderCore 实例
+ * @param {Object} [options]
+ * @param {string} [options.format='jpeg'] - 'jpeg' | 'tiff16'
+ * @param {number} [options.quality=95] - JPEG 质量
+ * @param {Object} [options.cropRect] - 渲染后尺寸上的裁剪比例 {x, y, w, h}
+ * @param {string} [options.outputPath] - tiff16 直接写入此文件 (返回 buffer 为 null)
+ * @param {number} [options.traceJob=0] - 追踪任务 ID
+ * @returns {Promise<{buffer: Buffer|null, width: number, height: number, sourceBits: number, outputPath?: string}>}
+ */
+async function renderPipeline(pipeline, core, options = {}) {
+  const {
+    format = 'jpeg',
+    quality = 95,
+    cropRect = null,
+    outputPath = null,
+    traceJob = 0
+  } = options;
+  if (!LibRawNative) {
+    throw new Error('Native tiled render not available');
+  }
+
+  const cachePath = tempPath('.tif');
+  const tempOutput = format === 'tiff16' && !outputPath ? tempPath('-out.tif') : null;
+  try {
+    // 未压缩 TIFF 保留源位深 (RAW 解码产物为 16 位), 原生端按位深读取
+    const info = await trace.span('read', 'io', traceJob, () => pipeline
+      .tiff({ compression: 'none', tile: true, tileWidth: CACHE_TILE_SIZE, tileHeight: CACHE_TILE_SIZE })
+      .toFile(cachePath));
+
+    const result = await LibRawNative.renderTiled(cachePath, core.getNativeStages(16), {
+      format,
+      quality,
+      outputPath: format === 'tiff16' ? (outputPath || tempOutput) : undefined,
+      region: cropRegion(cropRect, info.width, info.height),
+      jobId: traceJob
+    });
+
+    const rendered = { buffer: null, width: result.width, height: result.height, sourceBits: result.sourceBits };
+    if (format !== 'tiff16') {
+      rendered.buffer = result.data;
+    } else if (tempOutput) {
+      rendered.buffer = await fs.promises.readFile(tempOutput);
+    } else {
+      rendered.outputPath = outputPath;
+    }
+    return rendered;
+  } finally {
+    await fs.promises.rm(cachePath, { force: true });
+    if (tempOutput) await fs.promises.rm(tempOutput, { force: true });
+  }
+}
+
+module.exports = {
+  isAvailable,
+  renderPipeline,
+  cropRegion
+};
@@ -0,0 +1,53 @@
+// Opt-in pipeline tracer (Chrome trace-event JSON, viewable in chrome://tracing / Perfetto)
+// Native decode spans come from @filmgallery/libraw-native; JS stages (read, render,
+// encode) are recorded into the same buffer so one timeline covers the whole export.
+// Enable with LIBRAW_NATIVE_TRACE=1 or POST /api/_trace {"enabled": true}.
+let native = null;
+// Largest ring buffer the native tracer allocates, in spans
+let MAX_CAPACITY = 0;
+try {
+  const mod = require('@filmgallery/libraw-native');
+  MAX_CAPACITY = mod.TRACE_MAX_CAPACITY;
+  if (mod.isAvailable()) native = mod;
+} catch (_) {}
+
+let nextJobId = 1;
+
+function isEnabled() {
+  return !!native && native.isTracingEnabled();
+}
+
+// Numeric id used to filter a single job out of the trace
+function newJobId() {
+  return nextJobId++;
+}
+
+// Measure fn (sync or async) as a span; a plain call when tracing is off
+function span(name, category, jobId, fn) {
+  if (!isEnabled()) return fn();
+  return native.traceSpan(name, category, jobId || 0, fn);
+}
+
+// Manual start/end pair for synchronous loops: const t = trace.begin(); ...; trace.end('render', 'render', jobId, t)
+function begin() {
+  return isEnabled() ? native.traceNow() : 0;
+}
+
+function end(name, category, jobId, start) {
+  if (!start || !isEnabled()) return;
+  native.recordTraceSpan(name, category, start, native.traceNow(), jobId || 0);
+}
+
+function setEnabled(enabled, capacity) {
+  if (!native) return false;
+  if (enabled) native.enableTracing({ capacity });
+  else native.disableTracing();
+  return true;
+}
+
+function dump(options = {}) {
+  if (!native) return { traceEvents: [], displayTimeUnit: 'ms' };
+  return native.dumpTrace(options);
+}
+
+module.exports = { isEnabled, newJobId, span, begin, end, setEnabled, dump, MAX_CAPACITY, available: () => !!native };